@@ -0,0 +1,440 @@
+//
+//  PBJAudioMeter.c
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include "PBJAudioMeter.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// the vector kernels keep four lanes of running peak, sum of squares and clip count.
+// lane i always holds channel i % channelCount, which is only true when the channel
+// count divides four, other layouts take the scalar path
+
+#define PBJ_AUDIO_METER_BAND_VECTORS (PBJAudioMeterMaximumBands / 4)
+
+static const float PBJAudioMeterInt16Scale = 1.0f / 32768.0f;
+static const double PBJAudioMeterPi = 3.14159265358979323846;
+
+// keeps the band filters out of denormals on silence, removed again by the band-pass
+static const float PBJAudioMeterAntiDenormal = 1e-18f;
+
+typedef struct {
+    float peak[4];
+    float sumSquares[4];
+    uint64_t clipped;
+} PBJAudioMeterLanes;
+
+struct PBJAudioMeter {
+    PBJAudioMeterConfiguration configuration;
+
+    // window
+    uint64_t frames;
+    float peak[PBJAudioMeterMaximumChannels];
+    double sumSquares[PBJAudioMeterMaximumChannels];
+    uint64_t clipped;
+    double bandSumSquares[PBJAudioMeterMaximumBands];
+
+    // band-pass biquads, transposed direct form II with b1 = 0 and b2 = -b0, unused lanes are zero
+    float bandFrequencies[PBJAudioMeterMaximumBands];
+    float b0[PBJAudioMeterMaximumBands];
+    float a1[PBJAudioMeterMaximumBands];
+    float a2[PBJAudioMeterMaximumBands];
+    float z1[PBJAudioMeterMaximumBands];
+    float z2[PBJAudioMeterMaximumBands];
+};
+
+PBJAudioMeterConfiguration PBJAudioMeterDefaultConfiguration(double sampleRate, uint32_t channelCount)
+{
+    PBJAudioMeterConfiguration configuration;
+    configuration.sampleRate = sampleRate;
+    configuration.channelCount = channelCount;
+    configuration.bandCount = 0;
+    configuration.minimumBandFrequency = 63.0;
+    configuration.maximumBandFrequency = 12000.0;
+    configuration.clipLevel = 32767.0f / 32768.0f;
+    return configuration;
+}
+
+#pragma mark - scalar
+
+static void PBJAudioMeterLevelsScalar(const void *samples, PBJAudioSampleFormat format, size_t begin, size_t end,
+                                      uint32_t channelCount, float clipLevel, float *peak, double *sumSquares, uint64_t *clipped)
+{
+    const int16_t *int16Samples = (const int16_t *)samples;
+    const float *floatSamples = (const float *)samples;
+
+    for (size_t i = begin; i < end; i++) {
+        float value = (format == PBJAudioSampleFormatInt16) ? (float)int16Samples[i] * PBJAudioMeterInt16Scale : floatSamples[i];
+        float magnitude = fabsf(value);
+        uint32_t channel = (uint32_t)(i % channelCount);
+        if (magnitude > peak[channel]) {
+            peak[channel] = magnitude;
+        }
+        sumSquares[channel] += (double)value * (double)value;
+        if (magnitude >= clipLevel) {
+            (*clipped)++;
+        }
+    }
+}
+
+static void PBJAudioMeterBandsScalar(PBJAudioMeter *meter, float mix, float *bandSumSquares)
+{
+    for (uint32_t band = 0; band < meter->configuration.bandCount; band++) {
+        float y = meter->b0[band] * mix + meter->z1[band];
+        meter->z1[band] = meter->z2[band] - meter->a1[band] * y;
+        meter->z2[band] = -meter->b0[band] * mix - meter->a2[band] * y;
+        bandSumSquares[band] += y * y;
+    }
+}
+
+#pragma mark - SSE2
+
+#if PBJ_SIMD_SSE2
+
+static inline void PBJAudioMeterAccumulateSSE2(__m128 value, __m128 clipLevel, __m128 *peak, __m128 *sumSquares, uint64_t *clipped)
+{
+    const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    __m128 magnitude = _mm_and_ps(value, absMask);
+    *peak = _mm_max_ps(*peak, magnitude);
+    *sumSquares = _mm_add_ps(*sumSquares, _mm_mul_ps(value, value));
+    *clipped += (uint64_t)__builtin_popcount((unsigned)_mm_movemask_ps(_mm_cmpge_ps(magnitude, clipLevel)));
+}
+
+static size_t PBJAudioMeterLevelsSSE2(const void *samples, PBJAudioSampleFormat format, size_t count, float clip, PBJAudioMeterLanes *lanes)
+{
+    __m128 peak = _mm_setzero_ps();
+    __m128 sumSquares = _mm_setzero_ps();
+    const __m128 clipLevel = _mm_set1_ps(clip);
+    uint64_t clipped = 0;
+    size_t i = 0;
+
+    if (format == PBJAudioSampleFormatInt16) {
+        const int16_t *source = (const int16_t *)samples;
+        const __m128 scale = _mm_set1_ps(PBJAudioMeterInt16Scale);
+        for (; i + 8 <= count; i += 8) {
+            __m128i packed = _mm_loadu_si128((const __m128i *)(source + i));
+            // sign extend by moving each sample into the high half and shifting back
+            __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(packed, packed), 16);
+            __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(packed, packed), 16);
+            PBJAudioMeterAccumulateSSE2(_mm_mul_ps(_mm_cvtepi32_ps(lo), scale), clipLevel, &peak, &sumSquares, &clipped);
+            PBJAudioMeterAccumulateSSE2(_mm_mul_ps(_mm_cvtepi32_ps(hi), scale), clipLevel, &peak, &sumSquares, &clipped);
+        }
+    } else {
+        const float *source = (const float *)samples;
+        for (; i + 4 <= count; i += 4) {
+            PBJAudioMeterAccumulateSSE2(_mm_loadu_ps(source + i), clipLevel, &peak, &sumSquares, &clipped);
+        }
+    }
+
+    _mm_storeu_ps(lanes->peak, peak);
+    _mm_storeu_ps(lanes->sumSquares, sumSquares);
+    lanes->clipped = clipped;
+    return i;
+}
+
+static void PBJAudioMeterBandsSSE2(PBJAudioMeter *meter, float mix, __m128 *bandSumSquares)
+{
+    __m128 x = _mm_set1_ps(mix);
+    for (int v = 0; v < PBJ_AUDIO_METER_BAND_VECTORS; v++) {
+        __m128 b0 = _mm_loadu_ps(meter->b0 + v * 4);
+        __m128 a1 = _mm_loadu_ps(meter->a1 + v * 4);
+        __m128 a2 = _mm_loadu_ps(meter->a2 + v * 4);
+        __m128 z1 = _mm_loadu_ps(meter->z1 + v * 4);
+        __m128 z2 = _mm_loadu_ps(meter->z2 + v * 4);
+
+        __m128 bx = _mm_mul_ps(b0, x);
+        __m128 y = _mm_add_ps(bx, z1);
+        _mm_storeu_ps(meter->z1 + v * 4, _mm_sub_ps(z2, _mm_mul_ps(a1, y)));
+        _mm_storeu_ps(meter->z2 + v * 4, _mm_sub_ps(_mm_sub_ps(_mm_setzero_ps(), bx), _mm_mul_ps(a2, y)));
+        bandSumSquares[v] = _mm_add_ps(bandSumSquares[v], _mm_mul_ps(y, y));
+    }
+}
+
+#endif
+
+#pragma mark - NEON
+
+#if PBJ_SIMD_NEON
+
+static inline void PBJAudioMeterAccumulateNEON(float32x4_t value, float32x4_t clipLevel, float32x4_t *peak, float32x4_t *sumSquares, uint32x4_t *clipped)
+{
+    float32x4_t magnitude = vabsq_f32(value);
+    *peak = vmaxq_f32(*peak, magnitude);
+    *sumSquares = vaddq_f32(*sumSquares, vmulq_f32(value, value));
+    // a set mask lane is all ones, subtracting it counts one
+    *clipped = vsubq_u32(*clipped, vcgeq_f32(magnitude, clipLevel));
+}
+
+static size_t PBJAudioMeterLevelsNEON(const void *samples, PBJAudioSampleFormat format, size_t count, float clip, PBJAudioMeterLanes *lanes)
+{
+    float32x4_t peak = vdupq_n_f32(0.0f);
+    float32x4_t sumSquares = vdupq_n_f32(0.0f);
+    const float32x4_t clipLevel = vdupq_n_f32(clip);
+    uint32x4_t clipped = vdupq_n_u32(0);
+    size_t i = 0;
+
+    if (format == PBJAudioSampleFormatInt16) {
+        const int16_t *source = (const int16_t *)samples;
+        const float32x4_t scale = vdupq_n_f32(PBJAudioMeterInt16Scale);
+        for (; i + 8 <= count; i += 8) {
+            int16x8_t packed = vld1q_s16(source + i);
+            float32x4_t lo = vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(packed))), scale);
+            float32x4_t hi = vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(packed))), scale);
+            PBJAudioMeterAccumulateNEON(lo, clipLevel, &peak, &sumSquares, &clipped);
+            PBJAudioMeterAccumulateNEON(hi, clipLevel, &peak, &sumSquares, &clipped);
+        }
+    } else {
+        const float *source = (const float *)samples;
+        for (; i + 4 <= count; i += 4) {
+            PBJAudioMeterAccumulateNEON(vld1q_f32(source + i), clipLevel, &peak, &sumSquares, &clipped);
+        }
+    }
+
+    uint32_t clippedLanes[4];
+    vst1q_f32(lanes->peak, peak);
+    vst1q_f32(lanes->sumSquares, sumSquares);
+    vst1q_u32(clippedLanes, clipped);
+    lanes->clipped = (uint64_t)clippedLanes[0] + clippedLanes[1] + clippedLanes[2] + clippedLanes[3];
+    return i;
+}
+
+static void PBJAudioMeterBandsNEON(PBJAudioMeter *meter, float mix, float32x4_t *bandSumSquares)
+{
+    float32x4_t x = vdupq_n_f32(mix);
+    for (int v = 0; v < PBJ_AUDIO_METER_BAND_VECTORS; v++) {
+        float32x4_t b0 = vld1q_f32(meter->b0 + v * 4);
+        float32x4_t a1 = vld1q_f32(meter->a1 + v * 4);
+        float32x4_t a2 = vld1q_f32(meter->a2 + v * 4);
+        float32x4_t z1 = vld1q_f32(meter->z1 + v * 4);
+        float32x4_t z2 = vld1q_f32(meter->z2 + v * 4);
+
+        // separate multiply and add, a fused multiply-add would drift from the scalar path
+        float32x4_t bx = vmulq_f32(b0, x);
+        float32x4_t y = vaddq_f32(bx, z1);
+        vst1q_f32(meter->z1 + v * 4, vsubq_f32(z2, vmulq_f32(a1, y)));
+        vst1q_f32(meter->z2 + v * 4, vsubq_f32(vnegq_f32(bx), vmulq_f32(a2, y)));
+        bandSumSquares[v] = vaddq_f32(bandSumSquares[v], vmulq_f32(y, y));
+    }
+}
+
+#endif
+
+#pragma mark - meter
+
+static void PBJAudioMeterSetupBands(PBJAudioMeter *meter)
+{
+    PBJAudioMeterConfiguration *configuration = &meter->configuration;
+    if (configuration->bandCount == 0)
+        return;
+
+    double nyquist = configuration->sampleRate * 0.5;
+    double maximum = fmin(configuration->maximumBandFrequency, nyquist * 0.9);
+    double minimum = fmax(fmin(configuration->minimumBandFrequency, maximum), 1.0);
+    uint32_t count = configuration->bandCount;
+
+    // bands an octave ratio apart get a one octave bandwidth, and so on
+    double ratio = count > 1 ? pow(maximum / minimum, 1.0 / (double)(count - 1)) : 2.0;
+    double octaves = fmax(log2(ratio), 0.1);
+    double q = sqrt(pow(2.0, octaves)) / (pow(2.0, octaves) - 1.0);
+
+    for (uint32_t band = 0; band < count; band++) {
+        double frequency = count > 1 ? minimum * pow(ratio, (double)band) : sqrt(minimum * maximum);
+        double w0 = 2.0 * PBJAudioMeterPi * frequency / configuration->sampleRate;
+        double alpha = sin(w0) / (2.0 * q);
+        double a0 = 1.0 + alpha;
+
+        meter->bandFrequencies[band] = (float)frequency;
+        meter->b0[band] = (float)(alpha / a0);
+        meter->a1[band] = (float)(-2.0 * cos(w0) / a0);
+        meter->a2[band] = (float)((1.0 - alpha) / a0);
+    }
+}
+
+PBJAudioMeter *PBJAudioMeterCreate(const PBJAudioMeterConfiguration *configuration)
+{
+    if (!configuration || configuration->sampleRate <= 0 || configuration->channelCount == 0 ||
+        configuration->channelCount > PBJAudioMeterMaximumChannels || configuration->bandCount > PBJAudioMeterMaximumBands)
+        return NULL;
+
+    PBJAudioMeter *meter = (PBJAudioMeter *)calloc(1, sizeof(PBJAudioMeter));
+    if (!meter)
+        return NULL;
+
+    meter->configuration = *configuration;
+    PBJAudioMeterSetupBands(meter);
+    return meter;
+}
+
+void PBJAudioMeterDestroy(PBJAudioMeter *meter)
+{
+    free(meter);
+}
+
+static inline float PBJAudioMeterMix(const void *samples, PBJAudioSampleFormat format, size_t frame, uint32_t channelCount)
+{
+    float mix = 0.0f;
+    for (uint32_t channel = 0; channel < channelCount; channel++) {
+        size_t index = frame * channelCount + channel;
+        mix += (format == PBJAudioSampleFormatInt16) ? (float)((const int16_t *)samples)[index] : ((const float *)samples)[index];
+    }
+    return mix;
+}
+
+static void PBJAudioMeterProcessBands(PBJAudioMeter *meter, const void *samples, size_t frameCount,
+                                      PBJAudioSampleFormat format, PBJSIMDLevel level)
+{
+    uint32_t channelCount = meter->configuration.channelCount;
+    float mixScale = (format == PBJAudioSampleFormatInt16 ? PBJAudioMeterInt16Scale : 1.0f) / (float)channelCount;
+    float bandSumSquares[PBJAudioMeterMaximumBands] = { 0 };
+
+    switch (level) {
+#if PBJ_SIMD_SSE2
+        case PBJSIMDLevelSSE2:
+        {
+            __m128 vectorSumSquares[PBJ_AUDIO_METER_BAND_VECTORS] = { _mm_setzero_ps(), _mm_setzero_ps() };
+            for (size_t frame = 0; frame < frameCount; frame++) {
+                float mix = PBJAudioMeterMix(samples, format, frame, channelCount) * mixScale + PBJAudioMeterAntiDenormal;
+                PBJAudioMeterBandsSSE2(meter, mix, vectorSumSquares);
+            }
+            _mm_storeu_ps(bandSumSquares, vectorSumSquares[0]);
+            _mm_storeu_ps(bandSumSquares + 4, vectorSumSquares[1]);
+            break;
+        }
+#endif
+#if PBJ_SIMD_NEON
+        case PBJSIMDLevelNEON:
+        {
+            float32x4_t vectorSumSquares[PBJ_AUDIO_METER_BAND_VECTORS] = { vdupq_n_f32(0.0f), vdupq_n_f32(0.0f) };
+            for (size_t frame = 0; frame < frameCount; frame++) {
+                float mix = PBJAudioMeterMix(samples, format, frame, channelCount) * mixScale + PBJAudioMeterAntiDenormal;
+                PBJAudioMeterBandsNEON(meter, mix, vectorSumSquares);
+            }
+            vst1q_f32(bandSumSquares, vectorSumSquares[0]);
+            vst1q_f32(bandSumSquares + 4, vectorSumSquares[1]);
+            break;
+        }
+#endif
+        default:
+            for (size_t frame = 0; frame < frameCount; frame++) {
+                float mix = PBJAudioMeterMix(samples, format, frame, channelCount) * mixScale + PBJAudioMeterAntiDenormal;
+                PBJAudioMeterBandsScalar(meter, mix, bandSumSquares);
+            }
+            break;
+    }
+
+    for (uint32_t band = 0; band < meter->configuration.bandCount; band++) {
+        meter->bandSumSquares[band] += bandSumSquares[band];
+    }
+}
+
+void PBJAudioMeterProcess(PBJAudioMeter *meter, const void *samples, size_t frameCount,
+                          PBJAudioSampleFormat format, PBJSIMDLevel level)
+{
+    if (!meter || !samples || frameCount == 0)
+        return;
+
+    uint32_t channelCount = meter->configuration.channelCount;
+    size_t count = frameCount * channelCount;
+
+    // four lanes is all either kernel needs
+    PBJSIMDLevel resolved = PBJSIMDLevelResolve(level);
+    if (resolved == PBJSIMDLevelAVX2) {
+        resolved = PBJSIMDLevelSSE2;
+    }
+    PBJSIMDLevel levelsLevel = (4 % channelCount == 0) ? resolved : PBJSIMDLevelScalar;
+
+    PBJAudioMeterLanes lanes;
+    memset(&lanes, 0, sizeof(lanes));
+    size_t i = 0;
+    switch (levelsLevel) {
+#if PBJ_SIMD_SSE2
+        case PBJSIMDLevelSSE2:
+            i = PBJAudioMeterLevelsSSE2(samples, format, count, meter->configuration.clipLevel, &lanes);
+            break;
+#endif
+#if PBJ_SIMD_NEON
+        case PBJSIMDLevelNEON:
+            i = PBJAudioMeterLevelsNEON(samples, format, count, meter->configuration.clipLevel, &lanes);
+            break;
+#endif
+        default:
+            break;
+    }
+    if (i > 0) {
+        for (uint32_t lane = 0; lane < 4; lane++) {
+            uint32_t channel = lane % channelCount;
+            if (lanes.peak[lane] > meter->peak[channel]) {
+                meter->peak[channel] = lanes.peak[lane];
+            }
+            meter->sumSquares[channel] += lanes.sumSquares[lane];
+        }
+        meter->clipped += lanes.clipped;
+    }
+    PBJAudioMeterLevelsScalar(samples, format, i, count, channelCount, meter->configuration.clipLevel,
+                              meter->peak, meter->sumSquares, &meter->clipped);
+    meter->frames += frameCount;
+
+    if (meter->configuration.bandCount > 0) {
+        PBJAudioMeterProcessBands(meter, samples, frameCount, format, resolved);
+    }
+}
+
+void PBJAudioMeterRead(PBJAudioMeter *meter, PBJAudioLevels *levels)
+{
+    if (!meter || !levels)
+        return;
+
+    memset(levels, 0, sizeof(PBJAudioLevels));
+    levels->frames = meter->frames;
+    levels->channelCount = meter->configuration.channelCount;
+    levels->clippedSamples = meter->clipped;
+    levels->bandCount = meter->configuration.bandCount;
+
+    double frames = meter->frames > 0 ? (double)meter->frames : 1.0;
+    for (uint32_t channel = 0; channel < levels->channelCount; channel++) {
+        levels->peak[channel] = meter->peak[channel];
+        levels->rms[channel] = (float)sqrt(meter->sumSquares[channel] / frames);
+    }
+    for (uint32_t band = 0; band < levels->bandCount; band++) {
+        levels->bandFrequencies[band] = meter->bandFrequencies[band];
+        levels->bandRMS[band] = (float)sqrt(meter->bandSumSquares[band] / frames);
+    }
+
+    meter->frames = 0;
+    meter->clipped = 0;
+    memset(meter->peak, 0, sizeof(meter->peak));
+    memset(meter->sumSquares, 0, sizeof(meter->sumSquares));
+    memset(meter->bandSumSquares, 0, sizeof(meter->bandSumSquares));
+}
+
+void PBJAudioMeterReset(PBJAudioMeter *meter)
+{
+    if (!meter)
+        return;
+
+    PBJAudioLevels discarded;
+    PBJAudioMeterRead(meter, &discarded);
+    memset(meter->z1, 0, sizeof(meter->z1));
+    memset(meter->z2, 0, sizeof(meter->z2));
+}
@@ -0,0 +1,99 @@
+//
+//  PBJAudioMeter.h
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef PBJAudioMeter_h
+#define PBJAudioMeter_h
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "PBJSIMD.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// level metering over interleaved PCM, read in place. peak, RMS and clipping are
+// vectorized four samples at a time, band energies run a bank of band-pass biquads
+// over the channel mix with the bands side by side in vector lanes. results accumulate
+// across buffers until read, so a caller can meter every buffer and report at its own
+// rate. not thread safe
+
+#define PBJAudioMeterMaximumChannels 8
+#define PBJAudioMeterMaximumBands 8
+
+typedef enum {
+    PBJAudioSampleFormatInt16 = 0, // signed, native endian
+    PBJAudioSampleFormatFloat32
+} PBJAudioSampleFormat;
+
+typedef struct {
+    double sampleRate;
+    uint32_t channelCount;
+    uint32_t bandCount; // 0 for none, centers are log spaced between the two frequencies
+    double minimumBandFrequency;
+    double maximumBandFrequency; // kept below nyquist
+    float clipLevel; // absolute level, full scale is 1, at or above counts as clipped
+} PBJAudioMeterConfiguration;
+
+// linear values, full scale is 1
+typedef struct {
+    uint64_t frames;
+    uint32_t channelCount;
+    float peak[PBJAudioMeterMaximumChannels];
+    float rms[PBJAudioMeterMaximumChannels];
+    uint64_t clippedSamples;
+    uint32_t bandCount;
+    float bandFrequencies[PBJAudioMeterMaximumBands];
+    float bandRMS[PBJAudioMeterMaximumBands];
+} PBJAudioLevels;
+
+typedef struct PBJAudioMeter PBJAudioMeter;
+
+// no bands, clipping just under full scale
+PBJAudioMeterConfiguration PBJAudioMeterDefaultConfiguration(double sampleRate, uint32_t channelCount);
+
+PBJAudioMeter *PBJAudioMeterCreate(const PBJAudioMeterConfiguration *configuration);
+void PBJAudioMeterDestroy(PBJAudioMeter *meter);
+
+void PBJAudioMeterProcess(PBJAudioMeter *meter, const void *samples, size_t frameCount,
+                          PBJAudioSampleFormat format, PBJSIMDLevel level);
+
+// levels since the previous read, which starts a new window, filter state carries over
+void PBJAudioMeterRead(PBJAudioMeter *meter, PBJAudioLevels *levels);
+
+// clears the window and the filter state
+void PBJAudioMeterReset(PBJAudioMeter *meter);
+
+static inline float PBJAudioLevelToDecibels(float level)
+{
+    return level > 1e-9f ? 20.0f * log10f(level) : -180.0f;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PBJAudioMeter_h */
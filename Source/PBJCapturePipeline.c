@@ -0,0 +1,407 @@
+//
+//  PBJCapturePipeline.c
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include "PBJCapturePipeline.h"
+#include "PBJSampleInterleaver.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+struct PBJCapturePipeline {
+    PBJCapturePipelineSink sink;
+    PBJCaptureTimeline *timeline;
+    PBJSampleInterleaver *interleaver;
+    PBJCaptureRetimer *retimer;
+    PBJCaptureRetimerConfiguration speed; // for the next start
+    PBJTime maximumDuration; // of the file
+    PBJCapturePipelineState state;
+    int audioEnabled;
+    int trackReady[PBJCaptureTrackCount];
+    int videoWritten;
+    int maximumDurationReported;
+    uint64_t counts[PBJCaptureTrackCount][PBJCapturePipelineSampleResultCount];
+};
+
+PBJCapturePipeline *PBJCapturePipelineCreate(PBJCapturePipelineSink sink)
+{
+    PBJCapturePipeline *pipeline = (PBJCapturePipeline *)calloc(1, sizeof(PBJCapturePipeline));
+    if (!pipeline)
+        return NULL;
+
+    pipeline->timeline = PBJCaptureTimelineCreate();
+    if (!pipeline->timeline) {
+        free(pipeline);
+        return NULL;
+    }
+    pipeline->retimer = PBJCaptureRetimerCreate(NULL);
+    if (!pipeline->retimer) {
+        PBJCaptureTimelineDestroy(pipeline->timeline);
+        free(pipeline);
+        return NULL;
+    }
+    if (sink.retainPayload && sink.releasePayload) {
+        pipeline->interleaver = PBJSampleInterleaverCreate(NULL);
+        if (!pipeline->interleaver) {
+            PBJCaptureRetimerDestroy(pipeline->retimer);
+            PBJCaptureTimelineDestroy(pipeline->timeline);
+            free(pipeline);
+            return NULL;
+        }
+    }
+    pipeline->speed = PBJCaptureRetimerDefaultConfiguration();
+    pipeline->maximumDuration = PBJTimeMake(0, 0);
+    pipeline->sink = sink;
+    pipeline->state = PBJCapturePipelineStateIdle;
+    pipeline->audioEnabled = 1;
+    return pipeline;
+}
+
+void PBJCapturePipelineDestroy(PBJCapturePipeline *pipeline)
+{
+    if (!pipeline)
+        return;
+    if (pipeline->interleaver) {
+        PBJCaptureSample sample;
+        while (PBJSampleInterleaverNext(pipeline->interleaver, 1, &sample) != PBJSampleInterleaverOutputNone)
+            pipeline->sink.releasePayload(pipeline->sink.context, sample.payload);
+        PBJSampleInterleaverDestroy(pipeline->interleaver);
+    }
+    PBJCaptureRetimerDestroy(pipeline->retimer);
+    PBJCaptureTimelineDestroy(pipeline->timeline);
+    free(pipeline);
+}
+
+// audio is only written when enabled and the speed is normal
+static int PBJCapturePipelineRecordsAudio(const PBJCapturePipeline *pipeline)
+{
+    return pipeline->audioEnabled && PBJCaptureRetimerKeepsAudio(pipeline->retimer);
+}
+
+void PBJCapturePipelineSetAudioEnabled(PBJCapturePipeline *pipeline, int audioEnabled)
+{
+    pipeline->audioEnabled = audioEnabled ? 1 : 0;
+    if (pipeline->interleaver)
+        PBJSampleInterleaverSetTrackEnabled(pipeline->interleaver, PBJCaptureTrackAudio, PBJCapturePipelineRecordsAudio(pipeline));
+}
+
+static int PBJCapturePipelineIsRetiming(const PBJCapturePipeline *pipeline)
+{
+    return PBJCaptureRetimerGetConfiguration(pipeline->retimer).speed != PBJCaptureSpeedNormal;
+}
+
+// the timeline limits recorded time, converted from the length of the file at the current speed
+static void PBJCapturePipelineApplyMaximumDuration(PBJCapturePipeline *pipeline)
+{
+    PBJTime recordedDuration = PBJTimeMake(0, 0);
+    if (PBJTimeIsValid(pipeline->maximumDuration))
+        recordedDuration = PBJCaptureRetimerRecordedDurationForOutputDuration(pipeline->retimer, pipeline->maximumDuration);
+    PBJCaptureTimelineSetMaximumDuration(pipeline->timeline, recordedDuration);
+}
+
+void PBJCapturePipelineSetMaximumDuration(PBJCapturePipeline *pipeline, PBJTime maximumDuration)
+{
+    pipeline->maximumDuration = maximumDuration;
+    PBJCapturePipelineApplyMaximumDuration(pipeline);
+}
+
+int PBJCapturePipelineSetSpeed(PBJCapturePipeline *pipeline, const PBJCaptureRetimerConfiguration *configuration)
+{
+    if (!PBJCaptureRetimerConfigurationIsValid(configuration))
+        return 0;
+    pipeline->speed = *configuration;
+    return 1;
+}
+
+#pragma mark - events
+
+static void PBJCapturePipelineReleaseHeldSamples(PBJCapturePipeline *pipeline, int drain);
+
+int PBJCapturePipelineStart(PBJCapturePipeline *pipeline)
+{
+    if (pipeline->state != PBJCapturePipelineStateIdle)
+        return 0;
+
+    PBJCaptureRetimerSetConfiguration(pipeline->retimer, &pipeline->speed);
+    PBJCapturePipelineApplyMaximumDuration(pipeline);
+    PBJCaptureTimelineStart(pipeline->timeline);
+    pipeline->state = PBJCapturePipelineStateRecording;
+    pipeline->trackReady[PBJCaptureTrackVideo] = 0;
+    pipeline->trackReady[PBJCaptureTrackAudio] = 0;
+    pipeline->videoWritten = 0;
+    pipeline->maximumDurationReported = 0;
+    memset(pipeline->counts, 0, sizeof(pipeline->counts));
+    if (pipeline->interleaver) {
+        PBJSampleInterleaverReset(pipeline->interleaver);
+        PBJSampleInterleaverSetTrackEnabled(pipeline->interleaver, PBJCaptureTrackAudio, PBJCapturePipelineRecordsAudio(pipeline));
+    }
+    return 1;
+}
+
+int PBJCapturePipelinePause(PBJCapturePipeline *pipeline)
+{
+    if (pipeline->state != PBJCapturePipelineStateRecording)
+        return 0;
+
+    PBJCapturePipelineReleaseHeldSamples(pipeline, 1);
+    PBJCaptureTimelinePause(pipeline->timeline);
+    pipeline->state = PBJCapturePipelineStatePaused;
+    return 1;
+}
+
+int PBJCapturePipelineResume(PBJCapturePipeline *pipeline)
+{
+    if (pipeline->state != PBJCapturePipelineStatePaused)
+        return 0;
+
+    PBJCaptureTimelineResume(pipeline->timeline);
+    pipeline->state = PBJCapturePipelineStateRecording;
+    return 1;
+}
+
+int PBJCapturePipelineStop(PBJCapturePipeline *pipeline)
+{
+    if (pipeline->state == PBJCapturePipelineStateIdle)
+        return 0;
+
+    PBJCapturePipelineReleaseHeldSamples(pipeline, 1);
+    PBJCaptureTimelineStop(pipeline->timeline);
+    pipeline->state = PBJCapturePipelineStateIdle;
+    return 1;
+}
+
+void PBJCapturePipelineInterrupt(PBJCapturePipeline *pipeline)
+{
+    PBJCapturePipelineReleaseHeldSamples(pipeline, 1);
+    PBJCaptureTimelineInterrupt(pipeline->timeline);
+}
+
+#pragma mark - samples
+
+static void PBJCapturePipelineReportMaximumDuration(PBJCapturePipeline *pipeline)
+{
+    if (pipeline->maximumDurationReported)
+        return;
+    pipeline->maximumDurationReported = 1;
+    if (pipeline->sink.maximumDurationReached)
+        pipeline->sink.maximumDurationReached(pipeline->sink.context);
+}
+
+// rebases and writes a sample the pipeline has let through
+static PBJCapturePipelineSampleResult PBJCapturePipelineWriteSample(PBJCapturePipeline *pipeline, const PBJCaptureSample *sample)
+{
+    // audio is only written once video has started the file
+    if (sample->track == PBJCaptureTrackAudio && !pipeline->videoWritten)
+        return PBJCapturePipelineSampleDroppedAwaitingVideo;
+
+    // rebase onto the recorded timeline, removing any paused or interrupted time
+    PBJTime rebasedTimestamp = PBJTimeMake(0, 0);
+    PBJCaptureTimelineSampleResult timelineResult = PBJCaptureTimelineAppendSample(pipeline->timeline, sample->track,
+                                                                                   sample->presentationTimestamp, sample->duration,
+                                                                                   &rebasedTimestamp);
+    switch (timelineResult) {
+        case PBJCaptureTimelineSampleAccepted:
+            break;
+        case PBJCaptureTimelineSampleDroppedNotRecording:
+            return PBJCapturePipelineSampleDroppedNotRecording;
+        case PBJCaptureTimelineSampleDroppedMaximumDuration:
+            PBJCapturePipelineReportMaximumDuration(pipeline);
+            return PBJCapturePipelineSampleDroppedMaximumDuration;
+        case PBJCaptureTimelineSampleDroppedOverlap:
+        case PBJCaptureTimelineSampleDroppedInvalid:
+        default:
+            return PBJCapturePipelineSampleDroppedTimeline;
+    }
+
+    // away from normal speed frames move to where they play in the file, or are left out
+    if (sample->track == PBJCaptureTrackVideo && PBJCapturePipelineIsRetiming(pipeline)) {
+        switch (PBJCaptureRetimerRetimeFrame(pipeline->retimer, rebasedTimestamp, &rebasedTimestamp)) {
+            case PBJCaptureRetimerFrameKept:
+                break;
+            case PBJCaptureRetimerFrameSkipped:
+                if (PBJCaptureTimelineMaximumDurationReached(pipeline->timeline))
+                    PBJCapturePipelineReportMaximumDuration(pipeline);
+                return PBJCapturePipelineSampleDroppedSpeed;
+            case PBJCaptureRetimerFrameInvalid:
+            default:
+                return PBJCapturePipelineSampleDroppedTimeline;
+        }
+    }
+
+    if (pipeline->sink.writeSample && !pipeline->sink.writeSample(pipeline->sink.context, sample, rebasedTimestamp))
+        return PBJCapturePipelineSampleDroppedWriteFailed;
+
+    if (sample->track == PBJCaptureTrackVideo)
+        pipeline->videoWritten = 1;
+
+    if (PBJCaptureTimelineMaximumDurationReached(pipeline->timeline))
+        PBJCapturePipelineReportMaximumDuration(pipeline);
+
+    return PBJCapturePipelineSampleWritten;
+}
+
+static PBJCapturePipelineSampleResult PBJCapturePipelineEvaluateSample(PBJCapturePipeline *pipeline, const PBJCaptureSample *sample)
+{
+    if (pipeline->state == PBJCapturePipelineStateIdle)
+        return PBJCapturePipelineSampleDroppedNotRecording;
+    if (pipeline->state == PBJCapturePipelineStatePaused)
+        return PBJCapturePipelineSampleDroppedPaused;
+    if (sample->track == PBJCaptureTrackAudio && !PBJCaptureRetimerKeepsAudio(pipeline->retimer))
+        return PBJCapturePipelineSampleDroppedSpeed;
+
+    // each track's input is configured from the first of its samples
+    if (!pipeline->trackReady[sample->track]) {
+        pipeline->trackReady[sample->track] = pipeline->sink.setupTrack ? (pipeline->sink.setupTrack(pipeline->sink.context, sample) != 0) : 1;
+    }
+
+    // held audio only needs its own input, it waits for the first frame in the interleaver
+    if (pipeline->interleaver && sample->track == PBJCaptureTrackAudio)
+        return pipeline->trackReady[PBJCaptureTrackAudio] ? PBJCapturePipelineSampleQueued : PBJCapturePipelineSampleDroppedWriterNotReady;
+
+    if (!pipeline->trackReady[PBJCaptureTrackVideo] || (PBJCapturePipelineRecordsAudio(pipeline) && !pipeline->trackReady[PBJCaptureTrackAudio]))
+        return PBJCapturePipelineSampleDroppedWriterNotReady;
+
+    if (pipeline->interleaver)
+        return PBJCapturePipelineSampleQueued;
+
+    return PBJCapturePipelineWriteSample(pipeline, sample);
+}
+
+// writes whatever the interleaver lets go, drain lets go of everything
+static void PBJCapturePipelineReleaseHeldSamples(PBJCapturePipeline *pipeline, int drain)
+{
+    if (!pipeline->interleaver)
+        return;
+
+    PBJCaptureSample sample;
+    PBJSampleInterleaverOutput output;
+    while ((output = PBJSampleInterleaverNext(pipeline->interleaver, drain, &sample)) != PBJSampleInterleaverOutputNone) {
+        PBJCapturePipelineSampleResult result = PBJCapturePipelineSampleDroppedAwaitingVideo;
+        if (output == PBJSampleInterleaverOutputRelease)
+            result = PBJCapturePipelineWriteSample(pipeline, &sample);
+        pipeline->counts[sample.track][result]++;
+        pipeline->sink.releasePayload(pipeline->sink.context, sample.payload);
+    }
+}
+
+PBJCapturePipelineSampleResult PBJCapturePipelineProcessSample(PBJCapturePipeline *pipeline, const PBJCaptureSample *sample)
+{
+    if (sample->track < 0 || sample->track >= PBJCaptureTrackCount)
+        return PBJCapturePipelineSampleDroppedTimeline;
+
+    PBJCapturePipelineSampleResult result = PBJCapturePipelineEvaluateSample(pipeline, sample);
+    if (result != PBJCapturePipelineSampleQueued) {
+        pipeline->counts[sample->track][result]++;
+        return result;
+    }
+
+    pipeline->sink.retainPayload(pipeline->sink.context, sample->payload);
+    if (!PBJSampleInterleaverPush(pipeline->interleaver, sample)) {
+        pipeline->sink.releasePayload(pipeline->sink.context, sample->payload);
+        pipeline->counts[sample->track][PBJCapturePipelineSampleDroppedTimeline]++;
+        return PBJCapturePipelineSampleDroppedTimeline;
+    }
+    PBJCapturePipelineReleaseHeldSamples(pipeline, 0);
+    return result;
+}
+
+void PBJCapturePipelineProcessSourceItem(PBJCapturePipeline *pipeline, const PBJCaptureSourceItem *item, PBJCapturePipelineSampleResult *sampleResult)
+{
+    switch (item->type) {
+        case PBJCaptureSourceItemSample:
+        {
+            PBJCapturePipelineSampleResult result = PBJCapturePipelineProcessSample(pipeline, &item->sample);
+            if (sampleResult)
+                *sampleResult = result;
+            break;
+        }
+        case PBJCaptureSourceItemPause:
+            PBJCapturePipelinePause(pipeline);
+            break;
+        case PBJCaptureSourceItemResume:
+            PBJCapturePipelineResume(pipeline);
+            break;
+        case PBJCaptureSourceItemInterrupt:
+            PBJCapturePipelineInterrupt(pipeline);
+            break;
+        case PBJCaptureSourceItemEnd:
+            PBJCapturePipelineStop(pipeline);
+            break;
+    }
+}
+
+uint64_t PBJCapturePipelineRunSource(PBJCapturePipeline *pipeline, PBJCaptureSource source)
+{
+    uint64_t processed = 0;
+    PBJCaptureSourceItem item;
+    while (source.nextItem(source.context, &item)) {
+        PBJCapturePipelineProcessSourceItem(pipeline, &item, NULL);
+        processed++;
+        if (item.type == PBJCaptureSourceItemEnd)
+            break;
+    }
+    return processed;
+}
+
+#pragma mark - queries
+
+PBJCapturePipelineState PBJCapturePipelineGetState(const PBJCapturePipeline *pipeline)
+{
+    return pipeline->state;
+}
+
+int PBJCapturePipelineHasWrittenVideo(const PBJCapturePipeline *pipeline)
+{
+    return pipeline->videoWritten;
+}
+
+const PBJCaptureTimeline *PBJCapturePipelineGetTimeline(const PBJCapturePipeline *pipeline)
+{
+    return pipeline->timeline;
+}
+
+const PBJCaptureRetimer *PBJCapturePipelineGetRetimer(const PBJCapturePipeline *pipeline)
+{
+    return pipeline->retimer;
+}
+
+PBJTime PBJCapturePipelineGetOutputDurationForTrack(const PBJCapturePipeline *pipeline, PBJCaptureTrack track)
+{
+    if (!PBJCapturePipelineIsRetiming(pipeline))
+        return PBJCaptureTimelineCapturedDurationForTrack(pipeline->timeline, track);
+    if (track == PBJCaptureTrackVideo)
+        return PBJCaptureRetimerGetOutputDuration(pipeline->retimer);
+    return PBJTimeMake(0, 1);
+}
+
+uint64_t PBJCapturePipelineGetSampleCount(const PBJCapturePipeline *pipeline, PBJCaptureTrack track, PBJCapturePipelineSampleResult result)
+{
+    if (track < 0 || track >= PBJCaptureTrackCount || result < 0 || result >= PBJCapturePipelineSampleResultCount)
+        return 0;
+    return pipeline->counts[track][result];
+}
+
+const struct PBJSampleInterleaver *PBJCapturePipelineGetInterleaver(const PBJCapturePipeline *pipeline)
+{
+    return pipeline->interleaver;
+}
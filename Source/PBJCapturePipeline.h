@@ -0,0 +1,158 @@
+//
+//  PBJCapturePipeline.h
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef PBJCapturePipeline_h
+#define PBJCapturePipeline_h
+
+#include <stdint.h>
+
+#include "PBJCaptureTimeline.h"
+#include "PBJCaptureRetimer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// the recording state machine that sits between a capture source and the media writer,
+// deciding per sample whether it is written, and when, with no dependency on AVFoundation.
+// PBJVision feeds it from its sample buffer delegate, the tests' PBJSyntheticCaptureSource
+// drives it deterministically off the device. not thread safe, confine to the capture queue
+
+#pragma mark - samples
+
+typedef struct {
+    PBJCaptureTrack track;
+    PBJTime presentationTimestamp;
+    PBJTime duration; // invalid for video frames
+    void *payload; // owned by the source, ie a CMSampleBufferRef
+} PBJCaptureSample;
+
+typedef enum {
+    PBJCapturePipelineSampleWritten = 0,
+    PBJCapturePipelineSampleDroppedNotRecording,
+    PBJCapturePipelineSampleDroppedPaused,
+    PBJCapturePipelineSampleDroppedWriterNotReady, // inputs are still being set up
+    PBJCapturePipelineSampleDroppedAwaitingVideo, // audio before the first video frame
+    PBJCapturePipelineSampleDroppedTimeline, // overlapping or invalid timestamp
+    PBJCapturePipelineSampleDroppedMaximumDuration,
+    PBJCapturePipelineSampleDroppedWriteFailed,
+    PBJCapturePipelineSampleDroppedSpeed, // left out by the recording speed, time-lapse frames between intervals and audio
+    PBJCapturePipelineSampleQueued, // held for interleaving, counted once it is written or dropped
+    PBJCapturePipelineSampleResultCount
+} PBJCapturePipelineSampleResult;
+
+#pragma mark - sources
+
+typedef enum {
+    PBJCaptureSourceItemSample = 0,
+    PBJCaptureSourceItemPause,
+    PBJCaptureSourceItemResume,
+    PBJCaptureSourceItemInterrupt,
+    PBJCaptureSourceItemEnd
+} PBJCaptureSourceItemType;
+
+typedef struct {
+    PBJCaptureSourceItemType type;
+    int64_t arrivalTime; // nanoseconds on the source clock, when the item is delivered
+    PBJCaptureSample sample; // valid for sample items until the next item is requested
+} PBJCaptureSourceItem;
+
+typedef struct {
+    void *context;
+    // fills in the next item, returns 0 once the source is exhausted
+    int (*nextItem)(void *context, PBJCaptureSourceItem *item);
+} PBJCaptureSource;
+
+#pragma mark - pipeline
+
+typedef enum {
+    PBJCapturePipelineStateIdle = 0,
+    PBJCapturePipelineStateRecording,
+    PBJCapturePipelineStatePaused
+} PBJCapturePipelineState;
+
+typedef struct {
+    void *context;
+    // prepares the writer input for the sample's track, called until it returns nonzero
+    int (*setupTrack)(void *context, const PBJCaptureSample *sample);
+    // writes the sample at its rebased presentation timestamp, returns nonzero on success
+    int (*writeSample)(void *context, const PBJCaptureSample *sample, PBJTime rebasedPresentationTimestamp);
+    // called once per recording when the maximum duration is reached, the owner should stop
+    void (*maximumDurationReached)(void *context);
+    // optional, with both set samples are held briefly and written in presentation order rather
+    // than as they arrive, and audio ahead of the first video frame is cut to it rather than
+    // dropped (see PBJSampleInterleaver.h). a sample whose presentation timestamp is later than
+    // its payload's starts part way in, the sink leaves out what comes before
+    void (*retainPayload)(void *context, void *payload);
+    void (*releasePayload)(void *context, void *payload);
+} PBJCapturePipelineSink;
+
+typedef struct PBJCapturePipeline PBJCapturePipeline;
+struct PBJSampleInterleaver;
+
+PBJCapturePipeline *PBJCapturePipelineCreate(PBJCapturePipelineSink sink);
+void PBJCapturePipelineDestroy(PBJCapturePipeline *pipeline);
+
+// when enabled (the default) video waits for the audio input to be ready as well
+void PBJCapturePipelineSetAudioEnabled(PBJCapturePipeline *pipeline, int audioEnabled);
+// the length of the file, at other than normal speed the recorded time it takes is worked out
+// by the retimer. an invalid duration removes the limit
+void PBJCapturePipelineSetMaximumDuration(PBJCapturePipeline *pipeline, PBJTime maximumDuration);
+// normal speed by default, takes effect from the next start, returns 0 for an invalid configuration
+int PBJCapturePipelineSetSpeed(PBJCapturePipeline *pipeline, const PBJCaptureRetimerConfiguration *configuration);
+
+// events, each returns 0 when it does not apply in the current state, samples held for
+// interleaving are written before a pause, an interruption or the stop
+int PBJCapturePipelineStart(PBJCapturePipeline *pipeline);
+int PBJCapturePipelinePause(PBJCapturePipeline *pipeline);
+int PBJCapturePipelineResume(PBJCapturePipeline *pipeline);
+int PBJCapturePipelineStop(PBJCapturePipeline *pipeline);
+// a discontinuity while recording, the next sample closes the gap
+void PBJCapturePipelineInterrupt(PBJCapturePipeline *pipeline);
+
+PBJCapturePipelineSampleResult PBJCapturePipelineProcessSample(PBJCapturePipeline *pipeline, const PBJCaptureSample *sample);
+
+// applies a source item, control items map onto the events above, sampleResult (optional)
+// is only set for sample items
+void PBJCapturePipelineProcessSourceItem(PBJCapturePipeline *pipeline, const PBJCaptureSourceItem *item, PBJCapturePipelineSampleResult *sampleResult);
+// pulls every item from the source, returns the number of items processed
+uint64_t PBJCapturePipelineRunSource(PBJCapturePipeline *pipeline, PBJCaptureSource source);
+
+// queries
+PBJCapturePipelineState PBJCapturePipelineGetState(const PBJCapturePipeline *pipeline);
+int PBJCapturePipelineHasWrittenVideo(const PBJCapturePipeline *pipeline);
+const PBJCaptureTimeline *PBJCapturePipelineGetTimeline(const PBJCapturePipeline *pipeline);
+const PBJCaptureRetimer *PBJCapturePipelineGetRetimer(const PBJCapturePipeline *pipeline);
+// how long the track plays in the file, the timeline's captured duration as retimed for the speed
+PBJTime PBJCapturePipelineGetOutputDurationForTrack(const PBJCapturePipeline *pipeline, PBJCaptureTrack track);
+// per recording, cleared by start
+uint64_t PBJCapturePipelineGetSampleCount(const PBJCapturePipeline *pipeline, PBJCaptureTrack track, PBJCapturePipelineSampleResult result);
+// NULL unless the sink retains payloads, its statistics are per recording too
+const struct PBJSampleInterleaver *PBJCapturePipelineGetInterleaver(const PBJCapturePipeline *pipeline);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PBJCapturePipeline_h */
@@ -0,0 +1,297 @@
+//
+//  PBJCaptureRetimer.c
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#include "PBJCaptureRetimer.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+struct PBJCaptureRetimer {
+    PBJCaptureRetimerConfiguration configuration;
+
+    int hasOrigin;
+    int64_t timescale; // of the first frame, every later frame is in it too
+    int64_t origin;
+    int64_t last;
+    int64_t lastOutput;
+
+    // elapsed recorded time scales to intervals (time-lapse) or output time (slow motion) by numerator / denominator
+    int64_t numerator;
+    int64_t denominator;
+    int64_t lastInterval;
+
+    PBJCaptureRetimerStatistics statistics;
+};
+
+#pragma mark - arithmetic
+
+static int64_t PBJCaptureRetimerGCD(int64_t a, int64_t b)
+{
+    while (b != 0) {
+        int64_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a < 0 ? -a : a;
+}
+
+// floor(value * numerator / denominator) for a value that isn't negative, split so the product
+// only overflows when the result would
+static int PBJCaptureRetimerMultiplyDivide(int64_t value, int64_t numerator, int64_t denominator, int64_t *result)
+{
+    int64_t quotient = value / denominator;
+    int64_t remainder = value % denominator;
+    int64_t whole = 0;
+    int64_t part = 0;
+    if (__builtin_mul_overflow(quotient, numerator, &whole) || __builtin_mul_overflow(remainder, numerator, &part))
+        return 0;
+    return !__builtin_add_overflow(whole, part / denominator, result);
+}
+
+// value / timescale with the common factor taken out, 0 on overflow
+static int PBJCaptureRetimerMakeReducedTime(int64_t value, int64_t valueFactor, int64_t timescale, int64_t timescaleFactor, PBJTime *time)
+{
+    int64_t reducedValue = 0;
+    int64_t reducedTimescale = 0;
+    if (__builtin_mul_overflow(value, valueFactor, &reducedValue) || __builtin_mul_overflow(timescale, timescaleFactor, &reducedTimescale))
+        return 0;
+    int64_t gcd = PBJCaptureRetimerGCD(reducedValue, reducedTimescale);
+    if (gcd > 1) {
+        reducedValue /= gcd;
+        reducedTimescale /= gcd;
+    }
+    *time = PBJTimeMake(reducedValue, reducedTimescale);
+    return 1;
+}
+
+#pragma mark - lifecycle
+
+PBJCaptureRetimerConfiguration PBJCaptureRetimerDefaultConfiguration(void)
+{
+    PBJCaptureRetimerConfiguration configuration;
+    configuration.speed = PBJCaptureSpeedNormal;
+    configuration.interval = PBJTimeMake(1, 1);
+    configuration.captureFrameRate = 240;
+    configuration.outputFrameRate = 30;
+    return configuration;
+}
+
+int PBJCaptureRetimerConfigurationIsValid(const PBJCaptureRetimerConfiguration *configuration)
+{
+    if (!configuration)
+        return 0;
+
+    switch (configuration->speed) {
+        case PBJCaptureSpeedNormal:
+            return 1;
+        case PBJCaptureSpeedTimeLapse:
+            return PBJTimeIsValid(configuration->interval) && configuration->interval.value > 0 && configuration->outputFrameRate > 0;
+        case PBJCaptureSpeedSlowMotion:
+            return configuration->outputFrameRate > 0 && configuration->captureFrameRate > configuration->outputFrameRate;
+        default:
+            return 0;
+    }
+}
+
+PBJCaptureRetimer *PBJCaptureRetimerCreate(const PBJCaptureRetimerConfiguration *configuration)
+{
+    PBJCaptureRetimerConfiguration defaultConfiguration = PBJCaptureRetimerDefaultConfiguration();
+    if (!configuration)
+        configuration = &defaultConfiguration;
+    if (!PBJCaptureRetimerConfigurationIsValid(configuration))
+        return NULL;
+
+    PBJCaptureRetimer *retimer = (PBJCaptureRetimer *)calloc(1, sizeof(PBJCaptureRetimer));
+    if (!retimer)
+        return NULL;
+    retimer->configuration = *configuration;
+    return retimer;
+}
+
+void PBJCaptureRetimerDestroy(PBJCaptureRetimer *retimer)
+{
+    free(retimer);
+}
+
+int PBJCaptureRetimerSetConfiguration(PBJCaptureRetimer *retimer, const PBJCaptureRetimerConfiguration *configuration)
+{
+    if (!PBJCaptureRetimerConfigurationIsValid(configuration))
+        return 0;
+    retimer->configuration = *configuration;
+    PBJCaptureRetimerReset(retimer);
+    return 1;
+}
+
+PBJCaptureRetimerConfiguration PBJCaptureRetimerGetConfiguration(const PBJCaptureRetimer *retimer)
+{
+    return retimer->configuration;
+}
+
+void PBJCaptureRetimerReset(PBJCaptureRetimer *retimer)
+{
+    PBJCaptureRetimerConfiguration configuration = retimer->configuration;
+    memset(retimer, 0, sizeof(PBJCaptureRetimer));
+    retimer->configuration = configuration;
+}
+
+int PBJCaptureRetimerKeepsAudio(const PBJCaptureRetimer *retimer)
+{
+    return retimer->configuration.speed == PBJCaptureSpeedNormal;
+}
+
+#pragma mark - frames
+
+// the scale from elapsed recorded time, fixed by the first frame's timescale
+static int PBJCaptureRetimerBegin(PBJCaptureRetimer *retimer, PBJTime timestamp)
+{
+    const PBJCaptureRetimerConfiguration *configuration = &retimer->configuration;
+    int64_t numerator = 1;
+    int64_t denominator = 1;
+    if (configuration->speed == PBJCaptureSpeedTimeLapse) {
+        // intervals elapsed = elapsed * interval.timescale / (interval.value * timescale)
+        int64_t gcd = PBJCaptureRetimerGCD(configuration->interval.timescale, timestamp.timescale);
+        numerator = configuration->interval.timescale / gcd;
+        if (__builtin_mul_overflow(configuration->interval.value, timestamp.timescale / gcd, &denominator))
+            return 0;
+    } else if (configuration->speed == PBJCaptureSpeedSlowMotion) {
+        int64_t gcd = PBJCaptureRetimerGCD(configuration->captureFrameRate, configuration->outputFrameRate);
+        numerator = configuration->captureFrameRate / gcd;
+        denominator = configuration->outputFrameRate / gcd;
+    }
+
+    retimer->numerator = numerator;
+    retimer->denominator = denominator;
+    retimer->timescale = timestamp.timescale;
+    retimer->origin = timestamp.value;
+    retimer->last = timestamp.value;
+    retimer->lastOutput = timestamp.value;
+    retimer->lastInterval = 0;
+    retimer->hasOrigin = 1;
+    return 1;
+}
+
+PBJCaptureRetimerResult PBJCaptureRetimerRetimeFrame(PBJCaptureRetimer *retimer, PBJTime timestamp, PBJTime *outputTimestamp)
+{
+    if (!PBJTimeIsValid(timestamp))
+        return PBJCaptureRetimerFrameInvalid;
+
+    if (!retimer->hasOrigin) {
+        if (!PBJCaptureRetimerBegin(retimer, timestamp))
+            return PBJCaptureRetimerFrameInvalid;
+        retimer->statistics.framesKept++;
+        if (outputTimestamp)
+            *outputTimestamp = timestamp;
+        return PBJCaptureRetimerFrameKept;
+    }
+
+    if (timestamp.timescale != retimer->timescale || timestamp.value <= retimer->last)
+        return PBJCaptureRetimerFrameInvalid;
+
+    int64_t elapsed = 0;
+    if (__builtin_sub_overflow(timestamp.value, retimer->origin, &elapsed))
+        return PBJCaptureRetimerFrameInvalid;
+
+    int64_t output = timestamp.value;
+    switch (retimer->configuration.speed) {
+        case PBJCaptureSpeedTimeLapse:
+        {
+            // the first frame into each new interval is kept, the kept frames play back to back
+            int64_t interval = 0;
+            if (!PBJCaptureRetimerMultiplyDivide(elapsed, retimer->numerator, retimer->denominator, &interval))
+                return PBJCaptureRetimerFrameInvalid;
+            if (interval <= retimer->lastInterval) {
+                retimer->last = timestamp.value;
+                retimer->statistics.framesSkipped++;
+                return PBJCaptureRetimerFrameSkipped;
+            }
+            int64_t offset = 0;
+            if (!PBJCaptureRetimerMultiplyDivide((int64_t)retimer->statistics.framesKept, retimer->timescale, retimer->configuration.outputFrameRate, &offset) ||
+                __builtin_add_overflow(retimer->origin, offset, &output))
+                return PBJCaptureRetimerFrameInvalid;
+            retimer->lastInterval = interval;
+            break;
+        }
+        case PBJCaptureSpeedSlowMotion:
+        {
+            int64_t offset = 0;
+            if (!PBJCaptureRetimerMultiplyDivide(elapsed, retimer->numerator, retimer->denominator, &offset) ||
+                __builtin_add_overflow(retimer->origin, offset, &output))
+                return PBJCaptureRetimerFrameInvalid;
+            break;
+        }
+        case PBJCaptureSpeedNormal:
+        default:
+            break;
+    }
+
+    retimer->last = timestamp.value;
+    retimer->lastOutput = output;
+    retimer->statistics.framesKept++;
+    if (outputTimestamp)
+        *outputTimestamp = PBJTimeMake(output, retimer->timescale);
+    return PBJCaptureRetimerFrameKept;
+}
+
+#pragma mark - durations
+
+PBJTime PBJCaptureRetimerRecordedDurationForOutputDuration(const PBJCaptureRetimer *retimer, PBJTime outputDuration)
+{
+    if (!PBJTimeIsValid(outputDuration))
+        return PBJTimeMake(0, 0);
+
+    const PBJCaptureRetimerConfiguration *configuration = &retimer->configuration;
+    PBJTime recordedDuration = outputDuration;
+    switch (configuration->speed) {
+        case PBJCaptureSpeedTimeLapse:
+        {
+            // a frame of the file for each interval recorded
+            int64_t frameIntervals = 0;
+            if (__builtin_mul_overflow((int64_t)configuration->outputFrameRate, configuration->interval.value, &frameIntervals) ||
+                !PBJCaptureRetimerMakeReducedTime(outputDuration.value, frameIntervals, outputDuration.timescale, configuration->interval.timescale, &recordedDuration))
+                return PBJTimeMake(0, 0);
+            break;
+        }
+        case PBJCaptureSpeedSlowMotion:
+            if (!PBJCaptureRetimerMakeReducedTime(outputDuration.value, configuration->outputFrameRate, outputDuration.timescale, configuration->captureFrameRate, &recordedDuration))
+                return PBJTimeMake(0, 0);
+            break;
+        case PBJCaptureSpeedNormal:
+        default:
+            break;
+    }
+    return recordedDuration;
+}
+
+PBJTime PBJCaptureRetimerGetOutputDuration(const PBJCaptureRetimer *retimer)
+{
+    if (!retimer->hasOrigin)
+        return PBJTimeMake(0, 1);
+    return PBJTimeMake(retimer->lastOutput - retimer->origin, retimer->timescale);
+}
+
+PBJCaptureRetimerStatistics PBJCaptureRetimerGetStatistics(const PBJCaptureRetimer *retimer)
+{
+    return retimer->statistics;
+}
@@ -0,0 +1,110 @@
+//
+//  PBJCaptureRetimer.h
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#ifndef PBJCaptureRetimer_h
+#define PBJCaptureRetimer_h
+
+#include <stdint.h>
+
+#include "PBJCaptureTimeline.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// maps the recorded timeline of the video track onto the file's for recording at other than
+// normal speed. time-lapse keeps the first frame of each interval of recorded time and lays the
+// kept frames out at the output frame rate, so the encoder only sees frames that are written.
+// slow motion keeps every frame and stretches the time between them by the capture frame rate
+// over the output frame rate. timestamps are recorded, paused and interrupted time already
+// removed, and all arithmetic is exact integer math in their timescale. audio can't be retimed
+// without resampling, so it's left out at any speed other than normal. not thread safe, confine
+// to one queue
+
+typedef enum {
+    PBJCaptureSpeedNormal = 0,
+    PBJCaptureSpeedTimeLapse,
+    PBJCaptureSpeedSlowMotion
+} PBJCaptureSpeed;
+
+typedef struct {
+    PBJCaptureSpeed speed;
+    PBJTime interval; // time-lapse, recorded time between kept frames
+    int32_t captureFrameRate; // slow motion, the rate frames arrive at, above the output frame rate
+    int32_t outputFrameRate; // time-lapse and slow motion, the rate the file plays at
+} PBJCaptureRetimerConfiguration;
+
+typedef enum {
+    PBJCaptureRetimerFrameKept = 0,
+    PBJCaptureRetimerFrameSkipped, // between time-lapse intervals
+    PBJCaptureRetimerFrameInvalid // earlier than the previous frame, or arithmetic overflow
+} PBJCaptureRetimerResult;
+
+typedef struct {
+    uint64_t framesKept;
+    uint64_t framesSkipped;
+} PBJCaptureRetimerStatistics;
+
+typedef struct PBJCaptureRetimer PBJCaptureRetimer;
+
+// normal speed, a frame a second played at 30 fps for time-lapse, 240 fps played at 30 for slow motion
+PBJCaptureRetimerConfiguration PBJCaptureRetimerDefaultConfiguration(void);
+
+// returns 1 when the configuration is usable, its speed set
+int PBJCaptureRetimerConfigurationIsValid(const PBJCaptureRetimerConfiguration *configuration);
+
+// NULL for an invalid configuration
+PBJCaptureRetimer *PBJCaptureRetimerCreate(const PBJCaptureRetimerConfiguration *configuration);
+void PBJCaptureRetimerDestroy(PBJCaptureRetimer *retimer);
+
+// resets as well, returns 0 and leaves the retimer as it was for an invalid configuration
+int PBJCaptureRetimerSetConfiguration(PBJCaptureRetimer *retimer, const PBJCaptureRetimerConfiguration *configuration);
+PBJCaptureRetimerConfiguration PBJCaptureRetimerGetConfiguration(const PBJCaptureRetimer *retimer);
+
+// for a new recording, the next frame is the first
+void PBJCaptureRetimerReset(PBJCaptureRetimer *retimer);
+
+// 1 at normal speed only
+int PBJCaptureRetimerKeepsAudio(const PBJCaptureRetimer *retimer);
+
+// a video frame at its recorded timestamp, on keeping outputTimestamp holds where it goes in
+// the file in the same timescale. the first frame stays where it is, the rest of the recording
+// shares its timescale
+PBJCaptureRetimerResult PBJCaptureRetimerRetimeFrame(PBJCaptureRetimer *retimer, PBJTime timestamp, PBJTime *outputTimestamp);
+
+// the recorded duration that fills outputDuration of the file, for limiting a recording by the
+// length of the file. invalid when it can't be represented
+PBJTime PBJCaptureRetimerRecordedDurationForOutputDuration(const PBJCaptureRetimer *retimer, PBJTime outputDuration);
+
+// from the first kept frame to the latest, as the file plays
+PBJTime PBJCaptureRetimerGetOutputDuration(const PBJCaptureRetimer *retimer);
+
+PBJCaptureRetimerStatistics PBJCaptureRetimerGetStatistics(const PBJCaptureRetimer *retimer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PBJCaptureRetimer_h */
@@ -0,0 +1,375 @@
+//
+//  PBJCaptureTimeline.c
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include "PBJCaptureTimeline.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// times are kept in units of 1/timescale relative to a whole second epoch taken from
+// the first sample, so raw host clock values never have to be scaled up
+
+#define PBJ_TIMELINE_MAXIMUM_TIMESCALE (INT64_C(1) << 48)
+
+typedef struct {
+    int64_t lastStart;
+    int64_t lastEnd;
+    int64_t lastInterval; // between the last two starts, 0 until there are two
+    int hasSamples;
+} PBJCaptureTrackState;
+
+struct PBJCaptureTimeline {
+    int64_t timescale; // lcm of every timescale seen
+    int64_t timestampTimescaleGCD; // gcd of presentation timestamp timescales
+    int64_t epochSeconds;
+    int hasEpoch;
+
+    int recording;
+    int paused;
+    int gapPending;
+
+    int hasOrigin;
+    int64_t origin;
+    int64_t outputEnd;
+    int64_t gap;
+    uint64_t gapCount;
+
+    int64_t maximumDuration; // < 0 when unlimited
+    int maximumDurationReached;
+
+    PBJCaptureTrackState tracks[PBJCaptureTrackCount];
+};
+
+#pragma mark - arithmetic
+
+static int64_t PBJTimelineGCD(int64_t a, int64_t b)
+{
+    while (b != 0) {
+        int64_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a < 0 ? -a : a;
+}
+
+static int PBJTimelineMultiply(int64_t a, int64_t b, int64_t *result)
+{
+    return !__builtin_mul_overflow(a, b, result);
+}
+
+static int64_t PBJTimelineFloorDivide(int64_t a, int64_t b)
+{
+    int64_t q = a / b;
+    if ((a % b != 0) && ((a < 0) != (b < 0)))
+        q--;
+    return q;
+}
+
+// rescales every stored time when a new timescale widens the internal one
+static int PBJTimelineAddTimescale(PBJCaptureTimeline *timeline, int64_t timescale, int isTimestamp)
+{
+    if (timescale <= 0)
+        return 0;
+
+    if (timeline->timescale % timescale != 0) {
+        int64_t factor = timescale / PBJTimelineGCD(timeline->timescale, timescale);
+        int64_t widened = 0;
+        if (!PBJTimelineMultiply(timeline->timescale, factor, &widened) || widened > PBJ_TIMELINE_MAXIMUM_TIMESCALE)
+            return 0;
+
+        int ok = PBJTimelineMultiply(timeline->origin, factor, &timeline->origin) &&
+                 PBJTimelineMultiply(timeline->outputEnd, factor, &timeline->outputEnd) &&
+                 PBJTimelineMultiply(timeline->gap, factor, &timeline->gap);
+        if (timeline->maximumDuration > 0)
+            ok = ok && PBJTimelineMultiply(timeline->maximumDuration, factor, &timeline->maximumDuration);
+        for (int i = 0; i < PBJCaptureTrackCount; i++) {
+            ok = ok && PBJTimelineMultiply(timeline->tracks[i].lastStart, factor, &timeline->tracks[i].lastStart) &&
+                       PBJTimelineMultiply(timeline->tracks[i].lastEnd, factor, &timeline->tracks[i].lastEnd) &&
+                       PBJTimelineMultiply(timeline->tracks[i].lastInterval, factor, &timeline->tracks[i].lastInterval);
+        }
+        if (!ok)
+            return 0;
+        timeline->timescale = widened;
+    }
+
+    if (isTimestamp) {
+        timeline->timestampTimescaleGCD = timeline->timestampTimescaleGCD == 0 ? timescale : PBJTimelineGCD(timeline->timestampTimescaleGCD, timescale);
+    }
+    return 1;
+}
+
+// converts to internal units relative to the epoch
+static int PBJTimelineToInternal(const PBJCaptureTimeline *timeline, PBJTime time, int relativeToEpoch, int64_t *result)
+{
+    int64_t value = time.value;
+    if (relativeToEpoch) {
+        int64_t epoch = 0;
+        if (!PBJTimelineMultiply(timeline->epochSeconds, time.timescale, &epoch) || __builtin_sub_overflow(value, epoch, &value))
+            return 0;
+    }
+    return PBJTimelineMultiply(value, timeline->timescale / time.timescale, result);
+}
+
+#pragma mark - lifecycle
+
+PBJCaptureTimeline *PBJCaptureTimelineCreate(void)
+{
+    PBJCaptureTimeline *timeline = (PBJCaptureTimeline *)calloc(1, sizeof(PBJCaptureTimeline));
+    if (!timeline)
+        return NULL;
+    timeline->maximumDuration = -1;
+    PBJCaptureTimelineStart(timeline);
+    timeline->recording = 0;
+    return timeline;
+}
+
+void PBJCaptureTimelineDestroy(PBJCaptureTimeline *timeline)
+{
+    free(timeline);
+}
+
+#pragma mark - events
+
+void PBJCaptureTimelineStart(PBJCaptureTimeline *timeline)
+{
+    if (!timeline)
+        return;
+
+    int64_t maximumDuration = timeline->maximumDuration;
+    int64_t timescale = timeline->timescale;
+
+    memset(timeline, 0, sizeof(PBJCaptureTimeline));
+    timeline->timescale = 1;
+    timeline->maximumDuration = -1;
+    timeline->recording = 1;
+
+    // carry the limit over, expressed in the fresh timescale
+    if (maximumDuration > 0 && timescale > 0) {
+        PBJCaptureTimelineSetMaximumDuration(timeline, PBJTimeMake(maximumDuration, timescale));
+    }
+}
+
+void PBJCaptureTimelineStop(PBJCaptureTimeline *timeline)
+{
+    if (!timeline)
+        return;
+    timeline->recording = 0;
+    timeline->paused = 0;
+    timeline->gapPending = 0;
+}
+
+void PBJCaptureTimelinePause(PBJCaptureTimeline *timeline)
+{
+    if (!timeline || !timeline->recording)
+        return;
+    timeline->paused = 1;
+    timeline->gapPending = 1;
+}
+
+void PBJCaptureTimelineResume(PBJCaptureTimeline *timeline)
+{
+    if (!timeline || !timeline->recording)
+        return;
+    timeline->paused = 0;
+}
+
+void PBJCaptureTimelineInterrupt(PBJCaptureTimeline *timeline)
+{
+    if (!timeline || !timeline->recording)
+        return;
+    timeline->gapPending = 1;
+}
+
+void PBJCaptureTimelineSetMaximumDuration(PBJCaptureTimeline *timeline, PBJTime maximumDuration)
+{
+    if (!timeline)
+        return;
+
+    if (!PBJTimeIsValid(maximumDuration) || maximumDuration.value <= 0) {
+        timeline->maximumDuration = -1;
+        timeline->maximumDurationReached = 0;
+        return;
+    }
+
+    int64_t duration = 0;
+    if (!PBJTimelineAddTimescale(timeline, maximumDuration.timescale, 0) ||
+        !PBJTimelineToInternal(timeline, maximumDuration, 0, &duration)) {
+        timeline->maximumDuration = -1;
+        return;
+    }
+    timeline->maximumDuration = duration;
+    timeline->maximumDurationReached = (timeline->hasOrigin && timeline->outputEnd - timeline->origin >= duration);
+}
+
+#pragma mark - samples
+
+// a track without durations (ie video) ends the output at its last start, resuming right
+// there would overlap that sample, so the recording picks up one frame interval later
+static int64_t PBJTimelineResumeOffset(const PBJCaptureTimeline *timeline, int64_t quantum)
+{
+    int64_t offset = 0;
+    for (int i = 0; i < PBJCaptureTrackCount; i++) {
+        const PBJCaptureTrackState *state = &timeline->tracks[i];
+        if (!state->hasSamples || state->lastEnd != state->lastStart || state->lastStart != timeline->outputEnd)
+            continue;
+        int64_t interval = state->lastInterval > 0 ? state->lastInterval : quantum;
+        if (interval > offset)
+            offset = interval;
+    }
+    return offset;
+}
+
+PBJCaptureTimelineSampleResult PBJCaptureTimelineAppendSample(PBJCaptureTimeline *timeline, PBJCaptureTrack track,
+                                                              PBJTime presentationTimestamp, PBJTime duration,
+                                                              PBJTime *rebasedTimestamp)
+{
+    if (!timeline || track < 0 || track >= PBJCaptureTrackCount || !PBJTimeIsValid(presentationTimestamp) ||
+        presentationTimestamp.timescale > INT32_MAX)
+        return PBJCaptureTimelineSampleDroppedInvalid;
+
+    if (!timeline->recording || timeline->paused)
+        return PBJCaptureTimelineSampleDroppedNotRecording;
+
+    if (timeline->maximumDurationReached)
+        return PBJCaptureTimelineSampleDroppedMaximumDuration;
+
+    int hasDuration = PBJTimeIsValid(duration) && duration.value > 0;
+    if (!PBJTimelineAddTimescale(timeline, presentationTimestamp.timescale, 1))
+        return PBJCaptureTimelineSampleDroppedInvalid;
+    if (hasDuration && !PBJTimelineAddTimescale(timeline, duration.timescale, 0))
+        return PBJCaptureTimelineSampleDroppedInvalid;
+
+    if (!timeline->hasEpoch) {
+        timeline->epochSeconds = PBJTimelineFloorDivide(presentationTimestamp.value, presentationTimestamp.timescale);
+        timeline->hasEpoch = 1;
+    }
+
+    int64_t start = 0;
+    int64_t length = 0;
+    if (!PBJTimelineToInternal(timeline, presentationTimestamp, 1, &start))
+        return PBJCaptureTimelineSampleDroppedInvalid;
+    if (hasDuration && !PBJTimelineToInternal(timeline, duration, 0, &length))
+        return PBJCaptureTimelineSampleDroppedInvalid;
+
+    // close a pending gap so this sample lands where the recording left off, the gap is
+    // rounded down to a step every timestamp timescale can represent exactly
+    if (timeline->gapPending) {
+        timeline->gapPending = 0;
+        if (timeline->hasOrigin) {
+            int64_t quantum = timeline->timescale / timeline->timestampTimescaleGCD;
+            int64_t resumePoint = 0;
+            if (__builtin_add_overflow(timeline->outputEnd, PBJTimelineResumeOffset(timeline, quantum), &resumePoint))
+                return PBJCaptureTimelineSampleDroppedInvalid;
+            int64_t gap = PBJTimelineFloorDivide(start - resumePoint, quantum) * quantum;
+            if (gap > timeline->gap) {
+                timeline->gap = gap;
+                timeline->gapCount++;
+            }
+        }
+    }
+
+    int64_t rebasedStart = start - timeline->gap;
+    int64_t rebasedEnd = rebasedStart + length;
+
+    PBJCaptureTrackState *state = &timeline->tracks[track];
+    if (state->hasSamples && (rebasedStart <= state->lastStart || rebasedStart < state->lastEnd))
+        return PBJCaptureTimelineSampleDroppedOverlap;
+    if (timeline->hasOrigin && rebasedStart < timeline->origin)
+        return PBJCaptureTimelineSampleDroppedOverlap;
+
+    if (!timeline->hasOrigin) {
+        timeline->origin = rebasedStart;
+        timeline->outputEnd = rebasedStart;
+        timeline->hasOrigin = 1;
+    }
+
+    if (timeline->maximumDuration > 0 && rebasedStart - timeline->origin >= timeline->maximumDuration) {
+        timeline->maximumDurationReached = 1;
+        return PBJCaptureTimelineSampleDroppedMaximumDuration;
+    }
+
+    state->lastInterval = state->hasSamples ? rebasedStart - state->lastStart : 0;
+    state->lastStart = rebasedStart;
+    state->lastEnd = rebasedEnd;
+    state->hasSamples = 1;
+    if (rebasedEnd > timeline->outputEnd)
+        timeline->outputEnd = rebasedEnd;
+    else if (rebasedStart > timeline->outputEnd)
+        timeline->outputEnd = rebasedStart;
+
+    if (timeline->maximumDuration > 0 && timeline->outputEnd - timeline->origin >= timeline->maximumDuration) {
+        timeline->maximumDurationReached = 1;
+    }
+
+    if (rebasedTimestamp) {
+        // exact, the gap is a multiple of timescale / presentationTimestamp.timescale
+        int64_t scale = timeline->timescale / presentationTimestamp.timescale;
+        rebasedTimestamp->value = rebasedStart / scale + timeline->epochSeconds * presentationTimestamp.timescale;
+        rebasedTimestamp->timescale = presentationTimestamp.timescale;
+    }
+    return PBJCaptureTimelineSampleAccepted;
+}
+
+#pragma mark - queries
+
+int PBJCaptureTimelineIsRecording(const PBJCaptureTimeline *timeline)
+{
+    return timeline ? timeline->recording : 0;
+}
+
+int PBJCaptureTimelineIsPaused(const PBJCaptureTimeline *timeline)
+{
+    return timeline ? timeline->paused : 0;
+}
+
+int PBJCaptureTimelineMaximumDurationReached(const PBJCaptureTimeline *timeline)
+{
+    return timeline ? timeline->maximumDurationReached : 0;
+}
+
+PBJTime PBJCaptureTimelineCapturedDuration(const PBJCaptureTimeline *timeline)
+{
+    if (!timeline || !timeline->hasOrigin)
+        return PBJTimeMake(0, 1);
+    return PBJTimeMake(timeline->outputEnd - timeline->origin, timeline->timescale);
+}
+
+PBJTime PBJCaptureTimelineCapturedDurationForTrack(const PBJCaptureTimeline *timeline, PBJCaptureTrack track)
+{
+    if (!timeline || track < 0 || track >= PBJCaptureTrackCount || !timeline->tracks[track].hasSamples)
+        return PBJTimeMake(0, 1);
+    return PBJTimeMake(timeline->tracks[track].lastEnd - timeline->origin, timeline->timescale);
+}
+
+PBJTime PBJCaptureTimelineGapDuration(const PBJCaptureTimeline *timeline)
+{
+    if (!timeline)
+        return PBJTimeMake(0, 1);
+    return PBJTimeMake(timeline->gap, timeline->timescale);
+}
+
+uint64_t PBJCaptureTimelineGapCount(const PBJCaptureTimeline *timeline)
+{
+    return timeline ? timeline->gapCount : 0;
+}
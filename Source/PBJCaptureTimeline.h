@@ -0,0 +1,120 @@
+//
+//  PBJCaptureTimeline.h
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef PBJCaptureTimeline_h
+#define PBJCaptureTimeline_h
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// maps raw capture timestamps onto the recorded timeline, removing the time spent
+// paused or interrupted. all arithmetic is exact integer math in a timescale that is
+// the least common multiple of every timescale seen, each sample costs O(1)
+
+// value / timescale seconds, mirrors CMTime but carries a 64-bit timescale
+typedef struct {
+    int64_t value;
+    int64_t timescale;
+} PBJTime;
+
+static inline PBJTime PBJTimeMake(int64_t value, int64_t timescale)
+{
+    PBJTime time = { value, timescale };
+    return time;
+}
+
+static inline int PBJTimeIsValid(PBJTime time)
+{
+    return time.timescale > 0;
+}
+
+typedef enum {
+    PBJCaptureTrackVideo = 0,
+    PBJCaptureTrackAudio,
+    PBJCaptureTrackCount
+} PBJCaptureTrack;
+
+typedef enum {
+    PBJCaptureTimelineSampleAccepted = 0,
+    PBJCaptureTimelineSampleDroppedNotRecording, // stopped or paused
+    PBJCaptureTimelineSampleDroppedOverlap, // starts before the end of the previous sample on its track
+    PBJCaptureTimelineSampleDroppedMaximumDuration,
+    PBJCaptureTimelineSampleDroppedInvalid // bad timestamp or arithmetic overflow
+} PBJCaptureTimelineSampleResult;
+
+typedef struct PBJCaptureTimeline PBJCaptureTimeline;
+
+PBJCaptureTimeline *PBJCaptureTimelineCreate(void);
+void PBJCaptureTimelineDestroy(PBJCaptureTimeline *timeline);
+
+// events, start clears all accounting from the previous recording
+void PBJCaptureTimelineStart(PBJCaptureTimeline *timeline);
+void PBJCaptureTimelineStop(PBJCaptureTimeline *timeline);
+void PBJCaptureTimelinePause(PBJCaptureTimeline *timeline);
+void PBJCaptureTimelineResume(PBJCaptureTimeline *timeline);
+// a discontinuity while recording (ie session interruption), the next sample closes the gap
+void PBJCaptureTimelineInterrupt(PBJCaptureTimeline *timeline);
+
+// an invalid duration removes the limit
+void PBJCaptureTimelineSetMaximumDuration(PBJCaptureTimeline *timeline, PBJTime maximumDuration);
+
+// on acceptance rebasedTimestamp holds the presentation timestamp to write, in the
+// timescale of the given timestamp. duration may be invalid (ie video frames)
+PBJCaptureTimelineSampleResult PBJCaptureTimelineAppendSample(PBJCaptureTimeline *timeline, PBJCaptureTrack track,
+                                                              PBJTime presentationTimestamp, PBJTime duration,
+                                                              PBJTime *rebasedTimestamp);
+
+// queries, durations are measured from the first accepted sample of the recording
+int PBJCaptureTimelineIsRecording(const PBJCaptureTimeline *timeline);
+int PBJCaptureTimelineIsPaused(const PBJCaptureTimeline *timeline);
+int PBJCaptureTimelineMaximumDurationReached(const PBJCaptureTimeline *timeline);
+PBJTime PBJCaptureTimelineCapturedDuration(const PBJCaptureTimeline *timeline);
+PBJTime PBJCaptureTimelineCapturedDurationForTrack(const PBJCaptureTimeline *timeline, PBJCaptureTrack track);
+PBJTime PBJCaptureTimelineGapDuration(const PBJCaptureTimeline *timeline);
+uint64_t PBJCaptureTimelineGapCount(const PBJCaptureTimeline *timeline);
+
+static inline double PBJTimeGetSeconds(PBJTime time)
+{
+    return time.timescale > 0 ? (double)time.value / (double)time.timescale : 0.0;
+}
+
+// exact, split into whole seconds and a remainder so value * 1e9 can't overflow, which holds for
+// any timescale below 9.2e9 and so every CMTime's
+static inline int64_t PBJTimeGetNanoseconds(PBJTime time)
+{
+    if (time.timescale <= 0)
+        return 0;
+    int64_t seconds = time.value / time.timescale;
+    int64_t remainder = time.value % time.timescale;
+    return seconds * 1000000000 + (remainder * 1000000000) / time.timescale;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PBJCaptureTimeline_h */
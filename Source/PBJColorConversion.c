@@ -0,0 +1,325 @@
+//
+//  PBJColorConversion.c
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include "PBJColorConversion.h"
+
+// BT.709, as in Shader.fsh
+//   R = Y'              + 1.57481 Cr
+//   G = Y' - 0.18732 Cb - 0.46813 Cr
+//   B = Y' + 1.85560 Cb
+// video range additionally expands luma by 255/219 and chroma by 255/224
+//
+// everything is evaluated in 16-bit lanes with 6 fractional bits, the luma term
+// carries the rounding bias, sums that leave the int16 range always clamp to 255
+// so the saturating vector adds and the scalar int math agree bit for bit
+
+typedef struct {
+    int16_t lumaOffset;
+    int16_t lumaScale;
+    int16_t crToR;
+    int16_t cbToG;
+    int16_t crToG;
+    int16_t cbToB;
+} PBJColorCoefficients;
+
+static const PBJColorCoefficients PBJColorCoefficientsFullRange = { 0, 64, 101, 12, 30, 119 };
+static const PBJColorCoefficients PBJColorCoefficientsVideoRange = { 16, 75, 115, 14, 34, 135 };
+
+static const int16_t PBJColorRoundingBias = 32;
+static const int PBJColorFractionBits = 6;
+
+static inline uint8_t PBJColorClamp(int32_t value)
+{
+    value >>= PBJColorFractionBits;
+    return (uint8_t)(value < 0 ? 0 : (value > 255 ? 255 : value));
+}
+
+static inline void PBJColorChannelIndices(PBJRGBOrder order, int *red, int *blue)
+{
+    *red = (order == PBJRGBOrderRGBA) ? 0 : 2;
+    *blue = (order == PBJRGBOrderRGBA) ? 2 : 0;
+}
+
+#pragma mark - scalar
+
+static void PBJColorConvertRowScalar(const uint8_t *lumaRow, const uint8_t *chromaRow, uint8_t *destination,
+                                     size_t x, size_t width, PBJRGBOrder order, const PBJColorCoefficients *k)
+{
+    int red, blue;
+    PBJColorChannelIndices(order, &red, &blue);
+
+    for (; x < width; x++) {
+        const uint8_t *cbcr = chromaRow + ((x >> 1) << 1);
+        int32_t y = ((int32_t)lumaRow[x] - k->lumaOffset) * k->lumaScale + PBJColorRoundingBias;
+        int32_t cb = (int32_t)cbcr[0] - 128;
+        int32_t cr = (int32_t)cbcr[1] - 128;
+
+        uint8_t *pixel = destination + (x << 2);
+        pixel[red] = PBJColorClamp(y + k->crToR * cr);
+        pixel[1] = PBJColorClamp(y - (k->cbToG * cb + k->crToG * cr));
+        pixel[blue] = PBJColorClamp(y + k->cbToB * cb);
+        pixel[3] = 0xff;
+    }
+}
+
+#pragma mark - SSE2, AVX2
+
+#if PBJ_SIMD_SSE2
+
+static size_t PBJColorConvertRowSSE2(const uint8_t *lumaRow, const uint8_t *chromaRow, uint8_t *destination,
+                                     size_t width, PBJRGBOrder order, const PBJColorCoefficients *k)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i alpha = _mm_set1_epi8((char)0xff);
+    const __m128i lowByte = _mm_set1_epi16(0x00ff);
+    const __m128i chromaBias = _mm_set1_epi16(128);
+    const __m128i lumaOffset = _mm_set1_epi16(k->lumaOffset);
+    const __m128i lumaScale = _mm_set1_epi16(k->lumaScale);
+    const __m128i bias = _mm_set1_epi16(PBJColorRoundingBias);
+    const __m128i crToR = _mm_set1_epi16(k->crToR);
+    const __m128i cbToG = _mm_set1_epi16(k->cbToG);
+    const __m128i crToG = _mm_set1_epi16(k->crToG);
+    const __m128i cbToB = _mm_set1_epi16(k->cbToB);
+
+    size_t x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m128i y = _mm_loadu_si128((const __m128i *)(lumaRow + x));
+        __m128i cbcr = _mm_loadu_si128((const __m128i *)(chromaRow + x));
+
+        __m128i yLo = _mm_add_epi16(_mm_mullo_epi16(_mm_sub_epi16(_mm_unpacklo_epi8(y, zero), lumaOffset), lumaScale), bias);
+        __m128i yHi = _mm_add_epi16(_mm_mullo_epi16(_mm_sub_epi16(_mm_unpackhi_epi8(y, zero), lumaOffset), lumaScale), bias);
+
+        __m128i cb = _mm_sub_epi16(_mm_and_si128(cbcr, lowByte), chromaBias);
+        __m128i cr = _mm_sub_epi16(_mm_srli_epi16(cbcr, 8), chromaBias);
+
+        __m128i r = _mm_mullo_epi16(cr, crToR);
+        __m128i g = _mm_add_epi16(_mm_mullo_epi16(cb, cbToG), _mm_mullo_epi16(cr, crToG));
+        __m128i b = _mm_mullo_epi16(cb, cbToB);
+
+        // each chroma sample covers two horizontal pixels
+        __m128i rOut = _mm_packus_epi16(_mm_srai_epi16(_mm_adds_epi16(yLo, _mm_unpacklo_epi16(r, r)), PBJColorFractionBits),
+                                        _mm_srai_epi16(_mm_adds_epi16(yHi, _mm_unpackhi_epi16(r, r)), PBJColorFractionBits));
+        __m128i gOut = _mm_packus_epi16(_mm_srai_epi16(_mm_subs_epi16(yLo, _mm_unpacklo_epi16(g, g)), PBJColorFractionBits),
+                                        _mm_srai_epi16(_mm_subs_epi16(yHi, _mm_unpackhi_epi16(g, g)), PBJColorFractionBits));
+        __m128i bOut = _mm_packus_epi16(_mm_srai_epi16(_mm_adds_epi16(yLo, _mm_unpacklo_epi16(b, b)), PBJColorFractionBits),
+                                        _mm_srai_epi16(_mm_adds_epi16(yHi, _mm_unpackhi_epi16(b, b)), PBJColorFractionBits));
+
+        __m128i first = (order == PBJRGBOrderRGBA) ? rOut : bOut;
+        __m128i third = (order == PBJRGBOrderRGBA) ? bOut : rOut;
+
+        __m128i fgLo = _mm_unpacklo_epi8(first, gOut);
+        __m128i fgHi = _mm_unpackhi_epi8(first, gOut);
+        __m128i taLo = _mm_unpacklo_epi8(third, alpha);
+        __m128i taHi = _mm_unpackhi_epi8(third, alpha);
+
+        __m128i *out = (__m128i *)(destination + (x << 2));
+        _mm_storeu_si128(out + 0, _mm_unpacklo_epi16(fgLo, taLo));
+        _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(fgLo, taLo));
+        _mm_storeu_si128(out + 2, _mm_unpacklo_epi16(fgHi, taHi));
+        _mm_storeu_si128(out + 3, _mm_unpackhi_epi16(fgHi, taHi));
+    }
+    return x;
+}
+
+#endif
+
+#if PBJ_SIMD_AVX2
+
+// identical to the SSE2 kernel, every instruction stays within its 128-bit lane so
+// each lane converts its own run of 16 pixels and the stores undo the lane split
+PBJ_TARGET_AVX2
+static size_t PBJColorConvertRowAVX2(const uint8_t *lumaRow, const uint8_t *chromaRow, uint8_t *destination,
+                                     size_t width, PBJRGBOrder order, const PBJColorCoefficients *k)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i alpha = _mm256_set1_epi8((char)0xff);
+    const __m256i lowByte = _mm256_set1_epi16(0x00ff);
+    const __m256i chromaBias = _mm256_set1_epi16(128);
+    const __m256i lumaOffset = _mm256_set1_epi16(k->lumaOffset);
+    const __m256i lumaScale = _mm256_set1_epi16(k->lumaScale);
+    const __m256i bias = _mm256_set1_epi16(PBJColorRoundingBias);
+    const __m256i crToR = _mm256_set1_epi16(k->crToR);
+    const __m256i cbToG = _mm256_set1_epi16(k->cbToG);
+    const __m256i crToG = _mm256_set1_epi16(k->crToG);
+    const __m256i cbToB = _mm256_set1_epi16(k->cbToB);
+
+    size_t x = 0;
+    for (; x + 32 <= width; x += 32) {
+        __m256i y = _mm256_loadu_si256((const __m256i *)(lumaRow + x));
+        __m256i cbcr = _mm256_loadu_si256((const __m256i *)(chromaRow + x));
+
+        __m256i yLo = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_sub_epi16(_mm256_unpacklo_epi8(y, zero), lumaOffset), lumaScale), bias);
+        __m256i yHi = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_sub_epi16(_mm256_unpackhi_epi8(y, zero), lumaOffset), lumaScale), bias);
+
+        __m256i cb = _mm256_sub_epi16(_mm256_and_si256(cbcr, lowByte), chromaBias);
+        __m256i cr = _mm256_sub_epi16(_mm256_srli_epi16(cbcr, 8), chromaBias);
+
+        __m256i r = _mm256_mullo_epi16(cr, crToR);
+        __m256i g = _mm256_add_epi16(_mm256_mullo_epi16(cb, cbToG), _mm256_mullo_epi16(cr, crToG));
+        __m256i b = _mm256_mullo_epi16(cb, cbToB);
+
+        __m256i rOut = _mm256_packus_epi16(_mm256_srai_epi16(_mm256_adds_epi16(yLo, _mm256_unpacklo_epi16(r, r)), PBJColorFractionBits),
+                                           _mm256_srai_epi16(_mm256_adds_epi16(yHi, _mm256_unpackhi_epi16(r, r)), PBJColorFractionBits));
+        __m256i gOut = _mm256_packus_epi16(_mm256_srai_epi16(_mm256_subs_epi16(yLo, _mm256_unpacklo_epi16(g, g)), PBJColorFractionBits),
+                                           _mm256_srai_epi16(_mm256_subs_epi16(yHi, _mm256_unpackhi_epi16(g, g)), PBJColorFractionBits));
+        __m256i bOut = _mm256_packus_epi16(_mm256_srai_epi16(_mm256_adds_epi16(yLo, _mm256_unpacklo_epi16(b, b)), PBJColorFractionBits),
+                                           _mm256_srai_epi16(_mm256_adds_epi16(yHi, _mm256_unpackhi_epi16(b, b)), PBJColorFractionBits));
+
+        __m256i first = (order == PBJRGBOrderRGBA) ? rOut : bOut;
+        __m256i third = (order == PBJRGBOrderRGBA) ? bOut : rOut;
+
+        __m256i fgLo = _mm256_unpacklo_epi8(first, gOut);
+        __m256i fgHi = _mm256_unpackhi_epi8(first, gOut);
+        __m256i taLo = _mm256_unpacklo_epi8(third, alpha);
+        __m256i taHi = _mm256_unpackhi_epi8(third, alpha);
+
+        __m256i p0 = _mm256_unpacklo_epi16(fgLo, taLo);
+        __m256i p1 = _mm256_unpackhi_epi16(fgLo, taLo);
+        __m256i p2 = _mm256_unpacklo_epi16(fgHi, taHi);
+        __m256i p3 = _mm256_unpackhi_epi16(fgHi, taHi);
+
+        __m256i *out = (__m256i *)(destination + (x << 2));
+        _mm256_storeu_si256(out + 0, _mm256_permute2x128_si256(p0, p1, 0x20));
+        _mm256_storeu_si256(out + 1, _mm256_permute2x128_si256(p2, p3, 0x20));
+        _mm256_storeu_si256(out + 2, _mm256_permute2x128_si256(p0, p1, 0x31));
+        _mm256_storeu_si256(out + 3, _mm256_permute2x128_si256(p2, p3, 0x31));
+    }
+    return x;
+}
+
+#endif
+
+#pragma mark - NEON
+
+#if PBJ_SIMD_NEON
+
+static size_t PBJColorConvertRowNEON(const uint8_t *lumaRow, const uint8_t *chromaRow, uint8_t *destination,
+                                     size_t width, PBJRGBOrder order, const PBJColorCoefficients *k)
+{
+    const int16x8_t chromaBias = vdupq_n_s16(128);
+    const int16x8_t lumaOffset = vdupq_n_s16(k->lumaOffset);
+    const int16x8_t bias = vdupq_n_s16(PBJColorRoundingBias);
+    const uint8x16_t alpha = vdupq_n_u8(0xff);
+
+    size_t x = 0;
+    for (; x + 16 <= width; x += 16) {
+        uint8x16_t y = vld1q_u8(lumaRow + x);
+        uint8x8x2_t cbcr = vld2_u8(chromaRow + x);
+
+        int16x8_t yLo = vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(y)));
+        int16x8_t yHi = vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(y)));
+        yLo = vaddq_s16(vmulq_n_s16(vsubq_s16(yLo, lumaOffset), k->lumaScale), bias);
+        yHi = vaddq_s16(vmulq_n_s16(vsubq_s16(yHi, lumaOffset), k->lumaScale), bias);
+
+        int16x8_t cb = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(cbcr.val[0])), chromaBias);
+        int16x8_t cr = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(cbcr.val[1])), chromaBias);
+
+        int16x8x2_t r = vzipq_s16(vmulq_n_s16(cr, k->crToR), vmulq_n_s16(cr, k->crToR));
+        int16x8_t gc = vaddq_s16(vmulq_n_s16(cb, k->cbToG), vmulq_n_s16(cr, k->crToG));
+        int16x8x2_t g = vzipq_s16(gc, gc);
+        int16x8x2_t b = vzipq_s16(vmulq_n_s16(cb, k->cbToB), vmulq_n_s16(cb, k->cbToB));
+
+        uint8x16_t rOut = vcombine_u8(vqmovun_s16(vshrq_n_s16(vqaddq_s16(yLo, r.val[0]), 6)),
+                                      vqmovun_s16(vshrq_n_s16(vqaddq_s16(yHi, r.val[1]), 6)));
+        uint8x16_t gOut = vcombine_u8(vqmovun_s16(vshrq_n_s16(vqsubq_s16(yLo, g.val[0]), 6)),
+                                      vqmovun_s16(vshrq_n_s16(vqsubq_s16(yHi, g.val[1]), 6)));
+        uint8x16_t bOut = vcombine_u8(vqmovun_s16(vshrq_n_s16(vqaddq_s16(yLo, b.val[0]), 6)),
+                                      vqmovun_s16(vshrq_n_s16(vqaddq_s16(yHi, b.val[1]), 6)));
+
+        uint8x16x4_t pixels;
+        pixels.val[0] = (order == PBJRGBOrderRGBA) ? rOut : bOut;
+        pixels.val[1] = gOut;
+        pixels.val[2] = (order == PBJRGBOrderRGBA) ? bOut : rOut;
+        pixels.val[3] = alpha;
+        vst4q_u8(destination + (x << 2), pixels);
+    }
+    return x;
+}
+
+#endif
+
+#pragma mark - rows
+
+void PBJColorConvertNV12ToRGBRows(const PBJNV12Image *source, uint8_t *destination, size_t destinationBytesPerRow,
+                                  PBJRGBOrder order, size_t rowBegin, size_t rowEnd, PBJSIMDLevel level)
+{
+    if (!source || !destination || rowBegin >= rowEnd)
+        return;
+
+    const PBJColorCoefficients *k = (source->range == PBJYCbCrRangeVideo) ? &PBJColorCoefficientsVideoRange : &PBJColorCoefficientsFullRange;
+    PBJSIMDLevel resolved = PBJSIMDLevelResolve(level);
+    if (rowEnd > source->height)
+        rowEnd = source->height;
+
+    for (size_t row = rowBegin; row < rowEnd; row++) {
+        const uint8_t *lumaRow = source->luma + row * source->lumaBytesPerRow;
+        const uint8_t *chromaRow = source->chroma + (row >> 1) * source->chromaBytesPerRow;
+        uint8_t *destinationRow = destination + row * destinationBytesPerRow;
+
+        size_t x = 0;
+        switch (resolved) {
+#if PBJ_SIMD_AVX2
+            case PBJSIMDLevelAVX2:
+                x = PBJColorConvertRowAVX2(lumaRow, chromaRow, destinationRow, source->width, order, k);
+                break;
+#endif
+#if PBJ_SIMD_SSE2
+            case PBJSIMDLevelSSE2:
+                x = PBJColorConvertRowSSE2(lumaRow, chromaRow, destinationRow, source->width, order, k);
+                break;
+#endif
+#if PBJ_SIMD_NEON
+            case PBJSIMDLevelNEON:
+                x = PBJColorConvertRowNEON(lumaRow, chromaRow, destinationRow, source->width, order, k);
+                break;
+#endif
+            default:
+                break;
+        }
+        PBJColorConvertRowScalar(lumaRow, chromaRow, destinationRow, x, source->width, order, k);
+    }
+}
+
+#pragma mark - strips
+
+size_t PBJColorConversionStripCount(size_t height, size_t maximumStrips)
+{
+    // keep strips tall enough that scheduling does not dominate
+    static const size_t PBJColorConversionMinimumStripRows = 64;
+    size_t strips = height / PBJColorConversionMinimumStripRows;
+    if (strips > maximumStrips)
+        strips = maximumStrips;
+    return strips > 0 ? strips : 1;
+}
+
+void PBJColorConversionStripRows(size_t height, size_t stripCount, size_t stripIndex, size_t *rowBegin, size_t *rowEnd)
+{
+    if (stripCount == 0)
+        stripCount = 1;
+    size_t pairs = (height + 1) >> 1;
+    size_t begin = ((pairs * stripIndex) / stripCount) << 1;
+    size_t end = ((pairs * (stripIndex + 1)) / stripCount) << 1;
+    *rowBegin = begin < height ? begin : height;
+    *rowEnd = end < height ? end : height;
+}
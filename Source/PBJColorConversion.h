@@ -0,0 +1,62 @@
+//
+//  PBJColorConversion.h
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef PBJColorConversion_h
+#define PBJColorConversion_h
+
+#include "PBJPlanarImage.h"
+#include "PBJSIMD.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// CPU conversion of NV12 (420f/420v) into 32-bit interleaved RGB
+// uses the same BT.709 matrix as Shaders/Shader.fsh, in 6-bit fixed point so the
+// NEON, SSE2, AVX2 and scalar paths produce identical output
+
+typedef enum {
+    PBJRGBOrderBGRA = 0, // kCVPixelFormatType_32BGRA, kCGBitmapByteOrder32Little | kCGImageAlphaNoneSkipFirst
+    PBJRGBOrderRGBA
+} PBJRGBOrder;
+
+// converts rows [rowBegin, rowEnd) of source into the same rows of destination, alpha is opaque
+void PBJColorConvertNV12ToRGBRows(const PBJNV12Image *source, uint8_t *destination, size_t destinationBytesPerRow,
+                                  PBJRGBOrder order, size_t rowBegin, size_t rowEnd, PBJSIMDLevel level);
+
+// row strips for spreading a conversion over cores, strips start on even rows so
+// neighbouring strips never share a chroma row
+size_t PBJColorConversionStripCount(size_t height, size_t maximumStrips);
+void PBJColorConversionStripRows(size_t height, size_t stripCount, size_t stripIndex, size_t *rowBegin, size_t *rowEnd);
+
+static inline void PBJColorConvertNV12ToRGB(const PBJNV12Image *source, uint8_t *destination, size_t destinationBytesPerRow, PBJRGBOrder order)
+{
+    PBJColorConvertNV12ToRGBRows(source, destination, destinationBytesPerRow, order, 0, source->height, PBJSIMDLevelAuto);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PBJColorConversion_h */
@@ -0,0 +1,302 @@
+//
+//  PBJFormatIndex.c
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include "PBJFormatIndex.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// ranking keys are copied in so sorting needs no outside state
+typedef struct {
+    int64_t area;
+    int binned;
+    float fieldOfView;
+    float maxZoomFactor;
+    uint32_t descriptor;
+} PBJFormatIndexEntry;
+
+typedef struct {
+    size_t offset;
+    size_t count;
+} PBJFormatIndexSegment;
+
+// segment 2i is the frame rate endpoints[i] itself, segment 2i + 1 the open interval above it
+struct PBJFormatIndex {
+    PBJFormatDescriptor *descriptors;
+    size_t descriptorCount;
+    double *endpoints;
+    size_t endpointCount;
+    PBJFormatIndexSegment *segments;
+    size_t segmentCount;
+    PBJFormatIndexEntry *entries;
+};
+
+#pragma mark - build
+
+static int PBJFormatIndexCompareRates(const void *a, const void *b)
+{
+    double lhs = *(const double *)a;
+    double rhs = *(const double *)b;
+    return (lhs > rhs) - (lhs < rhs);
+}
+
+static int PBJFormatIndexCompareEntries(const void *a, const void *b)
+{
+    const PBJFormatIndexEntry *lhs = (const PBJFormatIndexEntry *)a;
+    const PBJFormatIndexEntry *rhs = (const PBJFormatIndexEntry *)b;
+    if (lhs->area != rhs->area)
+        return lhs->area < rhs->area ? -1 : 1;
+    if (lhs->binned != rhs->binned)
+        return lhs->binned ? 1 : -1;
+    if (lhs->fieldOfView != rhs->fieldOfView)
+        return lhs->fieldOfView > rhs->fieldOfView ? -1 : 1;
+    if (lhs->maxZoomFactor != rhs->maxZoomFactor)
+        return lhs->maxZoomFactor > rhs->maxZoomFactor ? -1 : 1;
+    return (lhs->descriptor < rhs->descriptor) - (lhs->descriptor > rhs->descriptor);
+}
+
+static double PBJFormatIndexSegmentRate(const PBJFormatIndex *index, size_t segment)
+{
+    size_t endpoint = segment / 2;
+    if ((segment & 1) == 0)
+        return index->endpoints[endpoint];
+    return 0.5 * (index->endpoints[endpoint] + index->endpoints[endpoint + 1]);
+}
+
+static int PBJFormatIndexDescriptorCoversRate(const PBJFormatDescriptor *descriptor, double frameRate)
+{
+    return descriptor->minFrameRate <= frameRate && frameRate <= descriptor->maxFrameRate;
+}
+
+PBJFormatIndex *PBJFormatIndexCreate(const PBJFormatDescriptor *descriptors, size_t count)
+{
+    PBJFormatIndex *index = (PBJFormatIndex *)calloc(1, sizeof(PBJFormatIndex));
+    if (!index)
+        return NULL;
+
+    index->descriptors = (PBJFormatDescriptor *)malloc((count ? count : 1) * sizeof(PBJFormatDescriptor));
+    index->endpoints = (double *)malloc((count ? 2 * count : 1) * sizeof(double));
+    if (!index->descriptors || !index->endpoints) {
+        PBJFormatIndexDestroy(index);
+        return NULL;
+    }
+
+    // drop anything that could never match
+    for (size_t i = 0; i < count; i++) {
+        const PBJFormatDescriptor *descriptor = &descriptors[i];
+        if (descriptor->width <= 0 || descriptor->height <= 0 || !(descriptor->minFrameRate <= descriptor->maxFrameRate))
+            continue;
+        index->descriptors[index->descriptorCount] = *descriptor;
+        index->endpoints[2 * index->descriptorCount] = descriptor->minFrameRate;
+        index->endpoints[2 * index->descriptorCount + 1] = descriptor->maxFrameRate;
+        index->descriptorCount++;
+    }
+
+    if (index->descriptorCount == 0)
+        return index;
+
+    size_t endpointCount = 2 * index->descriptorCount;
+    qsort(index->endpoints, endpointCount, sizeof(double), PBJFormatIndexCompareRates);
+    size_t unique = 1;
+    for (size_t i = 1; i < endpointCount; i++) {
+        if (index->endpoints[i] != index->endpoints[unique - 1]) {
+            index->endpoints[unique++] = index->endpoints[i];
+        }
+    }
+    index->endpointCount = unique;
+    index->segmentCount = 2 * unique - 1;
+
+    index->segments = (PBJFormatIndexSegment *)calloc(index->segmentCount, sizeof(PBJFormatIndexSegment));
+    if (!index->segments) {
+        PBJFormatIndexDestroy(index);
+        return NULL;
+    }
+
+    size_t entryCount = 0;
+    for (size_t s = 0; s < index->segmentCount; s++) {
+        double rate = PBJFormatIndexSegmentRate(index, s);
+        for (size_t d = 0; d < index->descriptorCount; d++) {
+            entryCount += (size_t)PBJFormatIndexDescriptorCoversRate(&index->descriptors[d], rate);
+        }
+    }
+
+    index->entries = (PBJFormatIndexEntry *)malloc((entryCount ? entryCount : 1) * sizeof(PBJFormatIndexEntry));
+    if (!index->entries) {
+        PBJFormatIndexDestroy(index);
+        return NULL;
+    }
+
+    size_t offset = 0;
+    for (size_t s = 0; s < index->segmentCount; s++) {
+        double rate = PBJFormatIndexSegmentRate(index, s);
+        PBJFormatIndexSegment *segment = &index->segments[s];
+        segment->offset = offset;
+
+        for (size_t d = 0; d < index->descriptorCount; d++) {
+            const PBJFormatDescriptor *descriptor = &index->descriptors[d];
+            if (!PBJFormatIndexDescriptorCoversRate(descriptor, rate))
+                continue;
+
+            PBJFormatIndexEntry *entry = &index->entries[offset++];
+            entry->area = (int64_t)descriptor->width * descriptor->height;
+            entry->binned = descriptor->binned ? 1 : 0;
+            entry->fieldOfView = descriptor->fieldOfView;
+            entry->maxZoomFactor = descriptor->maxZoomFactor;
+            entry->descriptor = (uint32_t)d;
+        }
+
+        segment->count = offset - segment->offset;
+        qsort(&index->entries[segment->offset], segment->count, sizeof(PBJFormatIndexEntry), PBJFormatIndexCompareEntries);
+    }
+
+    return index;
+}
+
+void PBJFormatIndexDestroy(PBJFormatIndex *index)
+{
+    if (!index)
+        return;
+
+    free(index->descriptors);
+    free(index->endpoints);
+    free(index->segments);
+    free(index->entries);
+    free(index);
+}
+
+#pragma mark - lookup
+
+// segment holding frameRate, -1 outside every range
+static long PBJFormatIndexFindSegment(const PBJFormatIndex *index, double frameRate)
+{
+    size_t low = 0;
+    size_t high = index->endpointCount;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (index->endpoints[middle] < frameRate) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    if (low == index->endpointCount)
+        return -1;
+    if (index->endpoints[low] == frameRate)
+        return (long)(2 * low);
+    if (low == 0)
+        return -1;
+    return (long)(2 * low - 1);
+}
+
+// first entry in [begin, end) with at least area
+static size_t PBJFormatIndexLowerBoundArea(const PBJFormatIndexEntry *entries, size_t begin, size_t end, int64_t area)
+{
+    while (begin < end) {
+        size_t middle = begin + (end - begin) / 2;
+        if (entries[middle].area < area) {
+            begin = middle + 1;
+        } else {
+            end = middle;
+        }
+    }
+    return begin;
+}
+
+static int PBJFormatIndexMatches(const PBJFormatDescriptor *descriptor, const PBJFormatQuery *query)
+{
+    if (descriptor->width < query->minimumWidth || descriptor->height < query->minimumHeight)
+        return 0;
+    if (query->pixelFormat && descriptor->pixelFormat != query->pixelFormat)
+        return 0;
+    if (descriptor->fieldOfView < query->minimumFieldOfView || descriptor->maxZoomFactor < query->minimumMaxZoomFactor)
+        return 0;
+    if (descriptor->binned && !query->allowBinned)
+        return 0;
+    return 1;
+}
+
+int PBJFormatIndexSupportsFrameRate(const PBJFormatIndex *index, double frameRate)
+{
+    if (!index || index->endpointCount == 0)
+        return 0;
+
+    long segment = PBJFormatIndexFindSegment(index, frameRate);
+    return segment >= 0 && index->segments[segment].count > 0;
+}
+
+const PBJFormatDescriptor *PBJFormatIndexFind(const PBJFormatIndex *index, const PBJFormatQuery *query)
+{
+    if (!index || !query || index->endpointCount == 0)
+        return NULL;
+
+    long segmentIndex = PBJFormatIndexFindSegment(index, query->frameRate);
+    if (segmentIndex < 0)
+        return NULL;
+
+    const PBJFormatIndexSegment *segment = &index->segments[segmentIndex];
+    const PBJFormatIndexEntry *entries = index->entries;
+    size_t begin = segment->offset;
+    size_t end = segment->offset + segment->count;
+    int64_t minimumArea = (int64_t)(query->minimumWidth > 0 ? query->minimumWidth : 0) * (query->minimumHeight > 0 ? query->minimumHeight : 0);
+    begin = PBJFormatIndexLowerBoundArea(entries, begin, end, minimumArea);
+
+    if (query->selection == PBJFormatSelectionSmallest) {
+        for (size_t i = begin; i < end; i++) {
+            const PBJFormatDescriptor *descriptor = &index->descriptors[entries[i].descriptor];
+            if (PBJFormatIndexMatches(descriptor, query))
+                return descriptor;
+        }
+        return NULL;
+    }
+
+    // largest, walk down one size at a time keeping the in size ranking
+    while (end > begin) {
+        size_t sizeBegin = PBJFormatIndexLowerBoundArea(entries, begin, end, entries[end - 1].area);
+        for (size_t i = sizeBegin; i < end; i++) {
+            const PBJFormatDescriptor *descriptor = &index->descriptors[entries[i].descriptor];
+            if (PBJFormatIndexMatches(descriptor, query))
+                return descriptor;
+        }
+        end = sizeBegin;
+    }
+    return NULL;
+}
+
+double PBJFormatIndexGetMaximumFrameRate(const PBJFormatIndex *index, int32_t minimumWidth, int32_t minimumHeight)
+{
+    if (!index || index->endpointCount == 0)
+        return 0.0;
+
+    // ranges are closed so the highest reachable rate is always an endpoint
+    PBJFormatQuery query = PBJFormatQueryMake(0.0, PBJFormatSelectionSmallest);
+    query.minimumWidth = minimumWidth;
+    query.minimumHeight = minimumHeight;
+    for (size_t endpoint = index->endpointCount; endpoint > 0; endpoint--) {
+        query.frameRate = index->endpoints[endpoint - 1];
+        if (PBJFormatIndexFind(index, &query))
+            return query.frameRate;
+    }
+    return 0.0;
+}
@@ -0,0 +1,101 @@
+//
+//  PBJFormatIndex.h
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef PBJFormatIndex_h
+#define PBJFormatIndex_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// capability index over a device's capture formats, built once per device. frame rates are cut
+// into the elementary intervals between every range endpoint, each interval keeps the formats
+// supporting it sorted by pixel area, so a query is a binary search for the rate, a binary
+// search for the size, then a walk over the few formats sharing that size
+
+#pragma mark - descriptors
+
+// one per format and supported frame rate range
+typedef struct {
+    uint32_t format; // caller's index, the position in the device's format list
+    int32_t width;
+    int32_t height;
+    uint32_t pixelFormat; // four char code
+    double minFrameRate;
+    double maxFrameRate;
+    float fieldOfView; // degrees
+    float maxZoomFactor;
+    int binned;
+} PBJFormatDescriptor;
+
+#pragma mark - queries
+
+typedef enum {
+    PBJFormatSelectionSmallest = 0, // smallest format covering the minimum dimensions
+    PBJFormatSelectionLargest
+} PBJFormatSelection;
+
+// zero leaves a constraint open, among formats of equal size unbinned comes first, then the
+// wider field of view, then the larger zoom range, then later in the device's list
+typedef struct {
+    double frameRate;
+    int32_t minimumWidth;
+    int32_t minimumHeight;
+    uint32_t pixelFormat;
+    float minimumFieldOfView;
+    float minimumMaxZoomFactor;
+    int allowBinned;
+    PBJFormatSelection selection;
+} PBJFormatQuery;
+
+static inline PBJFormatQuery PBJFormatQueryMake(double frameRate, PBJFormatSelection selection)
+{
+    PBJFormatQuery query = { frameRate, 0, 0, 0, 0.0f, 0.0f, 1, selection };
+    return query;
+}
+
+#pragma mark - index
+
+typedef struct PBJFormatIndex PBJFormatIndex;
+
+// copies the descriptors, NULL on allocation failure
+PBJFormatIndex *PBJFormatIndexCreate(const PBJFormatDescriptor *descriptors, size_t count);
+void PBJFormatIndexDestroy(PBJFormatIndex *index);
+
+int PBJFormatIndexSupportsFrameRate(const PBJFormatIndex *index, double frameRate);
+
+// best match, NULL when nothing satisfies the query
+const PBJFormatDescriptor *PBJFormatIndexFind(const PBJFormatIndex *index, const PBJFormatQuery *query);
+
+// highest frame rate any format covering the dimensions reaches, 0 when none does
+double PBJFormatIndexGetMaximumFrameRate(const PBJFormatIndex *index, int32_t minimumWidth, int32_t minimumHeight);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PBJFormatIndex_h */
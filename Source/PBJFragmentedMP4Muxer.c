@@ -0,0 +1,754 @@
+//
+//  PBJFragmentedMP4Muxer.c
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include "PBJFragmentedMP4Muxer.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// trun sample flags, ISO/IEC 14496-12 8.8.3.1
+#define PBJ_MP4_SAMPLE_FLAGS_SYNC 0x02000000u // depends on no others
+#define PBJ_MP4_SAMPLE_FLAGS_NON_SYNC 0x01010000u // depends on others, non-sync
+
+#define PBJ_MP4_TFHD_DEFAULT_BASE_IS_MOOF 0x020000u
+#define PBJ_MP4_TRUN_FLAGS 0x000f01u // data offset, duration, size, flags and composition offset per sample
+#define PBJ_MP4_TRUN_SAMPLE_SIZE 16
+
+// without a keyframe a fragment is cut anyway once it spans this many intervals
+#define PBJ_MP4_MAXIMUM_FRAGMENT_INTERVALS 4
+
+#pragma mark - byte buffer
+
+typedef struct {
+    uint8_t *bytes;
+    size_t length;
+    size_t capacity;
+    int failed;
+} PBJMP4Buffer;
+
+static int PBJMP4BufferReserve(PBJMP4Buffer *buffer, size_t additional)
+{
+    if (buffer->failed)
+        return 0;
+    if (buffer->length + additional <= buffer->capacity)
+        return 1;
+    size_t capacity = buffer->capacity ? buffer->capacity : 4096;
+    while (capacity < buffer->length + additional)
+        capacity *= 2;
+    uint8_t *bytes = (uint8_t *)realloc(buffer->bytes, capacity);
+    if (!bytes) {
+        buffer->failed = 1;
+        return 0;
+    }
+    buffer->bytes = bytes;
+    buffer->capacity = capacity;
+    return 1;
+}
+
+static void PBJMP4BufferAppend(PBJMP4Buffer *buffer, const void *bytes, size_t length)
+{
+    if (length == 0 || !PBJMP4BufferReserve(buffer, length))
+        return;
+    memcpy(buffer->bytes + buffer->length, bytes, length);
+    buffer->length += length;
+}
+
+static void PBJMP4BufferAppendZeros(PBJMP4Buffer *buffer, size_t length)
+{
+    if (length == 0 || !PBJMP4BufferReserve(buffer, length))
+        return;
+    memset(buffer->bytes + buffer->length, 0, length);
+    buffer->length += length;
+}
+
+static void PBJMP4BufferAppendU8(PBJMP4Buffer *buffer, uint8_t value)
+{
+    PBJMP4BufferAppend(buffer, &value, 1);
+}
+
+static void PBJMP4BufferAppendU16(PBJMP4Buffer *buffer, uint16_t value)
+{
+    uint8_t bytes[2] = { (uint8_t)(value >> 8), (uint8_t)value };
+    PBJMP4BufferAppend(buffer, bytes, sizeof(bytes));
+}
+
+static void PBJMP4BufferAppendU24(PBJMP4Buffer *buffer, uint32_t value)
+{
+    uint8_t bytes[3] = { (uint8_t)(value >> 16), (uint8_t)(value >> 8), (uint8_t)value };
+    PBJMP4BufferAppend(buffer, bytes, sizeof(bytes));
+}
+
+static void PBJMP4BufferAppendU32(PBJMP4Buffer *buffer, uint32_t value)
+{
+    uint8_t bytes[4] = { (uint8_t)(value >> 24), (uint8_t)(value >> 16), (uint8_t)(value >> 8), (uint8_t)value };
+    PBJMP4BufferAppend(buffer, bytes, sizeof(bytes));
+}
+
+static void PBJMP4BufferAppendU64(PBJMP4Buffer *buffer, uint64_t value)
+{
+    PBJMP4BufferAppendU32(buffer, (uint32_t)(value >> 32));
+    PBJMP4BufferAppendU32(buffer, (uint32_t)value);
+}
+
+static void PBJMP4BufferAppendFourCC(PBJMP4Buffer *buffer, const char *fourCC)
+{
+    PBJMP4BufferAppend(buffer, fourCC, 4);
+}
+
+// boxes are opened with a placeholder size that is patched when they close
+static size_t PBJMP4BeginBox(PBJMP4Buffer *buffer, const char *type)
+{
+    size_t offset = buffer->length;
+    PBJMP4BufferAppendU32(buffer, 0);
+    PBJMP4BufferAppendFourCC(buffer, type);
+    return offset;
+}
+
+static size_t PBJMP4BeginFullBox(PBJMP4Buffer *buffer, const char *type, uint8_t version, uint32_t flags)
+{
+    size_t offset = PBJMP4BeginBox(buffer, type);
+    PBJMP4BufferAppendU8(buffer, version);
+    PBJMP4BufferAppendU24(buffer, flags);
+    return offset;
+}
+
+static void PBJMP4EndBox(PBJMP4Buffer *buffer, size_t offset)
+{
+    if (buffer->failed)
+        return;
+    uint32_t size = (uint32_t)(buffer->length - offset);
+    buffer->bytes[offset] = (uint8_t)(size >> 24);
+    buffer->bytes[offset + 1] = (uint8_t)(size >> 16);
+    buffer->bytes[offset + 2] = (uint8_t)(size >> 8);
+    buffer->bytes[offset + 3] = (uint8_t)size;
+}
+
+#pragma mark - types
+
+typedef struct {
+    int64_t decodeTime;
+    uint32_t size;
+    uint32_t duration;
+    int32_t compositionOffset;
+    uint32_t flags;
+} PBJMP4SampleEntry;
+
+typedef struct {
+    int enabled;
+    uint32_t trackID;
+    uint32_t timescale;
+
+    // the fragment being built
+    PBJMP4SampleEntry *samples;
+    size_t sampleCount;
+    size_t sampleCapacity;
+    PBJMP4Buffer data;
+    uint32_t finalDuration; // declared duration of the last buffered sample
+
+    int hasLastSample;
+    int64_t lastDecodeTime;
+    uint32_t lastDuration;
+} PBJMP4TrackState;
+
+struct PBJFragmentedMP4Muxer {
+    PBJFragmentedMP4WriteFunction write;
+    void *context;
+    uint32_t fragmentDuration;
+
+    PBJFragmentedMP4VideoTrack video;
+    PBJFragmentedMP4AudioTrack audio;
+    uint8_t *avcC;
+    uint8_t *audioSpecificConfig;
+
+    PBJMP4TrackState tracks[PBJFragmentedMP4TrackCount];
+    PBJMP4Buffer header;
+    uint32_t sequenceNumber;
+    uint64_t bytesWritten;
+    int failed;
+    int finished;
+};
+
+static int PBJFragmentedMP4MuxerWrite(PBJFragmentedMP4Muxer *muxer, const void *bytes, size_t length)
+{
+    if (muxer->failed)
+        return 0;
+    if (length > 0 && !muxer->write(muxer->context, bytes, length)) {
+        muxer->failed = 1;
+        return 0;
+    }
+    muxer->bytesWritten += length;
+    return 1;
+}
+
+#pragma mark - init segment
+
+static void PBJMP4AppendMatrix(PBJMP4Buffer *buffer, int32_t rotation, uint16_t width, uint16_t height)
+{
+    // {a b u c d v x y w}, a-d and x/y are 16.16, u/v/w are 2.30
+    int32_t a = 0x00010000, b = 0, c = 0, d = 0x00010000, x = 0, y = 0;
+    int32_t quarterTurns = ((rotation / 90) % 4 + 4) % 4;
+    switch (quarterTurns) {
+        case 1:
+            a = 0; b = 0x00010000; c = -0x00010000; d = 0; x = (int32_t)height << 16;
+            break;
+        case 2:
+            a = -0x00010000; d = -0x00010000; x = (int32_t)width << 16; y = (int32_t)height << 16;
+            break;
+        case 3:
+            a = 0; b = -0x00010000; c = 0x00010000; d = 0; y = (int32_t)width << 16;
+            break;
+        default:
+            break;
+    }
+    int32_t matrix[9] = { a, b, 0, c, d, 0, x, y, 0x40000000 };
+    for (int i = 0; i < 9; i++) {
+        PBJMP4BufferAppendU32(buffer, (uint32_t)matrix[i]);
+    }
+}
+
+static void PBJMP4AppendDescriptorHeader(PBJMP4Buffer *buffer, uint8_t tag, size_t length)
+{
+    // four byte length form, accepted by every parser and independent of the payload size
+    PBJMP4BufferAppendU8(buffer, tag);
+    PBJMP4BufferAppendU8(buffer, (uint8_t)(0x80 | ((length >> 21) & 0x7f)));
+    PBJMP4BufferAppendU8(buffer, (uint8_t)(0x80 | ((length >> 14) & 0x7f)));
+    PBJMP4BufferAppendU8(buffer, (uint8_t)(0x80 | ((length >> 7) & 0x7f)));
+    PBJMP4BufferAppendU8(buffer, (uint8_t)(length & 0x7f));
+}
+
+static void PBJMP4AppendVideoSampleEntry(PBJMP4Buffer *buffer, const PBJFragmentedMP4VideoTrack *video)
+{
+    size_t avc1 = PBJMP4BeginBox(buffer, "avc1");
+    PBJMP4BufferAppendZeros(buffer, 6);
+    PBJMP4BufferAppendU16(buffer, 1); // data reference index
+    PBJMP4BufferAppendZeros(buffer, 16);
+    PBJMP4BufferAppendU16(buffer, video->width);
+    PBJMP4BufferAppendU16(buffer, video->height);
+    PBJMP4BufferAppendU32(buffer, 0x00480000); // 72 dpi
+    PBJMP4BufferAppendU32(buffer, 0x00480000);
+    PBJMP4BufferAppendU32(buffer, 0);
+    PBJMP4BufferAppendU16(buffer, 1); // frame count
+    PBJMP4BufferAppendZeros(buffer, 32); // compressor name
+    PBJMP4BufferAppendU16(buffer, 0x0018); // depth
+    PBJMP4BufferAppendU16(buffer, 0xffff);
+    size_t avcC = PBJMP4BeginBox(buffer, "avcC");
+    PBJMP4BufferAppend(buffer, video->avcC, video->avcCSize);
+    PBJMP4EndBox(buffer, avcC);
+    PBJMP4EndBox(buffer, avc1);
+}
+
+static void PBJMP4AppendAudioSampleEntry(PBJMP4Buffer *buffer, const PBJFragmentedMP4AudioTrack *audio)
+{
+    size_t mp4a = PBJMP4BeginBox(buffer, "mp4a");
+    PBJMP4BufferAppendZeros(buffer, 6);
+    PBJMP4BufferAppendU16(buffer, 1); // data reference index
+    PBJMP4BufferAppendZeros(buffer, 8);
+    PBJMP4BufferAppendU16(buffer, audio->channelCount);
+    PBJMP4BufferAppendU16(buffer, 16); // sample size
+    PBJMP4BufferAppendZeros(buffer, 4);
+    PBJMP4BufferAppendU32(buffer, audio->sampleRate << 16);
+
+    size_t esds = PBJMP4BeginFullBox(buffer, "esds", 0, 0);
+    size_t decoderSpecificInfoLength = 5 + audio->audioSpecificConfigSize;
+    size_t decoderConfigLength = 13 + decoderSpecificInfoLength;
+    size_t esLength = 3 + (5 + decoderConfigLength) + (5 + 1);
+    PBJMP4AppendDescriptorHeader(buffer, 0x03, esLength); // ES_Descriptor
+    PBJMP4BufferAppendU16(buffer, 0); // ES_ID
+    PBJMP4BufferAppendU8(buffer, 0);
+    PBJMP4AppendDescriptorHeader(buffer, 0x04, decoderConfigLength); // DecoderConfigDescriptor
+    PBJMP4BufferAppendU8(buffer, 0x40); // MPEG-4 audio
+    PBJMP4BufferAppendU8(buffer, (0x05 << 2) | 1); // audio stream
+    PBJMP4BufferAppendU24(buffer, 0); // buffer size
+    PBJMP4BufferAppendU32(buffer, audio->averageBitRate); // maximum
+    PBJMP4BufferAppendU32(buffer, audio->averageBitRate);
+    PBJMP4AppendDescriptorHeader(buffer, 0x05, audio->audioSpecificConfigSize); // DecoderSpecificInfo
+    PBJMP4BufferAppend(buffer, audio->audioSpecificConfig, audio->audioSpecificConfigSize);
+    PBJMP4AppendDescriptorHeader(buffer, 0x06, 1); // SLConfigDescriptor
+    PBJMP4BufferAppendU8(buffer, 0x02);
+    PBJMP4EndBox(buffer, esds);
+
+    PBJMP4EndBox(buffer, mp4a);
+}
+
+static void PBJMP4AppendTrack(PBJFragmentedMP4Muxer *muxer, PBJMP4Buffer *buffer, PBJFragmentedMP4Track track)
+{
+    int isVideo = (track == PBJFragmentedMP4TrackVideo);
+    const PBJMP4TrackState *state = &muxer->tracks[track];
+
+    size_t trak = PBJMP4BeginBox(buffer, "trak");
+
+    size_t tkhd = PBJMP4BeginFullBox(buffer, "tkhd", 0, 0x3); // enabled, in movie
+    PBJMP4BufferAppendU32(buffer, 0); // creation time
+    PBJMP4BufferAppendU32(buffer, 0); // modification time
+    PBJMP4BufferAppendU32(buffer, state->trackID);
+    PBJMP4BufferAppendU32(buffer, 0);
+    PBJMP4BufferAppendU32(buffer, 0); // duration, carried by the fragments
+    PBJMP4BufferAppendZeros(buffer, 8);
+    PBJMP4BufferAppendU16(buffer, 0); // layer
+    PBJMP4BufferAppendU16(buffer, isVideo ? 0 : 1); // alternate group
+    PBJMP4BufferAppendU16(buffer, isVideo ? 0 : 0x0100); // volume
+    PBJMP4BufferAppendU16(buffer, 0);
+    if (isVideo) {
+        PBJMP4AppendMatrix(buffer, muxer->video.rotation, muxer->video.width, muxer->video.height);
+        PBJMP4BufferAppendU32(buffer, (uint32_t)muxer->video.width << 16);
+        PBJMP4BufferAppendU32(buffer, (uint32_t)muxer->video.height << 16);
+    } else {
+        PBJMP4AppendMatrix(buffer, 0, 0, 0);
+        PBJMP4BufferAppendU32(buffer, 0);
+        PBJMP4BufferAppendU32(buffer, 0);
+    }
+    PBJMP4EndBox(buffer, tkhd);
+
+    // priming plays from media time primingFrames, for the whole track as fragments are free to
+    // extend it (a zero segment duration in a fragmented file, ISO/IEC 14496-12 8.6.6)
+    if (!isVideo && muxer->audio.primingFrames > 0) {
+        size_t edts = PBJMP4BeginBox(buffer, "edts");
+        size_t elst = PBJMP4BeginFullBox(buffer, "elst", 0, 0);
+        PBJMP4BufferAppendU32(buffer, 1);
+        PBJMP4BufferAppendU32(buffer, 0); // segment duration
+        PBJMP4BufferAppendU32(buffer, muxer->audio.primingFrames); // media time
+        PBJMP4BufferAppendU16(buffer, 1); // rate
+        PBJMP4BufferAppendU16(buffer, 0);
+        PBJMP4EndBox(buffer, elst);
+        PBJMP4EndBox(buffer, edts);
+    }
+
+    size_t mdia = PBJMP4BeginBox(buffer, "mdia");
+
+    size_t mdhd = PBJMP4BeginFullBox(buffer, "mdhd", 0, 0);
+    PBJMP4BufferAppendU32(buffer, 0);
+    PBJMP4BufferAppendU32(buffer, 0);
+    PBJMP4BufferAppendU32(buffer, state->timescale);
+    PBJMP4BufferAppendU32(buffer, 0);
+    PBJMP4BufferAppendU16(buffer, 0x55c4); // 'und'
+    PBJMP4BufferAppendU16(buffer, 0);
+    PBJMP4EndBox(buffer, mdhd);
+
+    size_t hdlr = PBJMP4BeginFullBox(buffer, "hdlr", 0, 0);
+    PBJMP4BufferAppendU32(buffer, 0);
+    PBJMP4BufferAppendFourCC(buffer, isVideo ? "vide" : "soun");
+    PBJMP4BufferAppendZeros(buffer, 12);
+    const char *name = isVideo ? "VideoHandler" : "SoundHandler";
+    PBJMP4BufferAppend(buffer, name, strlen(name) + 1);
+    PBJMP4EndBox(buffer, hdlr);
+
+    size_t minf = PBJMP4BeginBox(buffer, "minf");
+    if (isVideo) {
+        size_t vmhd = PBJMP4BeginFullBox(buffer, "vmhd", 0, 1);
+        PBJMP4BufferAppendZeros(buffer, 8);
+        PBJMP4EndBox(buffer, vmhd);
+    } else {
+        size_t smhd = PBJMP4BeginFullBox(buffer, "smhd", 0, 0);
+        PBJMP4BufferAppendZeros(buffer, 4);
+        PBJMP4EndBox(buffer, smhd);
+    }
+
+    size_t dinf = PBJMP4BeginBox(buffer, "dinf");
+    size_t dref = PBJMP4BeginFullBox(buffer, "dref", 0, 0);
+    PBJMP4BufferAppendU32(buffer, 1);
+    size_t url = PBJMP4BeginFullBox(buffer, "url ", 0, 1); // media is in this file
+    PBJMP4EndBox(buffer, url);
+    PBJMP4EndBox(buffer, dref);
+    PBJMP4EndBox(buffer, dinf);
+
+    // sample tables stay empty, every sample lives in a fragment
+    size_t stbl = PBJMP4BeginBox(buffer, "stbl");
+    size_t stsd = PBJMP4BeginFullBox(buffer, "stsd", 0, 0);
+    PBJMP4BufferAppendU32(buffer, 1);
+    if (isVideo) {
+        PBJMP4AppendVideoSampleEntry(buffer, &muxer->video);
+    } else {
+        PBJMP4AppendAudioSampleEntry(buffer, &muxer->audio);
+    }
+    PBJMP4EndBox(buffer, stsd);
+    const char *emptyTables[] = { "stts", "stsc", "stco" };
+    for (size_t i = 0; i < sizeof(emptyTables) / sizeof(emptyTables[0]); i++) {
+        size_t table = PBJMP4BeginFullBox(buffer, emptyTables[i], 0, 0);
+        PBJMP4BufferAppendU32(buffer, 0);
+        PBJMP4EndBox(buffer, table);
+    }
+    size_t stsz = PBJMP4BeginFullBox(buffer, "stsz", 0, 0);
+    PBJMP4BufferAppendU32(buffer, 0);
+    PBJMP4BufferAppendU32(buffer, 0);
+    PBJMP4EndBox(buffer, stsz);
+    PBJMP4EndBox(buffer, stbl);
+
+    PBJMP4EndBox(buffer, minf);
+    PBJMP4EndBox(buffer, mdia);
+    PBJMP4EndBox(buffer, trak);
+}
+
+static int PBJFragmentedMP4MuxerWriteInitSegment(PBJFragmentedMP4Muxer *muxer)
+{
+    PBJMP4Buffer *buffer = &muxer->header;
+    buffer->length = 0;
+
+    size_t ftyp = PBJMP4BeginBox(buffer, "ftyp");
+    PBJMP4BufferAppendFourCC(buffer, "isom");
+    PBJMP4BufferAppendU32(buffer, 0x200);
+    PBJMP4BufferAppendFourCC(buffer, "isom");
+    PBJMP4BufferAppendFourCC(buffer, "iso6");
+    if (muxer->tracks[PBJFragmentedMP4TrackVideo].enabled)
+        PBJMP4BufferAppendFourCC(buffer, "avc1");
+    PBJMP4BufferAppendFourCC(buffer, "mp41");
+    PBJMP4EndBox(buffer, ftyp);
+
+    size_t moov = PBJMP4BeginBox(buffer, "moov");
+
+    size_t mvhd = PBJMP4BeginFullBox(buffer, "mvhd", 0, 0);
+    PBJMP4BufferAppendU32(buffer, 0);
+    PBJMP4BufferAppendU32(buffer, 0);
+    PBJMP4BufferAppendU32(buffer, 1000); // timescale
+    PBJMP4BufferAppendU32(buffer, 0); // duration
+    PBJMP4BufferAppendU32(buffer, 0x00010000); // rate
+    PBJMP4BufferAppendU16(buffer, 0x0100); // volume
+    PBJMP4BufferAppendZeros(buffer, 10);
+    PBJMP4AppendMatrix(buffer, 0, 0, 0);
+    PBJMP4BufferAppendZeros(buffer, 24);
+    uint32_t nextTrackID = 1;
+    for (int track = 0; track < PBJFragmentedMP4TrackCount; track++) {
+        if (muxer->tracks[track].enabled)
+            nextTrackID = muxer->tracks[track].trackID + 1;
+    }
+    PBJMP4BufferAppendU32(buffer, nextTrackID);
+    PBJMP4EndBox(buffer, mvhd);
+
+    for (int track = 0; track < PBJFragmentedMP4TrackCount; track++) {
+        if (muxer->tracks[track].enabled)
+            PBJMP4AppendTrack(muxer, buffer, (PBJFragmentedMP4Track)track);
+    }
+
+    size_t mvex = PBJMP4BeginBox(buffer, "mvex");
+    for (int track = 0; track < PBJFragmentedMP4TrackCount; track++) {
+        if (!muxer->tracks[track].enabled)
+            continue;
+        size_t trex = PBJMP4BeginFullBox(buffer, "trex", 0, 0);
+        PBJMP4BufferAppendU32(buffer, muxer->tracks[track].trackID);
+        PBJMP4BufferAppendU32(buffer, 1); // sample description index
+        PBJMP4BufferAppendU32(buffer, 0);
+        PBJMP4BufferAppendU32(buffer, 0);
+        PBJMP4BufferAppendU32(buffer, 0);
+        PBJMP4EndBox(buffer, trex);
+    }
+    PBJMP4EndBox(buffer, mvex);
+
+    PBJMP4EndBox(buffer, moov);
+
+    if (buffer->failed)
+        return 0;
+    return PBJFragmentedMP4MuxerWrite(muxer, buffer->bytes, buffer->length);
+}
+
+#pragma mark - init
+
+PBJFragmentedMP4Muxer *PBJFragmentedMP4MuxerCreate(const PBJFragmentedMP4Configuration *configuration,
+                                                   PBJFragmentedMP4WriteFunction write, void *context)
+{
+    if (!configuration || !write || (!configuration->video && !configuration->audio))
+        return NULL;
+    if (configuration->video && (!configuration->video->timescale || !configuration->video->avcC || !configuration->video->avcCSize))
+        return NULL;
+    if (configuration->audio && (!configuration->audio->sampleRate || configuration->audio->sampleRate > 0xffff ||
+                                 !configuration->audio->audioSpecificConfig || !configuration->audio->audioSpecificConfigSize ||
+                                 configuration->audio->primingFrames > INT32_MAX))
+        return NULL;
+
+    PBJFragmentedMP4Muxer *muxer = (PBJFragmentedMP4Muxer *)calloc(1, sizeof(PBJFragmentedMP4Muxer));
+    if (!muxer)
+        return NULL;
+
+    muxer->write = write;
+    muxer->context = context;
+    muxer->fragmentDuration = configuration->fragmentDuration;
+
+    uint32_t trackID = 1;
+    if (configuration->video) {
+        muxer->video = *configuration->video;
+        muxer->avcC = (uint8_t *)malloc(muxer->video.avcCSize);
+        if (!muxer->avcC)
+            goto fail;
+        memcpy(muxer->avcC, configuration->video->avcC, muxer->video.avcCSize);
+        muxer->video.avcC = muxer->avcC;
+
+        PBJMP4TrackState *state = &muxer->tracks[PBJFragmentedMP4TrackVideo];
+        state->enabled = 1;
+        state->trackID = trackID++;
+        state->timescale = muxer->video.timescale;
+    }
+    if (configuration->audio) {
+        muxer->audio = *configuration->audio;
+        muxer->audioSpecificConfig = (uint8_t *)malloc(muxer->audio.audioSpecificConfigSize);
+        if (!muxer->audioSpecificConfig)
+            goto fail;
+        memcpy(muxer->audioSpecificConfig, configuration->audio->audioSpecificConfig, muxer->audio.audioSpecificConfigSize);
+        muxer->audio.audioSpecificConfig = muxer->audioSpecificConfig;
+
+        PBJMP4TrackState *state = &muxer->tracks[PBJFragmentedMP4TrackAudio];
+        state->enabled = 1;
+        state->trackID = trackID++;
+        state->timescale = muxer->audio.sampleRate;
+    }
+
+    if (!PBJFragmentedMP4MuxerWriteInitSegment(muxer))
+        goto fail;
+
+    return muxer;
+
+fail:
+    PBJFragmentedMP4MuxerDestroy(muxer);
+    return NULL;
+}
+
+void PBJFragmentedMP4MuxerDestroy(PBJFragmentedMP4Muxer *muxer)
+{
+    if (!muxer)
+        return;
+    for (int track = 0; track < PBJFragmentedMP4TrackCount; track++) {
+        free(muxer->tracks[track].samples);
+        free(muxer->tracks[track].data.bytes);
+    }
+    free(muxer->header.bytes);
+    free(muxer->avcC);
+    free(muxer->audioSpecificConfig);
+    free(muxer);
+}
+
+#pragma mark - fragments
+
+static uint32_t PBJFragmentedMP4MuxerDefaultDuration(const PBJFragmentedMP4Muxer *muxer, PBJFragmentedMP4Track track)
+{
+    const PBJMP4TrackState *state = &muxer->tracks[track];
+    if (state->lastDuration)
+        return state->lastDuration;
+    return track == PBJFragmentedMP4TrackVideo ? state->timescale / 30 : 1024;
+}
+
+int PBJFragmentedMP4MuxerFlush(PBJFragmentedMP4Muxer *muxer)
+{
+    if (muxer->failed)
+        return 0;
+
+    size_t trackCount = 0;
+    uint64_t dataLength = 0;
+    for (int track = 0; track < PBJFragmentedMP4TrackCount; track++) {
+        PBJMP4TrackState *state = &muxer->tracks[track];
+        if (state->sampleCount == 0)
+            continue;
+        trackCount++;
+        dataLength += state->data.length;
+
+        // unless its successor already arrived, the last sample has nothing to measure against
+        PBJMP4SampleEntry *last = &state->samples[state->sampleCount - 1];
+        if (last->duration == 0) {
+            last->duration = state->finalDuration ? state->finalDuration : PBJFragmentedMP4MuxerDefaultDuration(muxer, (PBJFragmentedMP4Track)track);
+            state->lastDuration = last->duration;
+        }
+    }
+    if (trackCount == 0)
+        return 1;
+    if (dataLength + 8 > UINT32_MAX) {
+        muxer->failed = 1;
+        return 0;
+    }
+
+    PBJMP4Buffer *buffer = &muxer->header;
+    buffer->length = 0;
+    muxer->sequenceNumber++;
+
+    size_t moof = PBJMP4BeginBox(buffer, "moof");
+    size_t mfhd = PBJMP4BeginFullBox(buffer, "mfhd", 0, 0);
+    PBJMP4BufferAppendU32(buffer, muxer->sequenceNumber);
+    PBJMP4EndBox(buffer, mfhd);
+
+    size_t dataOffsetFields[PBJFragmentedMP4TrackCount] = { 0 };
+    for (int track = 0; track < PBJFragmentedMP4TrackCount; track++) {
+        PBJMP4TrackState *state = &muxer->tracks[track];
+        if (state->sampleCount == 0)
+            continue;
+
+        size_t traf = PBJMP4BeginBox(buffer, "traf");
+
+        size_t tfhd = PBJMP4BeginFullBox(buffer, "tfhd", 0, PBJ_MP4_TFHD_DEFAULT_BASE_IS_MOOF);
+        PBJMP4BufferAppendU32(buffer, state->trackID);
+        PBJMP4EndBox(buffer, tfhd);
+
+        size_t tfdt = PBJMP4BeginFullBox(buffer, "tfdt", 1, 0);
+        PBJMP4BufferAppendU64(buffer, (uint64_t)state->samples[0].decodeTime);
+        PBJMP4EndBox(buffer, tfdt);
+
+        size_t trun = PBJMP4BeginFullBox(buffer, "trun", 1, PBJ_MP4_TRUN_FLAGS);
+        PBJMP4BufferAppendU32(buffer, (uint32_t)state->sampleCount);
+        dataOffsetFields[track] = buffer->length;
+        PBJMP4BufferAppendU32(buffer, 0); // patched below
+        for (size_t i = 0; i < state->sampleCount; i++) {
+            const PBJMP4SampleEntry *sample = &state->samples[i];
+            PBJMP4BufferAppendU32(buffer, sample->duration);
+            PBJMP4BufferAppendU32(buffer, sample->size);
+            PBJMP4BufferAppendU32(buffer, sample->flags);
+            PBJMP4BufferAppendU32(buffer, (uint32_t)sample->compositionOffset);
+        }
+        PBJMP4EndBox(buffer, trun);
+
+        PBJMP4EndBox(buffer, traf);
+    }
+    PBJMP4EndBox(buffer, moof);
+
+    PBJMP4BufferAppendU32(buffer, (uint32_t)(dataLength + 8));
+    PBJMP4BufferAppendFourCC(buffer, "mdat");
+    if (buffer->failed) {
+        muxer->failed = 1;
+        return 0;
+    }
+
+    // track data follows the mdat header in track order, offsets are from the start of moof
+    uint32_t dataOffset = (uint32_t)(buffer->length - moof);
+    for (int track = 0; track < PBJFragmentedMP4TrackCount; track++) {
+        PBJMP4TrackState *state = &muxer->tracks[track];
+        if (state->sampleCount == 0)
+            continue;
+        uint8_t *field = buffer->bytes + dataOffsetFields[track];
+        field[0] = (uint8_t)(dataOffset >> 24);
+        field[1] = (uint8_t)(dataOffset >> 16);
+        field[2] = (uint8_t)(dataOffset >> 8);
+        field[3] = (uint8_t)dataOffset;
+        dataOffset += (uint32_t)state->data.length;
+    }
+
+    if (!PBJFragmentedMP4MuxerWrite(muxer, buffer->bytes, buffer->length))
+        return 0;
+    for (int track = 0; track < PBJFragmentedMP4TrackCount; track++) {
+        PBJMP4TrackState *state = &muxer->tracks[track];
+        if (state->sampleCount == 0)
+            continue;
+        if (!PBJFragmentedMP4MuxerWrite(muxer, state->data.bytes, state->data.length))
+            return 0;
+        state->sampleCount = 0;
+        state->data.length = 0;
+        state->finalDuration = 0;
+    }
+    return 1;
+}
+
+static int PBJFragmentedMP4MuxerShouldFlushBefore(const PBJFragmentedMP4Muxer *muxer, PBJFragmentedMP4Track track, int64_t decodeTime, int isSync)
+{
+    int hasVideo = muxer->tracks[PBJFragmentedMP4TrackVideo].enabled;
+    PBJFragmentedMP4Track clockTrack = hasVideo ? PBJFragmentedMP4TrackVideo : PBJFragmentedMP4TrackAudio;
+    const PBJMP4TrackState *state = &muxer->tracks[clockTrack];
+    if (track != clockTrack || state->sampleCount == 0)
+        return 0;
+
+    // fragment duration in milliseconds against the track's timescale, without overflow for any sane clip
+    int64_t elapsed = decodeTime - state->samples[0].decodeTime;
+    int64_t interval = (int64_t)muxer->fragmentDuration * state->timescale;
+    int64_t elapsedMilliseconds = elapsed * 1000;
+
+    if (hasVideo && isSync)
+        return elapsedMilliseconds >= interval;
+    if (!hasVideo)
+        return elapsedMilliseconds >= interval;
+    return muxer->fragmentDuration > 0 && elapsedMilliseconds >= interval * PBJ_MP4_MAXIMUM_FRAGMENT_INTERVALS;
+}
+
+int PBJFragmentedMP4MuxerAppendSample(PBJFragmentedMP4Muxer *muxer, PBJFragmentedMP4Track track,
+                                      const uint8_t *data, size_t size, int64_t decodeTime,
+                                      int32_t compositionOffset, uint32_t duration, int isSync)
+{
+    if (muxer->failed || muxer->finished || track < 0 || track >= PBJFragmentedMP4TrackCount)
+        return 0;
+
+    PBJMP4TrackState *state = &muxer->tracks[track];
+    if (!state->enabled || !data || size == 0 || size > UINT32_MAX || decodeTime < 0)
+        return 0;
+    if (state->hasLastSample && decodeTime <= state->lastDecodeTime)
+        return 0;
+
+    // the previous sample lasts until this one
+    if (state->sampleCount > 0) {
+        PBJMP4SampleEntry *previous = &state->samples[state->sampleCount - 1];
+        int64_t previousDuration = decodeTime - previous->decodeTime;
+        if (previousDuration > UINT32_MAX)
+            return 0;
+        previous->duration = (uint32_t)previousDuration;
+        state->lastDuration = previous->duration;
+    }
+
+    if (PBJFragmentedMP4MuxerShouldFlushBefore(muxer, track, decodeTime, isSync)) {
+        if (!PBJFragmentedMP4MuxerFlush(muxer))
+            return 0;
+    }
+
+    if (state->sampleCount == state->sampleCapacity) {
+        size_t capacity = state->sampleCapacity ? state->sampleCapacity * 2 : 64;
+        PBJMP4SampleEntry *samples = (PBJMP4SampleEntry *)realloc(state->samples, capacity * sizeof(PBJMP4SampleEntry));
+        if (!samples) {
+            muxer->failed = 1;
+            return 0;
+        }
+        state->samples = samples;
+        state->sampleCapacity = capacity;
+    }
+
+    PBJMP4BufferAppend(&state->data, data, size);
+    if (state->data.failed) {
+        muxer->failed = 1;
+        return 0;
+    }
+
+    PBJMP4SampleEntry *sample = &state->samples[state->sampleCount++];
+    sample->decodeTime = decodeTime;
+    sample->size = (uint32_t)size;
+    sample->duration = 0;
+    sample->compositionOffset = compositionOffset;
+    sample->flags = (track == PBJFragmentedMP4TrackAudio || isSync) ? PBJ_MP4_SAMPLE_FLAGS_SYNC : PBJ_MP4_SAMPLE_FLAGS_NON_SYNC;
+    state->finalDuration = duration;
+    state->hasLastSample = 1;
+    state->lastDecodeTime = decodeTime;
+    return 1;
+}
+
+int PBJFragmentedMP4MuxerFinish(PBJFragmentedMP4Muxer *muxer)
+{
+    if (muxer->finished)
+        return !muxer->failed;
+    int result = PBJFragmentedMP4MuxerFlush(muxer);
+    muxer->finished = 1;
+    return result;
+}
+
+#pragma mark - queries
+
+int PBJFragmentedMP4MuxerHasFailed(const PBJFragmentedMP4Muxer *muxer)
+{
+    return muxer->failed;
+}
+
+uint32_t PBJFragmentedMP4MuxerGetFragmentCount(const PBJFragmentedMP4Muxer *muxer)
+{
+    return muxer->sequenceNumber;
+}
+
+uint64_t PBJFragmentedMP4MuxerGetBytesWritten(const PBJFragmentedMP4Muxer *muxer)
+{
+    return muxer->bytesWritten;
+}
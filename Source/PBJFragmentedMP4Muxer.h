@@ -0,0 +1,103 @@
+//
+//  PBJFragmentedMP4Muxer.h
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef PBJFragmentedMP4Muxer_h
+#define PBJFragmentedMP4Muxer_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// streaming ISO-BMFF (fragmented MP4) writer for H.264 and AAC access units. the
+// ftyp and moov boxes are written up front, samples follow as moof/mdat fragments,
+// so finishing costs one fragment and a file cut short stays playable up to its
+// last complete fragment. only the fragment being built is held in memory
+
+typedef struct {
+    uint32_t timescale; // ie 90000
+    uint16_t width;
+    uint16_t height;
+    int32_t rotation; // degrees clockwise, a multiple of 90
+    const uint8_t *avcC; // AVCDecoderConfigurationRecord
+    size_t avcCSize;
+} PBJFragmentedMP4VideoTrack;
+
+typedef struct {
+    uint32_t sampleRate; // also the timescale, below 65536
+    uint16_t channelCount;
+    uint32_t averageBitRate; // optional
+    const uint8_t *audioSpecificConfig;
+    size_t audioSpecificConfigSize;
+    // encoder delay (ie 2112 for AAC) at the head of the media, an edit list leaves it out of
+    // playback so the first decode time plays at the track's start. 0 for none
+    uint32_t primingFrames;
+} PBJFragmentedMP4AudioTrack;
+
+typedef struct {
+    const PBJFragmentedMP4VideoTrack *video; // NULL for none
+    const PBJFragmentedMP4AudioTrack *audio; // NULL for none
+    uint32_t fragmentDuration; // milliseconds, fragments start at the first video keyframe past it, 0 for every keyframe
+} PBJFragmentedMP4Configuration;
+
+typedef enum {
+    PBJFragmentedMP4TrackVideo = 0,
+    PBJFragmentedMP4TrackAudio,
+    PBJFragmentedMP4TrackCount
+} PBJFragmentedMP4Track;
+
+// returns nonzero when all bytes were written
+typedef int (*PBJFragmentedMP4WriteFunction)(void *context, const void *bytes, size_t length);
+
+typedef struct PBJFragmentedMP4Muxer PBJFragmentedMP4Muxer;
+
+// writes the ftyp and moov boxes, the track descriptions are copied
+PBJFragmentedMP4Muxer *PBJFragmentedMP4MuxerCreate(const PBJFragmentedMP4Configuration *configuration,
+                                                   PBJFragmentedMP4WriteFunction write, void *context);
+void PBJFragmentedMP4MuxerDestroy(PBJFragmentedMP4Muxer *muxer);
+
+// decode times are in the track's timescale and must increase, each sample lasts until
+// the next on its track, duration (0 to repeat the last) only applies to a track's final
+// sample. returns 0 if the sample was rejected or a write failed
+int PBJFragmentedMP4MuxerAppendSample(PBJFragmentedMP4Muxer *muxer, PBJFragmentedMP4Track track,
+                                      const uint8_t *data, size_t size, int64_t decodeTime,
+                                      int32_t compositionOffset, uint32_t duration, int isSync);
+
+// writes buffered samples as a fragment now
+int PBJFragmentedMP4MuxerFlush(PBJFragmentedMP4Muxer *muxer);
+
+// writes the last fragment, the file is complete afterwards
+int PBJFragmentedMP4MuxerFinish(PBJFragmentedMP4Muxer *muxer);
+
+int PBJFragmentedMP4MuxerHasFailed(const PBJFragmentedMP4Muxer *muxer);
+uint32_t PBJFragmentedMP4MuxerGetFragmentCount(const PBJFragmentedMP4Muxer *muxer);
+uint64_t PBJFragmentedMP4MuxerGetBytesWritten(const PBJFragmentedMP4Muxer *muxer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PBJFragmentedMP4Muxer_h */
@@ -0,0 +1,62 @@
+//
+//  PBJFragmentedMediaWriter.h
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#import <Foundation/Foundation.h>
+#import <AVFoundation/AVFoundation.h>
+
+#import "PBJOutputSink.h"
+
+// encodes H.264 and AAC on the device and streams the access units into a fragmented
+// MP4, finishing writes a single fragment and a recording cut short by a crash stays
+// playable up to its last fragment. not thread safe, use from the writer thread
+@interface PBJFragmentedMediaWriter : NSObject
+
+- (instancetype)initWithOutputURL:(NSURL *)outputURL fragmentInterval:(CMTime)fragmentInterval;
+
+// the file is written through a PBJOutputSink, preallocated, batched and synced as configured
+- (instancetype)initWithOutputURL:(NSURL *)outputURL fragmentInterval:(CMTime)fragmentInterval outputConfiguration:(PBJOutputSinkConfiguration)outputConfiguration;
+
+@property (nonatomic, readonly) NSURL *outputURL;
+@property (nonatomic, readonly) NSError *error;
+
+// space reserved for the file but not yet written, safe from any thread
+@property (nonatomic, readonly) uint64_t unusedPreallocatedBytes;
+
+// the encoder's average bit rate from the next frame, 0 for the one in the video settings, safe from any thread
+@property (nonatomic) double videoBitRate;
+
+@property (nonatomic, readonly, getter=isAudioReady) BOOL audioReady;
+@property (nonatomic, readonly, getter=isVideoReady) BOOL videoReady;
+
+// the same settings dictionaries AVAssetWriterInput takes, rotation in radians
+- (BOOL)setupAudioWithSettings:(NSDictionary *)audioSettings;
+- (BOOL)setupVideoWithSettings:(NSDictionary *)videoSettings rotation:(CGFloat)rotation;
+
+// video sample buffers carry pixel buffers or H.264 access units, audio sample buffers linear PCM
+- (BOOL)appendSampleBuffer:(CMSampleBufferRef)sampleBuffer withMediaTypeVideo:(BOOL)video;
+
+// drains the encoders and writes the last fragment
+- (BOOL)finishWriting;
+
+@end
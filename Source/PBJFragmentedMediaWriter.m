@@ -0,0 +1,596 @@
+//
+//  PBJFragmentedMediaWriter.m
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#import "PBJFragmentedMediaWriter.h"
+#import "PBJFragmentedMP4Muxer.h"
+#import "PBJVisionUtilities.h"
+
+#import <AudioToolbox/AudioToolbox.h>
+#import <VideoToolbox/VideoToolbox.h>
+
+#include <os/lock.h>
+#include <stdatomic.h>
+
+#define LOG_WRITER 0
+#if !defined(NDEBUG) && LOG_WRITER
+#   define DLog(fmt, ...) NSLog((@"fragmented writer: " fmt), ##__VA_ARGS__);
+#else
+#   define DLog(...)
+#endif
+
+static int32_t const PBJFragmentedMediaWriterVideoTimescale = 90000;
+static UInt32 const PBJFragmentedMediaWriterAACFramesPerPacket = 1024;
+// the media time the audio edit list starts playback at, the AAC encoder's usual priming. packets
+// are placed so the converter's actual leading frames end exactly there
+static UInt32 const PBJFragmentedMediaWriterAACPrimingFrames = 2112;
+static OSStatus const PBJFragmentedMediaWriterNoMoreInput = 'pbjn';
+
+@interface PBJFragmentedMediaWriter ()
+{
+    NSURL *_outputURL;
+    NSError *_error;
+    CMTime _fragmentInterval;
+
+    // the muxer is fed from the writer thread (audio) and the compression callback (video),
+    // the sink is its single producer under the same lock
+    os_unfair_lock _muxerLock;
+    PBJFragmentedMP4Muxer *_muxer;
+    PBJOutputSink *_sink;
+    uint32_t _sinkFragmentCount;
+    CMTime _sessionStartTime;
+
+    // video
+    BOOL _videoConfigured;
+    NSDictionary *_videoSettings;
+    VTCompressionSessionRef _compressionSession;
+    int32_t _videoWidth;
+    int32_t _videoHeight;
+    int32_t _videoRotation;
+    NSMutableData *_videoScratch;
+    _Atomic(uint64_t) _requestedVideoBitRate;
+    uint64_t _appliedVideoBitRate; // writer thread
+
+    // audio, PCM is collected until a full AAC packet can be encoded
+    BOOL _audioConfigured;
+    Float64 _audioSampleRate;
+    UInt32 _audioChannels;
+    UInt32 _audioBitRate;
+    NSData *_audioSpecificConfig;
+    AudioConverterRef _audioConverter;
+    AudioStreamBasicDescription _pcmFormat;
+    NSMutableData *_pcmBuffer;
+    NSUInteger _pcmReadOffset;
+    int64_t _pcmHeadFrame;
+    int64_t _aacPrimingAdjustment; // edit list start less the converter's leading frames
+    NSMutableData *_aacPacket;
+    NSMutableArray *_pendingAudioPackets;
+}
+
+- (void)_muxVideoSampleBuffer:(CMSampleBufferRef)sampleBuffer;
+- (OSStatus)_providePCMPackets:(UInt32 *)packetCount bufferList:(AudioBufferList *)bufferList;
+
+@end
+
+@implementation PBJFragmentedMediaWriter
+
+@synthesize outputURL = _outputURL;
+@synthesize error = _error;
+
+#pragma mark - getters/setters
+
+- (BOOL)isAudioReady
+{
+    return _audioConfigured;
+}
+
+- (BOOL)isVideoReady
+{
+    return _videoConfigured;
+}
+
+- (double)videoBitRate
+{
+    return (double)atomic_load_explicit(&_requestedVideoBitRate, memory_order_relaxed);
+}
+
+- (void)setVideoBitRate:(double)videoBitRate
+{
+    atomic_store_explicit(&_requestedVideoBitRate, videoBitRate > 0 ? (uint64_t)videoBitRate : 0, memory_order_relaxed);
+}
+
+- (uint64_t)unusedPreallocatedBytes
+{
+    PBJOutputSinkStatistics statistics;
+    os_unfair_lock_lock(&_muxerLock);
+    PBJOutputSinkGetStatistics(_sink, &statistics);
+    os_unfair_lock_unlock(&_muxerLock);
+    return statistics.preallocatedBytes > statistics.bytesWritten ? statistics.preallocatedBytes - statistics.bytesWritten : 0;
+}
+
+#pragma mark - init
+
+- (instancetype)initWithOutputURL:(NSURL *)outputURL fragmentInterval:(CMTime)fragmentInterval
+{
+    return [self initWithOutputURL:outputURL fragmentInterval:fragmentInterval outputConfiguration:PBJOutputSinkDefaultConfiguration()];
+}
+
+- (instancetype)initWithOutputURL:(NSURL *)outputURL fragmentInterval:(CMTime)fragmentInterval outputConfiguration:(PBJOutputSinkConfiguration)outputConfiguration
+{
+    self = [super init];
+    if (self) {
+        _sink = PBJOutputSinkCreateFile(outputURL.fileSystemRepresentation, &outputConfiguration);
+        if (!_sink) {
+            DLog(@"error opening (%@)", outputURL);
+            return nil;
+        }
+        _outputURL = outputURL;
+        _fragmentInterval = fragmentInterval;
+        _muxerLock = OS_UNFAIR_LOCK_INIT;
+        _sessionStartTime = kCMTimeInvalid;
+        _videoScratch = [[NSMutableData alloc] init];
+        _pcmBuffer = [[NSMutableData alloc] init];
+        _aacPacket = [[NSMutableData alloc] init];
+        _pendingAudioPackets = [[NSMutableArray alloc] init];
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    [self _destroyEncoders];
+    PBJFragmentedMP4MuxerDestroy(_muxer);
+    _muxer = NULL;
+    PBJOutputSinkDestroy(_sink);
+    _sink = NULL;
+}
+
+- (void)_destroyEncoders
+{
+    if (_compressionSession) {
+        VTCompressionSessionInvalidate(_compressionSession);
+        CFRelease(_compressionSession);
+        _compressionSession = NULL;
+    }
+    if (_audioConverter) {
+        AudioConverterDispose(_audioConverter);
+        _audioConverter = NULL;
+    }
+}
+
+#pragma mark - errors
+
+- (void)_failWithStatus:(OSStatus)status
+{
+    if (!_error) {
+        _error = [NSError errorWithDomain:NSOSStatusErrorDomain code:status userInfo:nil];
+        DLog(@"failed with status (%d)", (int)status);
+    }
+}
+
+#pragma mark - setup
+
+// AAC LC AudioSpecificConfig, ISO/IEC 14496-3 1.6.2.1
+static NSData *PBJFragmentedMediaWriterAudioSpecificConfig(Float64 sampleRate, UInt32 channels)
+{
+    static const Float64 sampleRates[] = { 96000, 88200, 64000, 48000, 44100, 32000, 24000, 22050, 16000, 12000, 11025, 8000, 7350 };
+    uint8_t frequencyIndex = 0xf;
+    for (uint8_t i = 0; i < sizeof(sampleRates) / sizeof(sampleRates[0]); i++) {
+        if (sampleRates[i] == sampleRate) {
+            frequencyIndex = i;
+            break;
+        }
+    }
+    if (frequencyIndex == 0xf || channels == 0 || channels > 7)
+        return nil;
+
+    uint8_t config[2];
+    config[0] = (uint8_t)((2 << 3) | (frequencyIndex >> 1));
+    config[1] = (uint8_t)(((frequencyIndex & 1) << 7) | (channels << 3));
+    return [NSData dataWithBytes:config length:sizeof(config)];
+}
+
+- (BOOL)setupAudioWithSettings:(NSDictionary *)audioSettings
+{
+    if (_audioConfigured)
+        return YES;
+
+    _audioSampleRate = [audioSettings[AVSampleRateKey] doubleValue];
+    _audioChannels = (UInt32)[audioSettings[AVNumberOfChannelsKey] unsignedIntegerValue];
+    _audioBitRate = (UInt32)[audioSettings[AVEncoderBitRateKey] unsignedIntegerValue];
+    _audioSpecificConfig = PBJFragmentedMediaWriterAudioSpecificConfig(_audioSampleRate, _audioChannels);
+    if (!_audioSpecificConfig) {
+        DLog(@"unsupported audio format, rate (%f) channels (%u)", _audioSampleRate, (unsigned)_audioChannels);
+        return NO;
+    }
+
+    // the converter needs the capture format, it is created with the first sample buffer
+    _audioConfigured = YES;
+    return YES;
+}
+
+static void PBJFragmentedMediaWriterCompressionOutput(void *outputCallbackRefCon, void *sourceFrameRefCon, OSStatus status,
+                                                      VTEncodeInfoFlags infoFlags, CMSampleBufferRef sampleBuffer)
+{
+    PBJFragmentedMediaWriter *writer = (__bridge PBJFragmentedMediaWriter *)outputCallbackRefCon;
+    if (status != noErr || !sampleBuffer) {
+        DLog(@"compression failed (%d)", (int)status);
+        return;
+    }
+    if (infoFlags & kVTEncodeInfo_FrameDropped)
+        return;
+    [writer _muxVideoSampleBuffer:sampleBuffer];
+}
+
+- (BOOL)setupVideoWithSettings:(NSDictionary *)videoSettings rotation:(CGFloat)rotation
+{
+    if (_videoConfigured)
+        return YES;
+
+    _videoWidth = [videoSettings[AVVideoWidthKey] intValue];
+    _videoHeight = [videoSettings[AVVideoHeightKey] intValue];
+    _videoRotation = (int32_t)lround(rotation * 180.0 / M_PI / 90.0) * 90;
+    if (_videoWidth <= 0 || _videoHeight <= 0)
+        return NO;
+
+    // the encoder is created with the first pixel buffer, already encoded video is muxed as is
+    _videoSettings = [videoSettings copy];
+    _videoConfigured = YES;
+    return YES;
+}
+
+#pragma mark - muxing
+
+// called with the muxer lock held, once the first video access unit carries the decoder configuration
+- (BOOL)_createMuxerWithFormatDescription:(CMFormatDescriptionRef)formatDescription
+{
+    CFDictionaryRef atoms = (CFDictionaryRef)CMFormatDescriptionGetExtension(formatDescription, kCMFormatDescriptionExtension_SampleDescriptionExtensionAtoms);
+    CFDataRef avcC = atoms ? (CFDataRef)CFDictionaryGetValue(atoms, CFSTR("avcC")) : NULL;
+    if (!avcC) {
+        DLog(@"missing decoder configuration");
+        return NO;
+    }
+
+    PBJFragmentedMP4VideoTrack video;
+    video.timescale = PBJFragmentedMediaWriterVideoTimescale;
+    video.width = (uint16_t)_videoWidth;
+    video.height = (uint16_t)_videoHeight;
+    video.rotation = _videoRotation;
+    video.avcC = CFDataGetBytePtr(avcC);
+    video.avcCSize = (size_t)CFDataGetLength(avcC);
+
+    PBJFragmentedMP4AudioTrack audio;
+    audio.sampleRate = (uint32_t)_audioSampleRate;
+    audio.channelCount = (uint16_t)_audioChannels;
+    audio.averageBitRate = _audioBitRate;
+    audio.audioSpecificConfig = _audioSpecificConfig.bytes;
+    audio.audioSpecificConfigSize = _audioSpecificConfig.length;
+    audio.primingFrames = PBJFragmentedMediaWriterAACPrimingFrames;
+
+    PBJFragmentedMP4Configuration configuration;
+    configuration.video = &video;
+    configuration.audio = _audioConfigured ? &audio : NULL;
+    configuration.fragmentDuration = CMTIME_IS_NUMERIC(_fragmentInterval) ? (uint32_t)MAX(CMTimeGetSeconds(_fragmentInterval) * 1000.0, 0.0) : 0;
+
+    _muxer = PBJFragmentedMP4MuxerCreate(&configuration, PBJOutputSinkWriteFunction, _sink);
+    return _muxer != NULL;
+}
+
+// muxer lock held, a fragment the muxer wrote goes out to the file whole, without waiting for a batch to fill
+- (void)_endWrittenFragments
+{
+    uint32_t fragmentCount = PBJFragmentedMP4MuxerGetFragmentCount(_muxer);
+    if (fragmentCount != _sinkFragmentCount) {
+        _sinkFragmentCount = fragmentCount;
+        PBJOutputSinkEndFragment(_sink);
+    }
+}
+
+- (const uint8_t *)_bytesOfBlockBuffer:(CMBlockBufferRef)blockBuffer length:(size_t *)length scratch:(NSMutableData *)scratch
+{
+    size_t totalLength = CMBlockBufferGetDataLength(blockBuffer);
+    char *pointer = NULL;
+    size_t lengthAtOffset = 0;
+    if (CMBlockBufferGetDataPointer(blockBuffer, 0, &lengthAtOffset, NULL, &pointer) == kCMBlockBufferNoErr && lengthAtOffset == totalLength) {
+        *length = totalLength;
+        return (const uint8_t *)pointer;
+    }
+    scratch.length = totalLength;
+    if (CMBlockBufferCopyDataBytes(blockBuffer, 0, totalLength, scratch.mutableBytes) != kCMBlockBufferNoErr)
+        return NULL;
+    *length = totalLength;
+    return (const uint8_t *)scratch.bytes;
+}
+
+- (void)_muxVideoSampleBuffer:(CMSampleBufferRef)sampleBuffer
+{
+    BOOL isSync = YES;
+    CFArrayRef attachments = CMSampleBufferGetSampleAttachmentsArray(sampleBuffer, false);
+    if (attachments && CFArrayGetCount(attachments) > 0) {
+        CFDictionaryRef attachment = (CFDictionaryRef)CFArrayGetValueAtIndex(attachments, 0);
+        isSync = !CFDictionaryContainsKey(attachment, kCMSampleAttachmentKey_NotSync);
+    }
+
+    os_unfair_lock_lock(&_muxerLock);
+
+    // the file has to open on a keyframe
+    if (!_muxer && (!isSync || ![self _createMuxerWithFormatDescription:CMSampleBufferGetFormatDescription(sampleBuffer)])) {
+        os_unfair_lock_unlock(&_muxerLock);
+        return;
+    }
+
+    CMTime presentationTime = CMSampleBufferGetPresentationTimeStamp(sampleBuffer);
+    CMTime decodeTime = CMSampleBufferGetDecodeTimeStamp(sampleBuffer);
+    if (!CMTIME_IS_NUMERIC(decodeTime)) {
+        decodeTime = presentationTime;
+    }
+    int64_t decodeValue = CMTimeConvertScale(CMTimeSubtract(decodeTime, _sessionStartTime), PBJFragmentedMediaWriterVideoTimescale, kCMTimeRoundingMethod_Default).value;
+    int64_t presentationValue = CMTimeConvertScale(CMTimeSubtract(presentationTime, _sessionStartTime), PBJFragmentedMediaWriterVideoTimescale, kCMTimeRoundingMethod_Default).value;
+
+    size_t length = 0;
+    const uint8_t *bytes = [self _bytesOfBlockBuffer:CMSampleBufferGetDataBuffer(sampleBuffer) length:&length scratch:_videoScratch];
+    if (bytes && decodeValue >= 0) {
+        PBJFragmentedMP4MuxerAppendSample(_muxer, PBJFragmentedMP4TrackVideo, bytes, length, decodeValue,
+                                          (int32_t)(presentationValue - decodeValue), 0, isSync);
+    }
+
+    // audio encoded before the file could be started
+    for (NSData *packet in _pendingAudioPackets) {
+        int64_t packetTime = 0;
+        [packet getBytes:&packetTime length:sizeof(packetTime)];
+        PBJFragmentedMP4MuxerAppendSample(_muxer, PBJFragmentedMP4TrackAudio, (const uint8_t *)packet.bytes + sizeof(packetTime),
+                                          packet.length - sizeof(packetTime), packetTime, 0, PBJFragmentedMediaWriterAACFramesPerPacket, 1);
+    }
+    [_pendingAudioPackets removeAllObjects];
+    [self _endWrittenFragments];
+
+    os_unfair_lock_unlock(&_muxerLock);
+}
+
+- (void)_muxAudioPacket:(const uint8_t *)bytes length:(size_t)length time:(int64_t)time
+{
+    os_unfair_lock_lock(&_muxerLock);
+    if (_muxer) {
+        PBJFragmentedMP4MuxerAppendSample(_muxer, PBJFragmentedMP4TrackAudio, bytes, length, time, 0, PBJFragmentedMediaWriterAACFramesPerPacket, 1);
+        [self _endWrittenFragments];
+    } else {
+        NSMutableData *packet = [NSMutableData dataWithBytes:&time length:sizeof(time)];
+        [packet appendBytes:bytes length:length];
+        [_pendingAudioPackets addObject:packet];
+    }
+    os_unfair_lock_unlock(&_muxerLock);
+}
+
+#pragma mark - encoding
+
+- (BOOL)appendSampleBuffer:(CMSampleBufferRef)sampleBuffer withMediaTypeVideo:(BOOL)video
+{
+    if (_error)
+        return NO;
+    return video ? [self _encodeVideoSampleBuffer:sampleBuffer] : [self _encodeAudioSampleBuffer:sampleBuffer];
+}
+
+- (BOOL)_encodeVideoSampleBuffer:(CMSampleBufferRef)sampleBuffer
+{
+    if (!_videoConfigured)
+        return NO;
+
+    CMTime presentationTime = CMSampleBufferGetPresentationTimeStamp(sampleBuffer);
+    if (!CMTIME_IS_VALID(_sessionStartTime)) {
+        os_unfair_lock_lock(&_muxerLock);
+        _sessionStartTime = presentationTime;
+        os_unfair_lock_unlock(&_muxerLock);
+    }
+
+    CVImageBufferRef imageBuffer = CMSampleBufferGetImageBuffer(sampleBuffer);
+    if (!imageBuffer) {
+        // compressed upstream (ie pre-roll), decode order is presentation order
+        [self _muxVideoSampleBuffer:sampleBuffer];
+        return YES;
+    }
+
+    if (!_compressionSession) {
+        _compressionSession = [PBJVisionUtilities createCompressionSessionWithVideoSettings:_videoSettings
+                                                                            outputCallback:PBJFragmentedMediaWriterCompressionOutput
+                                                                                    refcon:(__bridge void *)self];
+        if (!_compressionSession) {
+            DLog(@"error creating compression session");
+            [self _failWithStatus:kVTVideoEncoderNotAvailableNowErr];
+            return NO;
+        }
+    }
+
+    // rate control follows a change from the next frame, no new session or keyframe
+    uint64_t bitRate = atomic_load_explicit(&_requestedVideoBitRate, memory_order_relaxed);
+    if (bitRate != 0 && bitRate != _appliedVideoBitRate) {
+        VTSessionSetProperty(_compressionSession, kVTCompressionPropertyKey_AverageBitRate, (__bridge CFTypeRef)@(bitRate));
+        _appliedVideoBitRate = bitRate;
+    }
+
+    OSStatus status = VTCompressionSessionEncodeFrame(_compressionSession, imageBuffer, presentationTime,
+                                                      CMSampleBufferGetDuration(sampleBuffer), NULL, NULL, NULL);
+    if (status != noErr) {
+        DLog(@"error encoding frame (%d)", (int)status);
+        [self _failWithStatus:status];
+        return NO;
+    }
+    return YES;
+}
+
+- (BOOL)_setupAudioConverterWithFormatDescription:(CMFormatDescriptionRef)formatDescription
+{
+    const AudioStreamBasicDescription *inputFormat = CMAudioFormatDescriptionGetStreamBasicDescription(formatDescription);
+    if (!inputFormat || inputFormat->mFormatID != kAudioFormatLinearPCM || (inputFormat->mFormatFlags & kAudioFormatFlagIsNonInterleaved && inputFormat->mChannelsPerFrame > 1))
+        return NO;
+    _pcmFormat = *inputFormat;
+
+    AudioStreamBasicDescription outputFormat = { 0 };
+    outputFormat.mFormatID = kAudioFormatMPEG4AAC;
+    outputFormat.mSampleRate = _audioSampleRate;
+    outputFormat.mChannelsPerFrame = _audioChannels;
+    outputFormat.mFramesPerPacket = PBJFragmentedMediaWriterAACFramesPerPacket;
+
+    OSStatus status = AudioConverterNew(&_pcmFormat, &outputFormat, &_audioConverter);
+    if (status != noErr) {
+        [self _failWithStatus:status];
+        return NO;
+    }
+    if (_audioBitRate > 0) {
+        UInt32 bitRate = _audioBitRate;
+        AudioConverterSetProperty(_audioConverter, kAudioConverterEncodeBitRate, sizeof(bitRate), &bitRate);
+    }
+
+    UInt32 maximumPacketSize = 0;
+    UInt32 propertySize = sizeof(maximumPacketSize);
+    AudioConverterGetProperty(_audioConverter, kAudioConverterPropertyMaximumOutputPacketSize, &propertySize, &maximumPacketSize);
+    _aacPacket.length = MAX(maximumPacketSize, (UInt32)2048);
+
+    // the first packets decode to the encoder's priming rather than the first captured frames
+    AudioConverterPrimeInfo primeInfo = { PBJFragmentedMediaWriterAACPrimingFrames, 0 };
+    propertySize = sizeof(primeInfo);
+    AudioConverterGetProperty(_audioConverter, kAudioConverterPrimeInfo, &propertySize, &primeInfo);
+    _aacPrimingAdjustment = (int64_t)PBJFragmentedMediaWriterAACPrimingFrames - (int64_t)primeInfo.leadingFrames;
+    return YES;
+}
+
+static OSStatus PBJFragmentedMediaWriterProvidePCM(AudioConverterRef converter, UInt32 *ioNumberDataPackets, AudioBufferList *ioData,
+                                                   AudioStreamPacketDescription **outDataPacketDescription, void *inUserData)
+{
+    PBJFragmentedMediaWriter *writer = (__bridge PBJFragmentedMediaWriter *)inUserData;
+    return [writer _providePCMPackets:ioNumberDataPackets bufferList:ioData];
+}
+
+- (OSStatus)_providePCMPackets:(UInt32 *)packetCount bufferList:(AudioBufferList *)bufferList
+{
+    UInt32 bytesPerFrame = _pcmFormat.mBytesPerFrame;
+    NSUInteger availableFrames = (_pcmBuffer.length - _pcmReadOffset) / bytesPerFrame;
+    if (availableFrames == 0) {
+        *packetCount = 0;
+        return PBJFragmentedMediaWriterNoMoreInput;
+    }
+
+    UInt32 frames = (UInt32)MIN((NSUInteger)*packetCount, availableFrames);
+    bufferList->mNumberBuffers = 1;
+    bufferList->mBuffers[0].mNumberChannels = _pcmFormat.mChannelsPerFrame;
+    bufferList->mBuffers[0].mDataByteSize = frames * bytesPerFrame;
+    bufferList->mBuffers[0].mData = (uint8_t *)_pcmBuffer.mutableBytes + _pcmReadOffset;
+    _pcmReadOffset += frames * bytesPerFrame;
+    *packetCount = frames;
+    return noErr;
+}
+
+- (BOOL)_encodeAudioSampleBuffer:(CMSampleBufferRef)sampleBuffer
+{
+    if (!_audioConfigured)
+        return NO;
+
+    // audio ahead of the first video frame has no place in the file
+    CMTime presentationTime = CMSampleBufferGetPresentationTimeStamp(sampleBuffer);
+    if (!CMTIME_IS_VALID(_sessionStartTime) || CMTIME_COMPARE_INLINE(presentationTime, <, _sessionStartTime))
+        return YES;
+
+    if (!_audioConverter && ![self _setupAudioConverterWithFormatDescription:CMSampleBufferGetFormatDescription(sampleBuffer)])
+        return NO;
+
+    CMBlockBufferRef blockBuffer = CMSampleBufferGetDataBuffer(sampleBuffer);
+    if (!blockBuffer)
+        return NO;
+
+    UInt32 bytesPerFrame = _pcmFormat.mBytesPerFrame;
+    if (_pcmBuffer.length == _pcmReadOffset) {
+        _pcmHeadFrame = CMTimeConvertScale(CMTimeSubtract(presentationTime, _sessionStartTime), (int32_t)_pcmFormat.mSampleRate, kCMTimeRoundingMethod_Default).value;
+    }
+    size_t length = CMBlockBufferGetDataLength(blockBuffer);
+    NSUInteger offset = _pcmBuffer.length;
+    _pcmBuffer.length = offset + length;
+    if (CMBlockBufferCopyDataBytes(blockBuffer, 0, length, (uint8_t *)_pcmBuffer.mutableBytes + offset) != kCMBlockBufferNoErr)
+        return NO;
+
+    while ((_pcmBuffer.length - _pcmReadOffset) / bytesPerFrame >= PBJFragmentedMediaWriterAACFramesPerPacket) {
+        AudioBufferList outputBufferList;
+        outputBufferList.mNumberBuffers = 1;
+        outputBufferList.mBuffers[0].mNumberChannels = _audioChannels;
+        outputBufferList.mBuffers[0].mDataByteSize = (UInt32)_aacPacket.length;
+        outputBufferList.mBuffers[0].mData = _aacPacket.mutableBytes;
+
+        UInt32 packetCount = 1;
+        AudioStreamPacketDescription packetDescription;
+        NSUInteger readOffset = _pcmReadOffset;
+        OSStatus status = AudioConverterFillComplexBuffer(_audioConverter, PBJFragmentedMediaWriterProvidePCM, (__bridge void *)self,
+                                                          &packetCount, &outputBufferList, &packetDescription);
+        if (status != noErr && status != PBJFragmentedMediaWriterNoMoreInput) {
+            [self _failWithStatus:status];
+            return NO;
+        }
+        _pcmHeadFrame += (int64_t)((_pcmReadOffset - readOffset) / bytesPerFrame);
+
+        if (packetCount > 0 && outputBufferList.mBuffers[0].mDataByteSize > 0) {
+            // head frame counts at the capture rate, packets at the encoded rate. a packet's media
+            // time is its input's plus the priming the edit list skips, one that would land before
+            // the track's start holds nothing but priming beyond what the edit list covers
+            int64_t packetTime = (int64_t)llround((double)_pcmHeadFrame * _audioSampleRate / _pcmFormat.mSampleRate) - PBJFragmentedMediaWriterAACFramesPerPacket + _aacPrimingAdjustment;
+            if (packetTime >= 0) {
+                [self _muxAudioPacket:(const uint8_t *)outputBufferList.mBuffers[0].mData length:outputBufferList.mBuffers[0].mDataByteSize time:packetTime];
+            }
+        } else if (_pcmReadOffset == readOffset) {
+            break;
+        }
+    }
+
+    // keep the unconsumed tail at the front
+    [_pcmBuffer replaceBytesInRange:NSMakeRange(0, _pcmReadOffset) withBytes:NULL length:0];
+    _pcmReadOffset = 0;
+    return YES;
+}
+
+#pragma mark - finish
+
+- (BOOL)finishWriting
+{
+    if (_compressionSession) {
+        VTCompressionSessionCompleteFrames(_compressionSession, kCMTimeInvalid);
+    }
+    [self _destroyEncoders];
+
+    os_unfair_lock_lock(&_muxerLock);
+    BOOL finished = NO;
+    if (_muxer) {
+        finished = PBJFragmentedMP4MuxerFinish(_muxer) != 0;
+        if (!finished && !_error) {
+            _error = [NSError errorWithDomain:NSPOSIXErrorDomain code:EIO userInfo:nil];
+        }
+    }
+    // syncs and closes the file, giving back what was preallocated past its end
+    if (!PBJOutputSinkFinish(_sink) && finished) {
+        finished = NO;
+        if (!_error) {
+            _error = [NSError errorWithDomain:NSPOSIXErrorDomain code:EIO userInfo:nil];
+        }
+    }
+    os_unfair_lock_unlock(&_muxerLock);
+
+    DLog(@"finished writing (%d)", finished);
+    return finished;
+}
+
+@end
@@ -0,0 +1,566 @@
+//
+//  PBJFrameAnalyzer.c
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#include "PBJFrameAnalyzer.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PBJFrameAnalyzerGridSize 16
+#define PBJFrameAnalyzerGridCells (PBJFrameAnalyzerGridSize * PBJFrameAnalyzerGridSize)
+#define PBJFrameAnalyzerAutomaticRows 270
+
+// a quarter of the grid's range changing is treated as a cut
+static const float PBJFrameStatisticsSceneChangeCutoff = 0.25f;
+
+struct PBJFrameAnalyzer {
+    PBJFrameAnalyzerConfiguration configuration;
+    PBJSIMDLevel level;
+
+    // luma to 0 - 255 across each range
+    uint8_t fullRangeLevels[256];
+    uint8_t videoRangeLevels[256];
+
+    // sampled pixels of a row that end each grid column, rebuilt when the width changes
+    size_t gridColumnEnds[PBJFrameAnalyzerGridSize];
+    size_t gridColumnsWidth;
+    size_t gridColumnsStep;
+
+    // block means of the previous frame
+    float previousGrid[PBJFrameAnalyzerGridCells];
+    size_t previousWidth;
+    size_t previousHeight;
+    int hasPrevious;
+};
+
+#pragma mark - score
+
+float PBJFrameStatisticsScore(const PBJFrameStatistics *statistics)
+{
+    if (!statistics || statistics->sampleCount == 0)
+        return 0.0f;
+
+    float exposure = 1.0f - statistics->shadowFraction - statistics->highlightFraction;
+    float steadiness = 1.0f - statistics->sceneChange / PBJFrameStatisticsSceneChangeCutoff;
+    if (exposure <= 0.0f || steadiness <= 0.0f)
+        return 0.0f;
+    return log2f(1.0f + statistics->sharpness) * exposure * steadiness;
+}
+
+#pragma mark - gradient rows
+
+// sum of squared horizontal and vertical differences for each pixel of row but the last,
+// the kernels return how far they got and the scalar path finishes the row
+
+static uint64_t PBJFrameGradientRowScalar(const uint8_t *row, const uint8_t *below, size_t x, size_t width)
+{
+    uint64_t energy = 0;
+    for (; x + 1 < width; x++) {
+        int32_t dx = (int32_t)row[x + 1] - (int32_t)row[x];
+        int32_t dy = (int32_t)below[x] - (int32_t)row[x];
+        energy += (uint64_t)(dx * dx + dy * dy);
+    }
+    return energy;
+}
+
+// a 32-bit lane gains at most 4 * 2 * 255^2 a step, flushing every 2048 steps keeps it below 2^31
+#define PBJFrameGradientFlushSteps 2048
+
+#pragma mark - SSE2, AVX2
+
+#if PBJ_SIMD_SSE2
+
+// lanes are widened before adding, together they can pass 32 bits
+static inline uint64_t PBJFrameGradientSumSSE2(__m128i sums)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i pairs = _mm_add_epi64(_mm_unpacklo_epi32(sums, zero), _mm_unpackhi_epi32(sums, zero));
+    uint64_t halves[2];
+    _mm_storeu_si128((__m128i *)halves, pairs);
+    return halves[0] + halves[1];
+}
+
+static size_t PBJFrameGradientRowSSE2(const uint8_t *row, const uint8_t *below, size_t width, uint64_t *energy)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i sums = zero;
+    size_t steps = 0;
+
+    size_t x = 0;
+    for (; x + 17 <= width; x += 16) {
+        __m128i center = _mm_loadu_si128((const __m128i *)(row + x));
+        __m128i right = _mm_loadu_si128((const __m128i *)(row + x + 1));
+        __m128i down = _mm_loadu_si128((const __m128i *)(below + x));
+
+        __m128i centerLo = _mm_unpacklo_epi8(center, zero);
+        __m128i centerHi = _mm_unpackhi_epi8(center, zero);
+        __m128i dxLo = _mm_sub_epi16(_mm_unpacklo_epi8(right, zero), centerLo);
+        __m128i dxHi = _mm_sub_epi16(_mm_unpackhi_epi8(right, zero), centerHi);
+        __m128i dyLo = _mm_sub_epi16(_mm_unpacklo_epi8(down, zero), centerLo);
+        __m128i dyHi = _mm_sub_epi16(_mm_unpackhi_epi8(down, zero), centerHi);
+
+        sums = _mm_add_epi32(sums, _mm_add_epi32(_mm_madd_epi16(dxLo, dxLo), _mm_madd_epi16(dxHi, dxHi)));
+        sums = _mm_add_epi32(sums, _mm_add_epi32(_mm_madd_epi16(dyLo, dyLo), _mm_madd_epi16(dyHi, dyHi)));
+
+        if (++steps == PBJFrameGradientFlushSteps) {
+            *energy += PBJFrameGradientSumSSE2(sums);
+            sums = zero;
+            steps = 0;
+        }
+    }
+    *energy += PBJFrameGradientSumSSE2(sums);
+    return x;
+}
+
+#endif
+
+#if PBJ_SIMD_AVX2
+
+PBJ_TARGET_AVX2
+static size_t PBJFrameGradientRowAVX2(const uint8_t *row, const uint8_t *below, size_t width, uint64_t *energy)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i sums = zero;
+    size_t steps = 0;
+
+    size_t x = 0;
+    for (; x + 33 <= width; x += 32) {
+        __m256i center = _mm256_loadu_si256((const __m256i *)(row + x));
+        __m256i right = _mm256_loadu_si256((const __m256i *)(row + x + 1));
+        __m256i down = _mm256_loadu_si256((const __m256i *)(below + x));
+
+        // unpacking stays within lanes, every pixel still meets its own neighbours
+        __m256i centerLo = _mm256_unpacklo_epi8(center, zero);
+        __m256i centerHi = _mm256_unpackhi_epi8(center, zero);
+        __m256i dxLo = _mm256_sub_epi16(_mm256_unpacklo_epi8(right, zero), centerLo);
+        __m256i dxHi = _mm256_sub_epi16(_mm256_unpackhi_epi8(right, zero), centerHi);
+        __m256i dyLo = _mm256_sub_epi16(_mm256_unpacklo_epi8(down, zero), centerLo);
+        __m256i dyHi = _mm256_sub_epi16(_mm256_unpackhi_epi8(down, zero), centerHi);
+
+        sums = _mm256_add_epi32(sums, _mm256_add_epi32(_mm256_madd_epi16(dxLo, dxLo), _mm256_madd_epi16(dxHi, dxHi)));
+        sums = _mm256_add_epi32(sums, _mm256_add_epi32(_mm256_madd_epi16(dyLo, dyLo), _mm256_madd_epi16(dyHi, dyHi)));
+
+        if (++steps == PBJFrameGradientFlushSteps) {
+            *energy += PBJFrameGradientSumSSE2(_mm256_castsi256_si128(sums)) + PBJFrameGradientSumSSE2(_mm256_extracti128_si256(sums, 1));
+            sums = zero;
+            steps = 0;
+        }
+    }
+    *energy += PBJFrameGradientSumSSE2(_mm256_castsi256_si128(sums)) + PBJFrameGradientSumSSE2(_mm256_extracti128_si256(sums, 1));
+    return x;
+}
+
+#endif
+
+#pragma mark - NEON
+
+#if PBJ_SIMD_NEON
+
+static inline uint64_t PBJFrameGradientSumNEON(uint32x4_t sums)
+{
+#if defined(__aarch64__)
+    return vaddlvq_u32(sums);
+#else
+    uint64x2_t pairs = vpaddlq_u32(sums);
+    return vgetq_lane_u64(pairs, 0) + vgetq_lane_u64(pairs, 1);
+#endif
+}
+
+static size_t PBJFrameGradientRowNEON(const uint8_t *row, const uint8_t *below, size_t width, uint64_t *energy)
+{
+    uint32x4_t sums = vdupq_n_u32(0);
+    size_t steps = 0;
+
+    size_t x = 0;
+    for (; x + 17 <= width; x += 16) {
+        uint8x16_t center = vld1q_u8(row + x);
+        uint8x16_t dx = vabdq_u8(vld1q_u8(row + x + 1), center);
+        uint8x16_t dy = vabdq_u8(vld1q_u8(below + x), center);
+
+        // squares of absolute differences fit 16 bits, pairs are widened into the sums
+        sums = vpadalq_u16(sums, vmull_u8(vget_low_u8(dx), vget_low_u8(dx)));
+        sums = vpadalq_u16(sums, vmull_u8(vget_high_u8(dx), vget_high_u8(dx)));
+        sums = vpadalq_u16(sums, vmull_u8(vget_low_u8(dy), vget_low_u8(dy)));
+        sums = vpadalq_u16(sums, vmull_u8(vget_high_u8(dy), vget_high_u8(dy)));
+
+        if (++steps == PBJFrameGradientFlushSteps) {
+            *energy += PBJFrameGradientSumNEON(sums);
+            sums = vdupq_n_u32(0);
+            steps = 0;
+        }
+    }
+    *energy += PBJFrameGradientSumNEON(sums);
+    return x;
+}
+
+#endif
+
+static uint64_t PBJFrameGradientRow(PBJSIMDLevel level, const uint8_t *row, const uint8_t *below, size_t width)
+{
+    uint64_t energy = 0;
+    size_t x = 0;
+    switch (level) {
+#if PBJ_SIMD_AVX2
+        case PBJSIMDLevelAVX2:
+            x = PBJFrameGradientRowAVX2(row, below, width, &energy);
+            break;
+#endif
+#if PBJ_SIMD_SSE2
+        case PBJSIMDLevelSSE2:
+            x = PBJFrameGradientRowSSE2(row, below, width, &energy);
+            break;
+#endif
+#if PBJ_SIMD_NEON
+        case PBJSIMDLevelNEON:
+            x = PBJFrameGradientRowNEON(row, below, width, &energy);
+            break;
+#endif
+        default:
+            break;
+    }
+    return energy + PBJFrameGradientRowScalar(row, below, x, width);
+}
+
+#pragma mark - analyzer
+
+PBJFrameAnalyzerConfiguration PBJFrameAnalyzerDefaultConfiguration(void)
+{
+    PBJFrameAnalyzerConfiguration configuration;
+    configuration.step = 0;
+    configuration.level = PBJSIMDLevelAuto;
+    return configuration;
+}
+
+PBJFrameAnalyzer *PBJFrameAnalyzerCreate(const PBJFrameAnalyzerConfiguration *configuration)
+{
+    PBJFrameAnalyzer *analyzer = (PBJFrameAnalyzer *)calloc(1, sizeof(PBJFrameAnalyzer));
+    if (!analyzer)
+        return NULL;
+
+    analyzer->configuration = configuration ? *configuration : PBJFrameAnalyzerDefaultConfiguration();
+    analyzer->level = PBJSIMDLevelResolve(analyzer->configuration.level);
+
+    for (int luma = 0; luma < 256; luma++) {
+        int level = ((luma - 16) * 255 + 109) / 219;
+        analyzer->fullRangeLevels[luma] = (uint8_t)luma;
+        analyzer->videoRangeLevels[luma] = (uint8_t)(level < 0 ? 0 : level > 255 ? 255 : level);
+    }
+    return analyzer;
+}
+
+void PBJFrameAnalyzerDestroy(PBJFrameAnalyzer *analyzer)
+{
+    if (!analyzer)
+        return;
+
+    free(analyzer);
+}
+
+void PBJFrameAnalyzerReset(PBJFrameAnalyzer *analyzer)
+{
+    if (analyzer) {
+        analyzer->hasPrevious = 0;
+    }
+}
+
+static void PBJFrameAnalyzerSetupGridColumns(PBJFrameAnalyzer *analyzer, size_t width, size_t step)
+{
+    if (analyzer->gridColumnsWidth == width && analyzer->gridColumnsStep == step)
+        return;
+
+    // sample i falls in column (i * step * size) / width
+    size_t samples = (width + step - 1) / step;
+    size_t i = 0;
+    for (size_t column = 0; column < PBJFrameAnalyzerGridSize; column++) {
+        while (i < samples && (i * step * PBJFrameAnalyzerGridSize) / width <= column) {
+            i++;
+        }
+        analyzer->gridColumnEnds[column] = i;
+    }
+    analyzer->gridColumnsWidth = width;
+    analyzer->gridColumnsStep = step;
+}
+
+int PBJFrameAnalyzerAnalyze(PBJFrameAnalyzer *analyzer, const PBJNV12Image *image, PBJFrameStatistics *statistics)
+{
+    if (!analyzer || !image || !image->luma || !statistics || image->width == 0 || image->height == 0)
+        return 0;
+
+    const uint8_t *levels = (image->range == PBJYCbCrRangeVideo) ? analyzer->videoRangeLevels : analyzer->fullRangeLevels;
+    size_t width = image->width;
+    size_t height = image->height;
+    size_t step = analyzer->configuration.step;
+    if (step == 0) {
+        step = height / PBJFrameAnalyzerAutomaticRows;
+    }
+    if (step == 0) {
+        step = 1;
+    }
+    PBJFrameAnalyzerSetupGridColumns(analyzer, width, step);
+
+    memset(statistics, 0, sizeof(PBJFrameStatistics));
+
+    // interleaved partial histograms keep back to back samples off the same counter
+    uint32_t histograms[4][PBJFrameStatisticsHistogramBins];
+    memset(histograms, 0, sizeof(histograms));
+    uint64_t gridSums[PBJFrameAnalyzerGridCells];
+    uint32_t gridRowSamples[PBJFrameAnalyzerGridSize];
+    memset(gridSums, 0, sizeof(gridSums));
+    memset(gridRowSamples, 0, sizeof(gridRowSamples));
+
+    uint64_t gradientEnergy = 0;
+    uint64_t gradientPixels = 0;
+
+    for (size_t y = 0; y < height; y += step) {
+        const uint8_t *row = image->luma + y * image->lumaBytesPerRow;
+
+        if (y + 1 < height && width > 1) {
+            gradientEnergy += PBJFrameGradientRow(analyzer->level, row, row + image->lumaBytesPerRow, width);
+            gradientPixels += width - 1;
+        }
+
+        size_t gridRow = (y * PBJFrameAnalyzerGridSize) / height;
+        uint64_t *gridSumRow = gridSums + gridRow * PBJFrameAnalyzerGridSize;
+        gridRowSamples[gridRow]++;
+
+        // a grid column at a time, so its sum stays in a register
+        size_t i = 0;
+        for (size_t column = 0; column < PBJFrameAnalyzerGridSize; column++) {
+            uint32_t sum = 0;
+            for (size_t end = analyzer->gridColumnEnds[column]; i < end; i++) {
+                uint32_t level = levels[row[i * step]];
+                histograms[i & 3][level >> 2]++;
+                sum += level;
+            }
+            gridSumRow[column] += sum;
+        }
+    }
+
+    uint32_t sampleCount = 0;
+    for (int bin = 0; bin < PBJFrameStatisticsHistogramBins; bin++) {
+        statistics->histogram[bin] = histograms[0][bin] + histograms[1][bin] + histograms[2][bin] + histograms[3][bin];
+        sampleCount += statistics->histogram[bin];
+    }
+    uint64_t levelSum = 0;
+    for (int cell = 0; cell < PBJFrameAnalyzerGridCells; cell++) {
+        levelSum += gridSums[cell];
+    }
+    statistics->sampleCount = sampleCount;
+    statistics->meanLuma = (float)((double)levelSum / ((double)sampleCount * 255.0));
+    statistics->shadowFraction = (float)statistics->histogram[0] / (float)sampleCount;
+    statistics->highlightFraction = (float)statistics->histogram[PBJFrameStatisticsHistogramBins - 1] / (float)sampleCount;
+
+    if (gradientPixels > 0) {
+        // in full range units, so both ranges score alike
+        double scale = (image->range == PBJYCbCrRangeVideo) ? (255.0 * 255.0) / (219.0 * 219.0) : 1.0;
+        statistics->sharpness = (float)((double)gradientEnergy * scale / (double)gradientPixels);
+    }
+
+    // block means against the previous frame, less the mean change so exposure drift isn't a cut
+    float grid[PBJFrameAnalyzerGridCells];
+    for (int cell = 0; cell < PBJFrameAnalyzerGridCells; cell++) {
+        size_t column = (size_t)cell % PBJFrameAnalyzerGridSize;
+        size_t columnSamples = analyzer->gridColumnEnds[column] - (column > 0 ? analyzer->gridColumnEnds[column - 1] : 0);
+        uint64_t count = (uint64_t)columnSamples * gridRowSamples[cell / PBJFrameAnalyzerGridSize];
+        grid[cell] = count ? (float)((double)gridSums[cell] / ((double)count * 255.0)) : -1.0f;
+    }
+    if (analyzer->hasPrevious && analyzer->previousWidth == width && analyzer->previousHeight == height) {
+        float differences[PBJFrameAnalyzerGridCells];
+        float differenceSum = 0.0f;
+        int cells = 0;
+        for (int cell = 0; cell < PBJFrameAnalyzerGridCells; cell++) {
+            if (grid[cell] < 0.0f)
+                continue;
+            differences[cells] = grid[cell] - analyzer->previousGrid[cell];
+            differenceSum += differences[cells];
+            cells++;
+        }
+        if (cells > 0) {
+            float meanDifference = differenceSum / (float)cells;
+            float deviation = 0.0f;
+            for (int cell = 0; cell < cells; cell++) {
+                deviation += fabsf(differences[cell] - meanDifference);
+            }
+            statistics->sceneChange = deviation / (float)cells;
+        }
+    }
+    memcpy(analyzer->previousGrid, grid, sizeof(grid));
+    analyzer->previousWidth = width;
+    analyzer->previousHeight = height;
+    analyzer->hasPrevious = 1;
+    return 1;
+}
+
+#pragma mark - best frame
+
+typedef struct {
+    void *frame;
+    int64_t time;
+    float score;
+} PBJBestFrameEntry;
+
+struct PBJBestFrameWindow {
+    int64_t duration;
+    size_t capacity;
+    PBJBestFrameReleaseFunction release;
+    void *releaseContext;
+
+    // ring, scores fall from head to tail
+    PBJBestFrameEntry *entries;
+    size_t head;
+    size_t count;
+};
+
+PBJBestFrameWindow *PBJBestFrameWindowCreate(int64_t duration, size_t capacity, PBJBestFrameReleaseFunction release, void *releaseContext)
+{
+    if (capacity == 0)
+        return NULL;
+
+    PBJBestFrameWindow *window = (PBJBestFrameWindow *)calloc(1, sizeof(PBJBestFrameWindow));
+    if (!window)
+        return NULL;
+
+    window->entries = (PBJBestFrameEntry *)calloc(capacity, sizeof(PBJBestFrameEntry));
+    if (!window->entries) {
+        free(window);
+        return NULL;
+    }
+    window->duration = duration;
+    window->capacity = capacity;
+    window->release = release;
+    window->releaseContext = releaseContext;
+    return window;
+}
+
+void PBJBestFrameWindowDestroy(PBJBestFrameWindow *window)
+{
+    if (!window)
+        return;
+
+    PBJBestFrameWindowClear(window);
+    free(window->entries);
+    free(window);
+}
+
+void PBJBestFrameWindowSetDuration(PBJBestFrameWindow *window, int64_t duration)
+{
+    if (window) {
+        window->duration = duration;
+    }
+}
+
+static inline PBJBestFrameEntry *PBJBestFrameWindowEntry(const PBJBestFrameWindow *window, size_t index)
+{
+    return &window->entries[(window->head + index) % window->capacity];
+}
+
+static void PBJBestFrameWindowReleaseEntry(PBJBestFrameWindow *window, PBJBestFrameEntry *entry)
+{
+    if (window->release && entry->frame) {
+        window->release(window->releaseContext, entry->frame);
+    }
+    entry->frame = NULL;
+}
+
+static void PBJBestFrameWindowPopFront(PBJBestFrameWindow *window)
+{
+    PBJBestFrameWindowReleaseEntry(window, PBJBestFrameWindowEntry(window, 0));
+    window->head = (window->head + 1) % window->capacity;
+    window->count--;
+}
+
+static void PBJBestFrameWindowPopBack(PBJBestFrameWindow *window)
+{
+    PBJBestFrameWindowReleaseEntry(window, PBJBestFrameWindowEntry(window, window->count - 1));
+    window->count--;
+}
+
+void PBJBestFrameWindowOffer(PBJBestFrameWindow *window, void *frame, int64_t time, float score)
+{
+    if (!window || !frame)
+        return;
+
+    // nothing older and no better can be chosen again
+    while (window->count > 0 && PBJBestFrameWindowEntry(window, window->count - 1)->score <= score) {
+        PBJBestFrameWindowPopBack(window);
+    }
+    if (window->count == window->capacity) {
+        PBJBestFrameWindowPopBack(window);
+    }
+
+    PBJBestFrameEntry *entry = PBJBestFrameWindowEntry(window, window->count);
+    entry->frame = frame;
+    entry->time = time;
+    entry->score = score;
+    window->count++;
+
+    while (window->count > 1 && PBJBestFrameWindowEntry(window, 0)->time < time - window->duration) {
+        PBJBestFrameWindowPopFront(window);
+    }
+}
+
+void *PBJBestFrameWindowPeekBest(const PBJBestFrameWindow *window, int64_t *time, float *score)
+{
+    if (!window || window->count == 0)
+        return NULL;
+
+    const PBJBestFrameEntry *entry = PBJBestFrameWindowEntry(window, 0);
+    if (time) {
+        *time = entry->time;
+    }
+    if (score) {
+        *score = entry->score;
+    }
+    return entry->frame;
+}
+
+void *PBJBestFrameWindowTakeBest(PBJBestFrameWindow *window, int64_t *time, float *score)
+{
+    void *frame = PBJBestFrameWindowPeekBest(window, time, score);
+    if (!frame)
+        return NULL;
+
+    PBJBestFrameWindowEntry(window, 0)->frame = NULL;
+    window->head = (window->head + 1) % window->capacity;
+    window->count--;
+    return frame;
+}
+
+size_t PBJBestFrameWindowGetCount(const PBJBestFrameWindow *window)
+{
+    return window ? window->count : 0;
+}
+
+void PBJBestFrameWindowClear(PBJBestFrameWindow *window)
+{
+    if (!window)
+        return;
+
+    while (window->count > 0) {
+        PBJBestFrameWindowPopFront(window);
+    }
+    window->head = 0;
+}
@@ -0,0 +1,118 @@
+//
+//  PBJFrameAnalyzer.h
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#ifndef PBJFrameAnalyzer_h
+#define PBJFrameAnalyzer_h
+
+#include "PBJPlanarImage.h"
+#include "PBJSIMD.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// cheap per-frame luma statistics for choosing which frames are worth keeping, a photo or a
+// thumbnail. only every step-th row of the Y plane is read, the gradient over those rows runs
+// on the vector unit at full resolution, the histogram and a coarse block grid come from every
+// step-th pixel of them
+
+#pragma mark - statistics
+
+#define PBJFrameStatisticsHistogramBins 64
+
+typedef struct {
+    uint32_t histogram[PBJFrameStatisticsHistogramBins]; // luma across the image's range, 4 levels a bin
+    uint32_t sampleCount;
+    float meanLuma; // 0 - 1 across the image's range
+    float shadowFraction; // samples in the lowest bin
+    float highlightFraction; // samples in the highest bin
+    float sharpness; // mean squared luma gradient of the sampled rows, falls as blur rises
+    float sceneChange; // 0 - 1, change of a 16x16 block grid since the previous frame beyond a uniform shift in brightness, 0 for the first
+} PBJFrameStatistics;
+
+// higher is a better still, sharp, not clipped and not caught in a cut or a fast pan,
+// 0 once a quarter of the block grid's range has changed
+float PBJFrameStatisticsScore(const PBJFrameStatistics *statistics);
+
+#pragma mark - analyzer
+
+typedef struct {
+    size_t step; // every step-th row, and pixel of it for the histogram, 0 to read about 270 rows of any frame
+    PBJSIMDLevel level;
+} PBJFrameAnalyzerConfiguration;
+
+typedef struct PBJFrameAnalyzer PBJFrameAnalyzer;
+
+// automatic step, best vector unit
+PBJFrameAnalyzerConfiguration PBJFrameAnalyzerDefaultConfiguration(void);
+
+// not thread safe, confine to one queue
+PBJFrameAnalyzer *PBJFrameAnalyzerCreate(const PBJFrameAnalyzerConfiguration *configuration);
+void PBJFrameAnalyzerDestroy(PBJFrameAnalyzer *analyzer);
+
+// forgets the previous frame, the next scene change is 0
+void PBJFrameAnalyzerReset(PBJFrameAnalyzer *analyzer);
+
+// reads the luma plane only, returns 0 for an empty image
+int PBJFrameAnalyzerAnalyze(PBJFrameAnalyzer *analyzer, const PBJNV12Image *image, PBJFrameStatistics *statistics);
+
+#pragma mark - best frame
+
+// the best scoring frames of a sliding window of time, kept as a run of falling scores so the
+// best is always at the front. a frame is dropped as soon as a newer one scores at least as well,
+// when capacity is reached the newest gives way. not thread safe, confine to one queue
+
+typedef void (*PBJBestFrameReleaseFunction)(void *context, void *frame);
+
+typedef struct PBJBestFrameWindow PBJBestFrameWindow;
+
+// duration in nanoseconds, capacity bounds how many frames are held back from their pool
+PBJBestFrameWindow *PBJBestFrameWindowCreate(int64_t duration, size_t capacity, PBJBestFrameReleaseFunction release, void *releaseContext);
+// releases the frames still held
+void PBJBestFrameWindowDestroy(PBJBestFrameWindow *window);
+
+// applies from the next offer
+void PBJBestFrameWindowSetDuration(PBJBestFrameWindow *window, int64_t duration);
+
+// takes ownership of frame, times must not decrease
+void PBJBestFrameWindowOffer(PBJBestFrameWindow *window, void *frame, int64_t time, float score);
+
+// the best frame within the duration of the latest offer, ownership passes to the caller,
+// NULL when empty. later frames stay as candidates
+void *PBJBestFrameWindowTakeBest(PBJBestFrameWindow *window, int64_t *time, float *score);
+
+// borrowed, valid until the next call on the window
+void *PBJBestFrameWindowPeekBest(const PBJBestFrameWindow *window, int64_t *time, float *score);
+
+size_t PBJBestFrameWindowGetCount(const PBJBestFrameWindow *window);
+
+// releases the frames held
+void PBJBestFrameWindowClear(PBJBestFrameWindow *window);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PBJFrameAnalyzer_h */
@@ -0,0 +1,119 @@
+//
+//  PBJFrameMailbox.c
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include "PBJFrameMailbox.h"
+
+#include <stdatomic.h>
+#include <stdlib.h>
+
+struct PBJFrameMailbox {
+    _Atomic(void *) slot;
+    _Atomic(uint64_t) posted;
+    _Atomic(uint64_t) taken;
+    _Atomic(uint64_t) superseded;
+    PBJFrameMailboxReleaseFunction release;
+    void *releaseContext;
+};
+
+PBJFrameMailbox *PBJFrameMailboxCreate(PBJFrameMailboxReleaseFunction release, void *releaseContext)
+{
+    PBJFrameMailbox *mailbox = (PBJFrameMailbox *)calloc(1, sizeof(PBJFrameMailbox));
+    if (!mailbox)
+        return NULL;
+
+    atomic_init(&mailbox->slot, NULL);
+    atomic_init(&mailbox->posted, 0);
+    atomic_init(&mailbox->taken, 0);
+    atomic_init(&mailbox->superseded, 0);
+    mailbox->release = release;
+    mailbox->releaseContext = releaseContext;
+    return mailbox;
+}
+
+void PBJFrameMailboxDestroy(PBJFrameMailbox *mailbox)
+{
+    if (!mailbox)
+        return;
+
+    PBJFrameMailboxClear(mailbox);
+    free(mailbox);
+}
+
+int PBJFrameMailboxPost(PBJFrameMailbox *mailbox, void *frame)
+{
+    if (!mailbox || !frame)
+        return 0;
+
+    atomic_fetch_add_explicit(&mailbox->posted, 1, memory_order_relaxed);
+
+    // release publishes the frame's contents, acquire pairs with the consumer that emptied the slot
+    void *displaced = atomic_exchange_explicit(&mailbox->slot, frame, memory_order_acq_rel);
+    if (!displaced)
+        return 1;
+
+    atomic_fetch_add_explicit(&mailbox->superseded, 1, memory_order_relaxed);
+    if (mailbox->release) {
+        mailbox->release(mailbox->releaseContext, displaced);
+    }
+    return 0;
+}
+
+void *PBJFrameMailboxTake(PBJFrameMailbox *mailbox)
+{
+    if (!mailbox)
+        return NULL;
+
+    // a plain load first keeps an idle poll from writing the cache line
+    if (!atomic_load_explicit(&mailbox->slot, memory_order_relaxed))
+        return NULL;
+
+    void *frame = atomic_exchange_explicit(&mailbox->slot, NULL, memory_order_acq_rel);
+    if (frame) {
+        atomic_fetch_add_explicit(&mailbox->taken, 1, memory_order_relaxed);
+    }
+    return frame;
+}
+
+void PBJFrameMailboxClear(PBJFrameMailbox *mailbox)
+{
+    if (!mailbox)
+        return;
+
+    void *frame = atomic_exchange_explicit(&mailbox->slot, NULL, memory_order_acq_rel);
+    if (frame && mailbox->release) {
+        mailbox->release(mailbox->releaseContext, frame);
+    }
+}
+
+PBJFrameMailboxCounters PBJFrameMailboxGetCounters(const PBJFrameMailbox *mailbox)
+{
+    PBJFrameMailboxCounters counters = { 0, 0, 0 };
+    if (!mailbox)
+        return counters;
+
+    counters.posted = atomic_load_explicit(&((PBJFrameMailbox *)mailbox)->posted, memory_order_relaxed);
+    counters.taken = atomic_load_explicit(&((PBJFrameMailbox *)mailbox)->taken, memory_order_relaxed);
+    counters.superseded = atomic_load_explicit(&((PBJFrameMailbox *)mailbox)->superseded, memory_order_relaxed);
+    return counters;
+}
@@ -0,0 +1,69 @@
+//
+//  PBJFrameMailbox.h
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef PBJFrameMailbox_h
+#define PBJFrameMailbox_h
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// single slot, latest wins. the producer swaps its frame in and releases whatever it
+// displaced, the consumer swaps the slot empty whenever it is ready, so a slow consumer
+// never holds up the producer and never sees more than one frame waiting. lock-free,
+// any number of producers and consumers
+
+typedef void (*PBJFrameMailboxReleaseFunction)(void *context, void *frame);
+
+typedef struct {
+    uint64_t posted;
+    uint64_t taken;
+    uint64_t superseded; // replaced before a consumer took them
+} PBJFrameMailboxCounters;
+
+typedef struct PBJFrameMailbox PBJFrameMailbox;
+
+PBJFrameMailbox *PBJFrameMailboxCreate(PBJFrameMailboxReleaseFunction release, void *releaseContext);
+// releases a frame still waiting
+void PBJFrameMailboxDestroy(PBJFrameMailbox *mailbox);
+
+// takes ownership of frame, returns 1 when the slot was empty, which is when the
+// consumer needs waking, a full slot means a wake is already on its way
+int PBJFrameMailboxPost(PBJFrameMailbox *mailbox, void *frame);
+
+// ownership passes to the caller, NULL when nothing is waiting
+void *PBJFrameMailboxTake(PBJFrameMailbox *mailbox);
+
+// releases a frame still waiting
+void PBJFrameMailboxClear(PBJFrameMailbox *mailbox);
+
+PBJFrameMailboxCounters PBJFrameMailboxGetCounters(const PBJFrameMailbox *mailbox);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PBJFrameMailbox_h */
@@ -0,0 +1,428 @@
+//
+//  PBJFrameOrientation.c
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include "PBJFrameOrientation.h"
+
+#include <math.h>
+#include <string.h>
+
+// every orientation reduces to an optional transpose plus a flip of each source axis,
+// destination (x, y) reads source (sx, sy) with
+//   straight:   sx = x or width - 1 - x,  sy = y or height - 1 - y
+//   transposed: sx = y or width - 1 - y,  sy = x or height - 1 - x
+// straight rows are copies or element reversals, transposed ones walk the destination in
+// tiles small enough that the source rows a tile reads stay in cache while it is written
+
+#define PBJ_FRAME_ORIENT_TILE_BYTES 64
+#define PBJ_FRAME_ORIENT_BLOCK 8
+
+typedef struct {
+    int transposed;
+    int flipX;
+    int flipY;
+} PBJFrameOrientMap;
+
+static const PBJFrameOrientMap PBJFrameOrientMaps[8] = {
+    { 0, 0, 0 }, // up
+    { 1, 0, 1 }, // right
+    { 0, 1, 1 }, // down
+    { 1, 1, 0 }, // left
+    { 0, 1, 0 }, // up mirrored
+    { 1, 1, 1 }, // right mirrored
+    { 0, 0, 1 }, // down mirrored
+    { 1, 0, 0 }  // left mirrored
+};
+
+typedef struct {
+    const uint8_t *source;
+    size_t sourceBytesPerRow;
+    size_t sourceWidth;  // elements
+    size_t sourceHeight;
+    uint8_t *destination;
+    size_t destinationBytesPerRow;
+    size_t destinationWidth;
+    size_t elementSize;  // 1 luma, 2 CbCr
+} PBJFrameOrientPlane;
+
+// transposes an 8x8 element block, rows[i] is source row i and columns[k] receives source column k
+typedef void (*PBJFrameTransposeBlock)(const uint8_t *const *rows, uint8_t *const *columns);
+
+// reverses count elements of src into dst, returns how many it handled
+typedef size_t (*PBJFrameReverseRow)(const uint8_t *src, uint8_t *dst, size_t count);
+
+PBJFrameOrientation PBJFrameOrientationMake(double degrees, int mirrored)
+{
+    long quarters = lround(degrees / 90.0) % 4;
+    if (quarters < 0) {
+        quarters += 4;
+    }
+    return (PBJFrameOrientation)(quarters + (mirrored ? 4 : 0));
+}
+
+void PBJFrameOrientationOutputSize(PBJFrameOrientation orientation, size_t width, size_t height,
+                                   size_t *outputWidth, size_t *outputHeight)
+{
+    int swaps = PBJFrameOrientationSwapsDimensions(orientation);
+    if (outputWidth) {
+        *outputWidth = swaps ? height : width;
+    }
+    if (outputHeight) {
+        *outputHeight = swaps ? width : height;
+    }
+}
+
+#pragma mark - scalar
+
+static inline void PBJFrameCopyElement(uint8_t *dst, const uint8_t *src, size_t elementSize)
+{
+    dst[0] = src[0];
+    if (elementSize == 2) {
+        dst[1] = src[1];
+    }
+}
+
+static size_t PBJFrameReverseRowScalar(const uint8_t *src, uint8_t *dst, size_t count, size_t elementSize, size_t done)
+{
+    for (size_t x = done; x < count; x++) {
+        PBJFrameCopyElement(dst + x * elementSize, src + (count - 1 - x) * elementSize, elementSize);
+    }
+    return count;
+}
+
+static void PBJFrameTransposeRegionScalar(const PBJFrameOrientPlane *plane, PBJFrameOrientMap map,
+                                          size_t xBegin, size_t xEnd, size_t yBegin, size_t yEnd)
+{
+    const size_t e = plane->elementSize;
+    for (size_t y = yBegin; y < yEnd; y++) {
+        uint8_t *out = plane->destination + y * plane->destinationBytesPerRow;
+        size_t sx = map.flipX ? plane->sourceWidth - 1 - y : y;
+        const uint8_t *column = plane->source + sx * e;
+        for (size_t x = xBegin; x < xEnd; x++) {
+            size_t sy = map.flipY ? plane->sourceHeight - 1 - x : x;
+            PBJFrameCopyElement(out + x * e, column + sy * plane->sourceBytesPerRow, e);
+        }
+    }
+}
+
+#pragma mark - sse2
+
+#if PBJ_SIMD_SSE2
+
+static void PBJFrameTranspose8x8x8SSE2(const uint8_t *const *rows, uint8_t *const *columns)
+{
+    __m128i a0 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)rows[0]), _mm_loadl_epi64((const __m128i *)rows[1]));
+    __m128i a1 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)rows[2]), _mm_loadl_epi64((const __m128i *)rows[3]));
+    __m128i a2 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)rows[4]), _mm_loadl_epi64((const __m128i *)rows[5]));
+    __m128i a3 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)rows[6]), _mm_loadl_epi64((const __m128i *)rows[7]));
+
+    __m128i b0 = _mm_unpacklo_epi16(a0, a1); // rows 0-3, columns 0-3
+    __m128i b1 = _mm_unpackhi_epi16(a0, a1); // rows 0-3, columns 4-7
+    __m128i b2 = _mm_unpacklo_epi16(a2, a3); // rows 4-7, columns 0-3
+    __m128i b3 = _mm_unpackhi_epi16(a2, a3); // rows 4-7, columns 4-7
+
+    __m128i c0 = _mm_unpacklo_epi32(b0, b2); // columns 0, 1
+    __m128i c1 = _mm_unpackhi_epi32(b0, b2); // columns 2, 3
+    __m128i c2 = _mm_unpacklo_epi32(b1, b3); // columns 4, 5
+    __m128i c3 = _mm_unpackhi_epi32(b1, b3); // columns 6, 7
+
+    _mm_storel_epi64((__m128i *)columns[0], c0);
+    _mm_storel_epi64((__m128i *)columns[1], _mm_unpackhi_epi64(c0, c0));
+    _mm_storel_epi64((__m128i *)columns[2], c1);
+    _mm_storel_epi64((__m128i *)columns[3], _mm_unpackhi_epi64(c1, c1));
+    _mm_storel_epi64((__m128i *)columns[4], c2);
+    _mm_storel_epi64((__m128i *)columns[5], _mm_unpackhi_epi64(c2, c2));
+    _mm_storel_epi64((__m128i *)columns[6], c3);
+    _mm_storel_epi64((__m128i *)columns[7], _mm_unpackhi_epi64(c3, c3));
+}
+
+static void PBJFrameTranspose8x8x16SSE2(const uint8_t *const *rows, uint8_t *const *columns)
+{
+    __m128i r0 = _mm_loadu_si128((const __m128i *)rows[0]);
+    __m128i r1 = _mm_loadu_si128((const __m128i *)rows[1]);
+    __m128i r2 = _mm_loadu_si128((const __m128i *)rows[2]);
+    __m128i r3 = _mm_loadu_si128((const __m128i *)rows[3]);
+    __m128i r4 = _mm_loadu_si128((const __m128i *)rows[4]);
+    __m128i r5 = _mm_loadu_si128((const __m128i *)rows[5]);
+    __m128i r6 = _mm_loadu_si128((const __m128i *)rows[6]);
+    __m128i r7 = _mm_loadu_si128((const __m128i *)rows[7]);
+
+    __m128i a0 = _mm_unpacklo_epi16(r0, r1);
+    __m128i a1 = _mm_unpackhi_epi16(r0, r1);
+    __m128i a2 = _mm_unpacklo_epi16(r2, r3);
+    __m128i a3 = _mm_unpackhi_epi16(r2, r3);
+    __m128i a4 = _mm_unpacklo_epi16(r4, r5);
+    __m128i a5 = _mm_unpackhi_epi16(r4, r5);
+    __m128i a6 = _mm_unpacklo_epi16(r6, r7);
+    __m128i a7 = _mm_unpackhi_epi16(r6, r7);
+
+    __m128i b0 = _mm_unpacklo_epi32(a0, a2); // rows 0-3, columns 0, 1
+    __m128i b1 = _mm_unpackhi_epi32(a0, a2); // columns 2, 3
+    __m128i b2 = _mm_unpacklo_epi32(a1, a3); // columns 4, 5
+    __m128i b3 = _mm_unpackhi_epi32(a1, a3); // columns 6, 7
+    __m128i b4 = _mm_unpacklo_epi32(a4, a6); // rows 4-7
+    __m128i b5 = _mm_unpackhi_epi32(a4, a6);
+    __m128i b6 = _mm_unpacklo_epi32(a5, a7);
+    __m128i b7 = _mm_unpackhi_epi32(a5, a7);
+
+    _mm_storeu_si128((__m128i *)columns[0], _mm_unpacklo_epi64(b0, b4));
+    _mm_storeu_si128((__m128i *)columns[1], _mm_unpackhi_epi64(b0, b4));
+    _mm_storeu_si128((__m128i *)columns[2], _mm_unpacklo_epi64(b1, b5));
+    _mm_storeu_si128((__m128i *)columns[3], _mm_unpackhi_epi64(b1, b5));
+    _mm_storeu_si128((__m128i *)columns[4], _mm_unpacklo_epi64(b2, b6));
+    _mm_storeu_si128((__m128i *)columns[5], _mm_unpackhi_epi64(b2, b6));
+    _mm_storeu_si128((__m128i *)columns[6], _mm_unpacklo_epi64(b3, b7));
+    _mm_storeu_si128((__m128i *)columns[7], _mm_unpackhi_epi64(b3, b7));
+}
+
+static size_t PBJFrameReverseRow8SSE2(const uint8_t *src, uint8_t *dst, size_t count)
+{
+    size_t x = 0;
+    for (; x + 16 <= count; x += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + count - x - 16));
+        v = _mm_shuffle_epi32(v, _MM_SHUFFLE(0, 1, 2, 3));
+        v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+        v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+        v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+        _mm_storeu_si128((__m128i *)(dst + x), v);
+    }
+    return x;
+}
+
+static size_t PBJFrameReverseRow16SSE2(const uint8_t *src, uint8_t *dst, size_t count)
+{
+    size_t x = 0;
+    for (; x + 8 <= count; x += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + (count - x - 8) * 2));
+        v = _mm_shuffle_epi32(v, _MM_SHUFFLE(0, 1, 2, 3));
+        v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+        v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+        _mm_storeu_si128((__m128i *)(dst + x * 2), v);
+    }
+    return x;
+}
+
+#endif
+
+#pragma mark - neon
+
+#if PBJ_SIMD_NEON
+
+static void PBJFrameTranspose8x8x8NEON(const uint8_t *const *rows, uint8_t *const *columns)
+{
+    uint8x8x2_t t0 = vtrn_u8(vld1_u8(rows[0]), vld1_u8(rows[1]));
+    uint8x8x2_t t1 = vtrn_u8(vld1_u8(rows[2]), vld1_u8(rows[3]));
+    uint8x8x2_t t2 = vtrn_u8(vld1_u8(rows[4]), vld1_u8(rows[5]));
+    uint8x8x2_t t3 = vtrn_u8(vld1_u8(rows[6]), vld1_u8(rows[7]));
+
+    uint16x4x2_t u0 = vtrn_u16(vreinterpret_u16_u8(t0.val[0]), vreinterpret_u16_u8(t1.val[0])); // columns 0 4, 2 6
+    uint16x4x2_t u1 = vtrn_u16(vreinterpret_u16_u8(t0.val[1]), vreinterpret_u16_u8(t1.val[1])); // columns 1 5, 3 7
+    uint16x4x2_t u2 = vtrn_u16(vreinterpret_u16_u8(t2.val[0]), vreinterpret_u16_u8(t3.val[0]));
+    uint16x4x2_t u3 = vtrn_u16(vreinterpret_u16_u8(t2.val[1]), vreinterpret_u16_u8(t3.val[1]));
+
+    uint32x2x2_t v0 = vtrn_u32(vreinterpret_u32_u16(u0.val[0]), vreinterpret_u32_u16(u2.val[0]));
+    uint32x2x2_t v1 = vtrn_u32(vreinterpret_u32_u16(u1.val[0]), vreinterpret_u32_u16(u3.val[0]));
+    uint32x2x2_t v2 = vtrn_u32(vreinterpret_u32_u16(u0.val[1]), vreinterpret_u32_u16(u2.val[1]));
+    uint32x2x2_t v3 = vtrn_u32(vreinterpret_u32_u16(u1.val[1]), vreinterpret_u32_u16(u3.val[1]));
+
+    vst1_u8(columns[0], vreinterpret_u8_u32(v0.val[0]));
+    vst1_u8(columns[1], vreinterpret_u8_u32(v1.val[0]));
+    vst1_u8(columns[2], vreinterpret_u8_u32(v2.val[0]));
+    vst1_u8(columns[3], vreinterpret_u8_u32(v3.val[0]));
+    vst1_u8(columns[4], vreinterpret_u8_u32(v0.val[1]));
+    vst1_u8(columns[5], vreinterpret_u8_u32(v1.val[1]));
+    vst1_u8(columns[6], vreinterpret_u8_u32(v2.val[1]));
+    vst1_u8(columns[7], vreinterpret_u8_u32(v3.val[1]));
+}
+
+static void PBJFrameTranspose8x8x16NEON(const uint8_t *const *rows, uint8_t *const *columns)
+{
+    uint16x8x2_t t0 = vtrnq_u16(vld1q_u16((const uint16_t *)rows[0]), vld1q_u16((const uint16_t *)rows[1]));
+    uint16x8x2_t t1 = vtrnq_u16(vld1q_u16((const uint16_t *)rows[2]), vld1q_u16((const uint16_t *)rows[3]));
+    uint16x8x2_t t2 = vtrnq_u16(vld1q_u16((const uint16_t *)rows[4]), vld1q_u16((const uint16_t *)rows[5]));
+    uint16x8x2_t t3 = vtrnq_u16(vld1q_u16((const uint16_t *)rows[6]), vld1q_u16((const uint16_t *)rows[7]));
+
+    uint32x4x2_t u0 = vtrnq_u32(vreinterpretq_u32_u16(t0.val[0]), vreinterpretq_u32_u16(t1.val[0])); // rows 0-3, columns 0 4, 2 6
+    uint32x4x2_t u1 = vtrnq_u32(vreinterpretq_u32_u16(t0.val[1]), vreinterpretq_u32_u16(t1.val[1])); // columns 1 5, 3 7
+    uint32x4x2_t u2 = vtrnq_u32(vreinterpretq_u32_u16(t2.val[0]), vreinterpretq_u32_u16(t3.val[0])); // rows 4-7
+    uint32x4x2_t u3 = vtrnq_u32(vreinterpretq_u32_u16(t2.val[1]), vreinterpretq_u32_u16(t3.val[1]));
+
+    vst1q_u32((uint32_t *)columns[0], vcombine_u32(vget_low_u32(u0.val[0]), vget_low_u32(u2.val[0])));
+    vst1q_u32((uint32_t *)columns[1], vcombine_u32(vget_low_u32(u1.val[0]), vget_low_u32(u3.val[0])));
+    vst1q_u32((uint32_t *)columns[2], vcombine_u32(vget_low_u32(u0.val[1]), vget_low_u32(u2.val[1])));
+    vst1q_u32((uint32_t *)columns[3], vcombine_u32(vget_low_u32(u1.val[1]), vget_low_u32(u3.val[1])));
+    vst1q_u32((uint32_t *)columns[4], vcombine_u32(vget_high_u32(u0.val[0]), vget_high_u32(u2.val[0])));
+    vst1q_u32((uint32_t *)columns[5], vcombine_u32(vget_high_u32(u1.val[0]), vget_high_u32(u3.val[0])));
+    vst1q_u32((uint32_t *)columns[6], vcombine_u32(vget_high_u32(u0.val[1]), vget_high_u32(u2.val[1])));
+    vst1q_u32((uint32_t *)columns[7], vcombine_u32(vget_high_u32(u1.val[1]), vget_high_u32(u3.val[1])));
+}
+
+static size_t PBJFrameReverseRow8NEON(const uint8_t *src, uint8_t *dst, size_t count)
+{
+    size_t x = 0;
+    for (; x + 16 <= count; x += 16) {
+        uint8x16_t v = vrev64q_u8(vld1q_u8(src + count - x - 16));
+        vst1q_u8(dst + x, vcombine_u8(vget_high_u8(v), vget_low_u8(v)));
+    }
+    return x;
+}
+
+static size_t PBJFrameReverseRow16NEON(const uint8_t *src, uint8_t *dst, size_t count)
+{
+    size_t x = 0;
+    for (; x + 8 <= count; x += 8) {
+        uint16x8_t v = vrev64q_u16(vld1q_u16((const uint16_t *)(src + (count - x - 8) * 2)));
+        vst1q_u16((uint16_t *)(dst + x * 2), vcombine_u16(vget_high_u16(v), vget_low_u16(v)));
+    }
+    return x;
+}
+
+#endif
+
+#pragma mark - planes
+
+static void PBJFrameOrientStraightRows(const PBJFrameOrientPlane *plane, PBJFrameOrientMap map,
+                                       size_t rowBegin, size_t rowEnd, PBJFrameReverseRow reverse)
+{
+    const size_t e = plane->elementSize;
+    const size_t width = plane->sourceWidth;
+    for (size_t y = rowBegin; y < rowEnd; y++) {
+        size_t sy = map.flipY ? plane->sourceHeight - 1 - y : y;
+        const uint8_t *src = plane->source + sy * plane->sourceBytesPerRow;
+        uint8_t *dst = plane->destination + y * plane->destinationBytesPerRow;
+        if (!map.flipX) {
+            memcpy(dst, src, width * e);
+        } else {
+            size_t done = reverse ? reverse(src, dst, width) : 0;
+            PBJFrameReverseRowScalar(src, dst, width, e, done);
+        }
+    }
+}
+
+static void PBJFrameOrientTransposedRows(const PBJFrameOrientPlane *plane, PBJFrameOrientMap map,
+                                         size_t rowBegin, size_t rowEnd, PBJFrameTransposeBlock block)
+{
+    const size_t e = plane->elementSize;
+    const size_t tile = PBJ_FRAME_ORIENT_TILE_BYTES / e;
+    const size_t width = plane->destinationWidth;
+    const uint8_t *rows[PBJ_FRAME_ORIENT_BLOCK];
+    uint8_t *columns[PBJ_FRAME_ORIENT_BLOCK];
+
+    for (size_t ty = rowBegin; ty < rowEnd; ty += tile) {
+        size_t tyEnd = ty + tile < rowEnd ? ty + tile : rowEnd;
+        for (size_t tx = 0; tx < width; tx += tile) {
+            size_t txEnd = tx + tile < width ? tx + tile : width;
+
+            size_t y = ty;
+            for (; block && y + PBJ_FRAME_ORIENT_BLOCK <= tyEnd; y += PBJ_FRAME_ORIENT_BLOCK) {
+                // eight destination rows read eight adjacent source columns, flipped ones backwards
+                size_t sx = map.flipX ? plane->sourceWidth - PBJ_FRAME_ORIENT_BLOCK - y : y;
+                for (size_t k = 0; k < PBJ_FRAME_ORIENT_BLOCK; k++) {
+                    size_t row = map.flipX ? y + PBJ_FRAME_ORIENT_BLOCK - 1 - k : y + k;
+                    columns[k] = plane->destination + row * plane->destinationBytesPerRow;
+                }
+
+                size_t x = tx;
+                for (; x + PBJ_FRAME_ORIENT_BLOCK <= txEnd; x += PBJ_FRAME_ORIENT_BLOCK) {
+                    for (size_t i = 0; i < PBJ_FRAME_ORIENT_BLOCK; i++) {
+                        size_t sy = map.flipY ? plane->sourceHeight - 1 - (x + i) : x + i;
+                        rows[i] = plane->source + sy * plane->sourceBytesPerRow + sx * e;
+                    }
+                    uint8_t *out[PBJ_FRAME_ORIENT_BLOCK];
+                    for (size_t k = 0; k < PBJ_FRAME_ORIENT_BLOCK; k++) {
+                        out[k] = columns[k] + x * e;
+                    }
+                    block(rows, out);
+                }
+                PBJFrameTransposeRegionScalar(plane, map, x, txEnd, y, y + PBJ_FRAME_ORIENT_BLOCK);
+            }
+            PBJFrameTransposeRegionScalar(plane, map, tx, txEnd, y, tyEnd);
+        }
+    }
+}
+
+static void PBJFrameOrientPlaneRows(const PBJFrameOrientPlane *plane, PBJFrameOrientMap map,
+                                    size_t rowBegin, size_t rowEnd, PBJSIMDLevel level)
+{
+    PBJFrameTransposeBlock block = NULL;
+    PBJFrameReverseRow reverse = NULL;
+    switch (level) {
+#if PBJ_SIMD_SSE2
+        case PBJSIMDLevelSSE2:
+        case PBJSIMDLevelAVX2:
+            block = plane->elementSize == 2 ? PBJFrameTranspose8x8x16SSE2 : PBJFrameTranspose8x8x8SSE2;
+            reverse = plane->elementSize == 2 ? PBJFrameReverseRow16SSE2 : PBJFrameReverseRow8SSE2;
+            break;
+#endif
+#if PBJ_SIMD_NEON
+        case PBJSIMDLevelNEON:
+            block = plane->elementSize == 2 ? PBJFrameTranspose8x8x16NEON : PBJFrameTranspose8x8x8NEON;
+            reverse = plane->elementSize == 2 ? PBJFrameReverseRow16NEON : PBJFrameReverseRow8NEON;
+            break;
+#endif
+        default:
+            break;
+    }
+
+    if (map.transposed) {
+        PBJFrameOrientTransposedRows(plane, map, rowBegin, rowEnd, block);
+    } else {
+        PBJFrameOrientStraightRows(plane, map, rowBegin, rowEnd, reverse);
+    }
+}
+
+void PBJFrameOrientRows(const PBJNV12Image *source, PBJNV12Image *destination, PBJFrameOrientation orientation,
+                        size_t rowBegin, size_t rowEnd, PBJSIMDLevel level)
+{
+    if (!source || !destination || (unsigned)orientation > PBJFrameOrientationLeftMirrored)
+        return;
+    if ((source->width & 1) || (source->height & 1))
+        return;
+
+    size_t width = 0;
+    size_t height = 0;
+    PBJFrameOrientationOutputSize(orientation, source->width, source->height, &width, &height);
+    if (destination->width != width || destination->height != height)
+        return;
+
+    if (rowEnd > height)
+        rowEnd = height;
+    if (rowBegin >= rowEnd)
+        return;
+
+    const PBJFrameOrientMap map = PBJFrameOrientMaps[orientation];
+    PBJSIMDLevel resolved = PBJSIMDLevelResolve(level);
+
+    PBJFrameOrientPlane luma = {
+        source->luma, source->lumaBytesPerRow, source->width, source->height,
+        destination->luma, destination->lumaBytesPerRow, width, 1
+    };
+    PBJFrameOrientPlaneRows(&luma, map, rowBegin, rowEnd, resolved);
+
+    PBJFrameOrientPlane chroma = {
+        source->chroma, source->chromaBytesPerRow, PBJNV12ChromaWidth(source), PBJNV12ChromaHeight(source),
+        destination->chroma, destination->chromaBytesPerRow, PBJNV12ChromaWidth(destination), 2
+    };
+    size_t chromaEnd = (rowEnd + 1) / 2;
+    PBJFrameOrientPlaneRows(&chroma, map, rowBegin / 2, chromaEnd, resolved);
+}
@@ -0,0 +1,76 @@
+//
+//  PBJFrameOrientation.h
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef PBJFrameOrientation_h
+#define PBJFrameOrientation_h
+
+#include "PBJPlanarImage.h"
+#include "PBJSIMD.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// rotates and mirrors NV12 planes into another image so frames can be recorded upright
+// instead of carrying a track transform, 90 and 270 transpose in cache sized tiles of
+// 8x8 vector blocks, luma as bytes and chroma as CbCr pairs
+
+typedef enum {
+    PBJFrameOrientationUp = 0,
+    PBJFrameOrientationRight,  // rotated 90 clockwise
+    PBJFrameOrientationDown,   // rotated 180
+    PBJFrameOrientationLeft,   // rotated 270 clockwise
+    PBJFrameOrientationUpMirrored, // flipped horizontally, then rotated as above
+    PBJFrameOrientationRightMirrored,
+    PBJFrameOrientationDownMirrored,
+    PBJFrameOrientationLeftMirrored
+} PBJFrameOrientation;
+
+// degrees clockwise, rounded to the nearest quarter turn
+PBJFrameOrientation PBJFrameOrientationMake(double degrees, int mirrored);
+
+static inline int PBJFrameOrientationSwapsDimensions(PBJFrameOrientation orientation)
+{
+    return (orientation & 1) != 0;
+}
+
+void PBJFrameOrientationOutputSize(PBJFrameOrientation orientation, size_t width, size_t height,
+                                   size_t *outputWidth, size_t *outputHeight);
+
+// writes destination luma rows [rowBegin, rowEnd) and the chroma rows they cover, rowBegin must be
+// even. source dimensions must be even and the destination must be PBJFrameOrientationOutputSize,
+// the two may not overlap
+void PBJFrameOrientRows(const PBJNV12Image *source, PBJNV12Image *destination, PBJFrameOrientation orientation,
+                        size_t rowBegin, size_t rowEnd, PBJSIMDLevel level);
+
+static inline void PBJFrameOrient(const PBJNV12Image *source, PBJNV12Image *destination, PBJFrameOrientation orientation)
+{
+    PBJFrameOrientRows(source, destination, orientation, 0, destination->height, PBJSIMDLevelAuto);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PBJFrameOrientation_h */
@@ -0,0 +1,401 @@
+//
+//  PBJFramePool.c
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#if defined(__linux__)
+#   define _POSIX_C_SOURCE 200112L
+#endif
+
+#include "PBJFramePool.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+
+#define PBJ_FRAME_POOL_CACHE_LINE 64
+
+struct PBJFrameBuffer {
+    PBJFramePool *pool;
+    _Atomic(uint32_t) references;
+    PBJFrameFormat format;
+    size_t width;
+    size_t height;
+    size_t planeCount;
+    uint8_t *planes[PBJFrameBufferMaximumPlanes];
+    size_t bytesPerRow[PBJFrameBufferMaximumPlanes];
+    size_t rows[PBJFrameBufferMaximumPlanes];
+    size_t size; // the whole allocation, this header included
+
+    // idle list, guarded by the pool's mutex
+    PBJFrameBuffer *newer;
+    PBJFrameBuffer *older;
+};
+
+struct PBJFramePool {
+    pthread_mutex_t mutex;
+    PBJFramePoolConfiguration configuration;
+    int destroyed;
+
+    // most recently released first
+    PBJFrameBuffer *newest;
+    PBJFrameBuffer *oldest;
+
+    PBJFramePoolStatistics statistics;
+};
+
+static int PBJFramePoolIsPowerOfTwo(size_t value)
+{
+    return value != 0 && (value & (value - 1)) == 0;
+}
+
+static size_t PBJFramePoolRoundUp(size_t value, size_t alignment)
+{
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+PBJFramePoolConfiguration PBJFramePoolDefaultConfiguration(void)
+{
+    PBJFramePoolConfiguration configuration;
+    configuration.maximumBytes = 64 * 1024 * 1024;
+    configuration.alignment = PBJ_FRAME_POOL_CACHE_LINE;
+    configuration.rowAlignment = PBJ_FRAME_POOL_CACHE_LINE;
+    return configuration;
+}
+
+PBJFramePool *PBJFramePoolCreate(const PBJFramePoolConfiguration *configuration)
+{
+    PBJFramePool *pool = (PBJFramePool *)calloc(1, sizeof(PBJFramePool));
+    if (!pool)
+        return NULL;
+
+    pool->configuration = configuration ? *configuration : PBJFramePoolDefaultConfiguration();
+    if (!PBJFramePoolIsPowerOfTwo(pool->configuration.alignment) || pool->configuration.alignment < PBJ_FRAME_POOL_CACHE_LINE)
+        pool->configuration.alignment = PBJ_FRAME_POOL_CACHE_LINE;
+    if (!PBJFramePoolIsPowerOfTwo(pool->configuration.rowAlignment))
+        pool->configuration.rowAlignment = PBJ_FRAME_POOL_CACHE_LINE;
+
+    if (pthread_mutex_init(&pool->mutex, NULL) != 0) {
+        free(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+static void PBJFramePoolUnlinkIdle(PBJFramePool *pool, PBJFrameBuffer *buffer)
+{
+    if (buffer->newer)
+        buffer->newer->older = buffer->older;
+    else
+        pool->newest = buffer->older;
+    if (buffer->older)
+        buffer->older->newer = buffer->newer;
+    else
+        pool->oldest = buffer->newer;
+    buffer->newer = NULL;
+    buffer->older = NULL;
+}
+
+// unlinks idle buffers, oldest first, onto a list to be freed once the mutex is dropped
+static PBJFrameBuffer *PBJFramePoolEvictIdle(PBJFramePool *pool, size_t targetBytes)
+{
+    PBJFrameBuffer *evicted = NULL;
+    while (pool->oldest && pool->statistics.bytesResident > targetBytes) {
+        PBJFrameBuffer *buffer = pool->oldest;
+        PBJFramePoolUnlinkIdle(pool, buffer);
+        pool->statistics.bytesResident -= buffer->size;
+        pool->statistics.buffersResident--;
+        pool->statistics.evictions++;
+        buffer->older = evicted;
+        evicted = buffer;
+    }
+    return evicted;
+}
+
+static void PBJFramePoolFreeList(PBJFrameBuffer *buffer)
+{
+    while (buffer) {
+        PBJFrameBuffer *older = buffer->older;
+        free(buffer);
+        buffer = older;
+    }
+}
+
+static void PBJFramePoolFree(PBJFramePool *pool)
+{
+    pthread_mutex_destroy(&pool->mutex);
+    free(pool);
+}
+
+void PBJFramePoolDestroy(PBJFramePool *pool)
+{
+    if (!pool)
+        return;
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->destroyed = 1;
+    PBJFrameBuffer *evicted = PBJFramePoolEvictIdle(pool, 0);
+    int outstanding = pool->statistics.buffersInUse > 0;
+    pthread_mutex_unlock(&pool->mutex);
+
+    PBJFramePoolFreeList(evicted);
+    if (!outstanding)
+        PBJFramePoolFree(pool);
+}
+
+static PBJFramePool *PBJFramePoolShared = NULL;
+static pthread_once_t PBJFramePoolSharedOnce = PTHREAD_ONCE_INIT;
+
+static void PBJFramePoolCreateShared(void)
+{
+    PBJFramePoolShared = PBJFramePoolCreate(NULL);
+}
+
+PBJFramePool *PBJFramePoolGetShared(void)
+{
+    pthread_once(&PBJFramePoolSharedOnce, PBJFramePoolCreateShared);
+    return PBJFramePoolShared;
+}
+
+void PBJFramePoolSetMaximumBytes(PBJFramePool *pool, size_t maximumBytes)
+{
+    pthread_mutex_lock(&pool->mutex);
+    pool->configuration.maximumBytes = maximumBytes;
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+#pragma mark - buffers
+
+// plane geometry and the allocation size, 0 when the size overflows
+static size_t PBJFramePoolLayout(const PBJFramePoolConfiguration *configuration, PBJFrameBuffer *layout)
+{
+    size_t rowAlignment = configuration->rowAlignment;
+    size_t width = layout->width;
+    size_t height = layout->height;
+    size_t rowBytes[PBJFrameBufferMaximumPlanes] = { 0, 0 };
+
+    switch (layout->format) {
+        case PBJFrameFormatNV12:
+            layout->planeCount = 2;
+            rowBytes[0] = width;
+            layout->rows[0] = height;
+            rowBytes[1] = ((width + 1) >> 1) * 2;
+            layout->rows[1] = (height + 1) >> 1;
+            break;
+        case PBJFrameFormatBGRA:
+            layout->planeCount = 1;
+            if (__builtin_mul_overflow(width, (size_t)4, &rowBytes[0]))
+                return 0;
+            layout->rows[0] = height;
+            break;
+        case PBJFrameFormatBytes:
+        default:
+            layout->planeCount = 1;
+            rowBytes[0] = width;
+            layout->rows[0] = height;
+            break;
+    }
+
+    size_t size = PBJFramePoolRoundUp(sizeof(PBJFrameBuffer), configuration->alignment);
+    for (size_t plane = 0; plane < layout->planeCount; plane++) {
+        if (rowBytes[plane] > SIZE_MAX - rowAlignment)
+            return 0;
+        layout->bytesPerRow[plane] = PBJFramePoolRoundUp(rowBytes[plane], rowAlignment);
+
+        size_t planeSize = 0;
+        if (__builtin_mul_overflow(layout->bytesPerRow[plane], layout->rows[plane], &planeSize) ||
+            planeSize > SIZE_MAX - configuration->alignment - size)
+            return 0;
+        size += PBJFramePoolRoundUp(planeSize, configuration->alignment);
+    }
+    return size;
+}
+
+PBJFrameBuffer *PBJFramePoolAcquire(PBJFramePool *pool, PBJFrameFormat format, size_t width, size_t height)
+{
+    if (!pool || width == 0 || height == 0 || format < 0 || format >= PBJFrameFormatCount)
+        return NULL;
+
+    pthread_mutex_lock(&pool->mutex);
+    PBJFrameBuffer *buffer = pool->newest;
+    while (buffer && (buffer->format != format || buffer->width != width || buffer->height != height))
+        buffer = buffer->older;
+    if (buffer) {
+        PBJFramePoolUnlinkIdle(pool, buffer);
+        pool->statistics.hits++;
+        pool->statistics.bytesInUse += buffer->size;
+        pool->statistics.buffersInUse++;
+    } else {
+        pool->statistics.misses++;
+    }
+    PBJFramePoolConfiguration configuration = pool->configuration;
+    pthread_mutex_unlock(&pool->mutex);
+
+    if (buffer) {
+        atomic_store_explicit(&buffer->references, 1, memory_order_relaxed);
+        return buffer;
+    }
+
+    PBJFrameBuffer layout = { 0 };
+    layout.format = format;
+    layout.width = width;
+    layout.height = height;
+    size_t size = PBJFramePoolLayout(&configuration, &layout);
+    void *memory = NULL;
+    if (size == 0 || posix_memalign(&memory, configuration.alignment, size) != 0)
+        return NULL;
+
+    buffer = (PBJFrameBuffer *)memory;
+    *buffer = layout;
+    buffer->pool = pool;
+    buffer->size = size;
+    atomic_init(&buffer->references, 1);
+    uint8_t *plane = (uint8_t *)memory + PBJFramePoolRoundUp(sizeof(PBJFrameBuffer), configuration.alignment);
+    for (size_t i = 0; i < buffer->planeCount; i++) {
+        buffer->planes[i] = plane;
+        plane += PBJFramePoolRoundUp(buffer->bytesPerRow[i] * buffer->rows[i], configuration.alignment);
+    }
+
+    // a new buffer may push idle ones out
+    pthread_mutex_lock(&pool->mutex);
+    PBJFramePoolStatistics *statistics = &pool->statistics;
+    statistics->bytesResident += size;
+    statistics->buffersResident++;
+    statistics->bytesInUse += size;
+    statistics->buffersInUse++;
+    if (statistics->bytesResident > statistics->peakBytesResident)
+        statistics->peakBytesResident = statistics->bytesResident;
+    PBJFrameBuffer *evicted = PBJFramePoolEvictIdle(pool, pool->configuration.maximumBytes);
+    pthread_mutex_unlock(&pool->mutex);
+
+    PBJFramePoolFreeList(evicted);
+    return buffer;
+}
+
+void PBJFramePoolTrim(PBJFramePool *pool, size_t targetBytes)
+{
+    pthread_mutex_lock(&pool->mutex);
+    PBJFrameBuffer *evicted = PBJFramePoolEvictIdle(pool, targetBytes);
+    pthread_mutex_unlock(&pool->mutex);
+
+    PBJFramePoolFreeList(evicted);
+}
+
+PBJFramePoolStatistics PBJFramePoolGetStatistics(PBJFramePool *pool)
+{
+    pthread_mutex_lock(&pool->mutex);
+    PBJFramePoolStatistics statistics = pool->statistics;
+    pthread_mutex_unlock(&pool->mutex);
+    return statistics;
+}
+
+PBJFrameBuffer *PBJFrameBufferRetain(PBJFrameBuffer *buffer)
+{
+    if (buffer)
+        atomic_fetch_add_explicit(&buffer->references, 1, memory_order_relaxed);
+    return buffer;
+}
+
+void PBJFrameBufferRelease(PBJFrameBuffer *buffer)
+{
+    if (!buffer || atomic_fetch_sub_explicit(&buffer->references, 1, memory_order_acq_rel) != 1)
+        return;
+
+    PBJFramePool *pool = buffer->pool;
+    pthread_mutex_lock(&pool->mutex);
+    PBJFramePoolStatistics *statistics = &pool->statistics;
+    statistics->bytesInUse -= buffer->size;
+    statistics->buffersInUse--;
+
+    PBJFrameBuffer *evicted = NULL;
+    int freePool = 0;
+    if (pool->destroyed) {
+        statistics->bytesResident -= buffer->size;
+        statistics->buffersResident--;
+        buffer->older = NULL;
+        evicted = buffer;
+        freePool = statistics->buffersInUse == 0;
+    } else {
+        buffer->newer = NULL;
+        buffer->older = pool->newest;
+        if (pool->newest)
+            pool->newest->newer = buffer;
+        else
+            pool->oldest = buffer;
+        pool->newest = buffer;
+        evicted = PBJFramePoolEvictIdle(pool, pool->configuration.maximumBytes);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+
+    PBJFramePoolFreeList(evicted);
+    if (freePool)
+        PBJFramePoolFree(pool);
+}
+
+PBJFrameFormat PBJFrameBufferGetFormat(const PBJFrameBuffer *buffer)
+{
+    return buffer->format;
+}
+
+size_t PBJFrameBufferGetWidth(const PBJFrameBuffer *buffer)
+{
+    return buffer->width;
+}
+
+size_t PBJFrameBufferGetHeight(const PBJFrameBuffer *buffer)
+{
+    return buffer->height;
+}
+
+size_t PBJFrameBufferGetPlaneCount(const PBJFrameBuffer *buffer)
+{
+    return buffer->planeCount;
+}
+
+uint8_t *PBJFrameBufferGetPlane(const PBJFrameBuffer *buffer, size_t plane)
+{
+    return plane < buffer->planeCount ? buffer->planes[plane] : NULL;
+}
+
+size_t PBJFrameBufferGetBytesPerRow(const PBJFrameBuffer *buffer, size_t plane)
+{
+    return plane < buffer->planeCount ? buffer->bytesPerRow[plane] : 0;
+}
+
+size_t PBJFrameBufferGetPlaneSize(const PBJFrameBuffer *buffer, size_t plane)
+{
+    return plane < buffer->planeCount ? buffer->bytesPerRow[plane] * buffer->rows[plane] : 0;
+}
+
+PBJNV12Image PBJFrameBufferGetNV12Image(const PBJFrameBuffer *buffer, PBJYCbCrRange range)
+{
+    PBJNV12Image image;
+    image.luma = buffer->planes[0];
+    image.lumaBytesPerRow = buffer->bytesPerRow[0];
+    image.chroma = buffer->format == PBJFrameFormatNV12 ? buffer->planes[1] : NULL;
+    image.chromaBytesPerRow = buffer->format == PBJFrameFormatNV12 ? buffer->bytesPerRow[1] : 0;
+    image.width = buffer->width;
+    image.height = buffer->height;
+    image.range = range;
+    return image;
+}
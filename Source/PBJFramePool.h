@@ -0,0 +1,123 @@
+//
+//  PBJFramePool.h
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+
+#ifndef PBJFramePool_h
+#define PBJFramePool_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "PBJPlanarImage.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// recycled memory for the frames built on the CPU (converted photos, thumbnails, resampling
+// scratch), keyed by format, width and height. every plane starts on an aligned boundary and
+// every row is padded to the row alignment, so vector loads never straddle a cache line at a
+// row start. buffers are reference counted, a consumer can hold one (ie as a CGImage's pixels)
+// without a copy and it returns to the pool with the last release. idle buffers are released
+// least recently used first to keep the pool under its cap, buffers in use are never taken
+// back so a burst can briefly exceed it. thread safe
+
+typedef enum {
+    PBJFrameFormatNV12 = 0, // luma plane, then interleaved CbCr at half height
+    PBJFrameFormatBGRA, // 4 bytes a pixel
+    PBJFrameFormatBytes, // a byte a pixel, ie scratch rows
+    PBJFrameFormatCount
+} PBJFrameFormat;
+
+#define PBJFrameBufferMaximumPlanes 2
+
+typedef struct {
+    size_t maximumBytes; // resident, in use and idle together
+    size_t alignment; // of each plane, a power of two, at least a cache line
+    size_t rowAlignment; // bytes per row are a multiple of it, a power of two
+} PBJFramePoolConfiguration;
+
+typedef struct {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions; // idle buffers released for the cap or a trim
+    uint64_t bytesResident;
+    uint64_t bytesInUse;
+    uint64_t peakBytesResident;
+    uint32_t buffersResident;
+    uint32_t buffersInUse;
+} PBJFramePoolStatistics;
+
+typedef struct PBJFramePool PBJFramePool;
+typedef struct PBJFrameBuffer PBJFrameBuffer;
+
+#pragma mark - pool
+
+// 64MB, planes and rows aligned to 64 bytes
+PBJFramePoolConfiguration PBJFramePoolDefaultConfiguration(void);
+
+PBJFramePool *PBJFramePoolCreate(const PBJFramePoolConfiguration *configuration);
+// buffers still in use stay valid, the pool goes with the last of them
+void PBJFramePoolDestroy(PBJFramePool *pool);
+
+// the library wide pool, created with the default configuration on first use, never destroyed
+PBJFramePool *PBJFramePoolGetShared(void);
+
+// applies from the next acquire or release
+void PBJFramePoolSetMaximumBytes(PBJFramePool *pool, size_t maximumBytes);
+
+// the most recently released idle buffer of the format and size, else a new one, contents
+// are undefined. returns NULL for an empty size or when memory runs out
+PBJFrameBuffer *PBJFramePoolAcquire(PBJFramePool *pool, PBJFrameFormat format, size_t width, size_t height);
+
+// releases idle buffers, least recently used first, until no more than targetBytes are
+// resident, ie 0 on memory pressure
+void PBJFramePoolTrim(PBJFramePool *pool, size_t targetBytes);
+
+PBJFramePoolStatistics PBJFramePoolGetStatistics(PBJFramePool *pool);
+
+#pragma mark - buffers
+
+PBJFrameBuffer *PBJFrameBufferRetain(PBJFrameBuffer *buffer);
+// the last release returns the buffer to its pool, NULL is ignored
+void PBJFrameBufferRelease(PBJFrameBuffer *buffer);
+
+PBJFrameFormat PBJFrameBufferGetFormat(const PBJFrameBuffer *buffer);
+size_t PBJFrameBufferGetWidth(const PBJFrameBuffer *buffer);
+size_t PBJFrameBufferGetHeight(const PBJFrameBuffer *buffer);
+size_t PBJFrameBufferGetPlaneCount(const PBJFrameBuffer *buffer);
+uint8_t *PBJFrameBufferGetPlane(const PBJFrameBuffer *buffer, size_t plane);
+size_t PBJFrameBufferGetBytesPerRow(const PBJFrameBuffer *buffer, size_t plane);
+// bytes per row times the plane's rows
+size_t PBJFrameBufferGetPlaneSize(const PBJFrameBuffer *buffer, size_t plane);
+
+// the planes of an NV12 buffer as the converters and resamplers take them
+PBJNV12Image PBJFrameBufferGetNV12Image(const PBJFrameBuffer *buffer, PBJYCbCrRange range);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PBJFramePool_h */
@@ -0,0 +1,438 @@
+//
+//  PBJFrameProcessor.c
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#if defined(__linux__)
+#   define _POSIX_C_SOURCE 200112L
+#endif
+
+#include "PBJFrameProcessor.h"
+#include "PBJInstrumentation.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define PBJFrameProcessorMaximumSlots 8 // workers and the calling thread
+#define PBJFrameProcessorDefaultTileRows 64
+
+// consecutive stages sharing tiles, only the first may be out of place
+typedef struct {
+    size_t firstStage;
+    size_t stageCount;
+} PBJFramePass;
+
+typedef struct {
+    struct PBJFrameProcessor *processor;
+    size_t slot;
+} PBJFrameProcessorWorker;
+
+struct PBJFrameProcessor {
+    PBJFrameStage stages[PBJFrameProcessorMaximumStages];
+    size_t stageCount;
+    PBJFramePass passes[PBJFrameProcessorMaximumStages];
+    size_t passCount;
+    size_t tileRows;
+
+    // pool, slot 0 is the calling thread
+    pthread_t threads[PBJFrameProcessorMaximumSlots];
+    PBJFrameProcessorWorker workers[PBJFrameProcessorMaximumSlots];
+    size_t threadCount;
+    pthread_mutex_t mutex;
+    pthread_cond_t wakeCondition;
+    pthread_cond_t idleCondition;
+    uint64_t generation; // guarded by mutex
+    size_t busyWorkers; // guarded by mutex
+    int stopping; // guarded by mutex
+
+    // the pass in flight, published under the mutex before generation moves
+    const PBJFramePass *pass;
+    const PBJNV12Image *source;
+    PBJNV12Image *destination;
+    size_t tileCount;
+
+    // each slot owns a run of tiles, taken from the front by its owner and from the back by thieves
+    _Atomic(uint64_t) ranges[PBJFrameProcessorMaximumSlots]; // begin << 32 | end
+
+    _Atomic(uint64_t) frames;
+    _Atomic(uint64_t) framesLate;
+    _Atomic(uint64_t) tiles;
+    _Atomic(uint64_t) tilesStolen;
+};
+
+#pragma mark - tiles
+
+static void PBJFrameProcessorCarryRows(const PBJNV12Image *source, PBJNV12Image *destination, uint32_t planes, PBJFrameTile tile)
+{
+    if (!(planes & PBJFramePlaneLuma)) {
+        for (size_t row = tile.rowBegin; row < tile.rowEnd; row++) {
+            memcpy(destination->luma + row * destination->lumaBytesPerRow, source->luma + row * source->lumaBytesPerRow, source->width);
+        }
+    }
+    if (!(planes & PBJFramePlaneChroma)) {
+        size_t chromaRowEnd = (tile.rowEnd + 1) >> 1;
+        size_t chromaBytes = PBJNV12ChromaWidth(source) * 2;
+        for (size_t row = tile.rowBegin >> 1; row < chromaRowEnd; row++) {
+            memcpy(destination->chroma + row * destination->chromaBytesPerRow, source->chroma + row * source->chromaBytesPerRow, chromaBytes);
+        }
+    }
+}
+
+static void PBJFrameProcessorRunTile(PBJFrameProcessor *processor, size_t tileIndex)
+{
+    const PBJFramePass *pass = processor->pass;
+    const PBJNV12Image *source = processor->source;
+    PBJNV12Image *destination = processor->destination;
+
+    PBJFrameTile tile;
+    tile.index = tileIndex;
+    tile.rowBegin = tileIndex * processor->tileRows;
+    tile.rowEnd = tile.rowBegin + processor->tileRows;
+    if (tile.rowEnd > destination->height)
+        tile.rowEnd = destination->height;
+
+    const PBJFrameStage *first = &processor->stages[pass->firstStage];
+    first->process(first->context, source, destination, tile);
+    if (source != destination) {
+        PBJFrameProcessorCarryRows(source, destination, first->planes, tile);
+    }
+
+    for (size_t i = 1; i < pass->stageCount; i++) {
+        const PBJFrameStage *stage = &processor->stages[pass->firstStage + i];
+        stage->process(stage->context, destination, destination, tile);
+    }
+}
+
+static int PBJFrameProcessorTakeFront(_Atomic(uint64_t) *range, size_t *tileIndex)
+{
+    uint64_t value = atomic_load_explicit(range, memory_order_acquire);
+    for (;;) {
+        uint32_t begin = (uint32_t)(value >> 32);
+        uint32_t end = (uint32_t)value;
+        if (begin >= end)
+            return 0;
+        uint64_t next = ((uint64_t)(begin + 1) << 32) | end;
+        if (atomic_compare_exchange_weak_explicit(range, &value, next, memory_order_acq_rel, memory_order_acquire)) {
+            *tileIndex = begin;
+            return 1;
+        }
+    }
+}
+
+static int PBJFrameProcessorTakeBack(_Atomic(uint64_t) *range, size_t *tileIndex)
+{
+    uint64_t value = atomic_load_explicit(range, memory_order_acquire);
+    for (;;) {
+        uint32_t begin = (uint32_t)(value >> 32);
+        uint32_t end = (uint32_t)value;
+        if (begin >= end)
+            return 0;
+        uint64_t next = ((uint64_t)begin << 32) | (end - 1);
+        if (atomic_compare_exchange_weak_explicit(range, &value, next, memory_order_acq_rel, memory_order_acquire)) {
+            *tileIndex = end - 1;
+            return 1;
+        }
+    }
+}
+
+// drains the slot's own run, then steals from the others until every run is empty
+static void PBJFrameProcessorWork(PBJFrameProcessor *processor, size_t slot)
+{
+    size_t slotCount = processor->threadCount + 1;
+    size_t tileIndex = 0;
+    uint64_t completed = 0;
+    uint64_t stolen = 0;
+
+    while (PBJFrameProcessorTakeFront(&processor->ranges[slot], &tileIndex)) {
+        PBJFrameProcessorRunTile(processor, tileIndex);
+        completed++;
+    }
+
+    for (;;) {
+        int found = 0;
+        for (size_t offset = 1; offset < slotCount; offset++) {
+            size_t victim = (slot + offset) % slotCount;
+            if (PBJFrameProcessorTakeBack(&processor->ranges[victim], &tileIndex)) {
+                PBJFrameProcessorRunTile(processor, tileIndex);
+                completed++;
+                stolen++;
+                found = 1;
+                break;
+            }
+        }
+        if (!found)
+            break;
+    }
+
+    atomic_fetch_add_explicit(&processor->tiles, completed, memory_order_relaxed);
+    if (stolen) {
+        atomic_fetch_add_explicit(&processor->tilesStolen, stolen, memory_order_relaxed);
+    }
+}
+
+#pragma mark - pool
+
+static void *PBJFrameProcessorThread(void *argument)
+{
+    PBJFrameProcessorWorker *worker = (PBJFrameProcessorWorker *)argument;
+    PBJFrameProcessor *processor = worker->processor;
+    uint64_t seen = 0; // a worker that starts late still owes the first generation
+
+    pthread_mutex_lock(&processor->mutex);
+    for (;;) {
+        while (!processor->stopping && processor->generation == seen) {
+            pthread_cond_wait(&processor->wakeCondition, &processor->mutex);
+        }
+        if (processor->stopping)
+            break;
+        seen = processor->generation;
+        pthread_mutex_unlock(&processor->mutex);
+
+        PBJFrameProcessorWork(processor, worker->slot);
+
+        pthread_mutex_lock(&processor->mutex);
+        if (--processor->busyWorkers == 0) {
+            pthread_cond_signal(&processor->idleCondition);
+        }
+    }
+    pthread_mutex_unlock(&processor->mutex);
+    return NULL;
+}
+
+static void PBJFrameProcessorRunPass(PBJFrameProcessor *processor, const PBJFramePass *pass, const PBJNV12Image *source, PBJNV12Image *destination, size_t tileCount)
+{
+    processor->pass = pass;
+    processor->source = source;
+    processor->destination = destination;
+    processor->tileCount = tileCount;
+
+    // too little work to be worth a wake up
+    if (processor->threadCount == 0 || tileCount < 2) {
+        for (size_t tileIndex = 0; tileIndex < tileCount; tileIndex++) {
+            PBJFrameProcessorRunTile(processor, tileIndex);
+        }
+        atomic_fetch_add_explicit(&processor->tiles, tileCount, memory_order_relaxed);
+        return;
+    }
+
+    size_t slotCount = processor->threadCount + 1;
+    for (size_t slot = 0; slot < slotCount; slot++) {
+        uint64_t begin = tileCount * slot / slotCount;
+        uint64_t end = tileCount * (slot + 1) / slotCount;
+        atomic_store_explicit(&processor->ranges[slot], (begin << 32) | end, memory_order_relaxed);
+    }
+
+    pthread_mutex_lock(&processor->mutex);
+    processor->generation++;
+    processor->busyWorkers = processor->threadCount;
+    pthread_cond_broadcast(&processor->wakeCondition);
+    pthread_mutex_unlock(&processor->mutex);
+
+    PBJFrameProcessorWork(processor, 0);
+
+    // every worker parks before the next pass republishes the job
+    pthread_mutex_lock(&processor->mutex);
+    while (processor->busyWorkers > 0) {
+        pthread_cond_wait(&processor->idleCondition, &processor->mutex);
+    }
+    pthread_mutex_unlock(&processor->mutex);
+}
+
+#pragma mark - processor
+
+PBJFrameProcessorConfiguration PBJFrameProcessorDefaultConfiguration(void)
+{
+    PBJFrameProcessorConfiguration configuration = { 0, PBJFrameProcessorDefaultTileRows };
+    return configuration;
+}
+
+PBJFrameProcessor *PBJFrameProcessorCreate(const PBJFrameProcessorConfiguration *configuration)
+{
+    PBJFrameProcessorConfiguration defaults = PBJFrameProcessorDefaultConfiguration();
+    if (!configuration)
+        configuration = &defaults;
+
+    PBJFrameProcessor *processor = (PBJFrameProcessor *)calloc(1, sizeof(PBJFrameProcessor));
+    if (!processor)
+        return NULL;
+
+    size_t tileRows = configuration->tileRows ? configuration->tileRows : PBJFrameProcessorDefaultTileRows;
+    processor->tileRows = (tileRows + 1) & ~(size_t)1;
+
+    size_t threadCount = configuration->threadCount;
+    if (threadCount == PBJFrameProcessorNoWorkers) {
+        threadCount = 0;
+    } else if (threadCount == 0) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        threadCount = cores > 1 ? (size_t)(cores - 1) : 0;
+    }
+    if (threadCount > PBJFrameProcessorMaximumSlots - 1)
+        threadCount = PBJFrameProcessorMaximumSlots - 1;
+
+    for (size_t slot = 0; slot < PBJFrameProcessorMaximumSlots; slot++) {
+        atomic_init(&processor->ranges[slot], 0);
+    }
+    atomic_init(&processor->frames, 0);
+    atomic_init(&processor->framesLate, 0);
+    atomic_init(&processor->tiles, 0);
+    atomic_init(&processor->tilesStolen, 0);
+
+    pthread_mutex_init(&processor->mutex, NULL);
+    pthread_cond_init(&processor->wakeCondition, NULL);
+    pthread_cond_init(&processor->idleCondition, NULL);
+
+    // a pool that comes up short still works with fewer threads
+    for (size_t i = 0; i < threadCount; i++) {
+        PBJFrameProcessorWorker *worker = &processor->workers[i + 1];
+        worker->processor = processor;
+        worker->slot = i + 1;
+        if (pthread_create(&processor->threads[i], NULL, PBJFrameProcessorThread, worker) != 0)
+            break;
+        processor->threadCount++;
+    }
+
+    return processor;
+}
+
+void PBJFrameProcessorDestroy(PBJFrameProcessor *processor)
+{
+    if (!processor)
+        return;
+
+    pthread_mutex_lock(&processor->mutex);
+    processor->stopping = 1;
+    pthread_cond_broadcast(&processor->wakeCondition);
+    pthread_mutex_unlock(&processor->mutex);
+
+    for (size_t i = 0; i < processor->threadCount; i++) {
+        pthread_join(processor->threads[i], NULL);
+    }
+
+    pthread_cond_destroy(&processor->idleCondition);
+    pthread_cond_destroy(&processor->wakeCondition);
+    pthread_mutex_destroy(&processor->mutex);
+    free(processor);
+}
+
+int PBJFrameProcessorAddStage(PBJFrameProcessor *processor, const PBJFrameStage *stage)
+{
+    if (!processor || !stage || !stage->process || processor->stageCount == PBJFrameProcessorMaximumStages)
+        return 0;
+
+    size_t index = processor->stageCount++;
+    processor->stages[index] = *stage;
+
+    if (processor->passCount == 0 || !stage->inPlace) {
+        PBJFramePass *pass = &processor->passes[processor->passCount++];
+        pass->firstStage = index;
+        pass->stageCount = 1;
+    } else {
+        processor->passes[processor->passCount - 1].stageCount++;
+    }
+    return 1;
+}
+
+void PBJFrameProcessorRemoveAllStages(PBJFrameProcessor *processor)
+{
+    if (!processor)
+        return;
+
+    processor->stageCount = 0;
+    processor->passCount = 0;
+}
+
+size_t PBJFrameProcessorGetStageCount(const PBJFrameProcessor *processor)
+{
+    return processor ? processor->stageCount : 0;
+}
+
+int PBJFrameProcessorNeedsSpare(const PBJFrameProcessor *processor)
+{
+    if (!processor)
+        return 0;
+
+    for (size_t i = 0; i < processor->stageCount; i++) {
+        if (!processor->stages[i].inPlace)
+            return 1;
+    }
+    return 0;
+}
+
+PBJFrameProcessorResult PBJFrameProcessorRun(PBJFrameProcessor *processor, PBJNV12Image *frame, PBJNV12Image *spare, uint64_t deadline)
+{
+    PBJFrameProcessorResult result = { 0, 0, 0 };
+    if (!processor || !frame || processor->stageCount == 0 || frame->height == 0)
+        return result;
+
+    if (PBJFrameProcessorNeedsSpare(processor) &&
+        (!spare || spare->width != frame->width || spare->height != frame->height)) {
+        result.stagesSkipped = processor->stageCount;
+        return result;
+    }
+
+    PBJNV12Image *current = frame;
+    PBJNV12Image *other = spare;
+    size_t tileCount = (frame->height + processor->tileRows - 1) / processor->tileRows;
+
+    for (size_t p = 0; p < processor->passCount; p++) {
+        const PBJFramePass *pass = &processor->passes[p];
+        if (deadline && PBJInstrumentationNow() >= deadline) {
+            result.stagesSkipped = processor->stageCount - pass->firstStage;
+            break;
+        }
+
+        if (processor->stages[pass->firstStage].inPlace) {
+            PBJFrameProcessorRunPass(processor, pass, current, current, tileCount);
+        } else {
+            PBJFrameProcessorRunPass(processor, pass, current, other, tileCount);
+            PBJNV12Image *previous = current;
+            current = other;
+            other = previous;
+        }
+        result.stagesRun += pass->stageCount;
+    }
+
+    result.outputInSpare = (current == spare);
+
+    atomic_fetch_add_explicit(&processor->frames, 1, memory_order_relaxed);
+    if (result.stagesSkipped) {
+        atomic_fetch_add_explicit(&processor->framesLate, 1, memory_order_relaxed);
+    }
+    return result;
+}
+
+PBJFrameProcessorCounters PBJFrameProcessorGetCounters(const PBJFrameProcessor *processor)
+{
+    PBJFrameProcessorCounters counters = { 0, 0, 0, 0 };
+    if (!processor)
+        return counters;
+
+    PBJFrameProcessor *mutableProcessor = (PBJFrameProcessor *)processor;
+    counters.frames = atomic_load_explicit(&mutableProcessor->frames, memory_order_relaxed);
+    counters.framesLate = atomic_load_explicit(&mutableProcessor->framesLate, memory_order_relaxed);
+    counters.tiles = atomic_load_explicit(&mutableProcessor->tiles, memory_order_relaxed);
+    counters.tilesStolen = atomic_load_explicit(&mutableProcessor->tilesStolen, memory_order_relaxed);
+    return counters;
+}
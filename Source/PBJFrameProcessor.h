@@ -0,0 +1,119 @@
+//
+//  PBJFrameProcessor.h
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef PBJFrameProcessor_h
+#define PBJFrameProcessor_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "PBJPlanarImage.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// a chain of per-frame processing stages run over NV12 frames in row tiles across a small
+// work-stealing thread pool, the calling thread included. consecutive in-place stages are
+// fused so each tile passes through all of them while it is still in cache. a stage that reads
+// outside its tile runs out of place, it starts a new pass, reading the previous result and
+// writing the spare frame, the two then trade roles, so no stage ever copies a whole frame
+
+#pragma mark - stages
+
+typedef enum {
+    PBJFramePlaneLuma = 1 << 0,
+    PBJFramePlaneChroma = 1 << 1,
+    PBJFramePlaneAll = PBJFramePlaneLuma | PBJFramePlaneChroma
+} PBJFramePlane;
+
+// luma rows [rowBegin, rowEnd), both even except a final odd height, chroma rows are half
+typedef struct {
+    size_t rowBegin;
+    size_t rowEnd;
+    size_t index;
+} PBJFrameTile;
+
+// writes the tile's rows of the planes it declares, in place stages get source == destination,
+// out of place stages may read any row of source. called concurrently for different tiles
+typedef void (*PBJFrameStageFunction)(void *context, const PBJNV12Image *source, PBJNV12Image *destination, PBJFrameTile tile);
+
+typedef struct {
+    PBJFrameStageFunction process;
+    void *context; // not owned, must outlive the stage
+    uint32_t planes; // PBJFramePlane mask written, undeclared planes are carried over for out of place stages
+    int inPlace;
+} PBJFrameStage;
+
+#pragma mark - processor
+
+#define PBJFrameProcessorMaximumStages 16
+
+// a threadCount that runs every tile on the calling thread
+#define PBJFrameProcessorNoWorkers ((size_t)-1)
+
+typedef struct {
+    size_t threadCount; // workers besides the calling thread, 0 picks one less than the online cores, at most 7
+    size_t tileRows; // rounded up to even, default 64
+} PBJFrameProcessorConfiguration;
+
+typedef struct {
+    int outputInSpare; // the processed frame is in spare rather than frame
+    size_t stagesRun;
+    size_t stagesSkipped; // passes not started before the deadline
+} PBJFrameProcessorResult;
+
+typedef struct {
+    uint64_t frames;
+    uint64_t framesLate; // skipped at least one stage
+    uint64_t tiles;
+    uint64_t tilesStolen;
+} PBJFrameProcessorCounters;
+
+typedef struct PBJFrameProcessor PBJFrameProcessor;
+
+PBJFrameProcessorConfiguration PBJFrameProcessorDefaultConfiguration(void);
+
+PBJFrameProcessor *PBJFrameProcessorCreate(const PBJFrameProcessorConfiguration *configuration);
+// joins the workers
+void PBJFrameProcessorDestroy(PBJFrameProcessor *processor);
+
+// stage changes and runs must come from one thread at a time, returns 0 when the chain is full
+int PBJFrameProcessorAddStage(PBJFrameProcessor *processor, const PBJFrameStage *stage);
+void PBJFrameProcessorRemoveAllStages(PBJFrameProcessor *processor);
+size_t PBJFrameProcessorGetStageCount(const PBJFrameProcessor *processor);
+int PBJFrameProcessorNeedsSpare(const PBJFrameProcessor *processor);
+
+// runs the chain over frame, spare must match frame's size when any stage is out of place.
+// deadline is a PBJInstrumentationNow() time, checked before each pass so a pass is never
+// left half applied, 0 runs everything
+PBJFrameProcessorResult PBJFrameProcessorRun(PBJFrameProcessor *processor, PBJNV12Image *frame, PBJNV12Image *spare, uint64_t deadline);
+
+PBJFrameProcessorCounters PBJFrameProcessorGetCounters(const PBJFrameProcessor *processor);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PBJFrameProcessor_h */
@@ -0,0 +1,150 @@
+//
+//  PBJFrameStages.c
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include "PBJFrameStages.h"
+
+// (a * x + (255 - a) * y) / 255, exact for all inputs
+static inline uint8_t PBJFrameStageBlend(uint8_t x, uint8_t y, uint32_t alpha)
+{
+    uint32_t value = alpha * x + (255u - alpha) * y + 128u;
+    return (uint8_t)((value + (value >> 8)) >> 8);
+}
+
+#pragma mark - overlay
+
+static void PBJFrameStageOverlayProcess(void *context, const PBJNV12Image *source, PBJNV12Image *destination, PBJFrameTile tile)
+{
+    (void)source;
+    const PBJFrameOverlay *overlay = (const PBJFrameOverlay *)context;
+
+    size_t rowBegin = tile.rowBegin > overlay->y ? tile.rowBegin : overlay->y;
+    size_t rowEnd = overlay->y + overlay->height;
+    if (rowEnd > tile.rowEnd)
+        rowEnd = tile.rowEnd;
+    size_t columnEnd = overlay->x + overlay->width;
+    if (columnEnd > destination->width)
+        columnEnd = destination->width;
+    if (rowBegin >= rowEnd || overlay->x >= columnEnd)
+        return;
+
+    uint32_t alpha = overlay->alpha;
+    for (size_t row = rowBegin; row < rowEnd; row++) {
+        uint8_t *luma = destination->luma + row * destination->lumaBytesPerRow;
+        for (size_t column = overlay->x; column < columnEnd; column++) {
+            luma[column] = PBJFrameStageBlend(overlay->luma, luma[column], alpha);
+        }
+    }
+
+    size_t chromaColumnEnd = (columnEnd + 1) >> 1;
+    for (size_t row = rowBegin >> 1; row < ((rowEnd + 1) >> 1); row++) {
+        uint8_t *chroma = destination->chroma + row * destination->chromaBytesPerRow;
+        for (size_t column = overlay->x >> 1; column < chromaColumnEnd; column++) {
+            chroma[2 * column] = PBJFrameStageBlend(overlay->cb, chroma[2 * column], alpha);
+            chroma[2 * column + 1] = PBJFrameStageBlend(overlay->cr, chroma[2 * column + 1], alpha);
+        }
+    }
+}
+
+PBJFrameStage PBJFrameStageMakeOverlay(const PBJFrameOverlay *overlay)
+{
+    PBJFrameStage stage = { PBJFrameStageOverlayProcess, (void *)overlay, PBJFramePlaneAll, 1 };
+    return stage;
+}
+
+#pragma mark - mask
+
+static void PBJFrameStageMaskProcess(void *context, const PBJNV12Image *source, PBJNV12Image *destination, PBJFrameTile tile)
+{
+    (void)source;
+    const PBJFrameMask *mask = (const PBJFrameMask *)context;
+    size_t width = destination->width;
+
+    for (size_t row = tile.rowBegin; row < tile.rowEnd; row++) {
+        const uint8_t *alpha = mask->alpha + row * mask->bytesPerRow;
+        uint8_t *luma = destination->luma + row * destination->lumaBytesPerRow;
+        for (size_t column = 0; column < width; column++) {
+            luma[column] = PBJFrameStageBlend(luma[column], mask->luma, alpha[column]);
+        }
+    }
+
+    size_t chromaWidth = PBJNV12ChromaWidth(destination);
+    for (size_t row = tile.rowBegin >> 1; row < ((tile.rowEnd + 1) >> 1); row++) {
+        const uint8_t *alpha = mask->alpha + (2 * row) * mask->bytesPerRow;
+        uint8_t *chroma = destination->chroma + row * destination->chromaBytesPerRow;
+        for (size_t column = 0; column < chromaWidth; column++) {
+            uint32_t a = alpha[2 * column];
+            chroma[2 * column] = PBJFrameStageBlend(chroma[2 * column], mask->cb, a);
+            chroma[2 * column + 1] = PBJFrameStageBlend(chroma[2 * column + 1], mask->cr, a);
+        }
+    }
+}
+
+PBJFrameStage PBJFrameStageMakeMask(const PBJFrameMask *mask)
+{
+    PBJFrameStage stage = { PBJFrameStageMaskProcess, (void *)mask, PBJFramePlaneAll, 1 };
+    return stage;
+}
+
+#pragma mark - denoise
+
+static void PBJFrameStageDenoiseProcess(void *context, const PBJNV12Image *source, PBJNV12Image *destination, PBJFrameTile tile)
+{
+    const PBJFrameDenoise *denoise = (const PBJFrameDenoise *)context;
+    int32_t strength = denoise->strength > 16 ? 16 : denoise->strength;
+    size_t width = source->width;
+    size_t height = source->height;
+
+    for (size_t row = tile.rowBegin; row < tile.rowEnd; row++) {
+        // edges repeat
+        const uint8_t *above = source->luma + (row > 0 ? row - 1 : row) * source->lumaBytesPerRow;
+        const uint8_t *center = source->luma + row * source->lumaBytesPerRow;
+        const uint8_t *below = source->luma + (row + 1 < height ? row + 1 : row) * source->lumaBytesPerRow;
+        uint8_t *output = destination->luma + row * destination->lumaBytesPerRow;
+
+        if (width < 2) {
+            for (size_t column = 0; column < width; column++) {
+                output[column] = center[column];
+            }
+            continue;
+        }
+
+        int32_t left = above[0] + 2 * center[0] + below[0];
+        int32_t middle = left;
+        for (size_t column = 0; column < width; column++) {
+            size_t next = column + 1 < width ? column + 1 : column;
+            int32_t right = above[next] + 2 * center[next] + below[next];
+            int32_t blurred = (left + 2 * middle + right + 8) >> 4;
+            int32_t value = center[column];
+            output[column] = (uint8_t)(value + (((blurred - value) * strength) >> 4));
+            left = middle;
+            middle = right;
+        }
+    }
+}
+
+PBJFrameStage PBJFrameStageMakeDenoise(const PBJFrameDenoise *denoise)
+{
+    PBJFrameStage stage = { PBJFrameStageDenoiseProcess, (void *)denoise, PBJFramePlaneLuma, 0 };
+    return stage;
+}
@@ -0,0 +1,81 @@
+//
+//  PBJFrameStages.h
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef PBJFrameStages_h
+#define PBJFrameStages_h
+
+#include "PBJFrameProcessor.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// reference stages for PBJFrameProcessor, each keeps its parameters in a caller owned
+// struct that must outlive the stage and stay unchanged while frames are processed
+
+#pragma mark - overlay
+
+// blends a solid Y'CbCr rectangle over the frame, in place
+typedef struct {
+    size_t x; // even
+    size_t y; // even
+    size_t width;
+    size_t height;
+    uint8_t luma;
+    uint8_t cb;
+    uint8_t cr;
+    uint8_t alpha; // 255 opaque
+} PBJFrameOverlay;
+
+PBJFrameStage PBJFrameStageMakeOverlay(const PBJFrameOverlay *overlay);
+
+#pragma mark - mask
+
+// keeps the frame where the mask is 255 and fills with a Y'CbCr color where it is 0, in place.
+// the mask matches the luma plane, chroma uses the top left sample of each 2x2 block
+typedef struct {
+    const uint8_t *alpha;
+    size_t bytesPerRow;
+    uint8_t luma;
+    uint8_t cb;
+    uint8_t cr;
+} PBJFrameMask;
+
+PBJFrameStage PBJFrameStageMakeMask(const PBJFrameMask *mask);
+
+#pragma mark - denoise
+
+// 3x3 binomial smoothing of luma mixed back by strength, out of place since it reads
+// one row either side of its tile
+typedef struct {
+    uint8_t strength; // 0 - 16, 16 is the full filter
+} PBJFrameDenoise;
+
+PBJFrameStage PBJFrameStageMakeDenoise(const PBJFrameDenoise *denoise);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PBJFrameStages_h */
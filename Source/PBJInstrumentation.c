@@ -0,0 +1,244 @@
+//
+//  PBJInstrumentation.c
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#if defined(__linux__)
+#   define _POSIX_C_SOURCE 200112L
+#endif
+
+#include "PBJInstrumentation.h"
+
+#include <stdatomic.h>
+#include <stdlib.h>
+
+#define PBJ_HISTOGRAM_SUB_BUCKET_BITS 4
+#define PBJ_HISTOGRAM_SUB_BUCKETS (1 << PBJ_HISTOGRAM_SUB_BUCKET_BITS)
+#define PBJ_HISTOGRAM_BUCKETS ((64 - PBJ_HISTOGRAM_SUB_BUCKET_BITS + 1) * PBJ_HISTOGRAM_SUB_BUCKETS)
+
+struct PBJLatencyHistogram {
+    _Atomic(uint64_t) count;
+    _Atomic(uint64_t) sum;
+    _Atomic(uint64_t) max;
+    _Atomic(uint64_t) buckets[PBJ_HISTOGRAM_BUCKETS];
+};
+
+struct PBJInstrumentation {
+    PBJLatencyHistogram stages[PBJInstrumentationStageCount];
+    _Atomic(int64_t) counters[PBJInstrumentationCounterCount];
+};
+
+#pragma mark - histogram
+
+static inline unsigned PBJLatencyHistogramBucketIndex(uint64_t value)
+{
+    if (value < PBJ_HISTOGRAM_SUB_BUCKETS)
+        return (unsigned)value;
+    unsigned exponent = 63u - (unsigned)__builtin_clzll(value);
+    unsigned shift = exponent - PBJ_HISTOGRAM_SUB_BUCKET_BITS;
+    unsigned sub = (unsigned)(value >> shift) & (PBJ_HISTOGRAM_SUB_BUCKETS - 1);
+    return (shift + 1) * PBJ_HISTOGRAM_SUB_BUCKETS + sub;
+}
+
+// largest value that falls into the bucket
+static inline uint64_t PBJLatencyHistogramBucketUpperBound(unsigned index)
+{
+    if (index < PBJ_HISTOGRAM_SUB_BUCKETS)
+        return index;
+    unsigned shift = index / PBJ_HISTOGRAM_SUB_BUCKETS - 1;
+    uint64_t sub = index % PBJ_HISTOGRAM_SUB_BUCKETS;
+    uint64_t lower = (PBJ_HISTOGRAM_SUB_BUCKETS + sub) << shift;
+    return lower + ((UINT64_C(1) << shift) - 1);
+}
+
+static void PBJLatencyHistogramInit(PBJLatencyHistogram *histogram)
+{
+    atomic_init(&histogram->count, 0);
+    atomic_init(&histogram->sum, 0);
+    atomic_init(&histogram->max, 0);
+    for (unsigned i = 0; i < PBJ_HISTOGRAM_BUCKETS; i++) {
+        atomic_init(&histogram->buckets[i], 0);
+    }
+}
+
+PBJLatencyHistogram *PBJLatencyHistogramCreate(void)
+{
+    PBJLatencyHistogram *histogram = (PBJLatencyHistogram *)malloc(sizeof(PBJLatencyHistogram));
+    if (histogram)
+        PBJLatencyHistogramInit(histogram);
+    return histogram;
+}
+
+void PBJLatencyHistogramDestroy(PBJLatencyHistogram *histogram)
+{
+    free(histogram);
+}
+
+void PBJLatencyHistogramReset(PBJLatencyHistogram *histogram)
+{
+    if (!histogram)
+        return;
+    atomic_store_explicit(&histogram->count, 0, memory_order_relaxed);
+    atomic_store_explicit(&histogram->sum, 0, memory_order_relaxed);
+    atomic_store_explicit(&histogram->max, 0, memory_order_relaxed);
+    for (unsigned i = 0; i < PBJ_HISTOGRAM_BUCKETS; i++) {
+        atomic_store_explicit(&histogram->buckets[i], 0, memory_order_relaxed);
+    }
+}
+
+void PBJLatencyHistogramRecord(PBJLatencyHistogram *histogram, uint64_t value)
+{
+    if (!histogram)
+        return;
+
+    atomic_fetch_add_explicit(&histogram->buckets[PBJLatencyHistogramBucketIndex(value)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&histogram->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&histogram->sum, value, memory_order_relaxed);
+
+    uint64_t max = atomic_load_explicit(&histogram->max, memory_order_relaxed);
+    while (value > max && !atomic_compare_exchange_weak_explicit(&histogram->max, &max, value, memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+static uint64_t PBJLatencyHistogramPercentileOfBuckets(const uint64_t *buckets, uint64_t total, double percentile, uint64_t max)
+{
+    if (total == 0)
+        return 0;
+
+    uint64_t rank = (uint64_t)(percentile / 100.0 * (double)total + 0.5);
+    if (rank < 1)
+        rank = 1;
+    if (rank > total)
+        rank = total;
+
+    uint64_t seen = 0;
+    for (unsigned i = 0; i < PBJ_HISTOGRAM_BUCKETS; i++) {
+        seen += buckets[i];
+        if (seen >= rank) {
+            uint64_t bound = PBJLatencyHistogramBucketUpperBound(i);
+            return bound < max ? bound : max;
+        }
+    }
+    return max;
+}
+
+uint64_t PBJLatencyHistogramValueAtPercentile(const PBJLatencyHistogram *histogram, double percentile)
+{
+    if (!histogram)
+        return 0;
+
+    PBJLatencyHistogram *mutableHistogram = (PBJLatencyHistogram *)histogram;
+    uint64_t buckets[PBJ_HISTOGRAM_BUCKETS];
+    uint64_t total = 0;
+    for (unsigned i = 0; i < PBJ_HISTOGRAM_BUCKETS; i++) {
+        buckets[i] = atomic_load_explicit(&mutableHistogram->buckets[i], memory_order_relaxed);
+        total += buckets[i];
+    }
+    uint64_t max = atomic_load_explicit(&mutableHistogram->max, memory_order_relaxed);
+    return PBJLatencyHistogramPercentileOfBuckets(buckets, total, percentile, max);
+}
+
+PBJLatencySummary PBJLatencyHistogramSummarize(const PBJLatencyHistogram *histogram)
+{
+    PBJLatencySummary summary = { 0, 0, 0, 0, 0, 0 };
+    if (!histogram)
+        return summary;
+
+    // one pass over a copy, so the percentiles agree with each other while recording continues
+    PBJLatencyHistogram *mutableHistogram = (PBJLatencyHistogram *)histogram;
+    uint64_t buckets[PBJ_HISTOGRAM_BUCKETS];
+    uint64_t total = 0;
+    for (unsigned i = 0; i < PBJ_HISTOGRAM_BUCKETS; i++) {
+        buckets[i] = atomic_load_explicit(&mutableHistogram->buckets[i], memory_order_relaxed);
+        total += buckets[i];
+    }
+    if (total == 0)
+        return summary;
+
+    uint64_t sum = atomic_load_explicit(&mutableHistogram->sum, memory_order_relaxed);
+    summary.count = total;
+    summary.mean = sum / total;
+    summary.max = atomic_load_explicit(&mutableHistogram->max, memory_order_relaxed);
+    summary.p50 = PBJLatencyHistogramPercentileOfBuckets(buckets, total, 50.0, summary.max);
+    summary.p99 = PBJLatencyHistogramPercentileOfBuckets(buckets, total, 99.0, summary.max);
+    summary.p999 = PBJLatencyHistogramPercentileOfBuckets(buckets, total, 99.9, summary.max);
+    return summary;
+}
+
+#pragma mark - stages and counters
+
+PBJInstrumentation *PBJInstrumentationCreate(void)
+{
+    PBJInstrumentation *instrumentation = (PBJInstrumentation *)malloc(sizeof(PBJInstrumentation));
+    if (!instrumentation)
+        return NULL;
+    for (int i = 0; i < PBJInstrumentationStageCount; i++) {
+        PBJLatencyHistogramInit(&instrumentation->stages[i]);
+    }
+    for (int i = 0; i < PBJInstrumentationCounterCount; i++) {
+        atomic_init(&instrumentation->counters[i], 0);
+    }
+    return instrumentation;
+}
+
+void PBJInstrumentationDestroy(PBJInstrumentation *instrumentation)
+{
+    free(instrumentation);
+}
+
+void PBJInstrumentationReset(PBJInstrumentation *instrumentation)
+{
+    if (!instrumentation)
+        return;
+    for (int i = 0; i < PBJInstrumentationStageCount; i++) {
+        PBJLatencyHistogramReset(&instrumentation->stages[i]);
+    }
+    for (int i = 0; i < PBJInstrumentationCounterCount; i++) {
+        atomic_store_explicit(&instrumentation->counters[i], 0, memory_order_relaxed);
+    }
+}
+
+void PBJInstrumentationRecordLatency(PBJInstrumentation *instrumentation, PBJInstrumentationStage stage, uint64_t nanoseconds)
+{
+    if (!instrumentation || stage < 0 || stage >= PBJInstrumentationStageCount)
+        return;
+    PBJLatencyHistogramRecord(&instrumentation->stages[stage], nanoseconds);
+}
+
+void PBJInstrumentationAddToCounter(PBJInstrumentation *instrumentation, PBJInstrumentationCounter counter, int64_t delta)
+{
+    if (!instrumentation || counter < 0 || counter >= PBJInstrumentationCounterCount)
+        return;
+    atomic_fetch_add_explicit(&instrumentation->counters[counter], delta, memory_order_relaxed);
+}
+
+PBJInstrumentationSnapshot PBJInstrumentationGetSnapshot(const PBJInstrumentation *instrumentation)
+{
+    PBJInstrumentationSnapshot snapshot;
+    for (int i = 0; i < PBJInstrumentationStageCount; i++) {
+        snapshot.stages[i] = PBJLatencyHistogramSummarize(instrumentation ? &instrumentation->stages[i] : NULL);
+    }
+    for (int i = 0; i < PBJInstrumentationCounterCount; i++) {
+        snapshot.counters[i] = instrumentation ? atomic_load_explicit(&((PBJInstrumentation *)instrumentation)->counters[i], memory_order_relaxed) : 0;
+    }
+    return snapshot;
+}
@@ -0,0 +1,141 @@
+//
+//  PBJInstrumentation.h
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef PBJInstrumentation_h
+#define PBJInstrumentation_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// lock-free latency histograms and frame counters, recording is a handful of relaxed
+// atomic adds so it can stay on in production and be polled for snapshots
+
+#pragma mark - histogram
+
+// log-linear buckets, each power of two is split into 16 linear steps (~6% resolution)
+typedef struct PBJLatencyHistogram PBJLatencyHistogram;
+
+typedef struct {
+    uint64_t count;
+    uint64_t mean;
+    uint64_t p50;
+    uint64_t p99;
+    uint64_t p999;
+    uint64_t max;
+} PBJLatencySummary;
+
+PBJLatencyHistogram *PBJLatencyHistogramCreate(void);
+void PBJLatencyHistogramDestroy(PBJLatencyHistogram *histogram);
+void PBJLatencyHistogramReset(PBJLatencyHistogram *histogram);
+
+// safe from any number of threads
+void PBJLatencyHistogramRecord(PBJLatencyHistogram *histogram, uint64_t value);
+
+// percentiles report the upper bound of their bucket, max is exact
+PBJLatencySummary PBJLatencyHistogramSummarize(const PBJLatencyHistogram *histogram);
+uint64_t PBJLatencyHistogramValueAtPercentile(const PBJLatencyHistogram *histogram, double percentile);
+
+#pragma mark - stages and counters
+
+typedef enum {
+    PBJInstrumentationStageSampleArrival = 0, // sample presentation time to delegate callback
+    PBJInstrumentationStageWriterSetup,
+    PBJInstrumentationStageRetiming,
+    PBJInstrumentationStageAppend,
+    PBJInstrumentationStageDelegateDispatch, // main queue hop
+    PBJInstrumentationStageRendering,
+    PBJInstrumentationStageFrameProcessing,
+    PBJInstrumentationStageFrameAnalysis, // scoring frames for photos and thumbnails
+    PBJInstrumentationStageProxyDownscale, // proxy frames from the master's
+    PBJInstrumentationStageCount
+} PBJInstrumentationStage;
+
+typedef enum {
+    PBJInstrumentationCounterFramesReceived = 0,
+    PBJInstrumentationCounterFramesWritten,
+    PBJInstrumentationCounterFramesDroppedNotReady,
+    PBJInstrumentationCounterFramesDroppedPaused,
+    PBJInstrumentationCounterDelegateBacklog, // gauge, main queue deliveries in flight
+    PBJInstrumentationCounterFramesSuperseded, // replaced in a mailbox before rendering or delegate delivery
+    PBJInstrumentationCounterAudioSamplesDropped, // oldest of a full delegate ring, never delivered
+    PBJInstrumentationCounterCount
+} PBJInstrumentationCounter;
+
+typedef struct PBJInstrumentation PBJInstrumentation;
+
+typedef struct {
+    PBJLatencySummary stages[PBJInstrumentationStageCount];
+    int64_t counters[PBJInstrumentationCounterCount];
+} PBJInstrumentationSnapshot;
+
+PBJInstrumentation *PBJInstrumentationCreate(void);
+void PBJInstrumentationDestroy(PBJInstrumentation *instrumentation);
+void PBJInstrumentationReset(PBJInstrumentation *instrumentation);
+
+// all recording functions accept NULL, so call sites need no checks when instrumentation is off
+void PBJInstrumentationRecordLatency(PBJInstrumentation *instrumentation, PBJInstrumentationStage stage, uint64_t nanoseconds);
+void PBJInstrumentationAddToCounter(PBJInstrumentation *instrumentation, PBJInstrumentationCounter counter, int64_t delta);
+
+static inline void PBJInstrumentationIncrementCounter(PBJInstrumentation *instrumentation, PBJInstrumentationCounter counter)
+{
+    PBJInstrumentationAddToCounter(instrumentation, counter, 1);
+}
+
+PBJInstrumentationSnapshot PBJInstrumentationGetSnapshot(const PBJInstrumentation *instrumentation);
+
+// monotonic clock in nanoseconds. elsewhere than Apple platforms it's POSIX, which strict C only
+// declares with _POSIX_C_SOURCE defined ahead of the first include, without it the wall clock stands in
+static inline uint64_t PBJInstrumentationNow(void)
+{
+#if defined(__APPLE__)
+    return clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+#elif defined(CLOCK_MONOTONIC)
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+#else
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+#endif
+}
+
+// records the time elapsed since start, when instrumentation is enabled
+static inline void PBJInstrumentationRecordSince(PBJInstrumentation *instrumentation, PBJInstrumentationStage stage, uint64_t start)
+{
+    if (instrumentation) {
+        PBJInstrumentationRecordLatency(instrumentation, stage, PBJInstrumentationNow() - start);
+    }
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PBJInstrumentation_h */
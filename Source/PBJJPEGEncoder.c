@@ -0,0 +1,900 @@
+//
+//  PBJJPEGEncoder.c
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include "PBJJPEGEncoder.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// BT.709 Y'CbCr, as PBJColorConversion decodes it, re-expressed in BT.601 (JFIF)
+//   Y601  = Y + 0.101581 Cb + 0.196079 Cr
+//   Cb601 =     0.989853 Cb - 0.110654 Cr
+//   Cr601 =    -0.072454 Cb + 0.983396 Cr
+// with Cb and Cr centred on zero and video range expanded first (luma 255/219, chroma 255/224).
+// luma takes the chroma of its 2x2 block, the same sample a 4:2:0 decoder pairs it with
+
+#define PBJ_JPEG_MCU 16
+#define PBJ_JPEG_BLOCK_BYTES_BOUND 1024 // 64 coefficients at 27 bits each with every byte stuffed, rounded up
+
+typedef struct {
+    float lumaScale;
+    float lumaOffset;
+    float chromaScale;
+} PBJJPEGRange;
+
+static const PBJJPEGRange PBJJPEGRangeFull = { 1.0f, 0.0f, 1.0f };
+static const PBJJPEGRange PBJJPEGRangeVideo = { 255.0f / 219.0f, 16.0f, 255.0f / 224.0f };
+
+// position k of the zigzag scan reads natural index PBJJPEGZigZag[k]
+static const uint8_t PBJJPEGZigZag[64] = {
+     0,  1,  8, 16,  9,  2,  3, 10, 17, 24, 32, 25, 18, 11,  4,  5,
+    12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13,  6,  7, 14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63
+};
+
+// Annex K.1, natural order
+static const uint8_t PBJJPEGLumaQuantization[64] = {
+    16,  11,  10,  16,  24,  40,  51,  61,
+    12,  12,  14,  19,  26,  58,  60,  55,
+    14,  13,  16,  24,  40,  57,  69,  56,
+    14,  17,  22,  29,  51,  87,  80,  62,
+    18,  22,  37,  56,  68, 109, 103,  77,
+    24,  35,  55,  64,  81, 104, 113,  92,
+    49,  64,  78,  87, 103, 121, 120, 101,
+    72,  92,  95,  98, 112, 100, 103,  99
+};
+
+static const uint8_t PBJJPEGChromaQuantization[64] = {
+    17, 18, 24, 47, 99, 99, 99, 99,
+    18, 21, 26, 66, 99, 99, 99, 99,
+    24, 26, 56, 99, 99, 99, 99, 99,
+    47, 66, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99
+};
+
+// Annex K.3, code counts by length then symbols
+static const uint8_t PBJJPEGLumaDCBits[16] = { 0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0 };
+static const uint8_t PBJJPEGChromaDCBits[16] = { 0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0 };
+static const uint8_t PBJJPEGDCValues[12] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+
+static const uint8_t PBJJPEGLumaACBits[16] = { 0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d };
+static const uint8_t PBJJPEGLumaACValues[162] = {
+    0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+    0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+    0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+    0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+    0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+    0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+    0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+    0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+    0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa
+};
+
+static const uint8_t PBJJPEGChromaACBits[16] = { 0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77 };
+static const uint8_t PBJJPEGChromaACValues[162] = {
+    0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+    0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0,
+    0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+    0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+    0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+    0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+    0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
+    0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+    0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+    0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa
+};
+
+// AAN scale factors, folded into the quantizer divisors
+static const float PBJJPEGAANScale[8] = {
+    1.0f, 1.387039845f, 1.306562965f, 1.175875602f, 1.0f, 0.785694958f, 0.541196100f, 0.275899379f
+};
+
+typedef struct {
+    uint16_t code[256];
+    uint8_t size[256];
+} PBJJPEGHuffmanTable;
+
+typedef struct {
+    uint8_t *data;
+    size_t size;
+    size_t capacity;
+    int encoded;
+} PBJJPEGSegment;
+
+// samples are level shifted, the block is transformed in place then quantized into zigzag order,
+// the vector paths take the divisors transposed
+typedef void (*PBJJPEGTransformBlockFunction)(float *block, const float *divisors, int16_t *coefficients);
+
+struct PBJJPEGEncoder {
+    PBJNV12Image image;
+    PBJJPEGRange range;
+    size_t mcuColumns;
+    size_t mcuRows;
+    size_t restartRows;
+
+    uint8_t quantization[2][64]; // natural order
+    float divisors[2][64];       // reciprocal quantizers with the AAN scaling, natural or transposed for the transform
+    PBJJPEGTransformBlockFunction transform;
+    PBJJPEGHuffmanTable dc[2];
+    PBJJPEGHuffmanTable ac[2];
+
+    uint8_t *header;
+    size_t headerSize;
+
+    PBJJPEGSegment *segments;
+    size_t segmentCount;
+};
+
+#pragma mark - tables
+
+static void PBJJPEGScaleQuantization(const uint8_t *base, int quality, uint8_t *table)
+{
+    // IJG scaling, 50 leaves the Annex K tables as they are
+    int scale = quality < 50 ? 5000 / quality : 200 - quality * 2;
+    for (int i = 0; i < 64; i++) {
+        int value = (base[i] * scale + 50) / 100;
+        table[i] = (uint8_t)(value < 1 ? 1 : (value > 255 ? 255 : value));
+    }
+}
+
+static void PBJJPEGBuildDivisors(const uint8_t *quantization, int transposed, float *divisors)
+{
+    for (int row = 0; row < 8; row++) {
+        for (int column = 0; column < 8; column++) {
+            int i = row * 8 + column;
+            float divisor = 1.0f / ((float)quantization[i] * PBJJPEGAANScale[row] * PBJJPEGAANScale[column] * 8.0f);
+            divisors[transposed ? column * 8 + row : i] = divisor;
+        }
+    }
+}
+
+// Annex C, canonical codes in order of length
+static void PBJJPEGBuildHuffmanTable(const uint8_t *bits, const uint8_t *values, PBJJPEGHuffmanTable *table)
+{
+    memset(table, 0, sizeof(*table));
+    unsigned code = 0;
+    size_t k = 0;
+    for (int length = 1; length <= 16; length++) {
+        for (int i = 0; i < bits[length - 1]; i++) {
+            table->code[values[k]] = (uint16_t)code++;
+            table->size[values[k]] = (uint8_t)length;
+            k++;
+        }
+        code <<= 1;
+    }
+}
+
+#pragma mark - header
+
+typedef struct {
+    uint8_t *data;
+    size_t size;
+} PBJJPEGHeaderWriter;
+
+static inline void PBJJPEGPutByte(PBJJPEGHeaderWriter *writer, uint8_t value)
+{
+    writer->data[writer->size++] = value;
+}
+
+static inline void PBJJPEGPutWord(PBJJPEGHeaderWriter *writer, uint16_t value)
+{
+    PBJJPEGPutByte(writer, (uint8_t)(value >> 8));
+    PBJJPEGPutByte(writer, (uint8_t)value);
+}
+
+static void PBJJPEGPutHuffmanTable(PBJJPEGHeaderWriter *writer, uint8_t tableClassAndIndex, const uint8_t *bits, const uint8_t *values, size_t valueCount)
+{
+    PBJJPEGPutByte(writer, tableClassAndIndex);
+    for (int i = 0; i < 16; i++) {
+        PBJJPEGPutByte(writer, bits[i]);
+    }
+    for (size_t i = 0; i < valueCount; i++) {
+        PBJJPEGPutByte(writer, values[i]);
+    }
+}
+
+// SOI through SOS, at most a few hundred bytes
+static size_t PBJJPEGWriteHeader(const PBJJPEGEncoder *encoder, uint8_t *data)
+{
+    PBJJPEGHeaderWriter writer = { data, 0 };
+
+    PBJJPEGPutWord(&writer, 0xffd8); // SOI
+
+    // JFIF 1.01, square pixels at 72 dpi
+    static const uint8_t jfif[] = { 'J', 'F', 'I', 'F', 0, 1, 1, 1, 0, 72, 0, 72, 0, 0 };
+    PBJJPEGPutWord(&writer, 0xffe0);
+    PBJJPEGPutWord(&writer, 2 + sizeof(jfif));
+    for (size_t i = 0; i < sizeof(jfif); i++) {
+        PBJJPEGPutByte(&writer, jfif[i]);
+    }
+
+    PBJJPEGPutWord(&writer, 0xffdb); // DQT, both tables in zigzag order
+    PBJJPEGPutWord(&writer, 2 + 2 * 65);
+    for (int table = 0; table < 2; table++) {
+        PBJJPEGPutByte(&writer, (uint8_t)table);
+        for (int k = 0; k < 64; k++) {
+            PBJJPEGPutByte(&writer, encoder->quantization[table][PBJJPEGZigZag[k]]);
+        }
+    }
+
+    PBJJPEGPutWord(&writer, 0xffc0); // SOF0, luma 2x2 over each chroma sample
+    PBJJPEGPutWord(&writer, 8 + 3 * 3);
+    PBJJPEGPutByte(&writer, 8);
+    PBJJPEGPutWord(&writer, (uint16_t)encoder->image.height);
+    PBJJPEGPutWord(&writer, (uint16_t)encoder->image.width);
+    PBJJPEGPutByte(&writer, 3);
+    static const uint8_t components[3][3] = { { 1, 0x22, 0 }, { 2, 0x11, 1 }, { 3, 0x11, 1 } };
+    for (int c = 0; c < 3; c++) {
+        PBJJPEGPutByte(&writer, components[c][0]);
+        PBJJPEGPutByte(&writer, components[c][1]);
+        PBJJPEGPutByte(&writer, components[c][2]);
+    }
+
+    PBJJPEGPutWord(&writer, 0xffc4); // DHT
+    PBJJPEGPutWord(&writer, 2 + 4 * 17 + 2 * sizeof(PBJJPEGDCValues) + sizeof(PBJJPEGLumaACValues) + sizeof(PBJJPEGChromaACValues));
+    PBJJPEGPutHuffmanTable(&writer, 0x00, PBJJPEGLumaDCBits, PBJJPEGDCValues, sizeof(PBJJPEGDCValues));
+    PBJJPEGPutHuffmanTable(&writer, 0x10, PBJJPEGLumaACBits, PBJJPEGLumaACValues, sizeof(PBJJPEGLumaACValues));
+    PBJJPEGPutHuffmanTable(&writer, 0x01, PBJJPEGChromaDCBits, PBJJPEGDCValues, sizeof(PBJJPEGDCValues));
+    PBJJPEGPutHuffmanTable(&writer, 0x11, PBJJPEGChromaACBits, PBJJPEGChromaACValues, sizeof(PBJJPEGChromaACValues));
+
+    if (encoder->segmentCount > 1) {
+        PBJJPEGPutWord(&writer, 0xffdd); // DRI, in MCUs
+        PBJJPEGPutWord(&writer, 4);
+        PBJJPEGPutWord(&writer, (uint16_t)(encoder->restartRows * encoder->mcuColumns));
+    }
+
+    PBJJPEGPutWord(&writer, 0xffda); // SOS, one interleaved baseline scan
+    PBJJPEGPutWord(&writer, 6 + 2 * 3);
+    PBJJPEGPutByte(&writer, 3);
+    static const uint8_t scanComponents[3][2] = { { 1, 0x00 }, { 2, 0x11 }, { 3, 0x11 } };
+    for (int c = 0; c < 3; c++) {
+        PBJJPEGPutByte(&writer, scanComponents[c][0]);
+        PBJJPEGPutByte(&writer, scanComponents[c][1]);
+    }
+    PBJJPEGPutByte(&writer, 0);
+    PBJJPEGPutByte(&writer, 63);
+    PBJJPEGPutByte(&writer, 0);
+
+    return writer.size;
+}
+
+#pragma mark - entropy coding
+
+typedef struct {
+    PBJJPEGSegment *segment;
+    uint64_t bits;
+    int count;
+} PBJJPEGBitWriter;
+
+static int PBJJPEGReserve(PBJJPEGSegment *segment, size_t bytes)
+{
+    if (segment->size + bytes <= segment->capacity)
+        return 1;
+
+    size_t capacity = segment->capacity ? segment->capacity * 2 : 4096;
+    while (capacity < segment->size + bytes) {
+        capacity *= 2;
+    }
+    uint8_t *data = (uint8_t *)realloc(segment->data, capacity);
+    if (!data)
+        return 0;
+    segment->data = data;
+    segment->capacity = capacity;
+    return 1;
+}
+
+// callers reserve room first, every 0xff gets a stuffed zero
+static inline void PBJJPEGEmitBytes(PBJJPEGBitWriter *writer)
+{
+    PBJJPEGSegment *segment = writer->segment;
+    while (writer->count >= 8) {
+        writer->count -= 8;
+        uint8_t byte = (uint8_t)(writer->bits >> writer->count);
+        segment->data[segment->size++] = byte;
+        if (byte == 0xff) {
+            segment->data[segment->size++] = 0;
+        }
+    }
+}
+
+// bits collect until at least 32 are waiting, so most codes are a shift and an or
+static inline void PBJJPEGPutBits(PBJJPEGBitWriter *writer, uint32_t code, int size)
+{
+    writer->bits = (writer->bits << size) | code;
+    writer->count += size;
+    if (writer->count >= 32) {
+        PBJJPEGEmitBytes(writer);
+    }
+}
+
+// pads the final byte with ones
+static void PBJJPEGFlushBits(PBJJPEGBitWriter *writer)
+{
+    int padding = (8 - (writer->count & 7)) & 7;
+    writer->bits = (writer->bits << padding) | ((1u << padding) - 1);
+    writer->count += padding;
+    PBJJPEGEmitBytes(writer);
+}
+
+static inline int PBJJPEGCategory(int value)
+{
+    unsigned magnitude = (unsigned)(value < 0 ? -value : value);
+    return magnitude ? 32 - __builtin_clz(magnitude) : 0;
+}
+
+// the code and its extra bits go out together, at most 27 bits
+static inline void PBJJPEGPutValue(PBJJPEGBitWriter *writer, const PBJJPEGHuffmanTable *table, int symbol, int value, int category)
+{
+    // negative values are sent as their ones' complement
+    uint32_t bits = (uint32_t)(value < 0 ? value - 1 : value) & ((1u << category) - 1);
+    PBJJPEGPutBits(writer, ((uint32_t)table->code[symbol] << category) | bits, table->size[symbol] + category);
+}
+
+static void PBJJPEGEncodeBlock(PBJJPEGBitWriter *writer, const int16_t *coefficients, int *predictor,
+                               const PBJJPEGHuffmanTable *dc, const PBJJPEGHuffmanTable *ac)
+{
+    int difference = coefficients[0] - *predictor;
+    *predictor = coefficients[0];
+    int category = PBJJPEGCategory(difference);
+    PBJJPEGPutValue(writer, dc, category, difference, category);
+
+    int run = 0;
+    for (int k = 1; k < 64; k++) {
+        int value = coefficients[k];
+        if (value == 0) {
+            run++;
+            continue;
+        }
+        while (run > 15) {
+            PBJJPEGPutBits(writer, ac->code[0xf0], ac->size[0xf0]); // ZRL
+            run -= 16;
+        }
+        category = PBJJPEGCategory(value);
+        PBJJPEGPutValue(writer, ac, (run << 4) | category, value, category);
+        run = 0;
+    }
+    if (run > 0) {
+        PBJJPEGPutBits(writer, ac->code[0x00], ac->size[0x00]); // EOB
+    }
+}
+
+#pragma mark - transform
+
+// AAN forward DCT of 8 samples at the given stride, outputs carry the PBJJPEGAANScale factors
+static inline void PBJJPEGForwardDCT8(float *d, size_t stride)
+{
+    float tmp0 = d[0 * stride] + d[7 * stride];
+    float tmp7 = d[0 * stride] - d[7 * stride];
+    float tmp1 = d[1 * stride] + d[6 * stride];
+    float tmp6 = d[1 * stride] - d[6 * stride];
+    float tmp2 = d[2 * stride] + d[5 * stride];
+    float tmp5 = d[2 * stride] - d[5 * stride];
+    float tmp3 = d[3 * stride] + d[4 * stride];
+    float tmp4 = d[3 * stride] - d[4 * stride];
+
+    float tmp10 = tmp0 + tmp3;
+    float tmp13 = tmp0 - tmp3;
+    float tmp11 = tmp1 + tmp2;
+    float tmp12 = tmp1 - tmp2;
+
+    d[0 * stride] = tmp10 + tmp11;
+    d[4 * stride] = tmp10 - tmp11;
+
+    float z1 = (tmp12 + tmp13) * 0.707106781f;
+    d[2 * stride] = tmp13 + z1;
+    d[6 * stride] = tmp13 - z1;
+
+    tmp10 = tmp4 + tmp5;
+    tmp11 = tmp5 + tmp6;
+    tmp12 = tmp6 + tmp7;
+
+    float z5 = (tmp10 - tmp12) * 0.382683433f;
+    float z2 = 0.541196100f * tmp10 + z5;
+    float z4 = 1.306562965f * tmp12 + z5;
+    float z3 = tmp11 * 0.707106781f;
+
+    float z11 = tmp7 + z3;
+    float z13 = tmp7 - z3;
+
+    d[5 * stride] = z13 + z2;
+    d[3 * stride] = z13 - z2;
+    d[1 * stride] = z11 + z4;
+    d[7 * stride] = z11 - z4;
+}
+
+// quantized magnitudes stay inside the 10 bit categories baseline Huffman tables cover, ties round
+// away from zero on every path
+static inline int16_t PBJJPEGQuantize(float value)
+{
+    value = value < -1023.0f ? -1023.0f : (value > 1023.0f ? 1023.0f : value);
+    return (int16_t)(value < 0.0f ? value - 0.5f : value + 0.5f);
+}
+
+static void PBJJPEGTransformBlockScalar(float *block, const float *divisors, int16_t *coefficients)
+{
+    for (int row = 0; row < 8; row++) {
+        PBJJPEGForwardDCT8(block + row * 8, 1);
+    }
+    for (int column = 0; column < 8; column++) {
+        PBJJPEGForwardDCT8(block + column, 8);
+    }
+    for (int k = 0; k < 64; k++) {
+        int i = PBJJPEGZigZag[k];
+        coefficients[k] = PBJJPEGQuantize(block[i] * divisors[i]);
+    }
+}
+
+// the vector paths run the column pass on two halves of four columns, transpose in registers and run
+// it again, which leaves the coefficients transposed, PBJJPEGZigZagTransposed reads them back in order
+static const uint8_t PBJJPEGZigZagTransposed[64] = {
+     0,  8,  1,  2,  9, 16, 24, 17, 10,  3,  4, 11, 18, 25, 32, 40,
+    33, 26, 19, 12,  5,  6, 13, 20, 27, 34, 41, 48, 56, 49, 42, 35,
+    28, 21, 14,  7, 15, 22, 29, 36, 43, 50, 57, 58, 51, 44, 37, 30,
+    23, 31, 38, 45, 52, 59, 60, 53, 46, 39, 47, 54, 61, 62, 55, 63
+};
+
+#if PBJ_SIMD_SSE2
+
+static inline void PBJJPEGForwardDCT8SSE2(__m128 *d)
+{
+    __m128 tmp0 = _mm_add_ps(d[0], d[7]);
+    __m128 tmp7 = _mm_sub_ps(d[0], d[7]);
+    __m128 tmp1 = _mm_add_ps(d[1], d[6]);
+    __m128 tmp6 = _mm_sub_ps(d[1], d[6]);
+    __m128 tmp2 = _mm_add_ps(d[2], d[5]);
+    __m128 tmp5 = _mm_sub_ps(d[2], d[5]);
+    __m128 tmp3 = _mm_add_ps(d[3], d[4]);
+    __m128 tmp4 = _mm_sub_ps(d[3], d[4]);
+
+    __m128 tmp10 = _mm_add_ps(tmp0, tmp3);
+    __m128 tmp13 = _mm_sub_ps(tmp0, tmp3);
+    __m128 tmp11 = _mm_add_ps(tmp1, tmp2);
+    __m128 tmp12 = _mm_sub_ps(tmp1, tmp2);
+
+    d[0] = _mm_add_ps(tmp10, tmp11);
+    d[4] = _mm_sub_ps(tmp10, tmp11);
+
+    __m128 z1 = _mm_mul_ps(_mm_add_ps(tmp12, tmp13), _mm_set1_ps(0.707106781f));
+    d[2] = _mm_add_ps(tmp13, z1);
+    d[6] = _mm_sub_ps(tmp13, z1);
+
+    tmp10 = _mm_add_ps(tmp4, tmp5);
+    tmp11 = _mm_add_ps(tmp5, tmp6);
+    tmp12 = _mm_add_ps(tmp6, tmp7);
+
+    __m128 z5 = _mm_mul_ps(_mm_sub_ps(tmp10, tmp12), _mm_set1_ps(0.382683433f));
+    __m128 z2 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(0.541196100f), tmp10), z5);
+    __m128 z4 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(1.306562965f), tmp12), z5);
+    __m128 z3 = _mm_mul_ps(tmp11, _mm_set1_ps(0.707106781f));
+
+    __m128 z11 = _mm_add_ps(tmp7, z3);
+    __m128 z13 = _mm_sub_ps(tmp7, z3);
+
+    d[5] = _mm_add_ps(z13, z2);
+    d[3] = _mm_sub_ps(z13, z2);
+    d[1] = _mm_add_ps(z11, z4);
+    d[7] = _mm_sub_ps(z11, z4);
+}
+
+static void PBJJPEGTransformBlockSSE2(float *block, const float *divisors, int16_t *coefficients)
+{
+    __m128 left[8];
+    __m128 right[8];
+    for (int row = 0; row < 8; row++) {
+        left[row] = _mm_loadu_ps(block + row * 8);
+        right[row] = _mm_loadu_ps(block + row * 8 + 4);
+    }
+    PBJJPEGForwardDCT8SSE2(left);
+    PBJJPEGForwardDCT8SSE2(right);
+
+    _MM_TRANSPOSE4_PS(left[0], left[1], left[2], left[3]);
+    _MM_TRANSPOSE4_PS(right[0], right[1], right[2], right[3]);
+    _MM_TRANSPOSE4_PS(left[4], left[5], left[6], left[7]);
+    _MM_TRANSPOSE4_PS(right[4], right[5], right[6], right[7]);
+    __m128 top[8] = { left[0], left[1], left[2], left[3], right[0], right[1], right[2], right[3] };
+    __m128 bottom[8] = { left[4], left[5], left[6], left[7], right[4], right[5], right[6], right[7] };
+    PBJJPEGForwardDCT8SSE2(top);
+    PBJJPEGForwardDCT8SSE2(bottom);
+
+    const __m128 limit = _mm_set1_ps(1023.0f);
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    int16_t transposed[64];
+    for (int column = 0; column < 8; column++) {
+        __m128 quantized[2] = { _mm_mul_ps(top[column], _mm_loadu_ps(divisors + column * 8)),
+                                _mm_mul_ps(bottom[column], _mm_loadu_ps(divisors + column * 8 + 4)) };
+        for (int i = 0; i < 2; i++) {
+            __m128 value = _mm_min_ps(_mm_max_ps(quantized[i], _mm_sub_ps(_mm_setzero_ps(), limit)), limit);
+            quantized[i] = _mm_add_ps(value, _mm_or_ps(_mm_and_ps(value, sign), half));
+        }
+        __m128i packed = _mm_packs_epi32(_mm_cvttps_epi32(quantized[0]), _mm_cvttps_epi32(quantized[1]));
+        _mm_storeu_si128((__m128i *)(transposed + column * 8), packed);
+    }
+    for (int k = 0; k < 64; k++) {
+        coefficients[k] = transposed[PBJJPEGZigZagTransposed[k]];
+    }
+}
+
+#endif
+
+#if PBJ_SIMD_NEON
+
+static inline void PBJJPEGForwardDCT8NEON(float32x4_t *d)
+{
+    float32x4_t tmp0 = vaddq_f32(d[0], d[7]);
+    float32x4_t tmp7 = vsubq_f32(d[0], d[7]);
+    float32x4_t tmp1 = vaddq_f32(d[1], d[6]);
+    float32x4_t tmp6 = vsubq_f32(d[1], d[6]);
+    float32x4_t tmp2 = vaddq_f32(d[2], d[5]);
+    float32x4_t tmp5 = vsubq_f32(d[2], d[5]);
+    float32x4_t tmp3 = vaddq_f32(d[3], d[4]);
+    float32x4_t tmp4 = vsubq_f32(d[3], d[4]);
+
+    float32x4_t tmp10 = vaddq_f32(tmp0, tmp3);
+    float32x4_t tmp13 = vsubq_f32(tmp0, tmp3);
+    float32x4_t tmp11 = vaddq_f32(tmp1, tmp2);
+    float32x4_t tmp12 = vsubq_f32(tmp1, tmp2);
+
+    d[0] = vaddq_f32(tmp10, tmp11);
+    d[4] = vsubq_f32(tmp10, tmp11);
+
+    float32x4_t z1 = vmulq_n_f32(vaddq_f32(tmp12, tmp13), 0.707106781f);
+    d[2] = vaddq_f32(tmp13, z1);
+    d[6] = vsubq_f32(tmp13, z1);
+
+    tmp10 = vaddq_f32(tmp4, tmp5);
+    tmp11 = vaddq_f32(tmp5, tmp6);
+    tmp12 = vaddq_f32(tmp6, tmp7);
+
+    float32x4_t z5 = vmulq_n_f32(vsubq_f32(tmp10, tmp12), 0.382683433f);
+    float32x4_t z2 = vaddq_f32(vmulq_n_f32(tmp10, 0.541196100f), z5);
+    float32x4_t z4 = vaddq_f32(vmulq_n_f32(tmp12, 1.306562965f), z5);
+    float32x4_t z3 = vmulq_n_f32(tmp11, 0.707106781f);
+
+    float32x4_t z11 = vaddq_f32(tmp7, z3);
+    float32x4_t z13 = vsubq_f32(tmp7, z3);
+
+    d[5] = vaddq_f32(z13, z2);
+    d[3] = vsubq_f32(z13, z2);
+    d[1] = vaddq_f32(z11, z4);
+    d[7] = vsubq_f32(z11, z4);
+}
+
+static inline void PBJJPEGTranspose4x4NEON(float32x4_t *a, float32x4_t *b, float32x4_t *c, float32x4_t *d)
+{
+    float32x4x2_t ab = vtrnq_f32(*a, *b);
+    float32x4x2_t cd = vtrnq_f32(*c, *d);
+    *a = vcombine_f32(vget_low_f32(ab.val[0]), vget_low_f32(cd.val[0]));
+    *b = vcombine_f32(vget_low_f32(ab.val[1]), vget_low_f32(cd.val[1]));
+    *c = vcombine_f32(vget_high_f32(ab.val[0]), vget_high_f32(cd.val[0]));
+    *d = vcombine_f32(vget_high_f32(ab.val[1]), vget_high_f32(cd.val[1]));
+}
+
+static void PBJJPEGTransformBlockNEON(float *block, const float *divisors, int16_t *coefficients)
+{
+    float32x4_t left[8];
+    float32x4_t right[8];
+    for (int row = 0; row < 8; row++) {
+        left[row] = vld1q_f32(block + row * 8);
+        right[row] = vld1q_f32(block + row * 8 + 4);
+    }
+    PBJJPEGForwardDCT8NEON(left);
+    PBJJPEGForwardDCT8NEON(right);
+
+    PBJJPEGTranspose4x4NEON(&left[0], &left[1], &left[2], &left[3]);
+    PBJJPEGTranspose4x4NEON(&right[0], &right[1], &right[2], &right[3]);
+    PBJJPEGTranspose4x4NEON(&left[4], &left[5], &left[6], &left[7]);
+    PBJJPEGTranspose4x4NEON(&right[4], &right[5], &right[6], &right[7]);
+    float32x4_t top[8] = { left[0], left[1], left[2], left[3], right[0], right[1], right[2], right[3] };
+    float32x4_t bottom[8] = { left[4], left[5], left[6], left[7], right[4], right[5], right[6], right[7] };
+    PBJJPEGForwardDCT8NEON(top);
+    PBJJPEGForwardDCT8NEON(bottom);
+
+    const float32x4_t limit = vdupq_n_f32(1023.0f);
+    const float32x4_t half = vdupq_n_f32(0.5f);
+    const uint32x4_t sign = vdupq_n_u32(0x80000000u);
+    int16_t transposed[64];
+    for (int column = 0; column < 8; column++) {
+        float32x4_t quantized[2] = { vmulq_f32(top[column], vld1q_f32(divisors + column * 8)),
+                                     vmulq_f32(bottom[column], vld1q_f32(divisors + column * 8 + 4)) };
+        for (int i = 0; i < 2; i++) {
+            float32x4_t value = vminq_f32(vmaxq_f32(quantized[i], vnegq_f32(limit)), limit);
+            quantized[i] = vaddq_f32(value, vbslq_f32(sign, value, half));
+        }
+        int16x8_t packed = vcombine_s16(vqmovn_s32(vcvtq_s32_f32(quantized[0])), vqmovn_s32(vcvtq_s32_f32(quantized[1])));
+        vst1q_s16(transposed + column * 8, packed);
+    }
+    for (int k = 0; k < 64; k++) {
+        coefficients[k] = transposed[PBJJPEGZigZagTransposed[k]];
+    }
+}
+
+#endif
+
+#pragma mark - MCUs
+
+static inline float PBJJPEGClampSample(float value)
+{
+    return value < -128.0f ? -128.0f : (value > 127.0f ? 127.0f : value);
+}
+
+typedef struct {
+    float luma[PBJ_JPEG_MCU * PBJ_JPEG_MCU];
+    float cb[64];
+    float cr[64];
+    float lumaCorrection[64]; // chroma's share of BT.601 luma, once per 2x2 luma samples
+} PBJJPEGMCU;
+
+// loads one MCU in BT.601, level shifted, edges replicate the last row and column
+static void PBJJPEGLoadMCU(const PBJJPEGEncoder *encoder, size_t mcuX, size_t mcuY, PBJJPEGMCU *mcu)
+{
+    const PBJNV12Image *image = &encoder->image;
+    const PBJJPEGRange range = encoder->range;
+    const size_t chromaWidth = PBJNV12ChromaWidth(image);
+    const size_t chromaHeight = PBJNV12ChromaHeight(image);
+
+    for (size_t y = 0; y < 8; y++) {
+        size_t cy = mcuY * 8 + y;
+        if (cy >= chromaHeight)
+            cy = chromaHeight - 1;
+        const uint8_t *chromaRow = image->chroma + cy * image->chromaBytesPerRow;
+        for (size_t x = 0; x < 8; x++) {
+            size_t cx = mcuX * 8 + x;
+            if (cx >= chromaWidth)
+                cx = chromaWidth - 1;
+            float cb = ((float)chromaRow[cx * 2] - 128.0f) * range.chromaScale;
+            float cr = ((float)chromaRow[cx * 2 + 1] - 128.0f) * range.chromaScale;
+            mcu->cb[y * 8 + x] = PBJJPEGClampSample(0.989853f * cb - 0.110654f * cr);
+            mcu->cr[y * 8 + x] = PBJJPEGClampSample(-0.072454f * cb + 0.983396f * cr);
+            mcu->lumaCorrection[y * 8 + x] = 0.101581f * cb + 0.196079f * cr - 128.0f;
+        }
+    }
+
+    for (size_t y = 0; y < PBJ_JPEG_MCU; y++) {
+        size_t ly = mcuY * PBJ_JPEG_MCU + y;
+        if (ly >= image->height)
+            ly = image->height - 1;
+        const uint8_t *lumaRow = image->luma + ly * image->lumaBytesPerRow;
+        const float *correction = mcu->lumaCorrection + (y >> 1) * 8;
+        for (size_t x = 0; x < PBJ_JPEG_MCU; x++) {
+            size_t lx = mcuX * PBJ_JPEG_MCU + x;
+            if (lx >= image->width)
+                lx = image->width - 1;
+            float luma = ((float)lumaRow[lx] - range.lumaOffset) * range.lumaScale;
+            mcu->luma[y * PBJ_JPEG_MCU + x] = PBJJPEGClampSample(luma + correction[x >> 1]);
+        }
+    }
+}
+
+int PBJJPEGEncoderEncodeSegment(PBJJPEGEncoder *encoder, size_t segmentIndex)
+{
+    if (!encoder || segmentIndex >= encoder->segmentCount)
+        return 0;
+
+    PBJJPEGSegment *segment = &encoder->segments[segmentIndex];
+    segment->size = 0;
+    segment->encoded = 0;
+
+    size_t rowsPerSegment = encoder->segmentCount > 1 ? encoder->restartRows : encoder->mcuRows;
+    size_t rowBegin = segmentIndex * rowsPerSegment;
+    size_t rowEnd = rowBegin + rowsPerSegment < encoder->mcuRows ? rowBegin + rowsPerSegment : encoder->mcuRows;
+
+    // roughly a bit per pixel to begin with
+    if (!PBJJPEGReserve(segment, (rowEnd - rowBegin) * encoder->mcuColumns * PBJ_JPEG_MCU * PBJ_JPEG_MCU / 8))
+        return 0;
+
+    PBJJPEGBitWriter writer = { segment, 0, 0 };
+    int predictors[3] = { 0, 0, 0 };
+    PBJJPEGMCU mcu;
+    float block[64];
+    int16_t coefficients[64];
+
+    for (size_t mcuY = rowBegin; mcuY < rowEnd; mcuY++) {
+        for (size_t mcuX = 0; mcuX < encoder->mcuColumns; mcuX++) {
+            if (!PBJJPEGReserve(segment, 6 * PBJ_JPEG_BLOCK_BYTES_BOUND))
+                return 0;
+
+            PBJJPEGLoadMCU(encoder, mcuX, mcuY, &mcu);
+
+            for (size_t b = 0; b < 4; b++) {
+                const float *source = mcu.luma + (b >> 1) * 8 * PBJ_JPEG_MCU + (b & 1) * 8;
+                for (size_t y = 0; y < 8; y++) {
+                    memcpy(block + y * 8, source + y * PBJ_JPEG_MCU, 8 * sizeof(float));
+                }
+                encoder->transform(block, encoder->divisors[0], coefficients);
+                PBJJPEGEncodeBlock(&writer, coefficients, &predictors[0], &encoder->dc[0], &encoder->ac[0]);
+            }
+
+            encoder->transform(mcu.cb, encoder->divisors[1], coefficients);
+            PBJJPEGEncodeBlock(&writer, coefficients, &predictors[1], &encoder->dc[1], &encoder->ac[1]);
+            encoder->transform(mcu.cr, encoder->divisors[1], coefficients);
+            PBJJPEGEncodeBlock(&writer, coefficients, &predictors[2], &encoder->dc[1], &encoder->ac[1]);
+        }
+    }
+
+    if (!PBJJPEGReserve(segment, 16))
+        return 0;
+    PBJJPEGFlushBits(&writer);
+    segment->encoded = 1;
+    return 1;
+}
+
+#pragma mark - encoder
+
+PBJJPEGEncoder *PBJJPEGEncoderCreate(const PBJNV12Image *image, PBJJPEGOptions options)
+{
+    if (!image || !image->luma || !image->chroma || image->width == 0 || image->height == 0 ||
+        image->width > 0xffff || image->height > 0xffff) {
+        return NULL;
+    }
+
+    PBJJPEGEncoder *encoder = (PBJJPEGEncoder *)calloc(1, sizeof(PBJJPEGEncoder));
+    if (!encoder)
+        return NULL;
+
+    encoder->image = *image;
+    encoder->range = image->range == PBJYCbCrRangeVideo ? PBJJPEGRangeVideo : PBJJPEGRangeFull;
+    encoder->mcuColumns = (image->width + PBJ_JPEG_MCU - 1) / PBJ_JPEG_MCU;
+    encoder->mcuRows = (image->height + PBJ_JPEG_MCU - 1) / PBJ_JPEG_MCU;
+
+    // the interval is a 16 bit count of MCUs
+    size_t restartRows = options.restartRows;
+    size_t maximumRestartRows = 0xffff / encoder->mcuColumns;
+    if (restartRows > maximumRestartRows)
+        restartRows = maximumRestartRows;
+    encoder->restartRows = restartRows;
+    encoder->segmentCount = restartRows > 0 ? (encoder->mcuRows + restartRows - 1) / restartRows : 1;
+
+    int quality = options.quality < 1 ? 1 : (options.quality > 100 ? 100 : options.quality);
+    PBJJPEGScaleQuantization(PBJJPEGLumaQuantization, quality, encoder->quantization[0]);
+    PBJJPEGScaleQuantization(PBJJPEGChromaQuantization, quality, encoder->quantization[1]);
+    int transposed = 1;
+    switch (PBJSIMDLevelResolve(options.level)) {
+#if PBJ_SIMD_SSE2
+        case PBJSIMDLevelSSE2:
+        case PBJSIMDLevelAVX2:
+            encoder->transform = PBJJPEGTransformBlockSSE2;
+            break;
+#endif
+#if PBJ_SIMD_NEON
+        case PBJSIMDLevelNEON:
+            encoder->transform = PBJJPEGTransformBlockNEON;
+            break;
+#endif
+        default:
+            encoder->transform = PBJJPEGTransformBlockScalar;
+            transposed = 0;
+            break;
+    }
+    PBJJPEGBuildDivisors(encoder->quantization[0], transposed, encoder->divisors[0]);
+    PBJJPEGBuildDivisors(encoder->quantization[1], transposed, encoder->divisors[1]);
+
+    PBJJPEGBuildHuffmanTable(PBJJPEGLumaDCBits, PBJJPEGDCValues, &encoder->dc[0]);
+    PBJJPEGBuildHuffmanTable(PBJJPEGChromaDCBits, PBJJPEGDCValues, &encoder->dc[1]);
+    PBJJPEGBuildHuffmanTable(PBJJPEGLumaACBits, PBJJPEGLumaACValues, &encoder->ac[0]);
+    PBJJPEGBuildHuffmanTable(PBJJPEGChromaACBits, PBJJPEGChromaACValues, &encoder->ac[1]);
+
+    encoder->segments = (PBJJPEGSegment *)calloc(encoder->segmentCount, sizeof(PBJJPEGSegment));
+    encoder->header = (uint8_t *)malloc(1024);
+    if (!encoder->segments || !encoder->header) {
+        PBJJPEGEncoderDestroy(encoder);
+        return NULL;
+    }
+    encoder->headerSize = PBJJPEGWriteHeader(encoder, encoder->header);
+
+    return encoder;
+}
+
+void PBJJPEGEncoderDestroy(PBJJPEGEncoder *encoder)
+{
+    if (!encoder)
+        return;
+    if (encoder->segments) {
+        for (size_t i = 0; i < encoder->segmentCount; i++) {
+            free(encoder->segments[i].data);
+        }
+        free(encoder->segments);
+    }
+    free(encoder->header);
+    free(encoder);
+}
+
+size_t PBJJPEGEncoderGetSegmentCount(const PBJJPEGEncoder *encoder)
+{
+    return encoder ? encoder->segmentCount : 0;
+}
+
+size_t PBJJPEGEncoderGetSize(const PBJJPEGEncoder *encoder)
+{
+    if (!encoder)
+        return 0;
+
+    // a restart marker between each segment, EOI after the last
+    size_t size = encoder->headerSize + (encoder->segmentCount - 1) * 2 + 2;
+    for (size_t i = 0; i < encoder->segmentCount; i++) {
+        if (!encoder->segments[i].encoded)
+            return 0;
+        size += encoder->segments[i].size;
+    }
+    return size;
+}
+
+size_t PBJJPEGEncoderCopyBytes(const PBJJPEGEncoder *encoder, uint8_t *destination, size_t capacity)
+{
+    size_t size = PBJJPEGEncoderGetSize(encoder);
+    if (size == 0 || !destination || capacity < size)
+        return 0;
+
+    uint8_t *out = destination;
+    memcpy(out, encoder->header, encoder->headerSize);
+    out += encoder->headerSize;
+    for (size_t i = 0; i < encoder->segmentCount; i++) {
+        if (i > 0) {
+            *out++ = 0xff;
+            *out++ = (uint8_t)(0xd0 + ((i - 1) & 7)); // RST0 - RST7
+        }
+        memcpy(out, encoder->segments[i].data, encoder->segments[i].size);
+        out += encoder->segments[i].size;
+    }
+    *out++ = 0xff;
+    *out++ = 0xd9; // EOI
+
+    return size;
+}
+
+uint8_t *PBJJPEGEncode(const PBJNV12Image *image, PBJJPEGOptions options, size_t *size)
+{
+    PBJJPEGEncoder *encoder = PBJJPEGEncoderCreate(image, options);
+    if (!encoder)
+        return NULL;
+
+    uint8_t *data = NULL;
+    size_t dataSize = 0;
+    size_t segmentCount = PBJJPEGEncoderGetSegmentCount(encoder);
+    size_t segment = 0;
+    while (segment < segmentCount && PBJJPEGEncoderEncodeSegment(encoder, segment)) {
+        segment++;
+    }
+    if (segment == segmentCount) {
+        dataSize = PBJJPEGEncoderGetSize(encoder);
+        data = (uint8_t *)malloc(dataSize);
+        if (data && PBJJPEGEncoderCopyBytes(encoder, data, dataSize) != dataSize) {
+            free(data);
+            data = NULL;
+        }
+    }
+
+    PBJJPEGEncoderDestroy(encoder);
+    if (size) {
+        *size = data ? dataSize : 0;
+    }
+    return data;
+}
@@ -0,0 +1,74 @@
+//
+//  PBJJPEGEncoder.h
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef PBJJPEGEncoder_h
+#define PBJJPEGEncoder_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "PBJPlanarImage.h"
+#include "PBJSIMD.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// baseline JPEG straight from NV12 planes, no RGB detour. the file is 4:2:0 like the source so
+// chroma is never resampled, the BT.709 planes (as PBJColorConversion reads them) are re-expressed
+// in JFIF's full range BT.601 while each MCU is loaded. restart intervals split the scan into
+// segments with independent entropy coding, so distinct segments can be encoded concurrently
+
+typedef struct {
+    int quality;        // 1 - 100, IJG scaling of the Annex K tables
+    size_t restartRows; // MCU rows (16 luma rows) per restart interval, 0 for a single segment
+    PBJSIMDLevel level; // transform and quantization, PBJSIMDLevelAuto for the best available
+} PBJJPEGOptions;
+
+typedef struct PBJJPEGEncoder PBJJPEGEncoder;
+
+// the image is borrowed until the last segment is encoded, any dimensions up to 65535
+PBJJPEGEncoder *PBJJPEGEncoderCreate(const PBJNV12Image *image, PBJJPEGOptions options);
+void PBJJPEGEncoderDestroy(PBJJPEGEncoder *encoder);
+
+size_t PBJJPEGEncoderGetSegmentCount(const PBJJPEGEncoder *encoder);
+
+// safe to call concurrently for different segments, returns 0 when out of memory
+int PBJJPEGEncoderEncodeSegment(PBJJPEGEncoder *encoder, size_t segment);
+
+// size of the complete file, 0 until every segment has been encoded
+size_t PBJJPEGEncoderGetSize(const PBJJPEGEncoder *encoder);
+
+// headers, the segments separated by restart markers and EOI, returns the bytes written or 0
+// when capacity is short or a segment is missing
+size_t PBJJPEGEncoderCopyBytes(const PBJJPEGEncoder *encoder, uint8_t *destination, size_t capacity);
+
+// encodes every segment on the calling thread, the result is malloc'd, NULL on failure
+uint8_t *PBJJPEGEncode(const PBJNV12Image *image, PBJJPEGOptions options, size_t *size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PBJJPEGEncoder_h */
@@ -26,10 +26,20 @@
 #import <Foundation/Foundation.h>
 #import <AVFoundation/AVFoundation.h>
 
+#import "PBJVision.h"
+
 @protocol PBJMediaWriterDelegate;
 @interface PBJMediaWriter : NSObject
 
 - (id)initWithOutputURL:(NSURL *)outputURL;
+- (id)initWithOutputURL:(NSURL *)outputURL queueDepth:(NSUInteger)queueDepth dropPolicy:(PBJFrameDropPolicy)dropPolicy;
+
+// a valid fragment interval writes a fragmented MP4 encoded on the device instead of using AVAssetWriter,
+// finishing is then constant time and an interrupted recording stays playable up to its last fragment
+- (id)initWithOutputURL:(NSURL *)outputURL queueDepth:(NSUInteger)queueDepth dropPolicy:(PBJFrameDropPolicy)dropPolicy fragmentInterval:(CMTime)fragmentInterval;
+
+// preallocation, batching and durability of the fragmented writer's file, ignored by AVAssetWriter
+- (id)initWithOutputURL:(NSURL *)outputURL queueDepth:(NSUInteger)queueDepth dropPolicy:(PBJFrameDropPolicy)dropPolicy fragmentInterval:(CMTime)fragmentInterval outputConfiguration:(PBJOutputSinkConfiguration)outputConfiguration;
 
 @property (nonatomic, weak) id<PBJMediaWriterDelegate> delegate;
 
@@ -50,9 +60,30 @@
 @property (nonatomic, readonly) CMTime audioTimestamp;
 @property (nonatomic, readonly) CMTime videoTimestamp;
 
+// queued writing, call from a single producer queue, appends happen on the writer thread
+- (void)enqueueSampleBuffer:(CMSampleBufferRef)sampleBuffer withMediaTypeVideo:(BOOL)video;
+
+// synchronous writing, bypasses the queues
 - (void)writeSampleBuffer:(CMSampleBufferRef)sampleBuffer withMediaTypeVideo:(BOOL)video;
+
+// flushes anything still queued before finishing
 - (void)finishWritingWithCompletionHandler:(void (^)(void))handler;
 
+@property (nonatomic, readonly) PBJWriterStatistics statistics;
+
+// the encoder's average bit rate from the next frame, 0 for the one in the video settings, safe from any
+// thread. only the fragmented writer encodes on the device, AVAssetWriter keeps the rate it was set up with
+@property (nonatomic) double videoBitRate;
+
+// size of the output file so far, safe from any thread
+@property (nonatomic, readonly) uint64_t bytesWritten;
+
+// space reserved for the output file that it has yet to fill, safe from any thread
+@property (nonatomic, readonly) uint64_t unusedPreallocatedBytes;
+
+// records append and setup latency and video frame accounting, not owned, must outlive the writer
+@property (nonatomic, assign) PBJInstrumentation *instrumentation;
+
 @end
 
 @protocol PBJMediaWriterDelegate <NSObject>
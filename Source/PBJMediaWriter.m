@@ -26,10 +26,15 @@
 #import "PBJMediaWriter.h"
 #import "PBJVisionUtilities.h"
 #import "PBJVision.h"
+#import "PBJSampleRing.h"
+#import "PBJFragmentedMediaWriter.h"
 
 #import <UIKit/UIDevice.h>
 #import <MobileCoreServices/UTCoreTypes.h>
 
+#include <stdatomic.h>
+#include <sys/stat.h>
+
 #define LOG_WRITER 0
 #if !defined(NDEBUG) && LOG_WRITER
 #   define DLog(fmt, ...) NSLog((@"writer: " fmt), ##__VA_ARGS__);
@@ -37,16 +42,52 @@
 #   define DLog(...)
 #endif
 
+static NSUInteger const PBJMediaWriterDefaultQueueDepth = 8;
+static int64_t const PBJMediaWriterRetryInterval = 2 * NSEC_PER_MSEC;
+static NSUInteger const PBJMediaWriterFlushAttempts = 250;
+
+typedef NS_ENUM(NSInteger, PBJMediaWriterAppendResult) {
+    PBJMediaWriterAppendResultAppended = 0,
+    PBJMediaWriterAppendResultNotReady,
+    PBJMediaWriterAppendResultFailed
+};
+
 @interface PBJMediaWriter ()
 {
     AVAssetWriter *_assetWriter;
     AVAssetWriterInput *_assetWriterAudioInput;
     AVAssetWriterInput *_assetWriterVideoInput;
 
+    // set instead of the asset writer when writing fragments
+    PBJFragmentedMediaWriter *_fragmentedWriter;
+
     NSURL *_outputURL;
 
     CMTime _audioTimestamp;
     CMTime _videoTimestamp;
+
+    // queued writing, rings are filled by the capture queue and drained on _writerQueue
+
+    dispatch_queue_t _writerQueue;
+    dispatch_source_t _writerSource;
+    PBJSampleRing *_videoRing;
+    PBJSampleRing *_audioRing;
+    PBJFrameDropPolicy _dropPolicy;
+
+    CMSampleBufferRef _pendingVideoSampleBuffer;
+    CMSampleBufferRef _pendingAudioSampleBuffer;
+    BOOL _retryScheduled;
+
+    _Atomic(uint64_t) _videoWritten;
+    _Atomic(uint64_t) _audioWritten;
+    _Atomic(uint64_t) _videoFailed;
+    _Atomic(uint64_t) _audioFailed;
+    _Atomic(uint64_t) _videoDeferred;
+    _Atomic(uint64_t) _videoAppendNanoseconds;
+
+    double _videoBitRate;
+
+    PBJInstrumentation *_instrumentation;
 }
 
 @end
@@ -57,6 +98,7 @@
 @synthesize outputURL = _outputURL;
 @synthesize audioTimestamp = _audioTimestamp;
 @synthesize videoTimestamp = _videoTimestamp;
+@synthesize instrumentation = _instrumentation;
 
 #pragma mark - getters/setters
 
@@ -65,7 +107,7 @@
     AVAuthorizationStatus audioAuthorizationStatus = [AVCaptureDevice authorizationStatusForMediaType:AVMediaTypeAudio];
 
     BOOL isAudioNotAuthorized = (audioAuthorizationStatus == AVAuthorizationStatusNotDetermined || audioAuthorizationStatus == AVAuthorizationStatusDenied);
-    BOOL isAudioSetup = (_assetWriterAudioInput != nil) || isAudioNotAuthorized;
+    BOOL isAudioSetup = (_assetWriterAudioInput != nil) || _fragmentedWriter.isAudioReady || isAudioNotAuthorized;
 
     return isAudioSetup;
 }
@@ -75,38 +117,123 @@
     AVAuthorizationStatus videoAuthorizationStatus = [AVCaptureDevice authorizationStatusForMediaType:AVMediaTypeVideo];
 
     BOOL isVideoNotAuthorized = (videoAuthorizationStatus == AVAuthorizationStatusNotDetermined || videoAuthorizationStatus == AVAuthorizationStatusDenied);
-    BOOL isVideoSetup = (_assetWriterVideoInput != nil) || isVideoNotAuthorized;
+    BOOL isVideoSetup = (_assetWriterVideoInput != nil) || _fragmentedWriter.isVideoReady || isVideoNotAuthorized;
 
     return isVideoSetup;
 }
 
 - (NSError *)error
 {
-    return _assetWriter.error;
+    return _fragmentedWriter ? _fragmentedWriter.error : _assetWriter.error;
+}
+
+- (PBJWriterStatistics)statistics
+{
+    PBJSampleRingCounters videoCounters = PBJSampleRingGetCounters(_videoRing);
+    PBJSampleRingCounters audioCounters = PBJSampleRingGetCounters(_audioRing);
+
+    PBJWriterStatistics statistics;
+    statistics.videoFramesEnqueued = videoCounters.enqueued;
+    statistics.videoFramesWritten = atomic_load_explicit(&_videoWritten, memory_order_relaxed);
+    statistics.videoFramesDropped = videoCounters.dropped + atomic_load_explicit(&_videoFailed, memory_order_relaxed);
+    statistics.audioSamplesEnqueued = audioCounters.enqueued;
+    statistics.audioSamplesWritten = atomic_load_explicit(&_audioWritten, memory_order_relaxed);
+    statistics.audioSamplesDropped = audioCounters.dropped + atomic_load_explicit(&_audioFailed, memory_order_relaxed);
+    statistics.videoFramesQueued = PBJSampleRingCount(_videoRing);
+    statistics.videoQueueCapacity = PBJSampleRingCapacity(_videoRing);
+    statistics.videoAppendsDeferred = atomic_load_explicit(&_videoDeferred, memory_order_relaxed);
+    statistics.videoAppendNanoseconds = atomic_load_explicit(&_videoAppendNanoseconds, memory_order_relaxed);
+    return statistics;
+}
+
+- (double)videoBitRate
+{
+    return _videoBitRate;
+}
+
+- (void)setVideoBitRate:(double)videoBitRate
+{
+    _videoBitRate = videoBitRate;
+    _fragmentedWriter.videoBitRate = videoBitRate;
+}
+
+- (uint64_t)bytesWritten
+{
+    struct stat status;
+    if (stat([_outputURL fileSystemRepresentation], &status) != 0)
+        return 0;
+    return (uint64_t)status.st_size;
+}
+
+- (uint64_t)unusedPreallocatedBytes
+{
+    return _fragmentedWriter.unusedPreallocatedBytes;
 }
 
 #pragma mark - init
 
 - (id)initWithOutputURL:(NSURL *)outputURL
+{
+    return [self initWithOutputURL:outputURL queueDepth:PBJMediaWriterDefaultQueueDepth dropPolicy:PBJFrameDropPolicyPreferAudio];
+}
+
+- (id)initWithOutputURL:(NSURL *)outputURL queueDepth:(NSUInteger)queueDepth dropPolicy:(PBJFrameDropPolicy)dropPolicy
+{
+    return [self initWithOutputURL:outputURL queueDepth:queueDepth dropPolicy:dropPolicy fragmentInterval:kCMTimeInvalid];
+}
+
+- (id)initWithOutputURL:(NSURL *)outputURL queueDepth:(NSUInteger)queueDepth dropPolicy:(PBJFrameDropPolicy)dropPolicy fragmentInterval:(CMTime)fragmentInterval
+{
+    return [self initWithOutputURL:outputURL queueDepth:queueDepth dropPolicy:dropPolicy fragmentInterval:fragmentInterval outputConfiguration:PBJOutputSinkDefaultConfiguration()];
+}
+
+- (id)initWithOutputURL:(NSURL *)outputURL queueDepth:(NSUInteger)queueDepth dropPolicy:(PBJFrameDropPolicy)dropPolicy fragmentInterval:(CMTime)fragmentInterval outputConfiguration:(PBJOutputSinkConfiguration)outputConfiguration
 {
     self = [super init];
     if (self) {
-        NSError *error = nil;
-        _assetWriter = [AVAssetWriter assetWriterWithURL:outputURL fileType:(NSString *)kUTTypeMPEG4 error:&error];
-        if (error) {
-            DLog(@"error setting up the asset writer (%@)", error);
-            _assetWriter = nil;
-            return nil;
+        if (CMTIME_IS_VALID(fragmentInterval)) {
+            _fragmentedWriter = [[PBJFragmentedMediaWriter alloc] initWithOutputURL:outputURL fragmentInterval:fragmentInterval outputConfiguration:outputConfiguration];
+            if (!_fragmentedWriter) {
+                DLog(@"error setting up the fragmented writer");
+                return nil;
+            }
+        } else {
+            NSError *error = nil;
+            _assetWriter = [AVAssetWriter assetWriterWithURL:outputURL fileType:(NSString *)kUTTypeMPEG4 error:&error];
+            if (error) {
+                DLog(@"error setting up the asset writer (%@)", error);
+                _assetWriter = nil;
+                return nil;
+            }
+
+            _assetWriter.shouldOptimizeForNetworkUse = YES;
+            _assetWriter.metadata = [self _metadataArray];
         }
 
         _outputURL = outputURL;
 
-        _assetWriter.shouldOptimizeForNetworkUse = YES;
-        _assetWriter.metadata = [self _metadataArray];
-
         _audioTimestamp = kCMTimeInvalid;
         _videoTimestamp = kCMTimeInvalid;
 
+        // setup the writer thread
+        queueDepth = MAX(queueDepth, (NSUInteger)1);
+        _dropPolicy = dropPolicy;
+        _videoRing = PBJSampleRingCreate(queueDepth);
+        _audioRing = PBJSampleRingCreate(queueDepth * 2);
+        atomic_init(&_videoWritten, 0);
+        atomic_init(&_audioWritten, 0);
+        atomic_init(&_videoFailed, 0);
+        atomic_init(&_audioFailed, 0);
+
+        dispatch_queue_attr_t attributes = dispatch_queue_attr_make_with_qos_class(DISPATCH_QUEUE_SERIAL, QOS_CLASS_USER_INITIATED, 0);
+        _writerQueue = dispatch_queue_create("PBJMediaWriter", attributes);
+        _writerSource = dispatch_source_create(DISPATCH_SOURCE_TYPE_DATA_OR, 0, 0, _writerQueue);
+        __weak PBJMediaWriter *weakSelf = self;
+        dispatch_source_set_event_handler(_writerSource, ^{
+            [weakSelf _drainQueues];
+        });
+        dispatch_resume(_writerSource);
+
         // ensure authorization is permitted, if not already prompted
         // it's possible to capture video without audio or audio without video
         if ([[AVCaptureDevice class] respondsToSelector:@selector(authorizationStatusForMediaType:)]) {
@@ -134,6 +261,17 @@
     return self;
 }
 
+- (void)dealloc
+{
+    if (_writerSource) {
+        dispatch_source_cancel(_writerSource);
+        _writerSource = nil;
+    }
+    [self _discardQueuedSampleBuffers];
+    PBJSampleRingDestroy(_videoRing);
+    PBJSampleRingDestroy(_audioRing);
+}
+
 #pragma mark - private
 
 - (NSArray *)_metadataArray
@@ -165,6 +303,11 @@
 
 - (BOOL)setupAudioWithSettings:(NSDictionary *)audioSettings
 {
+    if (_fragmentedWriter) {
+        [_fragmentedWriter setupAudioWithSettings:audioSettings];
+        return self.isAudioReady;
+    }
+
     if (!_assetWriterAudioInput && [_assetWriter canApplyOutputSettings:audioSettings forMediaType:AVMediaTypeAudio]) {
 
         _assetWriterAudioInput = [AVAssetWriterInput assetWriterInputWithMediaType:AVMediaTypeAudio outputSettings:audioSettings];
@@ -193,6 +336,11 @@
 }
 
 - (BOOL)setupVideoWithSettings:(NSDictionary *)videoSettings withAdditional:(NSDictionary *)additional {
+    if (_fragmentedWriter) {
+        [_fragmentedWriter setupVideoWithSettings:videoSettings rotation:[additional[PBJVisionVideoRotation] floatValue]];
+        return self.isVideoReady;
+    }
+
     if (!_assetWriterVideoInput && [_assetWriter canApplyOutputSettings:videoSettings forMediaType:AVMediaTypeVideo]) {
 
         _assetWriterVideoInput = [AVAssetWriterInput assetWriterInputWithMediaType:AVMediaTypeVideo outputSettings:videoSettings];
@@ -236,22 +384,159 @@
 
 #pragma mark - sample buffer writing
 
+- (void)enqueueSampleBuffer:(CMSampleBufferRef)sampleBuffer withMediaTypeVideo:(BOOL)video
+{
+    if (!sampleBuffer || !_writerSource)
+        return;
+
+    PBJSampleRing *ring = video ? _videoRing : _audioRing;
+
+    // give the writer a chance to catch up on audio before taking more video
+    if (video && _dropPolicy == PBJFrameDropPolicyPreferAudio &&
+        PBJSampleRingCount(_audioRing) * 2 >= PBJSampleRingCapacity(_audioRing)) {
+        PBJSampleRingCountDropped(ring);
+        PBJInstrumentationIncrementCounter(_instrumentation, PBJInstrumentationCounterFramesDroppedNotReady);
+        DLog(@"dropped video, audio is backed up");
+        return;
+    }
+
+    PBJSampleRingOverflow overflow = (_dropPolicy == PBJFrameDropPolicyDropNewest) ? PBJSampleRingOverflowDropNewest : PBJSampleRingOverflowDropOldest;
+    void *dropped = NULL;
+    CFRetain(sampleBuffer);
+    PBJSampleRingPush(ring, (void *)sampleBuffer, overflow, &dropped);
+    if (dropped) {
+        if (video) {
+            PBJInstrumentationIncrementCounter(_instrumentation, PBJInstrumentationCounterFramesDroppedNotReady);
+        }
+        DLog(@"writer queue overflow, dropped %@", video ? @"video" : @"audio");
+        CFRelease((CMSampleBufferRef)dropped);
+    }
+
+    dispatch_source_merge_data(_writerSource, 1);
+}
+
 - (void)writeSampleBuffer:(CMSampleBufferRef)sampleBuffer withMediaTypeVideo:(BOOL)video
+{
+    [self _appendSampleBuffer:sampleBuffer withMediaTypeVideo:video];
+}
+
+#pragma mark - writer thread
+
+- (void)_drainQueues
+{
+    BOOL progress = YES;
+    while (progress) {
+        progress = NO;
+        progress |= [self _drainRing:_videoRing pendingSampleBuffer:&_pendingVideoSampleBuffer withMediaTypeVideo:YES];
+        progress |= [self _drainRing:_audioRing pendingSampleBuffer:&_pendingAudioSampleBuffer withMediaTypeVideo:NO];
+    }
+
+    // an input was not ready, hold on to its sample and try again shortly
+    if ((_pendingVideoSampleBuffer || _pendingAudioSampleBuffer) && !_retryScheduled) {
+        _retryScheduled = YES;
+        __weak PBJMediaWriter *weakSelf = self;
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, PBJMediaWriterRetryInterval), _writerQueue, ^{
+            PBJMediaWriter *strongSelf = weakSelf;
+            if (strongSelf) {
+                strongSelf->_retryScheduled = NO;
+                [strongSelf _drainQueues];
+            }
+        });
+    }
+}
+
+- (BOOL)_drainRing:(PBJSampleRing *)ring pendingSampleBuffer:(CMSampleBufferRef *)pendingSampleBuffer withMediaTypeVideo:(BOOL)video
+{
+    if (!*pendingSampleBuffer) {
+        *pendingSampleBuffer = (CMSampleBufferRef)PBJSampleRingPop(ring);
+    }
+    if (!*pendingSampleBuffer)
+        return NO;
+
+    uint64_t appendStart = video ? PBJInstrumentationNow() : 0;
+    PBJMediaWriterAppendResult result = [self _appendSampleBuffer:*pendingSampleBuffer withMediaTypeVideo:video];
+    if (result == PBJMediaWriterAppendResultNotReady) {
+        if (video) {
+            atomic_fetch_add_explicit(&_videoDeferred, 1, memory_order_relaxed);
+        }
+        return NO;
+    }
+
+    CFRelease(*pendingSampleBuffer);
+    *pendingSampleBuffer = NULL;
+
+    if (result == PBJMediaWriterAppendResultAppended) {
+        atomic_fetch_add_explicit(video ? &_videoWritten : &_audioWritten, 1, memory_order_relaxed);
+        if (video) {
+            atomic_fetch_add_explicit(&_videoAppendNanoseconds, PBJInstrumentationNow() - appendStart, memory_order_relaxed);
+            PBJInstrumentationIncrementCounter(_instrumentation, PBJInstrumentationCounterFramesWritten);
+        }
+    } else {
+        atomic_fetch_add_explicit(video ? &_videoFailed : &_audioFailed, 1, memory_order_relaxed);
+    }
+    return YES;
+}
+
+- (void)_flushQueues
+{
+    for (NSUInteger attempt = 0; attempt < PBJMediaWriterFlushAttempts; attempt++) {
+        [self _drainQueues];
+        BOOL empty = !_pendingVideoSampleBuffer && !_pendingAudioSampleBuffer &&
+                     PBJSampleRingCount(_videoRing) == 0 && PBJSampleRingCount(_audioRing) == 0;
+        if (empty)
+            return;
+        usleep((useconds_t)(PBJMediaWriterRetryInterval / NSEC_PER_USEC));
+    }
+    DLog(@"inputs did not become ready, discarding queued samples");
+    [self _discardQueuedSampleBuffers];
+}
+
+- (void)_discardQueuedSampleBuffers
+{
+    void *sampleBuffer = NULL;
+    while ((sampleBuffer = PBJSampleRingPop(_videoRing))) {
+        atomic_fetch_add_explicit(&_videoFailed, 1, memory_order_relaxed);
+        PBJInstrumentationIncrementCounter(_instrumentation, PBJInstrumentationCounterFramesDroppedNotReady);
+        CFRelease((CMSampleBufferRef)sampleBuffer);
+    }
+    while ((sampleBuffer = PBJSampleRingPop(_audioRing))) {
+        atomic_fetch_add_explicit(&_audioFailed, 1, memory_order_relaxed);
+        CFRelease((CMSampleBufferRef)sampleBuffer);
+    }
+    if (_pendingVideoSampleBuffer) {
+        atomic_fetch_add_explicit(&_videoFailed, 1, memory_order_relaxed);
+        PBJInstrumentationIncrementCounter(_instrumentation, PBJInstrumentationCounterFramesDroppedNotReady);
+        CFRelease(_pendingVideoSampleBuffer);
+        _pendingVideoSampleBuffer = NULL;
+    }
+    if (_pendingAudioSampleBuffer) {
+        atomic_fetch_add_explicit(&_audioFailed, 1, memory_order_relaxed);
+        CFRelease(_pendingAudioSampleBuffer);
+        _pendingAudioSampleBuffer = NULL;
+    }
+}
+
+- (PBJMediaWriterAppendResult)_appendSampleBuffer:(CMSampleBufferRef)sampleBuffer withMediaTypeVideo:(BOOL)video
 {
     if (!CMSampleBufferDataIsReady(sampleBuffer)) {
-        return;
+        return PBJMediaWriterAppendResultFailed;
     }
 
+    if (_fragmentedWriter)
+        return [self _appendFragmentedSampleBuffer:sampleBuffer withMediaTypeVideo:video];
+
     // setup the writer
     if ( _assetWriter.status == AVAssetWriterStatusUnknown ) {
 
+        uint64_t setupStart = _instrumentation ? PBJInstrumentationNow() : 0;
         if ([_assetWriter startWriting]) {
             CMTime timestamp = CMSampleBufferGetPresentationTimeStamp(sampleBuffer);
             [_assetWriter startSessionAtSourceTime:timestamp];
+            PBJInstrumentationRecordSince(_instrumentation, PBJInstrumentationStageWriterSetup, setupStart);
             DLog(@"started writing with status (%ld)", (long)_assetWriter.status);
         } else {
             DLog(@"error when starting to write (%@)", [_assetWriter error]);
-            return;
+            return PBJMediaWriterAppendResultFailed;
         }
 
     }
@@ -259,17 +544,17 @@
     // check for completion state
     if ( _assetWriter.status == AVAssetWriterStatusFailed ) {
         DLog(@"writer failure, (%@)", _assetWriter.error.localizedDescription);
-        return;
+        return PBJMediaWriterAppendResultFailed;
     }
 
     if (_assetWriter.status == AVAssetWriterStatusCancelled) {
         DLog(@"writer cancelled");
-        return;
+        return PBJMediaWriterAppendResultFailed;
     }
 
     if ( _assetWriter.status == AVAssetWriterStatusCompleted) {
         DLog(@"writer finished and completed");
-        return;
+        return PBJMediaWriterAppendResultFailed;
     }
 
     // perform write
@@ -281,37 +566,79 @@
             timestamp = CMTimeAdd(timestamp, duration);
         }
 
+        AVAssetWriterInput *input = video ? _assetWriterVideoInput : _assetWriterAudioInput;
+        if (!input.readyForMoreMediaData) {
+            return PBJMediaWriterAppendResultNotReady;
+        }
+
+        uint64_t appendStart = _instrumentation ? PBJInstrumentationNow() : 0;
+        if (![input appendSampleBuffer:sampleBuffer]) {
+            DLog(@"writer error appending %@ (%@)", video ? @"video" : @"audio", _assetWriter.error);
+            return PBJMediaWriterAppendResultFailed;
+        }
+        PBJInstrumentationRecordSince(_instrumentation, PBJInstrumentationStageAppend, appendStart);
+
         if (video) {
-            if (_assetWriterVideoInput.readyForMoreMediaData) {
-                if ([_assetWriterVideoInput appendSampleBuffer:sampleBuffer]) {
-                    _videoTimestamp = timestamp;
-                } else {
-                    DLog(@"writer error appending video (%@)", _assetWriter.error);
-                }
-            }
+            _videoTimestamp = timestamp;
         } else {
-            if (_assetWriterAudioInput.readyForMoreMediaData) {
-                if ([_assetWriterAudioInput appendSampleBuffer:sampleBuffer]) {
-                    _audioTimestamp = timestamp;
-                } else {
-                    DLog(@"writer error appending audio (%@)", _assetWriter.error);
-                }
-            }
+            _audioTimestamp = timestamp;
         }
+        return PBJMediaWriterAppendResultAppended;
+    }
 
+    return PBJMediaWriterAppendResultFailed;
+}
+
+- (PBJMediaWriterAppendResult)_appendFragmentedSampleBuffer:(CMSampleBufferRef)sampleBuffer withMediaTypeVideo:(BOOL)video
+{
+    // encoding is asynchronous, there is no back pressure to wait on
+    uint64_t appendStart = _instrumentation ? PBJInstrumentationNow() : 0;
+    if (![_fragmentedWriter appendSampleBuffer:sampleBuffer withMediaTypeVideo:video]) {
+        DLog(@"writer error appending %@ (%@)", video ? @"video" : @"audio", _fragmentedWriter.error);
+        return PBJMediaWriterAppendResultFailed;
+    }
+    PBJInstrumentationRecordSince(_instrumentation, PBJInstrumentationStageAppend, appendStart);
+
+    CMTime timestamp = CMSampleBufferGetPresentationTimeStamp(sampleBuffer);
+    CMTime duration = CMSampleBufferGetDuration(sampleBuffer);
+    if (duration.value > 0) {
+        timestamp = CMTimeAdd(timestamp, duration);
+    }
+    if (video) {
+        _videoTimestamp = timestamp;
+    } else {
+        _audioTimestamp = timestamp;
     }
+    return PBJMediaWriterAppendResultAppended;
 }
 
 - (void)finishWritingWithCompletionHandler:(void (^)(void))handler
 {
-    if (_assetWriter.status == AVAssetWriterStatusUnknown ||
-        _assetWriter.status == AVAssetWriterStatusCompleted) {
-        DLog(@"asset writer was in an unexpected state (%@)", @(_assetWriter.status));
-        return;
-    }
-    [_assetWriterVideoInput markAsFinished];
-    [_assetWriterAudioInput markAsFinished];
-    [_assetWriter finishWritingWithCompletionHandler:handler];
+    dispatch_async(_writerQueue, ^{
+        [self _flushQueues];
+
+        if (self->_fragmentedWriter) {
+            // only the open fragment is left to write, everything before it is already on disk
+            [self->_fragmentedWriter finishWriting];
+            if (handler) {
+                handler();
+            }
+            return;
+        }
+
+        if (self->_assetWriter.status == AVAssetWriterStatusUnknown ||
+            self->_assetWriter.status == AVAssetWriterStatusCompleted) {
+            // nothing to finish, the caller is still waiting on its handler to tear down
+            DLog(@"asset writer was in an unexpected state (%@)", @(self->_assetWriter.status));
+            if (handler) {
+                handler();
+            }
+            return;
+        }
+        [self->_assetWriterVideoInput markAsFinished];
+        [self->_assetWriterAudioInput markAsFinished];
+        [self->_assetWriter finishWritingWithCompletionHandler:handler];
+    });
 }
 
 
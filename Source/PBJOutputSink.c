@@ -0,0 +1,467 @@
+//
+//  PBJOutputSink.c
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#if defined(__linux__)
+#   define _GNU_SOURCE
+#endif
+
+#include "PBJOutputSink.h"
+#include "PBJInstrumentation.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define PBJOutputSinkDefaultBatchBytes (1024 * 1024)
+#define PBJOutputSinkDefaultBatchCount 4
+
+typedef enum {
+    PBJOutputSinkKindFile = 0,
+    PBJOutputSinkKindMemory
+} PBJOutputSinkKind;
+
+// a run of the file starting at an aligned offset, batches are used in ring order
+typedef struct {
+    uint8_t *bytes;
+    uint64_t offset;
+    size_t length;
+    int sync;
+} PBJOutputBatch;
+
+struct PBJOutputSink {
+    PBJOutputSinkKind kind;
+    PBJOutputSinkConfiguration configuration;
+    int finished;
+    _Atomic(int) failed;
+    uint64_t bytesWritten;
+
+    // memory
+    uint8_t *memory;
+    size_t memoryCapacity;
+
+    // file, the producer owns the batch at fillIndex, the I/O thread takes pending batches from ioIndex
+    int fileDescriptor;
+    PBJOutputBatch *batches;
+    size_t fillIndex;
+    uint64_t nextSyncPosition;
+    pthread_t thread;
+    int threadStarted;
+    pthread_mutex_t mutex;
+    pthread_cond_t submittedCondition;
+    pthread_cond_t completedCondition;
+    size_t ioIndex; // guarded by mutex
+    size_t pendingCount; // guarded by mutex
+    int stopping; // guarded by mutex
+
+    uint64_t preallocatedBytes;
+    _Atomic(uint64_t) bytesStored;
+    _Atomic(uint64_t) writeCalls;
+    _Atomic(uint64_t) syncCalls;
+    uint64_t producerWaits;
+    uint64_t producerWaitNanoseconds;
+};
+
+PBJOutputSinkConfiguration PBJOutputSinkDefaultConfiguration(void)
+{
+    PBJOutputSinkConfiguration configuration;
+    configuration.preallocationBytes = 0;
+    configuration.batchBytes = PBJOutputSinkDefaultBatchBytes;
+    configuration.batchCount = PBJOutputSinkDefaultBatchCount;
+    configuration.durability = PBJOutputSinkDurabilityFinish;
+    configuration.durabilityBytes = 0;
+    return configuration;
+}
+
+#pragma mark - I/O thread
+
+static int PBJOutputSinkWriteFully(PBJOutputSink *sink, const uint8_t *bytes, size_t length, uint64_t offset)
+{
+    while (length > 0) {
+        ssize_t written = pwrite(sink->fileDescriptor, bytes, length, (off_t)offset);
+        atomic_fetch_add_explicit(&sink->writeCalls, 1, memory_order_relaxed);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            return 0;
+        }
+        bytes += written;
+        length -= (size_t)written;
+        offset += (uint64_t)written;
+    }
+    return 1;
+}
+
+static void *PBJOutputSinkThread(void *context)
+{
+    PBJOutputSink *sink = (PBJOutputSink *)context;
+    for (;;) {
+        pthread_mutex_lock(&sink->mutex);
+        while (sink->pendingCount == 0 && !sink->stopping) {
+            pthread_cond_wait(&sink->submittedCondition, &sink->mutex);
+        }
+        if (sink->pendingCount == 0) {
+            pthread_mutex_unlock(&sink->mutex);
+            break;
+        }
+        PBJOutputBatch *batch = &sink->batches[sink->ioIndex];
+        pthread_mutex_unlock(&sink->mutex);
+
+        // after a failure batches are still retired so the producer never waits forever
+        if (!atomic_load_explicit(&sink->failed, memory_order_relaxed)) {
+            int succeeded = PBJOutputSinkWriteFully(sink, batch->bytes, batch->length, batch->offset);
+            if (succeeded && batch->sync) {
+                succeeded = fsync(sink->fileDescriptor) == 0;
+                atomic_fetch_add_explicit(&sink->syncCalls, 1, memory_order_relaxed);
+            }
+            if (succeeded) {
+                uint64_t end = batch->offset + batch->length;
+                if (end > atomic_load_explicit(&sink->bytesStored, memory_order_relaxed))
+                    atomic_store_explicit(&sink->bytesStored, end, memory_order_relaxed);
+            } else {
+                atomic_store_explicit(&sink->failed, 1, memory_order_relaxed);
+            }
+        }
+
+        pthread_mutex_lock(&sink->mutex);
+        sink->ioIndex = (sink->ioIndex + 1) % sink->configuration.batchCount;
+        sink->pendingCount--;
+        pthread_cond_signal(&sink->completedCondition);
+        pthread_mutex_unlock(&sink->mutex);
+    }
+    return NULL;
+}
+
+#pragma mark - batches
+
+static void PBJOutputSinkWaitForPending(PBJOutputSink *sink, size_t maximumPending)
+{
+    pthread_mutex_lock(&sink->mutex);
+    if (sink->pendingCount > maximumPending) {
+        uint64_t start = PBJInstrumentationNow();
+        while (sink->pendingCount > maximumPending) {
+            pthread_cond_wait(&sink->completedCondition, &sink->mutex);
+        }
+        sink->producerWaits++;
+        sink->producerWaitNanoseconds += PBJInstrumentationNow() - start;
+    }
+    pthread_mutex_unlock(&sink->mutex);
+}
+
+// hands the filling batch to the I/O thread and starts the next one where it left off. a partial
+// batch carries its unaligned tail over, so the next write lands on an aligned offset again and
+// rewrites those few bytes
+static void PBJOutputSinkSubmitBatch(PBJOutputSink *sink, int sync, int continues)
+{
+    size_t batchCount = sink->configuration.batchCount;
+    PBJOutputBatch *batch = &sink->batches[sink->fillIndex];
+    batch->sync = sync;
+
+    pthread_mutex_lock(&sink->mutex);
+    sink->pendingCount++;
+    pthread_cond_signal(&sink->submittedCondition);
+    pthread_mutex_unlock(&sink->mutex);
+
+    if (!continues)
+        return;
+
+    // the next batch in ring order is the oldest, free once at most batchCount - 1 are pending
+    PBJOutputSinkWaitForPending(sink, batchCount - 1);
+    sink->fillIndex = (sink->fillIndex + 1) % batchCount;
+    PBJOutputBatch *next = &sink->batches[sink->fillIndex];
+    size_t aligned = batch->length & ~(size_t)(PBJOutputSinkAlignment - 1);
+    next->offset = batch->offset + aligned;
+    next->length = batch->length - aligned;
+    memcpy(next->bytes, batch->bytes + aligned, next->length);
+}
+
+static int PBJOutputSinkShouldSync(PBJOutputSink *sink)
+{
+    if (sink->configuration.durability != PBJOutputSinkDurabilityBytes || sink->bytesWritten < sink->nextSyncPosition)
+        return 0;
+    // stays on a grid of durabilityBytes so batch granularity never stretches the interval
+    uint64_t interval = sink->configuration.durabilityBytes;
+    sink->nextSyncPosition = (sink->bytesWritten / interval + 1) * interval;
+    return 1;
+}
+
+#pragma mark - create
+
+static uint64_t PBJOutputSinkPreallocate(int fileDescriptor, uint64_t length)
+{
+    if (length == 0)
+        return 0;
+#if defined(__APPLE__)
+    // contiguous if the volume can, blocks past the end of the file are released on close
+    fstore_t store = { F_ALLOCATECONTIG | F_ALLOCATEALL, F_PEOFPOSMODE, 0, (off_t)length, 0 };
+    if (fcntl(fileDescriptor, F_PREALLOCATE, &store) == -1) {
+        store.fst_flags = F_ALLOCATEALL;
+        if (fcntl(fileDescriptor, F_PREALLOCATE, &store) == -1)
+            return 0;
+    }
+    return (uint64_t)store.fst_bytesalloc;
+#elif defined(__linux__)
+    return fallocate(fileDescriptor, FALLOC_FL_KEEP_SIZE, 0, (off_t)length) == 0 ? length : 0;
+#else
+    return 0;
+#endif
+}
+
+PBJOutputSink *PBJOutputSinkCreateFile(const char *path, const PBJOutputSinkConfiguration *configuration)
+{
+    if (!path || !configuration)
+        return NULL;
+
+    PBJOutputSink *sink = (PBJOutputSink *)calloc(1, sizeof(PBJOutputSink));
+    if (!sink)
+        return NULL;
+
+    sink->kind = PBJOutputSinkKindFile;
+    sink->configuration = *configuration;
+    size_t batchBytes = configuration->batchBytes > 0 ? configuration->batchBytes : PBJOutputSinkDefaultBatchBytes;
+    sink->configuration.batchBytes = (batchBytes + PBJOutputSinkAlignment - 1) & ~(size_t)(PBJOutputSinkAlignment - 1);
+    sink->configuration.batchCount = configuration->batchCount >= 2 ? configuration->batchCount : 2;
+    if (sink->configuration.durability == PBJOutputSinkDurabilityBytes && sink->configuration.durabilityBytes == 0)
+        sink->configuration.durability = PBJOutputSinkDurabilityFinish;
+    sink->nextSyncPosition = sink->configuration.durabilityBytes;
+    atomic_init(&sink->failed, 0);
+    atomic_init(&sink->bytesStored, 0);
+    atomic_init(&sink->writeCalls, 0);
+    atomic_init(&sink->syncCalls, 0);
+
+    sink->fileDescriptor = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    sink->batches = (PBJOutputBatch *)calloc(sink->configuration.batchCount, sizeof(PBJOutputBatch));
+    if (sink->fileDescriptor < 0 || !sink->batches) {
+        PBJOutputSinkDestroy(sink);
+        return NULL;
+    }
+    for (size_t i = 0; i < sink->configuration.batchCount; i++) {
+        void *bytes = NULL;
+        if (posix_memalign(&bytes, PBJOutputSinkAlignment, sink->configuration.batchBytes) != 0) {
+            PBJOutputSinkDestroy(sink);
+            return NULL;
+        }
+        sink->batches[i].bytes = (uint8_t *)bytes;
+    }
+
+    sink->preallocatedBytes = PBJOutputSinkPreallocate(sink->fileDescriptor, configuration->preallocationBytes);
+
+    pthread_mutex_init(&sink->mutex, NULL);
+    pthread_cond_init(&sink->submittedCondition, NULL);
+    pthread_cond_init(&sink->completedCondition, NULL);
+    if (pthread_create(&sink->thread, NULL, PBJOutputSinkThread, sink) != 0) {
+        pthread_cond_destroy(&sink->completedCondition);
+        pthread_cond_destroy(&sink->submittedCondition);
+        pthread_mutex_destroy(&sink->mutex);
+        PBJOutputSinkDestroy(sink);
+        return NULL;
+    }
+    sink->threadStarted = 1;
+    return sink;
+}
+
+PBJOutputSink *PBJOutputSinkCreateMemory(void)
+{
+    PBJOutputSink *sink = (PBJOutputSink *)calloc(1, sizeof(PBJOutputSink));
+    if (!sink)
+        return NULL;
+
+    sink->kind = PBJOutputSinkKindMemory;
+    sink->configuration = PBJOutputSinkDefaultConfiguration();
+    sink->fileDescriptor = -1;
+    atomic_init(&sink->failed, 0);
+    atomic_init(&sink->bytesStored, 0);
+    atomic_init(&sink->writeCalls, 0);
+    atomic_init(&sink->syncCalls, 0);
+    return sink;
+}
+
+static void PBJOutputSinkStopThread(PBJOutputSink *sink)
+{
+    if (!sink->threadStarted)
+        return;
+
+    pthread_mutex_lock(&sink->mutex);
+    sink->stopping = 1;
+    pthread_cond_signal(&sink->submittedCondition);
+    pthread_mutex_unlock(&sink->mutex);
+    pthread_join(sink->thread, NULL);
+    sink->threadStarted = 0;
+
+    pthread_cond_destroy(&sink->completedCondition);
+    pthread_cond_destroy(&sink->submittedCondition);
+    pthread_mutex_destroy(&sink->mutex);
+}
+
+void PBJOutputSinkDestroy(PBJOutputSink *sink)
+{
+    if (!sink)
+        return;
+
+    PBJOutputSinkStopThread(sink);
+    if (sink->kind == PBJOutputSinkKindFile && sink->fileDescriptor >= 0)
+        close(sink->fileDescriptor);
+    if (sink->batches) {
+        for (size_t i = 0; i < sink->configuration.batchCount; i++) {
+            free(sink->batches[i].bytes);
+        }
+        free(sink->batches);
+    }
+    free(sink->memory);
+    free(sink);
+}
+
+#pragma mark - writing
+
+static int PBJOutputSinkWriteMemory(PBJOutputSink *sink, const void *bytes, size_t length)
+{
+    if (sink->bytesWritten + length > sink->memoryCapacity) {
+        size_t capacity = sink->memoryCapacity > 0 ? sink->memoryCapacity : 64 * 1024;
+        while (capacity < sink->bytesWritten + length) {
+            capacity *= 2;
+        }
+        uint8_t *memory = (uint8_t *)realloc(sink->memory, capacity);
+        if (!memory) {
+            atomic_store_explicit(&sink->failed, 1, memory_order_relaxed);
+            return 0;
+        }
+        sink->memory = memory;
+        sink->memoryCapacity = capacity;
+    }
+    memcpy(sink->memory + sink->bytesWritten, bytes, length);
+    sink->bytesWritten += length;
+    atomic_store_explicit(&sink->bytesStored, sink->bytesWritten, memory_order_relaxed);
+    return 1;
+}
+
+int PBJOutputSinkWrite(PBJOutputSink *sink, const void *bytes, size_t length)
+{
+    if (!sink || sink->finished || atomic_load_explicit(&sink->failed, memory_order_relaxed))
+        return 0;
+    if (length == 0)
+        return 1;
+    if (sink->kind == PBJOutputSinkKindMemory)
+        return PBJOutputSinkWriteMemory(sink, bytes, length);
+
+    const uint8_t *cursor = (const uint8_t *)bytes;
+    size_t batchBytes = sink->configuration.batchBytes;
+    while (length > 0) {
+        PBJOutputBatch *batch = &sink->batches[sink->fillIndex];
+        size_t count = batchBytes - batch->length;
+        if (count > length)
+            count = length;
+        memcpy(batch->bytes + batch->length, cursor, count);
+        batch->length += count;
+        sink->bytesWritten += count;
+        cursor += count;
+        length -= count;
+
+        if (batch->length == batchBytes) {
+            PBJOutputSinkSubmitBatch(sink, PBJOutputSinkShouldSync(sink), 1);
+        }
+    }
+    return !atomic_load_explicit(&sink->failed, memory_order_relaxed);
+}
+
+int PBJOutputSinkWriteFunction(void *context, const void *bytes, size_t length)
+{
+    return PBJOutputSinkWrite((PBJOutputSink *)context, bytes, length);
+}
+
+int PBJOutputSinkEndFragment(PBJOutputSink *sink)
+{
+    if (!sink || sink->finished)
+        return 0;
+    if (sink->kind == PBJOutputSinkKindMemory)
+        return !atomic_load_explicit(&sink->failed, memory_order_relaxed);
+
+    int sync = sink->configuration.durability == PBJOutputSinkDurabilityFragment || PBJOutputSinkShouldSync(sink);
+    PBJOutputBatch *batch = &sink->batches[sink->fillIndex];
+    if (batch->length > 0 || sync) {
+        PBJOutputSinkSubmitBatch(sink, sync, 1);
+    }
+    return !atomic_load_explicit(&sink->failed, memory_order_relaxed);
+}
+
+int PBJOutputSinkFinish(PBJOutputSink *sink)
+{
+    if (!sink || sink->finished)
+        return 0;
+    sink->finished = 1;
+    if (sink->kind == PBJOutputSinkKindMemory)
+        return !atomic_load_explicit(&sink->failed, memory_order_relaxed);
+
+    PBJOutputSinkSubmitBatch(sink, 1, 0);
+    PBJOutputSinkStopThread(sink);
+
+    int succeeded = !atomic_load_explicit(&sink->failed, memory_order_relaxed);
+    if (succeeded && sink->preallocatedBytes > 0) {
+        // hands back whatever the recording didn't use
+        succeeded = ftruncate(sink->fileDescriptor, (off_t)sink->bytesWritten) == 0;
+    }
+    if (close(sink->fileDescriptor) != 0)
+        succeeded = 0;
+    sink->fileDescriptor = -1;
+    if (!succeeded)
+        atomic_store_explicit(&sink->failed, 1, memory_order_relaxed);
+    return succeeded;
+}
+
+int PBJOutputSinkHasFailed(const PBJOutputSink *sink)
+{
+    return !sink || atomic_load_explicit(&sink->failed, memory_order_relaxed);
+}
+
+void PBJOutputSinkGetStatistics(const PBJOutputSink *sink, PBJOutputSinkStatistics *statistics)
+{
+    if (!statistics)
+        return;
+    memset(statistics, 0, sizeof(PBJOutputSinkStatistics));
+    if (!sink)
+        return;
+
+    statistics->bytesWritten = sink->bytesWritten;
+    statistics->bytesStored = atomic_load_explicit(&sink->bytesStored, memory_order_relaxed);
+    statistics->preallocatedBytes = sink->preallocatedBytes;
+    statistics->writeCalls = atomic_load_explicit(&sink->writeCalls, memory_order_relaxed);
+    statistics->syncCalls = atomic_load_explicit(&sink->syncCalls, memory_order_relaxed);
+    statistics->producerWaits = sink->producerWaits;
+    statistics->producerWaitNanoseconds = sink->producerWaitNanoseconds;
+}
+
+const uint8_t *PBJOutputSinkGetMemoryBytes(const PBJOutputSink *sink, size_t *length)
+{
+    if (!sink || sink->kind != PBJOutputSinkKindMemory) {
+        if (length)
+            *length = 0;
+        return NULL;
+    }
+    if (length)
+        *length = (size_t)sink->bytesWritten;
+    return sink->memory;
+}
@@ -0,0 +1,102 @@
+//
+//  PBJOutputSink.h
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#ifndef PBJOutputSink_h
+#define PBJOutputSink_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// where a muxer's bytes go. the file sink preallocates the file, coalesces writes into large
+// batches at aligned offsets and hands them to its own I/O thread, so the producer only copies.
+// the end of each fragment is written out straight away, a crash of the app loses at most the
+// open fragment, when the file is synced for a crash of the system is up to the durability
+// policy. the memory sink keeps everything in one buffer, for tests. single producer
+
+#define PBJOutputSinkAlignment 4096
+
+typedef enum {
+    PBJOutputSinkDurabilityFinish = 0, // synced once, when the sink finishes
+    PBJOutputSinkDurabilityFragment, // after every fragment
+    PBJOutputSinkDurabilityBytes // whenever another durabilityBytes have been written
+} PBJOutputSinkDurability;
+
+typedef struct {
+    uint64_t preallocationBytes; // reserved up front, best effort, 0 for none
+    size_t batchBytes; // rounded up to the alignment
+    size_t batchCount; // in flight between the producer and the I/O thread, at least 2
+    PBJOutputSinkDurability durability;
+    uint64_t durabilityBytes;
+} PBJOutputSinkConfiguration;
+
+typedef struct {
+    uint64_t bytesWritten; // taken from the producer
+    uint64_t bytesStored; // reached the file
+    uint64_t preallocatedBytes;
+    uint64_t writeCalls;
+    uint64_t syncCalls;
+    uint64_t producerWaits; // writes that waited on the I/O thread for a free batch
+    uint64_t producerWaitNanoseconds;
+} PBJOutputSinkStatistics;
+
+typedef struct PBJOutputSink PBJOutputSink;
+
+// 1 MB batches, four in flight, synced when finished
+PBJOutputSinkConfiguration PBJOutputSinkDefaultConfiguration(void);
+
+// creates or truncates the file
+PBJOutputSink *PBJOutputSinkCreateFile(const char *path, const PBJOutputSinkConfiguration *configuration);
+PBJOutputSink *PBJOutputSinkCreateMemory(void);
+
+// a file sink that wasn't finished is drained and closed without a sync
+void PBJOutputSinkDestroy(PBJOutputSink *sink);
+
+// returns 0 once anything has failed
+int PBJOutputSinkWrite(PBJOutputSink *sink, const void *bytes, size_t length);
+
+// PBJOutputSinkWrite with the sink as context, for PBJFragmentedMP4WriteFunction
+int PBJOutputSinkWriteFunction(void *context, const void *bytes, size_t length);
+
+// a fragment is complete, it is written out and synced as the policy asks
+int PBJOutputSinkEndFragment(PBJOutputSink *sink);
+
+// writes and syncs everything, releases unused preallocation and closes the file
+int PBJOutputSinkFinish(PBJOutputSink *sink);
+
+int PBJOutputSinkHasFailed(const PBJOutputSink *sink);
+void PBJOutputSinkGetStatistics(const PBJOutputSink *sink, PBJOutputSinkStatistics *statistics);
+
+// memory sinks only, valid until the next write
+const uint8_t *PBJOutputSinkGetMemoryBytes(const PBJOutputSink *sink, size_t *length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PBJOutputSink_h */
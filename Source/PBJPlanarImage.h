@@ -0,0 +1,67 @@
+//
+//  PBJPlanarImage.h
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef PBJPlanarImage_h
+#define PBJPlanarImage_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// portable description of a bi-planar Y'CbCr 4:2:0 image (NV12, CoreVideo's 420f/420v),
+// the planes are borrowed, nothing here owns memory
+
+typedef enum {
+    PBJYCbCrRangeFull = 0,  // luma=[0,255] chroma=[1,255]
+    PBJYCbCrRangeVideo      // luma=[16,235] chroma=[16,240]
+} PBJYCbCrRange;
+
+typedef struct {
+    uint8_t *luma;
+    size_t lumaBytesPerRow;
+    uint8_t *chroma; // interleaved CbCr, ceil(width / 2) pairs by ceil(height / 2) rows
+    size_t chromaBytesPerRow;
+    size_t width;
+    size_t height;
+    PBJYCbCrRange range;
+} PBJNV12Image;
+
+static inline size_t PBJNV12ChromaWidth(const PBJNV12Image *image)
+{
+    return (image->width + 1) >> 1;
+}
+
+static inline size_t PBJNV12ChromaHeight(const PBJNV12Image *image)
+{
+    return (image->height + 1) >> 1;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PBJPlanarImage_h */
@@ -0,0 +1,64 @@
+//
+//  PBJPrerollBuffer.h
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#import <Foundation/Foundation.h>
+#import <AVFoundation/AVFoundation.h>
+
+#import "PBJPrerollRing.h"
+
+// compresses video while previewing and keeps the last few seconds of it, with the captured
+// audio, inside a fixed memory budget. a recording seeded from it starts in the past, and
+// the encoder keeps running into the recording so the stream has no seam
+@interface PBJPrerollBuffer : NSObject
+
+- (instancetype)initWithDuration:(CMTime)duration memoryBudget:(NSUInteger)memoryBudget videoSettings:(NSDictionary *)videoSettings;
+
+@property (nonatomic, readonly) CMTime duration;
+@property (nonatomic, readonly) NSUInteger memoryBudget;
+@property (nonatomic, readonly) NSDictionary *videoSettings;
+
+@property (nonatomic, readonly) PBJPrerollRingCounters counters;
+@property (nonatomic, readonly, getter=isForwarding) BOOL forwarding;
+
+// the encoder's average bit rate from the next frame, 0 for the one in the video settings,
+// set from the queue that appends
+@property (nonatomic) double videoBitRate;
+
+// call from a single queue, video sample buffers carry pixel buffers matching the video settings
+- (BOOL)appendVideoSampleBuffer:(CMSampleBufferRef)sampleBuffer;
+- (void)appendAudioSampleBuffer:(CMSampleBufferRef)sampleBuffer;
+
+// hands over everything held in presentation order, starting on a keyframe, then passes each
+// newly encoded video frame to forwarder until forwarding stops. handlers must retain what they keep
+- (void)drainToHandler:(void (^)(CMSampleBufferRef sampleBuffer, BOOL video))handler
+      forwardingVideoTo:(void (^)(CMSampleBufferRef sampleBuffer))forwarder;
+
+// waits for frames still in the encoder
+- (void)completeFrames;
+- (void)stopForwarding;
+
+- (void)reset;
+- (void)invalidate;
+
+@end
@@ -0,0 +1,276 @@
+//
+//  PBJPrerollBuffer.m
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#import "PBJPrerollBuffer.h"
+#import "PBJVisionUtilities.h"
+
+#import <VideoToolbox/VideoToolbox.h>
+
+#include <os/lock.h>
+
+// enough slots for the window at high frame rates, the byte budget is what normally binds
+static size_t const PBJPrerollBufferMinimumCapacity = 64;
+static double const PBJPrerollBufferSlotsPerSecond = 120.0;
+
+@interface PBJPrerollBuffer ()
+{
+    CMTime _duration;
+    NSUInteger _memoryBudget;
+    NSDictionary *_videoSettings;
+
+    VTCompressionSessionRef _compressionSession;
+    BOOL _forceKeyframe;
+    double _videoBitRate;
+
+    // the ring and forwarder are shared with the compression callback
+    os_unfair_lock _lock;
+    PBJPrerollRing *_ring;
+    void (^_forwarder)(CMSampleBufferRef sampleBuffer);
+}
+
+- (void)_didEncodeSampleBuffer:(CMSampleBufferRef)sampleBuffer;
+
+@end
+
+@implementation PBJPrerollBuffer
+
+@synthesize duration = _duration;
+@synthesize memoryBudget = _memoryBudget;
+@synthesize videoSettings = _videoSettings;
+@synthesize videoBitRate = _videoBitRate;
+
+static void PBJPrerollBufferRelease(void *context, void *payload)
+{
+    CFRelease((CMSampleBufferRef)payload);
+}
+
+static void PBJPrerollBufferCompressionOutput(void *outputCallbackRefCon, void *sourceFrameRefCon, OSStatus status,
+                                              VTEncodeInfoFlags infoFlags, CMSampleBufferRef sampleBuffer)
+{
+    if (status != noErr || !sampleBuffer || (infoFlags & kVTEncodeInfo_FrameDropped))
+        return;
+
+    PBJPrerollBuffer *prerollBuffer = (__bridge PBJPrerollBuffer *)outputCallbackRefCon;
+    [prerollBuffer _didEncodeSampleBuffer:sampleBuffer];
+}
+
+#pragma mark - getters/setters
+
+- (PBJPrerollRingCounters)counters
+{
+    os_unfair_lock_lock(&_lock);
+    PBJPrerollRingCounters counters = PBJPrerollRingGetCounters(_ring);
+    os_unfair_lock_unlock(&_lock);
+    return counters;
+}
+
+- (BOOL)isForwarding
+{
+    os_unfair_lock_lock(&_lock);
+    BOOL forwarding = (_forwarder != nil);
+    os_unfair_lock_unlock(&_lock);
+    return forwarding;
+}
+
+#pragma mark - init
+
+- (instancetype)initWithDuration:(CMTime)duration memoryBudget:(NSUInteger)memoryBudget videoSettings:(NSDictionary *)videoSettings
+{
+    self = [super init];
+    if (self) {
+        _duration = duration;
+        _memoryBudget = memoryBudget;
+        _videoSettings = [videoSettings copy];
+        _lock = OS_UNFAIR_LOCK_INIT;
+
+        double seconds = CMTIME_IS_NUMERIC(duration) ? CMTimeGetSeconds(duration) : 0;
+        PBJPrerollRingConfiguration configuration;
+        configuration.duration = CMTIME_IS_NUMERIC(duration) ? PBJTimeMake(duration.value, duration.timescale) : PBJTimeMake(0, 0);
+        configuration.memoryBudget = memoryBudget;
+        configuration.capacity = MAX((size_t)(seconds * PBJPrerollBufferSlotsPerSecond), PBJPrerollBufferMinimumCapacity);
+        _ring = PBJPrerollRingCreate(&configuration, PBJPrerollBufferRelease, NULL);
+
+        _compressionSession = [PBJVisionUtilities createCompressionSessionWithVideoSettings:videoSettings
+                                                                            outputCallback:PBJPrerollBufferCompressionOutput
+                                                                                    refcon:(__bridge void *)self];
+        if (!_ring || !_compressionSession) {
+            [self invalidate];
+            return nil;
+        }
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    [self invalidate];
+}
+
+- (void)invalidate
+{
+    if (_compressionSession) {
+        VTCompressionSessionInvalidate(_compressionSession);
+        CFRelease(_compressionSession);
+        _compressionSession = NULL;
+    }
+
+    os_unfair_lock_lock(&_lock);
+    _forwarder = nil;
+    PBJPrerollRingDestroy(_ring);
+    _ring = NULL;
+    os_unfair_lock_unlock(&_lock);
+}
+
+- (void)reset
+{
+    os_unfair_lock_lock(&_lock);
+    PBJPrerollRingClear(_ring);
+    os_unfair_lock_unlock(&_lock);
+    _forceKeyframe = YES;
+}
+
+- (void)setVideoBitRate:(double)videoBitRate
+{
+    if (videoBitRate == _videoBitRate)
+        return;
+    _videoBitRate = videoBitRate;
+
+    NSNumber *bitRate = videoBitRate > 0 ? @(videoBitRate) : _videoSettings[AVVideoCompressionPropertiesKey][AVVideoAverageBitRateKey];
+    if (_compressionSession && bitRate) {
+        VTSessionSetProperty(_compressionSession, kVTCompressionPropertyKey_AverageBitRate, (__bridge CFTypeRef)bitRate);
+    }
+}
+
+#pragma mark - samples
+
+- (BOOL)appendVideoSampleBuffer:(CMSampleBufferRef)sampleBuffer
+{
+    CVImageBufferRef imageBuffer = CMSampleBufferGetImageBuffer(sampleBuffer);
+    if (!_compressionSession || !imageBuffer)
+        return NO;
+
+    NSDictionary *frameProperties = nil;
+    if (_forceKeyframe) {
+        frameProperties = @{ (id)kVTEncodeFrameOptionKey_ForceKeyFrame : @YES };
+        _forceKeyframe = NO;
+    }
+
+    OSStatus status = VTCompressionSessionEncodeFrame(_compressionSession, imageBuffer,
+                                                      CMSampleBufferGetPresentationTimeStamp(sampleBuffer),
+                                                      CMSampleBufferGetDuration(sampleBuffer),
+                                                      (__bridge CFDictionaryRef)frameProperties, NULL, NULL);
+    return status == noErr;
+}
+
+- (void)_didEncodeSampleBuffer:(CMSampleBufferRef)sampleBuffer
+{
+    os_unfair_lock_lock(&_lock);
+
+    if (_forwarder) {
+        _forwarder(sampleBuffer);
+        os_unfair_lock_unlock(&_lock);
+        return;
+    }
+
+    BOOL isKeyframe = YES;
+    CFArrayRef attachments = CMSampleBufferGetSampleAttachmentsArray(sampleBuffer, false);
+    if (attachments && CFArrayGetCount(attachments) > 0) {
+        CFDictionaryRef attachment = (CFDictionaryRef)CFArrayGetValueAtIndex(attachments, 0);
+        isKeyframe = !CFDictionaryContainsKey(attachment, kCMSampleAttachmentKey_NotSync);
+    }
+
+    CMTime presentationTime = CMSampleBufferGetPresentationTimeStamp(sampleBuffer);
+    CMTime duration = CMSampleBufferGetDuration(sampleBuffer);
+
+    PBJPrerollItem item;
+    item.track = PBJCaptureTrackVideo;
+    item.presentationTimestamp = PBJTimeMake(presentationTime.value, presentationTime.timescale);
+    item.duration = CMTIME_IS_NUMERIC(duration) ? PBJTimeMake(duration.value, duration.timescale) : PBJTimeMake(0, 0);
+    item.size = CMSampleBufferGetTotalSampleSize(sampleBuffer);
+    item.isKeyframe = isKeyframe;
+    item.payload = (void *)CFRetain(sampleBuffer);
+    PBJPrerollRingPush(_ring, &item);
+
+    os_unfair_lock_unlock(&_lock);
+}
+
+- (void)appendAudioSampleBuffer:(CMSampleBufferRef)sampleBuffer
+{
+    CMTime presentationTime = CMSampleBufferGetPresentationTimeStamp(sampleBuffer);
+    CMTime duration = CMSampleBufferGetDuration(sampleBuffer);
+    CMBlockBufferRef blockBuffer = CMSampleBufferGetDataBuffer(sampleBuffer);
+    if (!CMTIME_IS_NUMERIC(presentationTime) || !blockBuffer)
+        return;
+
+    PBJPrerollItem item;
+    item.track = PBJCaptureTrackAudio;
+    item.presentationTimestamp = PBJTimeMake(presentationTime.value, presentationTime.timescale);
+    item.duration = CMTIME_IS_NUMERIC(duration) ? PBJTimeMake(duration.value, duration.timescale) : PBJTimeMake(0, 0);
+    item.size = CMBlockBufferGetDataLength(blockBuffer);
+    item.isKeyframe = 1;
+    item.payload = (void *)CFRetain(sampleBuffer);
+
+    os_unfair_lock_lock(&_lock);
+    PBJPrerollRingPush(_ring, &item);
+    os_unfair_lock_unlock(&_lock);
+}
+
+#pragma mark - recording
+
+static void PBJPrerollBufferDrain(void *context, const PBJPrerollItem *item)
+{
+    void (^handler)(CMSampleBufferRef sampleBuffer, BOOL video) = (__bridge void (^)(CMSampleBufferRef, BOOL))context;
+    CMSampleBufferRef sampleBuffer = (CMSampleBufferRef)item->payload;
+    handler(sampleBuffer, item->track == PBJCaptureTrackVideo);
+    CFRelease(sampleBuffer);
+}
+
+- (void)drainToHandler:(void (^)(CMSampleBufferRef sampleBuffer, BOOL video))handler
+      forwardingVideoTo:(void (^)(CMSampleBufferRef sampleBuffer))forwarder
+{
+    // held under the lock so no frame from the encoder slips between the two
+    os_unfair_lock_lock(&_lock);
+    PBJPrerollRingDrain(_ring, handler ? PBJPrerollBufferDrain : NULL, (__bridge void *)handler);
+    _forwarder = [forwarder copy];
+    os_unfair_lock_unlock(&_lock);
+}
+
+- (void)completeFrames
+{
+    if (_compressionSession) {
+        VTCompressionSessionCompleteFrames(_compressionSession, kCMTimeInvalid);
+    }
+}
+
+- (void)stopForwarding
+{
+    os_unfair_lock_lock(&_lock);
+    _forwarder = nil;
+    os_unfair_lock_unlock(&_lock);
+
+    // the ring only starts on a keyframe
+    _forceKeyframe = YES;
+}
+
+@end
@@ -0,0 +1,342 @@
+//
+//  PBJPrerollRing.c
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include "PBJPrerollRing.h"
+
+#include <stdlib.h>
+
+// each track is a circular array allocated up front, pushes never allocate.
+// timestamps are converted to nanoseconds once so the tracks compare directly
+
+typedef struct {
+    PBJPrerollItem item;
+    int64_t time;
+    int64_t end;
+} PBJPrerollEntry;
+
+typedef struct {
+    PBJPrerollEntry *entries;
+    size_t head;
+    size_t count;
+    uint64_t evicted;
+} PBJPrerollQueue;
+
+struct PBJPrerollRing {
+    PBJPrerollQueue queues[PBJCaptureTrackCount];
+    size_t capacity;
+    size_t memoryBudget;
+    int64_t duration; // nanoseconds, 0 for no limit
+    size_t bytes;
+    size_t keyframes;
+    int awaitingKeyframe;
+    uint64_t rejected;
+    PBJPrerollRingReleaseFunction release;
+    void *releaseContext;
+};
+
+static inline PBJPrerollEntry *PBJPrerollQueueAt(const PBJPrerollRing *ring, const PBJPrerollQueue *queue, size_t index)
+{
+    return &queue->entries[(queue->head + index) % ring->capacity];
+}
+
+static void PBJPrerollReleasePayload(PBJPrerollRing *ring, void *payload)
+{
+    if (ring->release && payload) {
+        ring->release(ring->releaseContext, payload);
+    }
+}
+
+static void PBJPrerollQueuePopFront(PBJPrerollRing *ring, PBJPrerollQueue *queue, int releasePayload)
+{
+    PBJPrerollEntry *entry = &queue->entries[queue->head];
+    ring->bytes -= entry->item.size;
+    if (entry->item.track == PBJCaptureTrackVideo && entry->item.isKeyframe) {
+        ring->keyframes--;
+    }
+    if (releasePayload) {
+        PBJPrerollReleasePayload(ring, entry->item.payload);
+        queue->evicted++;
+    }
+    entry->item.payload = NULL;
+    queue->head = (queue->head + 1) % ring->capacity;
+    queue->count--;
+}
+
+#pragma mark - eviction
+
+// drops audio that ends before the first kept keyframe, it could never be written
+static void PBJPrerollEvictLeadingAudio(PBJPrerollRing *ring)
+{
+    PBJPrerollQueue *video = &ring->queues[PBJCaptureTrackVideo];
+    PBJPrerollQueue *audio = &ring->queues[PBJCaptureTrackAudio];
+    if (video->count == 0)
+        return;
+
+    int64_t start = PBJPrerollQueueAt(ring, video, 0)->time;
+    while (audio->count > 0 && PBJPrerollQueueAt(ring, audio, 0)->end <= start) {
+        PBJPrerollQueuePopFront(ring, audio, 1);
+    }
+}
+
+// drops video up to the next keyframe, or all of it when only one GOP is held
+static void PBJPrerollEvictGOP(PBJPrerollRing *ring)
+{
+    PBJPrerollQueue *video = &ring->queues[PBJCaptureTrackVideo];
+    if (video->count == 0)
+        return;
+
+    if (ring->keyframes < 2) {
+        while (video->count > 0) {
+            PBJPrerollQueuePopFront(ring, video, 1);
+        }
+        ring->awaitingKeyframe = 1;
+        return;
+    }
+
+    do {
+        PBJPrerollQueuePopFront(ring, video, 1);
+    } while (video->count > 0 && !PBJPrerollQueueAt(ring, video, 0)->item.isKeyframe);
+
+    PBJPrerollEvictLeadingAudio(ring);
+}
+
+static int64_t PBJPrerollSecondKeyframeTime(const PBJPrerollRing *ring)
+{
+    const PBJPrerollQueue *video = &ring->queues[PBJCaptureTrackVideo];
+    for (size_t i = 1; i < video->count; i++) {
+        const PBJPrerollEntry *entry = PBJPrerollQueueAt(ring, video, i);
+        if (entry->item.isKeyframe)
+            return entry->time;
+    }
+    return INT64_MAX;
+}
+
+static void PBJPrerollTrim(PBJPrerollRing *ring)
+{
+    PBJPrerollQueue *video = &ring->queues[PBJCaptureTrackVideo];
+    PBJPrerollQueue *audio = &ring->queues[PBJCaptureTrackAudio];
+
+    // window, a GOP goes once the rest still covers the duration
+    if (ring->duration > 0) {
+        while (ring->keyframes >= 2) {
+            int64_t newest = PBJPrerollQueueAt(ring, video, video->count - 1)->end;
+            if (newest - PBJPrerollSecondKeyframeTime(ring) < ring->duration)
+                break;
+            PBJPrerollEvictGOP(ring);
+        }
+        if (video->count == 0) {
+            while (audio->count > 1) {
+                int64_t newest = PBJPrerollQueueAt(ring, audio, audio->count - 1)->end;
+                if (newest - PBJPrerollQueueAt(ring, audio, 1)->time < ring->duration)
+                    break;
+                PBJPrerollQueuePopFront(ring, audio, 1);
+            }
+        }
+    }
+
+    // budget, oldest first across both tracks
+    while (ring->bytes > ring->memoryBudget) {
+        int64_t videoStart = video->count > 0 ? PBJPrerollQueueAt(ring, video, 0)->time : INT64_MAX;
+        if (audio->count > 0 && PBJPrerollQueueAt(ring, audio, 0)->time < videoStart) {
+            PBJPrerollQueuePopFront(ring, audio, 1);
+        } else if (video->count > 0) {
+            PBJPrerollEvictGOP(ring);
+        } else {
+            break;
+        }
+    }
+}
+
+#pragma mark - ring
+
+PBJPrerollRing *PBJPrerollRingCreate(const PBJPrerollRingConfiguration *configuration,
+                                     PBJPrerollRingReleaseFunction release, void *releaseContext)
+{
+    if (!configuration || configuration->capacity == 0 || configuration->memoryBudget == 0)
+        return NULL;
+
+    PBJPrerollRing *ring = (PBJPrerollRing *)calloc(1, sizeof(PBJPrerollRing));
+    if (!ring)
+        return NULL;
+
+    ring->capacity = configuration->capacity;
+    ring->memoryBudget = configuration->memoryBudget;
+    ring->duration = PBJTimeIsValid(configuration->duration) && configuration->duration.value > 0 ? PBJTimeGetNanoseconds(configuration->duration) : 0;
+    ring->awaitingKeyframe = 1;
+    ring->release = release;
+    ring->releaseContext = releaseContext;
+
+    for (int track = 0; track < PBJCaptureTrackCount; track++) {
+        ring->queues[track].entries = (PBJPrerollEntry *)calloc(ring->capacity, sizeof(PBJPrerollEntry));
+        if (!ring->queues[track].entries) {
+            PBJPrerollRingDestroy(ring);
+            return NULL;
+        }
+    }
+    return ring;
+}
+
+void PBJPrerollRingDestroy(PBJPrerollRing *ring)
+{
+    if (!ring)
+        return;
+
+    PBJPrerollRingClear(ring);
+    for (int track = 0; track < PBJCaptureTrackCount; track++) {
+        free(ring->queues[track].entries);
+    }
+    free(ring);
+}
+
+int PBJPrerollRingPush(PBJPrerollRing *ring, const PBJPrerollItem *item)
+{
+    if (!ring || !item)
+        return 0;
+
+    int isVideo = (item->track == PBJCaptureTrackVideo);
+    int valid = (item->track == PBJCaptureTrackVideo || item->track == PBJCaptureTrackAudio) &&
+                PBJTimeIsValid(item->presentationTimestamp) && item->size <= ring->memoryBudget;
+    if (!valid || (isVideo && ring->awaitingKeyframe && !item->isKeyframe)) {
+        ring->rejected++;
+        PBJPrerollReleasePayload(ring, item->payload);
+        return 0;
+    }
+
+    PBJPrerollQueue *queue = &ring->queues[item->track];
+    PBJPrerollQueue *video = &ring->queues[PBJCaptureTrackVideo];
+    int64_t time = PBJTimeGetNanoseconds(item->presentationTimestamp);
+    int64_t end = (PBJTimeIsValid(item->duration) && item->duration.value > 0) ? time + PBJTimeGetNanoseconds(item->duration) : time;
+    // audio delivered late can end before the first kept keyframe, it would never be written
+    int stale = !isVideo && video->count > 0 && end <= PBJPrerollQueueAt(ring, video, 0)->time;
+    if (stale || (queue->count > 0 && time <= PBJPrerollQueueAt(ring, queue, queue->count - 1)->time)) {
+        ring->rejected++;
+        PBJPrerollReleasePayload(ring, item->payload);
+        return 0;
+    }
+
+    // out of slots, make room the same way the budget would
+    if (queue->count == ring->capacity) {
+        if (isVideo) {
+            PBJPrerollEvictGOP(ring);
+            if (ring->awaitingKeyframe && !item->isKeyframe) {
+                ring->rejected++;
+                PBJPrerollReleasePayload(ring, item->payload);
+                return 0;
+            }
+        } else {
+            PBJPrerollQueuePopFront(ring, queue, 1);
+        }
+    }
+
+    PBJPrerollEntry *entry = PBJPrerollQueueAt(ring, queue, queue->count);
+    entry->item = *item;
+    entry->item.isKeyframe = isVideo ? (item->isKeyframe != 0) : 1;
+    entry->time = time;
+    entry->end = end;
+    queue->count++;
+    ring->bytes += item->size;
+
+    if (isVideo) {
+        if (item->isKeyframe) {
+            ring->keyframes++;
+        }
+        ring->awaitingKeyframe = 0;
+        if (queue->count == 1) {
+            PBJPrerollEvictLeadingAudio(ring);
+        }
+    }
+
+    PBJPrerollTrim(ring);
+    return 1;
+}
+
+size_t PBJPrerollRingDrain(PBJPrerollRing *ring, PBJPrerollRingDrainFunction drain, void *context)
+{
+    if (!ring)
+        return 0;
+
+    PBJPrerollQueue *video = &ring->queues[PBJCaptureTrackVideo];
+    PBJPrerollQueue *audio = &ring->queues[PBJCaptureTrackAudio];
+    size_t drained = 0;
+
+    while (video->count > 0 || audio->count > 0) {
+        PBJPrerollQueue *queue = video;
+        if (video->count == 0 || (audio->count > 0 && PBJPrerollQueueAt(ring, audio, 0)->time < PBJPrerollQueueAt(ring, video, 0)->time)) {
+            queue = audio;
+        }
+
+        PBJPrerollItem item = PBJPrerollQueueAt(ring, queue, 0)->item;
+        PBJPrerollQueuePopFront(ring, queue, 0);
+        if (drain) {
+            drain(context, &item);
+        } else {
+            PBJPrerollReleasePayload(ring, item.payload);
+        }
+        drained++;
+    }
+
+    ring->awaitingKeyframe = 1;
+    return drained;
+}
+
+void PBJPrerollRingClear(PBJPrerollRing *ring)
+{
+    if (!ring)
+        return;
+
+    for (int track = 0; track < PBJCaptureTrackCount; track++) {
+        PBJPrerollQueue *queue = &ring->queues[track];
+        while (queue->count > 0) {
+            PBJPrerollReleasePayload(ring, PBJPrerollQueueAt(ring, queue, 0)->item.payload);
+            PBJPrerollQueuePopFront(ring, queue, 0);
+        }
+    }
+    ring->awaitingKeyframe = 1;
+}
+
+PBJPrerollRingCounters PBJPrerollRingGetCounters(const PBJPrerollRing *ring)
+{
+    PBJPrerollRingCounters counters = { 0 };
+    if (!ring)
+        return counters;
+
+    counters.videoItems = ring->queues[PBJCaptureTrackVideo].count;
+    counters.audioItems = ring->queues[PBJCaptureTrackAudio].count;
+    counters.bytes = ring->bytes;
+    counters.evictedVideo = ring->queues[PBJCaptureTrackVideo].evicted;
+    counters.evictedAudio = ring->queues[PBJCaptureTrackAudio].evicted;
+    counters.rejected = ring->rejected;
+    return counters;
+}
+
+PBJTime PBJPrerollRingGetVideoDuration(const PBJPrerollRing *ring)
+{
+    if (!ring || ring->queues[PBJCaptureTrackVideo].count == 0)
+        return PBJTimeMake(0, 1000000000);
+
+    const PBJPrerollQueue *video = &ring->queues[PBJCaptureTrackVideo];
+    int64_t start = PBJPrerollQueueAt(ring, video, 0)->time;
+    int64_t end = PBJPrerollQueueAt(ring, video, video->count - 1)->end;
+    return PBJTimeMake(end - start, 1000000000);
+}
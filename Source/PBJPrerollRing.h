@@ -0,0 +1,98 @@
+//
+//  PBJPrerollRing.h
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef PBJPrerollRing_h
+#define PBJPrerollRing_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "PBJCaptureTimeline.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// holds the last few seconds of capture while previewing so a recording can start
+// in the past. video is evicted a whole GOP at a time from the front, so the ring
+// always begins on a keyframe, and audio older than that keyframe goes with it.
+// the byte budget is hard, a push never leaves more than it charged in the ring.
+// payloads are opaque, the ring owns them from push until they are drained or
+// handed to the release function. not thread safe
+
+typedef struct {
+    PBJCaptureTrack track;
+    PBJTime presentationTimestamp;
+    PBJTime duration; // may be invalid
+    size_t size; // bytes charged against the budget
+    int isKeyframe; // video only, audio is always independently decodable
+    void *payload;
+} PBJPrerollItem;
+
+typedef struct {
+    PBJTime duration; // the window to keep, measured from the first keyframe, invalid for no limit
+    size_t memoryBudget; // bytes
+    size_t capacity; // items per track
+} PBJPrerollRingConfiguration;
+
+typedef struct {
+    size_t videoItems;
+    size_t audioItems;
+    size_t bytes;
+    uint64_t evictedVideo;
+    uint64_t evictedAudio;
+    uint64_t rejected; // released on push, ie video ahead of the first keyframe, audio ending before it, or larger than the budget
+} PBJPrerollRingCounters;
+
+typedef void (*PBJPrerollRingReleaseFunction)(void *context, void *payload);
+
+// called in presentation order with the two tracks interleaved, ownership of the payload passes
+typedef void (*PBJPrerollRingDrainFunction)(void *context, const PBJPrerollItem *item);
+
+typedef struct PBJPrerollRing PBJPrerollRing;
+
+PBJPrerollRing *PBJPrerollRingCreate(const PBJPrerollRingConfiguration *configuration,
+                                     PBJPrerollRingReleaseFunction release, void *releaseContext);
+void PBJPrerollRingDestroy(PBJPrerollRing *ring);
+
+// takes ownership of item->payload, returns 0 when it was released right away.
+// presentation timestamps must increase per track
+int PBJPrerollRingPush(PBJPrerollRing *ring, const PBJPrerollItem *item);
+
+// empties the ring, handing every item over. the next video kept will be a keyframe
+size_t PBJPrerollRingDrain(PBJPrerollRing *ring, PBJPrerollRingDrainFunction drain, void *context);
+
+// releases everything
+void PBJPrerollRingClear(PBJPrerollRing *ring);
+
+PBJPrerollRingCounters PBJPrerollRingGetCounters(const PBJPrerollRing *ring);
+
+// from the first kept keyframe to the end of the newest video, zero when empty
+PBJTime PBJPrerollRingGetVideoDuration(const PBJPrerollRing *ring);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PBJPrerollRing_h */
@@ -0,0 +1,254 @@
+//
+//  PBJProxyOutput.c
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#include "PBJProxyOutput.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define PBJ_PROXY_NSEC_PER_SEC 1000000000LL
+
+struct PBJProxyOutput {
+    PBJProxyOutputConfiguration configuration;
+
+    size_t masterWidth;
+    size_t masterHeight;
+    size_t width;
+    size_t height;
+    PBJResampler *resampler;
+
+    int64_t frameInterval; // 0 keeps every frame
+    int deciding;
+    int64_t nextFrameTime;
+
+    PBJProxyOutputStatistics statistics;
+};
+
+#pragma mark - lifecycle
+
+PBJProxyOutputConfiguration PBJProxyOutputDefaultConfiguration(void)
+{
+    PBJProxyOutputConfiguration configuration;
+    configuration.maximumDimension = 640;
+    configuration.frameRate = 15;
+    configuration.filter = PBJResampleFilterBox;
+    return configuration;
+}
+
+static int PBJProxyOutputConfigurationIsValid(const PBJProxyOutputConfiguration *configuration)
+{
+    return configuration && configuration->maximumDimension >= 2 && configuration->frameRate >= 0;
+}
+
+PBJProxyOutput *PBJProxyOutputCreate(const PBJProxyOutputConfiguration *configuration)
+{
+    PBJProxyOutputConfiguration defaultConfiguration = PBJProxyOutputDefaultConfiguration();
+    if (!configuration)
+        configuration = &defaultConfiguration;
+    if (!PBJProxyOutputConfigurationIsValid(configuration))
+        return NULL;
+
+    PBJProxyOutput *proxy = (PBJProxyOutput *)calloc(1, sizeof(PBJProxyOutput));
+    if (!proxy)
+        return NULL;
+    PBJProxyOutputSetConfiguration(proxy, configuration);
+    return proxy;
+}
+
+void PBJProxyOutputDestroy(PBJProxyOutput *proxy)
+{
+    if (!proxy)
+        return;
+    PBJResamplerDestroy(proxy->resampler);
+    free(proxy);
+}
+
+int PBJProxyOutputSetConfiguration(PBJProxyOutput *proxy, const PBJProxyOutputConfiguration *configuration)
+{
+    if (!proxy || !PBJProxyOutputConfigurationIsValid(configuration))
+        return 0;
+
+    // the geometry follows the long edge and the filter, it's chosen again by the next prepare
+    if (configuration->maximumDimension != proxy->configuration.maximumDimension || configuration->filter != proxy->configuration.filter) {
+        PBJResamplerDestroy(proxy->resampler);
+        proxy->resampler = NULL;
+        proxy->masterWidth = 0;
+        proxy->masterHeight = 0;
+        proxy->width = 0;
+        proxy->height = 0;
+    }
+
+    proxy->configuration = *configuration;
+    proxy->frameInterval = configuration->frameRate > 0 ? (int64_t)((double)PBJ_PROXY_NSEC_PER_SEC / configuration->frameRate) : 0;
+    PBJProxyOutputReset(proxy);
+    return 1;
+}
+
+PBJProxyOutputConfiguration PBJProxyOutputGetConfiguration(const PBJProxyOutput *proxy)
+{
+    return proxy ? proxy->configuration : PBJProxyOutputDefaultConfiguration();
+}
+
+void PBJProxyOutputReset(PBJProxyOutput *proxy)
+{
+    if (!proxy)
+        return;
+    proxy->deciding = 0;
+    proxy->nextFrameTime = 0;
+    memset(&proxy->statistics, 0, sizeof(PBJProxyOutputStatistics));
+}
+
+#pragma mark - geometry
+
+int PBJProxyOutputPrepare(PBJProxyOutput *proxy, size_t masterWidth, size_t masterHeight)
+{
+    if (!proxy)
+        return 0;
+    if (masterWidth < 2 || masterHeight < 2)
+        return 0;
+    if (proxy->width > 0 && masterWidth == proxy->masterWidth && masterHeight == proxy->masterHeight)
+        return 1;
+
+    PBJResamplerDestroy(proxy->resampler);
+    proxy->resampler = NULL;
+    proxy->width = 0;
+    proxy->height = 0;
+
+    // the long edge fits, the short edge follows it rounded to the nearest even size
+    size_t longEdge = masterWidth > masterHeight ? masterWidth : masterHeight;
+    size_t maximumDimension = proxy->configuration.maximumDimension & ~(size_t)1;
+    size_t width = masterWidth & ~(size_t)1;
+    size_t height = masterHeight & ~(size_t)1;
+    if (longEdge > maximumDimension) {
+        double scale = (double)maximumDimension / (double)longEdge;
+        width = ((size_t)((double)masterWidth * scale * 0.5 + 0.5)) * 2;
+        height = ((size_t)((double)masterHeight * scale * 0.5 + 0.5)) * 2;
+        if (width < 2)
+            width = 2;
+        if (height < 2)
+            height = 2;
+    }
+
+    // a master of odd size or beyond the long edge is cropped by at most a pixel and resampled
+    if (width != masterWidth || height != masterHeight) {
+        PBJCropRect crop = { 0, 0, masterWidth & ~(size_t)1, masterHeight & ~(size_t)1 };
+        proxy->resampler = PBJResamplerCreate(crop, width, height, proxy->configuration.filter);
+        if (!proxy->resampler)
+            return 0;
+    }
+
+    proxy->masterWidth = masterWidth;
+    proxy->masterHeight = masterHeight;
+    proxy->width = width;
+    proxy->height = height;
+    return 1;
+}
+
+void PBJProxyOutputGetDimensions(const PBJProxyOutput *proxy, size_t *width, size_t *height)
+{
+    if (width)
+        *width = proxy ? proxy->width : 0;
+    if (height)
+        *height = proxy ? proxy->height : 0;
+}
+
+const PBJResampler *PBJProxyOutputGetResampler(const PBJProxyOutput *proxy)
+{
+    return proxy ? proxy->resampler : NULL;
+}
+
+#pragma mark - routing
+
+unsigned int PBJProxyOutputRouteSample(PBJProxyOutput *proxy, PBJCaptureTrack track, int64_t time)
+{
+    if (!proxy)
+        return PBJProxyOutputRouteMaster;
+
+    if (track != PBJCaptureTrackVideo) {
+        proxy->statistics.audioSamplesRouted++;
+        return PBJProxyOutputRouteMaster | PBJProxyOutputRouteProxy;
+    }
+
+    if (proxy->frameInterval > 0) {
+        if (!proxy->deciding) {
+            proxy->deciding = 1;
+            proxy->nextFrameTime = time;
+        }
+
+        // a little early is on time, written timestamps carry the capture's jitter
+        if (time + proxy->frameInterval / 8 < proxy->nextFrameTime) {
+            proxy->statistics.framesDecimated++;
+            return PBJProxyOutputRouteMaster;
+        }
+
+        proxy->nextFrameTime += proxy->frameInterval;
+        if (proxy->nextFrameTime <= time) {
+            // after a gap, start a new grid rather than catch up in a burst
+            proxy->nextFrameTime = time + proxy->frameInterval;
+        }
+    }
+
+    proxy->statistics.framesRouted++;
+    return PBJProxyOutputRouteMaster | PBJProxyOutputRouteProxy;
+}
+
+#pragma mark - downscale
+
+size_t PBJProxyOutputScratchSize(const PBJProxyOutput *proxy)
+{
+    return (proxy && proxy->resampler) ? PBJResamplerScratchSize(proxy->resampler) : 0;
+}
+
+int PBJProxyOutputDownscale(const PBJProxyOutput *proxy, const PBJNV12Image *master, PBJNV12Image *destination, void *scratch, PBJSIMDLevel level)
+{
+    if (!proxy || !master || !destination || proxy->width == 0)
+        return 0;
+    if (master->width != proxy->masterWidth || master->height != proxy->masterHeight ||
+        destination->width != proxy->width || destination->height != proxy->height)
+        return 0;
+
+    if (!proxy->resampler) {
+        size_t chromaHeight = PBJNV12ChromaHeight(destination);
+        size_t chromaBytes = PBJNV12ChromaWidth(destination) * 2;
+        for (size_t row = 0; row < destination->height; row++)
+            memcpy(destination->luma + row * destination->lumaBytesPerRow, master->luma + row * master->lumaBytesPerRow, destination->width);
+        for (size_t row = 0; row < chromaHeight; row++)
+            memcpy(destination->chroma + row * destination->chromaBytesPerRow, master->chroma + row * master->chromaBytesPerRow, chromaBytes);
+        return 1;
+    }
+
+    if (!scratch)
+        return 0;
+    PBJResamplerProcessRows(proxy->resampler, master, destination, 0, destination->height, scratch, level);
+    return 1;
+}
+
+PBJProxyOutputStatistics PBJProxyOutputGetStatistics(const PBJProxyOutput *proxy)
+{
+    if (proxy)
+        return proxy->statistics;
+    PBJProxyOutputStatistics statistics = { 0, 0, 0 };
+    return statistics;
+}
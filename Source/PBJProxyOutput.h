@@ -0,0 +1,102 @@
+//
+//  PBJProxyOutput.h
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#ifndef PBJProxyOutput_h
+#define PBJProxyOutput_h
+
+#include <stdint.h>
+
+#include "PBJCaptureTimeline.h"
+#include "PBJResampler.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// a low resolution proxy recorded alongside the full resolution master from the same samples.
+// every sample written to the master is routed to the proxy as well, except video frames beyond
+// the proxy's frame rate, which are decimated on a fixed grid of written time before any work is
+// spent on them. kept frames are downscaled once to fit the proxy's long edge, aspect kept and
+// even aligned for 4:2:0, through a resampler shared by every frame of the recording. times are
+// nanoseconds of the written timeline. not thread safe, confine to one queue
+
+typedef struct {
+    size_t maximumDimension; // long edge of the proxy, a smaller master is kept at its size
+    double frameRate; // 0 keeps every frame written to the master
+    PBJResampleFilter filter;
+} PBJProxyOutputConfiguration;
+
+typedef enum {
+    PBJProxyOutputRouteMaster = 1 << 0,
+    PBJProxyOutputRouteProxy = 1 << 1
+} PBJProxyOutputRoute;
+
+typedef struct {
+    uint64_t framesRouted; // to the proxy
+    uint64_t framesDecimated;
+    uint64_t audioSamplesRouted;
+} PBJProxyOutputStatistics;
+
+typedef struct PBJProxyOutput PBJProxyOutput;
+
+// 640 on the long edge, 15 fps, box filtered
+PBJProxyOutputConfiguration PBJProxyOutputDefaultConfiguration(void);
+
+// NULL without a long edge of at least 2 or for a negative frame rate
+PBJProxyOutput *PBJProxyOutputCreate(const PBJProxyOutputConfiguration *configuration);
+void PBJProxyOutputDestroy(PBJProxyOutput *proxy);
+
+// resets as well, returns 0 and leaves the proxy as it was for an invalid configuration
+int PBJProxyOutputSetConfiguration(PBJProxyOutput *proxy, const PBJProxyOutputConfiguration *configuration);
+PBJProxyOutputConfiguration PBJProxyOutputGetConfiguration(const PBJProxyOutput *proxy);
+
+// for a new recording, the next frame is kept
+void PBJProxyOutputReset(PBJProxyOutput *proxy);
+
+// sizes the proxy for frames as the master writes them, returns 0 for frames it can't take.
+// the resampler is kept while the master's dimensions stay the same
+int PBJProxyOutputPrepare(PBJProxyOutput *proxy, size_t masterWidth, size_t masterHeight);
+
+// 0 before a successful prepare
+void PBJProxyOutputGetDimensions(const PBJProxyOutput *proxy, size_t *width, size_t *height);
+
+// NULL when the proxy is the master's size and frames are passed through as they are
+const PBJResampler *PBJProxyOutputGetResampler(const PBJProxyOutput *proxy);
+
+// the outputs a sample written to the master at time goes to, master always
+unsigned int PBJProxyOutputRouteSample(PBJProxyOutput *proxy, PBJCaptureTrack track, int64_t time);
+
+// downscales a whole master frame on the calling thread, scratch of PBJProxyOutputScratchSize,
+// the destination at the prepared dimensions. for strips across cores use the resampler directly
+int PBJProxyOutputDownscale(const PBJProxyOutput *proxy, const PBJNV12Image *master, PBJNV12Image *destination, void *scratch, PBJSIMDLevel level);
+size_t PBJProxyOutputScratchSize(const PBJProxyOutput *proxy);
+
+PBJProxyOutputStatistics PBJProxyOutputGetStatistics(const PBJProxyOutput *proxy);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PBJProxyOutput_h */
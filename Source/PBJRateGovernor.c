@@ -0,0 +1,306 @@
+//
+//  PBJRateGovernor.c
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#include "PBJRateGovernor.h"
+
+#include <stdlib.h>
+
+#define PBJ_GOVERNOR_NSEC_PER_SEC 1000000000LL
+
+struct PBJRateGovernor {
+    PBJRateGovernorConfiguration configuration;
+
+    double bitRate;
+    double frameRate;
+    int64_t increaseHold;
+    uint32_t decreases;
+    uint32_t increases;
+
+    // the interval being read, totals are taken from the load at its start
+    int baselined;
+    PBJWriterLoad baseline;
+    int64_t intervalStart;
+    double queueFillSum;
+    uint32_t queueFillCount;
+
+    int clearRun;
+    int64_t clearSince;
+    int increased;
+    int64_t lastIncreaseTime;
+    int decreased;
+    int64_t lastDecreaseTime;
+
+    // frame spacing below the maximum frame rate
+    int admitting;
+    int64_t nextAdmitTime;
+};
+
+PBJRateGovernorConfiguration PBJRateGovernorDefaultConfiguration(double bitRate, double frameRate)
+{
+    PBJRateGovernorConfiguration configuration;
+    configuration.minimumBitRate = bitRate / 4.0;
+    configuration.maximumBitRate = bitRate;
+    configuration.minimumFrameRate = frameRate;
+    configuration.maximumFrameRate = frameRate;
+    configuration.interval = PBJ_GOVERNOR_NSEC_PER_SEC / 4;
+    configuration.highQueueFill = 0.5;
+    configuration.lowQueueFill = 0.125;
+    configuration.highAppendLoad = 0.9;
+    configuration.lowAppendLoad = 0.75;
+    configuration.decreaseFactor = 0.75;
+    configuration.increaseFraction = 0.1;
+    configuration.increaseHold = PBJ_GOVERNOR_NSEC_PER_SEC;
+    configuration.maximumIncreaseHold = 32 * PBJ_GOVERNOR_NSEC_PER_SEC;
+    return configuration;
+}
+
+PBJRateGovernor *PBJRateGovernorCreate(const PBJRateGovernorConfiguration *configuration)
+{
+    if (!configuration || configuration->maximumBitRate <= 0 || configuration->maximumFrameRate <= 0)
+        return NULL;
+
+    PBJRateGovernor *governor = (PBJRateGovernor *)calloc(1, sizeof(PBJRateGovernor));
+    if (!governor)
+        return NULL;
+
+    PBJRateGovernorConfiguration *adopted = &governor->configuration;
+    *adopted = *configuration;
+    if (adopted->minimumBitRate <= 0 || adopted->minimumBitRate > adopted->maximumBitRate)
+        adopted->minimumBitRate = adopted->maximumBitRate;
+    if (adopted->minimumFrameRate <= 0 || adopted->minimumFrameRate > adopted->maximumFrameRate)
+        adopted->minimumFrameRate = adopted->maximumFrameRate;
+    if (adopted->interval <= 0)
+        adopted->interval = PBJ_GOVERNOR_NSEC_PER_SEC / 4;
+    if (adopted->lowQueueFill > adopted->highQueueFill)
+        adopted->lowQueueFill = adopted->highQueueFill;
+    if (adopted->lowAppendLoad > adopted->highAppendLoad)
+        adopted->lowAppendLoad = adopted->highAppendLoad;
+    if (adopted->decreaseFactor <= 0 || adopted->decreaseFactor >= 1)
+        adopted->decreaseFactor = 0.75;
+    if (adopted->increaseFraction <= 0)
+        adopted->increaseFraction = 0.1;
+    if (adopted->increaseHold < adopted->interval)
+        adopted->increaseHold = adopted->interval;
+    if (adopted->maximumIncreaseHold < adopted->increaseHold)
+        adopted->maximumIncreaseHold = adopted->increaseHold;
+
+    PBJRateGovernorReset(governor);
+    return governor;
+}
+
+void PBJRateGovernorDestroy(PBJRateGovernor *governor)
+{
+    free(governor);
+}
+
+void PBJRateGovernorReset(PBJRateGovernor *governor)
+{
+    if (!governor)
+        return;
+
+    const PBJRateGovernorConfiguration *configuration = &governor->configuration;
+    governor->bitRate = configuration->maximumBitRate;
+    governor->frameRate = configuration->maximumFrameRate;
+    governor->increaseHold = configuration->increaseHold;
+    governor->decreases = 0;
+    governor->increases = 0;
+    governor->baselined = 0;
+    governor->queueFillSum = 0;
+    governor->queueFillCount = 0;
+    governor->clearRun = 0;
+    governor->increased = 0;
+    governor->decreased = 0;
+    governor->admitting = 0;
+}
+
+#pragma mark - control
+
+static uint64_t PBJRateGovernorDelta(uint64_t total, uint64_t baseline)
+{
+    return total > baseline ? total - baseline : 0;
+}
+
+// the bit rate gives way first, what is encoded is kept whole for as long as it can be
+static int PBJRateGovernorStepDown(PBJRateGovernor *governor)
+{
+    const PBJRateGovernorConfiguration *configuration = &governor->configuration;
+    if (governor->bitRate > configuration->minimumBitRate) {
+        double bitRate = governor->bitRate * configuration->decreaseFactor;
+        governor->bitRate = bitRate > configuration->minimumBitRate ? bitRate : configuration->minimumBitRate;
+        return 1;
+    }
+    if (governor->frameRate > configuration->minimumFrameRate) {
+        double frameRate = governor->frameRate * configuration->decreaseFactor;
+        governor->frameRate = frameRate > configuration->minimumFrameRate ? frameRate : configuration->minimumFrameRate;
+        return 1;
+    }
+    return 0;
+}
+
+// and comes back last, once the motion is whole again
+static int PBJRateGovernorStepUp(PBJRateGovernor *governor)
+{
+    const PBJRateGovernorConfiguration *configuration = &governor->configuration;
+    if (governor->frameRate < configuration->maximumFrameRate) {
+        double frameRate = governor->frameRate / configuration->decreaseFactor;
+        // a cut and its undo don't quite cancel in floating point
+        governor->frameRate = frameRate < configuration->maximumFrameRate * 0.999 ? frameRate : configuration->maximumFrameRate;
+        return 1;
+    }
+    if (governor->bitRate < configuration->maximumBitRate) {
+        double bitRate = governor->bitRate + configuration->maximumBitRate * configuration->increaseFraction;
+        governor->bitRate = bitRate < configuration->maximumBitRate ? bitRate : configuration->maximumBitRate;
+        return 1;
+    }
+    return 0;
+}
+
+int PBJRateGovernorObserve(PBJRateGovernor *governor, const PBJWriterLoad *load)
+{
+    if (!governor || !load)
+        return 0;
+
+    const PBJRateGovernorConfiguration *configuration = &governor->configuration;
+
+    if (!governor->baselined) {
+        governor->baselined = 1;
+        governor->baseline = *load;
+        governor->intervalStart = load->time;
+        governor->queueFillSum = 0;
+        governor->queueFillCount = 0;
+    }
+
+    if (load->queueCapacity > 0) {
+        double fill = (double)load->queuedFrames / (double)load->queueCapacity;
+        governor->queueFillSum += fill < 1.0 ? fill : 1.0;
+        governor->queueFillCount++;
+    }
+
+    int64_t now = load->time;
+    if (now - governor->intervalStart < configuration->interval)
+        return 0;
+
+    uint64_t dropped = PBJRateGovernorDelta(load->framesDropped, governor->baseline.framesDropped);
+    uint64_t deferred = PBJRateGovernorDelta(load->appendsDeferred, governor->baseline.appendsDeferred);
+    uint64_t appended = PBJRateGovernorDelta(load->framesAppended, governor->baseline.framesAppended);
+    uint64_t appendNanoseconds = PBJRateGovernorDelta(load->appendNanoseconds, governor->baseline.appendNanoseconds);
+    double queueFill = governor->queueFillCount > 0 ? governor->queueFillSum / (double)governor->queueFillCount : 0;
+    double frameInterval = (double)PBJ_GOVERNOR_NSEC_PER_SEC / governor->frameRate;
+    double appendLoad = appended > 0 ? ((double)appendNanoseconds / (double)appended) / frameInterval : 0;
+
+    governor->baseline = *load;
+    governor->intervalStart = now;
+    governor->queueFillSum = 0;
+    governor->queueFillCount = 0;
+
+    int congested = dropped > 0 || queueFill >= configuration->highQueueFill || appendLoad >= configuration->highAppendLoad;
+    int clear = !congested && deferred == 0 && queueFill <= configuration->lowQueueFill && appendLoad <= configuration->lowAppendLoad;
+
+    int changed = 0;
+    if (congested) {
+        governor->clearRun = 0;
+
+        // the last step up went too far, wait longer before the next
+        if (governor->increased && now - governor->lastIncreaseTime <= governor->increaseHold + configuration->interval) {
+            int64_t increaseHold = governor->increaseHold * 2;
+            governor->increaseHold = increaseHold < configuration->maximumIncreaseHold ? increaseHold : configuration->maximumIncreaseHold;
+        }
+        governor->increased = 0;
+
+        // a queue drains over a few intervals after a cut, give it two before cutting again
+        if (!governor->decreased || now - governor->lastDecreaseTime >= 2 * configuration->interval) {
+            changed = PBJRateGovernorStepDown(governor);
+            if (changed) {
+                governor->decreased = 1;
+                governor->lastDecreaseTime = now;
+                governor->decreases++;
+            }
+        }
+    } else if (clear) {
+        if (!governor->clearRun) {
+            governor->clearRun = 1;
+            governor->clearSince = now - configuration->interval;
+        }
+
+        if (now - governor->clearSince >= governor->increaseHold) {
+            changed = PBJRateGovernorStepUp(governor);
+            if (changed) {
+                governor->increased = 1;
+                governor->lastIncreaseTime = now;
+                governor->increases++;
+                governor->clearSince = now;
+            } else if (now - governor->clearSince >= configuration->maximumIncreaseHold) {
+                // clear at the maximums for the longest hold, whatever held the rates back has passed
+                governor->increaseHold = configuration->increaseHold;
+            }
+        }
+    } else {
+        governor->clearRun = 0;
+    }
+
+    return changed;
+}
+
+void PBJRateGovernorGetTargets(const PBJRateGovernor *governor, PBJRateGovernorTargets *targets)
+{
+    if (!governor || !targets)
+        return;
+
+    targets->bitRate = governor->bitRate;
+    targets->frameRate = governor->frameRate;
+    targets->increaseHold = governor->increaseHold;
+    targets->decreases = governor->decreases;
+    targets->increases = governor->increases;
+}
+
+#pragma mark - frame spacing
+
+int PBJRateGovernorAdmitFrame(PBJRateGovernor *governor, int64_t time)
+{
+    if (!governor)
+        return 1;
+
+    if (governor->frameRate >= governor->configuration.maximumFrameRate) {
+        governor->admitting = 0;
+        return 1;
+    }
+
+    int64_t frameInterval = (int64_t)((double)PBJ_GOVERNOR_NSEC_PER_SEC / governor->frameRate);
+    if (!governor->admitting) {
+        governor->admitting = 1;
+        governor->nextAdmitTime = time;
+    }
+
+    // a little early is on time, capture timestamps jitter
+    if (time + frameInterval / 8 < governor->nextAdmitTime)
+        return 0;
+
+    governor->nextAdmitTime += frameInterval;
+    if (governor->nextAdmitTime <= time) {
+        // after a gap, start a new grid rather than catch up in a burst
+        governor->nextAdmitTime = time + frameInterval;
+    }
+    return 1;
+}
@@ -0,0 +1,105 @@
+//
+//  PBJRateGovernor.h
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#ifndef PBJRateGovernor_h
+#define PBJRateGovernor_h
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// steps the video bit rate, and when allowed the frame rate, to what the writer keeps pace with.
+// the writer's load is read once an interval: congested when frames were dropped, the queue sat
+// past its high mark or appends took most of a frame interval, clear when the queue stayed low and
+// every append was taken. congestion cuts the bit rate by a factor, then the frame rate once the bit
+// rate is at its floor. a clear run of the hold restores the frame rate, then raises the bit rate a
+// step at a time. in between nothing changes, and an increase undone by congestion within the hold
+// doubles it, so a limit that sits between two steps isn't probed over and over. times are
+// nanoseconds on the owner's clock. not thread safe, confine to one queue
+
+typedef struct {
+    double minimumBitRate; // bits per second
+    double maximumBitRate;
+    double minimumFrameRate; // the maximum keeps the frame rate fixed
+    double maximumFrameRate;
+    int64_t interval; // between readings of the load
+    double highQueueFill; // 0 - 1, mean over the interval, congested at or above
+    double lowQueueFill; // clear at or below
+    double highAppendLoad; // mean append time over the target frame interval, congested at or above
+    double lowAppendLoad; // clear at or below
+    double decreaseFactor; // 0 - 1, on congestion
+    double increaseFraction; // of the maximum bit rate, each step up
+    int64_t increaseHold; // of clear load before a step up
+    int64_t maximumIncreaseHold; // bounds the backoff
+} PBJRateGovernorConfiguration;
+
+// the writer as seen at one moment, counts are running totals of the recording
+typedef struct {
+    int64_t time;
+    uint64_t queuedFrames; // waiting for the writer
+    uint64_t queueCapacity;
+    uint64_t framesDropped;
+    uint64_t appendsDeferred; // turned away by an encoder that wasn't ready
+    uint64_t framesAppended;
+    uint64_t appendNanoseconds;
+} PBJWriterLoad;
+
+typedef struct {
+    double bitRate;
+    double frameRate;
+    int64_t increaseHold; // grows with the backoff
+    uint32_t decreases;
+    uint32_t increases;
+} PBJRateGovernorTargets;
+
+typedef struct PBJRateGovernor PBJRateGovernor;
+
+// down to a quarter of the bit rate, fixed frame rate, read four times a second, congested at half
+// a queue or 90% of a frame interval appending, clear at an eighth and 75%, 25% cuts, 10% steps
+// after 1 s clear, backing off up to 32 s
+PBJRateGovernorConfiguration PBJRateGovernorDefaultConfiguration(double bitRate, double frameRate);
+
+PBJRateGovernor *PBJRateGovernorCreate(const PBJRateGovernorConfiguration *configuration);
+void PBJRateGovernorDestroy(PBJRateGovernor *governor);
+
+// back to the maximums and the base hold, the next load observed is the baseline for the totals
+void PBJRateGovernorReset(PBJRateGovernor *governor);
+
+// returns 1 when the targets changed
+int PBJRateGovernorObserve(PBJRateGovernor *governor, const PBJWriterLoad *load);
+
+void PBJRateGovernorGetTargets(const PBJRateGovernor *governor, PBJRateGovernorTargets *targets);
+
+// spaces frames at the target frame rate on a fixed grid, every frame passes at the maximum,
+// returns 1 for a frame to keep
+int PBJRateGovernorAdmitFrame(PBJRateGovernor *governor, int64_t time);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PBJRateGovernor_h */
@@ -0,0 +1,496 @@
+//
+//  PBJResampler.c
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include "PBJResampler.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// separable filtering, each destination row is produced by a vertical pass over the
+// cropped source columns into a scratch row followed by a horizontal pass, weights
+// are 14-bit fixed point and every path rounds and clamps identically
+
+#define PBJ_RESAMPLE_WEIGHT_BITS 14
+#define PBJ_RESAMPLE_WEIGHT_ONE (1 << PBJ_RESAMPLE_WEIGHT_BITS)
+#define PBJ_RESAMPLE_ROUNDING (1 << (PBJ_RESAMPLE_WEIGHT_BITS - 1))
+#define PBJ_RESAMPLE_TAP_ALIGNMENT 8
+#define PBJ_RESAMPLE_MAX_VECTOR_ROWS 64
+
+typedef struct {
+    size_t inLength;
+    size_t outLength;
+    size_t taps;       // taps used by each output sample
+    size_t tapStride;  // taps rounded up to the vector width, padded with zero weights
+    int identity;
+    size_t *start;
+    int16_t *weights;
+} PBJResampleAxis;
+
+struct PBJResampler {
+    PBJCropRect crop;
+    PBJResampleAxis lumaColumns;
+    PBJResampleAxis lumaRows;
+    PBJResampleAxis chromaColumns;
+    PBJResampleAxis chromaRows;
+};
+
+#pragma mark - filters
+
+static double PBJResampleSinc(double x)
+{
+    if (x == 0.0)
+        return 1.0;
+    x *= 3.14159265358979323846;
+    return sin(x) / x;
+}
+
+static double PBJResampleFilterSupport(PBJResampleFilter filter)
+{
+    switch (filter) {
+        case PBJResampleFilterLanczos3:
+            return 3.0;
+        case PBJResampleFilterBilinear:
+            return 1.0;
+        case PBJResampleFilterBox:
+        default:
+            return 0.5;
+    }
+}
+
+static double PBJResampleFilterWeight(PBJResampleFilter filter, double x)
+{
+    switch (filter) {
+        case PBJResampleFilterLanczos3:
+            return (x > -3.0 && x < 3.0) ? PBJResampleSinc(x) * PBJResampleSinc(x / 3.0) : 0.0;
+        case PBJResampleFilterBilinear:
+            x = fabs(x);
+            return x < 1.0 ? 1.0 - x : 0.0;
+        case PBJResampleFilterBox:
+        default:
+            return (x >= -0.5 && x < 0.5) ? 1.0 : 0.0;
+    }
+}
+
+#pragma mark - axis
+
+static void PBJResampleAxisDestroy(PBJResampleAxis *axis)
+{
+    free(axis->start);
+    free(axis->weights);
+    axis->start = NULL;
+    axis->weights = NULL;
+}
+
+static int PBJResampleAxisInit(PBJResampleAxis *axis, size_t inLength, size_t outLength, PBJResampleFilter filter)
+{
+    memset(axis, 0, sizeof(PBJResampleAxis));
+    axis->inLength = inLength;
+    axis->outLength = outLength;
+    axis->identity = (inLength == outLength);
+    if (axis->identity || inLength == 0 || outLength == 0)
+        return 1;
+
+    double scale = (double)inLength / (double)outLength;
+    double filterScale = scale > 1.0 ? scale : 1.0;
+    double support = PBJResampleFilterSupport(filter) * filterScale;
+
+    size_t taps = (size_t)ceil(support) * 2 + 1;
+    if (taps > inLength)
+        taps = inLength;
+    size_t tapStride = (taps + PBJ_RESAMPLE_TAP_ALIGNMENT - 1) & ~(size_t)(PBJ_RESAMPLE_TAP_ALIGNMENT - 1);
+
+    axis->taps = taps;
+    axis->tapStride = tapStride;
+    axis->start = (size_t *)calloc(outLength, sizeof(size_t));
+    axis->weights = (int16_t *)calloc(outLength * tapStride, sizeof(int16_t));
+    double *window = (double *)calloc(taps + 1, sizeof(double));
+    if (!axis->start || !axis->weights || !window) {
+        free(window);
+        PBJResampleAxisDestroy(axis);
+        return 0;
+    }
+
+    for (size_t i = 0; i < outLength; i++) {
+        double center = ((double)i + 0.5) * scale;
+        long lo = (long)floor(center - support + 0.5);
+        long hi = (long)floor(center + support + 0.5);
+        if (lo < 0)
+            lo = 0;
+        if (hi > (long)inLength)
+            hi = (long)inLength;
+        if (hi - lo > (long)taps)
+            hi = lo + (long)taps;
+
+        // keep every window inside the source so vector loads never overrun
+        size_t start = (size_t)lo;
+        if (start + taps > inLength)
+            start = inLength - taps;
+
+        double total = 0.0;
+        for (size_t k = 0; k < taps; k++) {
+            long j = (long)(start + k);
+            double w = 0.0;
+            if (j >= lo && j < hi)
+                w = PBJResampleFilterWeight(filter, ((double)j + 0.5 - center) / filterScale);
+            window[k] = w;
+            total += w;
+        }
+        if (total == 0.0) {
+            // degenerate window, fall back to the nearest sample
+            size_t nearest = (size_t)center;
+            if (nearest < start)
+                nearest = start;
+            if (nearest >= start + taps)
+                nearest = start + taps - 1;
+            window[nearest - start] = 1.0;
+            total = 1.0;
+        }
+
+        int16_t *weights = axis->weights + i * tapStride;
+        int32_t sum = 0;
+        size_t largest = 0;
+        for (size_t k = 0; k < taps; k++) {
+            weights[k] = (int16_t)lround(window[k] / total * PBJ_RESAMPLE_WEIGHT_ONE);
+            sum += weights[k];
+            if (weights[k] > weights[largest])
+                largest = k;
+        }
+        weights[largest] = (int16_t)(weights[largest] + (PBJ_RESAMPLE_WEIGHT_ONE - sum));
+        axis->start[i] = start;
+    }
+
+    free(window);
+    return 1;
+}
+
+static inline uint8_t PBJResampleClamp(int32_t accumulator)
+{
+    accumulator >>= PBJ_RESAMPLE_WEIGHT_BITS;
+    return (uint8_t)(accumulator < 0 ? 0 : (accumulator > 255 ? 255 : accumulator));
+}
+
+#pragma mark - vertical pass
+
+static void PBJResampleVerticalScalar(const uint8_t *const *rows, const int16_t *weights, size_t taps,
+                                      uint8_t *out, size_t x, size_t count)
+{
+    for (; x < count; x++) {
+        int32_t accumulator = PBJ_RESAMPLE_ROUNDING;
+        for (size_t k = 0; k < taps; k++) {
+            accumulator += weights[k] * rows[k][x];
+        }
+        out[x] = PBJResampleClamp(accumulator);
+    }
+}
+
+#if PBJ_SIMD_SSE2
+
+static size_t PBJResampleVerticalSSE2(const uint8_t *const *rows, const int16_t *weights, size_t taps,
+                                      uint8_t *out, size_t count)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i rounding = _mm_set1_epi32(PBJ_RESAMPLE_ROUNDING);
+
+    size_t x = 0;
+    for (; x + 8 <= count; x += 8) {
+        __m128i lo = rounding;
+        __m128i hi = rounding;
+        size_t k = 0;
+        for (; k + 1 < taps; k += 2) {
+            __m128i a = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(rows[k] + x)), zero);
+            __m128i b = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(rows[k + 1] + x)), zero);
+            __m128i w = _mm_set1_epi32((int32_t)(((uint32_t)(uint16_t)weights[k + 1] << 16) | (uint16_t)weights[k]));
+            lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), w));
+            hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi16(a, b), w));
+        }
+        if (k < taps) {
+            __m128i a = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(rows[k] + x)), zero);
+            __m128i w = _mm_set1_epi32((int32_t)(uint16_t)weights[k]);
+            lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi16(a, zero), w));
+            hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi16(a, zero), w));
+        }
+        __m128i packed = _mm_packs_epi32(_mm_srai_epi32(lo, PBJ_RESAMPLE_WEIGHT_BITS), _mm_srai_epi32(hi, PBJ_RESAMPLE_WEIGHT_BITS));
+        _mm_storel_epi64((__m128i *)(out + x), _mm_packus_epi16(packed, packed));
+    }
+    return x;
+}
+
+#endif
+
+#if PBJ_SIMD_NEON
+
+static size_t PBJResampleVerticalNEON(const uint8_t *const *rows, const int16_t *weights, size_t taps,
+                                      uint8_t *out, size_t count)
+{
+    size_t x = 0;
+    for (; x + 8 <= count; x += 8) {
+        int32x4_t lo = vdupq_n_s32(PBJ_RESAMPLE_ROUNDING);
+        int32x4_t hi = vdupq_n_s32(PBJ_RESAMPLE_ROUNDING);
+        for (size_t k = 0; k < taps; k++) {
+            int16x8_t p = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(rows[k] + x)));
+            lo = vmlal_n_s16(lo, vget_low_s16(p), weights[k]);
+            hi = vmlal_n_s16(hi, vget_high_s16(p), weights[k]);
+        }
+        int16x8_t narrowed = vcombine_s16(vqshrn_n_s32(lo, PBJ_RESAMPLE_WEIGHT_BITS), vqshrn_n_s32(hi, PBJ_RESAMPLE_WEIGHT_BITS));
+        vst1_u8(out + x, vqmovun_s16(narrowed));
+    }
+    return x;
+}
+
+#endif
+
+static void PBJResampleVertical(const uint8_t *const *rows, const int16_t *weights, size_t taps,
+                                uint8_t *out, size_t count, PBJSIMDLevel level)
+{
+    size_t x = 0;
+    switch (level) {
+#if PBJ_SIMD_SSE2
+        case PBJSIMDLevelSSE2:
+        case PBJSIMDLevelAVX2:
+            x = PBJResampleVerticalSSE2(rows, weights, taps, out, count);
+            break;
+#endif
+#if PBJ_SIMD_NEON
+        case PBJSIMDLevelNEON:
+            x = PBJResampleVerticalNEON(rows, weights, taps, out, count);
+            break;
+#endif
+        default:
+            break;
+    }
+    PBJResampleVerticalScalar(rows, weights, taps, out, x, count);
+}
+
+#pragma mark - horizontal pass
+
+static inline int32_t PBJResampleHorizontalScalarSample(const uint8_t *in, const int16_t *weights, size_t taps, size_t channels)
+{
+    int32_t accumulator = PBJ_RESAMPLE_ROUNDING;
+    for (size_t k = 0; k < taps; k++) {
+        accumulator += weights[k] * in[k * channels];
+    }
+    return accumulator;
+}
+
+#if PBJ_SIMD_SSE2
+
+static inline int32_t PBJResampleHorizontalSSE2Sample(const uint8_t *in, const int16_t *weights, size_t tapStride)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i sum = _mm_setzero_si128();
+    for (size_t k = 0; k < tapStride; k += 8) {
+        __m128i p = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(in + k)), zero);
+        sum = _mm_add_epi32(sum, _mm_madd_epi16(p, _mm_loadu_si128((const __m128i *)(weights + k))));
+    }
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(sum) + PBJ_RESAMPLE_ROUNDING;
+}
+
+#endif
+
+#if PBJ_SIMD_NEON
+
+static inline int32_t PBJResampleHorizontalNEONSample(const uint8_t *in, const int16_t *weights, size_t tapStride)
+{
+    int32x4_t sum = vdupq_n_s32(0);
+    for (size_t k = 0; k < tapStride; k += 8) {
+        int16x8_t p = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(in + k)));
+        int16x8_t w = vld1q_s16(weights + k);
+        sum = vmlal_s16(sum, vget_low_s16(p), vget_low_s16(w));
+        sum = vmlal_s16(sum, vget_high_s16(p), vget_high_s16(w));
+    }
+#if defined(__aarch64__)
+    return vaddvq_s32(sum) + PBJ_RESAMPLE_ROUNDING;
+#else
+    int32x2_t half = vadd_s32(vget_low_s32(sum), vget_high_s32(sum));
+    return vget_lane_s32(vpadd_s32(half, half), 0) + PBJ_RESAMPLE_ROUNDING;
+#endif
+}
+
+#endif
+
+static void PBJResampleHorizontal(const PBJResampleAxis *axis, const uint8_t *in, uint8_t *out, size_t channels, PBJSIMDLevel level)
+{
+    if (axis->identity) {
+        memcpy(out, in, axis->outLength * channels);
+        return;
+    }
+
+    // vector taps are only used for the single channel luma plane when the padded
+    // window still lies inside the row
+    int vector = (channels == 1 && level != PBJSIMDLevelScalar);
+
+    for (size_t i = 0; i < axis->outLength; i++) {
+        const int16_t *weights = axis->weights + i * axis->tapStride;
+        size_t start = axis->start[i];
+        for (size_t c = 0; c < channels; c++) {
+            const uint8_t *samples = in + start * channels + c;
+            int32_t accumulator;
+            if (vector && start + axis->tapStride <= axis->inLength) {
+#if PBJ_SIMD_SSE2
+                accumulator = PBJResampleHorizontalSSE2Sample(samples, weights, axis->tapStride);
+#elif PBJ_SIMD_NEON
+                accumulator = PBJResampleHorizontalNEONSample(samples, weights, axis->tapStride);
+#else
+                accumulator = PBJResampleHorizontalScalarSample(samples, weights, axis->taps, channels);
+#endif
+            } else {
+                accumulator = PBJResampleHorizontalScalarSample(samples, weights, axis->taps, channels);
+            }
+            out[i * channels + c] = PBJResampleClamp(accumulator);
+        }
+    }
+}
+
+#pragma mark - plane
+
+static void PBJResamplePlaneRows(const PBJResampleAxis *columns, const PBJResampleAxis *rows, size_t channels,
+                                 const uint8_t *sourceBase, size_t sourceBytesPerRow, size_t cropX, size_t cropY,
+                                 uint8_t *destinationBase, size_t destinationBytesPerRow,
+                                 size_t rowBegin, size_t rowEnd, uint8_t *scratch, PBJSIMDLevel level)
+{
+    const uint8_t *rowPointers[PBJ_RESAMPLE_MAX_VECTOR_ROWS];
+    size_t rowBytes = columns->inLength * channels;
+
+    for (size_t row = rowBegin; row < rowEnd; row++) {
+        const uint8_t *filtered = NULL;
+
+        if (rows->identity) {
+            filtered = sourceBase + (cropY + row) * sourceBytesPerRow + cropX * channels;
+        } else {
+            const int16_t *weights = rows->weights + row * rows->tapStride;
+            size_t start = rows->start[row];
+            size_t taps = rows->taps;
+            if (taps <= PBJ_RESAMPLE_MAX_VECTOR_ROWS) {
+                for (size_t k = 0; k < taps; k++) {
+                    rowPointers[k] = sourceBase + (cropY + start + k) * sourceBytesPerRow + cropX * channels;
+                }
+                PBJResampleVertical(rowPointers, weights, taps, scratch, rowBytes, level);
+            } else {
+                // extreme downscales, accumulate the whole window directly
+                const uint8_t *first = sourceBase + (cropY + start) * sourceBytesPerRow + cropX * channels;
+                for (size_t x = 0; x < rowBytes; x++) {
+                    int32_t accumulator = PBJ_RESAMPLE_ROUNDING;
+                    for (size_t k = 0; k < taps; k++) {
+                        accumulator += weights[k] * first[k * sourceBytesPerRow + x];
+                    }
+                    scratch[x] = PBJResampleClamp(accumulator);
+                }
+            }
+            filtered = scratch;
+        }
+
+        PBJResampleHorizontal(columns, filtered, destinationBase + row * destinationBytesPerRow, channels, level);
+    }
+}
+
+#pragma mark - public
+
+PBJCropRect PBJCropRectForAspectRatio(size_t sourceWidth, size_t sourceHeight, size_t aspectWidth, size_t aspectHeight)
+{
+    PBJCropRect crop = { 0, 0, sourceWidth & ~(size_t)1, sourceHeight & ~(size_t)1 };
+    if (aspectWidth == 0 || aspectHeight == 0)
+        return crop;
+
+    if ((uint64_t)sourceWidth * aspectHeight > (uint64_t)sourceHeight * aspectWidth) {
+        crop.width = (size_t)(((uint64_t)sourceHeight * aspectWidth / aspectHeight) & ~(uint64_t)1);
+    } else {
+        crop.height = (size_t)(((uint64_t)sourceWidth * aspectHeight / aspectWidth) & ~(uint64_t)1);
+    }
+    crop.x = ((sourceWidth - crop.width) / 2) & ~(size_t)1;
+    crop.y = ((sourceHeight - crop.height) / 2) & ~(size_t)1;
+    return crop;
+}
+
+PBJResampler *PBJResamplerCreate(PBJCropRect crop, size_t destinationWidth, size_t destinationHeight, PBJResampleFilter filter)
+{
+    if ((crop.x | crop.y | crop.width | crop.height | destinationWidth | destinationHeight) & 1)
+        return NULL;
+    if (crop.width == 0 || crop.height == 0 || destinationWidth == 0 || destinationHeight == 0)
+        return NULL;
+
+    PBJResampler *resampler = (PBJResampler *)calloc(1, sizeof(PBJResampler));
+    if (!resampler)
+        return NULL;
+
+    resampler->crop = crop;
+    int ok = PBJResampleAxisInit(&resampler->lumaColumns, crop.width, destinationWidth, filter) &&
+             PBJResampleAxisInit(&resampler->lumaRows, crop.height, destinationHeight, filter) &&
+             PBJResampleAxisInit(&resampler->chromaColumns, crop.width / 2, destinationWidth / 2, filter) &&
+             PBJResampleAxisInit(&resampler->chromaRows, crop.height / 2, destinationHeight / 2, filter);
+    if (!ok) {
+        PBJResamplerDestroy(resampler);
+        return NULL;
+    }
+    return resampler;
+}
+
+void PBJResamplerDestroy(PBJResampler *resampler)
+{
+    if (!resampler)
+        return;
+    PBJResampleAxisDestroy(&resampler->lumaColumns);
+    PBJResampleAxisDestroy(&resampler->lumaRows);
+    PBJResampleAxisDestroy(&resampler->chromaColumns);
+    PBJResampleAxisDestroy(&resampler->chromaRows);
+    free(resampler);
+}
+
+size_t PBJResamplerScratchSize(const PBJResampler *resampler)
+{
+    return resampler ? resampler->crop.width + 64 : 0;
+}
+
+void PBJResamplerProcessRows(const PBJResampler *resampler, const PBJNV12Image *source, PBJNV12Image *destination,
+                             size_t rowBegin, size_t rowEnd, void *scratch, PBJSIMDLevel level)
+{
+    if (!resampler || !source || !destination || !scratch)
+        return;
+
+    const PBJCropRect crop = resampler->crop;
+    if (crop.x + crop.width > source->width || crop.y + crop.height > source->height)
+        return;
+
+    if (rowEnd > resampler->lumaRows.outLength)
+        rowEnd = resampler->lumaRows.outLength;
+    if (rowBegin >= rowEnd)
+        return;
+
+    PBJSIMDLevel resolved = PBJSIMDLevelResolve(level);
+
+    PBJResamplePlaneRows(&resampler->lumaColumns, &resampler->lumaRows, 1,
+                         source->luma, source->lumaBytesPerRow, crop.x, crop.y,
+                         destination->luma, destination->lumaBytesPerRow,
+                         rowBegin, rowEnd, (uint8_t *)scratch, resolved);
+
+    size_t chromaEnd = (rowEnd + 1) / 2;
+    if (chromaEnd > resampler->chromaRows.outLength)
+        chromaEnd = resampler->chromaRows.outLength;
+    PBJResamplePlaneRows(&resampler->chromaColumns, &resampler->chromaRows, 2,
+                         source->chroma, source->chromaBytesPerRow, crop.x / 2, crop.y / 2,
+                         destination->chroma, destination->chromaBytesPerRow,
+                         rowBegin / 2, chromaEnd, (uint8_t *)scratch, resolved);
+}
@@ -0,0 +1,72 @@
+//
+//  PBJResampler.h
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef PBJResampler_h
+#define PBJResampler_h
+
+#include "PBJPlanarImage.h"
+#include "PBJSIMD.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// single-pass crop and resample of NV12 planes, only source pixels inside the
+// crop rect are ever read, weights are precomputed once per geometry
+
+typedef enum {
+    PBJResampleFilterBox = 0,
+    PBJResampleFilterBilinear,
+    PBJResampleFilterLanczos3
+} PBJResampleFilter;
+
+typedef struct {
+    size_t x;
+    size_t y;
+    size_t width;
+    size_t height;
+} PBJCropRect;
+
+// largest centered rect of the given aspect inside the source, even aligned for 4:2:0
+PBJCropRect PBJCropRectForAspectRatio(size_t sourceWidth, size_t sourceHeight, size_t aspectWidth, size_t aspectHeight);
+
+typedef struct PBJResampler PBJResampler;
+
+// crop must be even aligned and lie inside the source, destination dimensions must be even
+PBJResampler *PBJResamplerCreate(PBJCropRect crop, size_t destinationWidth, size_t destinationHeight, PBJResampleFilter filter);
+void PBJResamplerDestroy(PBJResampler *resampler);
+
+// scratch needed by each concurrent caller of PBJResamplerProcessRows
+size_t PBJResamplerScratchSize(const PBJResampler *resampler);
+
+// resamples destination luma rows [rowBegin, rowEnd) and the chroma rows they cover,
+// rowBegin must be even, strips from PBJColorConversionStripRows satisfy this
+void PBJResamplerProcessRows(const PBJResampler *resampler, const PBJNV12Image *source, PBJNV12Image *destination,
+                             size_t rowBegin, size_t rowEnd, void *scratch, PBJSIMDLevel level);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PBJResampler_h */
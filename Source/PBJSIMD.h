@@ -0,0 +1,97 @@
+//
+//  PBJSIMD.h
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef PBJSIMD_h
+#define PBJSIMD_h
+
+// compile-time and run-time selection of the vector instruction set used by the
+// pixel kernels, every kernel also keeps a scalar reference path
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#   define PBJ_SIMD_NEON 1
+#   include <arm_neon.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64)
+#   define PBJ_SIMD_SSE2 1
+#   include <emmintrin.h>
+#   if defined(__GNUC__) || defined(__clang__)
+#       define PBJ_SIMD_AVX2 1
+#       include <immintrin.h>
+#       define PBJ_TARGET_AVX2 __attribute__((target("avx2")))
+#   endif
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    PBJSIMDLevelAuto = 0, // best available
+    PBJSIMDLevelScalar,
+    PBJSIMDLevelSSE2,
+    PBJSIMDLevelAVX2,
+    PBJSIMDLevelNEON
+} PBJSIMDLevel;
+
+static inline PBJSIMDLevel PBJSIMDLevelAvailable(void)
+{
+#if PBJ_SIMD_NEON
+    return PBJSIMDLevelNEON;
+#elif PBJ_SIMD_AVX2
+    static int avx2 = -1;
+    if (avx2 < 0) {
+        avx2 = __builtin_cpu_supports("avx2") ? 1 : 0;
+    }
+    return avx2 ? PBJSIMDLevelAVX2 : PBJSIMDLevelSSE2;
+#elif PBJ_SIMD_SSE2
+    return PBJSIMDLevelSSE2;
+#else
+    return PBJSIMDLevelScalar;
+#endif
+}
+
+// resolves a requested level against what this build and cpu can actually run
+static inline PBJSIMDLevel PBJSIMDLevelResolve(PBJSIMDLevel level)
+{
+    PBJSIMDLevel available = PBJSIMDLevelAvailable();
+    switch (level) {
+        case PBJSIMDLevelScalar:
+            return PBJSIMDLevelScalar;
+        case PBJSIMDLevelSSE2:
+            return (available == PBJSIMDLevelSSE2 || available == PBJSIMDLevelAVX2) ? PBJSIMDLevelSSE2 : PBJSIMDLevelScalar;
+        case PBJSIMDLevelAVX2:
+        case PBJSIMDLevelNEON:
+            return (available == level) ? level : PBJSIMDLevelScalar;
+        case PBJSIMDLevelAuto:
+        default:
+            return available;
+    }
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PBJSIMD_h */
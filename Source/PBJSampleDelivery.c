@@ -0,0 +1,283 @@
+//
+//  PBJSampleDelivery.c
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#if defined(__linux__)
+#   define _POSIX_C_SOURCE 200112L
+#endif
+
+#include "PBJSampleDelivery.h"
+#include "PBJFrameMailbox.h"
+#include "PBJSampleRing.h"
+
+#include <stdatomic.h>
+#include <stdlib.h>
+
+struct PBJSampleDelivery {
+    PBJSampleDeliveryCallbacks callbacks;
+    PBJRateGovernor *governor;
+    PBJInstrumentation *instrumentation;
+
+    // thumbnail requests, times from the first thumbnail frame, each frame only checks the heads
+    PBJThumbnailRequests pendingTimes;
+    PBJThumbnailRequests pendingFrames;
+    int64_t frameCount;
+    int64_t firstTime;
+    int hasFirstTime;
+
+    PBJBestFrameWindow *frameSelection;
+    PBJFrameMailbox *mailboxes[PBJSampleDeliveryWakeDelegateAudio]; // by wake, render and delegate video
+    PBJSampleRing *audioRing;
+    _Atomic(int) audioWakePending;
+    PBJSampleDeliveryWake wakes[PBJSampleDeliveryWakeCount];
+
+    PBJSampleDeliveryCounters counters;
+};
+
+// held samples go back through the owner
+static void PBJSampleDeliveryReleaseHeld(void *context, void *sample)
+{
+    PBJSampleDelivery *delivery = (PBJSampleDelivery *)context;
+    delivery->callbacks.releaseSample(delivery->callbacks.context, sample);
+}
+
+PBJSampleDelivery *PBJSampleDeliveryCreate(PBJSampleDeliveryCallbacks callbacks, size_t frameSelectionCapacity, size_t audioCapacity)
+{
+    if (!callbacks.retainSample || !callbacks.releaseSample || !callbacks.sendWake)
+        return NULL;
+
+    PBJSampleDelivery *delivery = (PBJSampleDelivery *)calloc(1, sizeof(PBJSampleDelivery));
+    if (!delivery)
+        return NULL;
+
+    delivery->callbacks = callbacks;
+    delivery->frameSelection = PBJBestFrameWindowCreate(0, frameSelectionCapacity, PBJSampleDeliveryReleaseHeld, delivery);
+    delivery->mailboxes[PBJSampleDeliveryWakeRender] = PBJFrameMailboxCreate(PBJSampleDeliveryReleaseHeld, delivery);
+    delivery->mailboxes[PBJSampleDeliveryWakeDelegateVideo] = PBJFrameMailboxCreate(PBJSampleDeliveryReleaseHeld, delivery);
+    delivery->audioRing = PBJSampleRingCreate(audioCapacity);
+    atomic_init(&delivery->audioWakePending, 0);
+    if (!delivery->frameSelection || !delivery->mailboxes[PBJSampleDeliveryWakeRender] ||
+        !delivery->mailboxes[PBJSampleDeliveryWakeDelegateVideo] || !delivery->audioRing) {
+        PBJSampleDeliveryDestroy(delivery);
+        return NULL;
+    }
+    for (int type = 0; type < PBJSampleDeliveryWakeCount; type++) {
+        delivery->wakes[type].delivery = delivery;
+        delivery->wakes[type].type = (PBJSampleDeliveryWakeType)type;
+    }
+    return delivery;
+}
+
+void PBJSampleDeliveryDestroy(PBJSampleDelivery *delivery)
+{
+    if (!delivery)
+        return;
+
+    PBJFrameMailboxDestroy(delivery->mailboxes[PBJSampleDeliveryWakeRender]);
+    PBJFrameMailboxDestroy(delivery->mailboxes[PBJSampleDeliveryWakeDelegateVideo]);
+    if (delivery->audioRing) {
+        void *audio = NULL;
+        while ((audio = PBJSampleRingPop(delivery->audioRing)))
+            PBJSampleDeliveryReleaseHeld(delivery, audio);
+        PBJSampleRingDestroy(delivery->audioRing);
+    }
+    PBJBestFrameWindowDestroy(delivery->frameSelection);
+    PBJThumbnailRequestsDestroy(&delivery->pendingTimes);
+    PBJThumbnailRequestsDestroy(&delivery->pendingFrames);
+    free(delivery);
+}
+
+#pragma mark - capture queue
+
+void PBJSampleDeliverySetRateGovernor(PBJSampleDelivery *delivery, PBJRateGovernor *governor)
+{
+    delivery->governor = governor;
+}
+
+void PBJSampleDeliverySetInstrumentation(PBJSampleDelivery *delivery, PBJInstrumentation *instrumentation)
+{
+    delivery->instrumentation = instrumentation;
+}
+
+void PBJSampleDeliveryReset(PBJSampleDelivery *delivery)
+{
+    PBJThumbnailRequestsReset(&delivery->pendingTimes);
+    PBJThumbnailRequestsReset(&delivery->pendingFrames);
+    delivery->frameCount = 0;
+    delivery->firstTime = 0;
+    delivery->hasFirstTime = 0;
+    PBJBestFrameWindowClear(delivery->frameSelection);
+}
+
+int PBJSampleDeliveryRequestThumbnailAtTime(PBJSampleDelivery *delivery, int64_t time)
+{
+    return PBJThumbnailRequestsInsert(&delivery->pendingTimes, time);
+}
+
+int PBJSampleDeliveryRequestThumbnailAtFrame(PBJSampleDelivery *delivery, int64_t frame)
+{
+    if (frame < 0)
+        return 0;
+    return PBJThumbnailRequestsInsert(&delivery->pendingFrames, frame);
+}
+
+int PBJSampleDeliveryRequestThumbnailAtNextFrame(PBJSampleDelivery *delivery)
+{
+    return PBJThumbnailRequestsInsert(&delivery->pendingFrames, delivery->frameCount);
+}
+
+int PBJSampleDeliveryHasThumbnailRequests(const PBJSampleDelivery *delivery)
+{
+    return delivery->pendingTimes.count > 0 || delivery->pendingFrames.count > 0;
+}
+
+int PBJSampleDeliveryAdmitFrame(PBJSampleDelivery *delivery, int64_t time)
+{
+    if (PBJRateGovernorAdmitFrame(delivery->governor, time))
+        return 1;
+    delivery->counters.framesPassedOver++;
+    return 0;
+}
+
+// the wake is free to fill in, its previous trip has been received
+static void PBJSampleDeliverySendWake(PBJSampleDelivery *delivery, PBJSampleDeliveryWakeType type)
+{
+    PBJSampleDeliveryWake *wake = &delivery->wakes[type];
+    wake->owner = NULL;
+    wake->instrumentation = delivery->instrumentation;
+    wake->start = delivery->instrumentation ? PBJInstrumentationNow() : 0;
+    delivery->counters.wakesSent[type]++;
+    delivery->callbacks.sendWake(delivery->callbacks.context, wake);
+}
+
+// the receiver never holds up capture, a wake is only sent when the mailbox was empty
+static void PBJSampleDeliveryPostFrame(PBJSampleDelivery *delivery, PBJSampleDeliveryWakeType type, void *frame)
+{
+    delivery->callbacks.retainSample(delivery->callbacks.context, frame);
+    if (!PBJFrameMailboxPost(delivery->mailboxes[type], frame)) {
+        delivery->counters.framesSuperseded++;
+        PBJInstrumentationIncrementCounter(delivery->instrumentation, PBJInstrumentationCounterFramesSuperseded);
+        return;
+    }
+    if (type == PBJSampleDeliveryWakeDelegateVideo)
+        PBJInstrumentationAddToCounter(delivery->instrumentation, PBJInstrumentationCounterDelegateBacklog, 1);
+    PBJSampleDeliverySendWake(delivery, type);
+}
+
+void PBJSampleDeliveryDeliverFrame(PBJSampleDelivery *delivery, void *frame, int64_t time, const PBJSampleDeliveryRoutes *routes)
+{
+    delivery->counters.framesDelivered++;
+
+    // scored only when something chooses between frames
+    int selectsFrames = routes->frameSelectionInterval > 0;
+    int scoresThumbnails = routes->thumbnails && routes->scoresThumbnails;
+    float score = 0;
+    if ((selectsFrames || scoresThumbnails) && delivery->callbacks.scoreFrame)
+        score = delivery->callbacks.scoreFrame(delivery->callbacks.context, frame);
+
+    if (routes->thumbnails) {
+        if (!delivery->hasFirstTime) {
+            delivery->firstTime = time;
+            delivery->hasFirstTime = 1;
+        }
+        // a request already passed is taken by this frame
+        int requested = PBJThumbnailRequestsConsume(&delivery->pendingFrames, delivery->frameCount++);
+        requested = PBJThumbnailRequestsConsume(&delivery->pendingTimes, time - delivery->firstTime) || requested;
+        if (delivery->callbacks.thumbnailFrame)
+            delivery->callbacks.thumbnailFrame(delivery->callbacks.context, frame, score, requested);
+    }
+
+    if (selectsFrames) {
+        PBJBestFrameWindowSetDuration(delivery->frameSelection, routes->frameSelectionInterval);
+        delivery->callbacks.retainSample(delivery->callbacks.context, frame);
+        PBJBestFrameWindowOffer(delivery->frameSelection, frame, time, score);
+    }
+
+    if (routes->render)
+        PBJSampleDeliveryPostFrame(delivery, PBJSampleDeliveryWakeRender, frame);
+    if (routes->delegateVideo)
+        PBJSampleDeliveryPostFrame(delivery, PBJSampleDeliveryWakeDelegateVideo, frame);
+}
+
+void PBJSampleDeliveryDeliverAudio(PBJSampleDelivery *delivery, void *audio, const PBJSampleDeliveryRoutes *routes)
+{
+    delivery->counters.audioDelivered++;
+    if (!routes->delegateAudio)
+        return;
+
+    void *dropped = NULL;
+    delivery->callbacks.retainSample(delivery->callbacks.context, audio);
+    PBJSampleRingPush(delivery->audioRing, audio, PBJSampleRingOverflowDropOldest, &dropped);
+    if (dropped) {
+        delivery->counters.audioDropped++;
+        PBJInstrumentationIncrementCounter(delivery->instrumentation, PBJInstrumentationCounterAudioSamplesDropped);
+        PBJSampleDeliveryReleaseHeld(delivery, dropped);
+    }
+
+    // one wake empties the ring, buffers pushed once it has been received send another
+    if (!atomic_exchange(&delivery->audioWakePending, 1))
+        PBJSampleDeliverySendWake(delivery, PBJSampleDeliveryWakeDelegateAudio);
+}
+
+PBJBestFrameWindow *PBJSampleDeliveryGetFrameSelectionWindow(PBJSampleDelivery *delivery)
+{
+    return delivery->frameSelection;
+}
+
+PBJSampleDeliveryCounters PBJSampleDeliveryGetCounters(const PBJSampleDelivery *delivery)
+{
+    return delivery->counters;
+}
+
+#pragma mark - receiving queue
+
+PBJSampleDeliveryWake PBJSampleDeliveryReceiveWake(PBJSampleDeliveryWake *wake)
+{
+    PBJSampleDeliveryWake received = *wake;
+    switch (received.type) {
+        case PBJSampleDeliveryWakeDelegateVideo:
+            PBJInstrumentationRecordSince(received.instrumentation, PBJInstrumentationStageDelegateDispatch, received.start);
+            PBJInstrumentationAddToCounter(received.instrumentation, PBJInstrumentationCounterDelegateBacklog, -1);
+            break;
+        case PBJSampleDeliveryWakeDelegateAudio:
+            // buffers pushed from here on send a wake of their own
+            atomic_store(&received.delivery->audioWakePending, 0);
+            break;
+        case PBJSampleDeliveryWakeRender:
+        default:
+            break;
+    }
+    return received;
+}
+
+void *PBJSampleDeliveryTakeFrame(PBJSampleDelivery *delivery, PBJSampleDeliveryWakeType type)
+{
+    if (type != PBJSampleDeliveryWakeRender && type != PBJSampleDeliveryWakeDelegateVideo)
+        return NULL;
+    return PBJFrameMailboxTake(delivery->mailboxes[type]);
+}
+
+void *PBJSampleDeliveryTakeAudio(PBJSampleDelivery *delivery)
+{
+    return PBJSampleRingPop(delivery->audioRing);
+}
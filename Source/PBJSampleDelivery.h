@@ -0,0 +1,152 @@
+//
+//  PBJSampleDelivery.h
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#ifndef PBJSampleDelivery_h
+#define PBJSampleDelivery_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "PBJFrameAnalyzer.h"
+#include "PBJInstrumentation.h"
+#include "PBJRateGovernor.h"
+#include "PBJThumbnailRequests.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// what happens to each sample around its write, in a fixed order. a frame is admitted by the rate
+// governor before any work is spent on it. once the writer has taken it, the frame is numbered
+// against the thumbnail requests, scored when something chooses between frames, offered to the
+// frame selection window and posted to the render and delegate mailboxes. audio goes to the
+// delegate ring. the main queue is reached through one reused wake of each kind, sent only once
+// the last has been received, which carries the time it was sent. samples are opaque (ie
+// CMSampleBufferRef) and held with the owner's retain and release. nothing here allocates after
+// create, except a thumbnail request that needs room. the capture side is confined to one queue,
+// receiving wakes and taking what they announce to another (main)
+
+typedef enum {
+    PBJSampleDeliveryWakeRender = 0, // the latest frame, for rendering or a photo
+    PBJSampleDeliveryWakeDelegateVideo, // the latest frame, for the delegate
+    PBJSampleDeliveryWakeDelegateAudio, // every buffer in the ring, for the delegate
+    PBJSampleDeliveryWakeCount
+} PBJSampleDeliveryWakeType;
+
+typedef struct PBJSampleDelivery PBJSampleDelivery;
+
+typedef struct {
+    PBJSampleDelivery *delivery;
+    PBJSampleDeliveryWakeType type;
+    void *owner; // the owner's, ie the PBJVision held while the wake is in flight
+    PBJInstrumentation *instrumentation; // as of the send
+    uint64_t start; // when sent, 0 without instrumentation
+} PBJSampleDeliveryWake;
+
+typedef struct {
+    void *context;
+    void (*retainSample)(void *context, void *sample);
+    void (*releaseSample)(void *context, void *sample);
+    // higher is better, only asked when the thumbnails or the frame selection choose between frames
+    float (*scoreFrame)(void *context, void *frame);
+    // a written frame for the thumbnails, requested when a thumbnail request has come due
+    void (*thumbnailFrame)(void *context, void *frame, float score, int requested);
+    // hands wake to the receiving queue, which passes it to PBJSampleDeliveryReceiveWake
+    void (*sendWake)(void *context, PBJSampleDeliveryWake *wake);
+} PBJSampleDeliveryCallbacks;
+
+// where written samples go, read with every sample since the owner's settings change under it
+typedef struct {
+    int thumbnails;
+    int scoresThumbnails; // the thumbnails keep the best scoring frame
+    int64_t frameSelectionInterval; // nanoseconds of frames held for choosing a photo, 0 for none
+    int render;
+    int delegateVideo;
+    int delegateAudio;
+} PBJSampleDeliveryRoutes;
+
+typedef struct {
+    uint64_t framesPassedOver; // not admitted by the governor
+    uint64_t framesDelivered;
+    uint64_t framesSuperseded; // replaced in a mailbox before they were taken
+    uint64_t audioDelivered;
+    uint64_t audioDropped; // the oldest of a full ring
+    uint64_t wakesSent[PBJSampleDeliveryWakeCount];
+} PBJSampleDeliveryCounters;
+
+// frameSelectionCapacity bounds the frames held back for choosing, audioCapacity the delegate ring
+PBJSampleDelivery *PBJSampleDeliveryCreate(PBJSampleDeliveryCallbacks callbacks, size_t frameSelectionCapacity, size_t audioCapacity);
+// releases every sample still held
+void PBJSampleDeliveryDestroy(PBJSampleDelivery *delivery);
+
+#pragma mark - capture queue
+
+// borrowed, NULL admits every frame
+void PBJSampleDeliverySetRateGovernor(PBJSampleDelivery *delivery, PBJRateGovernor *governor);
+// borrowed, NULL records nothing
+void PBJSampleDeliverySetInstrumentation(PBJSampleDelivery *delivery, PBJInstrumentation *instrumentation);
+
+// a new recording, frame numbers and thumbnail times start over, requests are forgotten and
+// the frame selection window empties
+void PBJSampleDeliveryReset(PBJSampleDelivery *delivery);
+
+// times in nanoseconds from the first thumbnail frame, a request already passed is taken by the
+// next frame. return 0 when memory runs out or for a negative frame
+int PBJSampleDeliveryRequestThumbnailAtTime(PBJSampleDelivery *delivery, int64_t time);
+int PBJSampleDeliveryRequestThumbnailAtFrame(PBJSampleDelivery *delivery, int64_t frame);
+int PBJSampleDeliveryRequestThumbnailAtNextFrame(PBJSampleDelivery *delivery);
+// requests no frame has reached yet
+int PBJSampleDeliveryHasThumbnailRequests(const PBJSampleDelivery *delivery);
+
+// times are nanoseconds on the file's timeline. 0 when the frame should be passed over
+int PBJSampleDeliveryAdmitFrame(PBJSampleDelivery *delivery, int64_t time);
+
+// a frame or audio buffer the writer has taken, retained for as long as anything holds it
+void PBJSampleDeliveryDeliverFrame(PBJSampleDelivery *delivery, void *frame, int64_t time, const PBJSampleDeliveryRoutes *routes);
+// a full ring loses its oldest buffer, a delegate that falls behind never holds up capture
+void PBJSampleDeliveryDeliverAudio(PBJSampleDelivery *delivery, void *audio, const PBJSampleDeliveryRoutes *routes);
+
+// the frames held for choosing a photo or thumbnail, confined to the capture queue
+PBJBestFrameWindow *PBJSampleDeliveryGetFrameSelectionWindow(PBJSampleDelivery *delivery);
+
+PBJSampleDeliveryCounters PBJSampleDeliveryGetCounters(const PBJSampleDelivery *delivery);
+
+#pragma mark - receiving queue
+
+// reads a wake that has arrived, after which the next of its kind may be sent, so call it before
+// taking what the wake announced. records the delegate's dispatch time and backlog
+PBJSampleDeliveryWake PBJSampleDeliveryReceiveWake(PBJSampleDeliveryWake *wake);
+
+// the latest frame of a render or delegate video wake, ownership passes to the caller, NULL when
+// a later wake's frame has already been taken
+void *PBJSampleDeliveryTakeFrame(PBJSampleDelivery *delivery, PBJSampleDeliveryWakeType type);
+// the oldest waiting audio buffer, ownership passes to the caller, NULL once the ring is empty
+void *PBJSampleDeliveryTakeAudio(PBJSampleDelivery *delivery);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PBJSampleDelivery_h */
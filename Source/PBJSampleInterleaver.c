@@ -0,0 +1,367 @@
+//
+//  PBJSampleInterleaver.c
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#include "PBJSampleInterleaver.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define PBJ_INTERLEAVER_NSEC_PER_SEC 1000000000LL
+
+typedef struct {
+    PBJCaptureSample sample;
+    double start; // seconds
+    uint64_t sequence; // arrival order across both tracks
+} PBJInterleavedSample;
+
+typedef struct {
+    PBJInterleavedSample *entries; // ring, one beyond capacity so a push always fits before the next take
+    size_t size;
+    size_t head;
+    size_t count;
+    size_t capacity;
+    int enabled;
+
+    // how far the track has been delivered, the start of a frame or the end of a buffer
+    int seen;
+    double latest;
+    double latestStart;
+
+    int released;
+    double lastReleased;
+} PBJInterleaverTrack;
+
+struct PBJSampleInterleaver {
+    double maximumDelay; // seconds
+    PBJInterleaverTrack tracks[PBJCaptureTrackCount];
+    uint64_t sequence;
+    double newest;
+
+    int hasVideoStart;
+    PBJTime videoStart;
+
+    PBJSampleInterleaverStatistics statistics;
+    double releaseSkewSum;
+    uint64_t releaseSkewCount;
+};
+
+PBJSampleInterleaverConfiguration PBJSampleInterleaverDefaultConfiguration(void)
+{
+    PBJSampleInterleaverConfiguration configuration;
+    configuration.maximumDelay = PBJ_INTERLEAVER_NSEC_PER_SEC / 10;
+    configuration.capacity[PBJCaptureTrackVideo] = 4;
+    configuration.capacity[PBJCaptureTrackAudio] = 16;
+    return configuration;
+}
+
+PBJSampleInterleaver *PBJSampleInterleaverCreate(const PBJSampleInterleaverConfiguration *configuration)
+{
+    PBJSampleInterleaver *interleaver = (PBJSampleInterleaver *)calloc(1, sizeof(PBJSampleInterleaver));
+    if (!interleaver)
+        return NULL;
+
+    PBJSampleInterleaverConfiguration defaults = PBJSampleInterleaverDefaultConfiguration();
+    if (!configuration)
+        configuration = &defaults;
+
+    interleaver->maximumDelay = (double)configuration->maximumDelay / (double)PBJ_INTERLEAVER_NSEC_PER_SEC;
+    for (int i = 0; i < PBJCaptureTrackCount; i++) {
+        PBJInterleaverTrack *track = &interleaver->tracks[i];
+        track->capacity = configuration->capacity[i] > 0 ? configuration->capacity[i] : 1;
+        track->size = track->capacity + 1;
+        track->entries = (PBJInterleavedSample *)calloc(track->size, sizeof(PBJInterleavedSample));
+        track->enabled = 1;
+        if (!track->entries) {
+            PBJSampleInterleaverDestroy(interleaver);
+            return NULL;
+        }
+    }
+    PBJSampleInterleaverReset(interleaver);
+    return interleaver;
+}
+
+void PBJSampleInterleaverDestroy(PBJSampleInterleaver *interleaver)
+{
+    if (!interleaver)
+        return;
+    for (int i = 0; i < PBJCaptureTrackCount; i++)
+        free(interleaver->tracks[i].entries);
+    free(interleaver);
+}
+
+void PBJSampleInterleaverReset(PBJSampleInterleaver *interleaver)
+{
+    for (int i = 0; i < PBJCaptureTrackCount; i++) {
+        PBJInterleaverTrack *track = &interleaver->tracks[i];
+        track->head = 0;
+        track->count = 0;
+        track->seen = 0;
+        track->latest = 0;
+        track->latestStart = 0;
+        track->released = 0;
+        track->lastReleased = 0;
+    }
+    interleaver->sequence = 0;
+    interleaver->newest = 0;
+    interleaver->hasVideoStart = 0;
+    interleaver->videoStart = PBJTimeMake(0, 0);
+    memset(&interleaver->statistics, 0, sizeof(interleaver->statistics));
+    interleaver->releaseSkewSum = 0;
+    interleaver->releaseSkewCount = 0;
+}
+
+void PBJSampleInterleaverSetTrackEnabled(PBJSampleInterleaver *interleaver, PBJCaptureTrack track, int enabled)
+{
+    if (track < 0 || track >= PBJCaptureTrackCount)
+        return;
+    interleaver->tracks[track].enabled = enabled ? 1 : 0;
+}
+
+#pragma mark - trimming
+
+static int64_t PBJInterleaverFloorDivide(int64_t a, int64_t b)
+{
+    int64_t q = a / b;
+    if ((a % b != 0) && ((a < 0) != (b < 0)))
+        q--;
+    return q;
+}
+
+// time in another timescale, rounded up, exact while both timescales fit in 32 bits
+static int PBJInterleaverConvertRoundingUp(PBJTime time, int64_t timescale, int64_t *result)
+{
+    int64_t whole = PBJInterleaverFloorDivide(time.value, time.timescale);
+    int64_t remainder = time.value - whole * time.timescale;
+    int64_t part = 0;
+    if (__builtin_mul_overflow(whole, timescale, &whole) || __builtin_mul_overflow(remainder, timescale, &part))
+        return 0;
+    int64_t fraction = part / time.timescale + (part % time.timescale != 0 ? 1 : 0);
+    return !__builtin_add_overflow(whole, fraction, result);
+}
+
+typedef enum {
+    PBJInterleaverTrimNone = 0,
+    PBJInterleaverTrimCut,
+    PBJInterleaverTrimDrop
+} PBJInterleaverTrim;
+
+// moves audio that begins before the video start up to it, to the first tick of its own
+// timescale at or after the start
+static PBJInterleaverTrim PBJInterleaverTrimToVideoStart(const PBJSampleInterleaver *interleaver, PBJCaptureSample *sample)
+{
+    PBJTime timestamp = sample->presentationTimestamp;
+    int64_t start = 0;
+    if (!PBJInterleaverConvertRoundingUp(interleaver->videoStart, timestamp.timescale, &start))
+        return PBJInterleaverTrimDrop;
+    if (start <= timestamp.value)
+        return PBJInterleaverTrimNone;
+
+    // without a duration there is no telling what is left of it
+    if (!PBJTimeIsValid(sample->duration))
+        return PBJInterleaverTrimDrop;
+
+    int64_t cut = start - timestamp.value;
+    if (sample->duration.timescale != timestamp.timescale &&
+        !PBJInterleaverConvertRoundingUp(PBJTimeMake(cut, timestamp.timescale), sample->duration.timescale, &cut))
+        return PBJInterleaverTrimDrop;
+    if (cut >= sample->duration.value)
+        return PBJInterleaverTrimDrop;
+
+    sample->presentationTimestamp.value = start;
+    sample->duration.value -= cut;
+    return PBJInterleaverTrimCut;
+}
+
+#pragma mark - samples
+
+int PBJSampleInterleaverPush(PBJSampleInterleaver *interleaver, const PBJCaptureSample *sample)
+{
+    if (sample->track < 0 || sample->track >= PBJCaptureTrackCount || !PBJTimeIsValid(sample->presentationTimestamp))
+        return 0;
+
+    PBJInterleaverTrack *track = &interleaver->tracks[sample->track];
+    if (track->count == track->size)
+        return 0;
+
+    PBJInterleavedSample *entry = &track->entries[(track->head + track->count) % track->size];
+    entry->sample = *sample;
+    entry->start = PBJTimeGetSeconds(sample->presentationTimestamp);
+    entry->sequence = interleaver->sequence++;
+    track->count++;
+
+    track->seen = 1;
+    track->latestStart = entry->start;
+    track->latest = entry->start;
+    if (sample->track == PBJCaptureTrackAudio && PBJTimeIsValid(sample->duration))
+        track->latest += PBJTimeGetSeconds(sample->duration);
+    if (entry->start > interleaver->newest || entry->sequence == 0)
+        interleaver->newest = entry->start;
+
+    // the first frame starts the recording
+    if (sample->track == PBJCaptureTrackVideo && !interleaver->hasVideoStart) {
+        interleaver->hasVideoStart = 1;
+        interleaver->videoStart = sample->presentationTimestamp;
+    }
+
+    PBJSampleInterleaverStatistics *statistics = &interleaver->statistics;
+    if (sample->track == PBJCaptureTrackAudio && !interleaver->hasVideoStart)
+        statistics->audioHeld++;
+
+    const PBJInterleaverTrack *video = &interleaver->tracks[PBJCaptureTrackVideo];
+    const PBJInterleaverTrack *audio = &interleaver->tracks[PBJCaptureTrackAudio];
+    if (video->seen && audio->seen) {
+        double skew = video->latestStart > audio->latestStart ? video->latestStart - audio->latestStart : audio->latestStart - video->latestStart;
+        int64_t nanoseconds = (int64_t)(skew * (double)PBJ_INTERLEAVER_NSEC_PER_SEC);
+        if (nanoseconds > statistics->maximumArrivalSkew)
+            statistics->maximumArrivalSkew = nanoseconds;
+    }
+
+    size_t held = video->count + audio->count;
+    if (held > statistics->maximumHeld)
+        statistics->maximumHeld = held;
+    return 1;
+}
+
+static PBJInterleavedSample PBJInterleaverTake(PBJSampleInterleaver *interleaver, PBJCaptureTrack index)
+{
+    PBJInterleaverTrack *track = &interleaver->tracks[index];
+    PBJInterleavedSample entry = track->entries[track->head];
+    track->head = (track->head + 1) % track->size;
+    track->count--;
+    return entry;
+}
+
+static void PBJInterleaverRecordRelease(PBJSampleInterleaver *interleaver, const PBJInterleavedSample *entry, int forced)
+{
+    PBJSampleInterleaverStatistics *statistics = &interleaver->statistics;
+    PBJCaptureTrack index = entry->sample.track;
+    PBJInterleaverTrack *track = &interleaver->tracks[index];
+    const PBJInterleaverTrack *other = &interleaver->tracks[index == PBJCaptureTrackVideo ? PBJCaptureTrackAudio : PBJCaptureTrackVideo];
+
+    statistics->released[index]++;
+    if (forced)
+        statistics->forced++;
+    if (other->count > 0 && other->entries[other->head].sequence < entry->sequence)
+        statistics->reordered++;
+
+    track->released = 1;
+    track->lastReleased = PBJTimeGetSeconds(entry->sample.presentationTimestamp);
+    if (other->released) {
+        double skew = track->lastReleased > other->lastReleased ? track->lastReleased - other->lastReleased : other->lastReleased - track->lastReleased;
+        int64_t nanoseconds = (int64_t)(skew * (double)PBJ_INTERLEAVER_NSEC_PER_SEC);
+        if (nanoseconds > statistics->maximumReleaseSkew)
+            statistics->maximumReleaseSkew = nanoseconds;
+        interleaver->releaseSkewSum += skew;
+        interleaver->releaseSkewCount++;
+        statistics->meanReleaseSkew = (int64_t)(interleaver->releaseSkewSum / (double)interleaver->releaseSkewCount * (double)PBJ_INTERLEAVER_NSEC_PER_SEC);
+    }
+
+    int64_t delay = (int64_t)((interleaver->newest - entry->start) * (double)PBJ_INTERLEAVER_NSEC_PER_SEC);
+    if (delay > statistics->maximumDelay)
+        statistics->maximumDelay = delay;
+}
+
+PBJSampleInterleaverOutput PBJSampleInterleaverNext(PBJSampleInterleaver *interleaver, int drain, PBJCaptureSample *sample)
+{
+    PBJInterleaverTrack *video = &interleaver->tracks[PBJCaptureTrackVideo];
+    PBJInterleaverTrack *audio = &interleaver->tracks[PBJCaptureTrackAudio];
+    int overflowing = video->count > video->capacity || audio->count > audio->capacity;
+
+    // audio is measured against the video start before it is ordered
+    PBJInterleaverTrim trim = PBJInterleaverTrimNone;
+    double audioStart = 0;
+    if (audio->count > 0) {
+        const PBJInterleavedSample *head = &audio->entries[audio->head];
+        PBJCaptureSample trimmed = head->sample;
+        if (interleaver->hasVideoStart) {
+            trim = PBJInterleaverTrimToVideoStart(interleaver, &trimmed);
+        } else if (drain || overflowing || interleaver->newest - head->start > interleaver->maximumDelay) {
+            // early audio waits for the start as long as the window allows
+            trim = PBJInterleaverTrimDrop;
+        } else {
+            return PBJSampleInterleaverOutputNone;
+        }
+        if (trim == PBJInterleaverTrimDrop) {
+            *sample = PBJInterleaverTake(interleaver, PBJCaptureTrackAudio).sample;
+            interleaver->statistics.audioDropped++;
+            return PBJSampleInterleaverOutputDrop;
+        }
+        audioStart = PBJTimeGetSeconds(trimmed.presentationTimestamp);
+    }
+
+    // the earliest head leaves first, video ahead of audio at the same time
+    PBJCaptureTrack index;
+    if (video->count > 0 && (audio->count == 0 || video->entries[video->head].start <= audioStart)) {
+        index = PBJCaptureTrackVideo;
+    } else if (audio->count > 0) {
+        index = PBJCaptureTrackAudio;
+    } else {
+        // drained, whatever arrives next (ie after a pause) is measured afresh
+        if (drain) {
+            for (int i = 0; i < PBJCaptureTrackCount; i++) {
+                interleaver->tracks[i].seen = 0;
+                interleaver->tracks[i].released = 0;
+            }
+        }
+        return PBJSampleInterleaverOutputNone;
+    }
+
+    PBJInterleaverTrack *track = &interleaver->tracks[index];
+    PBJInterleaverTrack *other = index == PBJCaptureTrackVideo ? audio : video;
+    double start = index == PBJCaptureTrackVideo ? track->entries[track->head].start : audioStart;
+
+    // nothing of the other track can still arrive ahead of the head
+    int caughtUp = !other->enabled || other->count > 0 || (other->seen && other->latest >= start);
+    int forced = !caughtUp && !drain;
+    if (forced && !overflowing && interleaver->newest - start <= interleaver->maximumDelay)
+        return PBJSampleInterleaverOutputNone;
+
+    PBJInterleavedSample entry = PBJInterleaverTake(interleaver, index);
+    if (index == PBJCaptureTrackAudio && trim == PBJInterleaverTrimCut) {
+        PBJInterleaverTrimToVideoStart(interleaver, &entry.sample);
+        entry.start = audioStart;
+        interleaver->statistics.audioTrimmed++;
+    }
+    PBJInterleaverRecordRelease(interleaver, &entry, forced);
+    *sample = entry.sample;
+    return PBJSampleInterleaverOutputRelease;
+}
+
+#pragma mark - queries
+
+size_t PBJSampleInterleaverGetCount(const PBJSampleInterleaver *interleaver)
+{
+    return interleaver->tracks[PBJCaptureTrackVideo].count + interleaver->tracks[PBJCaptureTrackAudio].count;
+}
+
+int PBJSampleInterleaverHasVideoStart(const PBJSampleInterleaver *interleaver)
+{
+    return interleaver->hasVideoStart;
+}
+
+PBJSampleInterleaverStatistics PBJSampleInterleaverGetStatistics(const PBJSampleInterleaver *interleaver)
+{
+    return interleaver->statistics;
+}
@@ -0,0 +1,109 @@
+//
+//  PBJSampleInterleaver.h
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+
+#ifndef PBJSampleInterleaver_h
+#define PBJSampleInterleaver_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "PBJCapturePipeline.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// holds samples briefly so audio and video leave in presentation order, whatever order the
+// two outputs delivered them in. audio that arrives before the first video frame is held
+// until that frame gives the recording its start, then cut to it, a buffer that straddles
+// the start comes back with its timestamp moved up to it and its duration shortened. a
+// sample waits only until the other track has caught up with it, or the window or its
+// track's capacity runs out. payloads are carried, never retained or released here.
+// not thread safe, confine to one queue
+
+#pragma mark - configuration
+
+typedef struct {
+    int64_t maximumDelay; // nanoseconds a sample may wait behind the newest timestamp seen
+    size_t capacity[PBJCaptureTrackCount]; // samples held per track, video holds capture buffers
+} PBJSampleInterleaverConfiguration;
+
+// 100ms, 4 video frames and 16 audio buffers
+PBJSampleInterleaverConfiguration PBJSampleInterleaverDefaultConfiguration(void);
+
+#pragma mark - statistics
+
+typedef struct {
+    uint64_t released[PBJCaptureTrackCount];
+    uint64_t reordered; // released ahead of a sample of the other track that arrived earlier
+    uint64_t forced; // released before the other track caught up
+    uint64_t audioHeld; // arrived before the video start was known
+    uint64_t audioTrimmed; // straddled the video start
+    uint64_t audioDropped; // ended by the video start, or held too long without one
+    size_t maximumHeld;
+    int64_t maximumArrivalSkew; // nanoseconds between the two tracks' latest timestamps as they arrived
+    int64_t maximumReleaseSkew; // the same as they were released, about a sample's duration once interleaved
+    int64_t meanReleaseSkew;
+    int64_t maximumDelay; // the longest any released sample trailed the newest timestamp seen
+} PBJSampleInterleaverStatistics;
+
+#pragma mark - interleaver
+
+typedef enum {
+    PBJSampleInterleaverOutputNone = 0, // nothing can leave yet
+    PBJSampleInterleaverOutputRelease, // write it
+    PBJSampleInterleaverOutputDrop // audio before the video start, only the payload is of use
+} PBJSampleInterleaverOutput;
+
+typedef struct PBJSampleInterleaver PBJSampleInterleaver;
+
+PBJSampleInterleaver *PBJSampleInterleaverCreate(const PBJSampleInterleaverConfiguration *configuration);
+void PBJSampleInterleaverDestroy(PBJSampleInterleaver *interleaver);
+
+// forgets the video start, the tracks' progress and the statistics, held samples must have
+// been taken out first
+void PBJSampleInterleaverReset(PBJSampleInterleaver *interleaver);
+
+// a disabled track is never waited on (the default is both enabled)
+void PBJSampleInterleaverSetTrackEnabled(PBJSampleInterleaver *interleaver, PBJCaptureTrack track, int enabled);
+
+// takes the sample, the payload must stay valid until it leaves. timestamps must rise on each
+// track, returns 0 when the track's queue is full, take samples out after every push
+int PBJSampleInterleaverPush(PBJSampleInterleaver *interleaver, const PBJCaptureSample *sample);
+
+// the next sample to leave, repeat until none. drain lets everything held go, ie before a
+// pause or the end of the recording, early audio with no video start is dropped
+PBJSampleInterleaverOutput PBJSampleInterleaverNext(PBJSampleInterleaver *interleaver, int drain, PBJCaptureSample *sample);
+
+size_t PBJSampleInterleaverGetCount(const PBJSampleInterleaver *interleaver);
+int PBJSampleInterleaverHasVideoStart(const PBJSampleInterleaver *interleaver);
+PBJSampleInterleaverStatistics PBJSampleInterleaverGetStatistics(const PBJSampleInterleaver *interleaver);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PBJSampleInterleaver_h */
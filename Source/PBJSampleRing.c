@@ -0,0 +1,174 @@
+//
+//  PBJSampleRing.c
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#if defined(__linux__)
+#   define _POSIX_C_SOURCE 200112L
+#endif
+
+#include "PBJSampleRing.h"
+
+#include <stdatomic.h>
+#include <stdlib.h>
+
+// head and tail are free running counters, the slot index is counter % capacity.
+// counters are only ever stored by a single side so they need no read-modify-write
+
+#define PBJ_SAMPLE_RING_CACHE_LINE 64
+
+struct PBJSampleRing {
+    _Alignas(PBJ_SAMPLE_RING_CACHE_LINE) _Atomic(size_t) head; // next entry to consume
+    _Alignas(PBJ_SAMPLE_RING_CACHE_LINE) _Atomic(size_t) tail; // next slot to fill, producer only
+    _Atomic(uint64_t) enqueued;
+    _Atomic(uint64_t) dropped;
+    _Alignas(PBJ_SAMPLE_RING_CACHE_LINE) _Atomic(uint64_t) dequeued;
+    _Alignas(PBJ_SAMPLE_RING_CACHE_LINE) size_t capacity;
+    _Atomic(void *) *slots;
+};
+
+static inline void PBJSampleRingIncrement(_Atomic(uint64_t) *counter)
+{
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + 1, memory_order_relaxed);
+}
+
+PBJSampleRing *PBJSampleRingCreate(size_t capacity)
+{
+    if (capacity == 0)
+        return NULL;
+
+    PBJSampleRing *ring = NULL;
+    if (posix_memalign((void **)&ring, PBJ_SAMPLE_RING_CACHE_LINE, sizeof(PBJSampleRing)) != 0)
+        return NULL;
+
+    ring->slots = (_Atomic(void *) *)calloc(capacity, sizeof(_Atomic(void *)));
+    if (!ring->slots) {
+        free(ring);
+        return NULL;
+    }
+
+    ring->capacity = capacity;
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->enqueued, 0);
+    atomic_init(&ring->dropped, 0);
+    atomic_init(&ring->dequeued, 0);
+    for (size_t i = 0; i < capacity; i++) {
+        atomic_init(&ring->slots[i], NULL);
+    }
+    return ring;
+}
+
+void PBJSampleRingDestroy(PBJSampleRing *ring)
+{
+    if (!ring)
+        return;
+    free((void *)ring->slots);
+    free(ring);
+}
+
+size_t PBJSampleRingCapacity(const PBJSampleRing *ring)
+{
+    return ring ? ring->capacity : 0;
+}
+
+size_t PBJSampleRingCount(const PBJSampleRing *ring)
+{
+    if (!ring)
+        return 0;
+    PBJSampleRing *mutableRing = (PBJSampleRing *)ring;
+    size_t head = atomic_load_explicit(&mutableRing->head, memory_order_acquire);
+    size_t tail = atomic_load_explicit(&mutableRing->tail, memory_order_acquire);
+    return tail > head ? tail - head : 0;
+}
+
+PBJSampleRingCounters PBJSampleRingGetCounters(const PBJSampleRing *ring)
+{
+    PBJSampleRingCounters counters = { 0, 0, 0 };
+    if (!ring)
+        return counters;
+    PBJSampleRing *mutableRing = (PBJSampleRing *)ring;
+    counters.enqueued = atomic_load_explicit(&mutableRing->enqueued, memory_order_relaxed);
+    counters.dequeued = atomic_load_explicit(&mutableRing->dequeued, memory_order_relaxed);
+    counters.dropped = atomic_load_explicit(&mutableRing->dropped, memory_order_relaxed);
+    return counters;
+}
+
+int PBJSampleRingPush(PBJSampleRing *ring, void *item, PBJSampleRingOverflow overflow, void **dropped)
+{
+    if (dropped)
+        *dropped = NULL;
+    if (!ring || !item)
+        return 0;
+
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+    while (tail - head >= ring->capacity) {
+        if (overflow == PBJSampleRingOverflowDropNewest) {
+            PBJSampleRingIncrement(&ring->dropped);
+            if (dropped)
+                *dropped = item;
+            return 0;
+        }
+
+        // evict the oldest entry, racing the consumer for it
+        void *oldest = atomic_load_explicit(&ring->slots[head % ring->capacity], memory_order_relaxed);
+        if (atomic_compare_exchange_strong_explicit(&ring->head, &head, head + 1, memory_order_acq_rel, memory_order_acquire)) {
+            PBJSampleRingIncrement(&ring->dropped);
+            if (dropped)
+                *dropped = oldest;
+            break;
+        }
+        // the consumer took it, head now holds the updated value
+    }
+
+    atomic_store_explicit(&ring->slots[tail % ring->capacity], item, memory_order_relaxed);
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+    PBJSampleRingIncrement(&ring->enqueued);
+    return 1;
+}
+
+void PBJSampleRingCountDropped(PBJSampleRing *ring)
+{
+    if (ring)
+        PBJSampleRingIncrement(&ring->dropped);
+}
+
+void *PBJSampleRingPop(PBJSampleRing *ring)
+{
+    if (!ring)
+        return NULL;
+
+    size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    for (;;) {
+        size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+        if (head == tail)
+            return NULL;
+
+        void *item = atomic_load_explicit(&ring->slots[head % ring->capacity], memory_order_relaxed);
+        if (atomic_compare_exchange_weak_explicit(&ring->head, &head, head + 1, memory_order_acq_rel, memory_order_acquire)) {
+            PBJSampleRingIncrement(&ring->dequeued);
+            return item;
+        }
+    }
+}
@@ -0,0 +1,75 @@
+//
+//  PBJSampleRing.h
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef PBJSampleRing_h
+#define PBJSampleRing_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// bounded lock-free single-producer/single-consumer ring of opaque pointers.
+// when full the producer may evict the oldest entry itself, so both sides claim the
+// head with a compare-and-swap and an entry is always owned by exactly one side.
+// the ring never retains or releases what it holds
+
+typedef enum {
+    PBJSampleRingOverflowDropOldest = 0,
+    PBJSampleRingOverflowDropNewest
+} PBJSampleRingOverflow;
+
+typedef struct {
+    uint64_t enqueued;
+    uint64_t dequeued;
+    uint64_t dropped;
+} PBJSampleRingCounters;
+
+typedef struct PBJSampleRing PBJSampleRing;
+
+PBJSampleRing *PBJSampleRingCreate(size_t capacity);
+void PBJSampleRingDestroy(PBJSampleRing *ring);
+
+size_t PBJSampleRingCapacity(const PBJSampleRing *ring);
+// a snapshot, exact only when called from the producer or consumer while the other is idle
+size_t PBJSampleRingCount(const PBJSampleRing *ring);
+PBJSampleRingCounters PBJSampleRingGetCounters(const PBJSampleRing *ring);
+
+// producer, returns 1 when item was enqueued. *dropped receives the entry the caller
+// now owns and must dispose of: the evicted oldest entry, item itself when rejected, or NULL
+int PBJSampleRingPush(PBJSampleRing *ring, void *item, PBJSampleRingOverflow overflow, void **dropped);
+
+// producer, counts an entry the caller discarded before it reached the ring
+void PBJSampleRingCountDropped(PBJSampleRing *ring);
+
+// consumer, NULL when empty
+void *PBJSampleRingPop(PBJSampleRing *ring);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PBJSampleRing_h */
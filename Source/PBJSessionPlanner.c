@@ -0,0 +1,189 @@
+//
+//  PBJSessionPlanner.c
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include "PBJSessionPlanner.h"
+
+static int PBJSessionConfigurationHasVideoConnection(const PBJSessionConfiguration *configuration)
+{
+    return configuration->camera != PBJSessionCameraNone && configuration->videoOutput;
+}
+
+// the video output leads when both are present
+static int PBJSessionConfigurationHasPrimaryConnection(const PBJSessionConfiguration *configuration)
+{
+    return configuration->camera != PBJSessionCameraNone && (configuration->videoOutput || configuration->photoOutput);
+}
+
+static int PBJSessionConfigurationMode(const PBJSessionConfiguration *configuration)
+{
+    if (configuration->videoOutput)
+        return 1;
+    if (configuration->photoOutput)
+        return 2;
+    return 0;
+}
+
+#pragma mark - apply
+
+void PBJSessionConfigurationApply(PBJSessionConfiguration *configuration, PBJSessionOperation operation, const PBJSessionConfiguration *desired)
+{
+    switch (operation) {
+        case PBJSessionOperationRemoveCameraInput:
+            configuration->camera = PBJSessionCameraNone;
+            configuration->videoOrientation = PBJSessionConnectionUnknown;
+            configuration->mirrored = PBJSessionConnectionUnknown;
+            break;
+        case PBJSessionOperationRemoveAudioInput:
+            configuration->audioInput = 0;
+            break;
+        case PBJSessionOperationRemoveVideoOutput:
+            // the photo output, if any, becomes primary
+            configuration->videoOutput = 0;
+            configuration->videoOrientation = PBJSessionConnectionUnknown;
+            configuration->mirrored = PBJSessionConnectionUnknown;
+            break;
+        case PBJSessionOperationRemovePhotoOutput:
+            configuration->photoOutput = 0;
+            if (!configuration->videoOutput) {
+                configuration->mirrored = PBJSessionConnectionUnknown;
+            }
+            break;
+        case PBJSessionOperationRemoveAudioOutput:
+            configuration->audioOutput = 0;
+            break;
+        case PBJSessionOperationAddCameraInput:
+            configuration->camera = desired->camera;
+            configuration->videoOrientation = PBJSessionConnectionUnknown;
+            configuration->mirrored = PBJSessionConnectionUnknown;
+            break;
+        case PBJSessionOperationAddAudioInput:
+            configuration->audioInput = 1;
+            break;
+        case PBJSessionOperationAddVideoOutput:
+            configuration->videoOutput = 1;
+            configuration->videoOrientation = PBJSessionConnectionUnknown;
+            configuration->mirrored = PBJSessionConnectionUnknown;
+            break;
+        case PBJSessionOperationAddPhotoOutput:
+            configuration->photoOutput = 1;
+            if (!configuration->videoOutput) {
+                configuration->mirrored = PBJSessionConnectionUnknown;
+            }
+            break;
+        case PBJSessionOperationAddAudioOutput:
+            configuration->audioOutput = 1;
+            break;
+        case PBJSessionOperationSetPreset:
+            configuration->preset = desired->preset;
+            break;
+        case PBJSessionOperationSetVideoOrientation:
+            configuration->videoOrientation = desired->videoOrientation;
+            break;
+        case PBJSessionOperationSetMirroring:
+            configuration->mirrored = desired->mirrored;
+            break;
+        case PBJSessionOperationConfigureVideoOutput:
+        case PBJSessionOperationConfigureDevice:
+        case PBJSessionOperationCount:
+        default:
+            break;
+    }
+}
+
+int PBJSessionConfigurationEqual(const PBJSessionConfiguration *lhs, const PBJSessionConfiguration *rhs)
+{
+    if (lhs->camera != rhs->camera || !lhs->videoOutput != !rhs->videoOutput || !lhs->photoOutput != !rhs->photoOutput ||
+        !lhs->audioInput != !rhs->audioInput || !lhs->audioOutput != !rhs->audioOutput || lhs->preset != rhs->preset)
+        return 0;
+    if (PBJSessionConfigurationHasVideoConnection(lhs) && lhs->videoOrientation != rhs->videoOrientation)
+        return 0;
+    if (PBJSessionConfigurationHasPrimaryConnection(lhs) && lhs->mirrored != rhs->mirrored)
+        return 0;
+    return 1;
+}
+
+#pragma mark - plan
+
+static void PBJSessionPlanAppend(PBJSessionPlan *plan, PBJSessionConfiguration *state, PBJSessionOperation operation, const PBJSessionConfiguration *desired)
+{
+    plan->operations[plan->count++] = operation;
+    PBJSessionConfigurationApply(state, operation, desired);
+}
+
+size_t PBJSessionPlannerPlan(const PBJSessionConfiguration *current, const PBJSessionConfiguration *desired, PBJSessionPlan *plan)
+{
+    if (!plan)
+        return 0;
+    plan->count = 0;
+    if (!current || !desired)
+        return 0;
+
+    // the plan is built by walking a copy of the state forward, so connection settings are
+    // only reapplied where an earlier operation actually replaced the connection
+    PBJSessionConfiguration state = *current;
+    int cameraChanged = current->camera != desired->camera;
+
+    if (cameraChanged && current->camera != PBJSessionCameraNone)
+        PBJSessionPlanAppend(plan, &state, PBJSessionOperationRemoveCameraInput, desired);
+    if (current->audioInput && !desired->audioInput)
+        PBJSessionPlanAppend(plan, &state, PBJSessionOperationRemoveAudioInput, desired);
+    if (current->videoOutput && !desired->videoOutput)
+        PBJSessionPlanAppend(plan, &state, PBJSessionOperationRemoveVideoOutput, desired);
+    if (current->photoOutput && !desired->photoOutput)
+        PBJSessionPlanAppend(plan, &state, PBJSessionOperationRemovePhotoOutput, desired);
+    if (current->audioOutput && !desired->audioOutput)
+        PBJSessionPlanAppend(plan, &state, PBJSessionOperationRemoveAudioOutput, desired);
+
+    if (cameraChanged && desired->camera != PBJSessionCameraNone)
+        PBJSessionPlanAppend(plan, &state, PBJSessionOperationAddCameraInput, desired);
+    if (!current->audioInput && desired->audioInput)
+        PBJSessionPlanAppend(plan, &state, PBJSessionOperationAddAudioInput, desired);
+    if (!current->videoOutput && desired->videoOutput)
+        PBJSessionPlanAppend(plan, &state, PBJSessionOperationAddVideoOutput, desired);
+    if (!current->photoOutput && desired->photoOutput)
+        PBJSessionPlanAppend(plan, &state, PBJSessionOperationAddPhotoOutput, desired);
+    if (!current->audioOutput && desired->audioOutput)
+        PBJSessionPlanAppend(plan, &state, PBJSessionOperationAddAudioOutput, desired);
+
+    if (current->preset != desired->preset || (cameraChanged && desired->camera != PBJSessionCameraNone))
+        PBJSessionPlanAppend(plan, &state, PBJSessionOperationSetPreset, desired);
+
+    int videoAdded = !current->videoOutput && desired->videoOutput;
+    if (PBJSessionConfigurationHasVideoConnection(desired) && (videoAdded || cameraChanged))
+        PBJSessionPlanAppend(plan, &state, PBJSessionOperationConfigureVideoOutput, desired);
+
+    int modeChanged = PBJSessionConfigurationMode(current) != PBJSessionConfigurationMode(desired);
+    if (PBJSessionConfigurationHasPrimaryConnection(desired) && (cameraChanged || modeChanged))
+        PBJSessionPlanAppend(plan, &state, PBJSessionOperationConfigureDevice, desired);
+
+    if (PBJSessionConfigurationHasVideoConnection(desired) && desired->videoOrientation != PBJSessionConnectionUnknown &&
+        state.videoOrientation != desired->videoOrientation)
+        PBJSessionPlanAppend(plan, &state, PBJSessionOperationSetVideoOrientation, desired);
+
+    if (PBJSessionConfigurationHasPrimaryConnection(desired) && desired->mirrored != PBJSessionConnectionUnknown &&
+        state.mirrored != desired->mirrored)
+        PBJSessionPlanAppend(plan, &state, PBJSessionOperationSetMirroring, desired);
+
+    return plan->count;
+}
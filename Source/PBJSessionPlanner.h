@@ -0,0 +1,107 @@
+//
+//  PBJSessionPlanner.h
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef PBJSessionPlanner_h
+#define PBJSessionPlanner_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// plans a capture session reconfiguration as the fewest operations taking the current
+// configuration to the desired one, in an order a single configuration transaction accepts,
+// removals first so a second camera never has to coexist with the first, connection settings
+// last since a new input or output brings new connections
+
+#pragma mark - configuration
+
+typedef enum {
+    PBJSessionCameraNone = 0,
+    PBJSessionCameraBack,
+    PBJSessionCameraFront
+} PBJSessionCamera;
+
+#define PBJSessionConnectionUnknown (-1)
+
+typedef struct {
+    PBJSessionCamera camera;
+    int videoOutput;
+    int photoOutput;
+    int audioInput;
+    int audioOutput;
+    uint32_t preset; // opaque, equal values are the same preset
+    int videoOrientation; // video output connection, PBJSessionConnectionUnknown when not known
+    int mirrored; // primary output connection, PBJSessionConnectionUnknown when not known
+} PBJSessionConfiguration;
+
+static inline PBJSessionConfiguration PBJSessionConfigurationMakeEmpty(void)
+{
+    PBJSessionConfiguration configuration = { PBJSessionCameraNone, 0, 0, 0, 0, 0, PBJSessionConnectionUnknown, PBJSessionConnectionUnknown };
+    return configuration;
+}
+
+#pragma mark - operations
+
+// declaration order is execution order
+typedef enum {
+    PBJSessionOperationRemoveCameraInput = 0,
+    PBJSessionOperationRemoveAudioInput,
+    PBJSessionOperationRemoveVideoOutput,
+    PBJSessionOperationRemovePhotoOutput,
+    PBJSessionOperationRemoveAudioOutput,
+    PBJSessionOperationAddCameraInput,
+    PBJSessionOperationAddAudioInput,
+    PBJSessionOperationAddVideoOutput,
+    PBJSessionOperationAddPhotoOutput,
+    PBJSessionOperationAddAudioOutput,
+    PBJSessionOperationSetPreset, // after inputs and outputs, a new camera may not have kept it
+    PBJSessionOperationConfigureVideoOutput, // pixel format, stabilization, late frames
+    PBJSessionOperationConfigureDevice, // per mode device settings
+    PBJSessionOperationSetVideoOrientation,
+    PBJSessionOperationSetMirroring,
+    PBJSessionOperationCount
+} PBJSessionOperation;
+
+typedef struct {
+    PBJSessionOperation operations[PBJSessionOperationCount];
+    size_t count;
+} PBJSessionPlan;
+
+// fills plan, returns the operation count, 0 when nothing needs to change
+size_t PBJSessionPlannerPlan(const PBJSessionConfiguration *current, const PBJSessionConfiguration *desired, PBJSessionPlan *plan);
+
+// the configuration an operation leaves behind, a new input or output invalidates connection settings
+void PBJSessionConfigurationApply(PBJSessionConfiguration *configuration, PBJSessionOperation operation, const PBJSessionConfiguration *desired);
+
+// whether two configurations describe the same session, connection settings only count where a connection exists
+int PBJSessionConfigurationEqual(const PBJSessionConfiguration *lhs, const PBJSessionConfiguration *rhs);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PBJSessionPlanner_h */
@@ -0,0 +1,252 @@
+//
+//  PBJStorageMonitor.c
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#include "PBJStorageMonitor.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+#define PBJ_STORAGE_NSEC_PER_SEC 1000000000LL
+
+struct PBJStorageMonitor {
+    PBJStorageMonitorConfiguration configuration;
+    PBJStorageVolume volume;
+
+    // cached volume answer, bytesWrittenAtQuery is what the recording had written by then
+    int measured;
+    int queried;
+    uint64_t queriedFreeBytes;
+    uint64_t bytesWrittenAtQuery;
+    int64_t lastQueryTime;
+    int64_t nextQueryTime;
+
+    int recording;
+    int64_t recordingStartTime;
+    uint64_t bytesWritten;
+    int64_t lastPollTime;
+    int rateKnown;
+    double smoothedRate;
+};
+
+PBJStorageMonitorConfiguration PBJStorageMonitorDefaultConfiguration(uint64_t reserveBytes)
+{
+    PBJStorageMonitorConfiguration configuration;
+    configuration.reserveBytes = reserveBytes;
+    configuration.idleQueryInterval = 10 * PBJ_STORAGE_NSEC_PER_SEC;
+    configuration.recordingQueryInterval = 5 * PBJ_STORAGE_NSEC_PER_SEC;
+    configuration.minimumQueryInterval = PBJ_STORAGE_NSEC_PER_SEC / 4;
+    configuration.writePollInterval = PBJ_STORAGE_NSEC_PER_SEC / 2;
+    configuration.rateTimeConstant = 4.0;
+    configuration.stopHeadroom = 3.0;
+    return configuration;
+}
+
+PBJStorageMonitor *PBJStorageMonitorCreate(const PBJStorageMonitorConfiguration *configuration, PBJStorageVolume volume)
+{
+    if (!configuration || !volume.freeBytes)
+        return NULL;
+
+    PBJStorageMonitor *monitor = (PBJStorageMonitor *)calloc(1, sizeof(PBJStorageMonitor));
+    if (!monitor)
+        return NULL;
+
+    monitor->configuration = *configuration;
+    if (monitor->configuration.minimumQueryInterval <= 0)
+        monitor->configuration.minimumQueryInterval = 1;
+    if (monitor->configuration.writePollInterval <= 0)
+        monitor->configuration.writePollInterval = monitor->configuration.minimumQueryInterval;
+    monitor->volume = volume;
+    return monitor;
+}
+
+void PBJStorageMonitorDestroy(PBJStorageMonitor *monitor)
+{
+    free(monitor);
+}
+
+#pragma mark - estimate
+
+static uint64_t PBJStorageMonitorFreeBytes(const PBJStorageMonitor *monitor)
+{
+    uint64_t writtenSinceQuery = monitor->bytesWritten > monitor->bytesWrittenAtQuery ? monitor->bytesWritten - monitor->bytesWrittenAtQuery : 0;
+    return monitor->queriedFreeBytes > writtenSinceQuery ? monitor->queriedFreeBytes - writtenSinceQuery : 0;
+}
+
+// the smoothed rate follows changes in bitrate, the mean since the start covers a lull in a bursty writer,
+// the larger of the two errs towards stopping early
+static double PBJStorageMonitorRate(const PBJStorageMonitor *monitor)
+{
+    if (!monitor->recording || !monitor->rateKnown)
+        return 0.0;
+
+    double elapsed = (double)(monitor->lastPollTime - monitor->recordingStartTime) / (double)PBJ_STORAGE_NSEC_PER_SEC;
+    double mean = elapsed > 0.0 ? (double)monitor->bytesWritten / elapsed : 0.0;
+    return monitor->smoothedRate > mean ? monitor->smoothedRate : mean;
+}
+
+void PBJStorageMonitorGetEstimate(const PBJStorageMonitor *monitor, PBJStorageEstimate *estimate)
+{
+    if (!estimate)
+        return;
+
+    estimate->measured = 0;
+    estimate->freeBytes = 0;
+    estimate->usableBytes = 0;
+    estimate->bytesPerSecond = 0.0;
+    estimate->remainingSeconds = -1.0;
+    estimate->shouldStop = 0;
+    if (!monitor || !monitor->measured)
+        return;
+
+    uint64_t freeBytes = PBJStorageMonitorFreeBytes(monitor);
+    uint64_t reserveBytes = monitor->configuration.reserveBytes;
+    double rate = PBJStorageMonitorRate(monitor);
+    double headroomBytes = rate * monitor->configuration.stopHeadroom;
+
+    estimate->measured = 1;
+    estimate->freeBytes = freeBytes;
+    estimate->usableBytes = freeBytes > reserveBytes ? freeBytes - reserveBytes : 0;
+    estimate->bytesPerSecond = rate;
+    if (rate > 0.0) {
+        double remaining = ((double)estimate->usableBytes - headroomBytes) / rate;
+        estimate->remainingSeconds = remaining > 0.0 ? remaining : 0.0;
+    }
+    estimate->shouldStop = monitor->recording && (estimate->usableBytes == 0 || (double)estimate->usableBytes <= headroomBytes);
+}
+
+#pragma mark - sampling
+
+// while recording, no more than a quarter of the time left passes between queries, so space
+// taken by anything other than the recording is noticed well before the headroom
+static int64_t PBJStorageMonitorQueryInterval(const PBJStorageMonitor *monitor)
+{
+    const PBJStorageMonitorConfiguration *configuration = &monitor->configuration;
+    if (!monitor->recording)
+        return configuration->idleQueryInterval > configuration->minimumQueryInterval ? configuration->idleQueryInterval : configuration->minimumQueryInterval;
+
+    double interval = (double)configuration->recordingQueryInterval;
+    double rate = PBJStorageMonitorRate(monitor);
+    if (monitor->measured && rate > 0.0) {
+        uint64_t freeBytes = PBJStorageMonitorFreeBytes(monitor);
+        double usable = freeBytes > configuration->reserveBytes ? (double)(freeBytes - configuration->reserveBytes) : 0.0;
+        double secondsLeft = usable / rate - configuration->stopHeadroom;
+        double quarter = secondsLeft * 0.25 * (double)PBJ_STORAGE_NSEC_PER_SEC;
+        if (quarter < interval)
+            interval = quarter;
+    }
+    if (interval < (double)configuration->minimumQueryInterval)
+        interval = (double)configuration->minimumQueryInterval;
+    return (int64_t)interval;
+}
+
+int PBJStorageMonitorUpdate(PBJStorageMonitor *monitor, int64_t now)
+{
+    if (!monitor)
+        return 0;
+    if (monitor->measured && now < monitor->nextQueryTime)
+        return 0;
+    if (monitor->queried && now < monitor->lastQueryTime + monitor->configuration.minimumQueryInterval)
+        return 0;
+
+    uint64_t freeBytes = 0;
+    if (monitor->volume.freeBytes(monitor->volume.context, &freeBytes)) {
+        monitor->measured = 1;
+        monitor->queriedFreeBytes = freeBytes;
+        monitor->bytesWrittenAtQuery = monitor->bytesWritten;
+    }
+
+    // a failed query keeps the cached answer and waits out the interval like any other
+    monitor->queried = 1;
+    monitor->lastQueryTime = now;
+    monitor->nextQueryTime = now + PBJStorageMonitorQueryInterval(monitor);
+    return 1;
+}
+
+int64_t PBJStorageMonitorNextUpdateTime(const PBJStorageMonitor *monitor)
+{
+    if (!monitor)
+        return 0;
+    if (!monitor->recording)
+        return monitor->nextQueryTime;
+
+    int64_t nextPoll = monitor->lastPollTime + monitor->configuration.writePollInterval;
+    return nextPoll < monitor->nextQueryTime ? nextPoll : monitor->nextQueryTime;
+}
+
+#pragma mark - recording
+
+void PBJStorageMonitorBeginRecording(PBJStorageMonitor *monitor, int64_t now)
+{
+    if (!monitor)
+        return;
+
+    monitor->recording = 1;
+    monitor->recordingStartTime = now;
+    monitor->bytesWritten = 0;
+    monitor->bytesWrittenAtQuery = 0;
+    monitor->lastPollTime = now;
+    monitor->rateKnown = 0;
+    monitor->smoothedRate = 0.0;
+    monitor->nextQueryTime = now;
+}
+
+void PBJStorageMonitorEndRecording(PBJStorageMonitor *monitor, int64_t now)
+{
+    if (!monitor || !monitor->recording)
+        return;
+
+    // the finished file is carried forward until the next query, which comes early
+    monitor->recording = 0;
+    monitor->nextQueryTime = now;
+}
+
+void PBJStorageMonitorRecordBytesWritten(PBJStorageMonitor *monitor, uint64_t bytesWritten, int64_t now)
+{
+    if (!monitor || !monitor->recording || now <= monitor->lastPollTime)
+        return;
+
+    if (bytesWritten < monitor->bytesWritten)
+        bytesWritten = monitor->bytesWritten;
+
+    double elapsed = (double)(now - monitor->lastPollTime) / (double)PBJ_STORAGE_NSEC_PER_SEC;
+    double rate = (double)(bytesWritten - monitor->bytesWritten) / elapsed;
+    if (!monitor->rateKnown) {
+        monitor->smoothedRate = rate;
+        monitor->rateKnown = 1;
+    } else {
+        double timeConstant = monitor->configuration.rateTimeConstant;
+        double alpha = timeConstant > 0.0 ? 1.0 - exp(-elapsed / timeConstant) : 1.0;
+        monitor->smoothedRate += alpha * (rate - monitor->smoothedRate);
+    }
+    monitor->bytesWritten = bytesWritten;
+    monitor->lastPollTime = now;
+
+    // a faster rate can bring the next query forward
+    if (monitor->measured) {
+        int64_t due = monitor->lastQueryTime + PBJStorageMonitorQueryInterval(monitor);
+        if (due < monitor->nextQueryTime)
+            monitor->nextQueryTime = due;
+    }
+}
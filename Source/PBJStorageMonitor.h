@@ -0,0 +1,94 @@
+//
+//  PBJStorageMonitor.h
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#ifndef PBJStorageMonitor_h
+#define PBJStorageMonitor_h
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// free space answers served from a cache that is refreshed at a bounded rate. between queries
+// the free space is carried forward by what the current recording has written, whose smoothed
+// rate also predicts the recording time left and when capture should end, leaving the reserve
+// and a few seconds of headroom for finishing the file. times are nanoseconds on the owner's
+// clock. not thread safe, confine to one queue
+
+typedef struct {
+    void *context;
+    // free bytes on the volume recordings go to, returns 0 when the query fails
+    int (*freeBytes)(void *context, uint64_t *freeBytes);
+} PBJStorageVolume;
+
+typedef struct {
+    uint64_t reserveBytes; // never recorded into
+    int64_t idleQueryInterval; // between volume queries while not recording
+    int64_t recordingQueryInterval; // while recording, shortened as the headroom runs out
+    int64_t minimumQueryInterval; // bounds the query rate however little headroom is left
+    int64_t writePollInterval; // between bytes written readings while recording
+    double rateTimeConstant; // seconds, smoothing of the write rate
+    double stopHeadroom; // seconds of recording at the current rate left when capture should end
+} PBJStorageMonitorConfiguration;
+
+typedef struct {
+    int measured; // the volume has answered at least once
+    uint64_t freeBytes; // last answer less what has been written since
+    uint64_t usableBytes; // free bytes above the reserve
+    double bytesPerSecond; // current recording, 0 when idle or not yet known
+    double remainingSeconds; // of recording until the headroom, negative when unknown
+    int shouldStop; // recording, and the headroom has been reached
+} PBJStorageEstimate;
+
+typedef struct PBJStorageMonitor PBJStorageMonitor;
+
+// queries every 10 s idle and 5 s recording, never more than 4 times a second, writes polled
+// twice a second, 3 s of headroom
+PBJStorageMonitorConfiguration PBJStorageMonitorDefaultConfiguration(uint64_t reserveBytes);
+
+PBJStorageMonitor *PBJStorageMonitorCreate(const PBJStorageMonitorConfiguration *configuration, PBJStorageVolume volume);
+void PBJStorageMonitorDestroy(PBJStorageMonitor *monitor);
+
+// a recording resets the write rate and asks for a fresh query
+void PBJStorageMonitorBeginRecording(PBJStorageMonitor *monitor, int64_t now);
+void PBJStorageMonitorEndRecording(PBJStorageMonitor *monitor, int64_t now);
+
+// total bytes the current recording has written so far
+void PBJStorageMonitorRecordBytesWritten(PBJStorageMonitor *monitor, uint64_t bytesWritten, int64_t now);
+
+// queries the volume when the cached answer is due, returns 1 when it queried
+int PBJStorageMonitorUpdate(PBJStorageMonitor *monitor, int64_t now);
+
+// when the owner should next poll bytes written and call update
+int64_t PBJStorageMonitorNextUpdateTime(const PBJStorageMonitor *monitor);
+
+void PBJStorageMonitorGetEstimate(const PBJStorageMonitor *monitor, PBJStorageEstimate *estimate);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PBJStorageMonitor_h */
@@ -0,0 +1,92 @@
+//
+//  PBJThumbnailRequests.c
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#include "PBJThumbnailRequests.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+int PBJThumbnailRequestsInsert(PBJThumbnailRequests *requests, int64_t value)
+{
+    int64_t *pending = requests->values + requests->head;
+    size_t low = 0;
+    size_t high = requests->count;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (pending[middle] < value) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    if (low < requests->count && pending[low] == value)
+        return 1;
+
+    // consumed entries make room before the array grows
+    if (requests->head > 0 && requests->head + requests->count == requests->capacity) {
+        memmove(requests->values, pending, requests->count * sizeof(int64_t));
+        requests->head = 0;
+    }
+    if (requests->count == requests->capacity) {
+        size_t capacity = requests->capacity > 0 ? requests->capacity * 2 : 16;
+        int64_t *values = (int64_t *)realloc(requests->values, capacity * sizeof(int64_t));
+        if (!values)
+            return 0;
+        requests->values = values;
+        requests->capacity = capacity;
+    }
+
+    pending = requests->values + requests->head;
+    memmove(pending + low + 1, pending + low, (requests->count - low) * sizeof(int64_t));
+    pending[low] = value;
+    requests->count++;
+    return 1;
+}
+
+int PBJThumbnailRequestsConsume(PBJThumbnailRequests *requests, int64_t value)
+{
+    int consumed = 0;
+    while (requests->count > 0 && requests->values[requests->head] <= value) {
+        requests->head++;
+        requests->count--;
+        consumed = 1;
+    }
+    if (requests->count == 0) {
+        requests->head = 0;
+    }
+    return consumed;
+}
+
+void PBJThumbnailRequestsReset(PBJThumbnailRequests *requests)
+{
+    requests->head = 0;
+    requests->count = 0;
+}
+
+void PBJThumbnailRequestsDestroy(PBJThumbnailRequests *requests)
+{
+    free(requests->values);
+    memset(requests, 0, sizeof(*requests));
+}
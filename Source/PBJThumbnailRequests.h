@@ -0,0 +1,63 @@
+//
+//  PBJThumbnailRequests.h
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#ifndef PBJThumbnailRequests_h
+#define PBJThumbnailRequests_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// requests kept as a sorted run of integers (frame numbers or nanoseconds), consumed from the
+// front as frames pass them, so a frame only checks the head. memory only grows when a request
+// is added, consumed entries make room first. zero initialized is empty, not thread safe
+
+typedef struct {
+    int64_t *values;
+    size_t head;
+    size_t count; // from head
+    size_t capacity;
+} PBJThumbnailRequests;
+
+// a request already pending is kept once, returns 0 when memory runs out
+int PBJThumbnailRequestsInsert(PBJThumbnailRequests *requests, int64_t value);
+
+// removes every request up to value, returns 1 when there were any
+int PBJThumbnailRequestsConsume(PBJThumbnailRequests *requests, int64_t value);
+
+// forgets every request, the memory is kept for the next
+void PBJThumbnailRequestsReset(PBJThumbnailRequests *requests);
+
+// releases the memory, the requests are empty after
+void PBJThumbnailRequestsDestroy(PBJThumbnailRequests *requests);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PBJThumbnailRequests_h */
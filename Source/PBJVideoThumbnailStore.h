@@ -0,0 +1,54 @@
+//
+//  PBJVideoThumbnailStore.h
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#import <Foundation/Foundation.h>
+#import <AVFoundation/AVFoundation.h>
+
+// captures downscaled video thumbnails as frames arrive, so nothing has to be decoded
+// once the recording is written. which frames were requested is decided by the sender
+// (PBJSampleDelivery keeps the requests in order), the last frame keeps a single rolling
+// slot, the best scoring frame another that is only rewritten when the score improves.
+// not thread safe, use from the queue that delivers the frames
+@interface PBJVideoThumbnailStore : NSObject
+
+- (instancetype)initWithMaximumDimension:(size_t)maximumDimension;
+
+@property (nonatomic, readonly) size_t maximumDimension;
+@property (nonatomic) BOOL capturesLastFrame;
+@property (nonatomic) BOOL capturesBestFrame;
+
+// a requested frame is kept as a thumbnail, times are relative to the first appended frame
+- (void)appendPixelBuffer:(CVPixelBufferRef)pixelBuffer presentationTimestamp:(CMTime)presentationTimestamp score:(float)score requested:(BOOL)requested;
+
+// a frame that was already appended and held back, a chosen frame from the recent past
+- (void)addThumbnailWithPixelBuffer:(CVPixelBufferRef)pixelBuffer presentationTimestamp:(CMTime)presentationTimestamp;
+
+// UIImages ordered by time, with requests that were never reached the last frame is added when it is captured
+- (NSArray *)thumbnailsWithRequestsPending:(BOOL)requestsPending;
+// bestFrameIndex is NSNotFound unless the best frame is among them
+- (NSArray *)thumbnailsWithBestFrameIndex:(NSUInteger *)bestFrameIndex requestsPending:(BOOL)requestsPending;
+
+- (void)reset;
+
+@end
@@ -0,0 +1,339 @@
+//
+//  PBJVideoThumbnailStore.m
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#import "PBJVideoThumbnailStore.h"
+#import "PBJVisionUtilities.h"
+
+#import <UIKit/UIKit.h>
+
+@interface PBJVideoThumbnailStore ()
+{
+    size_t _maximumDimension;
+    BOOL _capturesLastFrame;
+    BOOL _capturesBestFrame;
+
+    // captured thumbnails
+    NSMutableArray *_pixelBuffers;
+    NSMutableArray *_timestamps;
+    CVPixelBufferRef _lastFramePixelBuffer;
+    CMTime _lastFrameTimestamp;
+    CVPixelBufferRef _bestFramePixelBuffer;
+    CMTime _bestFrameTimestamp;
+    float _bestFrameScore;
+
+    CMTime _firstTimestamp;
+
+    // downscaling, rebuilt only when the source geometry changes
+    PBJResampler *_resampler;
+    CVPixelBufferPoolRef _pixelBufferPool;
+    size_t _sourceWidth;
+    size_t _sourceHeight;
+    OSType _sourcePixelFormat;
+}
+
+@end
+
+@implementation PBJVideoThumbnailStore
+
+@synthesize maximumDimension = _maximumDimension;
+@synthesize capturesLastFrame = _capturesLastFrame;
+@synthesize capturesBestFrame = _capturesBestFrame;
+
+#pragma mark - init
+
+- (instancetype)initWithMaximumDimension:(size_t)maximumDimension
+{
+    self = [super init];
+    if (self) {
+        _maximumDimension = MAX(maximumDimension, (size_t)2);
+        _pixelBuffers = [[NSMutableArray alloc] init];
+        _timestamps = [[NSMutableArray alloc] init];
+        _firstTimestamp = kCMTimeInvalid;
+        _lastFrameTimestamp = kCMTimeInvalid;
+        _bestFrameTimestamp = kCMTimeInvalid;
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    [self reset];
+    [self _destroyResampler];
+}
+
+#pragma mark - frames
+
+- (void)appendPixelBuffer:(CVPixelBufferRef)pixelBuffer presentationTimestamp:(CMTime)presentationTimestamp score:(float)score requested:(BOOL)requested
+{
+    if (!pixelBuffer || !CMTIME_IS_NUMERIC(presentationTimestamp))
+        return;
+
+    if (CMTIME_IS_INVALID(_firstTimestamp)) {
+        _firstTimestamp = presentationTimestamp;
+    }
+    CMTime time = CMTimeSubtract(presentationTimestamp, _firstTimestamp);
+
+    // the best slot is only rewritten when the score improves, ties keep the earlier frame
+    BOOL bestSoFar = _capturesBestFrame && (!_bestFramePixelBuffer || !CMTIME_IS_NUMERIC(_bestFrameTimestamp) || score > _bestFrameScore);
+
+    if (!requested && !_capturesLastFrame && !bestSoFar)
+        return;
+
+    if (![self _setupResamplerForPixelBuffer:pixelBuffer])
+        return;
+
+    if (requested) {
+        CVPixelBufferRef thumbnailPixelBuffer = [self _createDownscaledPixelBuffer:pixelBuffer];
+        if (thumbnailPixelBuffer) {
+            [_pixelBuffers addObject:(__bridge id)thumbnailPixelBuffer];
+            [_timestamps addObject:[NSValue valueWithCMTime:time]];
+            CVPixelBufferRelease(thumbnailPixelBuffer);
+        }
+    }
+
+    if (_capturesLastFrame) {
+        // a single slot, overwritten in place by every frame
+        if (!_lastFramePixelBuffer) {
+            CVPixelBufferPoolCreatePixelBuffer(kCFAllocatorDefault, _pixelBufferPool, &_lastFramePixelBuffer);
+        }
+        if (_lastFramePixelBuffer && [PBJVisionUtilities resamplePixelBuffer:pixelBuffer toPixelBuffer:_lastFramePixelBuffer withResampler:_resampler]) {
+            _lastFrameTimestamp = time;
+        }
+    }
+
+    if (bestSoFar) {
+        if (!_bestFramePixelBuffer) {
+            CVPixelBufferPoolCreatePixelBuffer(kCFAllocatorDefault, _pixelBufferPool, &_bestFramePixelBuffer);
+        }
+        if (_bestFramePixelBuffer && [PBJVisionUtilities resamplePixelBuffer:pixelBuffer toPixelBuffer:_bestFramePixelBuffer withResampler:_resampler]) {
+            _bestFrameTimestamp = time;
+            _bestFrameScore = score;
+        }
+    }
+}
+
+- (void)addThumbnailWithPixelBuffer:(CVPixelBufferRef)pixelBuffer presentationTimestamp:(CMTime)presentationTimestamp
+{
+    if (!pixelBuffer || !CMTIME_IS_NUMERIC(presentationTimestamp) || CMTIME_IS_INVALID(_firstTimestamp))
+        return;
+
+    CMTime time = CMTimeSubtract(presentationTimestamp, _firstTimestamp);
+
+    NSUInteger index = 0;
+    for (NSValue *timestamp in _timestamps) {
+        int32_t comparison = CMTimeCompare([timestamp CMTimeValue], time);
+        if (comparison == 0)
+            return;
+        if (comparison > 0)
+            break;
+        index++;
+    }
+
+    if (![self _setupResamplerForPixelBuffer:pixelBuffer])
+        return;
+
+    CVPixelBufferRef thumbnailPixelBuffer = [self _createDownscaledPixelBuffer:pixelBuffer];
+    if (thumbnailPixelBuffer) {
+        [_pixelBuffers insertObject:(__bridge id)thumbnailPixelBuffer atIndex:index];
+        [_timestamps insertObject:[NSValue valueWithCMTime:time] atIndex:index];
+        CVPixelBufferRelease(thumbnailPixelBuffer);
+    }
+}
+
+- (NSArray *)thumbnailsWithRequestsPending:(BOOL)requestsPending
+{
+    return [self thumbnailsWithBestFrameIndex:NULL requestsPending:requestsPending];
+}
+
+- (NSArray *)thumbnailsWithBestFrameIndex:(NSUInteger *)bestFrameIndex requestsPending:(BOOL)requestsPending
+{
+    NSMutableArray *thumbnails = [[NSMutableArray alloc] initWithCapacity:_pixelBuffers.count + 2];
+    NSUInteger bestIndex = NSNotFound;
+    CMTime latestTimestamp = kCMTimeInvalid;
+
+    // the best frame goes in by time, a requested thumbnail of the same frame serves for both
+    BOOL wantsBestFrame = _capturesBestFrame && _bestFramePixelBuffer && CMTIME_IS_NUMERIC(_bestFrameTimestamp);
+
+    for (NSUInteger index = 0; index < _pixelBuffers.count; index++) {
+        CMTime timestamp = [_timestamps[index] CMTimeValue];
+        if (wantsBestFrame && CMTIME_COMPARE_INLINE(_bestFrameTimestamp, <, timestamp)) {
+            if ([self _addImageWithPixelBuffer:_bestFramePixelBuffer toThumbnails:thumbnails])
+                bestIndex = thumbnails.count - 1;
+            wantsBestFrame = NO;
+        }
+
+        BOOL added = [self _addImageWithPixelBuffer:(__bridge CVPixelBufferRef)_pixelBuffers[index] toThumbnails:thumbnails];
+        if (wantsBestFrame && CMTIME_COMPARE_INLINE(_bestFrameTimestamp, ==, timestamp)) {
+            if (added)
+                bestIndex = thumbnails.count - 1;
+            wantsBestFrame = NO;
+        }
+        latestTimestamp = timestamp;
+    }
+
+    if (wantsBestFrame) {
+        if ([self _addImageWithPixelBuffer:_bestFramePixelBuffer toThumbnails:thumbnails])
+            bestIndex = thumbnails.count - 1;
+        latestTimestamp = _bestFrameTimestamp;
+    }
+
+    // requests past the end of the recording fall back to the last frame, as the
+    // asset image generator would have
+    BOOL wantsLastFrame = _capturesLastFrame || requestsPending;
+    if (wantsLastFrame && _lastFramePixelBuffer && CMTIME_IS_NUMERIC(_lastFrameTimestamp)) {
+        BOOL alreadyCaptured = (CMTIME_IS_NUMERIC(latestTimestamp) && CMTIME_COMPARE_INLINE(latestTimestamp, ==, _lastFrameTimestamp));
+        if (!alreadyCaptured) {
+            [self _addImageWithPixelBuffer:_lastFramePixelBuffer toThumbnails:thumbnails];
+        }
+    }
+
+    if (bestFrameIndex) {
+        *bestFrameIndex = bestIndex;
+    }
+    return thumbnails;
+}
+
+- (void)reset
+{
+    [_pixelBuffers removeAllObjects];
+    [_timestamps removeAllObjects];
+
+    if (_lastFramePixelBuffer) {
+        CVPixelBufferRelease(_lastFramePixelBuffer);
+        _lastFramePixelBuffer = NULL;
+    }
+    _lastFrameTimestamp = kCMTimeInvalid;
+    if (_bestFramePixelBuffer) {
+        CVPixelBufferRelease(_bestFramePixelBuffer);
+        _bestFramePixelBuffer = NULL;
+    }
+    _bestFrameTimestamp = kCMTimeInvalid;
+    _bestFrameScore = 0;
+    _firstTimestamp = kCMTimeInvalid;
+}
+
+#pragma mark - downscaling
+
+- (BOOL)_setupResamplerForPixelBuffer:(CVPixelBufferRef)pixelBuffer
+{
+    size_t width = CVPixelBufferGetWidth(pixelBuffer);
+    size_t height = CVPixelBufferGetHeight(pixelBuffer);
+    OSType pixelFormat = CVPixelBufferGetPixelFormatType(pixelBuffer);
+
+    if (_resampler && width == _sourceWidth && height == _sourceHeight && pixelFormat == _sourcePixelFormat)
+        return YES;
+
+    [self _destroyResampler];
+
+    if (pixelFormat != kCVPixelFormatType_420YpCbCr8BiPlanarFullRange &&
+        pixelFormat != kCVPixelFormatType_420YpCbCr8BiPlanarVideoRange) {
+        return NO;
+    }
+
+    // the rolling slots belong to the old pool
+    if (_lastFramePixelBuffer) {
+        CVPixelBufferRelease(_lastFramePixelBuffer);
+        _lastFramePixelBuffer = NULL;
+        _lastFrameTimestamp = kCMTimeInvalid;
+    }
+    if (_bestFramePixelBuffer) {
+        CVPixelBufferRelease(_bestFramePixelBuffer);
+        _bestFramePixelBuffer = NULL;
+        _bestFrameTimestamp = kCMTimeInvalid;
+    }
+
+    size_t largest = MAX(width, height);
+    double scale = largest > _maximumDimension ? (double)_maximumDimension / (double)largest : 1.0;
+    size_t thumbnailWidth = MAX((size_t)(width * scale) & ~(size_t)1, (size_t)2);
+    size_t thumbnailHeight = MAX((size_t)(height * scale) & ~(size_t)1, (size_t)2);
+
+    PBJCropRect crop = { 0, 0, width & ~(size_t)1, height & ~(size_t)1 };
+    _resampler = PBJResamplerCreate(crop, thumbnailWidth, thumbnailHeight, PBJResampleFilterBox);
+    if (!_resampler)
+        return NO;
+
+    NSDictionary *pixelBufferAttributes = @{ (id)kCVPixelBufferPixelFormatTypeKey : @(pixelFormat),
+                                             (id)kCVPixelBufferWidthKey : @(thumbnailWidth),
+                                             (id)kCVPixelBufferHeightKey : @(thumbnailHeight),
+                                             (id)kCVPixelBufferIOSurfacePropertiesKey : @{} };
+    if (CVPixelBufferPoolCreate(kCFAllocatorDefault, NULL, (__bridge CFDictionaryRef)pixelBufferAttributes, &_pixelBufferPool) != kCVReturnSuccess) {
+        [self _destroyResampler];
+        return NO;
+    }
+
+    _sourceWidth = width;
+    _sourceHeight = height;
+    _sourcePixelFormat = pixelFormat;
+    return YES;
+}
+
+- (void)_destroyResampler
+{
+    if (_resampler) {
+        PBJResamplerDestroy(_resampler);
+        _resampler = NULL;
+    }
+    if (_pixelBufferPool) {
+        CVPixelBufferPoolRelease(_pixelBufferPool);
+        _pixelBufferPool = NULL;
+    }
+    _sourceWidth = 0;
+    _sourceHeight = 0;
+    _sourcePixelFormat = 0;
+}
+
+- (CVPixelBufferRef)_createDownscaledPixelBuffer:(CVPixelBufferRef)pixelBuffer CF_RETURNS_RETAINED
+{
+    CVPixelBufferRef thumbnailPixelBuffer = NULL;
+    if (CVPixelBufferPoolCreatePixelBuffer(kCFAllocatorDefault, _pixelBufferPool, &thumbnailPixelBuffer) != kCVReturnSuccess)
+        return NULL;
+
+    if (![PBJVisionUtilities resamplePixelBuffer:pixelBuffer toPixelBuffer:thumbnailPixelBuffer withResampler:_resampler]) {
+        CVPixelBufferRelease(thumbnailPixelBuffer);
+        return NULL;
+    }
+    return thumbnailPixelBuffer;
+}
+
+- (UIImage *)_imageWithPixelBuffer:(CVPixelBufferRef)pixelBuffer
+{
+    CGImageRef cgImage = [PBJVisionUtilities createCGImageFromPixelBuffer:pixelBuffer];
+    if (!cgImage)
+        return nil;
+
+    UIImage *image = [[UIImage alloc] initWithCGImage:cgImage];
+    CGImageRelease(cgImage);
+    return image;
+}
+
+- (BOOL)_addImageWithPixelBuffer:(CVPixelBufferRef)pixelBuffer toThumbnails:(NSMutableArray *)thumbnails
+{
+    UIImage *image = [self _imageWithPixelBuffer:pixelBuffer];
+    if (!image)
+        return NO;
+    [thumbnails addObject:image];
+    return YES;
+}
+
+@end
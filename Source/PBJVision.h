@@ -26,6 +26,14 @@
 #import <Foundation/Foundation.h>
 #import <AVFoundation/AVFoundation.h>
 
+#import "PBJInstrumentation.h"
+#import "PBJAudioMeter.h"
+#import "PBJFrameProcessor.h"
+#import "PBJOutputSink.h"
+#import "PBJSampleInterleaver.h"
+#import "PBJFramePool.h"
+#import "PBJProxyOutput.h"
+
 // support for swift compiler
 #ifndef NS_ASSUME_NONNULL_BEGIN
 # define NS_ASSUME_NONNULL_BEGIN
@@ -91,6 +99,33 @@ typedef NS_ENUM(NSInteger, PBJOutputFormat) {
     PBJOutputFormatStandard // 4:3
 };
 
+// what to drop when the writer falls behind capture
+typedef NS_ENUM(NSInteger, PBJFrameDropPolicy) {
+    PBJFrameDropPolicyDropOldest = 0,
+    PBJFrameDropPolicyDropNewest,
+    PBJFrameDropPolicyPreferAudio // drops video while audio is backed up, audio only drops its oldest on overflow
+};
+
+// how recorded time maps onto the file
+typedef NS_ENUM(NSInteger, PBJRecordingSpeed) {
+    PBJRecordingSpeedNormal = 0,
+    PBJRecordingSpeedTimeLapse, // a frame each timeLapseInterval, played at playbackFrameRate
+    PBJRecordingSpeedSlowMotion // every frame captured at videoFrameRate (ie 120 or 240), played at playbackFrameRate
+};
+
+typedef struct {
+    uint64_t videoFramesEnqueued;
+    uint64_t videoFramesWritten;
+    uint64_t videoFramesDropped;
+    uint64_t audioSamplesEnqueued; // sample buffers
+    uint64_t audioSamplesWritten;
+    uint64_t audioSamplesDropped;
+    uint64_t videoFramesQueued; // waiting for the writer when read
+    uint64_t videoQueueCapacity;
+    uint64_t videoAppendsDeferred; // the input wasn't ready for more, each retry counts
+    uint64_t videoAppendNanoseconds; // spent appending the frames written
+} PBJWriterStatistics;
+
 // PBJError
 
 extern NSString * const PBJVisionErrorDomain;
@@ -103,11 +138,13 @@ typedef NS_ENUM(NSInteger, PBJVisionErrorType)
     PBJVisionErrorBadOutputFile = 102,
     PBJVisionErrorOutputFileExists = 103,
     PBJVisionErrorCaptureFailed = 104,
+    PBJVisionErrorInsufficientStorage = 105, // recording ended early to leave room for finishing the file
 };
 
 // additional video capture keys
 
 extern NSString * const PBJVisionVideoRotation;
+extern NSString * const PBJVisionVideoMirrored; // horizontal flip ahead of the rotation, only with orientsVideoFrames
 
 // photo dictionary keys
 
@@ -122,6 +159,8 @@ extern NSString * const PBJVisionVideoPathKey;
 extern NSString * const PBJVisionVideoThumbnailKey;
 extern NSString * const PBJVisionVideoThumbnailArrayKey;
 extern NSString * const PBJVisionVideoCapturedDurationKey; // Captured duration in seconds
+extern NSString * const PBJVisionVideoProxyPathKey; // with recordsProxy, absent when the proxy failed
+extern NSString * const PBJVisionVideoProxyErrorKey; // why the proxy failed, the master may still be fine
 
 // suggested videoBitRate constants
 
@@ -178,6 +217,11 @@ static CGFloat const PBJVideoBitRate1280x750 = 5000000 * 8;
 @property (nonatomic) NSInteger videoFrameRate; // desired fps for active cameraDevice
 - (BOOL)supportsVideoFrameRate:(NSInteger)videoFrameRate;
 
+// picks the smallest format covering the dimensions at the rate, preferring unbinned formats, where
+// setting videoFrameRate picks the largest format supporting it
+- (void)setVideoFrameRate:(NSInteger)videoFrameRate minimumDimensions:(CMVideoDimensions)dimensions;
+- (NSInteger)maximumVideoFrameRateForDimensions:(CMVideoDimensions)dimensions; // 0 when the device cannot cover them
+
 // preview
 
 @property (nonatomic, readonly) AVCaptureVideoPreviewLayer *previewLayer;
@@ -212,13 +256,25 @@ static CGFloat const PBJVideoBitRate1280x750 = 5000000 * 8;
 // photo
 
 @property (nonatomic, readonly) BOOL canCapturePhoto;
+@property (nonatomic) CGFloat photoJPEGQuality; // 0 - 1, photos taken from video frames, default 0.9
 - (void)capturePhoto;
 
+// while recording, a photo from a video frame. with a selection interval the sharpest, best exposed
+// frame written within that many seconds before the call is taken, a few frames are held back
+// from the capture pool for it. default 0, the next frame
+@property (nonatomic) NSTimeInterval frameSelectionInterval;
+- (void)captureVideoFrameAsPhoto;
+
 // video
 // use pause/resume if a session is in progress, end finalizes that recording session
 
 @property (nonatomic, readonly) BOOL supportsVideoCapture;
 @property (nonatomic, readonly) BOOL canCaptureVideo;
+
+// free space is sampled in the background at a bounded rate and cached for canCapturePhoto and
+// canCaptureVideo. while recording, the rate the writer fills the disk predicts the time left and
+// capture ends with PBJVisionErrorInsufficientStorage a few seconds before the space runs out
+@property (nonatomic, readonly) NSTimeInterval estimatedRecordingTimeRemaining; // seconds, negative until known
 @property (nonatomic, readonly, getter=isRecording) BOOL recording;
 @property (nonatomic, readonly, getter=isPaused) BOOL paused;
 
@@ -228,10 +284,98 @@ static CGFloat const PBJVideoBitRate1280x750 = 5000000 * 8;
 @property (nonatomic, readonly) EAGLContext *context;
 @property (nonatomic) CGRect presentationFrame;
 
+// frames are queued between capture and a dedicated writer thread, depth applies to the
+// next recording (audio queues twice as many sample buffers)
+@property (nonatomic) NSUInteger writerQueueDepth; // default 8
+@property (nonatomic) PBJFrameDropPolicy frameDropPolicy; // default PBJFrameDropPolicyPreferAudio
+@property (nonatomic, readonly) PBJWriterStatistics writerStatistics; // current or most recent recording
+
+// steps the video bit rate down while the writer falls behind and back up once it keeps pace, then the
+// frame rate written once the bit rate is at its minimum, holding between the two so neither oscillates.
+// the bit rate follows on the device encoder of fragmented and pre-roll recordings, AVAssetWriter keeps
+// videoBitRate and only the frame rate follows, applies to the next recording
+@property (nonatomic) BOOL adaptsToWriterLoad; // default NO
+@property (nonatomic) CGFloat minimumVideoBitRate; // default 0, a quarter of videoBitRate
+@property (nonatomic) NSInteger minimumVideoFrameRate; // default 0, the frame rate stays fixed
+@property (nonatomic, readonly) CGFloat adaptedVideoBitRate; // current or most recent recording
+@property (nonatomic, readonly) CGFloat adaptedVideoFrameRate;
+
+// a valid interval records a fragmented MP4, flushed every interval at the next keyframe, ending a
+// recording is then near instant and a crash loses at most the open fragment, applies to the next recording
+@property (nonatomic) CMTime fragmentInterval; // default kCMTimeInvalid, standard MP4
+
+// fragmented recordings are written in large batches on their own thread, into a file preallocated
+// from the bit rates when maximumCaptureDuration is set. durability decides how often the file is
+// synced, which a crash of the app doesn't need but losing power does, applies to the next recording
+@property (nonatomic) PBJOutputSinkDurability outputDurability; // default PBJOutputSinkDurabilityFinish
+@property (nonatomic) uint64_t outputDurabilityBytes; // for PBJOutputSinkDurabilityBytes, default 8 MB
+
+// keeps the last few seconds of compressed video and audio while previewing, inside a fixed
+// memory budget, and starts each recording from the oldest keyframe held. recordings then use
+// the fragmented writer, with one second fragments unless fragmentInterval is set
+@property (nonatomic) CMTime prerollDuration; // default kCMTimeInvalid, disabled
+@property (nonatomic) NSUInteger prerollMemoryBudget; // bytes, default 24 MB
+
+// opt-in per-stage latency histograms (nanoseconds) and frame counters, cheap enough to leave on
+// and poll, counters cover video frames and delegate audio drops, values accumulate until reset
+@property (nonatomic, getter=isInstrumentationEnabled) BOOL instrumentationEnabled; // default NO
+@property (nonatomic, readonly) PBJInstrumentationSnapshot instrumentationSnapshot;
+- (void)resetInstrumentation;
+
+// audio levels measured on the capture queue, in place, and reported to vision:didMeasureAudioLevels:
+// at most once per interval with everything since the previous report. meters while previewing too
+@property (nonatomic, getter=isAudioMeteringEnabled) BOOL audioMeteringEnabled; // default NO
+@property (nonatomic) NSTimeInterval audioMeteringInterval; // default 1/60 s, about once per display frame
+@property (nonatomic) NSUInteger audioMeteringBandCount; // 0 - 8 log spaced bands, default 0
+
+// frame processing chain, stages run in the order added on every recorded video frame after
+// cropping and before the writer, preview rendering and the delegate, in tiles across cores
+// (see PBJFrameStages.h for reference stages). passes not started within the deadline are skipped
+- (void)addFrameProcessingStage:(PBJFrameStage)stage;
+- (void)removeAllFrameProcessingStages; // stage contexts may be released once this returns
+@property (nonatomic) NSTimeInterval frameProcessingDeadline; // default 0, one frame at videoFrameRate
+
+// rotates (PBJVisionVideoRotation, in quarter turns) and mirrors recorded frames in the pixels instead of
+// writing a track transform, for consumers that ignore it. applies before the frame processing chain,
+// taking effect from the next recording
+@property (nonatomic) BOOL orientsVideoFrames; // default NO
+
 @property (nonatomic) CMTime maximumCaptureDuration; // automatically triggers vision:capturedVideo:error: after exceeding threshold, (kCMTimeInvalid records without threshold)
+
+// time-lapse frames are dropped before the encoder, slow motion frames are spread out to play at
+// playbackFrameRate, either way audio isn't recorded and maximumCaptureDuration and the captured
+// seconds measure the file. takes effect from the next recording, one started with pre-roll
+// buffered records at normal speed
+@property (nonatomic) PBJRecordingSpeed recordingSpeed; // default PBJRecordingSpeedNormal
+@property (nonatomic) NSTimeInterval timeLapseInterval; // default 1
+@property (nonatomic) NSInteger playbackFrameRate; // default 30
 @property (nonatomic, readonly) Float64 capturedAudioSeconds;
 @property (nonatomic, readonly) Float64 capturedVideoSeconds;
 
+// audio and video are held briefly and written in presentation order, audio from before the first
+// frame is cut to it rather than dropped. how far apart the two arrived and were written, current
+// or most recent recording
+@property (nonatomic, readonly) PBJSampleInterleaverStatistics interleaveStatistics;
+
+// records a low resolution proxy next to each recording from the same frames, without transcoding
+// the finished file. frames are decimated to proxyFrameRate on the capture queue before any work is
+// spent on them, then downscaled on the CPU from the master's frames as written (cropped, oriented,
+// processed, retimed) to fit proxyMaximumDimension, and share the master's audio. the proxy goes next
+// to the master file with a _proxy suffix, both finish before vision:capturedVideo:error: and its
+// dictionary carries PBJVisionVideoProxyPathKey. applies to the next recording, not to one started
+// with pre-roll buffered
+@property (nonatomic) BOOL recordsProxy; // default NO
+@property (nonatomic) NSUInteger proxyMaximumDimension; // long edge, default 640
+@property (nonatomic) CGFloat proxyVideoBitRate; // default PBJVideoBitRate480x360
+@property (nonatomic) NSInteger proxyFrameRate; // default 15, 0 for every frame written
+@property (nonatomic, readonly) PBJProxyOutputStatistics proxyStatistics; // current or most recent recording
+
+// frames built on the CPU (photos, thumbnails, resampling scratch) come from a shared, recycled pool,
+// idle memory above the cap is released least recently used first and all of it on a memory warning
+// or entering the background
+@property (nonatomic) size_t framePoolMaximumBytes; // default 64MB
+@property (nonatomic, readonly) PBJFramePoolStatistics framePoolStatistics;
+
 @property (nonatomic, assign) CGFloat videoZoomFactor;
 @property (nonatomic, readonly) CGPoint focusPoint;
 
@@ -245,8 +389,9 @@ static CGFloat const PBJVideoBitRate1280x750 = 5000000 * 8;
 
 @property (nonatomic) BOOL thumbnailEnabled; // thumbnail generation, disabling reduces processing time for a photo or video
 @property (nonatomic) BOOL defaultVideoThumbnails; // capture first and last frames of video
+@property (nonatomic) BOOL contentAwareVideoThumbnails; // the best scoring frame in place of the first, default NO
 
-- (void)captureCurrentVideoThumbnail;
+- (void)captureCurrentVideoThumbnail; // the best frame of frameSelectionInterval when one is set
 - (void)captureVideoThumbnailAtFrame:(int64_t)frame;
 - (void)captureVideoThumbnailAtTime:(Float64)seconds;
 
@@ -315,10 +460,18 @@ static CGFloat const PBJVideoBitRate1280x750 = 5000000 * 8;
 - (void)vision:(PBJVision *)vision capturedVideo:(nullable NSDictionary *)videoDict error:(nullable NSError *)error;
 
 // video capture progress
+// video sample buffers are latest wins, a delegate slower than capture skips frames rather than falling behind.
+// audio sample buffers arrive in order, but a delegate that falls 64 buffers behind loses the oldest, counted
+// as PBJInstrumentationCounterAudioSamplesDropped in instrumentationSnapshot while instrumentation is enabled
+// to keep a frame past the callback, copy it with +[PBJVisionUtilities createFrameBufferWithPixelBuffer:]
 
 - (void)vision:(PBJVision *)vision didCaptureVideoSampleBuffer:(CMSampleBufferRef)sampleBuffer;
 - (void)vision:(PBJVision *)vision didCaptureAudioSample:(CMSampleBufferRef)sampleBuffer;
 
+// audio metering
+
+- (void)vision:(PBJVision *)vision didMeasureAudioLevels:(PBJAudioLevels)levels;
+
 NS_ASSUME_NONNULL_END
 
 @end
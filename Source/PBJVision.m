@@ -26,13 +26,23 @@
 #import "PBJVision.h"
 #import "PBJVisionUtilities.h"
 #import "PBJMediaWriter.h"
+#import "PBJVideoThumbnailStore.h"
+#import "PBJPrerollBuffer.h"
+#import "PBJCapturePipeline.h"
+#import "PBJSampleInterleaver.h"
+#import "PBJSampleDelivery.h"
+#import "PBJFormatIndex.h"
+#import "PBJSessionPlanner.h"
+#import "PBJStorageMonitor.h"
+#import "PBJRateGovernor.h"
 #import "PBJGLProgram.h"
 
-#import <CoreImage/CoreImage.h>
 #import <ImageIO/ImageIO.h>
 #import <OpenGLES/EAGL.h>
 #import <UIKit/UIKit.h>
 
+#include <stdatomic.h>
+
 #define LOG_VISION 1
 #ifndef DLog
 #if !defined(NDEBUG) && LOG_VISION
@@ -46,6 +56,35 @@ NSString * const PBJVisionErrorDomain = @"PBJVisionErrorDomain";
 
 static uint64_t const PBJVisionRequiredMinimumDiskSpaceInBytes = 49999872; // ~ 47 MB
 static CGFloat const PBJVisionThumbnailWidth = 160.0f;
+static size_t const PBJVisionVideoThumbnailMaximumDimension = 640;
+static NSUInteger const PBJVisionDefaultPrerollMemoryBudget = 24 * 1024 * 1024;
+static uint64_t const PBJVisionDefaultOutputDurabilityBytes = 8 * 1024 * 1024;
+static size_t const PBJVisionFrameSelectionCapacity = 3;
+static size_t const PBJVisionDelegateAudioCapacity = 64;
+
+static inline PBJTime PBJTimeFromCMTime(CMTime time)
+{
+    return CMTIME_IS_NUMERIC(time) ? PBJTimeMake(time.value, time.timescale) : PBJTimeMake(0, 0);
+}
+
+// capture pipeline sink, feeds accepted samples back into the writer
+static int PBJVisionPipelineSetupTrack(void *context, const PBJCaptureSample *sample);
+static int PBJVisionPipelineWriteSample(void *context, const PBJCaptureSample *sample, PBJTime rebasedPresentationTimestamp);
+static void PBJVisionPipelineMaximumDurationReached(void *context);
+static void PBJVisionPipelineRetainPayload(void *context, void *payload);
+static void PBJVisionPipelineReleasePayload(void *context, void *payload);
+
+// storage monitor volume, free space where recordings are written
+static int PBJVisionStorageFreeBytes(void *context, uint64_t *freeBytes);
+
+// written samples go out through the sample delivery, main queue wakes are filled in and sent
+// again by it rather than captured in a new block for every frame
+static void PBJVisionSampleDeliveryRetainSample(void *context, void *sample);
+static void PBJVisionSampleDeliveryReleaseSample(void *context, void *sample);
+static float PBJVisionSampleDeliveryScoreFrame(void *context, void *frame);
+static void PBJVisionSampleDeliveryThumbnailFrame(void *context, void *frame, float score, int requested);
+static void PBJVisionSampleDeliverySendWake(void *context, PBJSampleDeliveryWake *wake);
+static void PBJVisionSampleDeliveryWake(void *context);
 
 // KVO contexts
 static NSString * const PBJVisionFocusModeObserverContext = @"PBJVisionFocusModeObserverContext";
@@ -61,6 +100,7 @@ static NSString * const PBJVisionCaptureStillImageIsCapturingStillImageObserverC
 // additional video capture keys
 
 NSString * const PBJVisionVideoRotation = @"PBJVisionVideoRotation";
+NSString * const PBJVisionVideoMirrored = @"PBJVisionVideoMirrored";
 
 // photo dictionary key definitions
 
@@ -75,6 +115,8 @@ NSString * const PBJVisionVideoPathKey = @"PBJVisionVideoPathKey";
 NSString * const PBJVisionVideoThumbnailKey = @"PBJVisionVideoThumbnailKey";
 NSString * const PBJVisionVideoThumbnailArrayKey = @"PBJVisionVideoThumbnailArrayKey";
 NSString * const PBJVisionVideoCapturedDurationKey = @"PBJVisionVideoCapturedDurationKey";
+NSString * const PBJVisionVideoProxyPathKey = @"PBJVisionVideoProxyPathKey";
+NSString * const PBJVisionVideoProxyErrorKey = @"PBJVisionVideoProxyErrorKey";
 
 // PBJGLProgram shader uniforms for pixel format conversion on the GPU
 typedef NS_ENUM(GLint, PBJVisionUniformLocationTypes)
@@ -111,6 +153,65 @@ typedef NS_ENUM(GLint, PBJVisionUniformLocationTypes)
     // vision core
 
     PBJMediaWriter *_mediaWriter;
+    NSUInteger _writerQueueDepth;
+    PBJFrameDropPolicy _frameDropPolicy;
+    CMTime _fragmentInterval;
+    PBJOutputSinkDurability _outputDurability;
+    uint64_t _outputDurabilityBytes;
+
+    // writer load governor, capture queue, rebuilt for each recording
+    BOOL _adaptsToWriterLoad;
+    CGFloat _minimumVideoBitRate;
+    NSInteger _minimumVideoFrameRate;
+    PBJRateGovernor *_rateGovernor;
+    CGFloat _adaptedVideoBitRate;
+    CGFloat _adaptedVideoFrameRate;
+
+    // pre-roll, created with the first frame while previewing
+    CMTime _prerollDuration;
+    NSUInteger _prerollMemoryBudget;
+    PBJPrerollBuffer *_prerollBuffer;
+    CMVideoDimensions _prerollSourceDimensions;
+
+    // audio metering, the meter is rebuilt when the format changes
+    BOOL _audioMeteringEnabled;
+    NSTimeInterval _audioMeteringInterval;
+    NSUInteger _audioMeteringBandCount;
+    PBJAudioMeter *_audioMeter;
+    AudioStreamBasicDescription _audioMeterFormat;
+    uint64_t _audioMeterLastReport;
+
+    // frame processing chain, the pool supplies spares for out of place stages
+    PBJFrameProcessor *_frameProcessor;
+    NSTimeInterval _frameProcessingDeadline;
+    CVPixelBufferPoolRef _frameProcessingPixelBufferPool;
+    CMVideoFormatDescriptionRef _frameProcessingFormatDescription;
+
+    // where written samples go: governor admission, thumbnail requests, the frame selection
+    // window, the latest frame for the renderer and the video delegate (a frame still waiting
+    // when the next arrives is replaced rather than queued behind it) and every audio buffer
+    // for the delegate, each drained on the main queue at its own pace
+    PBJSampleDelivery *_sampleDelivery;
+
+    // written frames are scored on the capture queue, the best of the selection interval
+    // is held back for a photo or a thumbnail
+    PBJFrameAnalyzer *_frameAnalyzer;
+    NSTimeInterval _frameSelectionInterval;
+
+    BOOL _instrumentationEnabled;
+    PBJInstrumentation *_instrumentationStorage; // allocated on first enable, kept for snapshots
+    PBJInstrumentation *_instrumentation; // capture queue, NULL while disabled
+
+    // free space, the monitor and writer are confined to the storage queue, answers are published
+    // through the atomics for canCapturePhoto and canCaptureVideo
+    PBJStorageMonitor *_storageMonitor;
+    dispatch_queue_t _storageDispatchQueue;
+    dispatch_source_t _storageTimer;
+    PBJMediaWriter *_storageMediaWriter;
+    PBJMediaWriter *_storageProxyWriter; // the proxy's file fills the same volume
+    _Atomic(int) _storageMeasured;
+    _Atomic(uint64_t) _storageUsableBytes;
+    _Atomic(int64_t) _storageRemainingMilliseconds;
 
     dispatch_queue_t _captureSessionDispatchQueue;
     dispatch_queue_t _captureCaptureDispatchQueue;
@@ -134,8 +235,11 @@ typedef NS_ENUM(GLint, PBJVisionUniformLocationTypes)
     NSString *_captureSessionPreset;
     NSString *_captureDirectory;
     PBJOutputFormat _outputFormat;
-    NSMutableSet* _captureThumbnailTimes;
-    NSMutableSet* _captureThumbnailFrames;
+    PBJVideoThumbnailStore *_thumbnailStore;
+
+    // capture format capabilities per camera position, built on first use
+    PBJFormatIndex *_formatIndexes[2];
+    NSString *_formatIndexDeviceIDs[2];
     
     CGFloat _videoBitRate;
     NSInteger _audioBitRate;
@@ -150,10 +254,44 @@ typedef NS_ENUM(GLint, PBJVisionUniformLocationTypes)
     AVCaptureVideoPreviewLayer *_previewLayer;
     CGRect _cleanAperture;
 
-    CMTime _startTimestamp;
-    CMTime _timeOffset;
+    PBJCapturePipeline *_pipeline;
     CMTime _maximumCaptureDuration;
 
+    // recording speed, the retimer configuration is taken at the start of each recording
+    PBJRecordingSpeed _recordingSpeed;
+    NSTimeInterval _timeLapseInterval;
+    NSInteger _playbackFrameRate;
+    PBJCaptureRetimerConfiguration _retimerConfiguration;
+
+    // proxy recording, a second writer fed from the master's samples, taken at the start of each recording
+
+    BOOL _recordsProxy;
+    NSUInteger _proxyMaximumDimension;
+    CGFloat _proxyVideoBitRate;
+    NSInteger _proxyFrameRate;
+    PBJProxyOutput *_proxyOutput;
+    PBJMediaWriter *_proxyWriter;
+    NSError *_proxyError; // once set, nothing more goes to the proxy writer
+    CVPixelBufferPoolRef _proxyPixelBufferPool;
+    CMVideoFormatDescriptionRef _proxyFormatDescription;
+
+    // output format cropping
+
+    PBJResampler *_videoResampler;
+    CVPixelBufferPoolRef _videoResamplerPixelBufferPool;
+    CMVideoFormatDescriptionRef _videoResamplerFormatDescription;
+
+    // physical orientation, applied after cropping
+
+    BOOL _orientsVideoFrames;
+    PBJFrameOrientation _videoOrientation;
+    CVPixelBufferPoolRef _videoOrientationPixelBufferPool;
+    CMVideoFormatDescriptionRef _videoOrientationFormatDescription;
+
+    // photos taken from video frames, encoded straight from the planes
+
+    CGFloat _photoJPEGQuality;
+
     // sample buffer rendering
 
     PBJCameraDevice _bufferDevice;
@@ -168,8 +306,6 @@ typedef NS_ENUM(GLint, PBJVisionUniformLocationTypes)
     CVOpenGLESTextureRef _chromaTexture;
     CVOpenGLESTextureCacheRef _videoTextureCache;
     
-    CIContext *_ciContext;
-    
     // flags
     
     struct {
@@ -177,12 +313,12 @@ typedef NS_ENUM(GLint, PBJVisionUniformLocationTypes)
         unsigned int changingModes:1;
         unsigned int recording:1;
         unsigned int paused:1;
-        unsigned int interrupted:1;
         unsigned int videoWritten:1;
         unsigned int videoRenderingEnabled:1;
         unsigned int audioCaptureEnabled:1;
         unsigned int thumbnailEnabled:1;
         unsigned int defaultVideoThumbnails:1;
+        unsigned int contentAwareVideoThumbnails:1;
         unsigned int videoCaptureFrame:1;
     } __block _flags;
 }
@@ -219,6 +355,32 @@ typedef NS_ENUM(GLint, PBJVisionUniformLocationTypes)
 @synthesize additionalCompressionProperties = _additionalCompressionProperties;
 @synthesize additionalVideoProperties = _additionalVideoProperties;
 @synthesize maximumCaptureDuration = _maximumCaptureDuration;
+@synthesize recordingSpeed = _recordingSpeed;
+@synthesize timeLapseInterval = _timeLapseInterval;
+@synthesize playbackFrameRate = _playbackFrameRate;
+@synthesize recordsProxy = _recordsProxy;
+@synthesize proxyMaximumDimension = _proxyMaximumDimension;
+@synthesize proxyVideoBitRate = _proxyVideoBitRate;
+@synthesize proxyFrameRate = _proxyFrameRate;
+@synthesize writerQueueDepth = _writerQueueDepth;
+@synthesize frameDropPolicy = _frameDropPolicy;
+@synthesize fragmentInterval = _fragmentInterval;
+@synthesize outputDurability = _outputDurability;
+@synthesize outputDurabilityBytes = _outputDurabilityBytes;
+@synthesize adaptsToWriterLoad = _adaptsToWriterLoad;
+@synthesize minimumVideoBitRate = _minimumVideoBitRate;
+@synthesize minimumVideoFrameRate = _minimumVideoFrameRate;
+@synthesize adaptedVideoBitRate = _adaptedVideoBitRate;
+@synthesize adaptedVideoFrameRate = _adaptedVideoFrameRate;
+@synthesize prerollDuration = _prerollDuration;
+@synthesize prerollMemoryBudget = _prerollMemoryBudget;
+@synthesize audioMeteringEnabled = _audioMeteringEnabled;
+@synthesize audioMeteringInterval = _audioMeteringInterval;
+@synthesize audioMeteringBandCount = _audioMeteringBandCount;
+@synthesize frameProcessingDeadline = _frameProcessingDeadline;
+@synthesize orientsVideoFrames = _orientsVideoFrames;
+@synthesize photoJPEGQuality = _photoJPEGQuality;
+@synthesize frameSelectionInterval = _frameSelectionInterval;
 
 #pragma mark - singleton
 
@@ -294,22 +456,153 @@ typedef NS_ENUM(GLint, PBJVisionUniformLocationTypes)
     return _flags.defaultVideoThumbnails ? YES : NO;
 }
 
+- (void)setContentAwareVideoThumbnails:(BOOL)contentAwareVideoThumbnails
+{
+    _flags.contentAwareVideoThumbnails = (unsigned int)contentAwareVideoThumbnails;
+}
+
+- (BOOL)contentAwareVideoThumbnails
+{
+    return _flags.contentAwareVideoThumbnails ? YES : NO;
+}
+
 - (Float64)capturedAudioSeconds
 {
-    if (_mediaWriter && CMTIME_IS_VALID(_mediaWriter.audioTimestamp)) {
-        return CMTimeGetSeconds(CMTimeSubtract(_mediaWriter.audioTimestamp, _startTimestamp));
-    } else {
-        return 0.0;
-    }
+    return PBJTimeGetSeconds(PBJCapturePipelineGetOutputDurationForTrack(_pipeline, PBJCaptureTrackAudio));
 }
 
 - (Float64)capturedVideoSeconds
 {
-    if (_mediaWriter && CMTIME_IS_VALID(_mediaWriter.videoTimestamp)) {
-        return CMTimeGetSeconds(CMTimeSubtract(_mediaWriter.videoTimestamp, _startTimestamp));
-    } else {
-        return 0.0;
+    return PBJTimeGetSeconds(PBJCapturePipelineGetOutputDurationForTrack(_pipeline, PBJCaptureTrackVideo));
+}
+
+- (PBJWriterStatistics)writerStatistics
+{
+    PBJMediaWriter *mediaWriter = _mediaWriter;
+    if (mediaWriter) {
+        return mediaWriter.statistics;
+    }
+    PBJWriterStatistics statistics = { 0, 0, 0, 0, 0, 0 };
+    return statistics;
+}
+
+- (PBJSampleInterleaverStatistics)interleaveStatistics
+{
+    return PBJSampleInterleaverGetStatistics(PBJCapturePipelineGetInterleaver(_pipeline));
+}
+
+- (PBJProxyOutputStatistics)proxyStatistics
+{
+    return PBJProxyOutputGetStatistics(_proxyOutput);
+}
+
+- (void)setFramePoolMaximumBytes:(size_t)framePoolMaximumBytes
+{
+    _framePoolMaximumBytes = framePoolMaximumBytes;
+    PBJFramePoolSetMaximumBytes(PBJFramePoolGetShared(), framePoolMaximumBytes);
+}
+
+- (PBJFramePoolStatistics)framePoolStatistics
+{
+    return PBJFramePoolGetStatistics(PBJFramePoolGetShared());
+}
+
+- (void)setInstrumentationEnabled:(BOOL)instrumentationEnabled
+{
+    if (_instrumentationEnabled == instrumentationEnabled)
+        return;
+    _instrumentationEnabled = instrumentationEnabled;
+
+    if (instrumentationEnabled && !_instrumentationStorage) {
+        _instrumentationStorage = PBJInstrumentationCreate();
     }
+
+    PBJInstrumentation *instrumentation = instrumentationEnabled ? _instrumentationStorage : NULL;
+    [self _enqueueBlockOnCaptureVideoQueue:^{
+        self->_instrumentation = instrumentation;
+        self->_mediaWriter.instrumentation = instrumentation;
+        PBJSampleDeliverySetInstrumentation(self->_sampleDelivery, instrumentation);
+    }];
+}
+
+- (BOOL)isInstrumentationEnabled
+{
+    return _instrumentationEnabled;
+}
+
+- (PBJInstrumentationSnapshot)instrumentationSnapshot
+{
+    return PBJInstrumentationGetSnapshot(_instrumentationStorage);
+}
+
+- (void)resetInstrumentation
+{
+    PBJInstrumentationReset(_instrumentationStorage);
+}
+
+- (void)setPrerollDuration:(CMTime)prerollDuration
+{
+    _prerollDuration = prerollDuration;
+    [self _enqueueBlockOnCaptureVideoQueue:^{
+        [self _updatePrerollBuffer];
+    }];
+}
+
+- (void)setPrerollMemoryBudget:(NSUInteger)prerollMemoryBudget
+{
+    _prerollMemoryBudget = prerollMemoryBudget;
+    [self _enqueueBlockOnCaptureVideoQueue:^{
+        [self _updatePrerollBuffer];
+    }];
+}
+
+- (void)setAudioMeteringEnabled:(BOOL)audioMeteringEnabled
+{
+    _audioMeteringEnabled = audioMeteringEnabled;
+    [self _enqueueBlockOnCaptureVideoQueue:^{
+        PBJAudioMeterDestroy(self->_audioMeter);
+        self->_audioMeter = NULL;
+    }];
+}
+
+- (void)setAudioMeteringBandCount:(NSUInteger)audioMeteringBandCount
+{
+    _audioMeteringBandCount = MIN(audioMeteringBandCount, (NSUInteger)PBJAudioMeterMaximumBands);
+    [self _enqueueBlockOnCaptureVideoQueue:^{
+        PBJAudioMeterDestroy(self->_audioMeter);
+        self->_audioMeter = NULL;
+    }];
+}
+
+// frame processing, the chain is only touched on the capture queue
+
+- (void)addFrameProcessingStage:(PBJFrameStage)stage
+{
+    [self _enqueueBlockOnCaptureVideoQueue:^{
+        if (!self->_frameProcessor) {
+            self->_frameProcessor = PBJFrameProcessorCreate(NULL);
+        }
+        if (!PBJFrameProcessorAddStage(self->_frameProcessor, &stage)) {
+            DLog(@"frame processing chain is full");
+        }
+    }];
+}
+
+- (void)removeAllFrameProcessingStages
+{
+    // synchronous so stage contexts can be released once this returns
+    dispatch_sync(_captureCaptureDispatchQueue, ^{
+        PBJFrameProcessorRemoveAllStages(self->_frameProcessor);
+        [self _destroyFrameProcessingPool];
+    });
+}
+
+- (void)setMaximumCaptureDuration:(CMTime)maximumCaptureDuration
+{
+    _maximumCaptureDuration = maximumCaptureDuration;
+    [self _enqueueBlockOnCaptureVideoQueue:^{
+        PBJCapturePipelineSetMaximumDuration(self->_pipeline, PBJTimeFromCMTime(maximumCaptureDuration));
+    }];
 }
 
 - (void)setCameraOrientation:(PBJCameraOrientation)cameraOrientation
@@ -427,11 +720,9 @@ typedef NS_ENUM(GLint, PBJVisionUniformLocationTypes)
     }
     
     [self _enqueueBlockOnCaptureSessionQueue:^{
-        // camera is already setup, no need to call _setupCamera
+        // camera is already setup, no need to call _setupCamera, the session plan covers mirroring
         [self _setupSession];
 
-        [self setMirroringMode:self->_mirroringMode];
-        
         [self _enqueueBlockOnMainQueue:didChangeBlock];
         [self setFlashMode:self.flashMode forceUpdate:YES];
     }];
@@ -572,13 +863,66 @@ typedef NS_ENUM(GLint, PBJVisionUniformLocationTypes)
 
 // framerate
 
-- (void)setVideoFrameRate:(NSInteger)videoFrameRate
+- (PBJFormatIndex *)_formatIndexForDevice:(AVCaptureDevice *)device
+{
+    if (!device)
+        return NULL;
+
+    NSInteger position = (device.position == AVCaptureDevicePositionFront) ? PBJCameraDeviceFront : PBJCameraDeviceBack;
+    if (_formatIndexes[position] && [_formatIndexDeviceIDs[position] isEqualToString:device.uniqueID])
+        return _formatIndexes[position];
+
+    NSArray *formats = device.formats;
+    NSUInteger descriptorCount = 0;
+    for (AVCaptureDeviceFormat *format in formats) {
+        descriptorCount += format.videoSupportedFrameRateRanges.count;
+    }
+
+    PBJFormatDescriptor *descriptors = (PBJFormatDescriptor *)calloc(MAX(descriptorCount, 1), sizeof(PBJFormatDescriptor));
+    if (!descriptors)
+        return NULL;
+
+    NSUInteger descriptorIndex = 0;
+    for (NSUInteger formatIndex = 0; formatIndex < formats.count; formatIndex++) {
+        AVCaptureDeviceFormat *format = formats[formatIndex];
+        CMFormatDescriptionRef formatDescription = format.formatDescription;
+        CMVideoDimensions dimensions = CMVideoFormatDescriptionGetDimensions(formatDescription);
+        for (AVFrameRateRange *range in format.videoSupportedFrameRateRanges) {
+            PBJFormatDescriptor *descriptor = &descriptors[descriptorIndex++];
+            descriptor->format = (uint32_t)formatIndex;
+            descriptor->width = dimensions.width;
+            descriptor->height = dimensions.height;
+            descriptor->pixelFormat = CMFormatDescriptionGetMediaSubType(formatDescription);
+            descriptor->minFrameRate = range.minFrameRate;
+            descriptor->maxFrameRate = range.maxFrameRate;
+            descriptor->fieldOfView = format.videoFieldOfView;
+            descriptor->maxZoomFactor = (float)format.videoMaxZoomFactor;
+            descriptor->binned = format.isVideoBinned ? 1 : 0;
+        }
+    }
+
+    PBJFormatIndexDestroy(_formatIndexes[position]);
+    _formatIndexes[position] = PBJFormatIndexCreate(descriptors, descriptorIndex);
+    _formatIndexDeviceIDs[position] = _formatIndexes[position] ? [device.uniqueID copy] : nil;
+    free(descriptors);
+
+    return _formatIndexes[position];
+}
+
+- (void)_setVideoFrameRate:(NSInteger)videoFrameRate withFormatQuery:(PBJFormatQuery)query
 {
-    if (![self supportsVideoFrameRate:videoFrameRate]) {
+    AVCaptureDevice *videoDevice = _currentDevice;
+    const PBJFormatDescriptor *descriptor = PBJFormatIndexFind([self _formatIndexForDevice:videoDevice], &query);
+    if (!descriptor) {
         DLog(@"frame rate range not supported for current device format");
         return;
     }
-    
+
+    NSArray *formats = videoDevice.formats;
+    AVCaptureDeviceFormat *supportingFormat = descriptor->format < formats.count ? formats[descriptor->format] : nil;
+    if (!supportingFormat)
+        return;
+
     BOOL isRecording = _flags.recording ? YES : NO;
     if (isRecording) {
         [self pauseVideoCapture];
@@ -586,38 +930,16 @@ typedef NS_ENUM(GLint, PBJVisionUniformLocationTypes)
 
     CMTime fps = CMTimeMake(1, (int32_t)videoFrameRate);
 
-    AVCaptureDevice *videoDevice = _currentDevice;
-    AVCaptureDeviceFormat *supportingFormat = nil;
-    int32_t maxWidth = 0;
-
-    NSArray *formats = [videoDevice formats];
-    for (AVCaptureDeviceFormat *format in formats) {
-        NSArray *videoSupportedFrameRateRanges = format.videoSupportedFrameRateRanges;
-        for (AVFrameRateRange *range in videoSupportedFrameRateRanges) {
-
-            CMFormatDescriptionRef desc = format.formatDescription;
-            CMVideoDimensions dimensions = CMVideoFormatDescriptionGetDimensions(desc);
-            int32_t width = dimensions.width;
-            if (range.minFrameRate <= videoFrameRate && videoFrameRate <= range.maxFrameRate && width >= maxWidth) {
-                supportingFormat = format;
-                maxWidth = width;
-            }
-            
-        }
-    }
-    
-    if (supportingFormat) {
-        NSError *error = nil;
-        [_captureSession beginConfiguration];  // the session to which the receiver's AVCaptureDeviceInput is added.
-        if ([_currentDevice lockForConfiguration:&error]) {
-            [_currentDevice setActiveFormat:supportingFormat];
-            _currentDevice.activeVideoMinFrameDuration = fps;
-            _currentDevice.activeVideoMaxFrameDuration = fps;
-            _videoFrameRate = videoFrameRate;
-            [_currentDevice unlockForConfiguration];
-        } else if (error) {
-            DLog(@"error locking device for frame rate change (%@)", error);
-        }
+    NSError *error = nil;
+    [_captureSession beginConfiguration];  // the session to which the receiver's AVCaptureDeviceInput is added.
+    if ([videoDevice lockForConfiguration:&error]) {
+        [videoDevice setActiveFormat:supportingFormat];
+        videoDevice.activeVideoMinFrameDuration = fps;
+        videoDevice.activeVideoMaxFrameDuration = fps;
+        _videoFrameRate = videoFrameRate;
+        [videoDevice unlockForConfiguration];
+    } else if (error) {
+        DLog(@"error locking device for frame rate change (%@)", error);
     }
     [_captureSession commitConfiguration];
     [self _enqueueBlockOnMainQueue:^{
@@ -630,6 +952,20 @@ typedef NS_ENUM(GLint, PBJVisionUniformLocationTypes)
     }
 }
 
+- (void)setVideoFrameRate:(NSInteger)videoFrameRate
+{
+    // the largest format supporting the rate
+    [self _setVideoFrameRate:videoFrameRate withFormatQuery:PBJFormatQueryMake(videoFrameRate, PBJFormatSelectionLargest)];
+}
+
+- (void)setVideoFrameRate:(NSInteger)videoFrameRate minimumDimensions:(CMVideoDimensions)dimensions
+{
+    PBJFormatQuery query = PBJFormatQueryMake(videoFrameRate, PBJFormatSelectionSmallest);
+    query.minimumWidth = dimensions.width;
+    query.minimumHeight = dimensions.height;
+    [self _setVideoFrameRate:videoFrameRate withFormatQuery:query];
+}
+
 - (NSInteger)videoFrameRate
 {
     if (!_currentDevice) {
@@ -641,20 +977,12 @@ typedef NS_ENUM(GLint, PBJVisionUniformLocationTypes)
 
 - (BOOL)supportsVideoFrameRate:(NSInteger)videoFrameRate
 {
-    if (!_currentDevice) {
-        return NO;
-    }
-    
-    NSArray *formats = [_currentDevice formats];
-    for (AVCaptureDeviceFormat *format in formats) {
-        NSArray *videoSupportedFrameRateRanges = [format videoSupportedFrameRateRanges];
-        for (AVFrameRateRange *frameRateRange in videoSupportedFrameRateRanges) {
-            if ( (frameRateRange.minFrameRate <= videoFrameRate) && (videoFrameRate <= frameRateRange.maxFrameRate) ) {
-                return YES;
-            }
-        }
-    }
-    return NO;
+    return PBJFormatIndexSupportsFrameRate([self _formatIndexForDevice:_currentDevice], videoFrameRate) ? YES : NO;
+}
+
+- (NSInteger)maximumVideoFrameRateForDimensions:(CMVideoDimensions)dimensions
+{
+    return (NSInteger)PBJFormatIndexGetMaximumFrameRate([self _formatIndexForDevice:_currentDevice], dimensions.width, dimensions.height);
 }
 
 #pragma mark - init
@@ -685,6 +1013,15 @@ typedef NS_ENUM(GLint, PBJVisionUniformLocationTypes)
 
         // default audio/video configuration
         _audioBitRate = 64000;
+        _writerQueueDepth = 8;
+        _frameDropPolicy = PBJFrameDropPolicyPreferAudio;
+        _fragmentInterval = kCMTimeInvalid;
+        _outputDurability = PBJOutputSinkDurabilityFinish;
+        _outputDurabilityBytes = PBJVisionDefaultOutputDurabilityBytes;
+        _prerollDuration = kCMTimeInvalid;
+        _prerollMemoryBudget = PBJVisionDefaultPrerollMemoryBudget;
+        _audioMeteringInterval = 1.0 / 60.0;
+        _photoJPEGQuality = 0.9f;
         
         // default flags
         _flags.thumbnailEnabled = YES;
@@ -694,15 +1031,38 @@ typedef NS_ENUM(GLint, PBJVisionUniformLocationTypes)
         // setup queues
         _captureSessionDispatchQueue = dispatch_queue_create("PBJVisionSession", DISPATCH_QUEUE_SERIAL); // protects session
         _captureCaptureDispatchQueue = dispatch_queue_create("PBJVisionCapture", DISPATCH_QUEUE_SERIAL); // protects capture
+
+        // accessed only on the capture queue
+        PBJCapturePipelineSink pipelineSink = { (__bridge void *)self, PBJVisionPipelineSetupTrack, PBJVisionPipelineWriteSample, PBJVisionPipelineMaximumDurationReached,
+                                                PBJVisionPipelineRetainPayload, PBJVisionPipelineReleasePayload };
+        _pipeline = PBJCapturePipelineCreate(pipelineSink);
+        PBJSampleDeliveryCallbacks deliveryCallbacks = { (__bridge void *)self, PBJVisionSampleDeliveryRetainSample, PBJVisionSampleDeliveryReleaseSample,
+                                                         PBJVisionSampleDeliveryScoreFrame, PBJVisionSampleDeliveryThumbnailFrame, PBJVisionSampleDeliverySendWake };
+        _sampleDelivery = PBJSampleDeliveryCreate(deliveryCallbacks, PBJVisionFrameSelectionCapacity, PBJVisionDelegateAudioCapacity);
+        _thumbnailStore = [[PBJVideoThumbnailStore alloc] initWithMaximumDimension:PBJVisionVideoThumbnailMaximumDimension];
+        PBJFrameAnalyzerConfiguration analyzerConfiguration = PBJFrameAnalyzerDefaultConfiguration();
+        _frameAnalyzer = PBJFrameAnalyzerCreate(&analyzerConfiguration);
+        [self _setupStorageMonitor];
         
         _previewLayer = [[AVCaptureVideoPreviewLayer alloc] init];
         
         _maximumCaptureDuration = kCMTimeInvalid;
+        _recordingSpeed = PBJRecordingSpeedNormal;
+        _timeLapseInterval = 1.0;
+        _playbackFrameRate = 30;
+        _retimerConfiguration = PBJCaptureRetimerDefaultConfiguration();
+        PBJProxyOutputConfiguration proxyConfiguration = PBJProxyOutputDefaultConfiguration();
+        _proxyOutput = PBJProxyOutputCreate(&proxyConfiguration);
+        _proxyMaximumDimension = proxyConfiguration.maximumDimension;
+        _proxyVideoBitRate = PBJVideoBitRate480x360;
+        _proxyFrameRate = (NSInteger)proxyConfiguration.frameRate;
+        _framePoolMaximumBytes = PBJFramePoolDefaultConfiguration().maximumBytes;
 
         [self setMirroringMode:PBJMirroringAuto];
 
         [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(_applicationWillEnterForeground:) name:UIApplicationWillEnterForegroundNotification object:[UIApplication sharedApplication]];
         [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(_applicationDidEnterBackground:) name:UIApplicationDidEnterBackgroundNotification object:[UIApplication sharedApplication]];
+        [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(_applicationDidReceiveMemoryWarning:) name:UIApplicationDidReceiveMemoryWarningNotification object:[UIApplication sharedApplication]];
     }
     return self;
 }
@@ -712,6 +1072,8 @@ typedef NS_ENUM(GLint, PBJVisionUniformLocationTypes)
     [[NSNotificationCenter defaultCenter] removeObserver:self];
     _delegate = nil;
 
+    [self _destroyStorageMonitor];
+
     [self _cleanUpTextures];
     
     if (_videoTextureCache) {
@@ -721,6 +1083,42 @@ typedef NS_ENUM(GLint, PBJVisionUniformLocationTypes)
     
     [self _destroyGL];
     [self _destroyCamera];
+    [self _destroyVideoResampler];
+    [self _destroyVideoOrientation];
+    [self _destroyProxyFrames];
+    PBJProxyOutputDestroy(_proxyOutput);
+    _proxyOutput = NULL;
+
+    PBJCapturePipelineDestroy(_pipeline);
+    _pipeline = NULL;
+
+    PBJRateGovernorDestroy(_rateGovernor);
+    _rateGovernor = NULL;
+
+    [_prerollBuffer invalidate];
+    _prerollBuffer = nil;
+
+    PBJAudioMeterDestroy(_audioMeter);
+    _audioMeter = NULL;
+
+    PBJSampleDeliveryDestroy(_sampleDelivery);
+    _sampleDelivery = NULL;
+    PBJFrameAnalyzerDestroy(_frameAnalyzer);
+    _frameAnalyzer = NULL;
+
+    for (NSInteger position = 0; position < 2; position++) {
+        PBJFormatIndexDestroy(_formatIndexes[position]);
+        _formatIndexes[position] = NULL;
+    }
+
+    [self _destroyFrameProcessingPool];
+    PBJFrameProcessorDestroy(_frameProcessor);
+    _frameProcessor = NULL;
+
+    _mediaWriter.instrumentation = NULL;
+    _instrumentation = NULL;
+    PBJInstrumentationDestroy(_instrumentationStorage);
+    _instrumentationStorage = NULL;
 }
 
 #pragma mark - queue helper methods
@@ -921,242 +1319,252 @@ typedef void (^PBJVisionBlock)(void);
     return (sessionContainsOutput && outputHasConnection);
 }
 
-// _setupSession is always called from the captureSession queue
-- (void)_setupSession
+// what the session holds right now, connection settings a connection cannot change count as settled
+- (PBJSessionConfiguration)_currentSessionConfigurationWithDesired:(PBJSessionConfiguration)desired
 {
-    if (!_captureSession) {
-        DLog(@"error, no session running to setup");
-        return;
+    PBJSessionConfiguration configuration = PBJSessionConfigurationMakeEmpty();
+
+    NSArray *inputs = _captureSession.inputs;
+    if (_captureDeviceInputBack && [inputs containsObject:_captureDeviceInputBack]) {
+        configuration.camera = PBJSessionCameraBack;
+    } else if (_captureDeviceInputFront && [inputs containsObject:_captureDeviceInputFront]) {
+        configuration.camera = PBJSessionCameraFront;
     }
-    
-    BOOL shouldSwitchDevice = (_currentDevice == nil) ||
-                              ((_currentDevice == _captureDeviceFront) && (_cameraDevice != PBJCameraDeviceFront)) ||
-                              ((_currentDevice == _captureDeviceBack) && (_cameraDevice != PBJCameraDeviceBack));
-    
-    AVCaptureOutput *cameraOutput = _captureOutputPhoto;
-    BOOL shouldSwitchMode = (_currentOutput == nil) ||
-                            ((_currentOutput == cameraOutput) && (_cameraMode != PBJCameraModePhoto)) ||
-                            ((_currentOutput == _captureOutputVideo) && (_cameraMode != PBJCameraModeVideo));
-    
-    DLog(@"switchDevice %d switchMode %d", shouldSwitchDevice, shouldSwitchMode);
+    configuration.audioInput = (_captureDeviceInputAudio && [inputs containsObject:_captureDeviceInputAudio]);
 
-    if (!shouldSwitchDevice && !shouldSwitchMode)
-        return;
-    
-    AVCaptureDeviceInput *newDeviceInput = nil;
-    AVCaptureOutput *newCaptureOutput = nil;
-    AVCaptureDevice *newCaptureDevice = nil;
-    
-    [_captureSession beginConfiguration];
-    
-    // setup session device
-    
-    if (shouldSwitchDevice) {
-        switch (_cameraDevice) {
-          case PBJCameraDeviceFront:
-          {
-            if (_captureDeviceInputBack)
-                [_captureSession removeInput:_captureDeviceInputBack];
-            
-            if (_captureDeviceInputFront && [_captureSession canAddInput:_captureDeviceInputFront]) {
-                [_captureSession addInput:_captureDeviceInputFront];
-                newDeviceInput = _captureDeviceInputFront;
-                newCaptureDevice = _captureDeviceFront;
-            }
+    NSArray *outputs = _captureSession.outputs;
+    configuration.videoOutput = (_captureOutputVideo && [outputs containsObject:_captureOutputVideo]);
+    configuration.photoOutput = (_captureOutputPhoto && [outputs containsObject:_captureOutputPhoto]);
+    configuration.audioOutput = (_captureOutputAudio && [outputs containsObject:_captureOutputAudio]);
+
+    // presets are tokens, 1 is the requested preset
+    configuration.preset = [_captureSession.sessionPreset isEqualToString:_captureSessionPreset] ? 1 : 0;
+
+    AVCaptureConnection *videoConnection = [_captureOutputVideo connectionWithMediaType:AVMediaTypeVideo];
+    if (configuration.videoOutput && videoConnection) {
+        configuration.videoOrientation = [videoConnection isVideoOrientationSupported] ? (int)videoConnection.videoOrientation : desired.videoOrientation;
+    }
+
+    AVCaptureOutput *primaryOutput = configuration.videoOutput ? _captureOutputVideo : (configuration.photoOutput ? _captureOutputPhoto : nil);
+    AVCaptureConnection *primaryConnection = [primaryOutput connectionWithMediaType:AVMediaTypeVideo];
+    if (primaryConnection && primaryOutput == _currentOutput) {
+        configuration.mirrored = [primaryConnection isVideoMirroringSupported] ? (primaryConnection.isVideoMirrored ? 1 : 0) : desired.mirrored;
+    }
+
+    return configuration;
+}
+
+- (PBJSessionConfiguration)_desiredSessionConfiguration
+{
+    PBJSessionConfiguration configuration = PBJSessionConfigurationMakeEmpty();
+
+    configuration.camera = (_cameraDevice == PBJCameraDeviceFront) ? PBJSessionCameraFront : PBJSessionCameraBack;
+    if (_cameraMode == PBJCameraModeVideo) {
+        configuration.videoOutput = 1;
+        configuration.audioInput = (_flags.audioCaptureEnabled && _captureDeviceInputAudio);
+        configuration.audioOutput = (_flags.audioCaptureEnabled && _captureOutputAudio);
+    } else {
+        configuration.photoOutput = 1;
+    }
+    configuration.preset = 1;
+
+    // PBJCameraOrientation shares AVCaptureVideoOrientation's values
+    configuration.videoOrientation = (int)_cameraOrientation;
+    switch (_mirroringMode) {
+        case PBJMirroringOn:
+            configuration.mirrored = 1;
             break;
-          }
-          case PBJCameraDeviceBack:
-          {
-            if (_captureDeviceInputFront)
-                [_captureSession removeInput:_captureDeviceInputFront];
-            
-            if (_captureDeviceInputBack && [_captureSession canAddInput:_captureDeviceInputBack]) {
-                [_captureSession addInput:_captureDeviceInputBack];
-                newDeviceInput = _captureDeviceInputBack;
-                newCaptureDevice = _captureDeviceBack;
-            }
+        case PBJMirroringOff:
+            configuration.mirrored = 0;
             break;
-          }
-          default:
+        case PBJMirroringAuto:
+        default:
+            configuration.mirrored = (_cameraDevice == PBJCameraDeviceFront) ? 1 : 0;
             break;
+    }
+
+    return configuration;
+}
+
+- (void)_configureVideoOutput
+{
+    AVCaptureConnection *videoConnection = [_captureOutputVideo connectionWithMediaType:AVMediaTypeVideo];
+    if (!videoConnection)
+        return;
+
+    // setup video stabilization, if available
+    if ([videoConnection isVideoStabilizationSupported]) {
+        if ([videoConnection respondsToSelector:@selector(setPreferredVideoStabilizationMode:)]) {
+            [videoConnection setPreferredVideoStabilizationMode:AVCaptureVideoStabilizationModeAuto];
         }
-        
-    } // shouldSwitchDevice
-    
-    // setup session input/output
-    
-    if (shouldSwitchMode) {
-    
-        // disable audio when in use for photos, otherwise enable it
-        
-        if (self.cameraMode == PBJCameraModePhoto) {
-            if (_captureDeviceInputAudio)
-                [_captureSession removeInput:_captureDeviceInputAudio];
-            
-            if (_captureOutputAudio)
-                [_captureSession removeOutput:_captureOutputAudio];
-        
-        } else if (!_captureDeviceAudio && !_captureDeviceInputAudio && !_captureOutputAudio &&  _flags.audioCaptureEnabled) {
-        
-            NSError *error = nil;
-            _captureDeviceAudio = [AVCaptureDevice defaultDeviceWithMediaType:AVMediaTypeAudio];
-            _captureDeviceInputAudio = [AVCaptureDeviceInput deviceInputWithDevice:_captureDeviceAudio error:&error];
-            if (error) {
-                DLog(@"error setting up audio input (%@)", error);
-            }
+    }
 
-            _captureOutputAudio = [[AVCaptureAudioDataOutput alloc] init];
-            [_captureOutputAudio setSampleBufferDelegate:self queue:_captureCaptureDispatchQueue];
-            
+    // discard late frames
+    [_captureOutputVideo setAlwaysDiscardsLateVideoFrames:YES];
+
+    // setup video settings
+    // kCVPixelFormatType_420YpCbCr8BiPlanarFullRange Bi-Planar Component Y'CbCr 8-bit 4:2:0, full-range (luma=[0,255] chroma=[1,255])
+    // baseAddr points to a big-endian CVPlanarPixelBufferInfo_YCbCrBiPlanar struct
+    BOOL supportsFullRangeYUV = NO;
+    BOOL supportsVideoRangeYUV = NO;
+    NSArray *supportedPixelFormats = _captureOutputVideo.availableVideoCVPixelFormatTypes;
+    for (NSNumber *currentPixelFormat in supportedPixelFormats) {
+        if ([currentPixelFormat intValue] == kCVPixelFormatType_420YpCbCr8BiPlanarFullRange) {
+            supportsFullRangeYUV = YES;
         }
-        
-        [_captureSession removeOutput:_captureOutputVideo];
-        
-        [_captureSession removeOutput:_captureOutputPhoto];
-        
-        switch (_cameraMode) {
-            case PBJCameraModeVideo:
-            {
-                // audio input
-                if ([_captureSession canAddInput:_captureDeviceInputAudio]) {
-                    [_captureSession addInput:_captureDeviceInputAudio];
-                }
-                // audio output
-                if ([_captureSession canAddOutput:_captureOutputAudio]) {
-                    [_captureSession addOutput:_captureOutputAudio];
-                }
-                // vidja output
-                if ([_captureSession canAddOutput:_captureOutputVideo]) {
-                    [_captureSession addOutput:_captureOutputVideo];
-                    newCaptureOutput = _captureOutputVideo;
-                }
-                break;
-            }
-            case PBJCameraModePhoto:
-            {
-                // photo output
-                if ([_captureSession canAddOutput:cameraOutput]) {
-                    [_captureSession addOutput:cameraOutput];
-                    newCaptureOutput = cameraOutput;
-                }
-                break;
-            }
-            default:
-                break;
+        if ([currentPixelFormat intValue] == kCVPixelFormatType_420YpCbCr8BiPlanarVideoRange) {
+            supportsVideoRangeYUV = YES;
         }
-        
-    } // shouldSwitchMode
-    
-    if (!newCaptureDevice)
-        newCaptureDevice = _currentDevice;
+    }
 
-    if (!newCaptureOutput)
-        newCaptureOutput = _currentOutput;
+    NSDictionary *videoSettings = nil;
+    if (supportsFullRangeYUV) {
+        videoSettings = @{ (id)kCVPixelBufferPixelFormatTypeKey : @(kCVPixelFormatType_420YpCbCr8BiPlanarFullRange) };
+    } else if (supportsVideoRangeYUV) {
+        videoSettings = @{ (id)kCVPixelBufferPixelFormatTypeKey : @(kCVPixelFormatType_420YpCbCr8BiPlanarVideoRange) };
+    }
+    if (videoSettings) {
+        [_captureOutputVideo setVideoSettings:videoSettings];
+    }
+}
 
-    // setup video connection
-    AVCaptureConnection *videoConnection = [_captureOutputVideo connectionWithMediaType:AVMediaTypeVideo];
-    
-    // setup input/output
-    
-    NSString *sessionPreset = _captureSessionPreset;
+- (void)_configureCaptureDevice:(AVCaptureDevice *)captureDevice
+{
+    NSError *error = nil;
+    if ([captureDevice lockForConfiguration:&error]) {
 
-    if ( newCaptureOutput && (newCaptureOutput == _captureOutputVideo) && videoConnection ) {
-        
-        // setup video orientation
-        [self _setOrientationForConnection:videoConnection];
-        
-        // setup video stabilization, if available
-        if ([videoConnection isVideoStabilizationSupported]) {
-            if ([videoConnection respondsToSelector:@selector(setPreferredVideoStabilizationMode:)]) {
-                [videoConnection setPreferredVideoStabilizationMode:AVCaptureVideoStabilizationModeAuto];
-            }
-        }
-        
-        // discard late frames
-        [_captureOutputVideo setAlwaysDiscardsLateVideoFrames:YES];
-        
-        // specify video preset
-        sessionPreset = _captureSessionPreset;
-
-        // setup video settings
-        // kCVPixelFormatType_420YpCbCr8BiPlanarFullRange Bi-Planar Component Y'CbCr 8-bit 4:2:0, full-range (luma=[0,255] chroma=[1,255])
-        // baseAddr points to a big-endian CVPlanarPixelBufferInfo_YCbCrBiPlanar struct
-        BOOL supportsFullRangeYUV = NO;
-        BOOL supportsVideoRangeYUV = NO;
-        NSArray *supportedPixelFormats = _captureOutputVideo.availableVideoCVPixelFormatTypes;
-        for (NSNumber *currentPixelFormat in supportedPixelFormats) {
-            if ([currentPixelFormat intValue] == kCVPixelFormatType_420YpCbCr8BiPlanarFullRange) {
-                supportsFullRangeYUV = YES;
-            }
-            if ([currentPixelFormat intValue] == kCVPixelFormatType_420YpCbCr8BiPlanarVideoRange) {
-                supportsVideoRangeYUV = YES;
-            }
-        }
-
-        NSDictionary *videoSettings = nil;
-        if (supportsFullRangeYUV) {
-            videoSettings = @{ (id)kCVPixelBufferPixelFormatTypeKey : @(kCVPixelFormatType_420YpCbCr8BiPlanarFullRange) };
-        } else if (supportsVideoRangeYUV) {
-            videoSettings = @{ (id)kCVPixelBufferPixelFormatTypeKey : @(kCVPixelFormatType_420YpCbCr8BiPlanarVideoRange) };
-        }
-        if (videoSettings) {
-            [_captureOutputVideo setVideoSettings:videoSettings];
-        }
-        
-        // setup video device configuration
-        NSError *error = nil;
-        if ([newCaptureDevice lockForConfiguration:&error]) {
-        
+        if (_cameraMode == PBJCameraModeVideo) {
             // smooth autofocus for videos
-            if ([newCaptureDevice isSmoothAutoFocusSupported])
-                [newCaptureDevice setSmoothAutoFocusEnabled:YES];
-            
-            [newCaptureDevice unlockForConfiguration];
-    
-        } else if (error) {
-            DLog(@"error locking device for video device configuration (%@)", error);
+            if ([captureDevice isSmoothAutoFocusSupported])
+                [captureDevice setSmoothAutoFocusEnabled:YES];
+        } else {
+            if ([captureDevice isLowLightBoostSupported])
+                [captureDevice setAutomaticallyEnablesLowLightBoostWhenAvailable:YES];
         }
-        
-    } else if ( newCaptureOutput && (newCaptureOutput == cameraOutput) ) {
-    
-        // specify photo preset
-        sessionPreset = _captureSessionPreset;
-            
-        // setup photo device configuration
+
+        [captureDevice unlockForConfiguration];
+
+    } else if (error) {
+        DLog(@"error locking device for %@ device configuration (%@)", _cameraMode == PBJCameraModeVideo ? @"video" : @"photo", error);
+    }
+}
+
+// _setupSession is always called from the captureSession queue, applies only what differs
+// from the running configuration in a single transaction
+- (void)_setupSession
+{
+    if (!_captureSession) {
+        DLog(@"error, no session running to setup");
+        return;
+    }
+
+    // audio is created on first use in video mode and kept across mode changes
+    if (_cameraMode == PBJCameraModeVideo && _flags.audioCaptureEnabled && !_captureDeviceInputAudio) {
         NSError *error = nil;
-        if ([newCaptureDevice lockForConfiguration:&error]) {
-            
-            if ([newCaptureDevice isLowLightBoostSupported])
-                [newCaptureDevice setAutomaticallyEnablesLowLightBoostWhenAvailable:YES];
-            
-            [newCaptureDevice unlockForConfiguration];
-        
-        } else if (error) {
-            DLog(@"error locking device for photo device configuration (%@)", error);
+        _captureDeviceAudio = [AVCaptureDevice defaultDeviceWithMediaType:AVMediaTypeAudio];
+        _captureDeviceInputAudio = [AVCaptureDeviceInput deviceInputWithDevice:_captureDeviceAudio error:&error];
+        if (error) {
+            DLog(@"error setting up audio input (%@)", error);
         }
-            
+    }
+    if (_cameraMode == PBJCameraModeVideo && _flags.audioCaptureEnabled && !_captureOutputAudio) {
+        _captureOutputAudio = [[AVCaptureAudioDataOutput alloc] init];
+        [_captureOutputAudio setSampleBufferDelegate:self queue:_captureCaptureDispatchQueue];
     }
 
-    // apply presets
-    if ([_captureSession canSetSessionPreset:sessionPreset])
-        [_captureSession setSessionPreset:sessionPreset];
+    PBJSessionConfiguration desired = [self _desiredSessionConfiguration];
+    PBJSessionConfiguration current = [self _currentSessionConfigurationWithDesired:desired];
+    PBJSessionPlan plan;
+    PBJSessionPlannerPlan(&current, &desired, &plan);
 
-    if (newDeviceInput)
-        _currentInput = newDeviceInput;
-    
-    if (newCaptureOutput)
-        _currentOutput = newCaptureOutput;
+    DLog(@"session plan (%lu operations)", (unsigned long)plan.count);
 
-    // ensure there is a capture device setup
-    if (_currentInput) {
-        AVCaptureDevice *device = [_currentInput device];
-        if (device) {
-            [self willChangeValueForKey:@"currentDevice"];
-            [self _setCurrentDevice:device];
-            [self didChangeValueForKey:@"currentDevice"];
+    if (plan.count == 0)
+        return;
+
+    AVCaptureDeviceInput *previousCameraInput = (current.camera == PBJSessionCameraFront) ? _captureDeviceInputFront : _captureDeviceInputBack;
+    AVCaptureDeviceInput *cameraInput = (_cameraDevice == PBJCameraDeviceFront) ? _captureDeviceInputFront : _captureDeviceInputBack;
+    AVCaptureOutput *primaryOutput = (_cameraMode == PBJCameraModeVideo) ? _captureOutputVideo : _captureOutputPhoto;
+
+    [_captureSession beginConfiguration];
+
+    for (size_t i = 0; i < plan.count; i++) {
+        switch (plan.operations[i]) {
+            case PBJSessionOperationRemoveCameraInput:
+                [_captureSession removeInput:previousCameraInput];
+                break;
+            case PBJSessionOperationRemoveAudioInput:
+                [_captureSession removeInput:_captureDeviceInputAudio];
+                break;
+            case PBJSessionOperationRemoveVideoOutput:
+                [_captureSession removeOutput:_captureOutputVideo];
+                break;
+            case PBJSessionOperationRemovePhotoOutput:
+                [_captureSession removeOutput:_captureOutputPhoto];
+                break;
+            case PBJSessionOperationRemoveAudioOutput:
+                [_captureSession removeOutput:_captureOutputAudio];
+                break;
+            case PBJSessionOperationAddCameraInput:
+                if (cameraInput && [_captureSession canAddInput:cameraInput]) {
+                    [_captureSession addInput:cameraInput];
+                    _currentInput = cameraInput;
+                }
+                break;
+            case PBJSessionOperationAddAudioInput:
+                if ([_captureSession canAddInput:_captureDeviceInputAudio]) {
+                    [_captureSession addInput:_captureDeviceInputAudio];
+                }
+                break;
+            case PBJSessionOperationAddVideoOutput:
+                if ([_captureSession canAddOutput:_captureOutputVideo]) {
+                    [_captureSession addOutput:_captureOutputVideo];
+                    _currentOutput = _captureOutputVideo;
+                }
+                break;
+            case PBJSessionOperationAddPhotoOutput:
+                if ([_captureSession canAddOutput:_captureOutputPhoto]) {
+                    [_captureSession addOutput:_captureOutputPhoto];
+                    if (primaryOutput == _captureOutputPhoto)
+                        _currentOutput = _captureOutputPhoto;
+                }
+                break;
+            case PBJSessionOperationAddAudioOutput:
+                if ([_captureSession canAddOutput:_captureOutputAudio]) {
+                    [_captureSession addOutput:_captureOutputAudio];
+                }
+                break;
+            case PBJSessionOperationSetPreset:
+                if ([_captureSession canSetSessionPreset:_captureSessionPreset])
+                    [_captureSession setSessionPreset:_captureSessionPreset];
+                break;
+            case PBJSessionOperationConfigureVideoOutput:
+                [self _configureVideoOutput];
+                break;
+            case PBJSessionOperationConfigureDevice:
+                [self _configureCaptureDevice:_currentInput.device];
+                break;
+            case PBJSessionOperationSetVideoOrientation:
+                [self _setOrientationForConnection:[_captureOutputVideo connectionWithMediaType:AVMediaTypeVideo]];
+                break;
+            case PBJSessionOperationSetMirroring:
+                // mirroring follows the current output
+                [self setMirroringMode:_mirroringMode];
+                break;
+            case PBJSessionOperationCount:
+            default:
+                break;
         }
     }
 
+    // ensure there is a capture device setup
+    AVCaptureDevice *device = [_currentInput device];
+    if (device && device != _currentDevice) {
+        [self willChangeValueForKey:@"currentDevice"];
+        [self _setCurrentDevice:device];
+        [self didChangeValueForKey:@"currentDevice"];
+    }
+
     [_captureSession commitConfiguration];
     
     DLog(@"capture session setup");
@@ -1459,8 +1867,7 @@ typedef void (^PBJVisionBlock)(void);
 
 - (BOOL)canCapturePhoto
 {
-    BOOL isDiskSpaceAvailable = [PBJVisionUtilities availableStorageSpaceInBytes] > PBJVisionRequiredMinimumDiskSpaceInBytes;
-    return [self isCaptureSessionActive] && !_flags.changingModes && isDiskSpaceAvailable;
+    return [self isCaptureSessionActive] && !_flags.changingModes && [self _isDiskSpaceAvailable];
 }
 
 - (UIImage *)_thumbnailJPEGData:(NSData *)jpegData
@@ -1491,35 +1898,19 @@ typedef void (^PBJVisionBlock)(void);
     return thumbnail;
 }
 
-// http://www.samwirch.com/blog/cropping-and-resizing-images-camera-ios-and-objective-c
-- (UIImage *)_squareImageWithImage:(UIImage *)image scaledToSize:(CGSize)newSize {
-    CGFloat ratio = 0.0;
-    CGFloat delta = 0.0;
-    CGPoint offset = CGPointZero;
-  
-    if (image.size.width > image.size.height) {
-        ratio = newSize.width / image.size.width;
-        delta = (ratio * image.size.width - ratio * image.size.height);
-        offset = CGPointMake(delta * 0.5f, 0);
-    } else {
-        ratio = newSize.width / image.size.height;
-        delta = (ratio * image.size.height - ratio * image.size.width);
-        offset = CGPointMake(0, delta * 0.5f);
+- (CGSize)_aspectRatioForOutputFormat:(PBJOutputFormat)outputFormat
+{
+    switch (outputFormat) {
+        case PBJOutputFormatSquare:
+            return CGSizeMake(1, 1);
+        case PBJOutputFormatWidescreen:
+            return CGSizeMake(16, 9);
+        case PBJOutputFormatStandard:
+            return CGSizeMake(4, 3);
+        case PBJOutputFormatPreset:
+        default:
+            return CGSizeZero;
     }
- 
-    CGRect clipRect = CGRectMake(-offset.x, -offset.y,
-                                 (ratio * image.size.width) + delta,
-                                 (ratio * image.size.height) + delta);
-  
-    CGSize squareSize = CGSizeMake(newSize.width, newSize.width);
-    
-    UIGraphicsBeginImageContextWithOptions(squareSize, YES, 0.0);
-    UIRectClip(clipRect);
-    [image drawInRect:clipRect];
-    UIImage *newImage = UIGraphicsGetImageFromCurrentImageContext();
-    UIGraphicsEndImageContext();
- 
-    return newImage;
 }
 
 - (void)_willCapturePhoto
@@ -1567,14 +1958,16 @@ typedef void (^PBJVisionBlock)(void);
         DLog(@"failed to generate metadata for photo");
     }
     
-    if (!_ciContext) {
-        _ciContext = [CIContext contextWithEAGLContext:[[EAGLContext alloc] initWithAPI:kEAGLRenderingAPIOpenGLES2]];
-    }
-
+    // convert on the CPU, avoids standing up a CIContext and GL context for a single frame,
+    // the output format crop happens on the planes so cropped away pixels are never converted
     CVPixelBufferRef pixelBuffer = CMSampleBufferGetImageBuffer(sampleBuffer);
-    CIImage *ciImage = [CIImage imageWithCVPixelBuffer:pixelBuffer];
-    
-    CGImageRef cgImage = [_ciContext createCGImage:ciImage fromRect:CGRectMake(0, 0, CVPixelBufferGetWidth(pixelBuffer), CVPixelBufferGetHeight(pixelBuffer))];
+    CGRect cropRect = CGRectNull;
+    CGSize aspectRatio = [self _aspectRatioForOutputFormat:_outputFormat];
+    if (pixelBuffer && !CGSizeEqualToSize(aspectRatio, CGSizeZero)) {
+        CGSize bufferSize = CGSizeMake(CVPixelBufferGetWidth(pixelBuffer), CVPixelBufferGetHeight(pixelBuffer));
+        cropRect = [PBJVisionUtilities cropRectForAspectRatio:aspectRatio insideSize:bufferSize];
+    }
+    CGImageRef cgImage = [PBJVisionUtilities createCGImageFromPixelBuffer:pixelBuffer cropRect:cropRect];
 
     // add UIImage
     UIImage *uiImage = [UIImage imageWithCGImage:cgImage];
@@ -1584,28 +1977,32 @@ typedef void (^PBJVisionBlock)(void);
     }
     
     if (uiImage) {
-        if (_outputFormat == PBJOutputFormatSquare) {
-            uiImage = [self _squareImageWithImage:uiImage scaledToSize:uiImage.size];
-        }
-        // PBJOutputFormatWidescreen
-        // PBJOutputFormatStandard
-    
         photoDict[PBJVisionPhotoImageKey] = uiImage;
         
-        // add JPEG, thumbnail
-        NSData *jpegData = UIImageJPEGRepresentation(uiImage, 0);
+        // add JPEG, thumbnail, both come from the same planes so the JPEG is never decoded back
+        CGImageRef thumbnailCGImage = NULL;
+        size_t thumbnailDimension = _flags.thumbnailEnabled ? (size_t)PBJVisionThumbnailWidth : 0;
+        NSData *jpegData = [PBJVisionUtilities JPEGDataFromPixelBuffer:pixelBuffer cropRect:cropRect quality:_photoJPEGQuality
+                                                    thumbnailDimension:thumbnailDimension thumbnail:&thumbnailCGImage];
+        if (!jpegData) {
+            // 32BGRA buffers
+            jpegData = UIImageJPEGRepresentation(uiImage, _photoJPEGQuality);
+        }
         if (jpegData) {
             // add JPEG
             photoDict[PBJVisionPhotoJPEGKey] = jpegData;
             
             // add thumbnail
             if (_flags.thumbnailEnabled) {
-                UIImage *thumbnail = [self _thumbnailJPEGData:jpegData];
+                UIImage *thumbnail = thumbnailCGImage ? [[UIImage alloc] initWithCGImage:thumbnailCGImage] : [self _thumbnailJPEGData:jpegData];
                 if (thumbnail) {
                     photoDict[PBJVisionPhotoThumbnailKey] = thumbnail;
                 }
             }
         }
+        if (thumbnailCGImage) {
+            CGImageRelease(thumbnailCGImage);
+        }
     } else {
         DLog(@"failed to create image from JPEG");
         error = [NSError errorWithDomain:PBJVisionErrorDomain code:PBJVisionErrorCaptureFailed userInfo:nil];
@@ -1708,8 +2105,60 @@ typedef void (^PBJVisionBlock)(void);
 
 - (BOOL)canCaptureVideo
 {
-    BOOL isDiskSpaceAvailable = [PBJVisionUtilities availableStorageSpaceInBytes] > PBJVisionRequiredMinimumDiskSpaceInBytes;
-    return [self supportsVideoCapture] && [self isCaptureSessionActive] && !_flags.changingModes && isDiskSpaceAvailable;
+    return [self supportsVideoCapture] && [self isCaptureSessionActive] && !_flags.changingModes && [self _isDiskSpaceAvailable];
+}
+
+// called on the capture queue as a recording starts, pre-roll was encoded at normal speed
+- (PBJCaptureRetimerConfiguration)_retimerConfigurationForRecording
+{
+    PBJCaptureRetimerConfiguration configuration = PBJCaptureRetimerDefaultConfiguration();
+    if (_prerollBuffer)
+        return configuration;
+
+    switch (_recordingSpeed) {
+        case PBJRecordingSpeedTimeLapse:
+            configuration.speed = PBJCaptureSpeedTimeLapse;
+            configuration.interval = PBJTimeMake((int64_t)llround(_timeLapseInterval * 1000.0), 1000);
+            configuration.outputFrameRate = (int32_t)_playbackFrameRate;
+            break;
+        case PBJRecordingSpeedSlowMotion:
+            configuration.speed = PBJCaptureSpeedSlowMotion;
+            configuration.captureFrameRate = (int32_t)_videoFrameRate;
+            configuration.outputFrameRate = (int32_t)_playbackFrameRate;
+            break;
+        case PBJRecordingSpeedNormal:
+        default:
+            break;
+    }
+
+    if (!PBJCaptureRetimerConfigurationIsValid(&configuration)) {
+        DLog(@"recording speed (%ld) is not usable at %ld fps played at %ld fps, recording at normal speed", (long)_recordingSpeed, (long)_videoFrameRate, (long)_playbackFrameRate);
+        configuration = PBJCaptureRetimerDefaultConfiguration();
+    }
+    return configuration;
+}
+
+// frames a second of the file being written
+- (NSInteger)_outputVideoFrameRate
+{
+    return _retimerConfiguration.speed == PBJCaptureSpeedNormal ? _videoFrameRate : (NSInteger)_retimerConfiguration.outputFrameRate;
+}
+
+// a capped recording gets its whole file reserved up front, with an eighth more for encoder overshoot
+- (PBJOutputSinkConfiguration)_outputConfiguration
+{
+    PBJOutputSinkConfiguration configuration = PBJOutputSinkDefaultConfiguration();
+    configuration.durability = _outputDurability;
+    configuration.durabilityBytes = _outputDurabilityBytes;
+    if (CMTIME_IS_NUMERIC(_maximumCaptureDuration)) {
+        BOOL recordsAudio = _flags.audioCaptureEnabled && _retimerConfiguration.speed == PBJCaptureSpeedNormal;
+        Float64 bytesPerSecond = (_videoBitRate + (Float64)(recordsAudio ? _audioBitRate : 0)) / 8.0;
+        Float64 seconds = CMTimeGetSeconds(_maximumCaptureDuration);
+        if (bytesPerSecond > 0 && seconds > 0) {
+            configuration.preallocationBytes = (uint64_t)(bytesPerSecond * seconds * 1.125);
+        }
+    }
+    return configuration;
 }
 
 - (void)startVideoCapture
@@ -1763,25 +2212,48 @@ typedef void (^PBJVisionBlock)(void);
             self->_mediaWriter.delegate = nil;
             self->_mediaWriter = nil;
         }
-        self->_mediaWriter = [[PBJMediaWriter alloc] initWithOutputURL:outputURL];
+        self->_retimerConfiguration = [self _retimerConfigurationForRecording];
+
+        // pre-roll is compressed video, which only the fragmented writer takes as is
+        CMTime fragmentInterval = self->_fragmentInterval;
+        if (self->_prerollBuffer && !CMTIME_IS_VALID(fragmentInterval)) {
+            fragmentInterval = CMTimeMake(1, 1);
+        }
+        PBJOutputSinkConfiguration outputConfiguration = [self _outputConfiguration];
+        self->_mediaWriter = [[PBJMediaWriter alloc] initWithOutputURL:outputURL queueDepth:self->_writerQueueDepth dropPolicy:self->_frameDropPolicy
+                                                      fragmentInterval:fragmentInterval outputConfiguration:outputConfiguration];
         self->_mediaWriter.delegate = self;
+        self->_mediaWriter.instrumentation = self->_instrumentation;
+        [self _setupProxyWriterWithOutputURL:outputURL];
+        [self _beginStorageMonitoringWithMediaWriter:self->_mediaWriter proxyWriter:self->_proxyWriter];
+        [self _setupRateGovernor];
+
+        if (self->_prerollBuffer) {
+            [self _seedMediaWriterFromPrerollBuffer];
+        }
 
         AVCaptureConnection *videoConnection = [self->_captureOutputVideo connectionWithMediaType:AVMediaTypeVideo];
         [self _setOrientationForConnection:videoConnection];
 
-        self->_startTimestamp = CMClockGetTime(CMClockGetHostTimeClock());
-        self->_timeOffset = kCMTimeInvalid;
-        
+        PBJCapturePipelineSetAudioEnabled(self->_pipeline, self->_flags.audioCaptureEnabled);
+        PBJCapturePipelineSetMaximumDuration(self->_pipeline, PBJTimeFromCMTime(self->_maximumCaptureDuration));
+        PBJCapturePipelineSetSpeed(self->_pipeline, &self->_retimerConfiguration);
+        PBJCapturePipelineStart(self->_pipeline);
+
         self->_flags.recording = YES;
         self->_flags.paused = NO;
-        self->_flags.interrupted = NO;
         self->_flags.videoWritten = NO;
         
-        self->_captureThumbnailTimes = [NSMutableSet set];
-        self->_captureThumbnailFrames = [NSMutableSet set];
+        PBJFrameAnalyzerReset(self->_frameAnalyzer);
+        PBJSampleDeliveryReset(self->_sampleDelivery);
+
+        [self->_thumbnailStore reset];
+        self->_thumbnailStore.capturesLastFrame = (self->_flags.thumbnailEnabled && self->_flags.defaultVideoThumbnails);
+        self->_thumbnailStore.capturesBestFrame = (self->_flags.thumbnailEnabled && self->_flags.contentAwareVideoThumbnails);
         
-        if (self->_flags.thumbnailEnabled && self->_flags.defaultVideoThumbnails) {
-            [self captureVideoThumbnailAtFrame:0];
+        // with content aware thumbnails the best frame stands in for the first
+        if (self->_flags.thumbnailEnabled && self->_flags.defaultVideoThumbnails && !self->_flags.contentAwareVideoThumbnails) {
+            PBJSampleDeliveryRequestThumbnailAtFrame(self->_sampleDelivery, 0);
         }
         
         [self _enqueueBlockOnMainQueue:^{                
@@ -1805,7 +2277,7 @@ typedef void (^PBJVisionBlock)(void);
         DLog(@"pausing video capture");
 
         self->_flags.paused = YES;
-        self->_flags.interrupted = YES;
+        PBJCapturePipelinePause(self->_pipeline);
         
         [self _enqueueBlockOnMainQueue:^{
             if ([self->_delegate respondsToSelector:@selector(visionDidPauseVideoCapture:)])
@@ -1828,6 +2300,7 @@ typedef void (^PBJVisionBlock)(void);
         DLog(@"resuming video capture");
        
         self->_flags.paused = NO;
+        PBJCapturePipelineResume(self->_pipeline);
 
         [self _enqueueBlockOnMainQueue:^{
             if ([self->_delegate respondsToSelector:@selector(visionDidResumeVideoCapture:)])
@@ -1841,52 +2314,105 @@ typedef void (^PBJVisionBlock)(void);
     DLog(@"ending video capture");
     
     [self _enqueueBlockOnCaptureVideoQueue:^{
-        if (!self->_flags.recording)
-            return;
-        
-        if (!self->_mediaWriter) {
-            DLog(@"media writer unavailable to end");
-            return;
+        [self _endVideoCaptureWithError:nil];
+    }];
+}
+
+// called on the capture queue, endError takes the place of the writer's own error
+- (void)_endVideoCaptureWithError:(NSError *)endError
+{
+    if (!self->_flags.recording)
+        return;
+    
+    if (!self->_mediaWriter) {
+        DLog(@"media writer unavailable to end");
+        return;
+    }
+    
+    self->_flags.recording = NO;
+    self->_flags.paused = NO;
+    PBJCapturePipelineStop(self->_pipeline);
+    [self _finishPrerollForwarding];
+    [self _endStorageMonitoring];
+
+    // thumbnails were captured as frames were written, no decode of the finished file
+    NSUInteger bestThumbnailIndex = NSNotFound;
+    BOOL thumbnailRequestsPending = PBJSampleDeliveryHasThumbnailRequests(self->_sampleDelivery) ? YES : NO;
+    NSArray *thumbnails = self->_flags.thumbnailEnabled ? [self->_thumbnailStore thumbnailsWithBestFrameIndex:&bestThumbnailIndex requestsPending:thumbnailRequestsPending] : nil;
+    [self->_thumbnailStore reset];
+    PBJSampleDeliveryReset(self->_sampleDelivery);
+
+    // samples reach the proxy's file on its writer queue, whether any did is only known once it has flushed
+    PBJMediaWriter *proxyWriter = self->_proxyWriter;
+    NSError *proxyError = self->_proxyError;
+    
+    void (^finishWritingCompletionHandler)(void) = ^{
+        Float64 capturedDuration = self.capturedVideoSeconds;
+
+        // a proxy that never appended a sample has no file
+        NSError *proxyWriterError = proxyError;
+        if (proxyWriter && !proxyWriterError) {
+            PBJWriterStatistics proxyStatistics = proxyWriter.statistics;
+            if (proxyStatistics.videoFramesWritten + proxyStatistics.audioSamplesWritten == 0) {
+                proxyWriterError = [NSError errorWithDomain:PBJVisionErrorDomain code:PBJVisionErrorCaptureFailed userInfo:nil];
+            } else {
+                proxyWriterError = [proxyWriter error];
+            }
         }
-        
-        self->_flags.recording = NO;
-        self->_flags.paused = NO;
-        
-        void (^finishWritingCompletionHandler)(void) = ^{
-            Float64 capturedDuration = self.capturedVideoSeconds;
-            
-            self->_timeOffset = kCMTimeInvalid;
-            self->_startTimestamp = CMClockGetTime(CMClockGetHostTimeClock());
-            self->_flags.interrupted = NO;
 
-            [self _enqueueBlockOnMainQueue:^{
-                if ([self->_delegate respondsToSelector:@selector(visionDidEndVideoCapture:)])
-                    [self->_delegate visionDidEndVideoCapture:self];
-
-                NSMutableDictionary *videoDict = [[NSMutableDictionary alloc] init];
-                NSString *path = [self->_mediaWriter.outputURL path];
-                if (path) {
-                    videoDict[PBJVisionVideoPathKey] = path;
-                    
-                    if (self->_flags.thumbnailEnabled) {
-                        if (self->_flags.defaultVideoThumbnails) {
-                            [self captureVideoThumbnailAtTime:capturedDuration];
-                        }
-                        
-                        [self _generateThumbnailsForVideoWithURL:self->_mediaWriter.outputURL inDictionary:videoDict];
-                    }
+        [self _enqueueBlockOnMainQueue:^{
+            if ([self->_delegate respondsToSelector:@selector(visionDidEndVideoCapture:)])
+                [self->_delegate visionDidEndVideoCapture:self];
+
+            NSMutableDictionary *videoDict = [[NSMutableDictionary alloc] init];
+            NSString *path = [self->_mediaWriter.outputURL path];
+            if (path) {
+                videoDict[PBJVisionVideoPathKey] = path;
+                
+                if (thumbnails.count > 0) {
+                    videoDict[PBJVisionVideoThumbnailKey] = bestThumbnailIndex != NSNotFound ? thumbnails[bestThumbnailIndex] : [thumbnails firstObject];
+                    videoDict[PBJVisionVideoThumbnailArrayKey] = thumbnails;
                 }
+            }
 
-                videoDict[PBJVisionVideoCapturedDurationKey] = @(capturedDuration);
+            videoDict[PBJVisionVideoCapturedDurationKey] = @(capturedDuration);
 
-                NSError *error = [self->_mediaWriter error];
-                if ([self->_delegate respondsToSelector:@selector(vision:capturedVideo:error:)]) {
-                    [self->_delegate vision:self capturedVideo:videoDict error:error];
-                }
-            }];
-        };
-        [self->_mediaWriter finishWritingWithCompletionHandler:finishWritingCompletionHandler];
+            if (proxyWriterError) {
+                videoDict[PBJVisionVideoProxyErrorKey] = proxyWriterError;
+            } else if ([proxyWriter.outputURL path]) {
+                videoDict[PBJVisionVideoProxyPathKey] = [proxyWriter.outputURL path];
+            }
+
+            NSError *error = endError ?: [self->_mediaWriter error];
+            if ([self->_delegate respondsToSelector:@selector(vision:capturedVideo:error:)]) {
+                [self->_delegate vision:self capturedVideo:videoDict error:error];
+            }
+        }];
+    };
+    [self _finishWritingWithProxyWriter:proxyWriter completionHandler:finishWritingCompletionHandler];
+}
+
+// called on the capture queue, the handler runs once both files are finished, the two writers flush
+// and finish side by side
+- (void)_finishWritingWithProxyWriter:(PBJMediaWriter *)proxyWriter completionHandler:(void (^)(void))handler
+{
+    self->_proxyWriter = nil;
+    self->_proxyError = nil;
+    if (!proxyWriter) {
+        [self->_mediaWriter finishWritingWithCompletionHandler:handler];
+        return;
+    }
+
+    dispatch_group_t finishGroup = dispatch_group_create();
+    dispatch_group_enter(finishGroup);
+    [proxyWriter finishWritingWithCompletionHandler:^{
+        dispatch_group_leave(finishGroup);
     }];
+    dispatch_group_enter(finishGroup);
+    [self->_mediaWriter finishWritingWithCompletionHandler:^{
+        dispatch_group_leave(finishGroup);
+    }];
+    dispatch_group_notify(finishGroup, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), handler);
 }
 
 - (void)cancelVideoCapture
@@ -1896,15 +2422,14 @@ typedef void (^PBJVisionBlock)(void);
     [self _enqueueBlockOnCaptureVideoQueue:^{
         self->_flags.recording = NO;
         self->_flags.paused = NO;
+        PBJCapturePipelineStop(self->_pipeline);
+        [self _finishPrerollForwarding];
+        [self _endStorageMonitoring];
         
-        [self->_captureThumbnailTimes removeAllObjects];
-        [self->_captureThumbnailFrames removeAllObjects];
+        [self->_thumbnailStore reset];
+        PBJSampleDeliveryReset(self->_sampleDelivery);
         
         void (^finishWritingCompletionHandler)(void) = ^{
-            self->_timeOffset = kCMTimeInvalid;
-            self->_startTimestamp = CMClockGetTime(CMClockGetHostTimeClock());
-            self->_flags.interrupted = NO;
-
             [self _enqueueBlockOnMainQueue:^{
                 NSError *error = [NSError errorWithDomain:PBJVisionErrorDomain code:PBJVisionErrorCancelled userInfo:nil];
                 if ([self->_delegate respondsToSelector:@selector(vision:capturedVideo:error:)]) {
@@ -1913,83 +2438,67 @@ typedef void (^PBJVisionBlock)(void);
             }];
         };
 
-        [self->_mediaWriter finishWritingWithCompletionHandler:finishWritingCompletionHandler];
+        [self _finishWritingWithProxyWriter:self->_proxyWriter completionHandler:finishWritingCompletionHandler];
     }];
 }
 
 - (void)captureVideoFrameAsPhoto
 {
-    _flags.videoCaptureFrame = YES;
+    if (_frameSelectionInterval <= 0) {
+        _flags.videoCaptureFrame = YES;
+        return;
+    }
+
+    // the best frame written within the interval, the next one when none was held back
+    [self _enqueueBlockOnCaptureVideoQueue:^{
+        CMSampleBufferRef best = (CMSampleBufferRef)PBJBestFrameWindowTakeBest(PBJSampleDeliveryGetFrameSelectionWindow(self->_sampleDelivery), NULL, NULL);
+        if (!best) {
+            self->_flags.videoCaptureFrame = YES;
+            return;
+        }
+
+        [self _enqueueBlockOnMainQueue:^{
+            [self _willCapturePhoto];
+            [self _capturePhotoFromSampleBuffer:best];
+            [self _didCapturePhoto];
+            CFRelease(best);
+        }];
+    }];
 }
 
 - (void)captureCurrentVideoThumbnail
 {
-    if (_flags.recording) {
-        [self captureVideoThumbnailAtTime:self.capturedVideoSeconds];
-    }
+    [self _enqueueBlockOnCaptureVideoQueue:^{
+        if (!self->_flags.recording)
+            return;
+
+        PBJBestFrameWindow *frameSelectionWindow = PBJSampleDeliveryGetFrameSelectionWindow(self->_sampleDelivery);
+        CMSampleBufferRef best = self->_frameSelectionInterval > 0 ? (CMSampleBufferRef)PBJBestFrameWindowPeekBest(frameSelectionWindow, NULL, NULL) : NULL;
+        if (best) {
+            [self->_thumbnailStore addThumbnailWithPixelBuffer:CMSampleBufferGetImageBuffer(best) presentationTimestamp:CMSampleBufferGetPresentationTimeStamp(best)];
+        } else {
+            PBJSampleDeliveryRequestThumbnailAtNextFrame(self->_sampleDelivery);
+        }
+    }];
 }
 
 - (void)captureVideoThumbnailAtTime:(Float64)seconds
 {
-    [_captureThumbnailTimes addObject:@(seconds)];
+    // nanoseconds from the first frame
+    CMTime time = CMTimeMakeWithSeconds(seconds, 600);
+    if (!CMTIME_IS_NUMERIC(time))
+        return;
+    int64_t nanoseconds = CMTimeConvertScale(time, NSEC_PER_SEC, kCMTimeRoundingMethod_RoundHalfAwayFromZero).value;
+    [self _enqueueBlockOnCaptureVideoQueue:^{
+        PBJSampleDeliveryRequestThumbnailAtTime(self->_sampleDelivery, nanoseconds);
+    }];
 }
 
 - (void)captureVideoThumbnailAtFrame:(int64_t)frame
 {
-    [_captureThumbnailFrames addObject:@(frame)];
-}
-
-- (void)_generateThumbnailsForVideoWithURL:(NSURL*)url inDictionary:(NSMutableDictionary*)videoDict
-{
-    if (_captureThumbnailFrames.count == 0 && _captureThumbnailTimes == 0)
-        return;
-    
-    AVURLAsset *asset = [[AVURLAsset alloc] initWithURL:url options:nil];
-    AVAssetImageGenerator *generate = [[AVAssetImageGenerator alloc] initWithAsset:asset];
-    generate.appliesPreferredTrackTransform = YES;
-    
-    int32_t timescale = [@([self videoFrameRate]) intValue];
-    
-    for (NSNumber *frameNumber in [_captureThumbnailFrames allObjects]) {
-        CMTime time = CMTimeMake([frameNumber longLongValue], timescale);
-        Float64 timeInSeconds = CMTimeGetSeconds(time);
-        [self captureVideoThumbnailAtTime:timeInSeconds];
-    }
-    
-    NSMutableArray *captureTimes = [NSMutableArray array];
-    NSArray *thumbnailTimes = [_captureThumbnailTimes allObjects];
-#pragma clang diagnostic push
-#pragma clang diagnostic ignored "-Wselector"
-    NSArray *sortedThumbnailTimes = [thumbnailTimes sortedArrayUsingSelector:@selector(compare:)];
-#pragma clang diagnostic pop
-    
-    for (NSNumber *seconds in sortedThumbnailTimes) {
-        CMTime time = CMTimeMakeWithSeconds([seconds doubleValue], timescale);
-        [captureTimes addObject:[NSValue valueWithCMTime:time]];
-    }
-    
-    NSMutableArray *thumbnails = [NSMutableArray array];
-    
-    for (NSValue *time in captureTimes) {
-        CGImageRef imgRef = [generate copyCGImageAtTime:[time CMTimeValue] actualTime:NULL error:NULL];
-        if (imgRef) {
-            UIImage *image = [[UIImage alloc] initWithCGImage:imgRef];
-            if (image) {
-                [thumbnails addObject:image];
-            }
-            
-            CGImageRelease(imgRef);
-        }
-    }
-    
-    UIImage *defaultThumbnail = [thumbnails firstObject];
-    if (defaultThumbnail) {
-        [videoDict setObject:defaultThumbnail forKey:PBJVisionVideoThumbnailKey];
-    }
-    
-    if (thumbnails.count) {
-        [videoDict setObject:thumbnails forKey:PBJVisionVideoThumbnailArrayKey];
-    }
+    [self _enqueueBlockOnCaptureVideoQueue:^{
+        PBJSampleDeliveryRequestThumbnailAtFrame(self->_sampleDelivery, frame);
+    }];
 }
 
 - (void)_failVideoCaptureWithErrorCode:(NSInteger)errorCode
@@ -2035,10 +2544,37 @@ typedef void (^PBJVisionBlock)(void);
                                                 AVEncoderBitRateKey : @(_audioBitRate),
                                                 AVChannelLayoutKey : currentChannelLayoutData };
 
-    return [_mediaWriter setupAudioWithSettings:audioCompressionSettings];
+    BOOL ready = [_mediaWriter setupAudioWithSettings:audioCompressionSettings];
+    if (ready) {
+        [self _setupProxyAudioWithSettings:audioCompressionSettings];
+    }
+    return ready;
 }
 
 - (BOOL)_setupMediaWriterVideoInputWithSampleBuffer:(CMSampleBufferRef)sampleBuffer
+{
+    NSDictionary *videoSettings = [self _videoSettingsForSampleBuffer:sampleBuffer];
+    BOOL ready = [_mediaWriter setupVideoWithSettings:videoSettings withAdditional:[self _mediaWriterVideoProperties]];
+    if (ready) {
+        [self _setupProxyVideoWithSampleBuffer:sampleBuffer masterSettings:videoSettings];
+    }
+    return ready;
+}
+
+// frames oriented in the pixels are written without a transform
+- (NSDictionary *)_mediaWriterVideoProperties
+{
+    NSDictionary *additionalVideoProperties = [self additionalVideoProperties];
+    if (!_videoOrientationPixelBufferPool || !additionalVideoProperties[PBJVisionVideoRotation])
+        return additionalVideoProperties;
+
+    NSMutableDictionary *mutableDictionary = [NSMutableDictionary dictionaryWithDictionary:additionalVideoProperties];
+    [mutableDictionary removeObjectForKey:PBJVisionVideoRotation];
+    return mutableDictionary;
+}
+
+// also prepares the resampler for the output format and the physical orientation
+- (NSDictionary *)_videoSettingsForSampleBuffer:(CMSampleBufferRef)sampleBuffer
 {
     CMFormatDescriptionRef formatDescription = CMSampleBufferGetFormatDescription(sampleBuffer);
     CMVideoDimensions dimensions = CMVideoFormatDescriptionGetDimensions(formatDescription);
@@ -2068,17 +2604,36 @@ typedef void (^PBJVisionBlock)(void);
         default:
             break;
     }
-    
+
+    // 4:2:0 planes need even dimensions
+    videoDimensions.width &= ~1;
+    videoDimensions.height &= ~1;
+
+    [self _destroyVideoResampler];
+    if (_outputFormat != PBJOutputFormatPreset) {
+        [self _setupVideoResamplerWithSampleBuffer:sampleBuffer dimensions:videoDimensions];
+    }
+
+    [self _destroyVideoOrientation];
+    if (_orientsVideoFrames) {
+        [self _setupVideoOrientationWithSampleBuffer:sampleBuffer dimensions:videoDimensions];
+        if (_videoOrientationPixelBufferPool && PBJFrameOrientationSwapsDimensions(_videoOrientation)) {
+            int32_t width = videoDimensions.width;
+            videoDimensions.width = videoDimensions.height;
+            videoDimensions.height = width;
+        }
+    }
+
     NSDictionary *compressionSettings = nil;
     
     if (_additionalCompressionProperties && [_additionalCompressionProperties count] > 0) {
         NSMutableDictionary *mutableDictionary = [NSMutableDictionary dictionaryWithDictionary:_additionalCompressionProperties];
         mutableDictionary[AVVideoAverageBitRateKey] = @(_videoBitRate);
-        mutableDictionary[AVVideoMaxKeyFrameIntervalKey] = @(_videoFrameRate);
+        mutableDictionary[AVVideoMaxKeyFrameIntervalKey] = @([self _outputVideoFrameRate]);
         compressionSettings = mutableDictionary;
     } else {
         compressionSettings = @{ AVVideoAverageBitRateKey : @(_videoBitRate),
-                                 AVVideoMaxKeyFrameIntervalKey : @(_videoFrameRate) };
+                                 AVVideoMaxKeyFrameIntervalKey : @([self _outputVideoFrameRate]) };
     }
     
     NSDictionary *videoSettings = @{ AVVideoCodecKey : AVVideoCodecH264,
@@ -2087,41 +2642,501 @@ typedef void (^PBJVisionBlock)(void);
                                      AVVideoHeightKey : @(videoDimensions.height),
                                      AVVideoCompressionPropertiesKey : compressionSettings };
 
-
-    return [_mediaWriter setupVideoWithSettings:videoSettings withAdditional:[self additionalVideoProperties]];
+    return videoSettings;
 }
 
-- (void)_automaticallyEndCaptureIfMaximumDurationReachedWithSampleBuffer:(CMSampleBufferRef)sampleBuffer
+#pragma mark - output format cropping
+
+- (void)_setupVideoResamplerWithSampleBuffer:(CMSampleBufferRef)sampleBuffer dimensions:(CMVideoDimensions)dimensions
 {
-    CMTime currentTimestamp = CMSampleBufferGetPresentationTimeStamp(sampleBuffer);
+    CVPixelBufferRef pixelBuffer = CMSampleBufferGetImageBuffer(sampleBuffer);
+    if (!pixelBuffer)
+        return;
 
-    if (!_flags.interrupted && CMTIME_IS_VALID(currentTimestamp) && CMTIME_IS_VALID(_startTimestamp) && CMTIME_IS_VALID(_maximumCaptureDuration)) {
-        if (CMTIME_IS_VALID(_timeOffset)) {
-            // Current time stamp is actually timstamp with data from globalClock
-            // In case, if we had interruption, then _timeOffset
-            // will have information about the time diff between globalClock and assetWriterClock
-            // So in case if we had interruption we need to remove that offset from "currentTimestamp"
-            currentTimestamp = CMTimeSubtract(currentTimestamp, _timeOffset);
-        }
-        CMTime currentCaptureDuration = CMTimeSubtract(currentTimestamp, _startTimestamp);
-        if (CMTIME_IS_VALID(currentCaptureDuration)) {
-            if (CMTIME_COMPARE_INLINE(currentCaptureDuration, >=, _maximumCaptureDuration)) {
-                [self _enqueueBlockOnMainQueue:^{
-                    [self endVideoCapture];
-                }];
-            }
-        }
+    OSType pixelFormat = CVPixelBufferGetPixelFormatType(pixelBuffer);
+    if (pixelFormat != kCVPixelFormatType_420YpCbCr8BiPlanarFullRange &&
+        pixelFormat != kCVPixelFormatType_420YpCbCr8BiPlanarVideoRange) {
+        // leave cropping to the writer's scaling mode
+        return;
     }
-}
 
-#pragma mark - AVCapturePhotoCaptureDelegate
+    size_t width = CVPixelBufferGetWidth(pixelBuffer);
+    size_t height = CVPixelBufferGetHeight(pixelBuffer);
+    if (width == (size_t)dimensions.width && height == (size_t)dimensions.height)
+        return;
 
-- (void)captureOutput:(AVCapturePhotoOutput *)captureOutput willBeginCaptureForResolvedSettings:(AVCaptureResolvedPhotoSettings *)resolvedSettings {
-    [self _willCapturePhoto];
-}
+    // aspect fill, same framing AVVideoScalingModeResizeAspectFill produced
+    PBJCropRect crop = PBJCropRectForAspectRatio(width, height, (size_t)dimensions.width, (size_t)dimensions.height);
+    _videoResampler = PBJResamplerCreate(crop, (size_t)dimensions.width, (size_t)dimensions.height, PBJResampleFilterBilinear);
+    if (!_videoResampler) {
+        DLog(@"failed to create video resampler");
+        return;
+    }
 
-- (void)captureOutput:(AVCapturePhotoOutput *)captureOutput didFinishCaptureForResolvedSettings:(AVCaptureResolvedPhotoSettings *)resolvedSettings error:(NSError *)error {
-    [self _didCapturePhoto];
+    NSDictionary *pixelBufferAttributes = @{ (id)kCVPixelBufferPixelFormatTypeKey : @(pixelFormat),
+                                             (id)kCVPixelBufferWidthKey : @(dimensions.width),
+                                             (id)kCVPixelBufferHeightKey : @(dimensions.height),
+                                             (id)kCVPixelBufferIOSurfacePropertiesKey : @{} };
+    CVReturn result = CVPixelBufferPoolCreate(kCFAllocatorDefault, NULL, (__bridge CFDictionaryRef)pixelBufferAttributes, &_videoResamplerPixelBufferPool);
+    if (result != kCVReturnSuccess) {
+        DLog(@"failed to create video resampler pixel buffer pool (%d)", result);
+        [self _destroyVideoResampler];
+    }
+}
+
+- (void)_destroyVideoResampler
+{
+    if (_videoResampler) {
+        PBJResamplerDestroy(_videoResampler);
+        _videoResampler = NULL;
+    }
+    if (_videoResamplerPixelBufferPool) {
+        CVPixelBufferPoolRelease(_videoResamplerPixelBufferPool);
+        _videoResamplerPixelBufferPool = NULL;
+    }
+    if (_videoResamplerFormatDescription) {
+        CFRelease(_videoResamplerFormatDescription);
+        _videoResamplerFormatDescription = NULL;
+    }
+}
+
+- (CMSampleBufferRef)_createResampledSampleBufferWithSampleBuffer:(CMSampleBufferRef)sampleBuffer CF_RETURNS_RETAINED
+{
+    CVPixelBufferRef sourcePixelBuffer = CMSampleBufferGetImageBuffer(sampleBuffer);
+    if (!sourcePixelBuffer || !_videoResampler || !_videoResamplerPixelBufferPool)
+        return NULL;
+
+    CVPixelBufferRef pixelBuffer = NULL;
+    CVReturn result = CVPixelBufferPoolCreatePixelBuffer(kCFAllocatorDefault, _videoResamplerPixelBufferPool, &pixelBuffer);
+    if (result != kCVReturnSuccess || !pixelBuffer) {
+        DLog(@"failed to obtain a pixel buffer from the resampler pool (%d)", result);
+        return NULL;
+    }
+
+    CMSampleBufferRef resampledSampleBuffer = NULL;
+    if ([PBJVisionUtilities resamplePixelBuffer:sourcePixelBuffer toPixelBuffer:pixelBuffer withResampler:_videoResampler]) {
+        CVBufferPropagateAttachments(sourcePixelBuffer, pixelBuffer);
+
+        if (!_videoResamplerFormatDescription) {
+            CMVideoFormatDescriptionCreateForImageBuffer(kCFAllocatorDefault, pixelBuffer, &_videoResamplerFormatDescription);
+        }
+
+        CMSampleTimingInfo timingInfo = kCMTimingInfoInvalid;
+        CMSampleBufferGetSampleTimingInfo(sampleBuffer, 0, &timingInfo);
+        if (_videoResamplerFormatDescription) {
+            CMSampleBufferCreateReadyWithImageBuffer([PBJVisionUtilities sampleBufferAllocator], pixelBuffer, _videoResamplerFormatDescription, &timingInfo, &resampledSampleBuffer);
+        }
+    }
+
+    CVPixelBufferRelease(pixelBuffer);
+    return resampledSampleBuffer;
+}
+
+#pragma mark - physical orientation
+
+// dimensions are the cropped frame's, before rotation
+- (void)_setupVideoOrientationWithSampleBuffer:(CMSampleBufferRef)sampleBuffer dimensions:(CMVideoDimensions)dimensions
+{
+    CVPixelBufferRef pixelBuffer = CMSampleBufferGetImageBuffer(sampleBuffer);
+    if (!pixelBuffer)
+        return;
+
+    OSType pixelFormat = CVPixelBufferGetPixelFormatType(pixelBuffer);
+    if (pixelFormat != kCVPixelFormatType_420YpCbCr8BiPlanarFullRange &&
+        pixelFormat != kCVPixelFormatType_420YpCbCr8BiPlanarVideoRange) {
+        // leave rotation to the track transform
+        return;
+    }
+
+    NSDictionary *additionalVideoProperties = [self additionalVideoProperties];
+    double degrees = [additionalVideoProperties[PBJVisionVideoRotation] doubleValue] * 180.0 / M_PI;
+    BOOL mirrored = [additionalVideoProperties[PBJVisionVideoMirrored] boolValue];
+    PBJFrameOrientation orientation = PBJFrameOrientationMake(degrees, mirrored);
+    if (orientation == PBJFrameOrientationUp)
+        return;
+
+    size_t width = 0;
+    size_t height = 0;
+    PBJFrameOrientationOutputSize(orientation, (size_t)dimensions.width, (size_t)dimensions.height, &width, &height);
+
+    NSDictionary *pixelBufferAttributes = @{ (id)kCVPixelBufferPixelFormatTypeKey : @(pixelFormat),
+                                             (id)kCVPixelBufferWidthKey : @(width),
+                                             (id)kCVPixelBufferHeightKey : @(height),
+                                             (id)kCVPixelBufferIOSurfacePropertiesKey : @{} };
+    CVReturn result = CVPixelBufferPoolCreate(kCFAllocatorDefault, NULL, (__bridge CFDictionaryRef)pixelBufferAttributes, &_videoOrientationPixelBufferPool);
+    if (result != kCVReturnSuccess) {
+        DLog(@"failed to create video orientation pixel buffer pool (%d)", result);
+        [self _destroyVideoOrientation];
+        return;
+    }
+    _videoOrientation = orientation;
+}
+
+- (void)_destroyVideoOrientation
+{
+    _videoOrientation = PBJFrameOrientationUp;
+    if (_videoOrientationPixelBufferPool) {
+        CVPixelBufferPoolRelease(_videoOrientationPixelBufferPool);
+        _videoOrientationPixelBufferPool = NULL;
+    }
+    if (_videoOrientationFormatDescription) {
+        CFRelease(_videoOrientationFormatDescription);
+        _videoOrientationFormatDescription = NULL;
+    }
+}
+
+- (CMSampleBufferRef)_createOrientedSampleBufferWithSampleBuffer:(CMSampleBufferRef)sampleBuffer CF_RETURNS_RETAINED
+{
+    CVPixelBufferRef sourcePixelBuffer = CMSampleBufferGetImageBuffer(sampleBuffer);
+    if (!sourcePixelBuffer || !_videoOrientationPixelBufferPool)
+        return NULL;
+
+    CVPixelBufferRef pixelBuffer = NULL;
+    CVReturn result = CVPixelBufferPoolCreatePixelBuffer(kCFAllocatorDefault, _videoOrientationPixelBufferPool, &pixelBuffer);
+    if (result != kCVReturnSuccess || !pixelBuffer) {
+        DLog(@"failed to obtain a pixel buffer from the orientation pool (%d)", result);
+        return NULL;
+    }
+
+    CMSampleBufferRef orientedSampleBuffer = NULL;
+    if ([PBJVisionUtilities orientPixelBuffer:sourcePixelBuffer toPixelBuffer:pixelBuffer orientation:_videoOrientation]) {
+        CVBufferPropagateAttachments(sourcePixelBuffer, pixelBuffer);
+
+        if (!_videoOrientationFormatDescription) {
+            CMVideoFormatDescriptionCreateForImageBuffer(kCFAllocatorDefault, pixelBuffer, &_videoOrientationFormatDescription);
+        }
+
+        CMSampleTimingInfo timingInfo = kCMTimingInfoInvalid;
+        CMSampleBufferGetSampleTimingInfo(sampleBuffer, 0, &timingInfo);
+        if (_videoOrientationFormatDescription) {
+            CMSampleBufferCreateReadyWithImageBuffer([PBJVisionUtilities sampleBufferAllocator], pixelBuffer, _videoOrientationFormatDescription, &timingInfo, &orientedSampleBuffer);
+        }
+    }
+
+    CVPixelBufferRelease(pixelBuffer);
+    return orientedSampleBuffer;
+}
+
+#pragma mark - frame processing
+
+- (void)_destroyFrameProcessingPool
+{
+    if (_frameProcessingPixelBufferPool) {
+        CVPixelBufferPoolRelease(_frameProcessingPixelBufferPool);
+        _frameProcessingPixelBufferPool = NULL;
+    }
+    if (_frameProcessingFormatDescription) {
+        CFRelease(_frameProcessingFormatDescription);
+        _frameProcessingFormatDescription = NULL;
+    }
+}
+
+// a spare matching the frame, only needed when a stage runs out of place
+- (CVPixelBufferRef)_createFrameProcessingSpareForPixelBuffer:(CVPixelBufferRef)pixelBuffer CF_RETURNS_RETAINED
+{
+    OSType pixelFormat = CVPixelBufferGetPixelFormatType(pixelBuffer);
+    size_t width = CVPixelBufferGetWidth(pixelBuffer);
+    size_t height = CVPixelBufferGetHeight(pixelBuffer);
+
+    if (_frameProcessingPixelBufferPool) {
+        NSDictionary *attributes = (__bridge NSDictionary *)CVPixelBufferPoolGetPixelBufferAttributes(_frameProcessingPixelBufferPool);
+        if ([attributes[(id)kCVPixelBufferWidthKey] unsignedLongValue] != width ||
+            [attributes[(id)kCVPixelBufferHeightKey] unsignedLongValue] != height ||
+            [attributes[(id)kCVPixelBufferPixelFormatTypeKey] unsignedIntValue] != pixelFormat) {
+            [self _destroyFrameProcessingPool];
+        }
+    }
+
+    if (!_frameProcessingPixelBufferPool) {
+        NSDictionary *pixelBufferAttributes = @{ (id)kCVPixelBufferPixelFormatTypeKey : @(pixelFormat),
+                                                 (id)kCVPixelBufferWidthKey : @(width),
+                                                 (id)kCVPixelBufferHeightKey : @(height),
+                                                 (id)kCVPixelBufferIOSurfacePropertiesKey : @{} };
+        CVReturn result = CVPixelBufferPoolCreate(kCFAllocatorDefault, NULL, (__bridge CFDictionaryRef)pixelBufferAttributes, &_frameProcessingPixelBufferPool);
+        if (result != kCVReturnSuccess) {
+            DLog(@"failed to create frame processing pixel buffer pool (%d)", result);
+            return NULL;
+        }
+    }
+
+    CVPixelBufferRef sparePixelBuffer = NULL;
+    CVReturn result = CVPixelBufferPoolCreatePixelBuffer(kCFAllocatorDefault, _frameProcessingPixelBufferPool, &sparePixelBuffer);
+    if (result != kCVReturnSuccess) {
+        DLog(@"failed to obtain a pixel buffer from the frame processing pool (%d)", result);
+        return NULL;
+    }
+    return sparePixelBuffer;
+}
+
+// runs the chain, in place stages write straight into the frame
+- (CMSampleBufferRef)_createProcessedSampleBufferWithSampleBuffer:(CMSampleBufferRef)sampleBuffer CF_RETURNS_RETAINED
+{
+    CVPixelBufferRef pixelBuffer = CMSampleBufferGetImageBuffer(sampleBuffer);
+    if (!pixelBuffer)
+        return NULL;
+
+    CVPixelBufferRef sparePixelBuffer = NULL;
+    if (PBJFrameProcessorNeedsSpare(_frameProcessor)) {
+        sparePixelBuffer = [self _createFrameProcessingSpareForPixelBuffer:pixelBuffer];
+        if (!sparePixelBuffer)
+            return NULL;
+    }
+
+    // the budget defaults to one frame at the capture rate
+    NSTimeInterval budget = _frameProcessingDeadline > 0 ? _frameProcessingDeadline : 1.0 / (double)MAX(_videoFrameRate, (NSInteger)1);
+    uint64_t processingStart = PBJInstrumentationNow();
+    uint64_t deadline = processingStart + (uint64_t)(budget * 1e9);
+
+    CVPixelBufferRef processedPixelBuffer = [PBJVisionUtilities processPixelBuffer:pixelBuffer sparePixelBuffer:sparePixelBuffer withFrameProcessor:_frameProcessor deadline:deadline];
+    PBJInstrumentationRecordSince(_instrumentation, PBJInstrumentationStageFrameProcessing, processingStart);
+
+    CMSampleBufferRef processedSampleBuffer = NULL;
+    if (processedPixelBuffer == pixelBuffer) {
+        processedSampleBuffer = (CMSampleBufferRef)CFRetain(sampleBuffer);
+    } else if (processedPixelBuffer) {
+        CVBufferPropagateAttachments(pixelBuffer, processedPixelBuffer);
+
+        if (!_frameProcessingFormatDescription) {
+            CMVideoFormatDescriptionCreateForImageBuffer(kCFAllocatorDefault, processedPixelBuffer, &_frameProcessingFormatDescription);
+        }
+
+        CMSampleTimingInfo timingInfo = kCMTimingInfoInvalid;
+        CMSampleBufferGetSampleTimingInfo(sampleBuffer, 0, &timingInfo);
+        if (_frameProcessingFormatDescription) {
+            CMSampleBufferCreateReadyWithImageBuffer([PBJVisionUtilities sampleBufferAllocator], processedPixelBuffer, _frameProcessingFormatDescription, &timingInfo, &processedSampleBuffer);
+        }
+    }
+
+    if (sparePixelBuffer) {
+        CVPixelBufferRelease(sparePixelBuffer);
+    }
+    return processedSampleBuffer;
+}
+
+// the frame as the writer should see it, cropped and resampled for the output format, oriented then processed
+- (CMSampleBufferRef)_createOutputSampleBufferWithSampleBuffer:(CMSampleBufferRef)sampleBuffer CF_RETURNS_RETAINED
+{
+    CMSampleBufferRef outputSampleBuffer = NULL;
+    if (_videoResampler) {
+        outputSampleBuffer = [self _createResampledSampleBufferWithSampleBuffer:sampleBuffer];
+        if (!outputSampleBuffer)
+            return NULL;
+    } else {
+        outputSampleBuffer = (CMSampleBufferRef)CFRetain(sampleBuffer);
+    }
+
+    if (_videoOrientationPixelBufferPool) {
+        CMSampleBufferRef orientedSampleBuffer = [self _createOrientedSampleBufferWithSampleBuffer:outputSampleBuffer];
+        CFRelease(outputSampleBuffer);
+        if (!orientedSampleBuffer)
+            return NULL;
+        outputSampleBuffer = orientedSampleBuffer;
+    }
+
+    // an empty chain costs nothing
+    if (PBJFrameProcessorGetStageCount(_frameProcessor) > 0) {
+        CMSampleBufferRef processedSampleBuffer = [self _createProcessedSampleBufferWithSampleBuffer:outputSampleBuffer];
+        if (processedSampleBuffer) {
+            CFRelease(outputSampleBuffer);
+            outputSampleBuffer = processedSampleBuffer;
+        } else {
+            DLog(@"failed to process video sample buffer");
+        }
+    }
+
+    return outputSampleBuffer;
+}
+
+#pragma mark - proxy
+
+// called on the capture queue as a recording starts, next to the master file with a _proxy suffix.
+// pre-roll starts the master from frames encoded before the recording, the proxy couldn't match it
+- (void)_setupProxyWriterWithOutputURL:(NSURL *)outputURL
+{
+    if (_proxyWriter) {
+        _proxyWriter.delegate = nil;
+        _proxyWriter = nil;
+    }
+    _proxyError = nil;
+    [self _destroyProxyFrames];
+
+    if (!_recordsProxy || _prerollBuffer)
+        return;
+
+    PBJProxyOutputConfiguration configuration = PBJProxyOutputDefaultConfiguration();
+    configuration.maximumDimension = _proxyMaximumDimension;
+    configuration.frameRate = (double)_proxyFrameRate;
+    if (!PBJProxyOutputSetConfiguration(_proxyOutput, &configuration)) {
+        DLog(@"proxy of (%lu) at (%ld) fps is not usable, recording without it", (unsigned long)_proxyMaximumDimension, (long)_proxyFrameRate);
+        return;
+    }
+
+    NSString *outputPath = [outputURL path];
+    NSString *proxyPath = [[outputPath stringByDeletingPathExtension] stringByAppendingString:@"_proxy"];
+    if ([[outputPath pathExtension] length] > 0) {
+        proxyPath = [proxyPath stringByAppendingPathExtension:[outputPath pathExtension]];
+    }
+    if ([[NSFileManager defaultManager] fileExistsAtPath:proxyPath]) {
+        NSError *error = nil;
+        if (![[NSFileManager defaultManager] removeItemAtPath:proxyPath error:&error]) {
+            DLog(@"could not setup a proxy file (file exists)");
+            _proxyError = [NSError errorWithDomain:PBJVisionErrorDomain code:PBJVisionErrorOutputFileExists userInfo:nil];
+            return;
+        }
+    }
+
+    // authorization is reported by the master's writer
+    _proxyWriter = [[PBJMediaWriter alloc] initWithOutputURL:[NSURL fileURLWithPath:proxyPath] queueDepth:_writerQueueDepth
+                                                  dropPolicy:_frameDropPolicy fragmentInterval:_fragmentInterval];
+}
+
+// the master stays up when the proxy fails, the proxy's file is finished and reported as failed
+- (void)_failProxyWithErrorCode:(PBJVisionErrorType)errorCode
+{
+    if (_proxyError)
+        return;
+    DLog(@"proxy failed (%ld), recording the master alone", (long)errorCode);
+    _proxyError = [NSError errorWithDomain:PBJVisionErrorDomain code:errorCode userInfo:nil];
+}
+
+- (void)_setupProxyAudioWithSettings:(NSDictionary *)audioSettings
+{
+    if (!_proxyWriter || _proxyError || _proxyWriter.isAudioReady)
+        return;
+    if (![_proxyWriter setupAudioWithSettings:audioSettings]) {
+        [self _failProxyWithErrorCode:PBJVisionErrorCaptureFailed];
+    }
+}
+
+// the master's settings as it writes its frames, cropped and oriented
+- (void)_setupProxyVideoWithSampleBuffer:(CMSampleBufferRef)sampleBuffer masterSettings:(NSDictionary *)masterSettings
+{
+    if (!_proxyWriter || _proxyError || _proxyWriter.isVideoReady)
+        return;
+
+    size_t masterWidth = [masterSettings[AVVideoWidthKey] unsignedIntegerValue];
+    size_t masterHeight = [masterSettings[AVVideoHeightKey] unsignedIntegerValue];
+    if (!PBJProxyOutputPrepare(_proxyOutput, masterWidth, masterHeight)) {
+        [self _failProxyWithErrorCode:PBJVisionErrorCaptureFailed];
+        return;
+    }
+    size_t width = 0;
+    size_t height = 0;
+    PBJProxyOutputGetDimensions(_proxyOutput, &width, &height);
+
+    // frames the CPU can't downscale are left to the proxy writer's scaling mode
+    CVPixelBufferRef pixelBuffer = CMSampleBufferGetImageBuffer(sampleBuffer);
+    OSType pixelFormat = pixelBuffer ? CVPixelBufferGetPixelFormatType(pixelBuffer) : 0;
+    if (PBJProxyOutputGetResampler(_proxyOutput) &&
+        (pixelFormat == kCVPixelFormatType_420YpCbCr8BiPlanarFullRange || pixelFormat == kCVPixelFormatType_420YpCbCr8BiPlanarVideoRange)) {
+        NSDictionary *pixelBufferAttributes = @{ (id)kCVPixelBufferPixelFormatTypeKey : @(pixelFormat),
+                                                 (id)kCVPixelBufferWidthKey : @(width),
+                                                 (id)kCVPixelBufferHeightKey : @(height),
+                                                 (id)kCVPixelBufferIOSurfacePropertiesKey : @{} };
+        CVReturn result = CVPixelBufferPoolCreate(kCFAllocatorDefault, NULL, (__bridge CFDictionaryRef)pixelBufferAttributes, &_proxyPixelBufferPool);
+        if (result != kCVReturnSuccess) {
+            DLog(@"failed to create proxy pixel buffer pool (%d)", result);
+            [self _failProxyWithErrorCode:PBJVisionErrorCaptureFailed];
+            return;
+        }
+    }
+
+    NSInteger keyFrameInterval = _proxyFrameRate > 0 ? MIN(_proxyFrameRate, [self _outputVideoFrameRate]) : [self _outputVideoFrameRate];
+    NSMutableDictionary *compressionSettings = [NSMutableDictionary dictionaryWithDictionary:masterSettings[AVVideoCompressionPropertiesKey]];
+    compressionSettings[AVVideoAverageBitRateKey] = @(_proxyVideoBitRate);
+    compressionSettings[AVVideoMaxKeyFrameIntervalKey] = @(keyFrameInterval);
+
+    NSDictionary *videoSettings = @{ AVVideoCodecKey : AVVideoCodecH264,
+                                     AVVideoScalingModeKey : AVVideoScalingModeResizeAspectFill,
+                                     AVVideoWidthKey : @(width),
+                                     AVVideoHeightKey : @(height),
+                                     AVVideoCompressionPropertiesKey : compressionSettings };
+    if (![_proxyWriter setupVideoWithSettings:videoSettings withAdditional:[self _mediaWriterVideoProperties]]) {
+        [self _failProxyWithErrorCode:PBJVisionErrorCaptureFailed];
+    }
+}
+
+- (void)_destroyProxyFrames
+{
+    if (_proxyPixelBufferPool) {
+        CVPixelBufferPoolRelease(_proxyPixelBufferPool);
+        _proxyPixelBufferPool = NULL;
+    }
+    if (_proxyFormatDescription) {
+        CFRelease(_proxyFormatDescription);
+        _proxyFormatDescription = NULL;
+    }
+}
+
+// the master's frame when the proxy is its size or can't be downscaled here
+- (CMSampleBufferRef)_createProxySampleBufferWithSampleBuffer:(CMSampleBufferRef)sampleBuffer CF_RETURNS_RETAINED
+{
+    CVPixelBufferRef sourcePixelBuffer = CMSampleBufferGetImageBuffer(sampleBuffer);
+    if (!sourcePixelBuffer || !_proxyPixelBufferPool)
+        return (CMSampleBufferRef)CFRetain(sampleBuffer);
+
+    CVPixelBufferRef pixelBuffer = NULL;
+    CVReturn result = CVPixelBufferPoolCreatePixelBuffer(kCFAllocatorDefault, _proxyPixelBufferPool, &pixelBuffer);
+    if (result != kCVReturnSuccess || !pixelBuffer) {
+        DLog(@"failed to obtain a pixel buffer from the proxy pool (%d)", result);
+        return NULL;
+    }
+
+    CMSampleBufferRef proxySampleBuffer = NULL;
+    if ([PBJVisionUtilities resamplePixelBuffer:sourcePixelBuffer toPixelBuffer:pixelBuffer withResampler:PBJProxyOutputGetResampler(_proxyOutput)]) {
+        CVBufferPropagateAttachments(sourcePixelBuffer, pixelBuffer);
+
+        if (!_proxyFormatDescription) {
+            CMVideoFormatDescriptionCreateForImageBuffer(kCFAllocatorDefault, pixelBuffer, &_proxyFormatDescription);
+        }
+
+        CMSampleTimingInfo timingInfo = kCMTimingInfoInvalid;
+        CMSampleBufferGetSampleTimingInfo(sampleBuffer, 0, &timingInfo);
+        if (_proxyFormatDescription) {
+            CMSampleBufferCreateReadyWithImageBuffer([PBJVisionUtilities sampleBufferAllocator], pixelBuffer, _proxyFormatDescription, &timingInfo, &proxySampleBuffer);
+        }
+    }
+
+    CVPixelBufferRelease(pixelBuffer);
+    return proxySampleBuffer;
+}
+
+// capture queue, a sample just handed to the master's writer, retimed as it was written. frames past
+// the proxy's rate are passed over before they're downscaled
+- (void)_writeProxySampleBuffer:(CMSampleBufferRef)sampleBuffer withMediaTypeVideo:(BOOL)isVideo
+{
+    if (!_proxyWriter || _proxyError)
+        return;
+
+    CMTime time = CMTimeConvertScale(CMSampleBufferGetPresentationTimeStamp(sampleBuffer), 1000000000, kCMTimeRoundingMethod_Default);
+    unsigned int route = PBJProxyOutputRouteSample(_proxyOutput, isVideo ? PBJCaptureTrackVideo : PBJCaptureTrackAudio, time.value);
+    if (!(route & PBJProxyOutputRouteProxy))
+        return;
+
+    if (!isVideo) {
+        [_proxyWriter enqueueSampleBuffer:sampleBuffer withMediaTypeVideo:NO];
+        return;
+    }
+
+    uint64_t downscaleStart = _instrumentation ? PBJInstrumentationNow() : 0;
+    CMSampleBufferRef proxySampleBuffer = [self _createProxySampleBufferWithSampleBuffer:sampleBuffer];
+    PBJInstrumentationRecordSince(_instrumentation, PBJInstrumentationStageProxyDownscale, downscaleStart);
+    if (!proxySampleBuffer) {
+        DLog(@"failed to downscale proxy frame");
+        return;
+    }
+    [_proxyWriter enqueueSampleBuffer:proxySampleBuffer withMediaTypeVideo:YES];
+    CFRelease(proxySampleBuffer);
+}
+
+#pragma mark - AVCapturePhotoCaptureDelegate
+
+- (void)captureOutput:(AVCapturePhotoOutput *)captureOutput willBeginCaptureForResolvedSettings:(AVCaptureResolvedPhotoSettings *)resolvedSettings {
+    [self _willCapturePhoto];
+}
+
+- (void)captureOutput:(AVCapturePhotoOutput *)captureOutput didFinishCaptureForResolvedSettings:(AVCaptureResolvedPhotoSettings *)resolvedSettings error:(NSError *)error {
+    [self _didCapturePhoto];
 }
 
 - (void)captureOutput:(AVCapturePhotoOutput *)captureOutput
@@ -2134,6 +3149,322 @@ previewPhotoSampleBuffer:(CMSampleBufferRef)previewPhotoSampleBuffer
     [self _processImageWithPhotoSampleBuffer:photoSampleBuffer previewSampleBuffer:previewPhotoSampleBuffer error:error];
 }
 
+#pragma mark - audio metering
+
+- (void)_meterAudioSampleBuffer:(CMSampleBufferRef)sampleBuffer
+{
+    const AudioStreamBasicDescription *asbd = CMAudioFormatDescriptionGetStreamBasicDescription(CMSampleBufferGetFormatDescription(sampleBuffer));
+    if (!asbd || asbd->mFormatID != kAudioFormatLinearPCM)
+        return;
+
+    BOOL isFloat = (asbd->mFormatFlags & kAudioFormatFlagIsFloat) != 0;
+    BOOL isInterleaved = (asbd->mFormatFlags & kAudioFormatFlagIsNonInterleaved) == 0 || asbd->mChannelsPerFrame == 1;
+    if (!isInterleaved || asbd->mBitsPerChannel != (isFloat ? 32 : 16) || asbd->mBytesPerFrame == 0)
+        return;
+
+    if (!_audioMeter || asbd->mSampleRate != _audioMeterFormat.mSampleRate ||
+        asbd->mChannelsPerFrame != _audioMeterFormat.mChannelsPerFrame || asbd->mFormatFlags != _audioMeterFormat.mFormatFlags) {
+        PBJAudioMeterDestroy(_audioMeter);
+        PBJAudioMeterConfiguration configuration = PBJAudioMeterDefaultConfiguration(asbd->mSampleRate, asbd->mChannelsPerFrame);
+        configuration.bandCount = (uint32_t)_audioMeteringBandCount;
+        _audioMeter = PBJAudioMeterCreate(&configuration);
+        _audioMeterFormat = *asbd;
+        _audioMeterLastReport = PBJInstrumentationNow();
+        if (!_audioMeter)
+            return;
+    }
+
+    // metered where the samples are, a buffer split across blocks is skipped rather than copied
+    CMBlockBufferRef blockBuffer = CMSampleBufferGetDataBuffer(sampleBuffer);
+    char *data = NULL;
+    size_t lengthAtOffset = 0;
+    size_t totalLength = 0;
+    if (!blockBuffer || CMBlockBufferGetDataPointer(blockBuffer, 0, &lengthAtOffset, &totalLength, &data) != kCMBlockBufferNoErr || lengthAtOffset < totalLength)
+        return;
+
+    size_t frameCount = MIN((size_t)CMSampleBufferGetNumSamples(sampleBuffer), totalLength / asbd->mBytesPerFrame);
+    PBJAudioMeterProcess(_audioMeter, data, frameCount, isFloat ? PBJAudioSampleFormatFloat32 : PBJAudioSampleFormatInt16, PBJSIMDLevelAuto);
+
+    uint64_t now = PBJInstrumentationNow();
+    if ((double)(now - _audioMeterLastReport) < _audioMeteringInterval * NSEC_PER_SEC)
+        return;
+    _audioMeterLastReport = now;
+
+    PBJAudioLevels levels;
+    PBJAudioMeterRead(_audioMeter, &levels);
+    if ([_delegate respondsToSelector:@selector(vision:didMeasureAudioLevels:)]) {
+        [self _enqueueBlockOnMainQueue:^{
+            [self->_delegate vision:self didMeasureAudioLevels:levels];
+        }];
+    }
+}
+
+#pragma mark - pre-roll
+
+- (void)_prerollSampleBuffer:(CMSampleBufferRef)sampleBuffer withMediaTypeVideo:(BOOL)isVideo
+{
+    if (!isVideo) {
+        if (_flags.audioCaptureEnabled) {
+            [_prerollBuffer appendAudioSampleBuffer:sampleBuffer];
+        }
+        return;
+    }
+
+    // a new device or format starts over
+    CMVideoDimensions dimensions = CMVideoFormatDescriptionGetDimensions(CMSampleBufferGetFormatDescription(sampleBuffer));
+    if (_prerollBuffer && (dimensions.width != _prerollSourceDimensions.width || dimensions.height != _prerollSourceDimensions.height)) {
+        [_prerollBuffer invalidate];
+        _prerollBuffer = nil;
+    }
+
+    if (!_prerollBuffer) {
+        _prerollSourceDimensions = dimensions;
+        NSDictionary *videoSettings = [self _videoSettingsForSampleBuffer:sampleBuffer];
+        _prerollBuffer = [[PBJPrerollBuffer alloc] initWithDuration:_prerollDuration memoryBudget:_prerollMemoryBudget videoSettings:videoSettings];
+        if (!_prerollBuffer) {
+            DLog(@"failed to setup pre-roll");
+            return;
+        }
+    }
+
+    CMSampleBufferRef outputSampleBuffer = [self _createOutputSampleBufferWithSampleBuffer:sampleBuffer];
+    if (outputSampleBuffer) {
+        [_prerollBuffer appendVideoSampleBuffer:outputSampleBuffer];
+        CFRelease(outputSampleBuffer);
+    }
+}
+
+// hands the held samples to the new writer and routes the encoder's output to it
+- (void)_seedMediaWriterFromPrerollBuffer
+{
+    PBJMediaWriter *mediaWriter = _mediaWriter;
+    if (![mediaWriter setupVideoWithSettings:_prerollBuffer.videoSettings withAdditional:[self _mediaWriterVideoProperties]])
+        return;
+
+    BOOL audioCaptureEnabled = _flags.audioCaptureEnabled;
+    __block BOOL audioReady = NO;
+    [_prerollBuffer drainToHandler:^(CMSampleBufferRef sampleBuffer, BOOL video) {
+        if (!video) {
+            if (!audioCaptureEnabled)
+                return;
+            audioReady = audioReady || mediaWriter.isAudioReady || [self _setupMediaWriterAudioInputWithSampleBuffer:sampleBuffer];
+            if (!audioReady)
+                return;
+        }
+        [mediaWriter writeSampleBuffer:sampleBuffer withMediaTypeVideo:video];
+    } forwardingVideoTo:^(CMSampleBufferRef sampleBuffer) {
+        [mediaWriter enqueueSampleBuffer:sampleBuffer withMediaTypeVideo:YES];
+    }];
+}
+
+- (void)_finishPrerollForwarding
+{
+    if (!_prerollBuffer.isForwarding)
+        return;
+
+    // the last frames still in the encoder belong to the recording
+    [_prerollBuffer completeFrames];
+    [_prerollBuffer stopForwarding];
+    _prerollBuffer.videoBitRate = 0;
+    [self _updatePrerollBuffer];
+}
+
+// rebuilt with the next frame after the settings change, never mid recording
+- (void)_updatePrerollBuffer
+{
+    if (!_prerollBuffer || _prerollBuffer.isForwarding)
+        return;
+
+    BOOL matches = CMTIME_IS_NUMERIC(_prerollDuration) &&
+                   CMTIME_COMPARE_INLINE(_prerollBuffer.duration, ==, _prerollDuration) &&
+                   _prerollBuffer.memoryBudget == _prerollMemoryBudget;
+    if (!matches) {
+        [_prerollBuffer invalidate];
+        _prerollBuffer = nil;
+    }
+}
+
+#pragma mark - writer load
+
+- (void)_setupRateGovernor
+{
+    PBJSampleDeliverySetRateGovernor(_sampleDelivery, NULL);
+    PBJRateGovernorDestroy(_rateGovernor);
+    _rateGovernor = NULL;
+    _adaptedVideoBitRate = _videoBitRate;
+    // frames are admitted on the file's timeline, at its frame rate
+    NSInteger frameRate = [self _outputVideoFrameRate];
+    _adaptedVideoFrameRate = (CGFloat)frameRate;
+
+    if (!_adaptsToWriterLoad)
+        return;
+
+    PBJRateGovernorConfiguration configuration = PBJRateGovernorDefaultConfiguration(_videoBitRate, (double)MAX(frameRate, (NSInteger)1));
+    if (_minimumVideoBitRate > 0) {
+        configuration.minimumBitRate = MIN(_minimumVideoBitRate, _videoBitRate);
+    }
+    if (_minimumVideoFrameRate > 0) {
+        configuration.minimumFrameRate = (double)MIN(_minimumVideoFrameRate, frameRate);
+    }
+    _rateGovernor = PBJRateGovernorCreate(&configuration);
+    PBJSampleDeliverySetRateGovernor(_sampleDelivery, _rateGovernor);
+}
+
+// read with every frame, the governor only decides once each of its intervals
+- (void)_observeWriterLoad
+{
+    PBJWriterStatistics statistics = _mediaWriter.statistics;
+    PBJWriterLoad load;
+    load.time = (int64_t)PBJInstrumentationNow();
+    load.queuedFrames = statistics.videoFramesQueued;
+    load.queueCapacity = statistics.videoQueueCapacity;
+    load.framesDropped = statistics.videoFramesDropped;
+    load.appendsDeferred = statistics.videoAppendsDeferred;
+    load.framesAppended = statistics.videoFramesWritten;
+    load.appendNanoseconds = statistics.videoAppendNanoseconds;
+    if (!PBJRateGovernorObserve(_rateGovernor, &load))
+        return;
+
+    PBJRateGovernorTargets targets;
+    PBJRateGovernorGetTargets(_rateGovernor, &targets);
+    _adaptedVideoBitRate = (CGFloat)targets.bitRate;
+    _adaptedVideoFrameRate = (CGFloat)targets.frameRate;
+    DLog(@"writer load, video at %.0f bps %.1f fps", targets.bitRate, targets.frameRate);
+
+    _mediaWriter.videoBitRate = targets.bitRate;
+    if (_prerollBuffer.isForwarding) {
+        _prerollBuffer.videoBitRate = targets.bitRate;
+    }
+}
+
+#pragma mark - storage
+
+static int PBJVisionStorageFreeBytes(void *context, uint64_t *freeBytes)
+{
+    @autoreleasepool {
+        NSArray *paths = NSSearchPathForDirectoriesInDomains(NSDocumentDirectory, NSUserDomainMask, YES);
+        NSDictionary *attributes = [[NSFileManager defaultManager] attributesOfFileSystemForPath:[paths lastObject] error:NULL];
+        NSNumber *freeFileSystemSizeInBytes = attributes[NSFileSystemFreeSize];
+        if (!freeFileSystemSizeInBytes)
+            return 0;
+        // space preallocated for the recording is still free as far as the recording is concerned,
+        // storage queue, where the monitor calls from
+        PBJVision *vision = (__bridge PBJVision *)context;
+        *freeBytes = [freeFileSystemSizeInBytes unsignedLongLongValue] + vision->_storageMediaWriter.unusedPreallocatedBytes +
+                     vision->_storageProxyWriter.unusedPreallocatedBytes;
+        return 1;
+    }
+}
+
+- (void)_setupStorageMonitor
+{
+    atomic_init(&_storageMeasured, 0);
+    atomic_init(&_storageUsableBytes, 0);
+    atomic_init(&_storageRemainingMilliseconds, -1);
+
+    PBJStorageMonitorConfiguration configuration = PBJStorageMonitorDefaultConfiguration(PBJVisionRequiredMinimumDiskSpaceInBytes);
+    // unretained, the monitor is only updated from the timer's weak reference
+    PBJStorageVolume volume = { (__bridge void *)self, PBJVisionStorageFreeBytes };
+    _storageMonitor = PBJStorageMonitorCreate(&configuration, volume);
+
+    dispatch_queue_attr_t attributes = dispatch_queue_attr_make_with_qos_class(DISPATCH_QUEUE_SERIAL, QOS_CLASS_UTILITY, 0);
+    _storageDispatchQueue = dispatch_queue_create("PBJVisionStorage", attributes);
+    _storageTimer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, _storageDispatchQueue);
+
+    // the monitor goes with the timer, so a tick already running can't outlive it
+    __weak PBJVision *weakSelf = self;
+    PBJStorageMonitor *storageMonitor = _storageMonitor;
+    dispatch_source_set_event_handler(_storageTimer, ^{
+        [weakSelf _updateStorageMonitor];
+    });
+    dispatch_source_set_cancel_handler(_storageTimer, ^{
+        PBJStorageMonitorDestroy(storageMonitor);
+    });
+    dispatch_source_set_timer(_storageTimer, DISPATCH_TIME_NOW, DISPATCH_TIME_FOREVER, 0);
+    dispatch_resume(_storageTimer);
+}
+
+- (void)_destroyStorageMonitor
+{
+    if (_storageTimer) {
+        dispatch_source_cancel(_storageTimer);
+        _storageTimer = nil;
+    }
+    _storageMonitor = NULL;
+}
+
+- (BOOL)_isDiskSpaceAvailable
+{
+    // only until the first background answer
+    if (!atomic_load_explicit(&_storageMeasured, memory_order_acquire))
+        return [PBJVisionUtilities availableStorageSpaceInBytes] > PBJVisionRequiredMinimumDiskSpaceInBytes;
+    return atomic_load_explicit(&_storageUsableBytes, memory_order_relaxed) > 0;
+}
+
+- (NSTimeInterval)estimatedRecordingTimeRemaining
+{
+    int64_t milliseconds = atomic_load_explicit(&_storageRemainingMilliseconds, memory_order_relaxed);
+    return milliseconds < 0 ? -1.0 : (NSTimeInterval)milliseconds / 1000.0;
+}
+
+// storage queue, polls the writer and the volume as the monitor asks, then schedules the next tick
+- (void)_updateStorageMonitor
+{
+    PBJStorageMonitor *storageMonitor = _storageMonitor;
+    if (!storageMonitor)
+        return;
+
+    int64_t now = (int64_t)PBJInstrumentationNow();
+    PBJMediaWriter *mediaWriter = _storageMediaWriter;
+    if (mediaWriter) {
+        PBJStorageMonitorRecordBytesWritten(storageMonitor, mediaWriter.bytesWritten + _storageProxyWriter.bytesWritten, now);
+    }
+    PBJStorageMonitorUpdate(storageMonitor, now);
+
+    PBJStorageEstimate estimate;
+    PBJStorageMonitorGetEstimate(storageMonitor, &estimate);
+    int64_t remainingMilliseconds = estimate.remainingSeconds < 0 ? -1 : (int64_t)(estimate.remainingSeconds * 1000.0);
+    atomic_store_explicit(&_storageUsableBytes, estimate.usableBytes, memory_order_relaxed);
+    atomic_store_explicit(&_storageRemainingMilliseconds, remainingMilliseconds, memory_order_relaxed);
+    atomic_store_explicit(&_storageMeasured, estimate.measured, memory_order_release);
+
+    if (estimate.shouldStop && mediaWriter) {
+        DLog(@"ending video capture, storage nearly full");
+        _storageMediaWriter = nil;
+        _storageProxyWriter = nil;
+        NSError *error = [NSError errorWithDomain:PBJVisionErrorDomain code:PBJVisionErrorInsufficientStorage userInfo:nil];
+        [self _enqueueBlockOnCaptureVideoQueue:^{
+            if (self->_mediaWriter == mediaWriter) {
+                [self _endVideoCaptureWithError:error];
+            }
+        }];
+    }
+
+    int64_t delay = MAX(PBJStorageMonitorNextUpdateTime(storageMonitor) - now, (int64_t)0);
+    dispatch_source_set_timer(_storageTimer, dispatch_time(DISPATCH_TIME_NOW, delay), DISPATCH_TIME_FOREVER, (uint64_t)delay / 10);
+}
+
+// capture queue, the proxy writer is nil when the recording has none
+- (void)_beginStorageMonitoringWithMediaWriter:(PBJMediaWriter *)mediaWriter proxyWriter:(PBJMediaWriter *)proxyWriter
+{
+    dispatch_async(_storageDispatchQueue, ^{
+        self->_storageMediaWriter = mediaWriter;
+        self->_storageProxyWriter = proxyWriter;
+        PBJStorageMonitorBeginRecording(self->_storageMonitor, (int64_t)PBJInstrumentationNow());
+        [self _updateStorageMonitor];
+    });
+}
+
+- (void)_endStorageMonitoring
+{
+    dispatch_async(_storageDispatchQueue, ^{
+        self->_storageMediaWriter = nil;
+        self->_storageProxyWriter = nil;
+        PBJStorageMonitorEndRecording(self->_storageMonitor, (int64_t)PBJInstrumentationNow());
+        [self _updateStorageMonitor];
+    });
+}
+
 #pragma mark - AVCaptureAudioDataOutputSampleBufferDelegate, AVCaptureVideoDataOutputSampleBufferDelegate
 
 - (void)captureOutput:(AVCaptureOutput *)captureOutput didOutputSampleBuffer:(CMSampleBufferRef)sampleBuffer fromConnection:(AVCaptureConnection *)connection
@@ -2146,7 +3477,16 @@ previewPhotoSampleBuffer:(CMSampleBufferRef)previewPhotoSampleBuffer
         return;
     }
 
-    if (!_flags.recording || _flags.paused) {
+    BOOL isVideo = (captureOutput == _captureOutputVideo);
+    if (_instrumentation && isVideo) {
+        [self _recordArrivalOfSampleBuffer:sampleBuffer];
+    }
+    if (_audioMeteringEnabled && !isVideo) {
+        [self _meterAudioSampleBuffer:sampleBuffer];
+    }
+
+    if (!_flags.recording && CMTIME_IS_NUMERIC(_prerollDuration)) {
+        [self _prerollSampleBuffer:sampleBuffer withMediaTypeVideo:isVideo];
         CFRelease(sampleBuffer);
         return;
     }
@@ -2155,51 +3495,135 @@ previewPhotoSampleBuffer:(CMSampleBufferRef)previewPhotoSampleBuffer
         CFRelease(sampleBuffer);
         return;
     }
+
+    // recording state, writer readiness, ordering and retiming are decided by the pipeline,
+    // accepted samples come back through PBJVisionPipelineWriteSample, now or a little later
+    PBJCaptureSample sample;
+    sample.track = isVideo ? PBJCaptureTrackVideo : PBJCaptureTrackAudio;
+    sample.presentationTimestamp = PBJTimeFromCMTime(CMSampleBufferGetPresentationTimeStamp(sampleBuffer));
+    sample.duration = PBJTimeFromCMTime(CMSampleBufferGetDuration(sampleBuffer));
+    sample.payload = (void *)sampleBuffer;
+
+    PBJCapturePipelineSampleResult result = PBJCapturePipelineProcessSample(_pipeline, &sample);
+    if (isVideo && result == PBJCapturePipelineSampleDroppedPaused) {
+        PBJInstrumentationIncrementCounter(_instrumentation, PBJInstrumentationCounterFramesDroppedPaused);
+    }
     
-    // setup media writer
-    BOOL isVideo = (captureOutput == _captureOutputVideo);
-    if (!isVideo && !_mediaWriter.isAudioReady) {
-        [self _setupMediaWriterAudioInputWithSampleBuffer:sampleBuffer];
-        DLog(@"ready for audio (%d)", _mediaWriter.isAudioReady);
+    CFRelease(sampleBuffer);
+}
+
+#pragma mark - capture pipeline sink
+
+static int PBJVisionPipelineSetupTrack(void *context, const PBJCaptureSample *sample)
+{
+    PBJVision *vision = (__bridge PBJVision *)context;
+    return [vision _setupMediaWriterForSampleBuffer:(CMSampleBufferRef)sample->payload track:sample->track] ? 1 : 0;
+}
+
+static int PBJVisionPipelineWriteSample(void *context, const PBJCaptureSample *sample, PBJTime rebasedPresentationTimestamp)
+{
+    PBJVision *vision = (__bridge PBJVision *)context;
+    CMSampleBufferRef sampleBuffer = (CMSampleBufferRef)sample->payload;
+
+    // audio that straddled the first frame comes back starting at it
+    CMSampleBufferRef trimmedSampleBuffer = NULL;
+    if (sample->track == PBJCaptureTrackAudio && sample->presentationTimestamp.value != CMSampleBufferGetPresentationTimeStamp(sampleBuffer).value) {
+        CMTime presentationTimestamp = CMTimeMake(sample->presentationTimestamp.value, (int32_t)sample->presentationTimestamp.timescale);
+        trimmedSampleBuffer = [PBJVisionUtilities createTrimmedAudioSampleBufferWithSampleBuffer:sampleBuffer fromPresentationTimestamp:presentationTimestamp];
+        if (!trimmedSampleBuffer) {
+            DLog(@"failed to trim audio sample buffer");
+            return 0;
+        }
+        sampleBuffer = trimmedSampleBuffer;
     }
-    if (isVideo && !_mediaWriter.isVideoReady) {
-        [self _setupMediaWriterVideoInputWithSampleBuffer:sampleBuffer];
+
+    BOOL written = [vision _writeSampleBuffer:sampleBuffer
+                           withMediaTypeVideo:(sample->track == PBJCaptureTrackVideo)
+                        presentationTimestamp:rebasedPresentationTimestamp];
+    if (trimmedSampleBuffer) {
+        CFRelease(trimmedSampleBuffer);
+    }
+    return written ? 1 : 0;
+}
+
+static void PBJVisionPipelineMaximumDurationReached(void *context)
+{
+    PBJVision *vision = (__bridge PBJVision *)context;
+    [vision _enqueueBlockOnMainQueue:^{
+        [vision endVideoCapture];
+    }];
+}
+
+// samples are held between the delegate callback and the write so they leave in order
+static void PBJVisionPipelineRetainPayload(void *context, void *payload)
+{
+    CFRetain((CMSampleBufferRef)payload);
+}
+
+static void PBJVisionPipelineReleasePayload(void *context, void *payload)
+{
+    CFRelease((CMSampleBufferRef)payload);
+}
+
+- (BOOL)_setupMediaWriterForSampleBuffer:(CMSampleBufferRef)sampleBuffer track:(PBJCaptureTrack)track
+{
+    PBJInstrumentation *instrumentation = _instrumentation;
+    uint64_t setupStart = instrumentation ? PBJInstrumentationNow() : 0;
+
+    BOOL ready = NO;
+    if (track == PBJCaptureTrackVideo) {
+        ready = _mediaWriter.isVideoReady || [self _setupMediaWriterVideoInputWithSampleBuffer:sampleBuffer];
         DLog(@"ready for video (%d)", _mediaWriter.isVideoReady);
+    } else {
+        ready = _mediaWriter.isAudioReady || [self _setupMediaWriterAudioInputWithSampleBuffer:sampleBuffer];
+        DLog(@"ready for audio (%d)", _mediaWriter.isAudioReady);
     }
 
-    BOOL isReadyToRecord = ((!_flags.audioCaptureEnabled || _mediaWriter.isAudioReady) && _mediaWriter.isVideoReady);
-    if (!isReadyToRecord) {
-        CFRelease(sampleBuffer);
-        return;
+    PBJInstrumentationRecordSince(instrumentation, PBJInstrumentationStageWriterSetup, setupStart);
+    return ready;
+}
+
+// sharpness, exposure and scene change of the frame as written, 0 when it can't be read
+- (float)_scoreVideoSampleBuffer:(CMSampleBufferRef)sampleBuffer
+{
+    uint64_t analysisStart = _instrumentation ? PBJInstrumentationNow() : 0;
+
+    PBJFrameStatistics statistics;
+    BOOL analyzed = [PBJVisionUtilities analyzePixelBuffer:CMSampleBufferGetImageBuffer(sampleBuffer) withFrameAnalyzer:_frameAnalyzer statistics:&statistics];
+    PBJInstrumentationRecordSince(_instrumentation, PBJInstrumentationStageFrameAnalysis, analysisStart);
+
+    return analyzed ? PBJFrameStatisticsScore(&statistics) : 0;
+}
+
+- (BOOL)_writeSampleBuffer:(CMSampleBufferRef)sampleBuffer withMediaTypeVideo:(BOOL)isVideo presentationTimestamp:(PBJTime)rebasedTimestamp
+{
+    PBJInstrumentation *instrumentation = _instrumentation;
+    CMSampleBufferRef outputSampleBuffer = NULL;
+
+    // below the governed frame rate frames are passed over before any work is spent on them
+    if (isVideo && _rateGovernor) {
+        [self _observeWriterLoad];
+        if (!PBJSampleDeliveryAdmitFrame(_sampleDelivery, PBJTimeGetNanoseconds(rebasedTimestamp)))
+            return YES;
     }
-    
-    CMTime currentTimestamp = CMSampleBufferGetPresentationTimeStamp(sampleBuffer);
 
-    // calculate the length of the interruption and store the offsets
-    if (_flags.interrupted) {
-        if (isVideo) {
-            CFRelease(sampleBuffer);
-            return;
+    // crop, resample, orient and process before anything downstream sees the frame
+    if (isVideo && (_videoResampler || _videoOrientationPixelBufferPool || PBJFrameProcessorGetStageCount(_frameProcessor) > 0)) {
+        outputSampleBuffer = [self _createOutputSampleBufferWithSampleBuffer:sampleBuffer];
+        if (!outputSampleBuffer) {
+            DLog(@"failed to prepare video sample buffer");
+            return NO;
         }
-        
-        // calculate the appropriate time offset
-        if (CMTIME_IS_VALID(currentTimestamp) && CMTIME_IS_VALID(_mediaWriter.audioTimestamp)) {
-            if (CMTIME_IS_VALID(_timeOffset)) {
-                currentTimestamp = CMTimeSubtract(currentTimestamp, _timeOffset);
-            }
-            
-            CMTime offset = CMTimeSubtract(currentTimestamp, _mediaWriter.audioTimestamp);
-            _timeOffset = CMTIME_IS_INVALID(_timeOffset) ? offset : CMTimeAdd(_timeOffset, offset);
-            DLog(@"new calculated offset %f valid (%d)", CMTimeGetSeconds(_timeOffset), CMTIME_IS_VALID(_timeOffset));
-        }
-        _flags.interrupted = NO;
+        sampleBuffer = outputSampleBuffer;
     }
-    
-    // adjust the sample buffer if there is a time offset
+
     CMSampleBufferRef bufferToWrite = NULL;
-    if (CMTIME_IS_VALID(_timeOffset)) {
-        //CMTime duration = CMSampleBufferGetDuration(sampleBuffer);
-        bufferToWrite = [PBJVisionUtilities createOffsetSampleBufferWithSampleBuffer:sampleBuffer withTimeOffset:_timeOffset];
+    CMTime presentationTimestamp = CMSampleBufferGetPresentationTimeStamp(sampleBuffer);
+    if (rebasedTimestamp.value != presentationTimestamp.value) {
+        CMTime timeOffset = CMTimeMake(presentationTimestamp.value - rebasedTimestamp.value, presentationTimestamp.timescale);
+        uint64_t retimingStart = instrumentation ? PBJInstrumentationNow() : 0;
+        bufferToWrite = [PBJVisionUtilities createOffsetSampleBufferWithSampleBuffer:sampleBuffer withTimeOffset:timeOffset];
+        PBJInstrumentationRecordSince(instrumentation, PBJInstrumentationStageRetiming, retimingStart);
         if (!bufferToWrite) {
             DLog(@"error subtracting the timeoffset from the sampleBuffer");
         }
@@ -2207,62 +3631,169 @@ previewPhotoSampleBuffer:(CMSampleBufferRef)previewPhotoSampleBuffer
         bufferToWrite = sampleBuffer;
         CFRetain(bufferToWrite);
     }
-    
+
+    if (outputSampleBuffer) {
+        CFRelease(outputSampleBuffer);
+    }
+
+    if (!bufferToWrite)
+        return NO;
+
     // write the sample buffer
-    if (bufferToWrite && !_flags.interrupted) {
-    
-        if (isVideo) {
+    if (isVideo) {
 
-            [_mediaWriter writeSampleBuffer:bufferToWrite withMediaTypeVideo:isVideo];
+        // while seeded from pre-roll the same encoder carries on, its output goes to the writer
+        if (_prerollBuffer.isForwarding) {
+            [_prerollBuffer appendVideoSampleBuffer:bufferToWrite];
+        } else {
+            [_mediaWriter enqueueSampleBuffer:bufferToWrite withMediaTypeVideo:isVideo];
+            [self _writeProxySampleBuffer:bufferToWrite withMediaTypeVideo:YES];
+        }
 
-            _flags.videoWritten = YES;
-        
-            // process the sample buffer for rendering onion layer or capturing video photo
-            if ( (_flags.videoRenderingEnabled || _flags.videoCaptureFrame) && _flags.videoWritten) {
-                [self _executeBlockOnMainQueue:^{
-                    [self _processSampleBuffer:bufferToWrite];
-                    
-                    if (self->_flags.videoCaptureFrame) {
-                        self->_flags.videoCaptureFrame = NO;
-                        [self _willCapturePhoto];
-                        [self _capturePhotoFromSampleBuffer:bufferToWrite];
-                        [self _didCapturePhoto];
-                    }
-                }];
-            }
+        _flags.videoWritten = YES;
 
-            if ([_delegate respondsToSelector:@selector(vision:didCaptureVideoSampleBuffer:)]) {
-                CMSampleBufferRef forDelegate = bufferToWrite;
-                CFRetain(forDelegate);
- 
-                [self _enqueueBlockOnMainQueue:^{
-                    [self->_delegate vision:self didCaptureVideoSampleBuffer:forDelegate];
-                        CFRelease(forDelegate);
-                }];
-            }
+        // thumbnails, frame selection, rendering and the delegate, each holding its own retain
+        PBJSampleDeliveryRoutes routes = [self _sampleDeliveryRoutes];
+        PBJSampleDeliveryDeliverFrame(_sampleDelivery, (void *)bufferToWrite, PBJTimeGetNanoseconds(rebasedTimestamp), &routes);
 
-        } else if (!isVideo && _flags.videoWritten) {
-            
-            [_mediaWriter writeSampleBuffer:bufferToWrite withMediaTypeVideo:isVideo];
-            
-            [self _enqueueBlockOnMainQueue:^{
-                if ([self->_delegate respondsToSelector:@selector(vision:didCaptureAudioSample:)]) {
-                    [self->_delegate vision:self didCaptureAudioSample:bufferToWrite];
-                }
-            }];
+    } else {
         
-        }
+        [_mediaWriter enqueueSampleBuffer:bufferToWrite withMediaTypeVideo:isVideo];
+        [self _writeProxySampleBuffer:bufferToWrite withMediaTypeVideo:NO];
+        
+        // only hop to the main queue for a delegate that listens, a delegate that falls a ring
+        // behind loses the oldest buffers rather than queueing without bound
+        PBJSampleDeliveryRoutes routes = [self _sampleDeliveryRoutes];
+        PBJSampleDeliveryDeliverAudio(_sampleDelivery, (void *)bufferToWrite, &routes);
     
     }
-    
-    [self _automaticallyEndCaptureIfMaximumDurationReachedWithSampleBuffer:sampleBuffer];
-        
-    if (bufferToWrite) {
-        CFRelease(bufferToWrite);
+
+    CFRelease(bufferToWrite);
+    return YES;
+}
+
+// read with every sample, the flags and the delegate change under the capture queue
+- (PBJSampleDeliveryRoutes)_sampleDeliveryRoutes
+{
+    PBJSampleDeliveryRoutes routes;
+    routes.thumbnails = _flags.thumbnailEnabled;
+    routes.scoresThumbnails = _flags.contentAwareVideoThumbnails;
+    routes.frameSelectionInterval = _frameSelectionInterval > 0 ? (int64_t)(_frameSelectionInterval * 1e9) : 0;
+    routes.render = (_flags.videoRenderingEnabled || _flags.videoCaptureFrame);
+    routes.delegateVideo = [_delegate respondsToSelector:@selector(vision:didCaptureVideoSampleBuffer:)];
+    routes.delegateAudio = [_delegate respondsToSelector:@selector(vision:didCaptureAudioSample:)];
+    return routes;
+}
+
+#pragma mark - sample delivery
+
+// the mailboxes, the delegate ring and the frame selection window each hold a retained sample buffer
+static void PBJVisionSampleDeliveryRetainSample(void *context, void *sample)
+{
+    CFRetain((CMSampleBufferRef)sample);
+}
+
+static void PBJVisionSampleDeliveryReleaseSample(void *context, void *sample)
+{
+    CFRelease((CMSampleBufferRef)sample);
+}
+
+static float PBJVisionSampleDeliveryScoreFrame(void *context, void *frame)
+{
+    PBJVision *vision = (__bridge PBJVision *)context;
+    return [vision _scoreVideoSampleBuffer:(CMSampleBufferRef)frame];
+}
+
+static void PBJVisionSampleDeliveryThumbnailFrame(void *context, void *frame, float score, int requested)
+{
+    PBJVision *vision = (__bridge PBJVision *)context;
+    [vision _appendThumbnailWithSampleBuffer:(CMSampleBufferRef)frame score:score requested:(requested != 0)];
+}
+
+// capture queue, the wake is free to fill in, its previous trip has been received
+static void PBJVisionSampleDeliverySendWake(void *context, PBJSampleDeliveryWake *wake)
+{
+    wake->owner = (void *)CFBridgingRetain((__bridge PBJVision *)context);
+    dispatch_async_f(dispatch_get_main_queue(), wake, PBJVisionSampleDeliveryWake);
+}
+
+// each wake is received before its mailbox or ring is emptied, which is what lets the next one be sent
+static void PBJVisionSampleDeliveryWake(void *context)
+{
+    PBJSampleDeliveryWake wake = PBJSampleDeliveryReceiveWake((PBJSampleDeliveryWake *)context);
+    PBJVision *vision = (PBJVision *)CFBridgingRelease(wake.owner);
+    switch (wake.type) {
+        case PBJSampleDeliveryWakeRender:
+            [vision _renderLatestSampleBufferWithWake:wake];
+            break;
+        case PBJSampleDeliveryWakeDelegateVideo:
+            [vision _deliverLatestVideoSampleBuffer];
+            break;
+        case PBJSampleDeliveryWakeDelegateAudio:
+            [vision _deliverAudioSampleBuffers];
+            break;
+        default:
+            break;
     }
-    
-    CFRelease(sampleBuffer);
+}
+
+- (void)_appendThumbnailWithSampleBuffer:(CMSampleBufferRef)sampleBuffer score:(float)score requested:(BOOL)requested
+{
+    [_thumbnailStore appendPixelBuffer:CMSampleBufferGetImageBuffer(sampleBuffer) presentationTimestamp:CMSampleBufferGetPresentationTimeStamp(sampleBuffer) score:score requested:requested];
+}
+
+- (void)_renderLatestSampleBufferWithWake:(PBJSampleDeliveryWake)wake
+{
+    CMSampleBufferRef latest = (CMSampleBufferRef)PBJSampleDeliveryTakeFrame(_sampleDelivery, PBJSampleDeliveryWakeRender);
+    if (!latest)
+        return;
+
+    uint64_t renderingStart = wake.instrumentation ? PBJInstrumentationNow() : 0;
+    [self _processSampleBuffer:latest];
+    PBJInstrumentationRecordSince(wake.instrumentation, PBJInstrumentationStageRendering, renderingStart);
 
+    if (_flags.videoCaptureFrame) {
+        _flags.videoCaptureFrame = NO;
+        [self _willCapturePhoto];
+        [self _capturePhotoFromSampleBuffer:latest];
+        [self _didCapturePhoto];
+    }
+    CFRelease(latest);
+}
+
+- (void)_deliverLatestVideoSampleBuffer
+{
+    CMSampleBufferRef latest = (CMSampleBufferRef)PBJSampleDeliveryTakeFrame(_sampleDelivery, PBJSampleDeliveryWakeDelegateVideo);
+    if (!latest)
+        return;
+
+    [_delegate vision:self didCaptureVideoSampleBuffer:latest];
+    CFRelease(latest);
+}
+
+- (void)_deliverAudioSampleBuffers
+{
+    CMSampleBufferRef sampleBuffer = NULL;
+    while ((sampleBuffer = (CMSampleBufferRef)PBJSampleDeliveryTakeAudio(_sampleDelivery))) {
+        if ([_delegate respondsToSelector:@selector(vision:didCaptureAudioSample:)]) {
+            [_delegate vision:self didCaptureAudioSample:sampleBuffer];
+        }
+        CFRelease(sampleBuffer);
+    }
+}
+
+// time from the sample's host clock presentation time to the delegate callback
+- (void)_recordArrivalOfSampleBuffer:(CMSampleBufferRef)sampleBuffer
+{
+    PBJInstrumentationIncrementCounter(_instrumentation, PBJInstrumentationCounterFramesReceived);
+
+    CMTime presentationTimestamp = CMSampleBufferGetPresentationTimeStamp(sampleBuffer);
+    if (!CMTIME_IS_NUMERIC(presentationTimestamp))
+        return;
+
+    CMTime latency = CMTimeSubtract(CMClockGetTime(CMClockGetHostTimeClock()), presentationTimestamp);
+    int64_t nanoseconds = CMTimeConvertScale(latency, 1000000000, kCMTimeRoundingMethod_Default).value;
+    PBJInstrumentationRecordLatency(_instrumentation, PBJInstrumentationStageSampleArrival, nanoseconds > 0 ? (uint64_t)nanoseconds : 0);
 }
 
 #pragma mark - App NSNotifications
@@ -2292,6 +3823,14 @@ previewPhotoSampleBuffer:(CMSampleBufferRef)previewPhotoSampleBuffer
             self->_flags.previewRunning = YES;
         }];
     }
+
+    PBJFramePoolTrim(PBJFramePoolGetShared(), 0);
+}
+
+- (void)_applicationDidReceiveMemoryWarning:(NSNotification *)notification
+{
+    DLog(@"applicationDidReceiveMemoryWarning");
+    PBJFramePoolTrim(PBJFramePoolGetShared(), 0);
 }
 
 #pragma mark - AV NSNotifications
@@ -2366,6 +3905,11 @@ previewPhotoSampleBuffer:(CMSampleBufferRef)previewPhotoSampleBuffer
         
         if (self->_flags.recording)
             [self endVideoCapture];
+
+        // what was held before the gap must not lead the next recording
+        [self _enqueueBlockOnCaptureVideoQueue:^{
+            [self->_prerollBuffer reset];
+        }];
     
         [self _enqueueBlockOnMainQueue:^{
             if ([self->_delegate respondsToSelector:@selector(visionSessionDidStop:)]) {
@@ -2382,6 +3926,11 @@ previewPhotoSampleBuffer:(CMSampleBufferRef)previewPhotoSampleBuffer
             return;
         
         DLog(@"session was interrupted");
+
+        // frames stop arriving, remove the hole from the recording once they resume
+        [self _enqueueBlockOnCaptureVideoQueue:^{
+            PBJCapturePipelineInterrupt(self->_pipeline);
+        }];
         
         if (self->_flags.recording) {
             [self _enqueueBlockOnMainQueue:^{
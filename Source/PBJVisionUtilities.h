@@ -26,6 +26,14 @@
 #import <Foundation/Foundation.h>
 #import <AVFoundation/AVFoundation.h>
 
+#import <VideoToolbox/VideoToolbox.h>
+
+#import "PBJResampler.h"
+#import "PBJFrameProcessor.h"
+#import "PBJFrameOrientation.h"
+#import "PBJFrameAnalyzer.h"
+#import "PBJFramePool.h"
+
 @interface PBJVisionUtilities : NSObject
 
 // devices and connections
@@ -37,10 +45,61 @@
 
 // sample buffers
 
+// recycles the memory of sample buffers made per frame (retimed, resampled, processed) through the shared
+// frame pool, so a steady recording doesn't go back to the heap for them
++ (CFAllocatorRef)sampleBufferAllocator;
+
 + (CMSampleBufferRef)createOffsetSampleBufferWithSampleBuffer:(CMSampleBufferRef)sampleBuffer withTimeOffset:(CMTime)timeOffset;
+// the part of a linear PCM sample buffer from presentationTimestamp on, rounded up to a whole
+// frame, NULL when nothing of it is left
++ (CMSampleBufferRef)createTrimmedAudioSampleBufferWithSampleBuffer:(CMSampleBufferRef)sampleBuffer fromPresentationTimestamp:(CMTime)presentationTimestamp;
 
 + (UIImage *)uiimageFromJPEGData:(NSData *)jpegData;
 
+// pixel buffers
+
+// converts a 420f/420v (or 32BGRA) pixel buffer into an image on the CPU, spreading the work across cores
++ (CGImageRef)createCGImageFromPixelBuffer:(CVPixelBufferRef)pixelBuffer CF_RETURNS_RETAINED;
+
+// same as above, only the pixels inside cropRect (CGRectNull for all) are read and converted
++ (CGImageRef)createCGImageFromPixelBuffer:(CVPixelBufferRef)pixelBuffer cropRect:(CGRect)cropRect CF_RETURNS_RETAINED;
+
+// encodes the pixels of a 420f/420v pixel buffer inside cropRect (CGRectNull for all) straight to JPEG, quality is
+// 0 - 1 and restart intervals let the scan be entropy coded across cores. when thumbnail is given and
+// thumbnailDimension isn't 0, a thumbnail no larger than that on either side is downsampled from the same planes
+// and returned retained
++ (NSData *)JPEGDataFromPixelBuffer:(CVPixelBufferRef)pixelBuffer cropRect:(CGRect)cropRect quality:(CGFloat)quality
+                thumbnailDimension:(size_t)thumbnailDimension thumbnail:(CGImageRef *)thumbnail;
+
+// largest centered, even aligned rect of the given aspect ratio inside a buffer of the given size
++ (CGRect)cropRectForAspectRatio:(CGSize)aspectRatio insideSize:(CGSize)size;
+
+// crops and resamples a 420f/420v pixel buffer into another of the same format, row strips run across cores
++ (BOOL)resamplePixelBuffer:(CVPixelBufferRef)sourcePixelBuffer toPixelBuffer:(CVPixelBufferRef)destinationPixelBuffer withResampler:(const PBJResampler *)resampler;
+
+// rotates and mirrors a 420f/420v pixel buffer into another of the same format sized by PBJFrameOrientationOutputSize,
+// row strips run across cores
++ (BOOL)orientPixelBuffer:(CVPixelBufferRef)sourcePixelBuffer toPixelBuffer:(CVPixelBufferRef)destinationPixelBuffer orientation:(PBJFrameOrientation)orientation;
+
+// luma statistics of a 420f/420v pixel buffer, read in place
++ (BOOL)analyzePixelBuffer:(CVPixelBufferRef)pixelBuffer withFrameAnalyzer:(PBJFrameAnalyzer *)frameAnalyzer statistics:(PBJFrameStatistics *)statistics;
+
+// copies the planes of a 420f/420v pixel buffer into a buffer of the shared frame pool, for holding on to
+// a frame past the capture callback without starving the capture pool, PBJFrameBufferRelease when done
++ (PBJFrameBuffer *)createFrameBufferWithPixelBuffer:(CVPixelBufferRef)pixelBuffer;
+
+// runs the processing chain over a 420f/420v pixel buffer, out of place stages alternate with the spare,
+// returns whichever of the two holds the result, NULL when the frame could not be processed
++ (CVPixelBufferRef)processPixelBuffer:(CVPixelBufferRef)pixelBuffer sparePixelBuffer:(CVPixelBufferRef)sparePixelBuffer withFrameProcessor:(PBJFrameProcessor *)frameProcessor deadline:(uint64_t)deadline;
+
+// encoding
+
+// an H.264 session for the AVAssetWriterInput style settings dictionary (dimensions, bit rate, key frame
+// interval), real time and without frame reordering so decode order is presentation order
++ (VTCompressionSessionRef)createCompressionSessionWithVideoSettings:(NSDictionary *)videoSettings
+                                                      outputCallback:(VTCompressionOutputCallback)outputCallback
+                                                              refcon:(void *)refcon CF_RETURNS_RETAINED;
+
 // orientation
 
 + (UIImageOrientation)uiimageOrientationFromExifOrientation:(NSInteger)exifOrientation;
@@ -25,6 +25,8 @@
 
 #import "PBJVisionUtilities.h"
 #import "PBJVision.h"
+#import "PBJColorConversion.h"
+#import "PBJJPEGEncoder.h"
 
 #import <ImageIO/ImageIO.h>
 
@@ -64,6 +66,66 @@
     return nil;
 }
 
+// each block carries its frame buffer ahead of it, to find its way back to the pool
+#define PBJVisionUtilitiesAllocationHeaderSize 16
+
+static void *PBJVisionUtilitiesPoolAllocate(CFIndex allocSize, CFOptionFlags hint, void *info)
+{
+    if (allocSize <= 0)
+        return NULL;
+
+    PBJFrameBuffer *buffer = PBJFramePoolAcquire(PBJFramePoolGetShared(), PBJFrameFormatBytes, (size_t)allocSize + PBJVisionUtilitiesAllocationHeaderSize, 1);
+    if (!buffer)
+        return NULL;
+
+    uint8_t *block = PBJFrameBufferGetPlane(buffer, 0);
+    *(PBJFrameBuffer **)block = buffer;
+    return block + PBJVisionUtilitiesAllocationHeaderSize;
+}
+
+static void PBJVisionUtilitiesPoolDeallocate(void *ptr, void *info)
+{
+    if (ptr) {
+        PBJFrameBufferRelease(*(PBJFrameBuffer **)((uint8_t *)ptr - PBJVisionUtilitiesAllocationHeaderSize));
+    }
+}
+
+static void *PBJVisionUtilitiesPoolReallocate(void *ptr, CFIndex newsize, CFOptionFlags hint, void *info)
+{
+    if (!ptr)
+        return PBJVisionUtilitiesPoolAllocate(newsize, hint, info);
+    if (newsize <= 0) {
+        PBJVisionUtilitiesPoolDeallocate(ptr, info);
+        return NULL;
+    }
+
+    PBJFrameBuffer *buffer = *(PBJFrameBuffer **)((uint8_t *)ptr - PBJVisionUtilitiesAllocationHeaderSize);
+    size_t size = PBJFrameBufferGetWidth(buffer) - PBJVisionUtilitiesAllocationHeaderSize;
+    if ((size_t)newsize <= size)
+        return ptr;
+
+    void *moved = PBJVisionUtilitiesPoolAllocate(newsize, hint, info);
+    if (moved) {
+        memcpy(moved, ptr, size);
+        PBJVisionUtilitiesPoolDeallocate(ptr, info);
+    }
+    return moved;
+}
+
++ (CFAllocatorRef)sampleBufferAllocator
+{
+    static CFAllocatorRef allocator = NULL;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        CFAllocatorContext context = { 0, NULL, NULL, NULL, NULL, PBJVisionUtilitiesPoolAllocate, PBJVisionUtilitiesPoolReallocate, PBJVisionUtilitiesPoolDeallocate, NULL };
+        allocator = CFAllocatorCreate(kCFAllocatorDefault, &context);
+    });
+    return allocator ?: kCFAllocatorDefault;
+}
+
+// capture sample buffers carry a single timing entry, or one per sample of uncompressed audio
+#define PBJVisionUtilitiesTimingInfoCapacity 8
+
 + (CMSampleBufferRef)createOffsetSampleBufferWithSampleBuffer:(CMSampleBufferRef)sampleBuffer withTimeOffset:(CMTime)timeOffset
 {
     CMItemCount itemCount;
@@ -73,34 +135,59 @@
         return NULL;
     }
     
-    CMSampleTimingInfo *timingInfo = (CMSampleTimingInfo *)malloc(sizeof(CMSampleTimingInfo) * (unsigned long)itemCount);
-    if (!timingInfo) {
-        return NULL;
+    CMSampleTimingInfo timingStorage[PBJVisionUtilitiesTimingInfoCapacity];
+    CMSampleTimingInfo *timingInfo = timingStorage;
+    if (itemCount > PBJVisionUtilitiesTimingInfoCapacity) {
+        timingInfo = (CMSampleTimingInfo *)malloc(sizeof(CMSampleTimingInfo) * (unsigned long)itemCount);
+        if (!timingInfo) {
+            return NULL;
+        }
     }
     
+    CMSampleBufferRef offsetSampleBuffer = NULL;
     status = CMSampleBufferGetSampleTimingInfoArray(sampleBuffer, itemCount, timingInfo, &itemCount);
-    if (status) {
-        free(timingInfo);
-        timingInfo = NULL;
-        return NULL;
-    }
-    
-    for (CMItemCount i = 0; i < itemCount; i++) {
-        timingInfo[i].presentationTimeStamp = CMTimeSubtract(timingInfo[i].presentationTimeStamp, timeOffset);
-        timingInfo[i].decodeTimeStamp = CMTimeSubtract(timingInfo[i].decodeTimeStamp, timeOffset);
+    if (!status) {
+        for (CMItemCount i = 0; i < itemCount; i++) {
+            timingInfo[i].presentationTimeStamp = CMTimeSubtract(timingInfo[i].presentationTimeStamp, timeOffset);
+            timingInfo[i].decodeTimeStamp = CMTimeSubtract(timingInfo[i].decodeTimeStamp, timeOffset);
+        }
+        CMSampleBufferCreateCopyWithNewTiming([self sampleBufferAllocator], sampleBuffer, itemCount, timingInfo, &offsetSampleBuffer);
     }
     
-    CMSampleBufferRef offsetSampleBuffer;
-    CMSampleBufferCreateCopyWithNewTiming(kCFAllocatorDefault, sampleBuffer, itemCount, timingInfo, &offsetSampleBuffer);
-    
-    if (timingInfo) {
+    if (timingInfo != timingStorage) {
         free(timingInfo);
-        timingInfo = NULL;
     }
     
     return offsetSampleBuffer;
 }
 
++ (CMSampleBufferRef)createTrimmedAudioSampleBufferWithSampleBuffer:(CMSampleBufferRef)sampleBuffer fromPresentationTimestamp:(CMTime)presentationTimestamp
+{
+    CMFormatDescriptionRef formatDescription = CMSampleBufferGetFormatDescription(sampleBuffer);
+    const AudioStreamBasicDescription *streamDescription = formatDescription ? CMAudioFormatDescriptionGetStreamBasicDescription(formatDescription) : NULL;
+    if (!streamDescription || streamDescription->mFormatID != kAudioFormatLinearPCM || streamDescription->mSampleRate <= 0) {
+        return NULL;
+    }
+
+    CMItemCount frameCount = CMSampleBufferGetNumSamples(sampleBuffer);
+    CMTime cut = CMTimeSubtract(presentationTimestamp, CMSampleBufferGetPresentationTimeStamp(sampleBuffer));
+    CMItemCount cutFrames = (CMItemCount)CMTimeConvertScale(cut, (int32_t)streamDescription->mSampleRate, kCMTimeRoundingMethod_RoundAwayFromZero).value;
+    if (cutFrames <= 0) {
+        CFRetain(sampleBuffer);
+        return sampleBuffer;
+    }
+    if (cutFrames >= frameCount) {
+        return NULL;
+    }
+
+    CMSampleBufferRef trimmedSampleBuffer = NULL;
+    OSStatus status = CMSampleBufferCopySampleBufferForRange(kCFAllocatorDefault, sampleBuffer, CFRangeMake(cutFrames, frameCount - cutFrames), &trimmedSampleBuffer);
+    if (status) {
+        return NULL;
+    }
+    return trimmedSampleBuffer;
+}
+
 + (UIImage *)uiimageFromJPEGData:(NSData *)jpegData
 {
     CGImageRef jpegCGImage = NULL;
@@ -143,6 +230,400 @@
     return image;
 }
 
+#pragma mark - pixel buffers
+
+static void PBJVisionUtilitiesReleaseImageData(void *info, const void *data, size_t size)
+{
+    PBJFrameBufferRelease((PBJFrameBuffer *)info);
+}
+
+static void PBJVisionUtilitiesNV12ImageFromPixelBuffer(CVPixelBufferRef pixelBuffer, PBJNV12Image *image)
+{
+    OSType pixelFormat = CVPixelBufferGetPixelFormatType(pixelBuffer);
+    image->luma = (uint8_t *)CVPixelBufferGetBaseAddressOfPlane(pixelBuffer, 0);
+    image->lumaBytesPerRow = CVPixelBufferGetBytesPerRowOfPlane(pixelBuffer, 0);
+    image->chroma = (uint8_t *)CVPixelBufferGetBaseAddressOfPlane(pixelBuffer, 1);
+    image->chromaBytesPerRow = CVPixelBufferGetBytesPerRowOfPlane(pixelBuffer, 1);
+    image->width = CVPixelBufferGetWidth(pixelBuffer);
+    image->height = CVPixelBufferGetHeight(pixelBuffer);
+    image->range = (pixelFormat == kCVPixelFormatType_420YpCbCr8BiPlanarVideoRange) ? PBJYCbCrRangeVideo : PBJYCbCrRangeFull;
+}
+
+static BOOL PBJVisionUtilitiesIsBiPlanar(CVPixelBufferRef pixelBuffer)
+{
+    OSType pixelFormat = CVPixelBufferGetPixelFormatType(pixelBuffer);
+    return (pixelFormat == kCVPixelFormatType_420YpCbCr8BiPlanarFullRange ||
+            pixelFormat == kCVPixelFormatType_420YpCbCr8BiPlanarVideoRange);
+}
+
+// even aligned crop inside the buffer, cropping later happens by offsetting into the planes
+static PBJCropRect PBJVisionUtilitiesCropRectInPixelBuffer(CVPixelBufferRef pixelBuffer, CGRect cropRect)
+{
+    size_t bufferWidth = CVPixelBufferGetWidth(pixelBuffer);
+    size_t bufferHeight = CVPixelBufferGetHeight(pixelBuffer);
+    CGRect bounds = CGRectMake(0, 0, bufferWidth, bufferHeight);
+    CGRect crop = CGRectIsNull(cropRect) ? bounds : CGRectIntersection(CGRectIntegral(cropRect), bounds);
+    if (CGRectIsNull(crop))
+        return (PBJCropRect){ 0, 0, 0, 0 };
+
+    PBJCropRect rect;
+    rect.x = ((size_t)CGRectGetMinX(crop)) & ~(size_t)1;
+    rect.y = ((size_t)CGRectGetMinY(crop)) & ~(size_t)1;
+    rect.width = ((size_t)CGRectGetWidth(crop)) & ~(size_t)1;
+    rect.height = ((size_t)CGRectGetHeight(crop)) & ~(size_t)1;
+    return rect;
+}
+
+static void PBJVisionUtilitiesCropNV12Image(PBJNV12Image *image, PBJCropRect crop)
+{
+    image->luma += crop.y * image->lumaBytesPerRow + crop.x;
+    image->chroma += (crop.y / 2) * image->chromaBytesPerRow + crop.x;
+    image->width = crop.width;
+    image->height = crop.height;
+}
+
+// takes over the reference to the pooled pixels, they return to the pool with the image
+static CGImageRef PBJVisionUtilitiesCreateBGRAImage(PBJFrameBuffer *pixelsBuffer)
+{
+    size_t width = PBJFrameBufferGetWidth(pixelsBuffer);
+    size_t height = PBJFrameBufferGetHeight(pixelsBuffer);
+    size_t bytesPerRow = PBJFrameBufferGetBytesPerRow(pixelsBuffer, 0);
+
+    CGImageRef image = NULL;
+    CGDataProviderRef provider = CGDataProviderCreateWithData(pixelsBuffer, PBJFrameBufferGetPlane(pixelsBuffer, 0), PBJFrameBufferGetPlaneSize(pixelsBuffer, 0), PBJVisionUtilitiesReleaseImageData);
+    if (provider) {
+        CGColorSpaceRef colorSpace = CGColorSpaceCreateDeviceRGB();
+        image = CGImageCreate(width, height, 8, 32, bytesPerRow, colorSpace,
+                              kCGBitmapByteOrder32Little | kCGImageAlphaNoneSkipFirst,
+                              provider, NULL, false, kCGRenderingIntentDefault);
+        CGColorSpaceRelease(colorSpace);
+        CGDataProviderRelease(provider);
+    } else {
+        PBJFrameBufferRelease(pixelsBuffer);
+    }
+    return image;
+}
+
++ (CGImageRef)createCGImageFromPixelBuffer:(CVPixelBufferRef)pixelBuffer
+{
+    return [self createCGImageFromPixelBuffer:pixelBuffer cropRect:CGRectNull];
+}
+
++ (CGImageRef)createCGImageFromPixelBuffer:(CVPixelBufferRef)pixelBuffer cropRect:(CGRect)cropRect
+{
+    if (!pixelBuffer)
+        return NULL;
+
+    OSType pixelFormat = CVPixelBufferGetPixelFormatType(pixelBuffer);
+    BOOL isBiPlanar = PBJVisionUtilitiesIsBiPlanar(pixelBuffer);
+    if (!isBiPlanar && pixelFormat != kCVPixelFormatType_32BGRA) {
+        return NULL;
+    }
+
+    // crop by offsetting into the planes, pixels outside the rect are never touched
+    PBJCropRect crop = PBJVisionUtilitiesCropRectInPixelBuffer(pixelBuffer, cropRect);
+    size_t width = crop.width;
+    size_t height = crop.height;
+    if (width == 0 || height == 0)
+        return NULL;
+
+    if (CVPixelBufferLockBaseAddress(pixelBuffer, kCVPixelBufferLock_ReadOnly) != kCVReturnSuccess)
+        return NULL;
+
+    PBJFrameBuffer *pixelsBuffer = PBJFramePoolAcquire(PBJFramePoolGetShared(), PBJFrameFormatBGRA, width, height);
+    if (!pixelsBuffer) {
+        CVPixelBufferUnlockBaseAddress(pixelBuffer, kCVPixelBufferLock_ReadOnly);
+        return NULL;
+    }
+    uint8_t *pixels = PBJFrameBufferGetPlane(pixelsBuffer, 0);
+    size_t bytesPerRow = PBJFrameBufferGetBytesPerRow(pixelsBuffer, 0);
+
+    if (isBiPlanar) {
+        PBJNV12Image source;
+        PBJVisionUtilitiesNV12ImageFromPixelBuffer(pixelBuffer, &source);
+        PBJVisionUtilitiesCropNV12Image(&source, crop);
+
+        size_t stripCount = PBJColorConversionStripCount(height, (size_t)[[NSProcessInfo processInfo] activeProcessorCount]);
+        dispatch_apply(stripCount, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^(size_t strip) {
+            size_t rowBegin = 0;
+            size_t rowEnd = 0;
+            PBJColorConversionStripRows(height, stripCount, strip, &rowBegin, &rowEnd);
+            PBJColorConvertNV12ToRGBRows(&source, pixels, bytesPerRow, PBJRGBOrderBGRA, rowBegin, rowEnd, PBJSIMDLevelAuto);
+        });
+    } else {
+        const uint8_t *base = (const uint8_t *)CVPixelBufferGetBaseAddress(pixelBuffer);
+        size_t sourceBytesPerRow = CVPixelBufferGetBytesPerRow(pixelBuffer);
+        base += crop.y * sourceBytesPerRow + crop.x * 4;
+        for (size_t row = 0; row < height; row++) {
+            memcpy(pixels + row * bytesPerRow, base + row * sourceBytesPerRow, width * 4);
+        }
+    }
+
+    CVPixelBufferUnlockBaseAddress(pixelBuffer, kCVPixelBufferLock_ReadOnly);
+
+    return PBJVisionUtilitiesCreateBGRAImage(pixelsBuffer);
+}
+
+// box filtered copy of the planes no larger than maximumDimension on either side, then BGRA
+static CGImageRef PBJVisionUtilitiesCreateThumbnail(const PBJNV12Image *source, size_t maximumDimension)
+{
+    size_t longest = MAX(source->width, source->height);
+    double scale = MIN(1.0, (double)maximumDimension / (double)longest);
+    size_t width = MAX((size_t)2, ((size_t)lround(source->width * scale)) & ~(size_t)1);
+    size_t height = MAX((size_t)2, ((size_t)lround(source->height * scale)) & ~(size_t)1);
+
+    PBJCropRect crop = { 0, 0, source->width, source->height };
+    PBJResampler *resampler = PBJResamplerCreate(crop, width, height, PBJResampleFilterBox);
+    if (!resampler)
+        return NULL;
+
+    PBJFramePool *pool = PBJFramePoolGetShared();
+    PBJFrameBuffer *planesBuffer = PBJFramePoolAcquire(pool, PBJFrameFormatNV12, width, height);
+    PBJFrameBuffer *scratchBuffer = PBJFramePoolAcquire(pool, PBJFrameFormatBytes, PBJResamplerScratchSize(resampler), 1);
+    PBJFrameBuffer *pixelsBuffer = PBJFramePoolAcquire(pool, PBJFrameFormatBGRA, width, height);
+
+    CGImageRef image = NULL;
+    if (planesBuffer && scratchBuffer && pixelsBuffer) {
+        PBJNV12Image thumbnail = PBJFrameBufferGetNV12Image(planesBuffer, source->range);
+        PBJResamplerProcessRows(resampler, source, &thumbnail, 0, height, PBJFrameBufferGetPlane(scratchBuffer, 0), PBJSIMDLevelAuto);
+        PBJColorConvertNV12ToRGBRows(&thumbnail, PBJFrameBufferGetPlane(pixelsBuffer, 0), PBJFrameBufferGetBytesPerRow(pixelsBuffer, 0), PBJRGBOrderBGRA, 0, height, PBJSIMDLevelAuto);
+        image = PBJVisionUtilitiesCreateBGRAImage(pixelsBuffer);
+    } else {
+        PBJFrameBufferRelease(pixelsBuffer);
+    }
+
+    PBJFrameBufferRelease(scratchBuffer);
+    PBJFrameBufferRelease(planesBuffer);
+    PBJResamplerDestroy(resampler);
+    return image;
+}
+
++ (NSData *)JPEGDataFromPixelBuffer:(CVPixelBufferRef)pixelBuffer cropRect:(CGRect)cropRect quality:(CGFloat)quality
+                thumbnailDimension:(size_t)thumbnailDimension thumbnail:(CGImageRef *)thumbnail
+{
+    if (thumbnail)
+        *thumbnail = NULL;
+    if (!pixelBuffer || !PBJVisionUtilitiesIsBiPlanar(pixelBuffer))
+        return nil;
+
+    PBJCropRect crop = PBJVisionUtilitiesCropRectInPixelBuffer(pixelBuffer, cropRect);
+    if (crop.width == 0 || crop.height == 0)
+        return nil;
+
+    if (CVPixelBufferLockBaseAddress(pixelBuffer, kCVPixelBufferLock_ReadOnly) != kCVReturnSuccess)
+        return nil;
+
+    PBJNV12Image source;
+    PBJVisionUtilitiesNV12ImageFromPixelBuffer(pixelBuffer, &source);
+    PBJVisionUtilitiesCropNV12Image(&source, crop);
+
+    // one restart interval per core, each segment is entropy coded on its own
+    size_t processorCount = (size_t)[[NSProcessInfo processInfo] activeProcessorCount];
+    size_t mcuRows = (crop.height + 15) / 16;
+    PBJJPEGOptions options;
+    options.quality = (int)MAX(1, MIN(100, lround(quality * 100.0)));
+    options.restartRows = processorCount > 1 ? (mcuRows + processorCount - 1) / processorCount : 0;
+    options.level = PBJSIMDLevelAuto;
+
+    NSMutableData *jpegData = nil;
+    PBJJPEGEncoder *encoder = PBJJPEGEncoderCreate(&source, options);
+    if (encoder) {
+        size_t segmentCount = PBJJPEGEncoderGetSegmentCount(encoder);
+        dispatch_apply(segmentCount, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^(size_t segment) {
+            PBJJPEGEncoderEncodeSegment(encoder, segment);
+        });
+
+        size_t size = PBJJPEGEncoderGetSize(encoder);
+        if (size > 0) {
+            jpegData = [NSMutableData dataWithLength:size];
+            if (PBJJPEGEncoderCopyBytes(encoder, (uint8_t *)jpegData.mutableBytes, size) != size) {
+                jpegData = nil;
+            }
+        }
+        PBJJPEGEncoderDestroy(encoder);
+    }
+
+    if (jpegData && thumbnail && thumbnailDimension > 0) {
+        *thumbnail = PBJVisionUtilitiesCreateThumbnail(&source, thumbnailDimension);
+    }
+
+    CVPixelBufferUnlockBaseAddress(pixelBuffer, kCVPixelBufferLock_ReadOnly);
+
+    return jpegData;
+}
+
++ (CGRect)cropRectForAspectRatio:(CGSize)aspectRatio insideSize:(CGSize)size
+{
+    // scale the ratio up so fractional aspects (ie 16:9 expressed as 1.777:1) keep their precision
+    PBJCropRect crop = PBJCropRectForAspectRatio((size_t)size.width, (size_t)size.height,
+                                                 (size_t)lround(aspectRatio.width * 1000.0), (size_t)lround(aspectRatio.height * 1000.0));
+    return CGRectMake(crop.x, crop.y, crop.width, crop.height);
+}
+
++ (BOOL)resamplePixelBuffer:(CVPixelBufferRef)sourcePixelBuffer toPixelBuffer:(CVPixelBufferRef)destinationPixelBuffer withResampler:(const PBJResampler *)resampler
+{
+    if (!sourcePixelBuffer || !destinationPixelBuffer || !resampler)
+        return NO;
+
+    if (!PBJVisionUtilitiesIsBiPlanar(sourcePixelBuffer) ||
+        CVPixelBufferGetPixelFormatType(sourcePixelBuffer) != CVPixelBufferGetPixelFormatType(destinationPixelBuffer)) {
+        return NO;
+    }
+
+    if (CVPixelBufferLockBaseAddress(sourcePixelBuffer, kCVPixelBufferLock_ReadOnly) != kCVReturnSuccess)
+        return NO;
+    if (CVPixelBufferLockBaseAddress(destinationPixelBuffer, 0) != kCVReturnSuccess) {
+        CVPixelBufferUnlockBaseAddress(sourcePixelBuffer, kCVPixelBufferLock_ReadOnly);
+        return NO;
+    }
+
+    PBJNV12Image source;
+    PBJNV12Image destination;
+    PBJVisionUtilitiesNV12ImageFromPixelBuffer(sourcePixelBuffer, &source);
+    PBJVisionUtilitiesNV12ImageFromPixelBuffer(destinationPixelBuffer, &destination);
+
+    size_t height = destination.height;
+    size_t stripCount = PBJColorConversionStripCount(height, (size_t)[[NSProcessInfo processInfo] activeProcessorCount]);
+    // a pooled row of scratch per strip, recycled frame to frame, no two strips share a cache line
+    PBJFrameBuffer *scratchBuffer = PBJFramePoolAcquire(PBJFramePoolGetShared(), PBJFrameFormatBytes, PBJResamplerScratchSize(resampler), stripCount);
+    if (scratchBuffer) {
+        uint8_t *scratch = PBJFrameBufferGetPlane(scratchBuffer, 0);
+        size_t scratchBytesPerRow = PBJFrameBufferGetBytesPerRow(scratchBuffer, 0);
+        dispatch_apply(stripCount, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^(size_t strip) {
+            size_t rowBegin = 0;
+            size_t rowEnd = 0;
+            PBJColorConversionStripRows(height, stripCount, strip, &rowBegin, &rowEnd);
+            PBJResamplerProcessRows(resampler, &source, &destination, rowBegin, rowEnd, scratch + strip * scratchBytesPerRow, PBJSIMDLevelAuto);
+        });
+        PBJFrameBufferRelease(scratchBuffer);
+    }
+
+    CVPixelBufferUnlockBaseAddress(destinationPixelBuffer, 0);
+    CVPixelBufferUnlockBaseAddress(sourcePixelBuffer, kCVPixelBufferLock_ReadOnly);
+
+    return (scratchBuffer != NULL);
+}
+
++ (BOOL)orientPixelBuffer:(CVPixelBufferRef)sourcePixelBuffer toPixelBuffer:(CVPixelBufferRef)destinationPixelBuffer orientation:(PBJFrameOrientation)orientation
+{
+    if (!sourcePixelBuffer || !destinationPixelBuffer)
+        return NO;
+
+    if (!PBJVisionUtilitiesIsBiPlanar(sourcePixelBuffer) ||
+        CVPixelBufferGetPixelFormatType(sourcePixelBuffer) != CVPixelBufferGetPixelFormatType(destinationPixelBuffer)) {
+        return NO;
+    }
+
+    size_t width = 0;
+    size_t height = 0;
+    PBJFrameOrientationOutputSize(orientation, CVPixelBufferGetWidth(sourcePixelBuffer), CVPixelBufferGetHeight(sourcePixelBuffer), &width, &height);
+    if (CVPixelBufferGetWidth(destinationPixelBuffer) != width || CVPixelBufferGetHeight(destinationPixelBuffer) != height)
+        return NO;
+
+    if (CVPixelBufferLockBaseAddress(sourcePixelBuffer, kCVPixelBufferLock_ReadOnly) != kCVReturnSuccess)
+        return NO;
+    if (CVPixelBufferLockBaseAddress(destinationPixelBuffer, 0) != kCVReturnSuccess) {
+        CVPixelBufferUnlockBaseAddress(sourcePixelBuffer, kCVPixelBufferLock_ReadOnly);
+        return NO;
+    }
+
+    PBJNV12Image source;
+    PBJNV12Image destination;
+    PBJVisionUtilitiesNV12ImageFromPixelBuffer(sourcePixelBuffer, &source);
+    PBJVisionUtilitiesNV12ImageFromPixelBuffer(destinationPixelBuffer, &destination);
+
+    // strips begin on even rows so each owns its chroma rows
+    size_t stripCount = PBJColorConversionStripCount(height, (size_t)[[NSProcessInfo processInfo] activeProcessorCount]);
+    dispatch_apply(stripCount, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^(size_t strip) {
+        size_t rowBegin = 0;
+        size_t rowEnd = 0;
+        PBJColorConversionStripRows(height, stripCount, strip, &rowBegin, &rowEnd);
+        PBJFrameOrientRows(&source, &destination, orientation, rowBegin, rowEnd, PBJSIMDLevelAuto);
+    });
+
+    CVPixelBufferUnlockBaseAddress(destinationPixelBuffer, 0);
+    CVPixelBufferUnlockBaseAddress(sourcePixelBuffer, kCVPixelBufferLock_ReadOnly);
+
+    return YES;
+}
+
++ (BOOL)analyzePixelBuffer:(CVPixelBufferRef)pixelBuffer withFrameAnalyzer:(PBJFrameAnalyzer *)frameAnalyzer statistics:(PBJFrameStatistics *)statistics
+{
+    if (!pixelBuffer || !frameAnalyzer || !statistics || !PBJVisionUtilitiesIsBiPlanar(pixelBuffer))
+        return NO;
+
+    if (CVPixelBufferLockBaseAddress(pixelBuffer, kCVPixelBufferLock_ReadOnly) != kCVReturnSuccess)
+        return NO;
+
+    PBJNV12Image image;
+    PBJVisionUtilitiesNV12ImageFromPixelBuffer(pixelBuffer, &image);
+    int analyzed = PBJFrameAnalyzerAnalyze(frameAnalyzer, &image, statistics);
+
+    CVPixelBufferUnlockBaseAddress(pixelBuffer, kCVPixelBufferLock_ReadOnly);
+    return analyzed != 0;
+}
+
++ (PBJFrameBuffer *)createFrameBufferWithPixelBuffer:(CVPixelBufferRef)pixelBuffer
+{
+    if (!pixelBuffer || !PBJVisionUtilitiesIsBiPlanar(pixelBuffer))
+        return NULL;
+
+    if (CVPixelBufferLockBaseAddress(pixelBuffer, kCVPixelBufferLock_ReadOnly) != kCVReturnSuccess)
+        return NULL;
+
+    size_t width = CVPixelBufferGetWidth(pixelBuffer);
+    size_t height = CVPixelBufferGetHeight(pixelBuffer);
+    PBJFrameBuffer *frameBuffer = PBJFramePoolAcquire(PBJFramePoolGetShared(), PBJFrameFormatNV12, width, height);
+    if (frameBuffer) {
+        for (size_t plane = 0; plane < 2; plane++) {
+            const uint8_t *source = (const uint8_t *)CVPixelBufferGetBaseAddressOfPlane(pixelBuffer, plane);
+            size_t sourceBytesPerRow = CVPixelBufferGetBytesPerRowOfPlane(pixelBuffer, plane);
+            uint8_t *destination = PBJFrameBufferGetPlane(frameBuffer, plane);
+            size_t destinationBytesPerRow = PBJFrameBufferGetBytesPerRow(frameBuffer, plane);
+            size_t rowBytes = MIN(sourceBytesPerRow, destinationBytesPerRow);
+            size_t rows = MIN(CVPixelBufferGetHeightOfPlane(pixelBuffer, plane), PBJFrameBufferGetPlaneSize(frameBuffer, plane) / destinationBytesPerRow);
+            for (size_t row = 0; row < rows; row++) {
+                memcpy(destination + row * destinationBytesPerRow, source + row * sourceBytesPerRow, rowBytes);
+            }
+        }
+    }
+
+    CVPixelBufferUnlockBaseAddress(pixelBuffer, kCVPixelBufferLock_ReadOnly);
+    return frameBuffer;
+}
+
++ (CVPixelBufferRef)processPixelBuffer:(CVPixelBufferRef)pixelBuffer sparePixelBuffer:(CVPixelBufferRef)sparePixelBuffer withFrameProcessor:(PBJFrameProcessor *)frameProcessor deadline:(uint64_t)deadline
+{
+    if (!pixelBuffer || !frameProcessor || !PBJVisionUtilitiesIsBiPlanar(pixelBuffer))
+        return NULL;
+
+    if (sparePixelBuffer && CVPixelBufferGetPixelFormatType(sparePixelBuffer) != CVPixelBufferGetPixelFormatType(pixelBuffer))
+        return NULL;
+
+    if (CVPixelBufferLockBaseAddress(pixelBuffer, 0) != kCVReturnSuccess)
+        return NULL;
+    if (sparePixelBuffer && CVPixelBufferLockBaseAddress(sparePixelBuffer, 0) != kCVReturnSuccess) {
+        CVPixelBufferUnlockBaseAddress(pixelBuffer, 0);
+        return NULL;
+    }
+
+    PBJNV12Image frame;
+    PBJNV12Image spare;
+    PBJVisionUtilitiesNV12ImageFromPixelBuffer(pixelBuffer, &frame);
+    if (sparePixelBuffer) {
+        PBJVisionUtilitiesNV12ImageFromPixelBuffer(sparePixelBuffer, &spare);
+    }
+
+    PBJFrameProcessorResult result = PBJFrameProcessorRun(frameProcessor, &frame, sparePixelBuffer ? &spare : NULL, deadline);
+
+    if (sparePixelBuffer) {
+        CVPixelBufferUnlockBaseAddress(sparePixelBuffer, 0);
+    }
+    CVPixelBufferUnlockBaseAddress(pixelBuffer, 0);
+
+    return result.outputInSpare ? sparePixelBuffer : pixelBuffer;
+}
+
 // http://sylvana.net/jpegcrop/exif_orientation.html
 + (UIImageOrientation)uiimageOrientationFromExifOrientation:(NSInteger)exifOrientation
 {
@@ -201,6 +682,49 @@
     return angle;
 }
 
+#pragma mark - encoding
+
++ (VTCompressionSessionRef)createCompressionSessionWithVideoSettings:(NSDictionary *)videoSettings
+                                                      outputCallback:(VTCompressionOutputCallback)outputCallback
+                                                              refcon:(void *)refcon
+{
+    int32_t width = [videoSettings[AVVideoWidthKey] intValue];
+    int32_t height = [videoSettings[AVVideoHeightKey] intValue];
+    if (width <= 0 || height <= 0)
+        return NULL;
+
+    VTCompressionSessionRef compressionSession = NULL;
+    OSStatus status = VTCompressionSessionCreate(kCFAllocatorDefault, width, height, kCMVideoCodecType_H264,
+                                                 NULL, NULL, NULL, outputCallback, refcon, &compressionSession);
+    if (status != noErr)
+        return NULL;
+
+    VTSessionSetProperty(compressionSession, kVTCompressionPropertyKey_RealTime, kCFBooleanTrue);
+    VTSessionSetProperty(compressionSession, kVTCompressionPropertyKey_AllowFrameReordering, kCFBooleanFalse);
+    VTSessionSetProperty(compressionSession, kVTCompressionPropertyKey_ProfileLevel, kVTProfileLevel_H264_High_AutoLevel);
+
+    NSDictionary *compressionProperties = videoSettings[AVVideoCompressionPropertiesKey];
+    NSNumber *bitRate = compressionProperties[AVVideoAverageBitRateKey];
+    if (bitRate) {
+        VTSessionSetProperty(compressionSession, kVTCompressionPropertyKey_AverageBitRate, (__bridge CFTypeRef)bitRate);
+    }
+    NSNumber *keyFrameInterval = compressionProperties[AVVideoMaxKeyFrameIntervalKey];
+    if (keyFrameInterval) {
+        VTSessionSetProperty(compressionSession, kVTCompressionPropertyKey_MaxKeyFrameInterval, (__bridge CFTypeRef)keyFrameInterval);
+    }
+    NSNumber *frameRate = compressionProperties[AVVideoExpectedSourceFrameRateKey];
+    if (frameRate) {
+        VTSessionSetProperty(compressionSession, kVTCompressionPropertyKey_ExpectedFrameRate, (__bridge CFTypeRef)frameRate);
+    }
+
+    if (VTCompressionSessionPrepareToEncodeFrames(compressionSession) != noErr) {
+        VTCompressionSessionInvalidate(compressionSession);
+        CFRelease(compressionSession);
+        return NULL;
+    }
+    return compressionSession;
+}
+
 #pragma mark - memory
 
 + (uint64_t)availableStorageSpaceInBytes
@@ -0,0 +1,98 @@
+//
+//  PBJAudioMeterBenchmark.c
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#include "PBJAudioMeter.h"
+#include "PBJTestSupport.h"
+
+// metering throughput in samples per second for each path this machine runs, over 1024 frame
+// buffers as capture delivers them, levels alone and with eight bands
+
+static const char *PBJAudioMeterBenchmarkLevelName(PBJSIMDLevel level)
+{
+    switch (level) {
+        case PBJSIMDLevelScalar: return "scalar";
+        case PBJSIMDLevelSSE2: return "sse2";
+        case PBJSIMDLevelAVX2: return "avx2";
+        case PBJSIMDLevelNEON: return "neon";
+        default: return "auto";
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int quick = PBJTestIsQuick(argc, argv);
+    static const PBJSIMDLevel levels[] = { PBJSIMDLevelScalar, PBJSIMDLevelSSE2, PBJSIMDLevelNEON };
+    static const uint32_t channelCounts[] = { 1, 2 };
+    static const uint32_t bandCounts[] = { 0, 8 };
+    uint64_t budget = quick ? 20000000ull : 500000000ull;
+    size_t frames = 1024;
+
+    int16_t *int16Samples = (int16_t *)malloc(frames * 2 * sizeof(int16_t));
+    float *floatSamples = (float *)malloc(frames * 2 * sizeof(float));
+    PBJTestCheck(int16Samples != NULL && floatSamples != NULL);
+    PBJTestRandom random = PBJTestRandomMake(3);
+    for (size_t i = 0; i < frames * 2; i++) {
+        int16Samples[i] = (int16_t)PBJTestRandomBetween(&random, -20000, 20000);
+        floatSamples[i] = (float)int16Samples[i] / 32768.0f;
+    }
+
+    printf("%-6s %-9s %-6s %-7s %12s %14s\n", "format", "channels", "bands", "path", "Msamples/s", "us/buffer");
+    for (int format = PBJAudioSampleFormatInt16; format <= PBJAudioSampleFormatFloat32; format++) {
+        const void *samples = format == PBJAudioSampleFormatInt16 ? (const void *)int16Samples : (const void *)floatSamples;
+        for (size_t c = 0; c < sizeof(channelCounts) / sizeof(channelCounts[0]); c++) {
+            for (size_t b = 0; b < sizeof(bandCounts) / sizeof(bandCounts[0]); b++) {
+                for (size_t l = 0; l < sizeof(levels) / sizeof(levels[0]); l++) {
+                    if (PBJSIMDLevelResolve(levels[l]) != levels[l])
+                        continue;
+                    PBJAudioMeterConfiguration configuration = PBJAudioMeterDefaultConfiguration(48000.0, channelCounts[c]);
+                    configuration.bandCount = bandCounts[b];
+                    PBJAudioMeter *meter = PBJAudioMeterCreate(&configuration);
+                    PBJTestCheck(meter != NULL);
+
+                    PBJAudioLevels result;
+                    uint64_t buffers = 0;
+                    uint64_t start = PBJTestNow();
+                    uint64_t elapsed = 0;
+                    do {
+                        PBJAudioMeterProcess(meter, samples, frames, (PBJAudioSampleFormat)format, levels[l]);
+                        // read at roughly the rate a level display would
+                        if (++buffers % 4 == 0)
+                            PBJAudioMeterRead(meter, &result);
+                        elapsed = PBJTestNow() - start;
+                    } while (elapsed < budget);
+                    double seconds = (double)elapsed / 1e9;
+                    double samplesMetered = (double)buffers * (double)(frames * channelCounts[c]);
+                    printf("%-6s %-9u %-6u %-7s %12.1f %14.2f\n", format == PBJAudioSampleFormatInt16 ? "int16" : "float",
+                           channelCounts[c], bandCounts[b], PBJAudioMeterBenchmarkLevelName(levels[l]),
+                           samplesMetered / seconds / 1e6, seconds * 1e6 / (double)buffers);
+                    PBJAudioMeterDestroy(meter);
+                }
+            }
+        }
+    }
+    free(int16Samples);
+    free(floatSamples);
+    return 0;
+}
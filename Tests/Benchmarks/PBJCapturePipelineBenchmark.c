@@ -0,0 +1,156 @@
+//
+//  PBJCapturePipelineBenchmark.c
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#include "PBJCapturePipeline.h"
+#include "PBJSyntheticCaptureSource.h"
+#include "PBJTestSupport.h"
+
+// the capture pipeline fed by the synthetic source with jitter, a pause, an interruption and a
+// stall, writing each frame into a staging buffer as the hand-off to the encoder would. every
+// item is timed for real and replayed against the source's arrival clock, so frames/s, p99
+// end-to-end latency and drops are what a device that fast would see in real time, items/s is
+// how many samples the pipeline gets through when nothing waits on the clock
+
+typedef struct {
+    uint8_t *staging;
+    size_t stagingSize;
+    uint64_t checksum;
+} PBJCapturePipelineBenchmarkSink;
+
+static int PBJCapturePipelineBenchmarkWrite(void *context, const PBJCaptureSample *sample, PBJTime rebasedPresentationTimestamp)
+{
+    PBJCapturePipelineBenchmarkSink *sink = (PBJCapturePipelineBenchmarkSink *)context;
+    if (sample->track == PBJCaptureTrackVideo) {
+        const PBJNV12Image *frame = (const PBJNV12Image *)sample->payload;
+        uint8_t *destination = sink->staging;
+        for (size_t y = 0; y < frame->height; y++, destination += frame->width)
+            memcpy(destination, frame->luma + y * frame->lumaBytesPerRow, frame->width);
+        for (size_t y = 0; y < PBJNV12ChromaHeight(frame); y++, destination += frame->width)
+            memcpy(destination, frame->chroma + y * frame->chromaBytesPerRow, frame->width);
+        sink->checksum += sink->staging[(size_t)rebasedPresentationTimestamp.value % sink->stagingSize];
+    } else {
+        const PBJSyntheticAudioBuffer *audio = (const PBJSyntheticAudioBuffer *)sample->payload;
+        memcpy(sink->staging, audio->samples, audio->frameCount * (size_t)audio->channels * sizeof(int16_t));
+    }
+    return 1;
+}
+
+typedef struct {
+    const char *name;
+    size_t width;
+    size_t height;
+} PBJCapturePipelineBenchmarkSize;
+
+int main(int argc, char **argv)
+{
+    int quick = PBJTestIsQuick(argc, argv);
+    static const PBJCapturePipelineBenchmarkSize sizes[] = { { "720p", 1280, 720 }, { "1080p", 1920, 1080 }, { "4K", 3840, 2160 } };
+    static const int32_t frameRates[] = { 30, 60, 240 };
+    const int64_t second = 1000000000ll;
+    int64_t duration = (quick ? 2 : 20) * second;
+
+    printf("%-6s %4s %10s %10s %12s %12s %8s %8s\n", "size", "fps", "frames/s", "items/s", "p50 latency", "p99 latency", "dropped", "late");
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        for (size_t r = 0; r < sizeof(frameRates) / sizeof(frameRates[0]); r++) {
+            PBJSyntheticCaptureSourceConfiguration configuration = PBJSyntheticCaptureSourceDefaultConfiguration(sizes[s].width, sizes[s].height, frameRates[r]);
+            configuration.duration = duration;
+            configuration.jitter = 2000000;
+            configuration.seed = (uint32_t)(s * 3 + r + 1);
+            PBJSyntheticCaptureEvent events[] = {
+                { PBJSyntheticCaptureEventPause, duration / 4, 0 },
+                { PBJSyntheticCaptureEventResume, duration / 4 + duration / 10, 0 },
+                { PBJSyntheticCaptureEventInterrupt, duration / 2, 300000000 },
+                { PBJSyntheticCaptureEventStall, duration * 3 / 4, 100000000 },
+            };
+            PBJSyntheticCaptureSource *source = PBJSyntheticCaptureSourceCreate(&configuration, events, sizeof(events) / sizeof(events[0]));
+            PBJTestCheck(source != NULL);
+
+            PBJCapturePipelineBenchmarkSink sinkState;
+            sinkState.stagingSize = sizes[s].width * sizes[s].height * 3 / 2;
+            sinkState.staging = (uint8_t *)malloc(sinkState.stagingSize);
+            sinkState.checksum = 0;
+            PBJTestCheck(sinkState.staging != NULL);
+            PBJCapturePipelineSink sink;
+            memset(&sink, 0, sizeof(sink));
+            sink.context = &sinkState;
+            sink.writeSample = PBJCapturePipelineBenchmarkWrite;
+            PBJCapturePipeline *pipeline = PBJCapturePipelineCreate(sink);
+            PBJTestCheck(pipeline != NULL);
+            PBJCapturePipelineStart(pipeline);
+
+            size_t latencyCapacity = (size_t)(duration / second + 1) * (size_t)frameRates[r];
+            uint64_t *latencies = (uint64_t *)malloc(latencyCapacity * sizeof(uint64_t));
+            PBJTestCheck(latencies != NULL);
+            size_t latencyCount = 0;
+            uint64_t late = 0;
+            uint64_t busyTime = 0;
+            int64_t busyUntil = 0;
+            int64_t frameInterval = second / frameRates[r];
+
+            PBJCaptureSourceItem item;
+            while (PBJSyntheticCaptureSourceNextItem(source, &item)) {
+                int isVideo = item.type == PBJCaptureSourceItemSample && item.sample.track == PBJCaptureTrackVideo;
+                // the capture output discards a frame that arrives while the previous one is still
+                // being processed, as alwaysDiscardsLateVideoFrames does
+                if (isVideo && busyUntil > item.arrivalTime + frameInterval) {
+                    late++;
+                    continue;
+                }
+                PBJCapturePipelineSampleResult result = PBJCapturePipelineSampleResultCount;
+                uint64_t start = PBJTestNow();
+                PBJCapturePipelineProcessSourceItem(pipeline, &item, &result);
+                uint64_t cost = PBJTestNow() - start;
+                busyTime += cost;
+                int64_t begin = busyUntil > item.arrivalTime ? busyUntil : item.arrivalTime;
+                busyUntil = begin + (int64_t)cost;
+                if (isVideo && result == PBJCapturePipelineSampleWritten && latencyCount < latencyCapacity) {
+                    int64_t presentation = item.sample.presentationTimestamp.value;
+                    latencies[latencyCount++] = (uint64_t)(busyUntil - presentation);
+                }
+                if (item.type == PBJCaptureSourceItemEnd)
+                    break;
+            }
+
+            uint64_t written = PBJCapturePipelineGetSampleCount(pipeline, PBJCaptureTrackVideo, PBJCapturePipelineSampleWritten);
+            PBJSyntheticCaptureSourceCounters counters = PBJSyntheticCaptureSourceGetCounters(source);
+            uint64_t dropped = counters.videoFramesDiscarded + late +
+                               PBJCapturePipelineGetSampleCount(pipeline, PBJCaptureTrackVideo, PBJCapturePipelineSampleDroppedTimeline) +
+                               PBJCapturePipelineGetSampleCount(pipeline, PBJCaptureTrackVideo, PBJCapturePipelineSampleDroppedWriteFailed);
+            double recordedSeconds = PBJTimeGetSeconds(PBJCaptureTimelineCapturedDuration(PBJCapturePipelineGetTimeline(pipeline)));
+            uint64_t p50 = PBJTestPercentile(latencies, latencyCount, 50.0);
+            uint64_t p99 = PBJTestPercentile(latencies, latencyCount, 99.0);
+            printf("%-6s %4d %10.1f %10.1f %10.2fms %10.2fms %8llu %8llu\n", sizes[s].name, frameRates[r],
+                   recordedSeconds > 0.0 ? (double)written / recordedSeconds : 0.0,
+                   busyTime ? (double)(counters.videoFrames + counters.audioBuffers) * 1e9 / (double)busyTime : 0.0,
+                   (double)p50 / 1e6, (double)p99 / 1e6, (unsigned long long)dropped, (unsigned long long)late);
+
+            free(latencies);
+            free(sinkState.staging);
+            PBJCapturePipelineDestroy(pipeline);
+            PBJSyntheticCaptureSourceDestroy(source);
+        }
+    }
+    return 0;
+}
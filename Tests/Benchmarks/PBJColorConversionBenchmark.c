@@ -0,0 +1,87 @@
+//
+//  PBJColorConversionBenchmark.c
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#include "PBJColorConversion.h"
+#include "PBJTestSupport.h"
+
+// NV12 to BGRA throughput in megapixels per second for each path this machine runs
+
+typedef struct {
+    const char *name;
+    size_t width;
+    size_t height;
+} PBJColorConversionBenchmarkSize;
+
+static const char *PBJColorConversionBenchmarkLevelName(PBJSIMDLevel level)
+{
+    switch (level) {
+        case PBJSIMDLevelScalar: return "scalar";
+        case PBJSIMDLevelSSE2: return "sse2";
+        case PBJSIMDLevelAVX2: return "avx2";
+        case PBJSIMDLevelNEON: return "neon";
+        default: return "auto";
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int quick = PBJTestIsQuick(argc, argv);
+    static const PBJColorConversionBenchmarkSize sizes[] = {
+        { "720p", 1280, 720 }, { "1080p", 1920, 1080 }, { "4K", 3840, 2160 }
+    };
+    static const PBJSIMDLevel levels[] = { PBJSIMDLevelScalar, PBJSIMDLevelSSE2, PBJSIMDLevelAVX2, PBJSIMDLevelNEON };
+    uint64_t budget = quick ? 20000000ull : 1000000000ull;
+
+    printf("%-6s %-7s %10s %10s\n", "size", "path", "MP/s", "ms/frame");
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        PBJTestFrame frame = PBJTestFrameCreate(sizes[s].width, sizes[s].height, PBJYCbCrRangeVideo);
+        PBJTestFrameFillScene(&frame);
+        size_t bytesPerRow = sizes[s].width * 4;
+        uint8_t *rgb = (uint8_t *)malloc(bytesPerRow * sizes[s].height);
+        PBJTestCheck(rgb != NULL);
+
+        for (size_t l = 0; l < sizeof(levels) / sizeof(levels[0]); l++) {
+            if (PBJSIMDLevelResolve(levels[l]) != levels[l])
+                continue;
+            // one untimed pass to fault the destination in
+            PBJColorConvertNV12ToRGBRows(&frame.image, rgb, bytesPerRow, PBJRGBOrderBGRA, 0, sizes[s].height, levels[l]);
+            uint64_t frames = 0;
+            uint64_t start = PBJTestNow();
+            uint64_t elapsed = 0;
+            do {
+                PBJColorConvertNV12ToRGBRows(&frame.image, rgb, bytesPerRow, PBJRGBOrderBGRA, 0, sizes[s].height, levels[l]);
+                frames++;
+                elapsed = PBJTestNow() - start;
+            } while (elapsed < budget);
+            double seconds = (double)elapsed / 1e9;
+            double megapixels = (double)(sizes[s].width * sizes[s].height) * (double)frames / 1e6;
+            printf("%-6s %-7s %10.1f %10.3f\n", sizes[s].name, PBJColorConversionBenchmarkLevelName(levels[l]),
+                   megapixels / seconds, seconds * 1e3 / (double)frames);
+        }
+        free(rgb);
+        PBJTestFrameDestroy(&frame);
+    }
+    return 0;
+}
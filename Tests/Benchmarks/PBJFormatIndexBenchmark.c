@@ -0,0 +1,130 @@
+//
+//  PBJFormatIndexBenchmark.c
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#include "PBJFormatIndex.h"
+#include "PBJSyntheticFormatTable.h"
+#include "PBJTestSupport.h"
+
+// cost of building the index for a device's table and of a query against it, next to the
+// linear scan over every format and range it replaced, for tables of growing size
+
+#define PBJ_FORMAT_INDEX_BENCHMARK_CAPACITY 4096
+#define PBJ_FORMAT_INDEX_BENCHMARK_QUERIES 1024
+
+static PBJFormatDescriptor PBJFormatIndexBenchmarkDescriptors[PBJ_FORMAT_INDEX_BENCHMARK_CAPACITY];
+
+// the first match in list order that covers the rate and dimensions with the smallest area,
+// what a walk over device.formats does
+static const PBJFormatDescriptor *PBJFormatIndexBenchmarkScan(const PBJFormatDescriptor *descriptors, size_t count, const PBJFormatQuery *query)
+{
+    const PBJFormatDescriptor *best = NULL;
+    for (size_t i = 0; i < count; i++) {
+        const PBJFormatDescriptor *descriptor = &descriptors[i];
+        if (descriptor->minFrameRate > query->frameRate || query->frameRate > descriptor->maxFrameRate)
+            continue;
+        if (descriptor->width < query->minimumWidth || descriptor->height < query->minimumHeight)
+            continue;
+        if (query->pixelFormat && descriptor->pixelFormat != query->pixelFormat)
+            continue;
+        if (descriptor->binned && !query->allowBinned)
+            continue;
+        if (!best || (int64_t)descriptor->width * descriptor->height < (int64_t)best->width * best->height)
+            best = descriptor;
+    }
+    return best;
+}
+
+int main(int argc, char **argv)
+{
+    int quick = PBJTestIsQuick(argc, argv);
+    static const uint32_t scales[] = { 1, 4, 16, 64 };
+    static const double rates[] = { 24.0, 30.0, 60.0, 120.0, 240.0 };
+    uint64_t budget = quick ? 10000000ull : 300000000ull;
+
+    PBJFormatQuery queries[PBJ_FORMAT_INDEX_BENCHMARK_QUERIES];
+    printf("%-7s %10s %12s %12s %12s\n", "ranges", "build us", "find ns", "scan ns", "max rate ns");
+    for (size_t s = 0; s < sizeof(scales) / sizeof(scales[0]); s++) {
+        PBJFormatDescriptor *descriptors = PBJFormatIndexBenchmarkDescriptors;
+        size_t count = PBJSyntheticFormatTableFill(descriptors, PBJ_FORMAT_INDEX_BENCHMARK_CAPACITY, scales[s], s);
+
+        PBJTestRandom random = PBJTestRandomMake(s + 1);
+        for (size_t q = 0; q < PBJ_FORMAT_INDEX_BENCHMARK_QUERIES; q++) {
+            const PBJFormatDescriptor *sample = &descriptors[PBJTestRandomBelow(&random, count)];
+            queries[q] = PBJFormatQueryMake(rates[PBJTestRandomBelow(&random, 5)], PBJFormatSelectionSmallest);
+            queries[q].minimumWidth = sample->width;
+            queries[q].minimumHeight = sample->height;
+            queries[q].allowBinned = (int)PBJTestRandomBelow(&random, 2);
+        }
+
+        uint64_t builds = 0;
+        uint64_t start = PBJTestNow();
+        uint64_t elapsed = 0;
+        do {
+            PBJFormatIndex *index = PBJFormatIndexCreate(descriptors, count);
+            PBJTestCheck(index != NULL);
+            PBJFormatIndexDestroy(index);
+            builds++;
+            elapsed = PBJTestNow() - start;
+        } while (elapsed < budget);
+        double buildMicroseconds = (double)elapsed / 1e3 / (double)builds;
+
+        PBJFormatIndex *index = PBJFormatIndexCreate(descriptors, count);
+        uintptr_t sink = 0;
+        uint64_t finds = 0;
+        start = PBJTestNow();
+        do {
+            for (size_t q = 0; q < PBJ_FORMAT_INDEX_BENCHMARK_QUERIES; q++)
+                sink += (uintptr_t)PBJFormatIndexFind(index, &queries[q]);
+            finds += PBJ_FORMAT_INDEX_BENCHMARK_QUERIES;
+            elapsed = PBJTestNow() - start;
+        } while (elapsed < budget);
+        double findNanoseconds = (double)elapsed / (double)finds;
+
+        uint64_t scans = 0;
+        start = PBJTestNow();
+        do {
+            for (size_t q = 0; q < PBJ_FORMAT_INDEX_BENCHMARK_QUERIES; q++)
+                sink += (uintptr_t)PBJFormatIndexBenchmarkScan(descriptors, count, &queries[q]);
+            scans += PBJ_FORMAT_INDEX_BENCHMARK_QUERIES;
+            elapsed = PBJTestNow() - start;
+        } while (elapsed < budget);
+        double scanNanoseconds = (double)elapsed / (double)scans;
+
+        uint64_t maximums = 0;
+        start = PBJTestNow();
+        do {
+            for (size_t q = 0; q < PBJ_FORMAT_INDEX_BENCHMARK_QUERIES; q++)
+                sink += (uintptr_t)PBJFormatIndexGetMaximumFrameRate(index, queries[q].minimumWidth, queries[q].minimumHeight);
+            maximums += PBJ_FORMAT_INDEX_BENCHMARK_QUERIES;
+            elapsed = PBJTestNow() - start;
+        } while (elapsed < budget);
+        double maximumNanoseconds = (double)elapsed / (double)maximums;
+        PBJFormatIndexDestroy(index);
+
+        printf("%-7zu %10.2f %12.1f %12.1f %12.1f\n", count, buildMicroseconds, findNanoseconds, scanNanoseconds, maximumNanoseconds);
+        PBJTestCheck(sink != 1);
+    }
+    return 0;
+}
@@ -0,0 +1,114 @@
+//
+//  PBJFragmentedMP4MuxerBenchmark.c
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#include "PBJFragmentedMP4Muxer.h"
+#include "PBJOutputSink.h"
+#include "PBJTestSupport.h"
+
+#include <unistd.h>
+
+// time to finalize a fragmented recording, the last fragment and the sink's drain and sync, for
+// clips of growing length. a progressive file rewrites its sample tables at the end so its
+// finish grows with the clip, here the muxer's part stays flat, which the memory sink shows.
+// a file sink adds the drain, sync and preallocation release, whatever the filesystem makes of them
+
+static const uint8_t PBJMP4BenchmarkAVCC[] = { 0x01, 0x64, 0x00, 0x28, 0xff, 0xe1, 0x00, 0x04, 0x67, 0x64, 0x00, 0x28, 0x01, 0x00, 0x02, 0x68, 0xee };
+static const uint8_t PBJMP4BenchmarkASC[] = { 0x12, 0x10 };
+
+typedef struct {
+    double appendSeconds;
+    double finishSeconds;
+    uint64_t bytes;
+    uint32_t fragments;
+} PBJMP4BenchmarkResult;
+
+// 1080p30 H.264 with a keyframe every second and 44.1 kHz AAC, appended in decode order
+static PBJMP4BenchmarkResult PBJMP4BenchmarkRecord(PBJOutputSink *sink, double seconds)
+{
+    static uint8_t payload[65536];
+    PBJFragmentedMP4VideoTrack video = { 90000, 1920, 1080, 0, PBJMP4BenchmarkAVCC, sizeof(PBJMP4BenchmarkAVCC) };
+    PBJFragmentedMP4AudioTrack audio = { 44100, 1, 64000, PBJMP4BenchmarkASC, sizeof(PBJMP4BenchmarkASC), 2112 };
+    PBJFragmentedMP4Configuration configuration = { &video, &audio, 2000 };
+    PBJFragmentedMP4Muxer *muxer = PBJFragmentedMP4MuxerCreate(&configuration, PBJOutputSinkWriteFunction, sink);
+    PBJTestCheck(muxer != NULL);
+    memset(payload, 0x5a, sizeof(payload));
+
+    PBJTestRandom random = PBJTestRandomMake(7);
+    int64_t frames = (int64_t)(seconds * 30);
+    int64_t packet = 0;
+    uint64_t start = PBJTestNow();
+    for (int64_t frame = 0; frame < frames; frame++) {
+        int64_t videoTime = frame * 3000;
+        while (packet * 1024 * 90000 <= videoTime * 44100) {
+            size_t size = 300 + PBJTestRandomBelow(&random, 100);
+            PBJTestCheck(PBJFragmentedMP4MuxerAppendSample(muxer, PBJFragmentedMP4TrackAudio, payload, size, packet * 1024, 0, 1024, 1));
+            packet++;
+        }
+        int isSync = frame % 30 == 0;
+        size_t size = isSync ? 60000 : 8000 + PBJTestRandomBelow(&random, 8000);
+        PBJTestCheck(PBJFragmentedMP4MuxerAppendSample(muxer, PBJFragmentedMP4TrackVideo, payload, size, videoTime, 3000, 0, isSync));
+    }
+    uint64_t appended = PBJTestNow();
+    PBJTestCheck(PBJFragmentedMP4MuxerFinish(muxer));
+    PBJTestCheck(PBJOutputSinkFinish(sink));
+    uint64_t finished = PBJTestNow();
+
+    PBJMP4BenchmarkResult result;
+    result.appendSeconds = (double)(appended - start) / 1e9;
+    result.finishSeconds = (double)(finished - appended) / 1e9;
+    result.bytes = PBJFragmentedMP4MuxerGetBytesWritten(muxer);
+    result.fragments = PBJFragmentedMP4MuxerGetFragmentCount(muxer);
+    PBJFragmentedMP4MuxerDestroy(muxer);
+    return result;
+}
+
+int main(int argc, char **argv)
+{
+    int quick = PBJTestIsQuick(argc, argv);
+    static const double lengths[] = { 10.0, 60.0, 600.0 };
+    size_t lengthCount = quick ? 2 : 3;
+    char path[] = "/tmp/PBJFragmentedMP4MuxerBenchmarkXXXXXX";
+    int descriptor = mkstemp(path);
+    PBJTestCheck(descriptor >= 0);
+    close(descriptor);
+
+    printf("%-13s %8s %10s %10s %12s %12s\n", "sink", "clip", "MB", "fragments", "append ms", "finish ms");
+    static const char *sinks[] = { "memory", "file", "file/fragment" };
+    for (int kind = 0; kind < 3; kind++) {
+        for (size_t i = 0; i < lengthCount; i++) {
+            PBJOutputSinkConfiguration configuration = PBJOutputSinkDefaultConfiguration();
+            if (kind == 2)
+                configuration.durability = PBJOutputSinkDurabilityFragment;
+            PBJOutputSink *sink = kind ? PBJOutputSinkCreateFile(path, &configuration) : PBJOutputSinkCreateMemory();
+            PBJTestCheck(sink != NULL);
+            PBJMP4BenchmarkResult result = PBJMP4BenchmarkRecord(sink, lengths[i]);
+            printf("%-13s %7.0fs %10.1f %10u %12.2f %12.3f\n", sinks[kind], lengths[i], (double)result.bytes / 1e6,
+                   result.fragments, result.appendSeconds * 1e3, result.finishSeconds * 1e3);
+            PBJOutputSinkDestroy(sink);
+        }
+    }
+    unlink(path);
+    return 0;
+}
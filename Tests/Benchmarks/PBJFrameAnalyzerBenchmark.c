@@ -0,0 +1,92 @@
+//
+//  PBJFrameAnalyzerBenchmark.c
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#include "PBJFrameAnalyzer.h"
+#include "PBJTestSupport.h"
+
+// per frame cost of the statistics on the capture queue, 4K at fixed and automatic steps for
+// each path this machine runs, then the automatic step at smaller sizes. percentiles of single
+// frames, since it's the odd slow frame that delays delivery
+
+typedef struct {
+    const char *name;
+    size_t width;
+    size_t height;
+    size_t step;
+} PBJFrameAnalyzerBenchmarkCase;
+
+static const char *PBJFrameAnalyzerBenchmarkLevelName(PBJSIMDLevel level)
+{
+    switch (level) {
+        case PBJSIMDLevelScalar: return "scalar";
+        case PBJSIMDLevelSSE2: return "sse2";
+        case PBJSIMDLevelAVX2: return "avx2";
+        case PBJSIMDLevelNEON: return "neon";
+        default: return "auto";
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int quick = PBJTestIsQuick(argc, argv);
+    static const PBJFrameAnalyzerBenchmarkCase cases[] = {
+        { "4K", 3840, 2160, 1 }, { "4K", 3840, 2160, 4 }, { "4K", 3840, 2160, 8 }, { "4K", 3840, 2160, 0 },
+        { "1080p", 1920, 1080, 0 }, { "720p", 1280, 720, 0 }
+    };
+    static const PBJSIMDLevel levels[] = { PBJSIMDLevelScalar, PBJSIMDLevelSSE2, PBJSIMDLevelAVX2, PBJSIMDLevelNEON };
+    size_t frameCount = quick ? 8 : 500;
+
+    uint64_t *times = (uint64_t *)malloc(frameCount * sizeof(uint64_t));
+    PBJTestCheck(times != NULL);
+    printf("%-6s %-5s %-7s %10s %10s %10s\n", "size", "step", "path", "p50 ms", "p90 ms", "max ms");
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        PBJTestFrame frame = PBJTestFrameCreate(cases[c].width, cases[c].height, PBJYCbCrRangeVideo);
+        PBJTestFrameFillScene(&frame);
+        for (size_t l = 0; l < sizeof(levels) / sizeof(levels[0]); l++) {
+            if (PBJSIMDLevelResolve(levels[l]) != levels[l])
+                continue;
+            PBJFrameAnalyzerConfiguration configuration = { cases[c].step, levels[l] };
+            PBJFrameAnalyzer *analyzer = PBJFrameAnalyzerCreate(&configuration);
+            PBJTestCheck(analyzer != NULL);
+            PBJFrameStatistics statistics;
+            // the first frame builds the grid columns for this width
+            PBJTestCheck(PBJFrameAnalyzerAnalyze(analyzer, &frame.image, &statistics));
+            for (size_t i = 0; i < frameCount; i++) {
+                uint64_t start = PBJTestNow();
+                PBJFrameAnalyzerAnalyze(analyzer, &frame.image, &statistics);
+                times[i] = PBJTestNow() - start;
+            }
+            char step[16];
+            snprintf(step, sizeof(step), cases[c].step ? "%zu" : "auto", cases[c].step);
+            printf("%-6s %-5s %-7s %10.3f %10.3f %10.3f\n", cases[c].name, step, PBJFrameAnalyzerBenchmarkLevelName(levels[l]),
+                   (double)PBJTestPercentile(times, frameCount, 50.0) / 1e6, (double)PBJTestPercentile(times, frameCount, 90.0) / 1e6,
+                   (double)PBJTestPercentile(times, frameCount, 100.0) / 1e6);
+            PBJFrameAnalyzerDestroy(analyzer);
+        }
+        PBJTestFrameDestroy(&frame);
+    }
+    free(times);
+    return 0;
+}
@@ -0,0 +1,117 @@
+//
+//  PBJFrameOrientationBenchmark.c
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#include "PBJFrameOrientation.h"
+#include "PBJTestSupport.h"
+
+// milliseconds per NV12 frame for each orientation and path this machine runs, per capture
+// resolution, next to a plain copy of both planes as the floor a transpose can't beat
+
+typedef struct {
+    const char *name;
+    size_t width;
+    size_t height;
+} PBJFrameOrientationBenchmarkSize;
+
+static const char *PBJFrameOrientationBenchmarkLevelName(PBJSIMDLevel level)
+{
+    switch (level) {
+        case PBJSIMDLevelScalar: return "scalar";
+        case PBJSIMDLevelSSE2: return "sse2";
+        case PBJSIMDLevelNEON: return "neon";
+        default: return "auto";
+    }
+}
+
+static const char *PBJFrameOrientationBenchmarkName(PBJFrameOrientation orientation)
+{
+    static const char *names[] = { "up", "right", "down", "left", "up mirrored", "right mirrored", "down mirrored", "left mirrored" };
+    return names[orientation];
+}
+
+static void PBJFrameOrientationBenchmarkCopy(const PBJNV12Image *source, PBJNV12Image *destination)
+{
+    for (size_t y = 0; y < source->height; y++)
+        memcpy(destination->luma + y * destination->lumaBytesPerRow, source->luma + y * source->lumaBytesPerRow, source->width);
+    for (size_t y = 0; y < PBJNV12ChromaHeight(source); y++)
+        memcpy(destination->chroma + y * destination->chromaBytesPerRow, source->chroma + y * source->chromaBytesPerRow, PBJNV12ChromaWidth(source) * 2);
+}
+
+int main(int argc, char **argv)
+{
+    int quick = PBJTestIsQuick(argc, argv);
+    static const PBJFrameOrientationBenchmarkSize sizes[] = {
+        { "480p", 640, 480 }, { "720p", 1280, 720 }, { "1080p", 1920, 1080 }, { "4K", 3840, 2160 }
+    };
+    // avx2 dispatches to the sse2 blocks, so it has no row of its own
+    static const PBJSIMDLevel levels[] = { PBJSIMDLevelScalar, PBJSIMDLevelSSE2, PBJSIMDLevelNEON };
+    uint64_t budget = quick ? 5000000ull : 300000000ull;
+
+    printf("%-6s %-15s %-7s %10s %10s\n", "size", "orientation", "path", "ms/frame", "MP/s");
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        PBJTestFrame source = PBJTestFrameCreate(sizes[s].width, sizes[s].height, PBJYCbCrRangeVideo);
+        PBJTestFrameFillScene(&source);
+        // swapped dimensions get their own destination, as capture keeps a pool per output size
+        PBJTestFrame upright = PBJTestFrameCreate(sizes[s].width, sizes[s].height, PBJYCbCrRangeVideo);
+        PBJTestFrame sideways = PBJTestFrameCreate(sizes[s].height, sizes[s].width, PBJYCbCrRangeVideo);
+        double megapixels = (double)(sizes[s].width * sizes[s].height) / 1e6;
+
+        PBJFrameOrientationBenchmarkCopy(&source.image, &upright.image);
+        uint64_t frames = 0;
+        uint64_t start = PBJTestNow();
+        uint64_t elapsed = 0;
+        do {
+            PBJFrameOrientationBenchmarkCopy(&source.image, &upright.image);
+            frames++;
+            elapsed = PBJTestNow() - start;
+        } while (elapsed < budget);
+        double milliseconds = (double)elapsed / 1e6 / (double)frames;
+        printf("%-6s %-15s %-7s %10.3f %10.1f\n", sizes[s].name, "copy", "memcpy", milliseconds, megapixels / milliseconds * 1e3);
+
+        for (int orientation = PBJFrameOrientationUp; orientation <= PBJFrameOrientationLeftMirrored; orientation++) {
+            PBJTestFrame *destination = PBJFrameOrientationSwapsDimensions((PBJFrameOrientation)orientation) ? &sideways : &upright;
+            for (size_t l = 0; l < sizeof(levels) / sizeof(levels[0]); l++) {
+                if (PBJSIMDLevelResolve(levels[l]) != levels[l])
+                    continue;
+                // one untimed pass to fault the destination in
+                PBJFrameOrientRows(&source.image, &destination->image, (PBJFrameOrientation)orientation, 0, destination->image.height, levels[l]);
+                frames = 0;
+                start = PBJTestNow();
+                do {
+                    PBJFrameOrientRows(&source.image, &destination->image, (PBJFrameOrientation)orientation, 0, destination->image.height, levels[l]);
+                    frames++;
+                    elapsed = PBJTestNow() - start;
+                } while (elapsed < budget);
+                milliseconds = (double)elapsed / 1e6 / (double)frames;
+                printf("%-6s %-15s %-7s %10.3f %10.1f\n", sizes[s].name, PBJFrameOrientationBenchmarkName((PBJFrameOrientation)orientation),
+                       PBJFrameOrientationBenchmarkLevelName(levels[l]), milliseconds, megapixels / milliseconds * 1e3);
+            }
+        }
+        PBJTestFrameDestroy(&sideways);
+        PBJTestFrameDestroy(&upright);
+        PBJTestFrameDestroy(&source);
+    }
+    return 0;
+}
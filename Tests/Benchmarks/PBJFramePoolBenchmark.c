@@ -0,0 +1,131 @@
+//
+//  PBJFramePoolBenchmark.c
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#include "PBJFramePool.h"
+#include "PBJTestSupport.h"
+
+#include <sys/resource.h>
+#if defined(__GLIBC__)
+#   include <malloc.h>
+#endif
+
+// a photo's BGRA conversion target written in full each frame, from a fresh malloc and from a
+// warm pool, with the page faults each costs. allocators hand frame sized blocks back to the
+// system on free, so each malloc faults its pages in again, that's the cost the pool saves on a
+// device. glibc can be held to either behaviour, the second pass keeps freed blocks in its heap
+// for the best case malloc can do
+
+static long PBJFramePoolBenchmarkFaults(void)
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_minflt;
+}
+
+typedef struct {
+    double milliseconds;
+    double framesPerSecond;
+    double faults;
+} PBJFramePoolBenchmarkResult;
+
+static PBJFramePoolBenchmarkResult PBJFramePoolBenchmarkRun(size_t width, size_t height, int pooled, uint64_t budget)
+{
+    PBJFramePool *pool = NULL;
+    if (pooled) {
+        pool = PBJFramePoolCreate(NULL);
+        PBJTestCheck(pool != NULL);
+        PBJFrameBuffer *buffer = PBJFramePoolAcquire(pool, PBJFrameFormatBGRA, width, height);
+        PBJTestCheck(buffer != NULL);
+        memset(PBJFrameBufferGetPlane(buffer, 0), 0, PBJFrameBufferGetPlaneSize(buffer, 0));
+        PBJFrameBufferRelease(buffer);
+    }
+    size_t bytes = width * 4 * height;
+    uint64_t frames = 0;
+    long faults = PBJFramePoolBenchmarkFaults();
+    uint64_t start = PBJTestNow();
+    uint64_t elapsed;
+    do {
+        if (pooled) {
+            PBJFrameBuffer *buffer = PBJFramePoolAcquire(pool, PBJFrameFormatBGRA, width, height);
+            PBJTestCheck(buffer != NULL);
+            memset(PBJFrameBufferGetPlane(buffer, 0), (int)frames, PBJFrameBufferGetPlaneSize(buffer, 0));
+            PBJFrameBufferRelease(buffer);
+        } else {
+            uint8_t *pixels = (uint8_t *)malloc(bytes);
+            PBJTestCheck(pixels != NULL);
+            memset(pixels, (int)frames, bytes);
+            __asm__ volatile("" : : "r"(pixels) : "memory");
+            free(pixels);
+        }
+        frames++;
+        elapsed = PBJTestNow() - start;
+    } while (elapsed < budget);
+
+    PBJFramePoolBenchmarkResult result;
+    result.milliseconds = (double)elapsed / 1e6 / (double)frames;
+    result.framesPerSecond = (double)frames * 1e9 / (double)elapsed;
+    result.faults = (double)(PBJFramePoolBenchmarkFaults() - faults) / (double)frames;
+    if (pooled) {
+        // one miss, the rest recycled
+        PBJTestCheck(PBJFramePoolGetStatistics(pool).misses == 1);
+        PBJFramePoolDestroy(pool);
+    }
+    return result;
+}
+
+int main(int argc, char **argv)
+{
+    int quick = PBJTestIsQuick(argc, argv);
+    uint64_t budget = quick ? 20000000 : 1000000000;
+    static const struct {
+        size_t width;
+        size_t height;
+    } sizes[] = { { 3840, 2160 }, { 1920, 1080 }, { 240, 135 } };
+#if defined(__GLIBC__)
+    int allocators = 2;
+#else
+    int allocators = 1;
+#endif
+
+    printf("%-14s %-10s %-6s %10s %10s %12s\n", "allocator", "frame", "source", "ms/frame", "frames/s", "faults/frame");
+    for (int allocator = 0; allocator < allocators; allocator++) {
+#if defined(__GLIBC__)
+        // set ahead of any large block, a heap that has grown serves them whatever the threshold
+        mallopt(M_MMAP_THRESHOLD, allocator == 0 ? 128 * 1024 : 32 * 1024 * 1024);
+        mallopt(M_TRIM_THRESHOLD, allocator == 0 ? 128 * 1024 : 256 * 1024 * 1024);
+#endif
+        const char *name = allocator == 0 ? "unmap on free" : "reuse";
+        for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+            char frame[16];
+            snprintf(frame, sizeof(frame), "%zux%zu", sizes[s].width, sizes[s].height);
+            for (int pooled = 0; pooled < 2; pooled++) {
+                PBJFramePoolBenchmarkResult result = PBJFramePoolBenchmarkRun(sizes[s].width, sizes[s].height, pooled, budget);
+                printf("%-14s %-10s %-6s %10.3f %10.0f %12.1f\n", name, frame, pooled ? "pool" : "malloc",
+                       result.milliseconds, result.framesPerSecond, result.faults);
+            }
+        }
+    }
+    return 0;
+}
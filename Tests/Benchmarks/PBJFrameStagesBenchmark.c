@@ -0,0 +1,156 @@
+//
+//  PBJFrameStagesBenchmark.c
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#include "PBJFrameProcessor.h"
+#include "PBJFrameStages.h"
+#include "PBJTestSupport.h"
+
+// the reference stages over synthetic NV12 frames, each alone and chained, with the in-place
+// stages fused into one pass against the same chain run a stage per pass, at a few frame
+// sizes and worker counts
+
+typedef struct {
+    const char *name;
+    size_t width;
+    size_t height;
+} PBJFrameStagesBenchmarkSize;
+
+typedef struct {
+    PBJFrameOverlay overlay;
+    PBJFrameOverlay badge;
+    PBJFrameMask mask;
+    PBJFrameDenoise denoise;
+    uint8_t *maskStorage;
+} PBJFrameStagesBenchmarkParameters;
+
+static PBJFrameStagesBenchmarkParameters PBJFrameStagesBenchmarkMakeParameters(size_t width, size_t height)
+{
+    PBJFrameStagesBenchmarkParameters parameters;
+    // a lower third caption bar and a small corner badge
+    parameters.overlay = (PBJFrameOverlay){ 0, (height * 2 / 3) & ~(size_t)1, width, height / 3, 16, 128, 128, 160 };
+    parameters.badge = (PBJFrameOverlay){ 32, 32, width / 8, height / 8, 235, 90, 240, 255 };
+    // a vignette style mask, opaque in the middle and fading to the corners
+    parameters.maskStorage = (uint8_t *)malloc(width * height);
+    PBJTestCheck(parameters.maskStorage != NULL);
+    for (size_t row = 0; row < height; row++) {
+        for (size_t column = 0; column < width; column++) {
+            double dx = ((double)column - (double)width / 2.0) / ((double)width / 2.0);
+            double dy = ((double)row - (double)height / 2.0) / ((double)height / 2.0);
+            double falloff = 1.6 - (dx * dx + dy * dy);
+            parameters.maskStorage[row * width + column] = (uint8_t)(falloff >= 1.0 ? 255 : falloff <= 0.0 ? 0 : falloff * 255.0);
+        }
+    }
+    parameters.mask = (PBJFrameMask){ parameters.maskStorage, width, 16, 128, 128 };
+    parameters.denoise = (PBJFrameDenoise){ 10 };
+    return parameters;
+}
+
+// runs frames until the budget is spent, returns milliseconds per frame
+static double PBJFrameStagesBenchmarkRun(PBJFrameProcessor **processors, size_t processorCount, PBJTestFrame *frame, PBJTestFrame *spare, uint64_t budget)
+{
+    // one untimed frame to fault everything in and start the workers
+    for (size_t p = 0; p < processorCount; p++)
+        PBJFrameProcessorRun(processors[p], &frame->image, &spare->image, 0);
+
+    uint64_t frames = 0;
+    uint64_t start = PBJTestNow();
+    uint64_t elapsed = 0;
+    do {
+        for (size_t p = 0; p < processorCount; p++) {
+            PBJFrameProcessorResult result = PBJFrameProcessorRun(processors[p], &frame->image, &spare->image, 0);
+            // keep feeding the processed frame back in, as capture would hand over the output
+            if (result.outputInSpare) {
+                PBJTestFrame swap = *frame;
+                *frame = *spare;
+                *spare = swap;
+            }
+        }
+        frames++;
+        elapsed = PBJTestNow() - start;
+    } while (elapsed < budget);
+    return (double)elapsed / 1e6 / (double)frames;
+}
+
+int main(int argc, char **argv)
+{
+    int quick = PBJTestIsQuick(argc, argv);
+    static const PBJFrameStagesBenchmarkSize sizes[] = { { "720p", 1280, 720 }, { "1080p", 1920, 1080 }, { "4K", 3840, 2160 } };
+    static const size_t threadCounts[] = { 0, 1, 3 };
+    uint64_t budget = quick ? 20000000ull : 500000000ull;
+    size_t sizeCount = quick ? 2 : 3;
+
+    printf("%-6s %-8s %-22s %10s %10s\n", "size", "workers", "stages", "ms/frame", "MP/s");
+    for (size_t s = 0; s < sizeCount; s++) {
+        PBJTestFrame frame = PBJTestFrameCreate(sizes[s].width, sizes[s].height, PBJYCbCrRangeVideo);
+        PBJTestFrame spare = PBJTestFrameCreate(sizes[s].width, sizes[s].height, PBJYCbCrRangeVideo);
+        PBJTestFrameFillScene(&frame);
+        PBJFrameStagesBenchmarkParameters parameters = PBJFrameStagesBenchmarkMakeParameters(sizes[s].width, sizes[s].height);
+        double megapixels = (double)(sizes[s].width * sizes[s].height) / 1e6;
+
+        const PBJFrameStage stages[] = {
+            PBJFrameStageMakeOverlay(&parameters.overlay),
+            PBJFrameStageMakeMask(&parameters.mask),
+            PBJFrameStageMakeOverlay(&parameters.badge),
+            PBJFrameStageMakeDenoise(&parameters.denoise),
+        };
+        static const char *stageNames[] = { "overlay", "mask", "badge", "denoise" };
+        size_t stageCount = sizeof(stages) / sizeof(stages[0]);
+
+        for (size_t t = 0; t < sizeof(threadCounts) / sizeof(threadCounts[0]); t++) {
+            PBJFrameProcessorConfiguration configuration = PBJFrameProcessorDefaultConfiguration();
+            configuration.threadCount = threadCounts[t];
+            // threadCount 0 means pick for this machine, one worker fewer than it has cores
+            const char *workers = threadCounts[t] == 0 ? "auto" : threadCounts[t] == 1 ? "1" : "3";
+
+            PBJFrameProcessor *single[PBJFrameProcessorMaximumStages];
+            for (size_t i = 0; i < stageCount; i++) {
+                single[i] = PBJFrameProcessorCreate(&configuration);
+                PBJTestCheck(single[i] != NULL && PBJFrameProcessorAddStage(single[i], &stages[i]));
+                double milliseconds = PBJFrameStagesBenchmarkRun(&single[i], 1, &frame, &spare, budget);
+                printf("%-6s %-8s %-22s %10.3f %10.1f\n", sizes[s].name, workers, stageNames[i], milliseconds, megapixels / milliseconds * 1e3);
+            }
+
+            // the whole chain a stage per run, every stage makes its own pass over the frame
+            double separate = PBJFrameStagesBenchmarkRun(single, stageCount, &frame, &spare, budget);
+            printf("%-6s %-8s %-22s %10.3f %10.1f\n", sizes[s].name, workers, "chain, pass per stage", separate, megapixels / separate * 1e3);
+
+            // one processor, the three in-place stages fuse into one pass before the denoise
+            PBJFrameProcessor *chained = PBJFrameProcessorCreate(&configuration);
+            PBJTestCheck(chained != NULL);
+            for (size_t i = 0; i < stageCount; i++)
+                PBJTestCheck(PBJFrameProcessorAddStage(chained, &stages[i]));
+            double fused = PBJFrameStagesBenchmarkRun(&chained, 1, &frame, &spare, budget);
+            printf("%-6s %-8s %-22s %10.3f %10.1f\n", sizes[s].name, workers, "chain, fused", fused, megapixels / fused * 1e3);
+
+            PBJFrameProcessorDestroy(chained);
+            for (size_t i = 0; i < stageCount; i++)
+                PBJFrameProcessorDestroy(single[i]);
+        }
+        free(parameters.maskStorage);
+        PBJTestFrameDestroy(&spare);
+        PBJTestFrameDestroy(&frame);
+    }
+    return 0;
+}
@@ -0,0 +1,108 @@
+//
+//  PBJInstrumentationBenchmark.c
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#include "PBJInstrumentation.h"
+#include "PBJTestSupport.h"
+
+#include <pthread.h>
+
+// what leaving instrumentation on costs per sample: the clock read, a latency record and a
+// counter bump, uncontended and with threads recording into the same stage, against off
+
+#define PBJ_INSTRUMENTATION_BENCHMARK_MAX_THREADS 4
+
+typedef struct {
+    PBJInstrumentation *instrumentation;
+    uint64_t operations;
+    uint64_t elapsed;
+} PBJInstrumentationBenchmarkThread;
+
+static void *PBJInstrumentationBenchmarkRecorder(void *context)
+{
+    PBJInstrumentationBenchmarkThread *thread = (PBJInstrumentationBenchmarkThread *)context;
+    uint64_t start = PBJTestNow();
+    for (uint64_t i = 0; i < thread->operations; i++) {
+        uint64_t sampleStart = PBJInstrumentationNow();
+        PBJInstrumentationRecordSince(thread->instrumentation, PBJInstrumentationStageAppend, sampleStart);
+        PBJInstrumentationIncrementCounter(thread->instrumentation, PBJInstrumentationCounterFramesWritten);
+    }
+    thread->elapsed = PBJTestNow() - start;
+    return NULL;
+}
+
+static double PBJInstrumentationBenchmarkPerOperation(PBJInstrumentation *instrumentation, int threadCount, uint64_t operations)
+{
+    pthread_t threads[PBJ_INSTRUMENTATION_BENCHMARK_MAX_THREADS];
+    PBJInstrumentationBenchmarkThread contexts[PBJ_INSTRUMENTATION_BENCHMARK_MAX_THREADS];
+    for (int i = 0; i < threadCount; i++) {
+        contexts[i].instrumentation = instrumentation;
+        contexts[i].operations = operations;
+        PBJTestCheck(pthread_create(&threads[i], NULL, PBJInstrumentationBenchmarkRecorder, &contexts[i]) == 0);
+    }
+    uint64_t elapsed = 0;
+    for (int i = 0; i < threadCount; i++) {
+        pthread_join(threads[i], NULL);
+        elapsed += contexts[i].elapsed;
+    }
+    return (double)elapsed / (double)(operations * (uint64_t)threadCount);
+}
+
+int main(int argc, char **argv)
+{
+    int quick = PBJTestIsQuick(argc, argv);
+    uint64_t operations = quick ? 200000 : 20000000;
+
+    uint64_t start = PBJTestNow();
+    uint64_t sink = 0;
+    for (uint64_t i = 0; i < operations; i++)
+        sink += PBJInstrumentationNow();
+    double clock = (double)(PBJTestNow() - start) / (double)operations;
+
+    PBJLatencyHistogram *histogram = PBJLatencyHistogramCreate();
+    start = PBJTestNow();
+    for (uint64_t i = 0; i < operations; i++)
+        PBJLatencyHistogramRecord(histogram, i * 977);
+    double record = (double)(PBJTestNow() - start) / (double)operations;
+
+    start = PBJTestNow();
+    for (uint64_t i = 0; i < (quick ? 1000 : 100000); i++)
+        sink += PBJLatencyHistogramSummarize(histogram).p99;
+    double summarize = (double)(PBJTestNow() - start) / (quick ? 1000.0 : 100000.0);
+    PBJLatencyHistogramDestroy(histogram);
+
+    printf("%-40s %10.1f ns\n", "clock read", clock);
+    printf("%-40s %10.1f ns\n", "histogram record", record);
+    printf("%-40s %10.1f ns\n", "histogram summary", summarize);
+
+    printf("%-40s %10.1f ns\n", "sample, instrumentation off", PBJInstrumentationBenchmarkPerOperation(NULL, 1, operations));
+    PBJInstrumentation *instrumentation = PBJInstrumentationCreate();
+    for (int threads = 1; threads <= PBJ_INSTRUMENTATION_BENCHMARK_MAX_THREADS; threads *= 2) {
+        char label[64];
+        snprintf(label, sizeof(label), "sample, instrumentation on, %d thread%s", threads, threads > 1 ? "s" : "");
+        printf("%-40s %10.1f ns\n", label, PBJInstrumentationBenchmarkPerOperation(instrumentation, threads, operations));
+    }
+    PBJInstrumentationDestroy(instrumentation);
+    return sink == 1 ? 1 : 0;
+}
@@ -0,0 +1,154 @@
+//
+//  PBJJPEGEncoderBenchmark.c
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#include "PBJJPEGEncoder.h"
+#include "PBJTestSupport.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+// milliseconds per photo and the file size for each path this machine runs, then the same
+// photo split into restart segments and encoded across a few threads, as capture does
+
+typedef struct {
+    const char *name;
+    size_t width;
+    size_t height;
+} PBJJPEGEncoderBenchmarkSize;
+
+static const char *PBJJPEGEncoderBenchmarkLevelName(PBJSIMDLevel level)
+{
+    switch (level) {
+        case PBJSIMDLevelScalar: return "scalar";
+        case PBJSIMDLevelSSE2: return "sse2";
+        case PBJSIMDLevelAVX2: return "avx2";
+        case PBJSIMDLevelNEON: return "neon";
+        default: return "auto";
+    }
+}
+
+typedef struct {
+    PBJJPEGEncoder *encoder;
+    _Atomic(size_t) next;
+    size_t count;
+} PBJJPEGEncoderBenchmarkWork;
+
+static void *PBJJPEGEncoderBenchmarkWorker(void *context)
+{
+    PBJJPEGEncoderBenchmarkWork *work = (PBJJPEGEncoderBenchmarkWork *)context;
+    for (size_t segment = atomic_fetch_add(&work->next, 1); segment < work->count; segment = atomic_fetch_add(&work->next, 1))
+        PBJTestCheck(PBJJPEGEncoderEncodeSegment(work->encoder, segment));
+    return NULL;
+}
+
+// one photo through the segmented encoder, returns its size
+static size_t PBJJPEGEncoderBenchmarkEncodeSegments(const PBJNV12Image *image, PBJJPEGOptions options, size_t threadCount, uint8_t *bytes, size_t capacity)
+{
+    PBJJPEGEncoder *encoder = PBJJPEGEncoderCreate(image, options);
+    PBJTestCheck(encoder != NULL);
+    PBJJPEGEncoderBenchmarkWork work = { encoder, 0, PBJJPEGEncoderGetSegmentCount(encoder) };
+    pthread_t threads[8];
+    for (size_t i = 1; i < threadCount; i++)
+        PBJTestCheck(pthread_create(&threads[i], NULL, PBJJPEGEncoderBenchmarkWorker, &work) == 0);
+    PBJJPEGEncoderBenchmarkWorker(&work);
+    for (size_t i = 1; i < threadCount; i++)
+        pthread_join(threads[i], NULL);
+    size_t size = PBJJPEGEncoderCopyBytes(encoder, bytes, capacity);
+    PBJTestCheck(size > 0);
+    PBJJPEGEncoderDestroy(encoder);
+    return size;
+}
+
+int main(int argc, char **argv)
+{
+    int quick = PBJTestIsQuick(argc, argv);
+    static const PBJJPEGEncoderBenchmarkSize sizes[] = {
+        { "720p", 1280, 720 }, { "1080p", 1920, 1080 }, { "4K", 3840, 2160 }, { "12MP", 4032, 3024 }
+    };
+    static const PBJSIMDLevel levels[] = { PBJSIMDLevelScalar, PBJSIMDLevelSSE2, PBJSIMDLevelAVX2, PBJSIMDLevelNEON };
+    static const int qualities[] = { 75, 90 };
+    static const size_t threadCounts[] = { 1, 2, 4 };
+    uint64_t budget = quick ? 10000000ull : 1000000000ull;
+    size_t sizeCount = quick ? 2 : sizeof(sizes) / sizeof(sizes[0]);
+
+    printf("%-6s %-7s %-7s %-11s %10s %10s\n", "size", "quality", "path", "segments", "ms/photo", "KiB");
+    for (size_t s = 0; s < sizeCount; s++) {
+        PBJTestFrame frame = PBJTestFrameCreate(sizes[s].width, sizes[s].height, PBJYCbCrRangeFull);
+        PBJTestFrameFillScene(&frame);
+        // a little noise on the scene so the entropy coder has something to do
+        PBJTestRandom random = PBJTestRandomMake(s + 1);
+        for (size_t y = 0; y < sizes[s].height; y++) {
+            for (size_t x = 0; x < sizes[s].width; x++) {
+                uint8_t *luma = frame.image.luma + y * frame.image.lumaBytesPerRow + x;
+                int value = *luma + (int)PBJTestRandomBetween(&random, -6, 6);
+                *luma = (uint8_t)(value < 0 ? 0 : value > 255 ? 255 : value);
+            }
+        }
+        size_t capacity = sizes[s].width * sizes[s].height * 3;
+        uint8_t *bytes = (uint8_t *)malloc(capacity);
+        PBJTestCheck(bytes != NULL);
+
+        for (size_t q = 0; q < sizeof(qualities) / sizeof(qualities[0]); q++) {
+            for (size_t l = 0; l < sizeof(levels) / sizeof(levels[0]); l++) {
+                if (PBJSIMDLevelResolve(levels[l]) != levels[l])
+                    continue;
+                PBJJPEGOptions options = { qualities[q], 0, levels[l] };
+                size_t size = 0;
+                uint64_t photos = 0;
+                uint64_t start = PBJTestNow();
+                uint64_t elapsed = 0;
+                do {
+                    free(PBJJPEGEncode(&frame.image, options, &size));
+                    photos++;
+                    elapsed = PBJTestNow() - start;
+                } while (elapsed < budget);
+                printf("%-6s %-7d %-7s %-11s %10.2f %10.1f\n", sizes[s].name, qualities[q], PBJJPEGEncoderBenchmarkLevelName(levels[l]),
+                       "1", (double)elapsed / 1e6 / (double)photos, (double)size / 1024.0);
+            }
+
+            // eight segments, about what capture splits a photo into
+            size_t mcuRows = (sizes[s].height + 15) / 16;
+            PBJJPEGOptions options = { qualities[q], (mcuRows + 7) / 8, PBJSIMDLevelAuto };
+            for (size_t t = 0; t < sizeof(threadCounts) / sizeof(threadCounts[0]); t++) {
+                size_t size = 0;
+                uint64_t photos = 0;
+                uint64_t start = PBJTestNow();
+                uint64_t elapsed = 0;
+                do {
+                    size = PBJJPEGEncoderBenchmarkEncodeSegments(&frame.image, options, threadCounts[t], bytes, capacity);
+                    photos++;
+                    elapsed = PBJTestNow() - start;
+                } while (elapsed < budget);
+                char segments[32];
+                snprintf(segments, sizeof(segments), "8, %zu thr", threadCounts[t]);
+                printf("%-6s %-7d %-7s %-11s %10.2f %10.1f\n", sizes[s].name, qualities[q], "auto", segments,
+                       (double)elapsed / 1e6 / (double)photos, (double)size / 1024.0);
+            }
+        }
+        free(bytes);
+        PBJTestFrameDestroy(&frame);
+    }
+    return 0;
+}
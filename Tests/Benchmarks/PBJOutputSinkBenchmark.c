@@ -0,0 +1,196 @@
+//
+//  PBJOutputSinkBenchmark.c
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#include "PBJOutputSink.h"
+#include "PBJTestSupport.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+// a 4K recording's bytes, 50 Mbps video at 30 fps with a keyframe a second, 128 kbps AAC and one
+// second fragments, written as capture hands samples over: with a write(2) per sample, with a
+// write(2) per box as the muxer lays a fragment out, and through the sink. reports the system
+// calls made, throughput, and the latency the producer sees per call, where the tail is what
+// backs up the capture queue
+
+typedef struct {
+    size_t length;
+    int fragmentEnd;
+} PBJOutputSinkBenchmarkWrite;
+
+typedef struct {
+    uint64_t systemCalls;
+    uint64_t syncs;
+    double megabytesPerSecond;
+    uint64_t p50;
+    uint64_t p99;
+    uint64_t p999;
+    uint64_t max;
+} PBJOutputSinkBenchmarkResult;
+
+// samples in arrival order
+static size_t PBJOutputSinkBenchmarkMakeSamples(PBJOutputSinkBenchmarkWrite *writes, int seconds)
+{
+    double videoBytes = 50e6 / 8.0 / 30.0;
+    double audioBytes = 128e3 / 8.0 / 46.875;
+    size_t count = 0;
+    for (int second = 0; second < seconds; second++) {
+        for (int frame = 0; frame < 30; frame++) {
+            writes[count++] = (PBJOutputSinkBenchmarkWrite){ (size_t)(frame == 0 ? videoBytes * 6.0 : videoBytes * 0.83), 0 };
+            for (int packet = 0; packet < (frame % 2 ? 2 : 1); packet++)
+                writes[count++] = (PBJOutputSinkBenchmarkWrite){ (size_t)audioBytes, 0 };
+        }
+        writes[count - 1].fragmentEnd = 1;
+    }
+    return count;
+}
+
+// the same bytes as the muxer writes them, a moof and mdat header, the video run and the audio run
+static size_t PBJOutputSinkBenchmarkMakeBoxes(const PBJOutputSinkBenchmarkWrite *samples, size_t sampleCount, PBJOutputSinkBenchmarkWrite *writes)
+{
+    size_t count = 0;
+    size_t video = 0;
+    size_t audio = 0;
+    for (size_t i = 0; i < sampleCount; i++) {
+        if (samples[i].length > 1000)
+            video += samples[i].length;
+        else
+            audio += samples[i].length;
+        if (samples[i].fragmentEnd) {
+            writes[count++] = (PBJOutputSinkBenchmarkWrite){ 2048, 0 };
+            writes[count++] = (PBJOutputSinkBenchmarkWrite){ video, 0 };
+            writes[count++] = (PBJOutputSinkBenchmarkWrite){ audio, 1 };
+            video = 0;
+            audio = 0;
+        }
+    }
+    return count;
+}
+
+static PBJOutputSinkBenchmarkResult PBJOutputSinkBenchmarkRun(const char *path, const PBJOutputSinkBenchmarkWrite *writes, size_t count,
+                                                              const uint8_t *payload, int useSink, PBJOutputSinkDurability durability, uint64_t preallocationBytes)
+{
+    PBJOutputSinkBenchmarkResult result;
+    memset(&result, 0, sizeof(result));
+    uint64_t *latencies = (uint64_t *)malloc(count * sizeof(uint64_t));
+    PBJTestCheck(latencies != NULL);
+    uint64_t total = 0;
+    uint64_t start = PBJTestNow();
+
+    if (!useSink) {
+        int descriptor = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        PBJTestCheck(descriptor >= 0);
+        for (size_t i = 0; i < count; i++) {
+            uint64_t callStart = PBJTestNow();
+            const uint8_t *cursor = payload;
+            size_t length = writes[i].length;
+            while (length > 0) {
+                ssize_t written = write(descriptor, cursor, length);
+                result.systemCalls++;
+                PBJTestCheck(written > 0);
+                cursor += written;
+                length -= (size_t)written;
+            }
+            if (writes[i].fragmentEnd && durability == PBJOutputSinkDurabilityFragment) {
+                PBJTestCheck(fsync(descriptor) == 0);
+                result.syncs++;
+            }
+            latencies[i] = PBJTestNow() - callStart;
+            total += writes[i].length;
+        }
+        PBJTestCheck(fsync(descriptor) == 0);
+        result.syncs++;
+        close(descriptor);
+    } else {
+        PBJOutputSinkConfiguration configuration = PBJOutputSinkDefaultConfiguration();
+        configuration.durability = durability;
+        configuration.preallocationBytes = preallocationBytes;
+        PBJOutputSink *sink = PBJOutputSinkCreateFile(path, &configuration);
+        PBJTestCheck(sink != NULL);
+        for (size_t i = 0; i < count; i++) {
+            uint64_t callStart = PBJTestNow();
+            PBJTestCheck(PBJOutputSinkWrite(sink, payload, writes[i].length));
+            if (writes[i].fragmentEnd)
+                PBJTestCheck(PBJOutputSinkEndFragment(sink));
+            latencies[i] = PBJTestNow() - callStart;
+            total += writes[i].length;
+        }
+        PBJTestCheck(PBJOutputSinkFinish(sink));
+        PBJOutputSinkStatistics statistics;
+        PBJOutputSinkGetStatistics(sink, &statistics);
+        result.systemCalls = statistics.writeCalls;
+        result.syncs = statistics.syncCalls;
+        PBJOutputSinkDestroy(sink);
+    }
+
+    result.megabytesPerSecond = (double)total / ((double)(PBJTestNow() - start) / 1e9) / 1e6;
+    result.p50 = PBJTestPercentile(latencies, count, 50.0);
+    result.p99 = PBJTestPercentile(latencies, count, 99.0);
+    result.p999 = PBJTestPercentile(latencies, count, 99.9);
+    result.max = PBJTestPercentile(latencies, count, 100.0);
+    free(latencies);
+    return result;
+}
+
+static void PBJOutputSinkBenchmarkPrint(const char *name, PBJOutputSinkBenchmarkResult result)
+{
+    printf("%-26s %8llu %6llu %9.0f %9.1f %9.1f %9.1f %9.1f\n", name, (unsigned long long)result.systemCalls, (unsigned long long)result.syncs,
+           result.megabytesPerSecond, (double)result.p50 / 1e3, (double)result.p99 / 1e3, (double)result.p999 / 1e3, (double)result.max / 1e3);
+}
+
+int main(int argc, char **argv)
+{
+    int quick = PBJTestIsQuick(argc, argv);
+    int seconds = quick ? 4 : 60;
+    char path[] = "/tmp/PBJOutputSinkBenchmarkXXXXXX";
+    int descriptor = mkstemp(path);
+    PBJTestCheck(descriptor >= 0);
+    close(descriptor);
+
+    PBJOutputSinkBenchmarkWrite *samples = (PBJOutputSinkBenchmarkWrite *)calloc((size_t)seconds * 80, sizeof(PBJOutputSinkBenchmarkWrite));
+    PBJOutputSinkBenchmarkWrite *boxes = (PBJOutputSinkBenchmarkWrite *)calloc((size_t)seconds * 3, sizeof(PBJOutputSinkBenchmarkWrite));
+    uint8_t *payload = (uint8_t *)malloc(16 << 20);
+    PBJTestCheck(samples != NULL && boxes != NULL && payload != NULL);
+    memset(payload, 0x5a, 16 << 20);
+    size_t sampleCount = PBJOutputSinkBenchmarkMakeSamples(samples, seconds);
+    size_t boxCount = PBJOutputSinkBenchmarkMakeBoxes(samples, sampleCount, boxes);
+    uint64_t preallocationBytes = (uint64_t)((50e6 + 128e3) / 8.0 * seconds) + (1 << 20);
+
+    for (int durability = PBJOutputSinkDurabilityFinish; durability <= PBJOutputSinkDurabilityFragment; durability++) {
+        printf("%d s of 4K, %zu samples, %s\n", seconds, sampleCount, durability == PBJOutputSinkDurabilityFinish ? "synced when finished" : "synced every fragment");
+        printf("%-26s %8s %6s %9s %9s %9s %9s %9s\n", "writer", "writes", "syncs", "MB/s", "p50 us", "p99 us", "p99.9 us", "max us");
+        PBJOutputSinkDurability policy = (PBJOutputSinkDurability)durability;
+        PBJOutputSinkBenchmarkPrint("write(2) per sample", PBJOutputSinkBenchmarkRun(path, samples, sampleCount, payload, 0, policy, 0));
+        PBJOutputSinkBenchmarkPrint("write(2) per muxer box", PBJOutputSinkBenchmarkRun(path, boxes, boxCount, payload, 0, policy, 0));
+        PBJOutputSinkBenchmarkPrint("sink per sample", PBJOutputSinkBenchmarkRun(path, samples, sampleCount, payload, 1, policy, 0));
+        PBJOutputSinkBenchmarkPrint("sink, preallocated", PBJOutputSinkBenchmarkRun(path, samples, sampleCount, payload, 1, policy, preallocationBytes));
+    }
+
+    free(payload);
+    free(boxes);
+    free(samples);
+    unlink(path);
+    return 0;
+}
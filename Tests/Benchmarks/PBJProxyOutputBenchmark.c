@@ -0,0 +1,239 @@
+//
+//  PBJProxyOutputBenchmark.c
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include "PBJCapturePipeline.h"
+#include "PBJProxyOutput.h"
+#include "PBJSyntheticCaptureSource.h"
+#include "PBJTestSupport.h"
+
+// what a proxy adds to a recording: routing a sample, downscaling a kept frame at each SIMD level
+// for the master sizes capture produces, and the fan-out of a synthetic 1080p30 recording with
+// audio through the pipeline, with and without the proxy, where decimation has to spare the
+// downscale for every frame past the proxy's rate
+
+#define PBJ_PROXY_BENCHMARK_NS PBJ_TEST_NSEC_PER_SEC
+
+typedef struct {
+    const char *name;
+    size_t width;
+    size_t height;
+} PBJProxyOutputBenchmarkMaster;
+
+static const char *PBJProxyOutputBenchmarkLevelName(PBJSIMDLevel level)
+{
+    switch (level) {
+        case PBJSIMDLevelScalar: return "scalar";
+        case PBJSIMDLevelSSE2: return "sse2";
+        case PBJSIMDLevelAVX2: return "avx2";
+        case PBJSIMDLevelNEON: return "neon";
+        default: return "auto";
+    }
+}
+
+#pragma mark - routing
+
+static void PBJProxyOutputBenchmarkRouting(uint64_t budget)
+{
+    PBJProxyOutput *proxy = PBJProxyOutputCreate(NULL);
+    PBJTestCheck(proxy != NULL);
+    PBJTestRandom random = PBJTestRandomMake(3);
+    uint64_t routed = 0;
+    uint64_t start = PBJTestNow();
+    uint64_t elapsed = 0;
+    do {
+        for (int frame = 0; frame < 30000; frame++) {
+            int64_t time = (int64_t)(routed + frame) * PBJ_PROXY_BENCHMARK_NS / 30 + PBJTestRandomBetween(&random, -3000000, 3000000);
+            PBJProxyOutputRouteSample(proxy, PBJCaptureTrackVideo, time);
+        }
+        routed += 30000;
+        elapsed = PBJTestNow() - start;
+    } while (elapsed < budget);
+
+    PBJProxyOutputStatistics statistics = PBJProxyOutputGetStatistics(proxy);
+    printf("%-18s %12s %12s %10s\n", "routing", "ns/frame", "kept", "decimated");
+    printf("%-18s %12.1f %12llu %10llu\n\n", "30 fps to 15", (double)elapsed / (double)routed,
+           (unsigned long long)statistics.framesRouted, (unsigned long long)statistics.framesDecimated);
+    PBJProxyOutputDestroy(proxy);
+}
+
+#pragma mark - downscale
+
+static void PBJProxyOutputBenchmarkDownscale(uint64_t budget)
+{
+    static const PBJProxyOutputBenchmarkMaster masters[] = {
+        { "4K", 3840, 2160 },
+        { "1080p", 1920, 1080 },
+        { "1080p portrait", 1080, 1920 },
+        { "720p", 1280, 720 },
+    };
+    static const PBJSIMDLevel levels[] = { PBJSIMDLevelScalar, PBJSIMDLevelSSE2, PBJSIMDLevelAVX2, PBJSIMDLevelNEON };
+
+    printf("%-18s %-9s %-7s %10s %10s\n", "master", "proxy", "path", "ms/frame", "p99 ms");
+    for (size_t m = 0; m < sizeof(masters) / sizeof(masters[0]); m++) {
+        PBJTestFrame master = PBJTestFrameCreate(masters[m].width, masters[m].height, PBJYCbCrRangeVideo);
+        PBJTestFrameFillScene(&master);
+        PBJProxyOutput *proxy = PBJProxyOutputCreate(NULL);
+        PBJTestCheck(proxy != NULL);
+        PBJTestCheck(PBJProxyOutputPrepare(proxy, masters[m].width, masters[m].height));
+        size_t width = 0;
+        size_t height = 0;
+        PBJProxyOutputGetDimensions(proxy, &width, &height);
+        PBJTestFrame destination = PBJTestFrameCreate(width, height, PBJYCbCrRangeVideo);
+        void *scratch = malloc(PBJProxyOutputScratchSize(proxy));
+        PBJTestCheck(scratch != NULL);
+        char geometry[32];
+        snprintf(geometry, sizeof(geometry), "%zux%zu", width, height);
+
+        for (size_t l = 0; l < sizeof(levels) / sizeof(levels[0]); l++) {
+            // levels this build or cpu can't run resolve to another, only time the ones that are there
+            if (PBJSIMDLevelResolve(levels[l]) != levels[l])
+                continue;
+            uint64_t samples[2048];
+            size_t count = 0;
+            uint64_t start = PBJTestNow();
+            do {
+                uint64_t frameStart = PBJTestNow();
+                PBJTestCheck(PBJProxyOutputDownscale(proxy, &master.image, &destination.image, scratch, levels[l]));
+                samples[count++] = PBJTestNow() - frameStart;
+            } while (PBJTestNow() - start < budget && count < sizeof(samples) / sizeof(samples[0]));
+
+            uint64_t total = 0;
+            for (size_t i = 0; i < count; i++)
+                total += samples[i];
+            printf("%-18s %-9s %-7s %10.3f %10.3f\n", masters[m].name, geometry, PBJProxyOutputBenchmarkLevelName(levels[l]),
+                   (double)total / (double)count / 1e6, (double)PBJTestPercentile(samples, count, 99.0) / 1e6);
+        }
+        free(scratch);
+        PBJTestFrameDestroy(&destination);
+        PBJProxyOutputDestroy(proxy);
+        PBJTestFrameDestroy(&master);
+    }
+    printf("\n");
+}
+
+#pragma mark - fan-out
+
+typedef struct {
+    PBJProxyOutput *proxy; // NULL records the master alone
+    PBJTestFrame destination;
+    void *scratch;
+    uint64_t written[PBJCaptureTrackCount];
+    uint64_t proxied[PBJCaptureTrackCount];
+    uint64_t downscaleNanoseconds;
+} PBJProxyOutputBenchmarkSink;
+
+static int PBJProxyOutputBenchmarkSetupTrack(void *context, const PBJCaptureSample *sample)
+{
+    return 1;
+}
+
+static int PBJProxyOutputBenchmarkWriteSample(void *context, const PBJCaptureSample *sample, PBJTime rebasedPresentationTimestamp)
+{
+    PBJProxyOutputBenchmarkSink *sink = (PBJProxyOutputBenchmarkSink *)context;
+    sink->written[sample->track]++;
+    if (!sink->proxy)
+        return 1;
+
+    unsigned int route = PBJProxyOutputRouteSample(sink->proxy, sample->track, PBJTimeGetNanoseconds(rebasedPresentationTimestamp));
+    if (!(route & PBJProxyOutputRouteProxy))
+        return 1;
+    sink->proxied[sample->track]++;
+    if (sample->track != PBJCaptureTrackVideo)
+        return 1;
+
+    const PBJNV12Image *master = (const PBJNV12Image *)sample->payload;
+    uint64_t start = PBJTestNow();
+    PBJTestCheck(PBJProxyOutputPrepare(sink->proxy, master->width, master->height));
+    PBJTestCheck(PBJProxyOutputDownscale(sink->proxy, master, &sink->destination.image, sink->scratch, PBJSIMDLevelAuto));
+    sink->downscaleNanoseconds += PBJTestNow() - start;
+    return 1;
+}
+
+static void PBJProxyOutputBenchmarkFanOut(int64_t duration, double proxyFrameRate, int withProxy)
+{
+    PBJSyntheticCaptureSourceConfiguration configuration = PBJSyntheticCaptureSourceDefaultConfiguration(1920, 1080, 30);
+    configuration.jitter = 3000000;
+    configuration.duration = duration;
+    PBJSyntheticCaptureSource *source = PBJSyntheticCaptureSourceCreate(&configuration, NULL, 0);
+    PBJTestCheck(source != NULL);
+
+    PBJProxyOutputBenchmarkSink sink;
+    memset(&sink, 0, sizeof(sink));
+    if (withProxy) {
+        PBJProxyOutputConfiguration proxyConfiguration = PBJProxyOutputDefaultConfiguration();
+        proxyConfiguration.frameRate = proxyFrameRate;
+        sink.proxy = PBJProxyOutputCreate(&proxyConfiguration);
+        PBJTestCheck(sink.proxy != NULL);
+        PBJTestCheck(PBJProxyOutputPrepare(sink.proxy, 1920, 1080));
+        sink.destination = PBJTestFrameCreate(640, 360, PBJYCbCrRangeVideo);
+        sink.scratch = malloc(PBJProxyOutputScratchSize(sink.proxy));
+        PBJTestCheck(sink.scratch != NULL);
+    }
+
+    PBJCapturePipelineSink callbacks = { &sink, PBJProxyOutputBenchmarkSetupTrack, PBJProxyOutputBenchmarkWriteSample, NULL, NULL, NULL };
+    PBJCapturePipeline *pipeline = PBJCapturePipelineCreate(callbacks);
+    PBJTestCheck(pipeline != NULL);
+    PBJTestCheck(PBJCapturePipelineStart(pipeline));
+    uint64_t start = PBJTestNow();
+    PBJCapturePipelineRunSource(pipeline, PBJSyntheticCaptureSourceGetSource(source));
+    uint64_t elapsed = PBJTestNow() - start;
+
+    char proxyName[16];
+    if (!withProxy)
+        snprintf(proxyName, sizeof(proxyName), "none");
+    else if (proxyFrameRate > 0)
+        snprintf(proxyName, sizeof(proxyName), "%.0f fps", proxyFrameRate);
+    else
+        snprintf(proxyName, sizeof(proxyName), "every frame");
+    uint64_t frames = sink.written[PBJCaptureTrackVideo];
+    uint64_t proxied = sink.proxied[PBJCaptureTrackVideo];
+    printf("%-12s %8llu %8llu %8llu %12.3f %12.3f\n", proxyName, (unsigned long long)frames, (unsigned long long)proxied,
+           (unsigned long long)sink.proxied[PBJCaptureTrackAudio], frames ? (double)elapsed / (double)frames / 1e6 : 0.0,
+           proxied ? (double)sink.downscaleNanoseconds / (double)proxied / 1e6 : 0.0);
+
+    PBJCapturePipelineDestroy(pipeline);
+    PBJSyntheticCaptureSourceDestroy(source);
+    if (withProxy) {
+        free(sink.scratch);
+        PBJTestFrameDestroy(&sink.destination);
+        PBJProxyOutputDestroy(sink.proxy);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int quick = PBJTestIsQuick(argc, argv);
+    uint64_t budget = quick ? 10000000ull : 500000000ull;
+    int64_t duration = (quick ? 1 : 20) * PBJ_PROXY_BENCHMARK_NS;
+
+    PBJProxyOutputBenchmarkRouting(budget);
+    PBJProxyOutputBenchmarkDownscale(budget);
+
+    // 1080p30 with audio, the cost each master frame carries with the proxy's work included
+    printf("%-12s %8s %8s %8s %12s %12s\n", "proxy", "frames", "proxy fr", "proxy au", "ms/frame", "ms/downscale");
+    PBJProxyOutputBenchmarkFanOut(duration, 0, 0);
+    PBJProxyOutputBenchmarkFanOut(duration, 15, 1);
+    PBJProxyOutputBenchmarkFanOut(duration, 0, 1);
+    return 0;
+}
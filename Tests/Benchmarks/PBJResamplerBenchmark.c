@@ -0,0 +1,104 @@
+//
+//  PBJResamplerBenchmark.c
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#include "PBJResampler.h"
+#include "PBJTestSupport.h"
+
+// headless crop and resample cost per frame for the geometries capture and export use
+
+typedef struct {
+    const char *name;
+    size_t sourceWidth;
+    size_t sourceHeight;
+    size_t aspectWidth; // 0 keeps the whole source
+    size_t aspectHeight;
+    size_t width;
+    size_t height;
+} PBJResamplerBenchmarkCase;
+
+static const char *PBJResamplerBenchmarkFilterName(PBJResampleFilter filter)
+{
+    switch (filter) {
+        case PBJResampleFilterBilinear: return "bilinear";
+        case PBJResampleFilterLanczos3: return "lanczos3";
+        default: return "box";
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int quick = PBJTestIsQuick(argc, argv);
+    static const PBJResamplerBenchmarkCase cases[] = {
+        { "4K to 1080p", 3840, 2160, 0, 0, 1920, 1080 },
+        { "1080p to 720p", 1920, 1080, 0, 0, 1280, 720 },
+        { "1080p square 640", 1920, 1080, 1, 1, 640, 640 },
+        { "720p to 1080p", 1280, 720, 0, 0, 1920, 1080 },
+    };
+    static const PBJSIMDLevel levels[] = { PBJSIMDLevelScalar, PBJSIMDLevelAuto };
+    uint64_t budget = quick ? 10000000ull : 500000000ull;
+
+    printf("%-18s %-9s %-7s %10s %10s %10s\n", "geometry", "filter", "path", "ms/frame", "p99 ms", "MP/s out");
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        const PBJResamplerBenchmarkCase *bench = &cases[c];
+        PBJTestFrame source = PBJTestFrameCreate(bench->sourceWidth, bench->sourceHeight, PBJYCbCrRangeVideo);
+        PBJTestFrameFillScene(&source);
+        PBJTestFrame destination = PBJTestFrameCreate(bench->width, bench->height, PBJYCbCrRangeVideo);
+        PBJCropRect crop = { 0, 0, bench->sourceWidth, bench->sourceHeight };
+        if (bench->aspectWidth)
+            crop = PBJCropRectForAspectRatio(bench->sourceWidth, bench->sourceHeight, bench->aspectWidth, bench->aspectHeight);
+
+        for (int filter = PBJResampleFilterBox; filter <= PBJResampleFilterLanczos3; filter++) {
+            PBJResampler *resampler = PBJResamplerCreate(crop, bench->width, bench->height, (PBJResampleFilter)filter);
+            PBJTestCheck(resampler != NULL);
+            void *scratch = malloc(PBJResamplerScratchSize(resampler));
+            PBJTestCheck(scratch != NULL);
+
+            for (size_t l = 0; l < sizeof(levels) / sizeof(levels[0]); l++) {
+                uint64_t samples[4096];
+                size_t count = 0;
+                uint64_t start = PBJTestNow();
+                do {
+                    uint64_t frameStart = PBJTestNow();
+                    PBJResamplerProcessRows(resampler, &source.image, &destination.image, 0, bench->height, scratch, levels[l]);
+                    samples[count++] = PBJTestNow() - frameStart;
+                } while (PBJTestNow() - start < budget && count < sizeof(samples) / sizeof(samples[0]));
+
+                uint64_t total = 0;
+                for (size_t i = 0; i < count; i++)
+                    total += samples[i];
+                double mean = (double)total / (double)count / 1e6;
+                printf("%-18s %-9s %-7s %10.3f %10.3f %10.1f\n", bench->name, PBJResamplerBenchmarkFilterName((PBJResampleFilter)filter),
+                       levels[l] == PBJSIMDLevelScalar ? "scalar" : "vector", mean,
+                       (double)PBJTestPercentile(samples, count, 99.0) / 1e6,
+                       (double)(bench->width * bench->height) / 1e6 / (mean / 1e3));
+            }
+            free(scratch);
+            PBJResamplerDestroy(resampler);
+        }
+        PBJTestFrameDestroy(&destination);
+        PBJTestFrameDestroy(&source);
+    }
+    return 0;
+}
@@ -0,0 +1,123 @@
+//
+//  PBJSampleRingBenchmark.c
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#include "PBJSampleRing.h"
+#include "PBJTestSupport.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+
+// ring throughput on one thread and across a producer and consumer thread, with the push
+// latency a capture callback sees
+
+typedef struct {
+    PBJSampleRing *ring;
+    uintptr_t items;
+    atomic_int producerDone;
+    uint64_t *pushLatency;
+    uintptr_t popped;
+    uintptr_t dropped;
+} PBJSampleRingBenchmarkRun;
+
+static void *PBJSampleRingBenchmarkProducer(void *context)
+{
+    PBJSampleRingBenchmarkRun *run = (PBJSampleRingBenchmarkRun *)context;
+    for (uintptr_t item = 1; item <= run->items; item++) {
+        void *dropped = NULL;
+        uint64_t start = PBJTestNow();
+        PBJSampleRingPush(run->ring, (void *)item, PBJSampleRingOverflowDropOldest, &dropped);
+        run->pushLatency[item - 1] = PBJTestNow() - start;
+        if (dropped)
+            run->dropped++;
+    }
+    atomic_store_explicit(&run->producerDone, 1, memory_order_release);
+    return NULL;
+}
+
+static void *PBJSampleRingBenchmarkConsumer(void *context)
+{
+    PBJSampleRingBenchmarkRun *run = (PBJSampleRingBenchmarkRun *)context;
+    for (;;) {
+        int done = atomic_load_explicit(&run->producerDone, memory_order_acquire);
+        if (PBJSampleRingPop(run->ring)) {
+            run->popped++;
+        } else if (done) {
+            break;
+        } else {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    int quick = PBJTestIsQuick(argc, argv);
+    uintptr_t items = quick ? 200000 : 10000000;
+    static const size_t capacities[] = { 4, 16, 256 };
+
+    printf("%-9s %-13s %12s %10s %10s %10s\n", "capacity", "mode", "Mitems/s", "push p50", "push p99", "dropped");
+    for (size_t c = 0; c < sizeof(capacities) / sizeof(capacities[0]); c++) {
+        PBJSampleRing *ring = PBJSampleRingCreate(capacities[c]);
+        PBJTestCheck(ring != NULL);
+
+        // push and pop pairs, the uncontended cost of a hand-off
+        uint64_t start = PBJTestNow();
+        for (uintptr_t item = 1; item <= items; item++) {
+            void *dropped = NULL;
+            PBJSampleRingPush(ring, (void *)item, PBJSampleRingOverflowDropOldest, &dropped);
+            PBJTestCheck(PBJSampleRingPop(ring) == (void *)item);
+        }
+        double seconds = (double)(PBJTestNow() - start) / 1e9;
+        printf("%-9zu %-13s %12.2f %10s %10s %10s\n", capacities[c], "one thread", (double)items / seconds / 1e6, "-", "-", "0");
+        PBJSampleRingDestroy(ring);
+
+        PBJSampleRingBenchmarkRun run;
+        memset(&run, 0, sizeof(run));
+        run.ring = PBJSampleRingCreate(capacities[c]);
+        run.items = items;
+        run.pushLatency = (uint64_t *)malloc(items * sizeof(uint64_t));
+        PBJTestCheck(run.ring != NULL && run.pushLatency != NULL);
+        atomic_init(&run.producerDone, 0);
+
+        pthread_t producer, consumer;
+        start = PBJTestNow();
+        PBJTestCheck(pthread_create(&consumer, NULL, PBJSampleRingBenchmarkConsumer, &run) == 0);
+        PBJTestCheck(pthread_create(&producer, NULL, PBJSampleRingBenchmarkProducer, &run) == 0);
+        pthread_join(producer, NULL);
+        pthread_join(consumer, NULL);
+        seconds = (double)(PBJTestNow() - start) / 1e9;
+        PBJTestCheck(run.popped + run.dropped == items);
+
+        uint64_t p50 = PBJTestPercentile(run.pushLatency, items, 50.0);
+        uint64_t p99 = PBJTestPercentile(run.pushLatency, items, 99.0);
+        printf("%-9zu %-13s %12.2f %8lluns %8lluns %10llu\n", capacities[c], "two threads", (double)items / seconds / 1e6,
+               (unsigned long long)p50, (unsigned long long)p99, (unsigned long long)run.dropped);
+        free(run.pushLatency);
+        PBJSampleRingDestroy(run.ring);
+    }
+    return 0;
+}
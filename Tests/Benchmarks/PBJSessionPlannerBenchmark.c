@@ -0,0 +1,148 @@
+//
+//  PBJSessionPlannerBenchmark.c
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#include "PBJSessionPlanner.h"
+#include "PBJTestSupport.h"
+
+// operations a reconfiguration performs with the planner against tearing the session down and
+// building it again, which is what the capture code did before, for the transitions an app
+// makes and over every pair of configurations, with the planner's own cost per plan
+
+typedef struct {
+    const char *name;
+    PBJSessionConfiguration from;
+    PBJSessionConfiguration to;
+} PBJSessionPlannerBenchmarkTransition;
+
+// everything present goes, everything desired comes back and is configured from scratch
+static size_t PBJSessionPlannerBenchmarkRebuildCount(const PBJSessionConfiguration *current, const PBJSessionConfiguration *desired)
+{
+    size_t count = 0;
+    count += (current->camera != PBJSessionCameraNone) + !!current->audioInput + !!current->videoOutput + !!current->photoOutput + !!current->audioOutput;
+    count += (desired->camera != PBJSessionCameraNone) + !!desired->audioInput + !!desired->videoOutput + !!desired->photoOutput + !!desired->audioOutput;
+    count += 1; // preset
+    int video = desired->camera != PBJSessionCameraNone && desired->videoOutput;
+    int primary = desired->camera != PBJSessionCameraNone && (desired->videoOutput || desired->photoOutput);
+    count += (size_t)video + (size_t)primary;
+    count += (size_t)(video && desired->videoOrientation != PBJSessionConnectionUnknown);
+    count += (size_t)(primary && desired->mirrored != PBJSessionConnectionUnknown);
+    return count;
+}
+
+static PBJSessionConfiguration PBJSessionPlannerBenchmarkMake(PBJSessionCamera camera, int video, int photo, int audio, uint32_t preset, int orientation, int mirrored)
+{
+    PBJSessionConfiguration configuration = PBJSessionConfigurationMakeEmpty();
+    configuration.camera = camera;
+    configuration.videoOutput = video;
+    configuration.photoOutput = photo;
+    configuration.audioInput = audio;
+    configuration.audioOutput = audio;
+    configuration.preset = preset;
+    configuration.videoOrientation = orientation;
+    configuration.mirrored = mirrored;
+    return configuration;
+}
+
+int main(int argc, char **argv)
+{
+    int quick = PBJTestIsQuick(argc, argv);
+    uint64_t budget = quick ? 10000000ull : 300000000ull;
+
+    PBJSessionConfiguration empty = PBJSessionConfigurationMakeEmpty();
+    PBJSessionConfiguration video = PBJSessionPlannerBenchmarkMake(PBJSessionCameraBack, 1, 0, 1, 1, 1, 0);
+    PBJSessionConfiguration videoFront = PBJSessionPlannerBenchmarkMake(PBJSessionCameraFront, 1, 0, 1, 1, 1, 1);
+    PBJSessionConfiguration videoRotated = PBJSessionPlannerBenchmarkMake(PBJSessionCameraBack, 1, 0, 1, 1, 3, 0);
+    PBJSessionConfiguration videoMuted = PBJSessionPlannerBenchmarkMake(PBJSessionCameraBack, 1, 0, 0, 1, 1, 0);
+    PBJSessionConfiguration videoHigh = PBJSessionPlannerBenchmarkMake(PBJSessionCameraBack, 1, 0, 1, 2, 1, 0);
+    PBJSessionConfiguration photo = PBJSessionPlannerBenchmarkMake(PBJSessionCameraBack, 0, 1, 0, 3, PBJSessionConnectionUnknown, 0);
+    PBJSessionConfiguration photoFront = PBJSessionPlannerBenchmarkMake(PBJSessionCameraFront, 0, 1, 0, 3, PBJSessionConnectionUnknown, 1);
+    const PBJSessionPlannerBenchmarkTransition transitions[] = {
+        { "start video", empty, video },
+        { "flip camera", video, videoFront },
+        { "rotate", video, videoRotated },
+        { "mute audio", video, videoMuted },
+        { "change preset", video, videoHigh },
+        { "video to photo", video, photo },
+        { "photo to video", photo, video },
+        { "flip in photo", photo, photoFront },
+        { "stop", video, empty },
+    };
+    size_t transitionCount = sizeof(transitions) / sizeof(transitions[0]);
+
+    printf("%-16s %8s %8s %8s\n", "transition", "rebuild", "planned", "avoided");
+    size_t rebuildTotal = 0;
+    size_t plannedTotal = 0;
+    for (size_t t = 0; t < transitionCount; t++) {
+        PBJSessionPlan plan;
+        size_t planned = PBJSessionPlannerPlan(&transitions[t].from, &transitions[t].to, &plan);
+        size_t rebuild = PBJSessionPlannerBenchmarkRebuildCount(&transitions[t].from, &transitions[t].to);
+        printf("%-16s %8zu %8zu %7.0f%%\n", transitions[t].name, rebuild, planned, 100.0 * (1.0 - (double)planned / (double)rebuild));
+        rebuildTotal += rebuild;
+        plannedTotal += planned;
+    }
+    printf("%-16s %8zu %8zu %7.0f%%\n", "all of the above", rebuildTotal, plannedTotal, 100.0 * (1.0 - (double)plannedTotal / (double)rebuildTotal));
+
+    // every pair of cameras, outputs, two presets and the connection settings
+    static const PBJSessionCamera cameras[] = { PBJSessionCameraNone, PBJSessionCameraBack, PBJSessionCameraFront };
+    PBJSessionConfiguration space[3 * 16 * 2 * 2 * 2];
+    size_t spaceCount = 0;
+    for (size_t c = 0; c < 3; c++)
+        for (int outputs = 0; outputs < 16; outputs++)
+            for (uint32_t preset = 0; preset < 2; preset++)
+                for (int orientation = 0; orientation < 2; orientation++)
+                    for (int mirrored = 0; mirrored < 2; mirrored++) {
+                        PBJSessionConfiguration configuration = PBJSessionPlannerBenchmarkMake(cameras[c], outputs & 1, (outputs >> 1) & 1, 0, preset, orientation + 1, mirrored);
+                        configuration.audioInput = (outputs >> 2) & 1;
+                        configuration.audioOutput = (outputs >> 3) & 1;
+                        space[spaceCount++] = configuration;
+                    }
+    rebuildTotal = 0;
+    plannedTotal = 0;
+    for (size_t a = 0; a < spaceCount; a++) {
+        for (size_t b = 0; b < spaceCount; b++) {
+            PBJSessionPlan plan;
+            plannedTotal += PBJSessionPlannerPlan(&space[a], &space[b], &plan);
+            rebuildTotal += PBJSessionPlannerBenchmarkRebuildCount(&space[a], &space[b]);
+        }
+    }
+    printf("%-16s %8.2f %8.2f %7.0f%%\n", "every pair, mean", (double)rebuildTotal / (double)(spaceCount * spaceCount),
+           (double)plannedTotal / (double)(spaceCount * spaceCount), 100.0 * (1.0 - (double)plannedTotal / (double)rebuildTotal));
+
+    uint64_t plans = 0;
+    size_t sink = 0;
+    uint64_t start = PBJTestNow();
+    uint64_t elapsed = 0;
+    do {
+        for (size_t t = 0; t < transitionCount; t++) {
+            PBJSessionPlan plan;
+            sink += PBJSessionPlannerPlan(&transitions[t].from, &transitions[t].to, &plan);
+        }
+        plans += transitionCount;
+        elapsed = PBJTestNow() - start;
+    } while (elapsed < budget);
+    printf("\n%.1f ns per plan\n", (double)elapsed / (double)plans);
+    PBJTestCheck(sink > 0);
+    return 0;
+}
@@ -0,0 +1,355 @@
+//
+//  PBJAudioMeterTests.c
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#include "PBJAudioMeter.h"
+#include "PBJTestSupport.h"
+
+#include <math.h>
+
+// levels and band energies of synthetic tones against their closed form values, and every
+// vector path against the scalar one
+
+static const PBJSIMDLevel PBJAudioMeterTestLevels[] = { PBJSIMDLevelScalar, PBJSIMDLevelSSE2, PBJSIMDLevelNEON };
+static const double PBJAudioMeterTestPi = 3.14159265358979323846;
+
+#define PBJ_AUDIO_METER_TEST_RATE 48000.0
+
+// interleaved, channel c is a sine of amplitudes[c] at frequencies[c], int16 or float
+static void *PBJAudioMeterTestTone(size_t frames, uint32_t channelCount, const double *amplitudes, const double *frequencies,
+                                   PBJAudioSampleFormat format)
+{
+    size_t count = frames * channelCount;
+    void *samples = malloc(count * (format == PBJAudioSampleFormatInt16 ? sizeof(int16_t) : sizeof(float)));
+    PBJTestCheck(samples != NULL);
+    for (size_t frame = 0; frame < frames; frame++) {
+        for (uint32_t channel = 0; channel < channelCount; channel++) {
+            double value = amplitudes[channel] * sin(2.0 * PBJAudioMeterTestPi * frequencies[channel] * (double)frame / PBJ_AUDIO_METER_TEST_RATE);
+            size_t index = frame * channelCount + channel;
+            if (format == PBJAudioSampleFormatInt16)
+                ((int16_t *)samples)[index] = (int16_t)lrint(fmax(fmin(value * 32768.0, 32767.0), -32768.0));
+            else
+                ((float *)samples)[index] = (float)value;
+        }
+    }
+    return samples;
+}
+
+static PBJAudioMeter *PBJAudioMeterTestCreate(uint32_t channelCount, uint32_t bandCount)
+{
+    PBJAudioMeterConfiguration configuration = PBJAudioMeterDefaultConfiguration(PBJ_AUDIO_METER_TEST_RATE, channelCount);
+    configuration.bandCount = bandCount;
+    PBJAudioMeter *meter = PBJAudioMeterCreate(&configuration);
+    PBJTestCheck(meter != NULL);
+    return meter;
+}
+
+static int PBJAudioMeterTestClose(double value, double expected, double relative)
+{
+    return fabs(value - expected) <= relative * fabs(expected) + 1e-7;
+}
+
+#pragma mark - tests
+
+// peak is the amplitude and RMS the amplitude over root two, per channel, for each format,
+// channel layout and path. 1 kHz at 48 kHz puts a sample on every crest
+static void PBJAudioMeterTestSineLevels(void)
+{
+    static const uint32_t channelCounts[] = { 1, 2, 3, 4, 6, 8 };
+    for (size_t c = 0; c < sizeof(channelCounts) / sizeof(channelCounts[0]); c++) {
+        uint32_t channelCount = channelCounts[c];
+        double amplitudes[PBJAudioMeterMaximumChannels];
+        double frequencies[PBJAudioMeterMaximumChannels];
+        for (uint32_t channel = 0; channel < channelCount; channel++) {
+            amplitudes[channel] = 0.9 / (double)(channel + 1);
+            frequencies[channel] = 1000.0;
+        }
+        for (int format = PBJAudioSampleFormatInt16; format <= PBJAudioSampleFormatFloat32; format++) {
+            size_t frames = 48000;
+            void *samples = PBJAudioMeterTestTone(frames, channelCount, amplitudes, frequencies, (PBJAudioSampleFormat)format);
+            for (size_t l = 0; l < sizeof(PBJAudioMeterTestLevels) / sizeof(PBJAudioMeterTestLevels[0]); l++) {
+                PBJSIMDLevel level = PBJAudioMeterTestLevels[l];
+                if (PBJSIMDLevelResolve(level) != level)
+                    continue;
+                PBJAudioMeter *meter = PBJAudioMeterTestCreate(channelCount, 0);
+                PBJAudioMeterProcess(meter, samples, frames, (PBJAudioSampleFormat)format, level);
+                PBJAudioLevels levels;
+                PBJAudioMeterRead(meter, &levels);
+                PBJTestCheck(levels.frames == frames && levels.channelCount == channelCount);
+                PBJTestCheck(levels.clippedSamples == 0);
+                // int16 quantizes to half a step
+                double quantum = format == PBJAudioSampleFormatInt16 ? 1.0 / 32768.0 : 1e-7;
+                for (uint32_t channel = 0; channel < channelCount; channel++) {
+                    PBJTestCheck(fabs(levels.peak[channel] - amplitudes[channel]) <= quantum);
+                    PBJTestCheck(PBJAudioMeterTestClose(levels.rms[channel], amplitudes[channel] / sqrt(2.0), 1e-4));
+                }
+                PBJAudioMeterDestroy(meter);
+            }
+            free(samples);
+        }
+    }
+}
+
+// buffers of every length around the vector width, split anywhere, meter the same as one
+// buffer through the scalar path
+static void PBJAudioMeterTestPathsAgree(void)
+{
+    PBJTestRandom random = PBJTestRandomMake(5);
+    static const uint32_t channelCounts[] = { 1, 2, 4 };
+    for (size_t c = 0; c < sizeof(channelCounts) / sizeof(channelCounts[0]); c++) {
+        uint32_t channelCount = channelCounts[c];
+        for (int format = PBJAudioSampleFormatInt16; format <= PBJAudioSampleFormatFloat32; format++) {
+            for (size_t frames = 1; frames < 40; frames++) {
+                size_t count = frames * channelCount;
+                float floatSamples[160];
+                int16_t int16Samples[160];
+                for (size_t i = 0; i < count; i++) {
+                    int16Samples[i] = (int16_t)PBJTestRandomBetween(&random, -32768, 32767);
+                    floatSamples[i] = (float)int16Samples[i] / 32768.0f;
+                }
+                const void *samples = format == PBJAudioSampleFormatInt16 ? (const void *)int16Samples : (const void *)floatSamples;
+
+                PBJAudioMeter *reference = PBJAudioMeterTestCreate(channelCount, 4);
+                PBJAudioMeterProcess(reference, samples, frames, (PBJAudioSampleFormat)format, PBJSIMDLevelScalar);
+                PBJAudioLevels expected;
+                PBJAudioMeterRead(reference, &expected);
+                PBJAudioMeterDestroy(reference);
+
+                for (size_t l = 0; l < sizeof(PBJAudioMeterTestLevels) / sizeof(PBJAudioMeterTestLevels[0]); l++) {
+                    PBJSIMDLevel level = PBJAudioMeterTestLevels[l];
+                    if (PBJSIMDLevelResolve(level) != level)
+                        continue;
+                    PBJAudioMeter *meter = PBJAudioMeterTestCreate(channelCount, 4);
+                    size_t split = (size_t)PBJTestRandomBelow(&random, frames + 1);
+                    size_t bytesPerFrame = channelCount * (format == PBJAudioSampleFormatInt16 ? sizeof(int16_t) : sizeof(float));
+                    PBJAudioMeterProcess(meter, samples, split, (PBJAudioSampleFormat)format, level);
+                    PBJAudioMeterProcess(meter, (const uint8_t *)samples + split * bytesPerFrame, frames - split, (PBJAudioSampleFormat)format, level);
+                    PBJAudioLevels levels;
+                    PBJAudioMeterRead(meter, &levels);
+                    PBJTestCheck(levels.frames == expected.frames);
+                    PBJTestCheck(levels.clippedSamples == expected.clippedSamples);
+                    for (uint32_t channel = 0; channel < channelCount; channel++) {
+                        // the peak is exact, the vector sums square in single precision
+                        PBJTestCheck(levels.peak[channel] == expected.peak[channel]);
+                        PBJTestCheck(PBJAudioMeterTestClose(levels.rms[channel], expected.rms[channel], 1e-5));
+                    }
+                    for (uint32_t band = 0; band < 4; band++)
+                        PBJTestCheck(PBJAudioMeterTestClose(levels.bandRMS[band], expected.bandRMS[band], 1e-4));
+                    PBJAudioMeterDestroy(meter);
+                }
+            }
+        }
+    }
+}
+
+static void PBJAudioMeterTestClipping(void)
+{
+    static const float values[] = { 0.0f, 0.5f, -0.99f, 32767.0f / 32768.0f, -1.0f, 1.0f, 1.5f, -2.0f, 0.999f, -0.25f, 1.0f, 0.1f };
+    size_t count = sizeof(values) / sizeof(values[0]);
+    for (size_t l = 0; l < sizeof(PBJAudioMeterTestLevels) / sizeof(PBJAudioMeterTestLevels[0]); l++) {
+        PBJSIMDLevel level = PBJAudioMeterTestLevels[l];
+        if (PBJSIMDLevelResolve(level) != level)
+            continue;
+        PBJAudioMeter *meter = PBJAudioMeterTestCreate(2, 0);
+        PBJAudioMeterProcess(meter, values, count / 2, PBJAudioSampleFormatFloat32, level);
+        PBJAudioLevels levels;
+        PBJAudioMeterRead(meter, &levels);
+        // at or above 32767/32768 in either direction
+        PBJTestCheck(levels.clippedSamples == 6);
+        PBJTestCheck(levels.peak[0] == 1.5f && levels.peak[1] == 2.0f);
+
+        // int16 full scale clips on both rails
+        int16_t int16Values[8] = { 32767, -32768, 32766, -32767, 0, 100, -32768, 32767 };
+        PBJAudioMeterProcess(meter, int16Values, 4, PBJAudioSampleFormatInt16, level);
+        PBJAudioMeterRead(meter, &levels);
+        PBJTestCheck(levels.clippedSamples == 5);
+        PBJTestCheck(levels.peak[0] == 1.0f && levels.peak[1] == 1.0f);
+        PBJAudioMeterDestroy(meter);
+    }
+}
+
+// a window holds what was processed since the last read, DC has an RMS of its magnitude
+static void PBJAudioMeterTestWindows(void)
+{
+    PBJAudioMeter *meter = PBJAudioMeterTestCreate(1, 0);
+    float loud[1000];
+    float quiet[3000];
+    for (size_t i = 0; i < 1000; i++)
+        loud[i] = -0.5f;
+    for (size_t i = 0; i < 3000; i++)
+        quiet[i] = 0.25f;
+    PBJAudioMeterProcess(meter, loud, 1000, PBJAudioSampleFormatFloat32, PBJSIMDLevelAuto);
+    PBJAudioMeterProcess(meter, quiet, 3000, PBJAudioSampleFormatFloat32, PBJSIMDLevelAuto);
+    PBJAudioLevels levels;
+    PBJAudioMeterRead(meter, &levels);
+    PBJTestCheck(levels.frames == 4000 && levels.peak[0] == 0.5f);
+    PBJTestCheck(PBJAudioMeterTestClose(levels.rms[0], sqrt((1000 * 0.25 + 3000 * 0.0625) / 4000.0), 1e-6));
+
+    PBJAudioMeterProcess(meter, quiet, 3000, PBJAudioSampleFormatFloat32, PBJSIMDLevelAuto);
+    PBJAudioMeterRead(meter, &levels);
+    PBJTestCheck(levels.frames == 3000 && levels.peak[0] == 0.25f && PBJAudioMeterTestClose(levels.rms[0], 0.25, 1e-6));
+
+    // an empty window reads as silence
+    PBJAudioMeterRead(meter, &levels);
+    PBJTestCheck(levels.frames == 0 && levels.peak[0] == 0.0f && levels.rms[0] == 0.0f);
+    PBJTestCheck(PBJAudioLevelToDecibels(levels.rms[0]) == -180.0f);
+    PBJTestCheck(fabsf(PBJAudioLevelToDecibels(0.5f) + 6.0206f) < 1e-3f);
+    PBJAudioMeterDestroy(meter);
+}
+
+// a tone at a band's center passes at unity gain and the bands an octave or more away
+// attenuate it, a tone between two bands splits between them
+static void PBJAudioMeterTestBands(void)
+{
+    uint32_t bandCount = 8;
+    PBJAudioMeter *probe = PBJAudioMeterTestCreate(1, bandCount);
+    PBJAudioLevels centers;
+    PBJAudioMeterRead(probe, &centers);
+    PBJAudioMeterDestroy(probe);
+    PBJTestCheck(centers.bandCount == bandCount);
+    PBJTestCheck(PBJAudioMeterTestClose(centers.bandFrequencies[0], 63.0, 1e-6));
+    PBJTestCheck(PBJAudioMeterTestClose(centers.bandFrequencies[bandCount - 1], 12000.0, 1e-6));
+    for (uint32_t band = 1; band < bandCount; band++)
+        PBJTestCheck(PBJAudioMeterTestClose(centers.bandFrequencies[band] / centers.bandFrequencies[band - 1],
+                                            centers.bandFrequencies[1] / centers.bandFrequencies[0], 1e-4));
+
+    for (uint32_t target = 0; target < bandCount; target++) {
+        double amplitude = 0.5;
+        double frequency = centers.bandFrequencies[target];
+        size_t frames = 96000;
+        void *samples = PBJAudioMeterTestTone(frames, 1, &amplitude, &frequency, PBJAudioSampleFormatFloat32);
+        for (size_t l = 0; l < sizeof(PBJAudioMeterTestLevels) / sizeof(PBJAudioMeterTestLevels[0]); l++) {
+            PBJSIMDLevel level = PBJAudioMeterTestLevels[l];
+            if (PBJSIMDLevelResolve(level) != level)
+                continue;
+            PBJAudioMeter *meter = PBJAudioMeterTestCreate(1, bandCount);
+            // the first half settles the filters
+            PBJAudioMeterProcess(meter, samples, frames / 2, PBJAudioSampleFormatFloat32, level);
+            PBJAudioLevels levels;
+            PBJAudioMeterRead(meter, &levels);
+            PBJAudioMeterProcess(meter, (const float *)samples + frames / 2, frames / 2, PBJAudioSampleFormatFloat32, level);
+            PBJAudioMeterRead(meter, &levels);
+            double rms = amplitude / sqrt(2.0);
+            PBJTestCheck(PBJAudioMeterTestClose(levels.bandRMS[target], rms, 0.01));
+            for (uint32_t band = 0; band < bandCount; band++) {
+                uint32_t distance = band > target ? band - target : target - band;
+                if (distance >= 2)
+                    PBJTestCheck(levels.bandRMS[band] < 0.2 * rms);
+                else if (distance == 1)
+                    PBJTestCheck(levels.bandRMS[band] < 0.6 * rms);
+            }
+            PBJAudioMeterDestroy(meter);
+        }
+        free(samples);
+    }
+
+    // halfway between two centers, on the log scale, both see the same share
+    double amplitude = 0.5;
+    double frequency = sqrt((double)centers.bandFrequencies[3] * centers.bandFrequencies[4]);
+    void *samples = PBJAudioMeterTestTone(96000, 1, &amplitude, &frequency, PBJAudioSampleFormatFloat32);
+    PBJAudioMeter *meter = PBJAudioMeterTestCreate(1, bandCount);
+    PBJAudioMeterProcess(meter, samples, 48000, PBJAudioSampleFormatFloat32, PBJSIMDLevelAuto);
+    PBJAudioLevels levels;
+    PBJAudioMeterRead(meter, &levels);
+    PBJAudioMeterProcess(meter, (const float *)samples + 48000, 48000, PBJAudioSampleFormatFloat32, PBJSIMDLevelAuto);
+    PBJAudioMeterRead(meter, &levels);
+    PBJTestCheck(PBJAudioMeterTestClose(levels.bandRMS[3], levels.bandRMS[4], 0.02));
+    PBJTestCheck(levels.bandRMS[3] > 0.3 * amplitude / sqrt(2.0));
+    PBJAudioMeterDestroy(meter);
+    free(samples);
+}
+
+// the band-pass mixes channels down, antiphase channels cancel and silence stays silent
+static void PBJAudioMeterTestBandMix(void)
+{
+    double amplitudes[2] = { 0.5, 0.5 };
+    double frequencies[2] = { 1000.0, 1000.0 };
+    float *samples = (float *)PBJAudioMeterTestTone(48000, 2, amplitudes, frequencies, PBJAudioSampleFormatFloat32);
+    for (size_t i = 0; i < 48000; i++)
+        samples[i * 2 + 1] = -samples[i * 2];
+    PBJAudioMeter *meter = PBJAudioMeterTestCreate(2, 8);
+    PBJAudioMeterProcess(meter, samples, 48000, PBJAudioSampleFormatFloat32, PBJSIMDLevelAuto);
+    PBJAudioLevels levels;
+    PBJAudioMeterRead(meter, &levels);
+    PBJTestCheck(PBJAudioMeterTestClose(levels.rms[0], levels.rms[1], 1e-6));
+    for (uint32_t band = 0; band < 8; band++)
+        PBJTestCheck(levels.bandRMS[band] < 1e-6f);
+
+    // ringing from a burst is gone after a reset, but not after a read
+    for (size_t i = 0; i < 48000; i++)
+        samples[i * 2 + 1] = samples[i * 2];
+    float silence[256] = { 0 };
+    PBJAudioMeterProcess(meter, samples, 4800, PBJAudioSampleFormatFloat32, PBJSIMDLevelAuto);
+    PBJAudioMeterRead(meter, &levels);
+    PBJAudioMeterProcess(meter, silence, 128, PBJAudioSampleFormatFloat32, PBJSIMDLevelAuto);
+    PBJAudioMeterRead(meter, &levels);
+    PBJTestCheck(levels.peak[0] == 0.0f);
+    float ringing = 0.0f;
+    for (uint32_t band = 0; band < 8; band++)
+        ringing = fmaxf(ringing, levels.bandRMS[band]);
+    PBJTestCheck(ringing > 1e-3f);
+
+    PBJAudioMeterReset(meter);
+    PBJAudioMeterProcess(meter, silence, 128, PBJAudioSampleFormatFloat32, PBJSIMDLevelAuto);
+    PBJAudioMeterRead(meter, &levels);
+    for (uint32_t band = 0; band < 8; band++)
+        PBJTestCheck(levels.bandRMS[band] < 1e-9f);
+    PBJAudioMeterDestroy(meter);
+    free(samples);
+}
+
+static void PBJAudioMeterTestConfiguration(void)
+{
+    PBJAudioMeterConfiguration configuration = PBJAudioMeterDefaultConfiguration(48000.0, 0);
+    PBJTestCheck(PBJAudioMeterCreate(&configuration) == NULL);
+    configuration.channelCount = PBJAudioMeterMaximumChannels + 1;
+    PBJTestCheck(PBJAudioMeterCreate(&configuration) == NULL);
+    configuration.channelCount = 2;
+    configuration.bandCount = PBJAudioMeterMaximumBands + 1;
+    PBJTestCheck(PBJAudioMeterCreate(&configuration) == NULL);
+    configuration.bandCount = 4;
+    configuration.sampleRate = 0.0;
+    PBJTestCheck(PBJAudioMeterCreate(&configuration) == NULL);
+
+    // bands stay below nyquist at a low rate
+    configuration.sampleRate = 8000.0;
+    PBJAudioMeter *meter = PBJAudioMeterCreate(&configuration);
+    PBJTestCheck(meter != NULL);
+    PBJAudioLevels levels;
+    PBJAudioMeterRead(meter, &levels);
+    PBJTestCheck(levels.bandFrequencies[3] <= 3600.0f);
+    PBJAudioMeterDestroy(meter);
+}
+
+int main(void)
+{
+    PBJAudioMeterTestSineLevels();
+    PBJAudioMeterTestPathsAgree();
+    PBJAudioMeterTestClipping();
+    PBJAudioMeterTestWindows();
+    PBJAudioMeterTestBands();
+    PBJAudioMeterTestBandMix();
+    PBJAudioMeterTestConfiguration();
+    return 0;
+}
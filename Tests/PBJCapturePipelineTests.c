@@ -0,0 +1,574 @@
+//
+//  PBJCapturePipelineTests.c
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#include "PBJCapturePipeline.h"
+#include "PBJSyntheticCaptureSource.h"
+#include "PBJTestSupport.h"
+
+// the pipeline's state machine and the result of every sample it's handed. transitions that
+// don't apply have to be refused and leave the state alone, samples wait for the writer's
+// inputs and audio for the first written frame, pauses and interruptions have to come out of
+// the rebased timestamps, and the maximum duration has to be reported once per recording.
+// last, the synthetic source with a script of pauses and interruptions against a model of
+// what the pipeline should do with each item, with and without interleaving
+
+#define PBJ_PIPELINE_TEST_NS PBJ_TEST_NSEC_PER_SEC
+
+static const PBJTime PBJCapturePipelineTestNoDuration = { 0, 0 };
+
+#pragma mark - sink
+
+typedef struct {
+    int setupFailures[PBJCaptureTrackCount]; // calls refused before the input is ready
+    int failWrites;
+    int setups[PBJCaptureTrackCount];
+    uint64_t writes[PBJCaptureTrackCount];
+    const void *lastPayload[PBJCaptureTrackCount];
+    PBJTime lastRebased[PBJCaptureTrackCount];
+    int64_t lastRebasedNanoseconds[PBJCaptureTrackCount];
+    int backwards; // a track's rebased timestamps went back
+    int ahead; // a rebased timestamp was past the captured one
+    int maximumDurationReached;
+    int64_t retained;
+} PBJCapturePipelineTestSink;
+
+static int PBJCapturePipelineTestSetupTrack(void *context, const PBJCaptureSample *sample)
+{
+    PBJCapturePipelineTestSink *sink = (PBJCapturePipelineTestSink *)context;
+    sink->setups[sample->track]++;
+    return sink->setups[sample->track] > sink->setupFailures[sample->track];
+}
+
+static int PBJCapturePipelineTestWriteSample(void *context, const PBJCaptureSample *sample, PBJTime rebasedPresentationTimestamp)
+{
+    PBJCapturePipelineTestSink *sink = (PBJCapturePipelineTestSink *)context;
+    if (sink->failWrites)
+        return 0;
+
+    int64_t time = PBJTimeGetNanoseconds(rebasedPresentationTimestamp);
+    if (sink->writes[sample->track] > 0 && time <= sink->lastRebasedNanoseconds[sample->track])
+        sink->backwards++;
+    if (time > PBJTimeGetNanoseconds(sample->presentationTimestamp))
+        sink->ahead++;
+    sink->lastRebased[sample->track] = rebasedPresentationTimestamp;
+    sink->lastRebasedNanoseconds[sample->track] = time;
+    sink->lastPayload[sample->track] = sample->payload;
+    sink->writes[sample->track]++;
+    return 1;
+}
+
+static void PBJCapturePipelineTestMaximumDurationReached(void *context)
+{
+    ((PBJCapturePipelineTestSink *)context)->maximumDurationReached++;
+}
+
+// payloads outlive the pipeline here, only the balance is kept
+static void PBJCapturePipelineTestRetainPayload(void *context, void *payload)
+{
+    ((PBJCapturePipelineTestSink *)context)->retained++;
+}
+
+static void PBJCapturePipelineTestReleasePayload(void *context, void *payload)
+{
+    ((PBJCapturePipelineTestSink *)context)->retained--;
+}
+
+static PBJCapturePipeline *PBJCapturePipelineTestCreate(PBJCapturePipelineTestSink *sink, int interleave)
+{
+    memset(sink, 0, sizeof(*sink));
+    PBJCapturePipelineSink callbacks = {
+        sink, PBJCapturePipelineTestSetupTrack, PBJCapturePipelineTestWriteSample, PBJCapturePipelineTestMaximumDurationReached,
+        interleave ? PBJCapturePipelineTestRetainPayload : NULL, interleave ? PBJCapturePipelineTestReleasePayload : NULL
+    };
+    PBJCapturePipeline *pipeline = PBJCapturePipelineCreate(callbacks);
+    PBJTestCheck(pipeline != NULL);
+    return pipeline;
+}
+
+// frames in a 600 timescale at 30 fps, audio in 1024 frame buffers at 44.1kHz
+static PBJCaptureSample PBJCapturePipelineTestFrame(int64_t frame)
+{
+    PBJCaptureSample sample = { PBJCaptureTrackVideo, PBJTimeMake(6000 + frame * 20, 600), PBJCapturePipelineTestNoDuration, NULL };
+    return sample;
+}
+
+static PBJCaptureSample PBJCapturePipelineTestAudio(int64_t buffer)
+{
+    PBJCaptureSample sample = { PBJCaptureTrackAudio, PBJTimeMake(441000 + buffer * 1024, 44100), PBJTimeMake(1024, 44100), NULL };
+    return sample;
+}
+
+static uint64_t PBJCapturePipelineTestCount(const PBJCapturePipeline *pipeline, PBJCaptureTrack track, PBJCapturePipelineSampleResult result)
+{
+    return PBJCapturePipelineGetSampleCount(pipeline, track, result);
+}
+
+#pragma mark - state
+
+static void PBJCapturePipelineTestTransitions(void)
+{
+    PBJCapturePipelineTestSink sink;
+    PBJCapturePipeline *pipeline = PBJCapturePipelineTestCreate(&sink, 0);
+    PBJTestCheck(PBJCapturePipelineGetState(pipeline) == PBJCapturePipelineStateIdle);
+
+    // nothing to pause, resume or stop before a start, an interruption changes nothing
+    PBJTestCheck(!PBJCapturePipelinePause(pipeline));
+    PBJTestCheck(!PBJCapturePipelineResume(pipeline));
+    PBJTestCheck(!PBJCapturePipelineStop(pipeline));
+    PBJCapturePipelineInterrupt(pipeline);
+    PBJTestCheck(PBJCapturePipelineGetState(pipeline) == PBJCapturePipelineStateIdle);
+
+    PBJTestCheck(PBJCapturePipelineStart(pipeline));
+    PBJTestCheck(PBJCapturePipelineGetState(pipeline) == PBJCapturePipelineStateRecording);
+    PBJTestCheck(!PBJCapturePipelineStart(pipeline));
+    PBJTestCheck(!PBJCapturePipelineResume(pipeline));
+    PBJCapturePipelineInterrupt(pipeline);
+    PBJTestCheck(PBJCapturePipelineGetState(pipeline) == PBJCapturePipelineStateRecording);
+
+    PBJTestCheck(PBJCapturePipelinePause(pipeline));
+    PBJTestCheck(PBJCapturePipelineGetState(pipeline) == PBJCapturePipelineStatePaused);
+    PBJTestCheck(!PBJCapturePipelinePause(pipeline));
+    PBJTestCheck(!PBJCapturePipelineStart(pipeline));
+    PBJCapturePipelineInterrupt(pipeline);
+    PBJTestCheck(PBJCapturePipelineGetState(pipeline) == PBJCapturePipelineStatePaused);
+
+    PBJTestCheck(PBJCapturePipelineResume(pipeline));
+    PBJTestCheck(PBJCapturePipelineGetState(pipeline) == PBJCapturePipelineStateRecording);
+
+    // a paused recording can be stopped outright
+    PBJTestCheck(PBJCapturePipelinePause(pipeline));
+    PBJTestCheck(PBJCapturePipelineStop(pipeline));
+    PBJTestCheck(PBJCapturePipelineGetState(pipeline) == PBJCapturePipelineStateIdle);
+    PBJTestCheck(!PBJCapturePipelineStop(pipeline));
+    PBJTestCheck(!PBJCapturePipelineResume(pipeline));
+    PBJTestCheck(!PBJCapturePipelinePause(pipeline));
+    PBJTestCheck(PBJCapturePipelineGetState(pipeline) == PBJCapturePipelineStateIdle);
+
+    PBJTestCheck(PBJCapturePipelineStart(pipeline));
+    PBJTestCheck(PBJCapturePipelineStop(pipeline));
+    PBJTestCheck(PBJCapturePipelineGetState(pipeline) == PBJCapturePipelineStateIdle);
+
+    // the sink never heard from any of it
+    PBJTestCheck(sink.setups[PBJCaptureTrackVideo] == 0 && sink.writes[PBJCaptureTrackVideo] == 0);
+    PBJCapturePipelineDestroy(pipeline);
+}
+
+#pragma mark - samples
+
+// nothing is written until setupTrack has succeeded for video and, while audio is enabled, for
+// audio too. a refused setup is asked again with the next sample of its track, never once it
+// has succeeded, and a new recording sets both inputs up afresh
+static void PBJCapturePipelineTestWriterReadiness(void)
+{
+    PBJCapturePipelineTestSink sink;
+    PBJCapturePipeline *pipeline = PBJCapturePipelineTestCreate(&sink, 0);
+    sink.setupFailures[PBJCaptureTrackVideo] = 2;
+    sink.setupFailures[PBJCaptureTrackAudio] = 1;
+
+    PBJCaptureSample sample = PBJCapturePipelineTestFrame(0);
+    PBJTestCheck(PBJCapturePipelineProcessSample(pipeline, &sample) == PBJCapturePipelineSampleDroppedNotRecording);
+    PBJTestCheck(sink.setups[PBJCaptureTrackVideo] == 0);
+
+    PBJTestCheck(PBJCapturePipelineStart(pipeline));
+    // a fresh recording has no counts, the idle frame went with the last one
+    PBJTestCheck(PBJCapturePipelineTestCount(pipeline, PBJCaptureTrackVideo, PBJCapturePipelineSampleDroppedNotRecording) == 0);
+
+    sample = PBJCapturePipelineTestAudio(0);
+    PBJTestCheck(PBJCapturePipelineProcessSample(pipeline, &sample) == PBJCapturePipelineSampleDroppedWriterNotReady);
+    sample = PBJCapturePipelineTestFrame(1);
+    PBJTestCheck(PBJCapturePipelineProcessSample(pipeline, &sample) == PBJCapturePipelineSampleDroppedWriterNotReady);
+    // audio's input is ready now, video's still isn't
+    sample = PBJCapturePipelineTestAudio(1);
+    PBJTestCheck(PBJCapturePipelineProcessSample(pipeline, &sample) == PBJCapturePipelineSampleDroppedWriterNotReady);
+    sample = PBJCapturePipelineTestFrame(2);
+    PBJTestCheck(PBJCapturePipelineProcessSample(pipeline, &sample) == PBJCapturePipelineSampleDroppedWriterNotReady);
+    PBJTestCheck(sink.setups[PBJCaptureTrackVideo] == 2 && sink.setups[PBJCaptureTrackAudio] == 2);
+    PBJTestCheck(sink.writes[PBJCaptureTrackVideo] == 0 && sink.writes[PBJCaptureTrackAudio] == 0);
+    PBJTestCheck(!PBJCapturePipelineHasWrittenVideo(pipeline));
+
+    sample = PBJCapturePipelineTestFrame(3);
+    PBJTestCheck(PBJCapturePipelineProcessSample(pipeline, &sample) == PBJCapturePipelineSampleWritten);
+    PBJTestCheck(PBJCapturePipelineHasWrittenVideo(pipeline));
+    sample = PBJCapturePipelineTestAudio(5);
+    PBJTestCheck(PBJCapturePipelineProcessSample(pipeline, &sample) == PBJCapturePipelineSampleWritten);
+    sample = PBJCapturePipelineTestFrame(4);
+    PBJTestCheck(PBJCapturePipelineProcessSample(pipeline, &sample) == PBJCapturePipelineSampleWritten);
+    PBJTestCheck(sink.setups[PBJCaptureTrackVideo] == 3 && sink.setups[PBJCaptureTrackAudio] == 2);
+    PBJTestCheck(sink.writes[PBJCaptureTrackVideo] == 2 && sink.writes[PBJCaptureTrackAudio] == 1);
+    PBJTestCheck(PBJCapturePipelineTestCount(pipeline, PBJCaptureTrackVideo, PBJCapturePipelineSampleDroppedWriterNotReady) == 2);
+    PBJTestCheck(PBJCapturePipelineTestCount(pipeline, PBJCaptureTrackAudio, PBJCapturePipelineSampleDroppedWriterNotReady) == 2);
+    PBJTestCheck(PBJCapturePipelineTestCount(pipeline, PBJCaptureTrackVideo, PBJCapturePipelineSampleWritten) == 2);
+    PBJTestCheck(PBJCapturePipelineTestCount(pipeline, PBJCaptureTrackAudio, PBJCapturePipelineSampleWritten) == 1);
+    PBJTestCheck(PBJCapturePipelineStop(pipeline));
+
+    // the next recording asks again, video waits on the audio input as well as its own
+    PBJTestCheck(PBJCapturePipelineStart(pipeline));
+    PBJTestCheck(PBJCapturePipelineTestCount(pipeline, PBJCaptureTrackVideo, PBJCapturePipelineSampleWritten) == 0);
+    PBJTestCheck(!PBJCapturePipelineHasWrittenVideo(pipeline));
+    sample = PBJCapturePipelineTestFrame(10);
+    PBJTestCheck(PBJCapturePipelineProcessSample(pipeline, &sample) == PBJCapturePipelineSampleDroppedWriterNotReady);
+    PBJTestCheck(sink.setups[PBJCaptureTrackVideo] == 4);
+    sample = PBJCapturePipelineTestFrame(11);
+    PBJTestCheck(PBJCapturePipelineProcessSample(pipeline, &sample) == PBJCapturePipelineSampleDroppedWriterNotReady);
+    PBJTestCheck(sink.setups[PBJCaptureTrackVideo] == 4);
+    sample = PBJCapturePipelineTestAudio(20);
+    PBJTestCheck(PBJCapturePipelineProcessSample(pipeline, &sample) == PBJCapturePipelineSampleDroppedAwaitingVideo);
+    PBJTestCheck(sink.setups[PBJCaptureTrackAudio] == 3);
+    sample = PBJCapturePipelineTestFrame(12);
+    PBJTestCheck(PBJCapturePipelineProcessSample(pipeline, &sample) == PBJCapturePipelineSampleWritten);
+    PBJTestCheck(PBJCapturePipelineStop(pipeline));
+
+    // without audio video only needs its own input
+    PBJCapturePipelineSetAudioEnabled(pipeline, 0);
+    PBJTestCheck(PBJCapturePipelineStart(pipeline));
+    sample = PBJCapturePipelineTestFrame(20);
+    PBJTestCheck(PBJCapturePipelineProcessSample(pipeline, &sample) == PBJCapturePipelineSampleWritten);
+    PBJTestCheck(sink.setups[PBJCaptureTrackVideo] == 5 && sink.setups[PBJCaptureTrackAudio] == 3);
+    PBJCapturePipelineDestroy(pipeline);
+}
+
+// audio is dropped until a frame has actually been written, a frame the writer refused
+// doesn't count
+static void PBJCapturePipelineTestAudioAwaitsVideo(void)
+{
+    PBJCapturePipelineTestSink sink;
+    PBJCapturePipeline *pipeline = PBJCapturePipelineTestCreate(&sink, 0);
+    PBJTestCheck(PBJCapturePipelineStart(pipeline));
+
+    PBJCaptureSample sample = PBJCapturePipelineTestAudio(0);
+    PBJTestCheck(PBJCapturePipelineProcessSample(pipeline, &sample) == PBJCapturePipelineSampleDroppedWriterNotReady);
+    sample = PBJCapturePipelineTestFrame(0);
+    sink.failWrites = 1;
+    PBJTestCheck(PBJCapturePipelineProcessSample(pipeline, &sample) == PBJCapturePipelineSampleDroppedWriteFailed);
+    PBJTestCheck(!PBJCapturePipelineHasWrittenVideo(pipeline));
+    for (int64_t buffer = 1; buffer < 4; buffer++) {
+        sample = PBJCapturePipelineTestAudio(buffer);
+        PBJTestCheck(PBJCapturePipelineProcessSample(pipeline, &sample) == PBJCapturePipelineSampleDroppedAwaitingVideo);
+    }
+    PBJTestCheck(sink.writes[PBJCaptureTrackAudio] == 0);
+
+    sink.failWrites = 0;
+    sample = PBJCapturePipelineTestFrame(1);
+    PBJTestCheck(PBJCapturePipelineProcessSample(pipeline, &sample) == PBJCapturePipelineSampleWritten);
+    PBJTestCheck(PBJCapturePipelineHasWrittenVideo(pipeline));
+    sample = PBJCapturePipelineTestAudio(4);
+    PBJTestCheck(PBJCapturePipelineProcessSample(pipeline, &sample) == PBJCapturePipelineSampleWritten);
+    PBJTestCheck(sink.writes[PBJCaptureTrackAudio] == 1);
+    PBJTestCheck(PBJTimeGetNanoseconds(sink.lastRebased[PBJCaptureTrackAudio]) == PBJTimeGetNanoseconds(sample.presentationTimestamp));
+
+    // a failed audio write leaves video alone
+    sink.failWrites = 1;
+    sample = PBJCapturePipelineTestAudio(5);
+    PBJTestCheck(PBJCapturePipelineProcessSample(pipeline, &sample) == PBJCapturePipelineSampleDroppedWriteFailed);
+    PBJTestCheck(PBJCapturePipelineHasWrittenVideo(pipeline));
+
+    PBJTestCheck(PBJCapturePipelineTestCount(pipeline, PBJCaptureTrackAudio, PBJCapturePipelineSampleDroppedAwaitingVideo) == 3);
+    PBJTestCheck(PBJCapturePipelineTestCount(pipeline, PBJCaptureTrackAudio, PBJCapturePipelineSampleDroppedWriteFailed) == 1);
+    PBJTestCheck(PBJCapturePipelineTestCount(pipeline, PBJCaptureTrackVideo, PBJCapturePipelineSampleDroppedWriteFailed) == 1);
+    PBJCapturePipelineDestroy(pipeline);
+}
+
+// paused frames are dropped and the pause, like an interruption, comes out of the timestamps
+// the writer sees, one frame interval on from the last written frame
+static void PBJCapturePipelineTestPauseAndInterrupt(void)
+{
+    PBJCapturePipelineTestSink sink;
+    PBJCapturePipeline *pipeline = PBJCapturePipelineTestCreate(&sink, 0);
+    PBJCapturePipelineSetAudioEnabled(pipeline, 0);
+    PBJTestCheck(PBJCapturePipelineStart(pipeline));
+
+    PBJCaptureSample sample;
+    for (int64_t frame = 0; frame < 10; frame++) {
+        sample = PBJCapturePipelineTestFrame(frame);
+        PBJTestCheck(PBJCapturePipelineProcessSample(pipeline, &sample) == PBJCapturePipelineSampleWritten);
+        PBJTestCheck(sink.lastRebased[PBJCaptureTrackVideo].value == 6000 + frame * 20 && sink.lastRebased[PBJCaptureTrackVideo].timescale == 600);
+    }
+
+    // a repeated frame, a broken timestamp and an unknown track go nowhere
+    PBJTestCheck(PBJCapturePipelineProcessSample(pipeline, &sample) == PBJCapturePipelineSampleDroppedTimeline);
+    sample.presentationTimestamp = PBJTimeMake(7000, 0);
+    PBJTestCheck(PBJCapturePipelineProcessSample(pipeline, &sample) == PBJCapturePipelineSampleDroppedTimeline);
+    sample = PBJCapturePipelineTestFrame(10);
+    sample.track = PBJCaptureTrackCount;
+    PBJTestCheck(PBJCapturePipelineProcessSample(pipeline, &sample) == PBJCapturePipelineSampleDroppedTimeline);
+    PBJTestCheck(sink.writes[PBJCaptureTrackVideo] == 10);
+
+    PBJTestCheck(PBJCapturePipelinePause(pipeline));
+    for (int64_t frame = 10; frame < 20; frame++) {
+        sample = PBJCapturePipelineTestFrame(frame);
+        PBJTestCheck(PBJCapturePipelineProcessSample(pipeline, &sample) == PBJCapturePipelineSampleDroppedPaused);
+    }
+    PBJTestCheck(sink.writes[PBJCaptureTrackVideo] == 10);
+    PBJTestCheck(PBJCapturePipelineResume(pipeline));
+    sample = PBJCapturePipelineTestFrame(20);
+    PBJTestCheck(PBJCapturePipelineProcessSample(pipeline, &sample) == PBJCapturePipelineSampleWritten);
+    PBJTestCheck(sink.lastRebased[PBJCaptureTrackVideo].value == 6000 + 10 * 20);
+
+    // frames 21 through 29 never arrive
+    PBJCapturePipelineInterrupt(pipeline);
+    PBJTestCheck(PBJCapturePipelineGetState(pipeline) == PBJCapturePipelineStateRecording);
+    sample = PBJCapturePipelineTestFrame(30);
+    PBJTestCheck(PBJCapturePipelineProcessSample(pipeline, &sample) == PBJCapturePipelineSampleWritten);
+    PBJTestCheck(sink.lastRebased[PBJCaptureTrackVideo].value == 6000 + 11 * 20);
+    sample = PBJCapturePipelineTestFrame(31);
+    PBJTestCheck(PBJCapturePipelineProcessSample(pipeline, &sample) == PBJCapturePipelineSampleWritten);
+    PBJTestCheck(sink.lastRebased[PBJCaptureTrackVideo].value == 6000 + 12 * 20);
+    PBJTestCheck(PBJTimeGetNanoseconds(PBJCapturePipelineGetOutputDurationForTrack(pipeline, PBJCaptureTrackVideo)) == 12 * PBJ_PIPELINE_TEST_NS / 30);
+
+    PBJTestCheck(PBJCapturePipelineStop(pipeline));
+    sample = PBJCapturePipelineTestFrame(32);
+    PBJTestCheck(PBJCapturePipelineProcessSample(pipeline, &sample) == PBJCapturePipelineSampleDroppedNotRecording);
+
+    PBJTestCheck(PBJCapturePipelineTestCount(pipeline, PBJCaptureTrackVideo, PBJCapturePipelineSampleWritten) == 13);
+    PBJTestCheck(PBJCapturePipelineTestCount(pipeline, PBJCaptureTrackVideo, PBJCapturePipelineSampleDroppedPaused) == 10);
+    PBJTestCheck(PBJCapturePipelineTestCount(pipeline, PBJCaptureTrackVideo, PBJCapturePipelineSampleDroppedTimeline) == 2);
+    PBJTestCheck(PBJCapturePipelineTestCount(pipeline, PBJCaptureTrackVideo, PBJCapturePipelineSampleDroppedNotRecording) == 1);
+    PBJTestCheck(sink.backwards == 0 && sink.ahead == 0);
+    PBJCapturePipelineDestroy(pipeline);
+}
+
+// a second of file at 30 fps is 30 frames, the 31st is dropped and reported, later ones are
+// dropped without another report, and the next recording reports again
+static void PBJCapturePipelineTestMaximumDuration(void)
+{
+    PBJCapturePipelineTestSink sink;
+    PBJCapturePipeline *pipeline = PBJCapturePipelineTestCreate(&sink, 0);
+    PBJCapturePipelineSetAudioEnabled(pipeline, 0);
+    PBJCapturePipelineSetMaximumDuration(pipeline, PBJTimeMake(1, 1));
+
+    for (int recording = 0; recording < 2; recording++) {
+        PBJTestCheck(PBJCapturePipelineStart(pipeline));
+        for (int64_t frame = 0; frame < 60; frame++) {
+            PBJCaptureSample sample = PBJCapturePipelineTestFrame(recording * 100 + frame);
+            PBJCapturePipelineSampleResult result = PBJCapturePipelineProcessSample(pipeline, &sample);
+            PBJTestCheck(result == (frame < 30 ? PBJCapturePipelineSampleWritten : PBJCapturePipelineSampleDroppedMaximumDuration));
+            PBJTestCheck(sink.maximumDurationReached == recording + (frame >= 30));
+        }
+        // the owner is told to stop, until it does the pipeline is still recording
+        PBJTestCheck(PBJCapturePipelineGetState(pipeline) == PBJCapturePipelineStateRecording);
+        PBJTestCheck(PBJCapturePipelineTestCount(pipeline, PBJCaptureTrackVideo, PBJCapturePipelineSampleWritten) == 30);
+        PBJTestCheck(PBJCapturePipelineTestCount(pipeline, PBJCaptureTrackVideo, PBJCapturePipelineSampleDroppedMaximumDuration) == 30);
+        PBJTestCheck(PBJTimeGetNanoseconds(PBJCapturePipelineGetOutputDurationForTrack(pipeline, PBJCaptureTrackVideo)) == 29 * PBJ_PIPELINE_TEST_NS / 30);
+        PBJTestCheck(PBJCapturePipelineStop(pipeline));
+    }
+    PBJTestCheck(sink.writes[PBJCaptureTrackVideo] == 60 && sink.maximumDurationReached == 2);
+
+    // without a limit nothing is reported
+    PBJCapturePipelineSetMaximumDuration(pipeline, PBJCapturePipelineTestNoDuration);
+    PBJTestCheck(PBJCapturePipelineStart(pipeline));
+    for (int64_t frame = 0; frame < 60; frame++) {
+        PBJCaptureSample sample = PBJCapturePipelineTestFrame(300 + frame);
+        PBJTestCheck(PBJCapturePipelineProcessSample(pipeline, &sample) == PBJCapturePipelineSampleWritten);
+    }
+    PBJTestCheck(sink.maximumDurationReached == 2);
+    PBJCapturePipelineDestroy(pipeline);
+}
+
+#pragma mark - synthetic source
+
+// what the pipeline is expected to do, kept alongside it from the same items
+typedef struct {
+    PBJCapturePipelineState state;
+    int interleave;
+    int setupCalls[PBJCaptureTrackCount];
+    int setupFailures[PBJCaptureTrackCount];
+    int ready[PBJCaptureTrackCount];
+    int videoWritten;
+    uint64_t counts[PBJCaptureTrackCount][PBJCapturePipelineSampleResultCount];
+} PBJCapturePipelineTestModel;
+
+static PBJCapturePipelineSampleResult PBJCapturePipelineTestModelSample(PBJCapturePipelineTestModel *model, const PBJCaptureSample *sample)
+{
+    if (model->state == PBJCapturePipelineStateIdle)
+        return PBJCapturePipelineSampleDroppedNotRecording;
+    if (model->state == PBJCapturePipelineStatePaused)
+        return PBJCapturePipelineSampleDroppedPaused;
+
+    if (!model->ready[sample->track]) {
+        model->setupCalls[sample->track]++;
+        model->ready[sample->track] = model->setupCalls[sample->track] > model->setupFailures[sample->track];
+    }
+
+    // interleaved audio only waits on its own input, the interleaver holds it for video
+    if (model->interleave && sample->track == PBJCaptureTrackAudio)
+        return model->ready[PBJCaptureTrackAudio] ? PBJCapturePipelineSampleQueued : PBJCapturePipelineSampleDroppedWriterNotReady;
+    if (!model->ready[PBJCaptureTrackVideo] || !model->ready[PBJCaptureTrackAudio])
+        return PBJCapturePipelineSampleDroppedWriterNotReady;
+    if (model->interleave)
+        return PBJCapturePipelineSampleQueued;
+
+    if (sample->track == PBJCaptureTrackAudio && !model->videoWritten)
+        return PBJCapturePipelineSampleDroppedAwaitingVideo;
+    if (sample->track == PBJCaptureTrackVideo)
+        model->videoWritten = 1;
+    return PBJCapturePipelineSampleWritten;
+}
+
+static void PBJCapturePipelineTestModelEvent(PBJCapturePipelineTestModel *model, PBJCaptureSourceItemType type)
+{
+    switch (type) {
+        case PBJCaptureSourceItemPause:
+            if (model->state == PBJCapturePipelineStateRecording)
+                model->state = PBJCapturePipelineStatePaused;
+            break;
+        case PBJCaptureSourceItemResume:
+            if (model->state == PBJCapturePipelineStatePaused)
+                model->state = PBJCapturePipelineStateRecording;
+            break;
+        case PBJCaptureSourceItemEnd:
+            model->state = PBJCapturePipelineStateIdle;
+            break;
+        case PBJCaptureSourceItemInterrupt:
+        case PBJCaptureSourceItemSample:
+        default:
+            break;
+    }
+}
+
+// six seconds at 30 fps with audio, paused from 1 to 2, interrupted from 3 to 3.5 and paused
+// again from 4 to 4.5, with a resume and a pause that don't apply, then stopped by the owner at
+// 5.5 ahead of the source's own end. the writer refuses video's input three times
+static void PBJCapturePipelineTestScriptedSource(int interleave, uint64_t *videoWritten)
+{
+    const PBJSyntheticCaptureEvent events[] = {
+        { PBJSyntheticCaptureEventPause, 1 * PBJ_PIPELINE_TEST_NS, 0 },
+        { PBJSyntheticCaptureEventResume, 2 * PBJ_PIPELINE_TEST_NS, 0 },
+        { PBJSyntheticCaptureEventResume, 5 * PBJ_PIPELINE_TEST_NS / 2, 0 },
+        { PBJSyntheticCaptureEventInterrupt, 3 * PBJ_PIPELINE_TEST_NS, PBJ_PIPELINE_TEST_NS / 2 },
+        { PBJSyntheticCaptureEventPause, 4 * PBJ_PIPELINE_TEST_NS, 0 },
+        { PBJSyntheticCaptureEventPause, 17 * PBJ_PIPELINE_TEST_NS / 4, 0 },
+        { PBJSyntheticCaptureEventResume, 9 * PBJ_PIPELINE_TEST_NS / 2, 0 }
+    };
+    PBJSyntheticCaptureSourceConfiguration configuration = PBJSyntheticCaptureSourceDefaultConfiguration(16, 16, 30);
+    configuration.duration = 6 * PBJ_PIPELINE_TEST_NS;
+    configuration.jitter = 2000000;
+    configuration.seed = 7;
+    PBJSyntheticCaptureSource *source = PBJSyntheticCaptureSourceCreate(&configuration, events, sizeof(events) / sizeof(events[0]));
+    PBJTestCheck(source != NULL);
+
+    PBJCapturePipelineTestSink sink;
+    PBJCapturePipeline *pipeline = PBJCapturePipelineTestCreate(&sink, interleave);
+    sink.setupFailures[PBJCaptureTrackVideo] = 3;
+
+    PBJCapturePipelineTestModel model;
+    memset(&model, 0, sizeof(model));
+    model.interleave = interleave;
+    model.setupFailures[PBJCaptureTrackVideo] = 3;
+    model.state = PBJCapturePipelineStateRecording;
+    PBJTestCheck(PBJCapturePipelineStart(pipeline));
+
+    uint64_t samples[PBJCaptureTrackCount] = { 0, 0 };
+    int64_t firstArrival = 0;
+    int stopped = 0;
+    int items = 0;
+    PBJCaptureSourceItem item;
+    while (PBJSyntheticCaptureSourceNextItem(source, &item)) {
+        if (items++ == 0)
+            firstArrival = item.arrivalTime;
+        if (!stopped && item.arrivalTime - firstArrival >= 11 * PBJ_PIPELINE_TEST_NS / 2) {
+            PBJTestCheck(PBJCapturePipelineStop(pipeline));
+            model.state = PBJCapturePipelineStateIdle;
+            stopped = 1;
+        }
+
+        PBJCapturePipelineSampleResult expected = PBJCapturePipelineSampleResultCount;
+        uint64_t writes = 0;
+        if (item.type == PBJCaptureSourceItemSample) {
+            expected = PBJCapturePipelineTestModelSample(&model, &item.sample);
+            writes = sink.writes[item.sample.track];
+            samples[item.sample.track]++;
+        }
+
+        PBJCapturePipelineSampleResult result = PBJCapturePipelineSampleResultCount;
+        PBJCapturePipelineProcessSourceItem(pipeline, &item, &result);
+        PBJCapturePipelineTestModelEvent(&model, item.type);
+        PBJTestCheck(PBJCapturePipelineGetState(pipeline) == model.state);
+
+        if (item.type != PBJCaptureSourceItemSample) {
+            PBJTestCheck(result == PBJCapturePipelineSampleResultCount);
+            continue;
+        }
+        PBJTestCheck(result == expected);
+        if (expected != PBJCapturePipelineSampleQueued)
+            model.counts[item.sample.track][expected]++;
+        if (!interleave) {
+            // exactly the written samples reach the writer, as they are handed over
+            PBJTestCheck(sink.writes[item.sample.track] == writes + (result == PBJCapturePipelineSampleWritten));
+            if (result == PBJCapturePipelineSampleWritten)
+                PBJTestCheck(sink.lastPayload[item.sample.track] == item.sample.payload);
+        }
+    }
+    PBJTestCheck(stopped && model.state == PBJCapturePipelineStateIdle);
+    PBJTestCheck(sink.setups[PBJCaptureTrackVideo] == 4 && sink.setups[PBJCaptureTrackAudio] == 1);
+    PBJTestCheck(sink.backwards == 0 && sink.ahead == 0);
+
+    // every sample is accounted for once the stop has let go of the held ones
+    for (int track = 0; track < PBJCaptureTrackCount; track++) {
+        uint64_t total = 0;
+        for (int result = 0; result < PBJCapturePipelineSampleResultCount; result++) {
+            uint64_t count = PBJCapturePipelineTestCount(pipeline, (PBJCaptureTrack)track, (PBJCapturePipelineSampleResult)result);
+            total += count;
+            if (!interleave)
+                PBJTestCheck(count == model.counts[track][result]);
+        }
+        PBJTestCheck(total == samples[track]);
+        PBJTestCheck(PBJCapturePipelineTestCount(pipeline, (PBJCaptureTrack)track, PBJCapturePipelineSampleQueued) == 0);
+        PBJTestCheck(PBJCapturePipelineTestCount(pipeline, (PBJCaptureTrack)track, PBJCapturePipelineSampleDroppedTimeline) == 0);
+        PBJTestCheck(sink.writes[track] == PBJCapturePipelineTestCount(pipeline, (PBJCaptureTrack)track, PBJCapturePipelineSampleWritten));
+        PBJTestCheck(PBJCapturePipelineTestCount(pipeline, (PBJCaptureTrack)track, PBJCapturePipelineSampleDroppedPaused) ==
+                     model.counts[track][PBJCapturePipelineSampleDroppedPaused]);
+        PBJTestCheck(PBJCapturePipelineTestCount(pipeline, (PBJCaptureTrack)track, PBJCapturePipelineSampleDroppedNotRecording) ==
+                     model.counts[track][PBJCapturePipelineSampleDroppedNotRecording]);
+    }
+    PBJTestCheck(sink.writes[PBJCaptureTrackAudio] > 0);
+    // audio's input is ready before video's fourth try, so only the refused three are dropped
+    PBJTestCheck(PBJCapturePipelineTestCount(pipeline, PBJCaptureTrackVideo, PBJCapturePipelineSampleDroppedWriterNotReady) == 3);
+
+    // a second and a half paused and half a second interrupted take two seconds from the five
+    // and a half, less the first few frames, plus a frame interval where each gap closed
+    double recorded = PBJTimeGetSeconds(PBJCapturePipelineGetOutputDurationForTrack(pipeline, PBJCaptureTrackVideo));
+    PBJTestCheck(recorded > 3.35 && recorded < 3.55);
+    *videoWritten = sink.writes[PBJCaptureTrackVideo];
+
+    PBJCapturePipelineDestroy(pipeline);
+    PBJTestCheck(sink.retained == 0);
+    PBJSyntheticCaptureSourceDestroy(source);
+}
+
+int main(void)
+{
+    PBJCapturePipelineTestTransitions();
+    PBJCapturePipelineTestWriterReadiness();
+    PBJCapturePipelineTestAudioAwaitsVideo();
+    PBJCapturePipelineTestPauseAndInterrupt();
+    PBJCapturePipelineTestMaximumDuration();
+
+    uint64_t videoWritten[2] = { 0, 0 };
+    for (int interleave = 0; interleave < 2; interleave++)
+        PBJCapturePipelineTestScriptedSource(interleave, &videoWritten[interleave]);
+    // holding samples back to interleave them doesn't change which frames are written
+    PBJTestCheck(videoWritten[0] == videoWritten[1]);
+    return 0;
+}
@@ -0,0 +1,351 @@
+//
+//  PBJCaptureRetimerTests.c
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#include "PBJCapturePipeline.h"
+#include "PBJCaptureRetimer.h"
+#include "PBJSyntheticCaptureSource.h"
+#include "PBJTestSupport.h"
+
+// the retimer on exact and jittered timestamp streams against a model of which frames are kept
+// and where they go, then the synthetic capture source through the pipeline at each speed, with
+// pauses and interruptions, with and without interleaving. time-lapse has to keep a frame an
+// interval and lay them out at the output rate, slow motion has to stretch every gap by the
+// speed, audio has to stay out of the file, and a limit on the file's length has to hold
+
+#define PBJ_RETIMER_TEST_NS PBJ_TEST_NSEC_PER_SEC
+
+static const PBJTime PBJRetimerTestNoDuration = { 0, 0 };
+
+#pragma mark - retimer
+
+static PBJCaptureRetimerConfiguration PBJRetimerTestTimeLapse(PBJTime interval, int32_t outputFrameRate)
+{
+    PBJCaptureRetimerConfiguration configuration = PBJCaptureRetimerDefaultConfiguration();
+    configuration.speed = PBJCaptureSpeedTimeLapse;
+    configuration.interval = interval;
+    configuration.outputFrameRate = outputFrameRate;
+    return configuration;
+}
+
+static PBJCaptureRetimerConfiguration PBJRetimerTestSlowMotion(int32_t captureFrameRate, int32_t outputFrameRate)
+{
+    PBJCaptureRetimerConfiguration configuration = PBJCaptureRetimerDefaultConfiguration();
+    configuration.speed = PBJCaptureSpeedSlowMotion;
+    configuration.captureFrameRate = captureFrameRate;
+    configuration.outputFrameRate = outputFrameRate;
+    return configuration;
+}
+
+// 20 seconds at 30 fps in a 600 timescale, a frame every half second kept
+static void PBJRetimerTestTimeLapseExact(void)
+{
+    PBJCaptureRetimerConfiguration configuration = PBJRetimerTestTimeLapse(PBJTimeMake(1, 2), 30);
+    PBJCaptureRetimer *retimer = PBJCaptureRetimerCreate(&configuration);
+    PBJTestCheck(retimer != NULL);
+    PBJTestCheck(!PBJCaptureRetimerKeepsAudio(retimer));
+
+    int64_t kept = 0;
+    PBJTime output;
+    for (int64_t frame = 0; frame < 600; frame++) {
+        PBJCaptureRetimerResult result = PBJCaptureRetimerRetimeFrame(retimer, PBJTimeMake(123456 + frame * 20, 600), &output);
+        if (frame % 15 == 0) {
+            PBJTestCheck(result == PBJCaptureRetimerFrameKept);
+            PBJTestCheck(output.value == 123456 + kept * 20 && output.timescale == 600);
+            kept++;
+        } else {
+            PBJTestCheck(result == PBJCaptureRetimerFrameSkipped);
+        }
+    }
+    PBJCaptureRetimerStatistics statistics = PBJCaptureRetimerGetStatistics(retimer);
+    PBJTestCheck(kept == 40 && statistics.framesKept == 40 && statistics.framesSkipped == 560);
+    PBJTestCheck(PBJCaptureRetimerGetOutputDuration(retimer).value == 39 * 20);
+
+    // going back, or past what the timescale can hold, is refused
+    PBJTestCheck(PBJCaptureRetimerRetimeFrame(retimer, PBJTimeMake(123456, 600), &output) == PBJCaptureRetimerFrameInvalid);
+    PBJTestCheck(PBJCaptureRetimerRetimeFrame(retimer, PBJTimeMake(INT64_MAX / 2, 1000), &output) == PBJCaptureRetimerFrameInvalid);
+
+    // 10 seconds of file at a frame a half second played at 30 fps takes 150 seconds to record
+    PBJTime recorded = PBJCaptureRetimerRecordedDurationForOutputDuration(retimer, PBJTimeMake(6000, 600));
+    PBJTestCheck(PBJTimeIsValid(recorded) && recorded.value == 150 * recorded.timescale);
+
+    // a new recording starts over
+    PBJCaptureRetimerReset(retimer);
+    PBJTestCheck(PBJCaptureRetimerRetimeFrame(retimer, PBJTimeMake(50, 600), &output) == PBJCaptureRetimerFrameKept);
+    PBJTestCheck(output.value == 50 && PBJCaptureRetimerGetStatistics(retimer).framesKept == 1);
+    PBJCaptureRetimerDestroy(retimer);
+}
+
+// a jittered nanosecond stream against the model, the first frame at or past each interval's
+// start is kept and lands a whole output frame after the one before
+static void PBJRetimerTestTimeLapseJittered(void)
+{
+    static const int64_t intervals[] = { PBJ_RETIMER_TEST_NS / 4, PBJ_RETIMER_TEST_NS, 3 * PBJ_RETIMER_TEST_NS + 7 };
+    for (size_t k = 0; k < sizeof(intervals) / sizeof(intervals[0]); k++) {
+        PBJCaptureRetimerConfiguration configuration = PBJRetimerTestTimeLapse(PBJTimeMake(intervals[k], PBJ_RETIMER_TEST_NS), 24);
+        PBJCaptureRetimer *retimer = PBJCaptureRetimerCreate(&configuration);
+        PBJTestCheck(retimer != NULL);
+
+        PBJTestRandom random = PBJTestRandomMake(11 + k);
+        int64_t first = 86400 * PBJ_RETIMER_TEST_NS + 999;
+        int64_t nextKept = first;
+        int64_t kept = 0;
+        for (int64_t frame = 0; frame < 30 * 120; frame++) {
+            // 30 fps, each frame up to 4 ms either side of its slot
+            int64_t time = first + frame * PBJ_RETIMER_TEST_NS / 30 + (frame ? PBJTestRandomBetween(&random, -4000000, 4000000) : 0);
+            PBJTime output;
+            PBJCaptureRetimerResult result = PBJCaptureRetimerRetimeFrame(retimer, PBJTimeMake(time, PBJ_RETIMER_TEST_NS), &output);
+            if (time >= nextKept) {
+                PBJTestCheck(result == PBJCaptureRetimerFrameKept);
+                PBJTestCheck(output.timescale == PBJ_RETIMER_TEST_NS);
+                PBJTestCheck(output.value == first + kept * PBJ_RETIMER_TEST_NS / 24);
+                while (nextKept <= time)
+                    nextKept += intervals[k];
+                kept++;
+            } else {
+                PBJTestCheck(result == PBJCaptureRetimerFrameSkipped);
+            }
+        }
+        PBJTestCheck(kept >= 120 * PBJ_RETIMER_TEST_NS / intervals[k] - 1);
+        PBJCaptureRetimerDestroy(retimer);
+    }
+}
+
+static void PBJRetimerTestSlowMotionStreams(void)
+{
+    PBJCaptureRetimerConfiguration configuration = PBJRetimerTestSlowMotion(240, 30);
+    PBJCaptureRetimer *retimer = PBJCaptureRetimerCreate(&configuration);
+    PBJTestCheck(retimer != NULL);
+    PBJTestCheck(!PBJCaptureRetimerKeepsAudio(retimer));
+
+    // every gap from the first frame stretched eightfold, exactly, jitter and all
+    PBJTestRandom random = PBJTestRandomMake(5);
+    int64_t first = 7 * PBJ_RETIMER_TEST_NS;
+    int64_t previous = first;
+    for (int64_t frame = 0; frame < 240 * 4; frame++) {
+        int64_t time = first + frame * PBJ_RETIMER_TEST_NS / 240 + (frame ? PBJTestRandomBetween(&random, 0, 1000000) : 0);
+        time = time > previous ? time : previous;
+        previous = time;
+        PBJTime output;
+        PBJTestCheck(PBJCaptureRetimerRetimeFrame(retimer, PBJTimeMake(time, PBJ_RETIMER_TEST_NS), &output) == PBJCaptureRetimerFrameKept);
+        PBJTestCheck(output.value == first + (time - first) * 8 && output.timescale == PBJ_RETIMER_TEST_NS);
+    }
+    PBJTestCheck(PBJCaptureRetimerGetOutputDuration(retimer).value == (previous - first) * 8);
+
+    // two seconds of file is a quarter second recorded
+    PBJTime recorded = PBJCaptureRetimerRecordedDurationForOutputDuration(retimer, PBJTimeMake(2, 1));
+    PBJTestCheck(PBJTimeIsValid(recorded) && recorded.value * 4 == recorded.timescale);
+
+    // a speed that doesn't divide evenly still rounds the same way every frame, never backwards
+    configuration = PBJRetimerTestSlowMotion(120, 25);
+    PBJTestCheck(PBJCaptureRetimerSetConfiguration(retimer, &configuration));
+    int64_t last = INT64_MIN;
+    for (int64_t frame = 0; frame < 600; frame++) {
+        PBJTime output;
+        PBJTestCheck(PBJCaptureRetimerRetimeFrame(retimer, PBJTimeMake(first + frame * 25, 3000), &output) == PBJCaptureRetimerFrameKept);
+        PBJTestCheck(output.timescale == 3000 && output.value > last);
+        PBJTestCheck(output.value - first == frame * 25 * 120 / 25);
+        last = output.value;
+    }
+    PBJCaptureRetimerDestroy(retimer);
+}
+
+static void PBJRetimerTestConfigurations(void)
+{
+    PBJCaptureRetimerConfiguration configuration = PBJCaptureRetimerDefaultConfiguration();
+    PBJTestCheck(configuration.speed == PBJCaptureSpeedNormal && PBJCaptureRetimerConfigurationIsValid(&configuration));
+    PBJCaptureRetimer *retimer = PBJCaptureRetimerCreate(&configuration);
+    PBJTestCheck(retimer != NULL && PBJCaptureRetimerKeepsAudio(retimer));
+
+    // normal speed passes timestamps through
+    PBJTime output;
+    PBJTestCheck(PBJCaptureRetimerRetimeFrame(retimer, PBJTimeMake(1001, 30000), &output) == PBJCaptureRetimerFrameKept);
+    PBJTestCheck(output.value == 1001 && output.timescale == 30000);
+
+    // slow motion has to capture faster than it plays
+    PBJCaptureRetimerConfiguration slow = PBJRetimerTestSlowMotion(240, 30);
+    PBJTestCheck(PBJCaptureRetimerSetConfiguration(retimer, &slow));
+    slow.captureFrameRate = 30;
+    PBJTestCheck(!PBJCaptureRetimerConfigurationIsValid(&slow));
+    PBJTestCheck(!PBJCaptureRetimerSetConfiguration(retimer, &slow));
+    PBJTestCheck(PBJCaptureRetimerGetConfiguration(retimer).captureFrameRate == 240);
+
+    PBJCaptureRetimerConfiguration lapse = PBJRetimerTestTimeLapse(PBJTimeMake(0, 1), 30);
+    PBJTestCheck(!PBJCaptureRetimerConfigurationIsValid(&lapse));
+    PBJTestCheck(PBJCaptureRetimerCreate(&lapse) == NULL);
+    lapse = PBJRetimerTestTimeLapse(PBJTimeMake(1, 1), 0);
+    PBJTestCheck(!PBJCaptureRetimerConfigurationIsValid(&lapse));
+    PBJCaptureRetimerDestroy(retimer);
+}
+
+#pragma mark - pipeline
+
+typedef struct {
+    int setups[PBJCaptureTrackCount];
+    uint64_t writes[PBJCaptureTrackCount];
+    int64_t lastVideo;
+    int64_t minimumStep;
+    int64_t maximumStep;
+    int backwards;
+    int maximumDurationReached;
+} PBJRetimerTestSink;
+
+static int PBJRetimerTestSetupTrack(void *context, const PBJCaptureSample *sample)
+{
+    ((PBJRetimerTestSink *)context)->setups[sample->track]++;
+    return 1;
+}
+
+static int PBJRetimerTestWriteSample(void *context, const PBJCaptureSample *sample, PBJTime rebasedPresentationTimestamp)
+{
+    PBJRetimerTestSink *sink = (PBJRetimerTestSink *)context;
+    if (sample->track == PBJCaptureTrackVideo) {
+        int64_t time = PBJTimeGetNanoseconds(rebasedPresentationTimestamp);
+        if (sink->writes[PBJCaptureTrackVideo] > 0) {
+            int64_t step = time - sink->lastVideo;
+            if (step <= 0)
+                sink->backwards++;
+            sink->minimumStep = step < sink->minimumStep ? step : sink->minimumStep;
+            sink->maximumStep = step > sink->maximumStep ? step : sink->maximumStep;
+        }
+        sink->lastVideo = time;
+    }
+    sink->writes[sample->track]++;
+    return 1;
+}
+
+static void PBJRetimerTestMaximumDurationReached(void *context)
+{
+    ((PBJRetimerTestSink *)context)->maximumDurationReached++;
+}
+
+// the synthetic source's payloads live as long as the source, there's nothing to hold
+static void PBJRetimerTestRetainPayload(void *context, void *payload)
+{
+}
+
+static void PBJRetimerTestReleasePayload(void *context, void *payload)
+{
+}
+
+static PBJCapturePipeline *PBJRetimerTestRecord(const PBJCaptureRetimerConfiguration *speed, int32_t frameRate, int64_t duration,
+                                                const PBJSyntheticCaptureEvent *events, size_t eventCount, PBJTime maximumDuration,
+                                                int interleave, PBJRetimerTestSink *sink)
+{
+    memset(sink, 0, sizeof(*sink));
+    sink->minimumStep = INT64_MAX;
+    PBJCapturePipelineSink callbacks = {
+        sink, PBJRetimerTestSetupTrack, PBJRetimerTestWriteSample, PBJRetimerTestMaximumDurationReached,
+        interleave ? PBJRetimerTestRetainPayload : NULL, interleave ? PBJRetimerTestReleasePayload : NULL
+    };
+    PBJCapturePipeline *pipeline = PBJCapturePipelineCreate(callbacks);
+    PBJTestCheck(pipeline != NULL);
+    PBJTestCheck(PBJCapturePipelineSetSpeed(pipeline, speed));
+    PBJCapturePipelineSetMaximumDuration(pipeline, maximumDuration);
+
+    PBJSyntheticCaptureSourceConfiguration configuration = PBJSyntheticCaptureSourceDefaultConfiguration(16, 16, frameRate);
+    configuration.jitter = 2000000;
+    configuration.duration = duration;
+    PBJSyntheticCaptureSource *source = PBJSyntheticCaptureSourceCreate(&configuration, events, eventCount);
+    PBJTestCheck(source != NULL);
+    PBJTestCheck(PBJCapturePipelineStart(pipeline));
+    PBJCapturePipelineRunSource(pipeline, PBJSyntheticCaptureSourceGetSource(source));
+    PBJSyntheticCaptureSourceDestroy(source);
+    return pipeline;
+}
+
+static void PBJRetimerTestPipelineTimeLapse(int interleave)
+{
+    PBJRetimerTestSink sink;
+    PBJCaptureRetimerConfiguration configuration = PBJRetimerTestTimeLapse(PBJTimeMake(1, 1), 30);
+
+    // a minute at 30 fps, a frame a second, paused for 10 seconds and interrupted for 5, so 45 recorded
+    const PBJSyntheticCaptureEvent events[] = {
+        { PBJSyntheticCaptureEventPause, 20 * PBJ_RETIMER_TEST_NS, 0 },
+        { PBJSyntheticCaptureEventResume, 30 * PBJ_RETIMER_TEST_NS, 0 },
+        { PBJSyntheticCaptureEventInterrupt, 40 * PBJ_RETIMER_TEST_NS, 5 * PBJ_RETIMER_TEST_NS }
+    };
+    PBJCapturePipeline *pipeline = PBJRetimerTestRecord(&configuration, 30, 60 * PBJ_RETIMER_TEST_NS, events, 3, PBJRetimerTestNoDuration, interleave, &sink);
+    PBJTestCheck(sink.writes[PBJCaptureTrackVideo] >= 44 && sink.writes[PBJCaptureTrackVideo] <= 46);
+    PBJTestCheck(PBJCapturePipelineGetSampleCount(pipeline, PBJCaptureTrackVideo, PBJCapturePipelineSampleDroppedSpeed) > 40 * 29);
+    // the file plays at 30 fps across the pause and the interruption
+    PBJTestCheck(sink.backwards == 0);
+    PBJTestCheck(sink.minimumStep >= PBJ_RETIMER_TEST_NS / 30 - 1 && sink.maximumStep <= PBJ_RETIMER_TEST_NS / 30 + 1);
+    // audio never reaches the writer, which never sets up an input for it
+    PBJTestCheck(sink.writes[PBJCaptureTrackAudio] == 0 && sink.setups[PBJCaptureTrackAudio] == 0);
+    PBJTestCheck(PBJCapturePipelineGetSampleCount(pipeline, PBJCaptureTrackAudio, PBJCapturePipelineSampleDroppedSpeed) > 0);
+    PBJTime file = PBJCapturePipelineGetOutputDurationForTrack(pipeline, PBJCaptureTrackVideo);
+    PBJTestCheck(PBJTimeGetNanoseconds(file) == (int64_t)(sink.writes[PBJCaptureTrackVideo] - 1) * PBJ_RETIMER_TEST_NS / 30);
+    PBJCapturePipelineDestroy(pipeline);
+
+    // a second of file is 30 recorded seconds
+    pipeline = PBJRetimerTestRecord(&configuration, 30, 60 * PBJ_RETIMER_TEST_NS, NULL, 0, PBJTimeMake(1, 1), interleave, &sink);
+    PBJTestCheck(sink.writes[PBJCaptureTrackVideo] == 30 && sink.maximumDurationReached == 1);
+    PBJCapturePipelineDestroy(pipeline);
+}
+
+static void PBJRetimerTestPipelineSlowMotion(int interleave)
+{
+    PBJRetimerTestSink sink;
+    PBJCaptureRetimerConfiguration configuration = PBJRetimerTestSlowMotion(240, 30);
+
+    // three seconds at 240 fps with a second paused, played at 30
+    const PBJSyntheticCaptureEvent events[] = {
+        { PBJSyntheticCaptureEventPause, 1 * PBJ_RETIMER_TEST_NS, 0 },
+        { PBJSyntheticCaptureEventResume, 2 * PBJ_RETIMER_TEST_NS, 0 }
+    };
+    PBJCapturePipeline *pipeline = PBJRetimerTestRecord(&configuration, 240, 3 * PBJ_RETIMER_TEST_NS, events, 2, PBJRetimerTestNoDuration, interleave, &sink);
+    PBJTestCheck(sink.writes[PBJCaptureTrackVideo] >= 470 && sink.writes[PBJCaptureTrackVideo] <= 481);
+    double file = PBJTimeGetSeconds(PBJCapturePipelineGetOutputDurationForTrack(pipeline, PBJCaptureTrackVideo));
+    double recorded = PBJTimeGetSeconds(PBJCaptureTimelineCapturedDurationForTrack(PBJCapturePipelineGetTimeline(pipeline), PBJCaptureTrackVideo));
+    PBJTestCheck(file > recorded * 7.99 && file < recorded * 8.01);
+    PBJTestCheck(sink.backwards == 0);
+    PBJTestCheck(sink.minimumStep >= 8 * (PBJ_RETIMER_TEST_NS / 240) - 8 && sink.maximumStep <= 8 * (PBJ_RETIMER_TEST_NS / 240) + 8);
+    PBJTestCheck(sink.writes[PBJCaptureTrackAudio] == 0);
+    PBJCapturePipelineDestroy(pipeline);
+
+    // two seconds of file is a quarter second recorded, 60 frames
+    pipeline = PBJRetimerTestRecord(&configuration, 240, 3 * PBJ_RETIMER_TEST_NS, NULL, 0, PBJTimeMake(2, 1), interleave, &sink);
+    PBJTestCheck(sink.writes[PBJCaptureTrackVideo] == 60 && sink.maximumDurationReached == 1);
+    PBJCapturePipelineDestroy(pipeline);
+
+    // back at normal speed every frame and the audio are written
+    PBJCaptureRetimerConfiguration normal = PBJCaptureRetimerDefaultConfiguration();
+    pipeline = PBJRetimerTestRecord(&normal, 30, 2 * PBJ_RETIMER_TEST_NS, NULL, 0, PBJRetimerTestNoDuration, interleave, &sink);
+    PBJTestCheck(sink.writes[PBJCaptureTrackVideo] >= 59 && sink.writes[PBJCaptureTrackAudio] > 80);
+    PBJCapturePipelineDestroy(pipeline);
+}
+
+int main(void)
+{
+    PBJRetimerTestConfigurations();
+    PBJRetimerTestTimeLapseExact();
+    PBJRetimerTestTimeLapseJittered();
+    PBJRetimerTestSlowMotionStreams();
+    for (int interleave = 0; interleave < 2; interleave++) {
+        PBJRetimerTestPipelineTimeLapse(interleave);
+        PBJRetimerTestPipelineSlowMotion(interleave);
+    }
+    return 0;
+}
@@ -0,0 +1,279 @@
+//
+//  PBJCaptureTimelineTests.c
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#include "PBJCaptureTimeline.h"
+#include "PBJTestSupport.h"
+
+// hours-long sessions with randomized pauses and interruptions, on the host clock video
+// arrives on and the audio sample clock, checking every property the writer relies on
+
+#define PBJ_TIMELINE_TEST_HOST_TIMESCALE 1000000000LL
+#define PBJ_TIMELINE_TEST_AUDIO_TIMESCALE 44100LL
+#define PBJ_TIMELINE_TEST_AUDIO_FRAMES 1024LL
+
+static const PBJTime PBJTimelineTestNoDuration = { 0, 0 };
+
+// the first frame after every resume must make it into the recording
+static void PBJTimelineTestVideoOnlyResume(void)
+{
+    PBJCaptureTimeline *timeline = PBJCaptureTimelineCreate();
+    PBJCaptureTimelineStart(timeline);
+
+    PBJTime rebased;
+    int64_t frame = 1000;
+    for (int i = 0; i < 30; i++, frame++)
+        PBJTestCheck(PBJCaptureTimelineAppendSample(timeline, PBJCaptureTrackVideo, PBJTimeMake(frame, 30), PBJTimelineTestNoDuration, &rebased) == PBJCaptureTimelineSampleAccepted);
+    PBJTestCheck(rebased.value == 1029 && rebased.timescale == 30);
+
+    PBJCaptureTimelinePause(timeline);
+    frame += 90;
+    PBJCaptureTimelineResume(timeline);
+    PBJTestCheck(PBJCaptureTimelineAppendSample(timeline, PBJCaptureTrackVideo, PBJTimeMake(frame, 30), PBJTimelineTestNoDuration, &rebased) == PBJCaptureTimelineSampleAccepted);
+    PBJTestCheck(rebased.value == 1030);
+    PBJTestCheck(PBJCaptureTimelineGapCount(timeline) == 1);
+    PBJTestCheck(PBJCaptureTimelineGapDuration(timeline).value * 30 == 90 * PBJCaptureTimelineGapDuration(timeline).timescale);
+
+    // an interruption with no frame interval known yet still resumes past the last frame
+    PBJCaptureTimelineStart(timeline);
+    PBJTestCheck(PBJCaptureTimelineAppendSample(timeline, PBJCaptureTrackVideo, PBJTimeMake(500, 600), PBJTimelineTestNoDuration, &rebased) == PBJCaptureTimelineSampleAccepted);
+    PBJCaptureTimelineInterrupt(timeline);
+    PBJTestCheck(PBJCaptureTimelineAppendSample(timeline, PBJCaptureTrackVideo, PBJTimeMake(9000, 600), PBJTimelineTestNoDuration, &rebased) == PBJCaptureTimelineSampleAccepted);
+    PBJTestCheck(rebased.value == 501 && rebased.timescale == 600);
+
+    PBJCaptureTimelineDestroy(timeline);
+}
+
+// with durations the next sample follows on exactly from the last one's end
+static void PBJTimelineTestAudioResume(void)
+{
+    PBJCaptureTimeline *timeline = PBJCaptureTimelineCreate();
+    PBJCaptureTimelineStart(timeline);
+
+    PBJTime rebased;
+    PBJTime duration = PBJTimeMake(PBJ_TIMELINE_TEST_AUDIO_FRAMES, PBJ_TIMELINE_TEST_AUDIO_TIMESCALE);
+    int64_t value = 7 * PBJ_TIMELINE_TEST_AUDIO_TIMESCALE;
+    for (int i = 0; i < 10; i++, value += PBJ_TIMELINE_TEST_AUDIO_FRAMES)
+        PBJTestCheck(PBJCaptureTimelineAppendSample(timeline, PBJCaptureTrackAudio, PBJTimeMake(value, PBJ_TIMELINE_TEST_AUDIO_TIMESCALE), duration, &rebased) == PBJCaptureTimelineSampleAccepted);
+    int64_t end = rebased.value + PBJ_TIMELINE_TEST_AUDIO_FRAMES;
+
+    PBJCaptureTimelinePause(timeline);
+    PBJCaptureTimelineResume(timeline);
+    value += 5 * PBJ_TIMELINE_TEST_AUDIO_TIMESCALE + 17;
+    PBJTestCheck(PBJCaptureTimelineAppendSample(timeline, PBJCaptureTrackAudio, PBJTimeMake(value, PBJ_TIMELINE_TEST_AUDIO_TIMESCALE), duration, &rebased) == PBJCaptureTimelineSampleAccepted);
+    PBJTestCheck(rebased.value == end);
+
+    PBJCaptureTimelineDestroy(timeline);
+}
+
+typedef struct {
+    int64_t hostNow; // ns
+    int64_t nextVideo;
+    int64_t nextAudio; // audio sample clock, in frames
+    int64_t videoInterval;
+
+    PBJTime lastVideo;
+    PBJTime lastAudio;
+    int hasVideo;
+    int hasAudio;
+
+    uint64_t accepted[PBJCaptureTrackCount];
+    uint64_t pauses;
+    int64_t recordedHost; // ns spent recording
+    int64_t pausedHost; // ns between recorded spans, a trailing pause never becomes a gap
+    int64_t pendingPause;
+} PBJTimelineTestSession;
+
+// delivers every sample captured up to hostEnd, while recording each one has to be accepted
+static void PBJTimelineTestDeliver(PBJCaptureTimeline *timeline, PBJTimelineTestSession *session, int64_t hostEnd,
+                                   int recording, int withAudio, PBJTestRandom *random)
+{
+    for (;;) {
+        int64_t audioHost = session->nextAudio / PBJ_TIMELINE_TEST_AUDIO_TIMESCALE * PBJ_TIMELINE_TEST_HOST_TIMESCALE +
+                            session->nextAudio % PBJ_TIMELINE_TEST_AUDIO_TIMESCALE * PBJ_TIMELINE_TEST_HOST_TIMESCALE / PBJ_TIMELINE_TEST_AUDIO_TIMESCALE;
+        int video = !withAudio || session->nextVideo <= audioHost;
+        int64_t at = video ? session->nextVideo : audioHost;
+        if (at >= hostEnd)
+            break;
+
+        PBJTime rebased;
+        PBJCaptureTimelineSampleResult result;
+        if (video) {
+            // capture timestamps carry a little jitter, the host clock never runs backwards
+            int64_t timestamp = session->nextVideo + (int64_t)PBJTestRandomBelow(random, 2000);
+            result = PBJCaptureTimelineAppendSample(timeline, PBJCaptureTrackVideo, PBJTimeMake(timestamp, PBJ_TIMELINE_TEST_HOST_TIMESCALE),
+                                                    PBJTimelineTestNoDuration, &rebased);
+            session->nextVideo += session->videoInterval;
+        } else {
+            result = PBJCaptureTimelineAppendSample(timeline, PBJCaptureTrackAudio, PBJTimeMake(session->nextAudio, PBJ_TIMELINE_TEST_AUDIO_TIMESCALE),
+                                                    PBJTimeMake(PBJ_TIMELINE_TEST_AUDIO_FRAMES, PBJ_TIMELINE_TEST_AUDIO_TIMESCALE), &rebased);
+            session->nextAudio += PBJ_TIMELINE_TEST_AUDIO_FRAMES;
+        }
+
+        if (!recording) {
+            PBJTestCheck(result == PBJCaptureTimelineSampleDroppedNotRecording);
+            continue;
+        }
+        PBJTestCheck(result == PBJCaptureTimelineSampleAccepted);
+        PBJTime *last = video ? &session->lastVideo : &session->lastAudio;
+        int *has = video ? &session->hasVideo : &session->hasAudio;
+        PBJTestCheck(rebased.timescale == (video ? PBJ_TIMELINE_TEST_HOST_TIMESCALE : PBJ_TIMELINE_TEST_AUDIO_TIMESCALE));
+        if (*has) {
+            PBJTestCheck(rebased.value > last->value);
+            if (!video) {
+                // audio stays gapless, each buffer starts where the previous one ended
+                PBJTestCheck(rebased.value >= last->value + PBJ_TIMELINE_TEST_AUDIO_FRAMES);
+            }
+        }
+        *last = rebased;
+        *has = 1;
+        session->accepted[video ? PBJCaptureTrackVideo : PBJCaptureTrackAudio]++;
+    }
+    session->hostNow = hostEnd;
+}
+
+static void PBJTimelineTestRunSession(uint64_t seed, int64_t hours, int64_t fps, int withAudio)
+{
+    PBJTestRandom random = PBJTestRandomMake(seed);
+    PBJCaptureTimeline *timeline = PBJCaptureTimelineCreate();
+    PBJCaptureTimelineStart(timeline);
+
+    PBJTimelineTestSession session;
+    memset(&session, 0, sizeof(session));
+    // a host clock days into uptime
+    session.hostNow = (int64_t)(250000 + PBJTestRandomBelow(&random, 100000)) * PBJ_TIMELINE_TEST_HOST_TIMESCALE + 123456789;
+    session.nextVideo = session.hostNow;
+    session.nextAudio = session.hostNow / PBJ_TIMELINE_TEST_HOST_TIMESCALE * PBJ_TIMELINE_TEST_AUDIO_TIMESCALE;
+    session.videoInterval = PBJ_TIMELINE_TEST_HOST_TIMESCALE / fps;
+
+    int64_t sessionEnd = session.hostNow + hours * 3600 * PBJ_TIMELINE_TEST_HOST_TIMESCALE;
+    uint64_t interruptions = 0;
+    while (session.hostNow < sessionEnd) {
+        // record for anything from a frame to ten minutes
+        int64_t span = (int64_t)PBJTestRandomBelow(&random, 600 * PBJ_TIMELINE_TEST_HOST_TIMESCALE) + session.videoInterval;
+        if (PBJTestRandomBelow(&random, 8) == 0) {
+            span = (int64_t)PBJTestRandomBelow(&random, 3 * session.videoInterval) + 1;
+        }
+        session.pausedHost += session.pendingPause;
+        session.pendingPause = 0;
+        int64_t before = session.hostNow;
+        PBJTimelineTestDeliver(timeline, &session, session.hostNow + span, 1, withAudio, &random);
+        session.recordedHost += session.hostNow - before;
+
+        if (PBJTestRandomBelow(&random, 5) == 0) {
+            // an interruption, capture keeps running but frames are lost
+            PBJCaptureTimelineInterrupt(timeline);
+            int64_t lost = (int64_t)PBJTestRandomBelow(&random, 2 * PBJ_TIMELINE_TEST_HOST_TIMESCALE) + session.videoInterval;
+            session.nextVideo += (lost / session.videoInterval) * session.videoInterval;
+            session.nextAudio += lost * PBJ_TIMELINE_TEST_AUDIO_TIMESCALE / PBJ_TIMELINE_TEST_HOST_TIMESCALE;
+            session.hostNow += lost;
+            session.pendingPause = lost;
+            interruptions++;
+        } else {
+            PBJCaptureTimelinePause(timeline);
+            int64_t pause = (int64_t)PBJTestRandomBelow(&random, 120 * PBJ_TIMELINE_TEST_HOST_TIMESCALE) + 1;
+            int64_t before = session.hostNow;
+            PBJTimelineTestDeliver(timeline, &session, session.hostNow + pause, 0, withAudio, &random);
+            session.pendingPause = session.hostNow - before;
+            PBJCaptureTimelineResume(timeline);
+            session.pauses++;
+        }
+    }
+    PBJCaptureTimelineStop(timeline);
+
+    // no sample was lost to the timeline, every gap was recorded once
+    PBJTestCheck(session.accepted[PBJCaptureTrackVideo] > 0);
+    PBJTestCheck(PBJCaptureTimelineGapCount(timeline) <= session.pauses + interruptions);
+
+    // what was captured matches the time spent recording, each gap may shift the output by
+    // up to a frame interval plus an audio buffer
+    uint64_t gaps = session.pauses + interruptions + 1;
+    double tolerance = (double)gaps * ((double)session.videoInterval / PBJ_TIMELINE_TEST_HOST_TIMESCALE +
+                                       (double)PBJ_TIMELINE_TEST_AUDIO_FRAMES / PBJ_TIMELINE_TEST_AUDIO_TIMESCALE + 2e-6);
+    double captured = PBJTimeGetSeconds(PBJCaptureTimelineCapturedDuration(timeline));
+    double recorded = (double)session.recordedHost / PBJ_TIMELINE_TEST_HOST_TIMESCALE;
+    PBJTestCheck(captured <= recorded + tolerance);
+    PBJTestCheck(captured >= recorded - tolerance);
+    double gap = PBJTimeGetSeconds(PBJCaptureTimelineGapDuration(timeline));
+    double paused = (double)session.pausedHost / PBJ_TIMELINE_TEST_HOST_TIMESCALE;
+    PBJTestCheck(gap <= paused + tolerance && gap >= paused - tolerance);
+
+    PBJCaptureTimelineDestroy(timeline);
+}
+
+static void PBJTimelineTestMaximumDuration(void)
+{
+    PBJCaptureTimeline *timeline = PBJCaptureTimelineCreate();
+    PBJCaptureTimelineSetMaximumDuration(timeline, PBJTimeMake(10, 1));
+    PBJCaptureTimelineStart(timeline);
+
+    PBJTime rebased;
+    int64_t frame = 0;
+    uint64_t accepted = 0;
+    for (; frame < 30 * 4; frame++)
+        accepted += PBJCaptureTimelineAppendSample(timeline, PBJCaptureTrackVideo, PBJTimeMake(frame, 30), PBJTimelineTestNoDuration, &rebased) == PBJCaptureTimelineSampleAccepted;
+    PBJCaptureTimelinePause(timeline);
+    PBJCaptureTimelineResume(timeline);
+    frame += 30 * 60;
+    for (int i = 0; i < 30 * 20; i++, frame++)
+        accepted += PBJCaptureTimelineAppendSample(timeline, PBJCaptureTrackVideo, PBJTimeMake(frame, 30), PBJTimelineTestNoDuration, &rebased) == PBJCaptureTimelineSampleAccepted;
+
+    // ten seconds of frames, the pause did not count against the limit nor cost a frame
+    PBJTestCheck(accepted == 300);
+    PBJTestCheck(PBJCaptureTimelineMaximumDurationReached(timeline));
+    PBJCaptureTimelineDestroy(timeline);
+}
+
+// exact where going through seconds as a double is not, a year in is past 2^53 nanoseconds
+static void PBJTimelineTestNanoseconds(void)
+{
+    PBJTestCheck(PBJTimeGetNanoseconds(PBJTimeMake(1, 30)) == 33333333);
+    PBJTestCheck(PBJTimeGetNanoseconds(PBJTimeMake(1001, 30000)) == 33366666);
+    PBJTestCheck(PBJTimeGetNanoseconds(PBJTimeMake(-1, 30)) == -33333333);
+    PBJTestCheck(PBJTimeGetNanoseconds(PBJTimeMake(5, 0)) == 0);
+
+    int64_t year = 365 * 86400;
+    PBJTime time = PBJTimeMake(year * 90000 + 1, 90000);
+    PBJTestCheck(PBJTimeGetNanoseconds(time) == year * PBJ_TEST_NSEC_PER_SEC + 11111);
+    PBJTestCheck((int64_t)(PBJTimeGetSeconds(time) * 1e9) != year * PBJ_TEST_NSEC_PER_SEC + 11111);
+
+    // the largest CMTime timescale, the remainder times 1e9 still fits
+    time = PBJTimeMake(INT64_MAX / 2, INT32_MAX);
+    int64_t seconds = time.value / time.timescale;
+    PBJTestCheck(PBJTimeGetNanoseconds(time) / PBJ_TEST_NSEC_PER_SEC == seconds);
+}
+
+int main(void)
+{
+    PBJTimelineTestNanoseconds();
+    PBJTimelineTestVideoOnlyResume();
+    PBJTimelineTestAudioResume();
+    PBJTimelineTestMaximumDuration();
+    for (uint64_t seed = 1; seed <= 4; seed++) {
+        PBJTimelineTestRunSession(seed, 3, 30, 0);
+        PBJTimelineTestRunSession(seed + 100, 2, 60, 1);
+    }
+    PBJTimelineTestRunSession(77, 1, 240, 1);
+    return 0;
+}
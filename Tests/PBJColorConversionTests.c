@@ -0,0 +1,229 @@
+//
+//  PBJColorConversionTests.c
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#include "PBJColorConversion.h"
+#include "PBJTestSupport.h"
+
+#include <math.h>
+
+// every vector path against the scalar one, byte for byte, and the scalar path against
+// the floating point BT.709 matrix it approximates
+
+static const PBJSIMDLevel PBJColorConversionTestLevels[] = { PBJSIMDLevelSSE2, PBJSIMDLevelAVX2, PBJSIMDLevelNEON };
+
+static uint8_t *PBJColorConversionTestConvert(const PBJNV12Image *image, PBJRGBOrder order, PBJSIMDLevel level, size_t *bytesPerRow)
+{
+    *bytesPerRow = image->width * 4 + 12;
+    uint8_t *rgb = (uint8_t *)malloc(*bytesPerRow * image->height);
+    PBJTestCheck(rgb != NULL);
+    memset(rgb, 0x5a, *bytesPerRow * image->height);
+    PBJColorConvertNV12ToRGBRows(image, rgb, *bytesPerRow, order, 0, image->height, level);
+    return rgb;
+}
+
+static void PBJColorConversionTestMatchesScalar(size_t width, size_t height, PBJYCbCrRange range, uint64_t seed)
+{
+    PBJTestFrame frame = PBJTestFrameCreate(width, height, range);
+    PBJTestFrameFillNoise(&frame, seed);
+
+    for (int order = PBJRGBOrderBGRA; order <= PBJRGBOrderRGBA; order++) {
+        size_t bytesPerRow;
+        uint8_t *reference = PBJColorConversionTestConvert(&frame.image, (PBJRGBOrder)order, PBJSIMDLevelScalar, &bytesPerRow);
+        for (size_t i = 0; i < sizeof(PBJColorConversionTestLevels) / sizeof(PBJColorConversionTestLevels[0]); i++) {
+            PBJSIMDLevel level = PBJColorConversionTestLevels[i];
+            if (PBJSIMDLevelResolve(level) != level)
+                continue;
+            uint8_t *rgb = PBJColorConversionTestConvert(&frame.image, (PBJRGBOrder)order, level, &bytesPerRow);
+            // padding past the row stays untouched too
+            PBJTestCheck(memcmp(rgb, reference, bytesPerRow * height) == 0);
+            free(rgb);
+        }
+        free(reference);
+    }
+    PBJTestFrameDestroy(&frame);
+}
+
+static void PBJColorConversionTestSIMDMatchesScalar(void)
+{
+    static const size_t sizes[][2] = {
+        { 1, 1 }, { 2, 2 }, { 15, 3 }, { 16, 2 }, { 17, 5 }, { 31, 7 }, { 32, 4 }, { 33, 9 },
+        { 63, 2 }, { 64, 64 }, { 65, 33 }, { 127, 11 }, { 640, 360 }, { 1279, 721 }, { 1920, 1080 }
+    };
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        PBJColorConversionTestMatchesScalar(sizes[i][0], sizes[i][1], PBJYCbCrRangeFull, 11 + i);
+        PBJColorConversionTestMatchesScalar(sizes[i][0], sizes[i][1], PBJYCbCrRangeVideo, 101 + i);
+    }
+}
+
+// extremes of every channel, where the saturating vector adds and the scalar clamp have to agree
+static void PBJColorConversionTestSaturation(void)
+{
+    static const uint8_t values[] = { 0, 1, 15, 16, 17, 127, 128, 129, 235, 236, 239, 240, 241, 254, 255 };
+    size_t count = sizeof(values) / sizeof(values[0]);
+    PBJTestFrame frame = PBJTestFrameCreate(count * 2, count * count * 2, PBJYCbCrRangeFull);
+    for (size_t y = 0; y < frame.image.height; y++) {
+        for (size_t x = 0; x < frame.image.width; x++)
+            frame.image.luma[y * frame.image.lumaBytesPerRow + x] = values[x >> 1];
+    }
+    for (size_t y = 0; y < PBJNV12ChromaHeight(&frame.image); y++) {
+        for (size_t x = 0; x < PBJNV12ChromaWidth(&frame.image); x++) {
+            frame.image.chroma[y * frame.image.chromaBytesPerRow + 2 * x] = values[y % count];
+            frame.image.chroma[y * frame.image.chromaBytesPerRow + 2 * x + 1] = values[y / count];
+        }
+    }
+
+    for (int range = PBJYCbCrRangeFull; range <= PBJYCbCrRangeVideo; range++) {
+        frame.image.range = (PBJYCbCrRange)range;
+        size_t bytesPerRow;
+        uint8_t *reference = PBJColorConversionTestConvert(&frame.image, PBJRGBOrderBGRA, PBJSIMDLevelScalar, &bytesPerRow);
+        for (size_t i = 0; i < sizeof(PBJColorConversionTestLevels) / sizeof(PBJColorConversionTestLevels[0]); i++) {
+            PBJSIMDLevel level = PBJColorConversionTestLevels[i];
+            if (PBJSIMDLevelResolve(level) != level)
+                continue;
+            uint8_t *rgb = PBJColorConversionTestConvert(&frame.image, PBJRGBOrderBGRA, level, &bytesPerRow);
+            PBJTestCheck(memcmp(rgb, reference, bytesPerRow * frame.image.height) == 0);
+            free(rgb);
+        }
+        free(reference);
+    }
+    PBJTestFrameDestroy(&frame);
+}
+
+static uint8_t PBJColorConversionTestRound(double value)
+{
+    return (uint8_t)(value < 0.0 ? 0.0 : (value > 255.0 ? 255.0 : floor(value + 0.5)));
+}
+
+// 6 fractional bits put the fixed point within a couple of steps of the exact matrix
+static void PBJColorConversionTestMatchesMatrix(void)
+{
+    PBJTestFrame frame = PBJTestFrameCreate(256, 64, PBJYCbCrRangeFull);
+    PBJTestFrameFillNoise(&frame, 7);
+
+    for (int range = PBJYCbCrRangeFull; range <= PBJYCbCrRangeVideo; range++) {
+        frame.image.range = (PBJYCbCrRange)range;
+        size_t bytesPerRow;
+        uint8_t *rgb = PBJColorConversionTestConvert(&frame.image, PBJRGBOrderRGBA, PBJSIMDLevelAuto, &bytesPerRow);
+        int worst = 0;
+        for (size_t y = 0; y < frame.image.height; y++) {
+            for (size_t x = 0; x < frame.image.width; x++) {
+                const uint8_t *cbcr = frame.image.chroma + (y >> 1) * frame.image.chromaBytesPerRow + ((x >> 1) << 1);
+                double luma = frame.image.luma[y * frame.image.lumaBytesPerRow + x];
+                double cb = cbcr[0] - 128.0;
+                double cr = cbcr[1] - 128.0;
+                if (range == PBJYCbCrRangeVideo) {
+                    luma = (luma - 16.0) * 255.0 / 219.0;
+                    cb *= 255.0 / 224.0;
+                    cr *= 255.0 / 224.0;
+                }
+                uint8_t expected[3] = {
+                    PBJColorConversionTestRound(luma + 1.57481 * cr),
+                    PBJColorConversionTestRound(luma - 0.18732 * cb - 0.46813 * cr),
+                    PBJColorConversionTestRound(luma + 1.85560 * cb)
+                };
+                const uint8_t *pixel = rgb + y * bytesPerRow + x * 4;
+                for (int c = 0; c < 3; c++) {
+                    int difference = abs((int)pixel[c] - (int)expected[c]);
+                    worst = difference > worst ? difference : worst;
+                }
+                PBJTestCheck(pixel[3] == 0xff);
+            }
+        }
+        PBJTestCheck(worst <= 3);
+        free(rgb);
+    }
+    PBJTestFrameDestroy(&frame);
+}
+
+static void PBJColorConversionTestOrder(void)
+{
+    PBJTestFrame frame = PBJTestFrameCreate(48, 6, PBJYCbCrRangeVideo);
+    PBJTestFrameFillNoise(&frame, 3);
+    size_t bytesPerRow;
+    uint8_t *bgra = PBJColorConversionTestConvert(&frame.image, PBJRGBOrderBGRA, PBJSIMDLevelAuto, &bytesPerRow);
+    uint8_t *rgba = PBJColorConversionTestConvert(&frame.image, PBJRGBOrderRGBA, PBJSIMDLevelAuto, &bytesPerRow);
+    for (size_t y = 0; y < frame.image.height; y++) {
+        for (size_t x = 0; x < frame.image.width; x++) {
+            const uint8_t *a = bgra + y * bytesPerRow + x * 4;
+            const uint8_t *b = rgba + y * bytesPerRow + x * 4;
+            PBJTestCheck(a[0] == b[2] && a[1] == b[1] && a[2] == b[0] && a[3] == b[3]);
+        }
+    }
+    free(bgra);
+    free(rgba);
+    PBJTestFrameDestroy(&frame);
+}
+
+// strips cover every row exactly once, start on even rows, and convert to the same image as one pass
+static void PBJColorConversionTestStrips(void)
+{
+    static const size_t heights[] = { 1, 2, 63, 64, 65, 127, 480, 721, 1080, 2160 };
+    for (size_t i = 0; i < sizeof(heights) / sizeof(heights[0]); i++) {
+        size_t height = heights[i];
+        for (size_t maximum = 1; maximum <= 12; maximum++) {
+            size_t count = PBJColorConversionStripCount(height, maximum);
+            PBJTestCheck(count >= 1 && count <= maximum);
+            size_t next = 0;
+            for (size_t strip = 0; strip < count; strip++) {
+                size_t begin, end;
+                PBJColorConversionStripRows(height, count, strip, &begin, &end);
+                PBJTestCheck(begin == next);
+                PBJTestCheck(begin % 2 == 0);
+                PBJTestCheck(end >= begin && end <= height);
+                next = end;
+            }
+            PBJTestCheck(next == height);
+        }
+    }
+
+    PBJTestFrame frame = PBJTestFrameCreate(333, 721, PBJYCbCrRangeFull);
+    PBJTestFrameFillNoise(&frame, 5);
+    size_t bytesPerRow;
+    uint8_t *whole = PBJColorConversionTestConvert(&frame.image, PBJRGBOrderBGRA, PBJSIMDLevelAuto, &bytesPerRow);
+    uint8_t *stripped = (uint8_t *)malloc(bytesPerRow * frame.image.height);
+    PBJTestCheck(stripped != NULL);
+    memset(stripped, 0x5a, bytesPerRow * frame.image.height);
+    size_t count = PBJColorConversionStripCount(frame.image.height, 8);
+    // out of order, as a concurrent apply finishes them
+    for (size_t strip = count; strip-- > 0;) {
+        size_t begin, end;
+        PBJColorConversionStripRows(frame.image.height, count, strip, &begin, &end);
+        PBJColorConvertNV12ToRGBRows(&frame.image, stripped, bytesPerRow, PBJRGBOrderBGRA, begin, end, PBJSIMDLevelAuto);
+    }
+    PBJTestCheck(memcmp(whole, stripped, bytesPerRow * frame.image.height) == 0);
+    free(whole);
+    free(stripped);
+    PBJTestFrameDestroy(&frame);
+}
+
+int main(void)
+{
+    PBJColorConversionTestSIMDMatchesScalar();
+    PBJColorConversionTestSaturation();
+    PBJColorConversionTestMatchesMatrix();
+    PBJColorConversionTestOrder();
+    PBJColorConversionTestStrips();
+    return 0;
+}
@@ -0,0 +1,253 @@
+//
+//  PBJFormatIndexTests.c
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#include "PBJFormatIndex.h"
+#include "PBJSyntheticFormatTable.h"
+#include "PBJTestSupport.h"
+
+// the index against a linear scan over the same descriptors, for random queries over
+// synthetic device format tables, plus the answers a real camera's table has to give
+
+#define PBJ_FORMAT_INDEX_TEST_CAPACITY 4096
+
+static PBJFormatDescriptor PBJFormatIndexTestDescriptors[PBJ_FORMAT_INDEX_TEST_CAPACITY];
+
+// the documented ranking, smaller area first for smallest, then unbinned, the wider field
+// of view, the larger zoom range and later in the list. negative when lhs ranks first
+static int PBJFormatIndexTestRank(const PBJFormatDescriptor *lhs, size_t lhsPosition, const PBJFormatDescriptor *rhs, size_t rhsPosition,
+                                  PBJFormatSelection selection)
+{
+    int64_t lhsArea = (int64_t)lhs->width * lhs->height;
+    int64_t rhsArea = (int64_t)rhs->width * rhs->height;
+    if (lhsArea != rhsArea)
+        return (lhsArea < rhsArea) == (selection == PBJFormatSelectionSmallest) ? -1 : 1;
+    if ((lhs->binned != 0) != (rhs->binned != 0))
+        return lhs->binned ? 1 : -1;
+    if (lhs->fieldOfView != rhs->fieldOfView)
+        return lhs->fieldOfView > rhs->fieldOfView ? -1 : 1;
+    if (lhs->maxZoomFactor != rhs->maxZoomFactor)
+        return lhs->maxZoomFactor > rhs->maxZoomFactor ? -1 : 1;
+    return lhsPosition > rhsPosition ? -1 : 1;
+}
+
+static int PBJFormatIndexTestMatches(const PBJFormatDescriptor *descriptor, const PBJFormatQuery *query)
+{
+    if (descriptor->width <= 0 || descriptor->height <= 0 || !(descriptor->minFrameRate <= descriptor->maxFrameRate))
+        return 0;
+    if (!(descriptor->minFrameRate <= query->frameRate && query->frameRate <= descriptor->maxFrameRate))
+        return 0;
+    if (descriptor->width < query->minimumWidth || descriptor->height < query->minimumHeight)
+        return 0;
+    if (query->pixelFormat && descriptor->pixelFormat != query->pixelFormat)
+        return 0;
+    if (descriptor->fieldOfView < query->minimumFieldOfView || descriptor->maxZoomFactor < query->minimumMaxZoomFactor)
+        return 0;
+    return !descriptor->binned || query->allowBinned;
+}
+
+static const PBJFormatDescriptor *PBJFormatIndexTestScan(const PBJFormatDescriptor *descriptors, size_t count, const PBJFormatQuery *query)
+{
+    const PBJFormatDescriptor *best = NULL;
+    size_t bestPosition = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (!PBJFormatIndexTestMatches(&descriptors[i], query))
+            continue;
+        if (!best || PBJFormatIndexTestRank(&descriptors[i], i, best, bestPosition, query->selection) < 0) {
+            best = &descriptors[i];
+            bestPosition = i;
+        }
+    }
+    return best;
+}
+
+static double PBJFormatIndexTestScanMaximumFrameRate(const PBJFormatDescriptor *descriptors, size_t count, int32_t width, int32_t height)
+{
+    double maximum = 0.0;
+    for (size_t i = 0; i < count; i++) {
+        const PBJFormatDescriptor *descriptor = &descriptors[i];
+        if (descriptor->width <= 0 || descriptor->height <= 0 || !(descriptor->minFrameRate <= descriptor->maxFrameRate))
+            continue;
+        if (descriptor->width >= width && descriptor->height >= height && descriptor->maxFrameRate > maximum)
+            maximum = descriptor->maxFrameRate;
+    }
+    return maximum;
+}
+
+static int PBJFormatIndexTestSame(const PBJFormatDescriptor *lhs, const PBJFormatDescriptor *rhs)
+{
+    if (!lhs || !rhs)
+        return lhs == rhs;
+    return memcmp(lhs, rhs, sizeof(PBJFormatDescriptor)) == 0;
+}
+
+static double PBJFormatIndexTestRandomRate(PBJTestRandom *random)
+{
+    static const double rates[] = { 0.5, 1.0, 2.0, 15.0, 23.976, 24.0, 25.0, 29.97, 30.0, 30.5, 48.0, 59.94, 60.0, 90.0, 120.0, 200.0, 240.0, 241.0 };
+    if (PBJTestRandomBelow(random, 4) == 0)
+        return (double)PBJTestRandomBelow(random, 2600000) / 10000.0;
+    return rates[PBJTestRandomBelow(random, sizeof(rates) / sizeof(rates[0]))];
+}
+
+static PBJFormatQuery PBJFormatIndexTestRandomQuery(PBJTestRandom *random, const PBJFormatDescriptor *descriptors, size_t count)
+{
+    PBJFormatQuery query = PBJFormatQueryMake(PBJFormatIndexTestRandomRate(random),
+                                              PBJTestRandomBelow(random, 2) ? PBJFormatSelectionSmallest : PBJFormatSelectionLargest);
+    // dimensions mostly taken from the table, so exact fits are common
+    if (PBJTestRandomBelow(random, 4) != 0) {
+        const PBJFormatDescriptor *sample = &descriptors[PBJTestRandomBelow(random, count)];
+        query.minimumWidth = sample->width + (int32_t)PBJTestRandomBetween(random, -1, 1) * (int32_t)PBJTestRandomBelow(random, 64);
+        query.minimumHeight = sample->height + (int32_t)PBJTestRandomBetween(random, -1, 1) * (int32_t)PBJTestRandomBelow(random, 64);
+    }
+    if (PBJTestRandomBelow(random, 3) == 0) {
+        static const uint32_t pixelFormats[] = { PBJSyntheticFormatPixelFormatVideoRange, PBJSyntheticFormatPixelFormatFullRange,
+                                                 PBJSyntheticFormatPixelFormatTenBit, 0x42475241u };
+        query.pixelFormat = pixelFormats[PBJTestRandomBelow(random, 4)];
+    }
+    if (PBJTestRandomBelow(random, 4) == 0)
+        query.minimumFieldOfView = 55.0f + (float)PBJTestRandomBelow(random, 200) / 10.0f;
+    if (PBJTestRandomBelow(random, 4) == 0)
+        query.minimumMaxZoomFactor = (float)PBJTestRandomBelow(random, 140);
+    query.allowBinned = (int)PBJTestRandomBelow(random, 2);
+    return query;
+}
+
+#pragma mark - tests
+
+static void PBJFormatIndexTestMatchesScan(void)
+{
+    static const uint32_t scales[] = { 1, 2, 8, 32 };
+    PBJTestRandom random = PBJTestRandomMake(17);
+    for (size_t s = 0; s < sizeof(scales) / sizeof(scales[0]); s++) {
+        for (uint64_t seed = 0; seed < 4; seed++) {
+            PBJFormatDescriptor *descriptors = PBJFormatIndexTestDescriptors;
+            size_t count = PBJSyntheticFormatTableFill(descriptors, PBJ_FORMAT_INDEX_TEST_CAPACITY, scales[s], seed);
+            PBJTestCheck(count > 0 && count < PBJ_FORMAT_INDEX_TEST_CAPACITY);
+            PBJFormatIndex *index = PBJFormatIndexCreate(descriptors, count);
+            PBJTestCheck(index != NULL);
+
+            for (int i = 0; i < 20000; i++) {
+                PBJFormatQuery query = PBJFormatIndexTestRandomQuery(&random, descriptors, count);
+                const PBJFormatDescriptor *found = PBJFormatIndexFind(index, &query);
+                const PBJFormatDescriptor *expected = PBJFormatIndexTestScan(descriptors, count, &query);
+                PBJTestCheck(PBJFormatIndexTestSame(found, expected));
+                // the index hands out its own copy
+                PBJTestCheck(!found || found < descriptors || found >= descriptors + count);
+
+                PBJFormatQuery open = PBJFormatQueryMake(query.frameRate, PBJFormatSelectionSmallest);
+                PBJTestCheck(PBJFormatIndexSupportsFrameRate(index, query.frameRate) == (PBJFormatIndexTestScan(descriptors, count, &open) != NULL));
+            }
+            for (int i = 0; i < 2000; i++) {
+                const PBJFormatDescriptor *sample = &descriptors[PBJTestRandomBelow(&random, count)];
+                int32_t width = sample->width + (int32_t)PBJTestRandomBetween(&random, -8, 8);
+                int32_t height = sample->height + (int32_t)PBJTestRandomBetween(&random, -8, 8);
+                PBJTestCheck(PBJFormatIndexGetMaximumFrameRate(index, width, height) == PBJFormatIndexTestScanMaximumFrameRate(descriptors, count, width, height));
+            }
+            PBJFormatIndexDestroy(index);
+        }
+    }
+}
+
+// what a camera's table has to answer: high frame rates only binned, the largest sensor
+// mode only at 30, ties broken the documented way
+static void PBJFormatIndexTestCameraTable(void)
+{
+    PBJFormatDescriptor *descriptors = PBJFormatIndexTestDescriptors;
+    size_t count = PBJSyntheticFormatTableFill(descriptors, PBJ_FORMAT_INDEX_TEST_CAPACITY, 1, 0);
+    PBJFormatIndex *index = PBJFormatIndexCreate(descriptors, count);
+
+    PBJTestCheck(PBJFormatIndexGetMaximumFrameRate(index, 1920, 1080) == 240.0);
+    PBJTestCheck(PBJFormatIndexGetMaximumFrameRate(index, 1921, 1080) == 60.0);
+    PBJTestCheck(PBJFormatIndexGetMaximumFrameRate(index, 4032, 3024) == 30.0);
+    PBJTestCheck(PBJFormatIndexGetMaximumFrameRate(index, 4033, 3024) == 0.0);
+    PBJTestCheck(PBJFormatIndexSupportsFrameRate(index, 1.0) && PBJFormatIndexSupportsFrameRate(index, 240.0));
+    PBJTestCheck(!PBJFormatIndexSupportsFrameRate(index, 0.99) && !PBJFormatIndexSupportsFrameRate(index, 240.01));
+
+    PBJFormatQuery query = PBJFormatQueryMake(240.0, PBJFormatSelectionSmallest);
+    query.minimumWidth = 1920;
+    query.minimumHeight = 1080;
+    query.allowBinned = 0;
+    PBJTestCheck(PBJFormatIndexFind(index, &query) == NULL);
+    query.allowBinned = 1;
+    const PBJFormatDescriptor *found = PBJFormatIndexFind(index, &query);
+    PBJTestCheck(found && found->width == 1920 && found->height == 1080 && found->binned && found->maxFrameRate == 240.0);
+
+    // at 60 the unbinned format wins over the binned ones of the same size
+    query.frameRate = 60.0;
+    found = PBJFormatIndexFind(index, &query);
+    PBJTestCheck(found && found->width == 1920 && !found->binned && found->maxFrameRate == 60.0);
+
+    // largest at 30 is the full sensor, smallest with no dimensions the smallest format
+    query = PBJFormatQueryMake(30.0, PBJFormatSelectionLargest);
+    found = PBJFormatIndexFind(index, &query);
+    PBJTestCheck(found && found->width == 4032 && found->height == 3024);
+    query.selection = PBJFormatSelectionSmallest;
+    found = PBJFormatIndexFind(index, &query);
+    PBJTestCheck(found && found->width == 192 && found->height == 144);
+
+    // pixel format narrows it, 420f sits after 420v in the list so it wins an otherwise equal tie
+    query.minimumWidth = 1280;
+    query.minimumHeight = 720;
+    found = PBJFormatIndexFind(index, &query);
+    PBJTestCheck(found && found->width == 1280 && found->pixelFormat == PBJSyntheticFormatPixelFormatFullRange);
+    query.pixelFormat = PBJSyntheticFormatPixelFormatVideoRange;
+    found = PBJFormatIndexFind(index, &query);
+    PBJTestCheck(found && found->width == 1280 && found->pixelFormat == PBJSyntheticFormatPixelFormatVideoRange && !found->binned);
+    PBJFormatIndexDestroy(index);
+}
+
+static void PBJFormatIndexTestDegenerate(void)
+{
+    // empty, and descriptors that can never match
+    PBJFormatIndex *index = PBJFormatIndexCreate(NULL, 0);
+    PBJTestCheck(index != NULL);
+    PBJFormatQuery query = PBJFormatQueryMake(30.0, PBJFormatSelectionSmallest);
+    PBJTestCheck(PBJFormatIndexFind(index, &query) == NULL);
+    PBJTestCheck(!PBJFormatIndexSupportsFrameRate(index, 30.0));
+    PBJTestCheck(PBJFormatIndexGetMaximumFrameRate(index, 0, 0) == 0.0);
+    PBJFormatIndexDestroy(index);
+
+    PBJFormatDescriptor descriptors[4] = {
+        { 0, 0, 480, 0, 1.0, 30.0, 60.0f, 1.0f, 0 },
+        { 1, 640, 480, 0, 30.0, 1.0, 60.0f, 1.0f, 0 },
+        { 2, 640, 480, 0, 30.0, 30.0, 60.0f, 1.0f, 0 },
+        { 3, 1280, 720, 0, 10.0, 20.0, 60.0f, 1.0f, 0 },
+    };
+    index = PBJFormatIndexCreate(descriptors, 4);
+    // a single rate range is a point, the gap between ranges supports nothing
+    PBJTestCheck(PBJFormatIndexSupportsFrameRate(index, 30.0) && !PBJFormatIndexSupportsFrameRate(index, 29.0));
+    PBJTestCheck(PBJFormatIndexSupportsFrameRate(index, 15.0) && !PBJFormatIndexSupportsFrameRate(index, 25.0));
+    PBJTestCheck(PBJFormatIndexFind(index, &query)->format == 2);
+    PBJTestCheck(PBJFormatIndexGetMaximumFrameRate(index, 641, 0) == 20.0);
+    PBJTestCheck(PBJFormatIndexFind(NULL, &query) == NULL && PBJFormatIndexFind(index, NULL) == NULL);
+    PBJFormatIndexDestroy(index);
+}
+
+int main(void)
+{
+    PBJFormatIndexTestMatchesScan();
+    PBJFormatIndexTestCameraTable();
+    PBJFormatIndexTestDegenerate();
+    return 0;
+}
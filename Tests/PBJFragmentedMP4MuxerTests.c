@@ -0,0 +1,582 @@
+//
+//  PBJFragmentedMP4MuxerTests.c
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#include "PBJFragmentedMP4Muxer.h"
+#include "PBJOutputSink.h"
+#include "PBJTestSupport.h"
+
+// muxes synthetic H.264 and AAC access units into memory, parses the file back box by box and
+// checks the sample tables, timestamps, edit list and payloads against what was appended
+
+#define PBJ_MP4_TEST_MAX_SAMPLES 8192
+#define PBJ_MP4_TEST_VIDEO_TIMESCALE 90000
+#define PBJ_MP4_TEST_AUDIO_RATE 44100
+#define PBJ_MP4_TEST_PRIMING 2112
+
+static const uint8_t PBJMP4TestAVCC[] = { 0x01, 0x64, 0x00, 0x28, 0xff, 0xe1, 0x00, 0x04, 0x67, 0x64, 0x00, 0x28, 0x01, 0x00, 0x02, 0x68, 0xee };
+static const uint8_t PBJMP4TestASC[] = { 0x12, 0x10 }; // AAC-LC, 44.1kHz, mono
+
+#pragma mark - reading
+
+static uint32_t PBJMP4TestU32(const uint8_t *bytes)
+{
+    return ((uint32_t)bytes[0] << 24) | ((uint32_t)bytes[1] << 16) | ((uint32_t)bytes[2] << 8) | bytes[3];
+}
+
+static uint64_t PBJMP4TestU64(const uint8_t *bytes)
+{
+    return ((uint64_t)PBJMP4TestU32(bytes) << 32) | PBJMP4TestU32(bytes + 4);
+}
+
+typedef struct {
+    char type[5];
+    const uint8_t *start; // of the header
+    const uint8_t *payload;
+    size_t payloadSize;
+} PBJMP4TestBox;
+
+// the box at *offset, every box has to fit inside its parent
+static int PBJMP4TestNextBox(const uint8_t *bytes, size_t length, size_t *offset, PBJMP4TestBox *box)
+{
+    if (*offset == length)
+        return 0;
+    PBJTestCheck(*offset + 8 <= length);
+    uint32_t size = PBJMP4TestU32(bytes + *offset);
+    PBJTestCheck(size >= 8 && *offset + size <= length);
+    memcpy(box->type, bytes + *offset + 4, 4);
+    box->type[4] = 0;
+    box->start = bytes + *offset;
+    box->payload = bytes + *offset + 8;
+    box->payloadSize = size - 8;
+    *offset += size;
+    return 1;
+}
+
+static int PBJMP4TestFindChild(const PBJMP4TestBox *parent, size_t skip, const char *type, PBJMP4TestBox *child)
+{
+    size_t offset = skip;
+    while (PBJMP4TestNextBox(parent->payload, parent->payloadSize, &offset, child)) {
+        if (strcmp(child->type, type) == 0)
+            return 1;
+    }
+    return 0;
+}
+
+static PBJMP4TestBox PBJMP4TestChild(const PBJMP4TestBox *parent, size_t skip, const char *type)
+{
+    PBJMP4TestBox child;
+    if (!PBJMP4TestFindChild(parent, skip, type, &child)) {
+        fprintf(stderr, "no %s in %s\n", type, parent->type);
+        exit(1);
+    }
+    return child;
+}
+
+typedef struct {
+    int64_t decodeTime;
+    uint32_t duration;
+    uint32_t size;
+    uint32_t flags;
+    int32_t compositionOffset;
+    const uint8_t *data;
+} PBJMP4TestSample;
+
+typedef struct {
+    uint32_t trackID;
+    char handler[5];
+    char sampleEntry[5];
+    uint32_t timescale;
+    int hasEditList;
+    uint32_t editSegmentDuration;
+    int32_t editMediaTime;
+    uint32_t editRate;
+    int32_t matrix[9];
+    uint32_t width; // 16.16
+    uint32_t height;
+    const uint8_t *decoderConfig; // avcC payload or esds DecoderSpecificInfo
+    size_t decoderConfigSize;
+
+    PBJMP4TestSample samples[PBJ_MP4_TEST_MAX_SAMPLES];
+    size_t sampleCount;
+    size_t fragmentStarts[PBJ_MP4_TEST_MAX_SAMPLES]; // sample index each of the track's fragments starts at
+    size_t fragmentCount;
+} PBJMP4TestTrack;
+
+typedef struct {
+    PBJMP4TestTrack tracks[2];
+    size_t trackCount;
+    uint32_t nextTrackID;
+    uint32_t fragmentCount;
+    size_t completeLength; // through the last complete moof and mdat
+} PBJMP4TestFile;
+
+static PBJMP4TestTrack *PBJMP4TestTrackWithID(PBJMP4TestFile *file, uint32_t trackID)
+{
+    for (size_t i = 0; i < file->trackCount; i++) {
+        if (file->tracks[i].trackID == trackID)
+            return &file->tracks[i];
+    }
+    fprintf(stderr, "no track %u\n", trackID);
+    exit(1);
+}
+
+static void PBJMP4TestParseTrack(PBJMP4TestFile *file, const PBJMP4TestBox *trak)
+{
+    PBJTestCheck(file->trackCount < 2);
+    PBJMP4TestTrack *track = &file->tracks[file->trackCount++];
+    memset(track, 0, sizeof(*track));
+
+    PBJMP4TestBox tkhd = PBJMP4TestChild(trak, 0, "tkhd");
+    PBJTestCheck(tkhd.payload[0] == 0 && tkhd.payloadSize == 84);
+    track->trackID = PBJMP4TestU32(tkhd.payload + 12);
+    for (int i = 0; i < 9; i++)
+        track->matrix[i] = (int32_t)PBJMP4TestU32(tkhd.payload + 40 + 4 * i);
+    track->width = PBJMP4TestU32(tkhd.payload + 76);
+    track->height = PBJMP4TestU32(tkhd.payload + 80);
+
+    PBJMP4TestBox edts;
+    if (PBJMP4TestFindChild(trak, 0, "edts", &edts)) {
+        PBJMP4TestBox elst = PBJMP4TestChild(&edts, 0, "elst");
+        PBJTestCheck(elst.payload[0] == 0);
+        PBJTestCheck(PBJMP4TestU32(elst.payload + 4) == 1);
+        PBJTestCheck(elst.payloadSize == 8 + 12);
+        track->hasEditList = 1;
+        track->editSegmentDuration = PBJMP4TestU32(elst.payload + 8);
+        track->editMediaTime = (int32_t)PBJMP4TestU32(elst.payload + 12);
+        track->editRate = PBJMP4TestU32(elst.payload + 16);
+    }
+
+    PBJMP4TestBox mdia = PBJMP4TestChild(trak, 0, "mdia");
+    PBJMP4TestBox mdhd = PBJMP4TestChild(&mdia, 0, "mdhd");
+    track->timescale = PBJMP4TestU32(mdhd.payload + 12);
+    PBJMP4TestBox hdlr = PBJMP4TestChild(&mdia, 0, "hdlr");
+    memcpy(track->handler, hdlr.payload + 8, 4);
+
+    PBJMP4TestBox minf = PBJMP4TestChild(&mdia, 0, "minf");
+    PBJMP4TestBox stbl = PBJMP4TestChild(&minf, 0, "stbl");
+    // every table is empty, the samples are in the fragments
+    PBJTestCheck(PBJMP4TestU32(PBJMP4TestChild(&stbl, 0, "stts").payload + 4) == 0);
+    PBJTestCheck(PBJMP4TestU32(PBJMP4TestChild(&stbl, 0, "stsc").payload + 4) == 0);
+    PBJTestCheck(PBJMP4TestU32(PBJMP4TestChild(&stbl, 0, "stco").payload + 4) == 0);
+    PBJTestCheck(PBJMP4TestU32(PBJMP4TestChild(&stbl, 0, "stsz").payload + 8) == 0);
+
+    PBJMP4TestBox stsd = PBJMP4TestChild(&stbl, 0, "stsd");
+    PBJTestCheck(PBJMP4TestU32(stsd.payload + 4) == 1);
+    PBJMP4TestBox entry;
+    size_t offset = 8;
+    PBJTestCheck(PBJMP4TestNextBox(stsd.payload, stsd.payloadSize, &offset, &entry));
+    memcpy(track->sampleEntry, entry.type, 5);
+    if (strcmp(entry.type, "avc1") == 0) {
+        PBJMP4TestBox avcC = PBJMP4TestChild(&entry, 78, "avcC");
+        track->decoderConfig = avcC.payload;
+        track->decoderConfigSize = avcC.payloadSize;
+    } else {
+        PBJTestCheck(strcmp(entry.type, "mp4a") == 0);
+        PBJTestCheck(PBJMP4TestU32(entry.payload + 24) >> 16 == PBJ_MP4_TEST_AUDIO_RATE);
+        PBJMP4TestBox esds = PBJMP4TestChild(&entry, 28, "esds");
+        // ES_Descriptor, DecoderConfigDescriptor, DecoderSpecificInfo in four byte length form
+        const uint8_t *descriptor = esds.payload + 4;
+        PBJTestCheck(descriptor[0] == 0x03 && descriptor[8] == 0x04 && descriptor[9 + 4 + 13] == 0x05);
+        track->decoderConfig = descriptor + 9 + 4 + 13 + 5;
+        track->decoderConfigSize = descriptor[9 + 4 + 13 + 4];
+    }
+}
+
+static void PBJMP4TestParseFragment(PBJMP4TestFile *file, const PBJMP4TestBox *moof, const PBJMP4TestBox *mdat)
+{
+    PBJMP4TestBox mfhd = PBJMP4TestChild(moof, 0, "mfhd");
+    PBJTestCheck(PBJMP4TestU32(mfhd.payload + 4) == ++file->fragmentCount);
+
+    size_t offset = 0;
+    PBJMP4TestBox traf;
+    while (PBJMP4TestNextBox(moof->payload, moof->payloadSize, &offset, &traf)) {
+        if (strcmp(traf.type, "traf") != 0)
+            continue;
+        PBJMP4TestBox tfhd = PBJMP4TestChild(&traf, 0, "tfhd");
+        PBJTestCheck((PBJMP4TestU32(tfhd.payload) & 0xffffff) == 0x020000); // default base is moof
+        PBJMP4TestTrack *track = PBJMP4TestTrackWithID(file, PBJMP4TestU32(tfhd.payload + 4));
+
+        PBJMP4TestBox tfdt = PBJMP4TestChild(&traf, 0, "tfdt");
+        PBJTestCheck(tfdt.payload[0] == 1);
+        int64_t decodeTime = (int64_t)PBJMP4TestU64(tfdt.payload + 4);
+
+        PBJMP4TestBox trun = PBJMP4TestChild(&traf, 0, "trun");
+        PBJTestCheck(trun.payload[0] == 1 && (PBJMP4TestU32(trun.payload) & 0xffffff) == 0x000f01);
+        uint32_t count = PBJMP4TestU32(trun.payload + 4);
+        uint32_t dataOffset = PBJMP4TestU32(trun.payload + 8);
+        PBJTestCheck(trun.payloadSize == 12 + (size_t)count * 16);
+        PBJTestCheck(track->sampleCount + count <= PBJ_MP4_TEST_MAX_SAMPLES);
+        track->fragmentStarts[track->fragmentCount++] = track->sampleCount;
+
+        // sample data is inside this fragment's mdat
+        const uint8_t *data = moof->start + dataOffset;
+        for (uint32_t i = 0; i < count; i++) {
+            const uint8_t *entry = trun.payload + 12 + 16 * i;
+            PBJMP4TestSample *sample = &track->samples[track->sampleCount++];
+            sample->decodeTime = decodeTime;
+            sample->duration = PBJMP4TestU32(entry);
+            sample->size = PBJMP4TestU32(entry + 4);
+            sample->flags = PBJMP4TestU32(entry + 8);
+            sample->compositionOffset = (int32_t)PBJMP4TestU32(entry + 12);
+            sample->data = data;
+            PBJTestCheck(data >= mdat->payload && data + sample->size <= mdat->payload + mdat->payloadSize);
+            data += sample->size;
+            decodeTime += sample->duration;
+        }
+    }
+}
+
+static void PBJMP4TestParse(const uint8_t *bytes, size_t length, PBJMP4TestFile *file)
+{
+    memset(file, 0, sizeof(*file));
+    size_t offset = 0;
+    PBJMP4TestBox box;
+
+    PBJTestCheck(PBJMP4TestNextBox(bytes, length, &offset, &box) && strcmp(box.type, "ftyp") == 0);
+    PBJTestCheck(memcmp(box.payload, "isom", 4) == 0);
+    PBJTestCheck(PBJMP4TestNextBox(bytes, length, &offset, &box) && strcmp(box.type, "moov") == 0);
+    PBJMP4TestBox moov = box;
+
+    PBJMP4TestBox mvhd = PBJMP4TestChild(&moov, 0, "mvhd");
+    PBJTestCheck(PBJMP4TestU32(mvhd.payload + 12) == 1000);
+    file->nextTrackID = PBJMP4TestU32(mvhd.payload + 96);
+    size_t childOffset = 0;
+    PBJMP4TestBox child;
+    while (PBJMP4TestNextBox(moov.payload, moov.payloadSize, &childOffset, &child)) {
+        if (strcmp(child.type, "trak") == 0)
+            PBJMP4TestParseTrack(file, &child);
+    }
+    PBJMP4TestBox mvex = PBJMP4TestChild(&moov, 0, "mvex");
+    for (size_t i = 0; i < file->trackCount; i++) {
+        PBJTestCheck(file->tracks[i].trackID < file->nextTrackID);
+        PBJMP4TestBox trex;
+        size_t trexOffset = 0;
+        int found = 0;
+        while (PBJMP4TestNextBox(mvex.payload, mvex.payloadSize, &trexOffset, &trex))
+            found |= PBJMP4TestU32(trex.payload + 4) == file->tracks[i].trackID;
+        PBJTestCheck(found);
+    }
+    file->completeLength = offset;
+
+    // moof and mdat pairs from here on
+    while (PBJMP4TestNextBox(bytes, length, &offset, &box)) {
+        PBJTestCheck(strcmp(box.type, "moof") == 0);
+        PBJMP4TestBox moof = box;
+        PBJTestCheck(PBJMP4TestNextBox(bytes, length, &offset, &box) && strcmp(box.type, "mdat") == 0);
+        PBJMP4TestParseFragment(file, &moof, &box);
+        file->completeLength = offset;
+    }
+}
+
+#pragma mark - writing
+
+typedef struct {
+    PBJFragmentedMP4Track track;
+    int64_t decodeTime;
+    int32_t compositionOffset;
+    uint32_t duration;
+    int isSync;
+    size_t size;
+    uint8_t seed;
+} PBJMP4TestAppended;
+
+static void PBJMP4TestFillPayload(uint8_t *bytes, size_t size, uint8_t seed)
+{
+    for (size_t i = 0; i < size; i++)
+        bytes[i] = (uint8_t)(seed + i * 7);
+}
+
+typedef struct {
+    PBJMP4TestAppended appended[2][PBJ_MP4_TEST_MAX_SAMPLES];
+    size_t appendedCount[2];
+} PBJMP4TestClip;
+
+// 30 fps video with a keyframe every second, B-frame composition offsets, and AAC packets
+// interleaved by decode time
+static void PBJMP4TestMakeClip(PBJMP4TestClip *clip, double seconds, int video, int audio, uint64_t seed)
+{
+    memset(clip, 0, sizeof(*clip));
+    PBJTestRandom random = PBJTestRandomMake(seed);
+    int64_t frameDuration = PBJ_MP4_TEST_VIDEO_TIMESCALE / 30;
+    size_t frames = video ? (size_t)(seconds * 30) : 0;
+    size_t packets = audio ? (size_t)(seconds * PBJ_MP4_TEST_AUDIO_RATE / 1024) : 0;
+    for (size_t i = 0; i < frames; i++) {
+        PBJMP4TestAppended *sample = &clip->appended[0][clip->appendedCount[0]++];
+        sample->track = PBJFragmentedMP4TrackVideo;
+        sample->decodeTime = (int64_t)i * frameDuration;
+        sample->compositionOffset = (i % 30 == 0) ? (int32_t)frameDuration : (int32_t)(frameDuration * (1 + (int64_t)(i % 2)));
+        sample->isSync = (i % 30 == 0);
+        sample->size = sample->isSync ? 20000 + PBJTestRandomBelow(&random, 5000) : 500 + PBJTestRandomBelow(&random, 3000);
+        sample->seed = (uint8_t)i;
+    }
+    for (size_t i = 0; i < packets; i++) {
+        PBJMP4TestAppended *sample = &clip->appended[1][clip->appendedCount[1]++];
+        sample->track = PBJFragmentedMP4TrackAudio;
+        sample->decodeTime = (int64_t)i * 1024;
+        sample->duration = 1024;
+        sample->isSync = 1;
+        sample->size = 200 + PBJTestRandomBelow(&random, 200);
+        sample->seed = (uint8_t)(i * 3 + 1);
+    }
+}
+
+static PBJFragmentedMP4Muxer *PBJMP4TestCreateMuxer(PBJOutputSink *sink, int video, int audio, int32_t rotation, uint32_t priming, uint32_t fragmentDuration)
+{
+    PBJFragmentedMP4VideoTrack videoTrack = { PBJ_MP4_TEST_VIDEO_TIMESCALE, 1920, 1080, rotation, PBJMP4TestAVCC, sizeof(PBJMP4TestAVCC) };
+    PBJFragmentedMP4AudioTrack audioTrack = { PBJ_MP4_TEST_AUDIO_RATE, 1, 64000, PBJMP4TestASC, sizeof(PBJMP4TestASC), priming };
+    PBJFragmentedMP4Configuration configuration = { video ? &videoTrack : NULL, audio ? &audioTrack : NULL, fragmentDuration };
+    return PBJFragmentedMP4MuxerCreate(&configuration, PBJOutputSinkWriteFunction, sink);
+}
+
+// appends in decode time order across both tracks, as the writer does
+static void PBJMP4TestAppendClip(PBJFragmentedMP4Muxer *muxer, const PBJMP4TestClip *clip)
+{
+    static uint8_t payload[32768];
+    size_t next[2] = { 0, 0 };
+    while (next[0] < clip->appendedCount[0] || next[1] < clip->appendedCount[1]) {
+        int track;
+        if (next[0] == clip->appendedCount[0]) {
+            track = 1;
+        } else if (next[1] == clip->appendedCount[1]) {
+            track = 0;
+        } else {
+            double videoTime = (double)clip->appended[0][next[0]].decodeTime / PBJ_MP4_TEST_VIDEO_TIMESCALE;
+            double audioTime = (double)clip->appended[1][next[1]].decodeTime / PBJ_MP4_TEST_AUDIO_RATE;
+            track = videoTime <= audioTime ? 0 : 1;
+        }
+        const PBJMP4TestAppended *sample = &clip->appended[track][next[track]++];
+        PBJMP4TestFillPayload(payload, sample->size, sample->seed);
+        PBJTestCheck(PBJFragmentedMP4MuxerAppendSample(muxer, sample->track, payload, sample->size, sample->decodeTime,
+                                                       sample->compositionOffset, sample->duration, sample->isSync));
+    }
+}
+
+// what was parsed is what was appended, sample for sample
+static void PBJMP4TestCompareTrack(const PBJMP4TestTrack *track, const PBJMP4TestAppended *appended, size_t count, uint32_t finalDuration)
+{
+    static uint8_t payload[32768];
+    PBJTestCheck(track->sampleCount == count);
+    for (size_t i = 0; i < count; i++) {
+        const PBJMP4TestSample *sample = &track->samples[i];
+        PBJTestCheck(sample->decodeTime == appended[i].decodeTime);
+        uint32_t duration = i + 1 < count ? (uint32_t)(appended[i + 1].decodeTime - appended[i].decodeTime) : finalDuration;
+        PBJTestCheck(sample->duration == duration);
+        PBJTestCheck(sample->size == appended[i].size);
+        PBJTestCheck(sample->compositionOffset == appended[i].compositionOffset);
+        PBJTestCheck(sample->flags == (appended[i].isSync ? 0x02000000u : 0x01010000u));
+        PBJMP4TestFillPayload(payload, appended[i].size, appended[i].seed);
+        PBJTestCheck(memcmp(sample->data, payload, appended[i].size) == 0);
+    }
+}
+
+#pragma mark - tests
+
+static PBJMP4TestClip PBJMP4TestClipStorage;
+static PBJMP4TestFile PBJMP4TestFileStorage;
+
+static void PBJMP4TestAudioVideo(void)
+{
+    PBJMP4TestClip *clip = &PBJMP4TestClipStorage;
+    PBJMP4TestFile *file = &PBJMP4TestFileStorage;
+    PBJMP4TestMakeClip(clip, 20.0, 1, 1, 1);
+
+    PBJOutputSink *sink = PBJOutputSinkCreateMemory();
+    PBJFragmentedMP4Muxer *muxer = PBJMP4TestCreateMuxer(sink, 1, 1, 90, PBJ_MP4_TEST_PRIMING, 2000);
+    PBJTestCheck(muxer != NULL);
+    PBJMP4TestAppendClip(muxer, clip);
+    PBJTestCheck(PBJFragmentedMP4MuxerFinish(muxer));
+    PBJTestCheck(PBJFragmentedMP4MuxerFinish(muxer)); // finishing twice is harmless
+    PBJTestCheck(!PBJFragmentedMP4MuxerHasFailed(muxer));
+
+    size_t length = 0;
+    const uint8_t *bytes = PBJOutputSinkGetMemoryBytes(sink, &length);
+    PBJTestCheck(length == PBJFragmentedMP4MuxerGetBytesWritten(muxer));
+    PBJMP4TestParse(bytes, length, file);
+    PBJTestCheck(file->completeLength == length);
+    PBJTestCheck(file->fragmentCount == PBJFragmentedMP4MuxerGetFragmentCount(muxer));
+
+    PBJTestCheck(file->trackCount == 2 && file->nextTrackID == 3);
+    const PBJMP4TestTrack *video = &file->tracks[0];
+    const PBJMP4TestTrack *audio = &file->tracks[1];
+    PBJTestCheck(strcmp(video->handler, "vide") == 0 && strcmp(video->sampleEntry, "avc1") == 0);
+    PBJTestCheck(strcmp(audio->handler, "soun") == 0 && strcmp(audio->sampleEntry, "mp4a") == 0);
+    PBJTestCheck(video->timescale == PBJ_MP4_TEST_VIDEO_TIMESCALE && audio->timescale == PBJ_MP4_TEST_AUDIO_RATE);
+    PBJTestCheck(video->decoderConfigSize == sizeof(PBJMP4TestAVCC) && memcmp(video->decoderConfig, PBJMP4TestAVCC, sizeof(PBJMP4TestAVCC)) == 0);
+    PBJTestCheck(audio->decoderConfigSize == sizeof(PBJMP4TestASC) && memcmp(audio->decoderConfig, PBJMP4TestASC, sizeof(PBJMP4TestASC)) == 0);
+    PBJTestCheck(video->width == (1920u << 16) && video->height == (1080u << 16));
+    // a quarter turn clockwise
+    PBJTestCheck(video->matrix[0] == 0 && video->matrix[1] == 0x10000 && video->matrix[3] == -0x10000 && video->matrix[4] == 0);
+    PBJTestCheck(video->matrix[6] == (1080 << 16) && video->matrix[8] == 0x40000000);
+
+    // the audio's priming is edited out, playback starts at media time 2112, video is untouched
+    PBJTestCheck(!video->hasEditList);
+    PBJTestCheck(audio->hasEditList);
+    PBJTestCheck(audio->editMediaTime == PBJ_MP4_TEST_PRIMING);
+    PBJTestCheck(audio->editSegmentDuration == 0);
+    PBJTestCheck(audio->editRate == 0x00010000);
+
+    PBJMP4TestCompareTrack(video, clip->appended[0], clip->appendedCount[0], PBJ_MP4_TEST_VIDEO_TIMESCALE / 30);
+    PBJMP4TestCompareTrack(audio, clip->appended[1], clip->appendedCount[1], 1024);
+
+    // fragments open on a keyframe once two seconds have gone by
+    PBJTestCheck(video->fragmentCount == 10);
+    for (size_t i = 0; i < video->fragmentCount; i++) {
+        const PBJMP4TestSample *first = &video->samples[video->fragmentStarts[i]];
+        PBJTestCheck(first->flags == 0x02000000u);
+        PBJTestCheck(first->decodeTime == (int64_t)i * 2 * PBJ_MP4_TEST_VIDEO_TIMESCALE);
+    }
+    // audio and video in a fragment cover the same stretch of time, within a packet
+    for (size_t i = 1; i < audio->fragmentCount; i++) {
+        double audioStart = (double)audio->samples[audio->fragmentStarts[i]].decodeTime / PBJ_MP4_TEST_AUDIO_RATE;
+        PBJTestCheck(audioStart >= (double)i * 2.0 - 1024.0 / PBJ_MP4_TEST_AUDIO_RATE && audioStart <= (double)i * 2.0 + 1024.0 / PBJ_MP4_TEST_AUDIO_RATE);
+    }
+
+    PBJFragmentedMP4MuxerDestroy(muxer);
+    PBJOutputSinkDestroy(sink);
+}
+
+// a file cut short anywhere keeps every complete fragment before the cut
+static void PBJMP4TestTruncated(void)
+{
+    PBJMP4TestClip *clip = &PBJMP4TestClipStorage;
+    PBJMP4TestFile *file = &PBJMP4TestFileStorage;
+    PBJMP4TestMakeClip(clip, 6.0, 1, 1, 2);
+
+    PBJOutputSink *sink = PBJOutputSinkCreateMemory();
+    PBJFragmentedMP4Muxer *muxer = PBJMP4TestCreateMuxer(sink, 1, 1, 0, PBJ_MP4_TEST_PRIMING, 0);
+    PBJMP4TestAppendClip(muxer, clip);
+    PBJTestCheck(PBJFragmentedMP4MuxerFinish(muxer));
+    size_t length = 0;
+    const uint8_t *bytes = PBJOutputSinkGetMemoryBytes(sink, &length);
+    PBJMP4TestParse(bytes, length, file);
+    PBJTestCheck(file->fragmentCount == 6); // every keyframe with no fragment duration
+    uint32_t fragments = file->fragmentCount;
+
+    uint8_t *copy = (uint8_t *)malloc(length);
+    PBJTestCheck(copy != NULL);
+    memcpy(copy, bytes, length);
+    size_t boundaries[16];
+    size_t boundaryCount = 0;
+    size_t offset = 0;
+    PBJMP4TestBox box;
+    while (PBJMP4TestNextBox(copy, length, &offset, &box)) {
+        if (strcmp(box.type, "mdat") == 0 || strcmp(box.type, "moov") == 0)
+            boundaries[boundaryCount++] = offset;
+    }
+    PBJTestCheck(boundaryCount == fragments + 1);
+    for (size_t i = 0; i < boundaryCount; i++) {
+        PBJMP4TestParse(copy, boundaries[i], file);
+        PBJTestCheck(file->fragmentCount == i);
+        PBJTestCheck(file->tracks[0].sampleCount == (i == boundaryCount - 1 ? clip->appendedCount[0] : i * 30));
+    }
+    free(copy);
+    PBJFragmentedMP4MuxerDestroy(muxer);
+    PBJOutputSinkDestroy(sink);
+}
+
+static void PBJMP4TestAudioOnly(void)
+{
+    PBJMP4TestClip *clip = &PBJMP4TestClipStorage;
+    PBJMP4TestFile *file = &PBJMP4TestFileStorage;
+    PBJMP4TestMakeClip(clip, 3.0, 0, 1, 3);
+
+    PBJOutputSink *sink = PBJOutputSinkCreateMemory();
+    PBJFragmentedMP4Muxer *muxer = PBJMP4TestCreateMuxer(sink, 0, 1, 0, 0, 1000);
+    PBJMP4TestAppendClip(muxer, clip);
+    PBJTestCheck(PBJFragmentedMP4MuxerFinish(muxer));
+    size_t length = 0;
+    const uint8_t *bytes = PBJOutputSinkGetMemoryBytes(sink, &length);
+    PBJMP4TestParse(bytes, length, file);
+    PBJTestCheck(file->trackCount == 1 && file->tracks[0].trackID == 1);
+    // without priming there's nothing to edit
+    PBJTestCheck(!file->tracks[0].hasEditList);
+    PBJMP4TestCompareTrack(&file->tracks[0], clip->appended[1], clip->appendedCount[1], 1024);
+    PBJTestCheck(file->fragmentCount == 3);
+    PBJFragmentedMP4MuxerDestroy(muxer);
+    PBJOutputSinkDestroy(sink);
+}
+
+static int PBJMP4TestFailingWrite(void *context, const void *bytes, size_t length)
+{
+    size_t *remaining = (size_t *)context;
+    if (length > *remaining)
+        return 0;
+    *remaining -= length;
+    return 1;
+}
+
+static void PBJMP4TestRejections(void)
+{
+    PBJOutputSink *sink = PBJOutputSinkCreateMemory();
+    PBJFragmentedMP4Muxer *muxer = PBJMP4TestCreateMuxer(sink, 1, 1, 0, PBJ_MP4_TEST_PRIMING, 1000);
+    uint8_t payload[16] = { 0 };
+    PBJTestCheck(PBJFragmentedMP4MuxerAppendSample(muxer, PBJFragmentedMP4TrackVideo, payload, sizeof(payload), 3000, 0, 0, 1));
+    // decode times must increase on a track, and be positive
+    PBJTestCheck(!PBJFragmentedMP4MuxerAppendSample(muxer, PBJFragmentedMP4TrackVideo, payload, sizeof(payload), 3000, 0, 0, 0));
+    PBJTestCheck(!PBJFragmentedMP4MuxerAppendSample(muxer, PBJFragmentedMP4TrackVideo, payload, sizeof(payload), 1000, 0, 0, 0));
+    PBJTestCheck(!PBJFragmentedMP4MuxerAppendSample(muxer, PBJFragmentedMP4TrackAudio, payload, sizeof(payload), -1, 0, 1024, 1));
+    PBJTestCheck(!PBJFragmentedMP4MuxerAppendSample(muxer, PBJFragmentedMP4TrackAudio, payload, 0, 0, 0, 1024, 1));
+    PBJTestCheck(PBJFragmentedMP4MuxerAppendSample(muxer, PBJFragmentedMP4TrackAudio, payload, sizeof(payload), 0, 0, 1024, 1));
+    PBJTestCheck(!PBJFragmentedMP4MuxerHasFailed(muxer));
+    PBJTestCheck(PBJFragmentedMP4MuxerFinish(muxer));
+    PBJTestCheck(!PBJFragmentedMP4MuxerAppendSample(muxer, PBJFragmentedMP4TrackVideo, payload, sizeof(payload), 6000, 0, 0, 1));
+    PBJFragmentedMP4MuxerDestroy(muxer);
+    PBJOutputSinkDestroy(sink);
+
+    // a track without its configuration, or an edit past what elst can hold
+    PBJFragmentedMP4AudioTrack audio = { PBJ_MP4_TEST_AUDIO_RATE, 1, 0, PBJMP4TestASC, sizeof(PBJMP4TestASC), 0x80000000u };
+    PBJFragmentedMP4Configuration configuration = { NULL, &audio, 0 };
+    size_t budget = SIZE_MAX;
+    PBJTestCheck(PBJFragmentedMP4MuxerCreate(&configuration, PBJMP4TestFailingWrite, &budget) == NULL);
+    audio.primingFrames = PBJ_MP4_TEST_PRIMING;
+    audio.audioSpecificConfigSize = 0;
+    PBJTestCheck(PBJFragmentedMP4MuxerCreate(&configuration, PBJMP4TestFailingWrite, &budget) == NULL);
+    audio.audioSpecificConfigSize = sizeof(PBJMP4TestASC);
+
+    // the init segment can't be written
+    budget = 16;
+    PBJTestCheck(PBJFragmentedMP4MuxerCreate(&configuration, PBJMP4TestFailingWrite, &budget) == NULL);
+
+    // a fragment can't be written, the muxer stays failed
+    budget = 4096;
+    muxer = PBJFragmentedMP4MuxerCreate(&configuration, PBJMP4TestFailingWrite, &budget);
+    PBJTestCheck(muxer != NULL);
+    uint8_t large[8192] = { 0 };
+    PBJTestCheck(PBJFragmentedMP4MuxerAppendSample(muxer, PBJFragmentedMP4TrackAudio, large, sizeof(large), 0, 0, 1024, 1));
+    PBJTestCheck(!PBJFragmentedMP4MuxerFlush(muxer));
+    PBJTestCheck(PBJFragmentedMP4MuxerHasFailed(muxer));
+    PBJTestCheck(!PBJFragmentedMP4MuxerAppendSample(muxer, PBJFragmentedMP4TrackAudio, payload, sizeof(payload), 1024, 0, 1024, 1));
+    PBJTestCheck(!PBJFragmentedMP4MuxerFinish(muxer));
+    PBJFragmentedMP4MuxerDestroy(muxer);
+}
+
+int main(void)
+{
+    PBJMP4TestAudioVideo();
+    PBJMP4TestTruncated();
+    PBJMP4TestAudioOnly();
+    PBJMP4TestRejections();
+    return 0;
+}
@@ -0,0 +1,344 @@
+//
+//  PBJFrameAnalyzerTests.c
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#include "PBJFrameAnalyzer.h"
+#include "PBJTestSupport.h"
+
+#include <math.h>
+
+// the vector paths against the scalar one and a brute force gradient, then synthetic scenes
+// blurred by known amounts, where sharpness has to fall as the blur grows, scene change has to
+// tell a cut from a brightness shift or a small pan, and the best frame window has to hold the
+// best frame of its duration
+
+static const PBJSIMDLevel PBJFrameAnalyzerTestLevels[] = { PBJSIMDLevelSSE2, PBJSIMDLevelAVX2, PBJSIMDLevelNEON };
+
+static PBJFrameStatistics PBJFrameAnalyzerTestAnalyze(const PBJTestFrame *frame, PBJSIMDLevel level, size_t step)
+{
+    PBJFrameAnalyzerConfiguration configuration = { step, level };
+    PBJFrameAnalyzer *analyzer = PBJFrameAnalyzerCreate(&configuration);
+    PBJTestCheck(analyzer != NULL);
+    PBJFrameStatistics statistics;
+    PBJTestCheck(PBJFrameAnalyzerAnalyze(analyzer, &frame->image, &statistics));
+    PBJFrameAnalyzerDestroy(analyzer);
+    return statistics;
+}
+
+// smooth gradients, hard edged rectangles and a fine texture of noise
+static PBJTestFrame PBJFrameAnalyzerTestCreateScene(size_t width, size_t height, uint64_t seed)
+{
+    PBJTestFrame frame = PBJTestFrameCreate(width, height, PBJYCbCrRangeFull);
+    PBJNV12Image *image = &frame.image;
+    PBJTestRandom random = PBJTestRandomMake(seed);
+    for (size_t y = 0; y < height; y++) {
+        for (size_t x = 0; x < width; x++)
+            image->luma[y * image->lumaBytesPerRow + x] = (uint8_t)(60 + (x * 80) / width + (y * 40) / height);
+    }
+    for (int rectangle = 0; rectangle < 40; rectangle++) {
+        size_t left = PBJTestRandomBelow(&random, width);
+        size_t top = PBJTestRandomBelow(&random, height);
+        size_t right = left + 1 + PBJTestRandomBelow(&random, width / 4 + 1);
+        size_t bottom = top + 1 + PBJTestRandomBelow(&random, height / 4 + 1);
+        uint8_t value = (uint8_t)PBJTestRandomBetween(&random, 30, 219);
+        for (size_t y = top; y < bottom && y < height; y++) {
+            for (size_t x = left; x < right && x < width; x++)
+                image->luma[y * image->lumaBytesPerRow + x] = value;
+        }
+    }
+    for (size_t y = 0; y < height; y++) {
+        for (size_t x = 0; x < width; x++) {
+            uint8_t *luma = &image->luma[y * image->lumaBytesPerRow + x];
+            int value = *luma + (int)PBJTestRandomBetween(&random, -4, 4);
+            *luma = (uint8_t)(value < 0 ? 0 : value > 255 ? 255 : value);
+        }
+    }
+    return frame;
+}
+
+// a box blur, radiusY 0 for a horizontal motion blur
+static PBJTestFrame PBJFrameAnalyzerTestBlur(const PBJTestFrame *source, int radiusX, int radiusY)
+{
+    const PBJNV12Image *image = &source->image;
+    PBJTestFrame frame = PBJTestFrameCreate(image->width, image->height, image->range);
+    for (size_t y = 0; y < image->height; y++) {
+        for (size_t x = 0; x < image->width; x++) {
+            int sum = 0;
+            int count = 0;
+            for (int dy = -radiusY; dy <= radiusY; dy++) {
+                for (int dx = -radiusX; dx <= radiusX; dx++) {
+                    long row = (long)y + dy;
+                    long column = (long)x + dx;
+                    if (row < 0 || column < 0 || row >= (long)image->height || column >= (long)image->width)
+                        continue;
+                    sum += image->luma[(size_t)row * image->lumaBytesPerRow + (size_t)column];
+                    count++;
+                }
+            }
+            frame.image.luma[y * frame.image.lumaBytesPerRow + x] = (uint8_t)((sum + count / 2) / count);
+        }
+    }
+    return frame;
+}
+
+#pragma mark - kernels
+
+static void PBJFrameAnalyzerTestPathsAgree(void)
+{
+    PBJTestRandom random = PBJTestRandomMake(29);
+    for (int trial = 0; trial < 400; trial++) {
+        size_t width = 1 + PBJTestRandomBelow(&random, 200);
+        size_t height = 1 + PBJTestRandomBelow(&random, 40);
+        size_t step = 1 + PBJTestRandomBelow(&random, 5);
+        PBJTestFrame frame = PBJTestFrameCreate(width, height, PBJYCbCrRangeFull);
+        // padding past the width too, none of it may be read; every third frame full swing to stress the sums
+        for (size_t i = 0; i < frame.image.lumaBytesPerRow * height; i++)
+            frame.image.luma[i] = (uint8_t)(trial % 3 == 0 ? (PBJTestRandomNext(&random) & 1) * 255 : PBJTestRandomNext(&random));
+        PBJFrameStatistics reference = PBJFrameAnalyzerTestAnalyze(&frame, PBJSIMDLevelScalar, step);
+
+        for (size_t l = 0; l < sizeof(PBJFrameAnalyzerTestLevels) / sizeof(PBJFrameAnalyzerTestLevels[0]); l++) {
+            PBJSIMDLevel level = PBJFrameAnalyzerTestLevels[l];
+            if (PBJSIMDLevelResolve(level) != level)
+                continue;
+            PBJFrameStatistics statistics = PBJFrameAnalyzerTestAnalyze(&frame, level, step);
+            PBJTestCheck(memcmp(&statistics, &reference, sizeof(statistics)) == 0);
+        }
+
+        // right and down differences of every sampled row, at full resolution across it
+        const uint8_t *luma = frame.image.luma;
+        size_t bytesPerRow = frame.image.lumaBytesPerRow;
+        double energy = 0.0;
+        uint64_t count = 0;
+        for (size_t y = 0; y + 1 < height && width >= 2; y += step) {
+            for (size_t x = 0; x + 1 < width; x++) {
+                int center = luma[y * bytesPerRow + x];
+                int right = luma[y * bytesPerRow + x + 1];
+                int below = luma[(y + 1) * bytesPerRow + x];
+                energy += (right - center) * (right - center) + (below - center) * (below - center);
+            }
+            count += width - 1;
+        }
+        double sharpness = count ? energy / (double)count : 0.0;
+        PBJTestCheck(fabs(sharpness - reference.sharpness) <= 1e-3 * (1.0 + reference.sharpness));
+
+        uint32_t total = 0;
+        for (int bin = 0; bin < PBJFrameStatisticsHistogramBins; bin++)
+            total += reference.histogram[bin];
+        PBJTestCheck(total == reference.sampleCount);
+        PBJTestCheck(reference.sampleCount == ((height + step - 1) / step) * ((width + step - 1) / step));
+        PBJTestFrameDestroy(&frame);
+    }
+
+    // a full swing checkerboard across a row long enough to overflow a 32 bit lane that was never flushed
+    PBJTestFrame frame = PBJTestFrameCreate(300000, 2, PBJYCbCrRangeFull);
+    for (size_t x = 0; x < 300000; x++) {
+        frame.image.luma[x] = (x & 1) ? 255 : 0;
+        frame.image.luma[frame.image.lumaBytesPerRow + x] = (x & 1) ? 0 : 255;
+    }
+    PBJFrameStatistics reference = PBJFrameAnalyzerTestAnalyze(&frame, PBJSIMDLevelScalar, 1);
+    PBJTestCheck(fabsf(reference.sharpness - 2.0f * 255.0f * 255.0f) < 1.0f);
+    for (size_t l = 0; l < sizeof(PBJFrameAnalyzerTestLevels) / sizeof(PBJFrameAnalyzerTestLevels[0]); l++) {
+        PBJSIMDLevel level = PBJFrameAnalyzerTestLevels[l];
+        if (PBJSIMDLevelResolve(level) == level)
+            PBJTestCheck(PBJFrameAnalyzerTestAnalyze(&frame, level, 1).sharpness == reference.sharpness);
+    }
+    PBJTestFrameDestroy(&frame);
+}
+
+#pragma mark - scenes
+
+static void PBJFrameAnalyzerTestBlurredVersusSharp(void)
+{
+    for (uint64_t seed = 1; seed <= 5; seed++) {
+        PBJTestFrame sharp = PBJFrameAnalyzerTestCreateScene(640, 360, seed);
+        PBJTestFrame blurred1 = PBJFrameAnalyzerTestBlur(&sharp, 1, 1);
+        PBJTestFrame blurred2 = PBJFrameAnalyzerTestBlur(&sharp, 2, 2);
+        PBJTestFrame blurred4 = PBJFrameAnalyzerTestBlur(&sharp, 4, 4);
+        PBJTestFrame motion = PBJFrameAnalyzerTestBlur(&sharp, 6, 0);
+
+        PBJFrameStatistics sharpStatistics = PBJFrameAnalyzerTestAnalyze(&sharp, PBJSIMDLevelAuto, 4);
+        PBJFrameStatistics motionStatistics = PBJFrameAnalyzerTestAnalyze(&motion, PBJSIMDLevelAuto, 4);
+        float sharpness1 = PBJFrameAnalyzerTestAnalyze(&blurred1, PBJSIMDLevelAuto, 4).sharpness;
+        float sharpness2 = PBJFrameAnalyzerTestAnalyze(&blurred2, PBJSIMDLevelAuto, 4).sharpness;
+        float sharpness4 = PBJFrameAnalyzerTestAnalyze(&blurred4, PBJSIMDLevelAuto, 4).sharpness;
+        PBJTestCheck(sharpStatistics.sharpness > sharpness1 && sharpness1 > sharpness2 && sharpness2 > sharpness4);
+        // a blur along one axis still costs half the gradient at least
+        PBJTestCheck(sharpStatistics.sharpness > 1.5f * motionStatistics.sharpness);
+        PBJTestCheck(PBJFrameStatisticsScore(&sharpStatistics) > PBJFrameStatisticsScore(&motionStatistics));
+        // the automatic step reads fewer rows and still ranks them
+        PBJTestCheck(PBJFrameAnalyzerTestAnalyze(&sharp, PBJSIMDLevelAuto, 0).sharpness > PBJFrameAnalyzerTestAnalyze(&blurred2, PBJSIMDLevelAuto, 0).sharpness);
+
+        PBJTestFrameDestroy(&motion);
+        PBJTestFrameDestroy(&blurred4);
+        PBJTestFrameDestroy(&blurred2);
+        PBJTestFrameDestroy(&blurred1);
+        PBJTestFrameDestroy(&sharp);
+    }
+}
+
+static void PBJFrameAnalyzerTestSceneChange(void)
+{
+    for (uint64_t seed = 1; seed <= 5; seed++) {
+        PBJTestFrame scene = PBJFrameAnalyzerTestCreateScene(640, 360, seed);
+        size_t bytesPerRow = scene.image.lumaBytesPerRow;
+        PBJTestFrame brighter = PBJTestFrameCreate(640, 360, PBJYCbCrRangeFull);
+        for (size_t i = 0; i < bytesPerRow * 360; i++)
+            brighter.image.luma[i] = (uint8_t)(scene.image.luma[i] + 20 > 255 ? 255 : scene.image.luma[i] + 20);
+        PBJTestFrame panned = PBJTestFrameCreate(640, 360, PBJYCbCrRangeFull);
+        for (size_t y = 0; y < 360; y++) {
+            for (size_t x = 0; x < 640; x++)
+                panned.image.luma[y * bytesPerRow + x] = brighter.image.luma[y * bytesPerRow + (x + 4 < 640 ? x + 4 : 639)];
+        }
+        PBJTestFrame cut = PBJFrameAnalyzerTestCreateScene(640, 360, seed + 100);
+
+        PBJFrameAnalyzerConfiguration configuration = { 4, PBJSIMDLevelAuto };
+        PBJFrameAnalyzer *analyzer = PBJFrameAnalyzerCreate(&configuration);
+        PBJTestCheck(analyzer != NULL);
+        PBJFrameStatistics statistics;
+        PBJTestCheck(PBJFrameAnalyzerAnalyze(analyzer, &scene.image, &statistics) && statistics.sceneChange == 0.0f);
+        PBJTestCheck(PBJFrameAnalyzerAnalyze(analyzer, &scene.image, &statistics) && statistics.sceneChange == 0.0f);
+        PBJFrameAnalyzerAnalyze(analyzer, &brighter.image, &statistics);
+        float shift = statistics.sceneChange;
+        PBJFrameAnalyzerAnalyze(analyzer, &panned.image, &statistics);
+        float pan = statistics.sceneChange;
+        PBJFrameAnalyzerAnalyze(analyzer, &cut.image, &statistics);
+        PBJTestCheck(shift < 0.01f && pan < 0.03f);
+        PBJTestCheck(statistics.sceneChange > 0.05f && statistics.sceneChange > 4.0f * pan);
+
+        // forgotten on reset, the next frame has nothing to change from
+        PBJFrameAnalyzerReset(analyzer);
+        PBJTestCheck(PBJFrameAnalyzerAnalyze(analyzer, &scene.image, &statistics) && statistics.sceneChange == 0.0f);
+        PBJFrameAnalyzerDestroy(analyzer);
+
+        PBJTestFrameDestroy(&cut);
+        PBJTestFrameDestroy(&panned);
+        PBJTestFrameDestroy(&brighter);
+        PBJTestFrameDestroy(&scene);
+    }
+}
+
+// clipped shadows score nothing, video range is measured across its own range
+static void PBJFrameAnalyzerTestExposure(void)
+{
+    PBJTestRandom random = PBJTestRandomMake(3);
+    PBJTestFrame dark = PBJTestFrameCreate(64, 64, PBJYCbCrRangeFull);
+    for (size_t i = 0; i < dark.image.lumaBytesPerRow * 64; i++)
+        dark.image.luma[i] = (uint8_t)PBJTestRandomBelow(&random, 3);
+    PBJFrameStatistics statistics = PBJFrameAnalyzerTestAnalyze(&dark, PBJSIMDLevelAuto, 1);
+    PBJTestCheck(statistics.shadowFraction == 1.0f && PBJFrameStatisticsScore(&statistics) == 0.0f);
+    PBJTestFrameDestroy(&dark);
+
+    PBJTestFrame video = PBJTestFrameCreate(64, 64, PBJYCbCrRangeVideo);
+    for (size_t y = 0; y < 64; y++) {
+        for (size_t x = 0; x < 64; x++)
+            video.image.luma[y * video.image.lumaBytesPerRow + x] = x < 32 ? 16 : 235;
+    }
+    PBJFrameAnalyzer *analyzer = PBJFrameAnalyzerCreate(NULL);
+    PBJTestCheck(analyzer != NULL);
+    PBJTestCheck(PBJFrameAnalyzerAnalyze(analyzer, &video.image, &statistics));
+    PBJTestCheck(fabsf(statistics.meanLuma - 0.5f) < 1e-3f);
+    PBJTestCheck(statistics.shadowFraction == 0.5f && statistics.highlightFraction == 0.5f);
+    PBJNV12Image empty = video.image;
+    empty.width = 0;
+    PBJTestCheck(PBJFrameAnalyzerAnalyze(analyzer, &empty, &statistics) == 0);
+    PBJFrameAnalyzerDestroy(analyzer);
+    PBJTestFrameDestroy(&video);
+}
+
+#pragma mark - best frame
+
+static int PBJFrameAnalyzerTestReleased;
+
+static void PBJFrameAnalyzerTestRelease(void *context, void *frame)
+{
+    PBJFrameAnalyzerTestReleased++;
+}
+
+// with room to spare the window holds exactly the best frame of its duration, the latest of equals,
+// and whatever it holds every frame is released once
+static void PBJFrameAnalyzerTestBestFrameWindow(void)
+{
+    PBJTestRandom random = PBJTestRandomMake(41);
+    int offered = 0;
+    int taken = 0;
+    PBJFrameAnalyzerTestReleased = 0;
+    for (int trial = 0; trial < 300; trial++) {
+        int64_t duration = 1 + (int64_t)PBJTestRandomBelow(&random, 500);
+        size_t capacity = trial % 2 ? 1000 : 1 + PBJTestRandomBelow(&random, 4);
+        PBJBestFrameWindow *window = PBJBestFrameWindowCreate(duration, capacity, PBJFrameAnalyzerTestRelease, NULL);
+        PBJTestCheck(window != NULL);
+        int64_t times[400];
+        float scores[400];
+        int64_t now = 0;
+        int floor = -1;
+        for (int i = 0; i < 400; i++) {
+            now += (int64_t)PBJTestRandomBelow(&random, 40);
+            times[i] = now;
+            scores[i] = (float)PBJTestRandomBelow(&random, 100);
+            PBJBestFrameWindowOffer(window, (void *)(intptr_t)(i + 1), now, scores[i]);
+            offered++;
+            PBJTestCheck(PBJBestFrameWindowGetCount(window) <= capacity);
+
+            int64_t bestTime;
+            float bestScore;
+            void *best = PBJBestFrameWindowPeekBest(window, &bestTime, &bestScore);
+            PBJTestCheck(best != NULL);
+            if (capacity == 1000) {
+                int expected = -1;
+                for (int k = floor + 1; k <= i; k++) {
+                    if (times[k] >= now - duration && (expected < 0 || scores[k] >= scores[expected]))
+                        expected = k;
+                }
+                PBJTestCheck((intptr_t)best == expected + 1);
+                PBJTestCheck(bestTime == times[expected] && bestScore == scores[expected]);
+            } else {
+                PBJTestCheck(bestTime >= now - duration || (intptr_t)best == i + 1);
+            }
+            if (PBJTestRandomBelow(&random, 50) == 0) {
+                PBJTestCheck(PBJBestFrameWindowTakeBest(window, NULL, NULL) == best);
+                taken++;
+                // only frames after it stay candidates
+                floor = (int)(intptr_t)best - 1;
+            }
+        }
+        if (trial % 3 == 0) {
+            PBJBestFrameWindowClear(window);
+            PBJTestCheck(PBJBestFrameWindowGetCount(window) == 0);
+            PBJTestCheck(PBJBestFrameWindowPeekBest(window, NULL, NULL) == NULL);
+            PBJTestCheck(PBJBestFrameWindowTakeBest(window, NULL, NULL) == NULL);
+        }
+        PBJBestFrameWindowDestroy(window);
+    }
+    PBJTestCheck(PBJFrameAnalyzerTestReleased + taken == offered);
+}
+
+int main(void)
+{
+    PBJFrameAnalyzerTestPathsAgree();
+    PBJFrameAnalyzerTestBlurredVersusSharp();
+    PBJFrameAnalyzerTestSceneChange();
+    PBJFrameAnalyzerTestExposure();
+    PBJFrameAnalyzerTestBestFrameWindow();
+    return 0;
+}
@@ -0,0 +1,293 @@
+//
+//  PBJFrameMailboxTests.c
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#include "PBJFrameMailbox.h"
+#include "PBJTestSupport.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+
+// producers and consumers racing over one mailbox. every frame carries its producer, a
+// sequence number and a payload written before posting, so a consumer can tell a frame
+// that was published whole, and the ledger can tell that each one was taken or released
+// exactly once. consumers that only take when woken show a wake is never lost
+
+#define PBJ_FRAME_MAILBOX_TEST_MAX_PRODUCERS 4
+#define PBJ_FRAME_MAILBOX_TEST_PAYLOAD 16
+
+typedef struct {
+    uint32_t producer;
+    uint32_t sequence;
+    uint64_t payload[PBJ_FRAME_MAILBOX_TEST_PAYLOAD];
+} PBJFrameMailboxTestFrame;
+
+typedef enum {
+    PBJFrameMailboxTestOwnedProducer = 0,
+    PBJFrameMailboxTestOwnedTaken,
+    PBJFrameMailboxTestOwnedReleased,
+} PBJFrameMailboxTestOwner;
+
+typedef struct {
+    PBJFrameMailbox *mailbox;
+    uint32_t producerCount;
+    uint32_t consumerCount;
+    uint32_t frames; // per producer
+    int wakeDriven;
+
+    PBJFrameMailboxTestFrame *storage; // producerCount * frames
+    _Atomic(uint8_t) *owners;
+    atomic_uint_fast64_t taken;
+    atomic_uint_fast64_t released;
+    atomic_uint_fast64_t wakesPosted;
+    atomic_int producersDone;
+
+    pthread_mutex_t lock;
+    pthread_cond_t condition;
+    uint64_t wakes; // posted and not yet consumed, under lock
+} PBJFrameMailboxTestRun;
+
+typedef struct {
+    PBJFrameMailboxTestRun *run;
+    uint32_t index;
+} PBJFrameMailboxTestThread;
+
+static uint64_t PBJFrameMailboxTestWord(uint32_t producer, uint32_t sequence, uint32_t word)
+{
+    return ((uint64_t)producer << 48) ^ ((uint64_t)sequence << 16) ^ (word * 0x9e3779b97f4a7c15ull);
+}
+
+static void PBJFrameMailboxTestClaim(PBJFrameMailboxTestRun *run, PBJFrameMailboxTestFrame *frame, PBJFrameMailboxTestOwner owner)
+{
+    size_t index = (size_t)(frame - run->storage);
+    PBJTestCheck(index < (size_t)run->producerCount * run->frames);
+    uint8_t expected = PBJFrameMailboxTestOwnedProducer;
+    // a frame leaves the mailbox once, by a take or by a release, never both
+    PBJTestCheck(atomic_compare_exchange_strong(&run->owners[index], &expected, (uint8_t)owner));
+}
+
+static void PBJFrameMailboxTestRelease(void *context, void *frame)
+{
+    PBJFrameMailboxTestRun *run = (PBJFrameMailboxTestRun *)context;
+    PBJFrameMailboxTestClaim(run, (PBJFrameMailboxTestFrame *)frame, PBJFrameMailboxTestOwnedReleased);
+    atomic_fetch_add(&run->released, 1);
+}
+
+static void *PBJFrameMailboxTestProducer(void *context)
+{
+    PBJFrameMailboxTestThread *thread = (PBJFrameMailboxTestThread *)context;
+    PBJFrameMailboxTestRun *run = thread->run;
+    PBJTestRandom random = PBJTestRandomMake(thread->index + 1);
+    for (uint32_t sequence = 0; sequence < run->frames; sequence++) {
+        PBJFrameMailboxTestFrame *frame = &run->storage[(size_t)thread->index * run->frames + sequence];
+        frame->producer = thread->index;
+        frame->sequence = sequence;
+        for (uint32_t word = 0; word < PBJ_FRAME_MAILBOX_TEST_PAYLOAD; word++)
+            frame->payload[word] = PBJFrameMailboxTestWord(thread->index, sequence, word);
+
+        if (PBJFrameMailboxPost(run->mailbox, frame)) {
+            atomic_fetch_add(&run->wakesPosted, 1);
+            if (run->wakeDriven) {
+                pthread_mutex_lock(&run->lock);
+                run->wakes++;
+                pthread_cond_signal(&run->condition);
+                pthread_mutex_unlock(&run->lock);
+            }
+        }
+        if (PBJTestRandomBelow(&random, 32) == 0)
+            sched_yield();
+    }
+    atomic_fetch_add(&run->producersDone, 1);
+    if (run->wakeDriven) {
+        pthread_mutex_lock(&run->lock);
+        pthread_cond_broadcast(&run->condition);
+        pthread_mutex_unlock(&run->lock);
+    }
+    return NULL;
+}
+
+static void PBJFrameMailboxTestConsume(PBJFrameMailboxTestRun *run, PBJFrameMailboxTestFrame *frame, int64_t *lastSequence)
+{
+    PBJTestCheck(frame->producer < run->producerCount);
+    // published whole, the payload was written before the post
+    for (uint32_t word = 0; word < PBJ_FRAME_MAILBOX_TEST_PAYLOAD; word++)
+        PBJTestCheck(frame->payload[word] == PBJFrameMailboxTestWord(frame->producer, frame->sequence, word));
+    // latest wins, so one consumer never sees a producer go backwards
+    PBJTestCheck((int64_t)frame->sequence > lastSequence[frame->producer]);
+    lastSequence[frame->producer] = frame->sequence;
+    PBJFrameMailboxTestClaim(run, frame, PBJFrameMailboxTestOwnedTaken);
+    atomic_fetch_add(&run->taken, 1);
+}
+
+static void *PBJFrameMailboxTestConsumer(void *context)
+{
+    PBJFrameMailboxTestThread *thread = (PBJFrameMailboxTestThread *)context;
+    PBJFrameMailboxTestRun *run = thread->run;
+    PBJTestRandom random = PBJTestRandomMake(thread->index * 77 + 5);
+    int64_t lastSequence[PBJ_FRAME_MAILBOX_TEST_MAX_PRODUCERS];
+    for (uint32_t i = 0; i < PBJ_FRAME_MAILBOX_TEST_MAX_PRODUCERS; i++)
+        lastSequence[i] = -1;
+
+    for (;;) {
+        if (run->wakeDriven) {
+            // takes only after a wake, as a consumer blocked on a semaphore or a dispatch would
+            pthread_mutex_lock(&run->lock);
+            while (run->wakes == 0 && (uint32_t)atomic_load(&run->producersDone) < run->producerCount)
+                pthread_cond_wait(&run->condition, &run->lock);
+            int woken = run->wakes > 0;
+            if (woken)
+                run->wakes--;
+            pthread_mutex_unlock(&run->lock);
+            if (!woken)
+                break;
+        } else {
+            int done = (uint32_t)atomic_load(&run->producersDone) == run->producerCount;
+            if (done && atomic_load(&run->taken) + atomic_load(&run->released) == (uint64_t)run->producerCount * run->frames)
+                break;
+            if (done && PBJTestRandomBelow(&random, 2) == 0)
+                break;
+        }
+
+        PBJFrameMailboxTestFrame *frame = (PBJFrameMailboxTestFrame *)PBJFrameMailboxTake(run->mailbox);
+        if (frame)
+            PBJFrameMailboxTestConsume(run, frame, lastSequence);
+        // a slow consumer now and then, so frames get superseded
+        if (PBJTestRandomBelow(&random, 8) == 0)
+            sched_yield();
+    }
+    return NULL;
+}
+
+static void PBJFrameMailboxTestStress(uint32_t producerCount, uint32_t consumerCount, uint32_t frames, int wakeDriven)
+{
+    PBJFrameMailboxTestRun run;
+    memset(&run, 0, sizeof(run));
+    run.producerCount = producerCount;
+    run.consumerCount = consumerCount;
+    run.frames = frames;
+    run.wakeDriven = wakeDriven;
+    size_t total = (size_t)producerCount * frames;
+    run.storage = (PBJFrameMailboxTestFrame *)calloc(total, sizeof(PBJFrameMailboxTestFrame));
+    run.owners = (_Atomic(uint8_t) *)calloc(total, sizeof(_Atomic(uint8_t)));
+    PBJTestCheck(run.storage != NULL && run.owners != NULL);
+    for (size_t i = 0; i < total; i++)
+        atomic_init(&run.owners[i], PBJFrameMailboxTestOwnedProducer);
+    atomic_init(&run.taken, 0);
+    atomic_init(&run.released, 0);
+    atomic_init(&run.wakesPosted, 0);
+    atomic_init(&run.producersDone, 0);
+    pthread_mutex_init(&run.lock, NULL);
+    pthread_cond_init(&run.condition, NULL);
+    run.mailbox = PBJFrameMailboxCreate(PBJFrameMailboxTestRelease, &run);
+    PBJTestCheck(run.mailbox != NULL);
+
+    pthread_t producers[PBJ_FRAME_MAILBOX_TEST_MAX_PRODUCERS];
+    pthread_t consumers[4];
+    PBJFrameMailboxTestThread producerThreads[PBJ_FRAME_MAILBOX_TEST_MAX_PRODUCERS];
+    PBJFrameMailboxTestThread consumerThreads[4];
+    for (uint32_t i = 0; i < consumerCount; i++) {
+        consumerThreads[i] = (PBJFrameMailboxTestThread){ &run, i };
+        PBJTestCheck(pthread_create(&consumers[i], NULL, PBJFrameMailboxTestConsumer, &consumerThreads[i]) == 0);
+    }
+    for (uint32_t i = 0; i < producerCount; i++) {
+        producerThreads[i] = (PBJFrameMailboxTestThread){ &run, i };
+        PBJTestCheck(pthread_create(&producers[i], NULL, PBJFrameMailboxTestProducer, &producerThreads[i]) == 0);
+    }
+    for (uint32_t i = 0; i < producerCount; i++)
+        pthread_join(producers[i], NULL);
+    for (uint32_t i = 0; i < consumerCount; i++)
+        pthread_join(consumers[i], NULL);
+
+    PBJFrameMailboxCounters counters = PBJFrameMailboxGetCounters(run.mailbox);
+    uint64_t taken = atomic_load(&run.taken);
+    uint64_t released = atomic_load(&run.released);
+    PBJTestCheck(counters.posted == total);
+    PBJTestCheck(counters.taken == taken);
+    PBJTestCheck(counters.superseded == released);
+    // each wake found a full slot, taking it or seeing it superseded, so none was stranded
+    if (wakeDriven) {
+        PBJTestCheck(PBJFrameMailboxTake(run.mailbox) == NULL);
+        PBJTestCheck(taken + released == total);
+        PBJTestCheck(atomic_load(&run.wakesPosted) == taken);
+    }
+
+    // whatever a polling consumer left behind goes with the mailbox
+    PBJFrameMailboxDestroy(run.mailbox);
+    PBJTestCheck(atomic_load(&run.taken) + atomic_load(&run.released) == total);
+    for (size_t i = 0; i < total; i++)
+        PBJTestCheck(atomic_load(&run.owners[i]) != PBJFrameMailboxTestOwnedProducer);
+    PBJTestCheck(taken > 0);
+
+    pthread_mutex_destroy(&run.lock);
+    pthread_cond_destroy(&run.condition);
+    free((void *)run.owners);
+    free(run.storage);
+}
+
+static void PBJFrameMailboxTestSingleThread(void)
+{
+    PBJFrameMailboxTestRun run;
+    memset(&run, 0, sizeof(run));
+    run.producerCount = 1;
+    run.frames = 4;
+    run.storage = (PBJFrameMailboxTestFrame *)calloc(4, sizeof(PBJFrameMailboxTestFrame));
+    run.owners = (_Atomic(uint8_t) *)calloc(4, sizeof(_Atomic(uint8_t)));
+    PBJTestCheck(run.storage != NULL && run.owners != NULL);
+    for (size_t i = 0; i < 4; i++)
+        atomic_init(&run.owners[i], PBJFrameMailboxTestOwnedProducer);
+    atomic_init(&run.released, 0);
+    PBJFrameMailbox *mailbox = PBJFrameMailboxCreate(PBJFrameMailboxTestRelease, &run);
+
+    PBJTestCheck(PBJFrameMailboxTake(mailbox) == NULL);
+    PBJTestCheck(!PBJFrameMailboxPost(mailbox, NULL));
+    PBJTestCheck(PBJFrameMailboxPost(mailbox, &run.storage[0]));
+    PBJTestCheck(!PBJFrameMailboxPost(mailbox, &run.storage[1]));
+    PBJTestCheck(atomic_load(&run.owners[0]) == PBJFrameMailboxTestOwnedReleased);
+    PBJTestCheck(PBJFrameMailboxTake(mailbox) == &run.storage[1]);
+    PBJTestCheck(PBJFrameMailboxTake(mailbox) == NULL);
+    PBJTestCheck(PBJFrameMailboxPost(mailbox, &run.storage[2]));
+    PBJFrameMailboxClear(mailbox);
+    PBJTestCheck(atomic_load(&run.owners[2]) == PBJFrameMailboxTestOwnedReleased);
+    PBJTestCheck(PBJFrameMailboxPost(mailbox, &run.storage[3]));
+
+    PBJFrameMailboxCounters counters = PBJFrameMailboxGetCounters(mailbox);
+    PBJTestCheck(counters.posted == 4 && counters.taken == 1 && counters.superseded == 1);
+    PBJFrameMailboxDestroy(mailbox);
+    PBJTestCheck(atomic_load(&run.owners[3]) == PBJFrameMailboxTestOwnedReleased);
+    PBJTestCheck(atomic_load(&run.released) == 3);
+    free((void *)run.owners);
+    free(run.storage);
+}
+
+int main(void)
+{
+    PBJFrameMailboxTestSingleThread();
+    static const uint32_t shapes[][2] = { { 1, 1 }, { 1, 2 }, { 2, 1 }, { 4, 4 } };
+    for (size_t i = 0; i < sizeof(shapes) / sizeof(shapes[0]); i++) {
+        PBJFrameMailboxTestStress(shapes[i][0], shapes[i][1], 100000, 0);
+        PBJFrameMailboxTestStress(shapes[i][0], shapes[i][1], 100000, 1);
+    }
+    return 0;
+}
@@ -0,0 +1,205 @@
+//
+//  PBJFrameOrientationTests.c
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#include "PBJFrameOrientation.h"
+#include "PBJTestSupport.h"
+
+// all eight orientation and mirror combinations against a pixel by pixel reference, for every
+// vector path, sizes on and off the tile and block edges, and the rows split into strips
+
+static const PBJSIMDLevel PBJFrameOrientationTestLevels[] = { PBJSIMDLevelScalar, PBJSIMDLevelSSE2, PBJSIMDLevelAVX2, PBJSIMDLevelNEON };
+
+// where destination (x, y) reads from in a width x height plane, mirrored first then rotated clockwise
+static void PBJFrameOrientationTestSourcePoint(PBJFrameOrientation orientation, size_t width, size_t height,
+                                               size_t x, size_t y, size_t *sourceX, size_t *sourceY)
+{
+    size_t mirroredX;
+    switch (orientation & 3) {
+        case PBJFrameOrientationUp:
+            mirroredX = x;
+            *sourceY = y;
+            break;
+        case PBJFrameOrientationRight:
+            mirroredX = y;
+            *sourceY = height - 1 - x;
+            break;
+        case PBJFrameOrientationDown:
+            mirroredX = width - 1 - x;
+            *sourceY = height - 1 - y;
+            break;
+        default:
+            mirroredX = width - 1 - y;
+            *sourceY = x;
+            break;
+    }
+    *sourceX = orientation >= PBJFrameOrientationUpMirrored ? width - 1 - mirroredX : mirroredX;
+}
+
+static void PBJFrameOrientationTestCheckPlane(const uint8_t *source, size_t sourceBytesPerRow, size_t width, size_t height,
+                                              const uint8_t *destination, size_t destinationBytesPerRow,
+                                              size_t elementSize, PBJFrameOrientation orientation)
+{
+    size_t outputWidth, outputHeight;
+    PBJFrameOrientationOutputSize(orientation, width, height, &outputWidth, &outputHeight);
+    for (size_t y = 0; y < outputHeight; y++) {
+        for (size_t x = 0; x < outputWidth; x++) {
+            size_t sourceX, sourceY;
+            PBJFrameOrientationTestSourcePoint(orientation, width, height, x, y, &sourceX, &sourceY);
+            const uint8_t *expected = source + sourceY * sourceBytesPerRow + sourceX * elementSize;
+            const uint8_t *actual = destination + y * destinationBytesPerRow + x * elementSize;
+            PBJTestCheck(memcmp(actual, expected, elementSize) == 0);
+        }
+    }
+}
+
+// the destination starts filled with a marker, so rows that were skipped and writes past the width show up
+static void PBJFrameOrientationTestOrient(size_t width, size_t height, PBJFrameOrientation orientation, PBJSIMDLevel level, size_t strips, uint64_t seed)
+{
+    PBJTestFrame source = PBJTestFrameCreate(width, height, PBJYCbCrRangeVideo);
+    PBJTestFrameFillNoise(&source, seed);
+    size_t outputWidth, outputHeight;
+    PBJFrameOrientationOutputSize(orientation, width, height, &outputWidth, &outputHeight);
+    PBJTestFrame destination = PBJTestFrameCreate(outputWidth, outputHeight, PBJYCbCrRangeVideo);
+    size_t lumaBytes = destination.image.lumaBytesPerRow * outputHeight;
+    size_t chromaBytes = destination.image.chromaBytesPerRow * PBJNV12ChromaHeight(&destination.image);
+    memset(destination.storage, 0xa5, lumaBytes + chromaBytes);
+
+    size_t step = (outputHeight / strips + 1) & ~(size_t)1;
+    if (step < 2)
+        step = 2;
+    for (size_t row = 0; row < outputHeight; row += step)
+        PBJFrameOrientRows(&source.image, &destination.image, orientation, row, row + step, level);
+
+    PBJFrameOrientationTestCheckPlane(source.image.luma, source.image.lumaBytesPerRow, width, height,
+                                      destination.image.luma, destination.image.lumaBytesPerRow, 1, orientation);
+    PBJFrameOrientationTestCheckPlane(source.image.chroma, source.image.chromaBytesPerRow, width / 2, height / 2,
+                                      destination.image.chroma, destination.image.chromaBytesPerRow, 2, orientation);
+    for (size_t y = 0; y < outputHeight; y++) {
+        for (size_t x = outputWidth; x < destination.image.lumaBytesPerRow; x++)
+            PBJTestCheck(destination.image.luma[y * destination.image.lumaBytesPerRow + x] == 0xa5);
+    }
+    for (size_t y = 0; y < PBJNV12ChromaHeight(&destination.image); y++) {
+        for (size_t x = outputWidth; x < destination.image.chromaBytesPerRow; x++)
+            PBJTestCheck(destination.image.chroma[y * destination.image.chromaBytesPerRow + x] == 0xa5);
+    }
+
+    PBJTestFrameDestroy(&destination);
+    PBJTestFrameDestroy(&source);
+}
+
+static void PBJFrameOrientationTestAllCombinations(void)
+{
+    // single blocks, partial blocks and tiles on both axes, and capture sizes
+    static const size_t sizes[][2] = {
+        { 2, 2 }, { 8, 8 }, { 16, 16 }, { 18, 10 }, { 30, 2 }, { 2, 34 }, { 34, 66 }, { 64, 48 },
+        { 130, 98 }, { 258, 130 }, { 640, 480 }, { 1282, 722 }
+    };
+    static const size_t strips[] = { 1, 3, 7 };
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        for (int orientation = PBJFrameOrientationUp; orientation <= PBJFrameOrientationLeftMirrored; orientation++) {
+            for (size_t l = 0; l < sizeof(PBJFrameOrientationTestLevels) / sizeof(PBJFrameOrientationTestLevels[0]); l++) {
+                PBJSIMDLevel level = PBJFrameOrientationTestLevels[l];
+                if (PBJSIMDLevelResolve(level) != level)
+                    continue;
+                for (size_t s = 0; s < sizeof(strips) / sizeof(strips[0]); s++)
+                    PBJFrameOrientationTestOrient(sizes[i][0], sizes[i][1], (PBJFrameOrientation)orientation, level, strips[s], 31 * i + (uint64_t)orientation);
+            }
+        }
+    }
+}
+
+// an orientation followed by its inverse gives back the source
+static void PBJFrameOrientationTestRoundTrip(void)
+{
+    static const PBJFrameOrientation inverses[] = {
+        PBJFrameOrientationUp, PBJFrameOrientationLeft, PBJFrameOrientationDown, PBJFrameOrientationRight,
+        PBJFrameOrientationUpMirrored, PBJFrameOrientationRightMirrored, PBJFrameOrientationDownMirrored, PBJFrameOrientationLeftMirrored
+    };
+    PBJTestFrame source = PBJTestFrameCreate(322, 182, PBJYCbCrRangeFull);
+    PBJTestFrameFillNoise(&source, 5);
+    uint64_t hash = PBJTestImageHash(&source.image);
+    for (int orientation = PBJFrameOrientationUp; orientation <= PBJFrameOrientationLeftMirrored; orientation++) {
+        size_t width, height;
+        PBJFrameOrientationOutputSize((PBJFrameOrientation)orientation, 322, 182, &width, &height);
+        PBJTestFrame oriented = PBJTestFrameCreate(width, height, PBJYCbCrRangeFull);
+        PBJTestFrame restored = PBJTestFrameCreate(322, 182, PBJYCbCrRangeFull);
+        PBJFrameOrient(&source.image, &oriented.image, (PBJFrameOrientation)orientation);
+        PBJTestCheck(orientation == PBJFrameOrientationUp || PBJTestImageHash(&oriented.image) != hash);
+        PBJFrameOrient(&oriented.image, &restored.image, inverses[orientation]);
+        PBJTestCheck(PBJTestImageHash(&restored.image) == hash);
+        PBJTestFrameDestroy(&restored);
+        PBJTestFrameDestroy(&oriented);
+    }
+    PBJTestFrameDestroy(&source);
+}
+
+static void PBJFrameOrientationTestMake(void)
+{
+    PBJTestCheck(PBJFrameOrientationMake(0.0, 0) == PBJFrameOrientationUp);
+    PBJTestCheck(PBJFrameOrientationMake(90.0, 0) == PBJFrameOrientationRight);
+    PBJTestCheck(PBJFrameOrientationMake(180.0, 0) == PBJFrameOrientationDown);
+    PBJTestCheck(PBJFrameOrientationMake(270.0, 0) == PBJFrameOrientationLeft);
+    PBJTestCheck(PBJFrameOrientationMake(360.0, 0) == PBJFrameOrientationUp);
+    PBJTestCheck(PBJFrameOrientationMake(-90.0, 0) == PBJFrameOrientationLeft);
+    PBJTestCheck(PBJFrameOrientationMake(-450.0, 0) == PBJFrameOrientationLeft);
+    PBJTestCheck(PBJFrameOrientationMake(44.0, 0) == PBJFrameOrientationUp);
+    PBJTestCheck(PBJFrameOrientationMake(46.0, 0) == PBJFrameOrientationRight);
+    PBJTestCheck(PBJFrameOrientationMake(89.5, 1) == PBJFrameOrientationRightMirrored);
+    PBJTestCheck(PBJFrameOrientationMake(0.0, 1) == PBJFrameOrientationUpMirrored);
+    PBJTestCheck(PBJFrameOrientationMake(-180.0, 1) == PBJFrameOrientationDownMirrored);
+
+    for (int orientation = PBJFrameOrientationUp; orientation <= PBJFrameOrientationLeftMirrored; orientation++) {
+        size_t width = 0, height = 0;
+        PBJFrameOrientationOutputSize((PBJFrameOrientation)orientation, 1920, 1080, &width, &height);
+        int swaps = PBJFrameOrientationSwapsDimensions((PBJFrameOrientation)orientation);
+        PBJTestCheck(swaps == (orientation == PBJFrameOrientationRight || orientation == PBJFrameOrientationLeft ||
+                               orientation == PBJFrameOrientationRightMirrored || orientation == PBJFrameOrientationLeftMirrored));
+        PBJTestCheck(width == (swaps ? 1080u : 1920u) && height == (swaps ? 1920u : 1080u));
+    }
+}
+
+// a destination of the wrong size is left alone rather than written out of bounds
+static void PBJFrameOrientationTestMismatchedDestination(void)
+{
+    PBJTestFrame source = PBJTestFrameCreate(64, 32, PBJYCbCrRangeVideo);
+    PBJTestFrameFillNoise(&source, 9);
+    PBJTestFrame destination = PBJTestFrameCreate(64, 32, PBJYCbCrRangeVideo);
+    uint64_t hash = PBJTestImageHash(&destination.image);
+    PBJFrameOrient(&source.image, &destination.image, PBJFrameOrientationRight);
+    PBJTestCheck(PBJTestImageHash(&destination.image) == hash);
+    PBJFrameOrientRows(&source.image, &destination.image, PBJFrameOrientationDown, 32, 64, PBJSIMDLevelAuto);
+    PBJTestCheck(PBJTestImageHash(&destination.image) == hash);
+    PBJTestFrameDestroy(&destination);
+    PBJTestFrameDestroy(&source);
+}
+
+int main(void)
+{
+    PBJFrameOrientationTestAllCombinations();
+    PBJFrameOrientationTestRoundTrip();
+    PBJFrameOrientationTestMake();
+    PBJFrameOrientationTestMismatchedDestination();
+    return 0;
+}
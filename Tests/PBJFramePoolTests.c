@@ -0,0 +1,276 @@
+//
+//  PBJFramePoolTests.c
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#include "PBJFramePool.h"
+#include "PBJTestSupport.h"
+
+#include <pthread.h>
+
+// plane and row layout, recycling, the byte cap and trimming on one thread, then producers
+// handing filled buffers to consumers that check them and hold extra references, so a buffer is
+// released on a thread other than the one that acquired it while trims run alongside. a buffer
+// recycled while still referenced shows up as a consumer seeing another producer's fill
+
+#define PBJ_FRAME_POOL_TEST_THREADS 3
+#define PBJ_FRAME_POOL_TEST_QUEUE 16
+#define PBJ_FRAME_POOL_TEST_HELD 4
+
+static void PBJFramePoolTestLayout(void)
+{
+    PBJFramePool *pool = PBJFramePoolCreate(NULL);
+    PBJTestCheck(pool != NULL);
+
+    // odd sizes, every plane aligned and every row padded
+    PBJFrameBuffer *buffer = PBJFramePoolAcquire(pool, PBJFrameFormatNV12, 1921, 1081);
+    PBJTestCheck(buffer != NULL && PBJFrameBufferGetPlaneCount(buffer) == 2);
+    for (size_t plane = 0; plane < 2; plane++) {
+        PBJTestCheck(((uintptr_t)PBJFrameBufferGetPlane(buffer, plane) & 63) == 0);
+        PBJTestCheck(PBJFrameBufferGetBytesPerRow(buffer, plane) % 64 == 0);
+    }
+    PBJTestCheck(PBJFrameBufferGetBytesPerRow(buffer, 0) >= 1921 && PBJFrameBufferGetBytesPerRow(buffer, 1) >= 1922);
+    PBJNV12Image image = PBJFrameBufferGetNV12Image(buffer, PBJYCbCrRangeFull);
+    PBJTestCheck(image.width == 1921 && image.height == 1081);
+    PBJTestCheck(image.chroma >= image.luma + image.lumaBytesPerRow * 1081);
+    PBJTestCheck(PBJFrameBufferGetPlaneSize(buffer, 1) == image.chromaBytesPerRow * PBJNV12ChromaHeight(&image));
+    memset(image.luma, 1, PBJFrameBufferGetPlaneSize(buffer, 0));
+    memset(image.chroma, 2, PBJFrameBufferGetPlaneSize(buffer, 1));
+    PBJFrameBufferRelease(buffer);
+
+    PBJFramePoolConfiguration configuration = PBJFramePoolDefaultConfiguration();
+    configuration.alignment = 256;
+    configuration.rowAlignment = 16;
+    PBJFramePool *aligned = PBJFramePoolCreate(&configuration);
+    PBJTestCheck(aligned != NULL);
+    PBJFrameBuffer *bgra = PBJFramePoolAcquire(aligned, PBJFrameFormatBGRA, 33, 3);
+    PBJTestCheck(bgra != NULL && ((uintptr_t)PBJFrameBufferGetPlane(bgra, 0) & 255) == 0);
+    PBJTestCheck(PBJFrameBufferGetBytesPerRow(bgra, 0) == 144);
+    PBJTestCheck(PBJFramePoolAcquire(aligned, PBJFrameFormatBGRA, 0, 3) == NULL);
+    PBJTestCheck(PBJFramePoolAcquire(aligned, PBJFrameFormatBGRA, SIZE_MAX / 2, 3) == NULL);
+    PBJFrameBufferRelease(bgra);
+    PBJFramePoolDestroy(aligned);
+
+    // the most recently released buffer of the same key comes back, another key never gets it
+    PBJFrameBuffer *first = PBJFramePoolAcquire(pool, PBJFrameFormatBGRA, 100, 100);
+    PBJFrameBuffer *second = PBJFramePoolAcquire(pool, PBJFrameFormatBGRA, 100, 100);
+    PBJFrameBufferRelease(first);
+    PBJFrameBufferRelease(second);
+    PBJTestCheck(PBJFramePoolAcquire(pool, PBJFrameFormatBGRA, 100, 100) == second);
+    PBJFrameBuffer *bytes = PBJFramePoolAcquire(pool, PBJFrameFormatBytes, 100, 100);
+    PBJTestCheck(bytes != first);
+    PBJFramePoolStatistics statistics = PBJFramePoolGetStatistics(pool);
+    PBJTestCheck(statistics.hits == 1 && statistics.misses == 4);
+    PBJTestCheck(statistics.buffersInUse == 2);
+
+    // a retained buffer stays out of the pool until its last release
+    PBJTestCheck(PBJFrameBufferRetain(bytes) == bytes);
+    PBJFrameBufferRelease(bytes);
+    PBJTestCheck(PBJFramePoolGetStatistics(pool).buffersInUse == 2);
+
+    // buffers outlive their pool
+    PBJFramePoolDestroy(pool);
+    memset(PBJFrameBufferGetPlane(second, 0), 3, PBJFrameBufferGetPlaneSize(second, 0));
+    PBJFrameBufferRelease(second);
+    PBJFrameBufferRelease(bytes);
+    PBJFrameBufferRelease(NULL);
+}
+
+static void PBJFramePoolTestCap(void)
+{
+    PBJFramePoolConfiguration configuration = PBJFramePoolDefaultConfiguration();
+    configuration.maximumBytes = 3 * (1000 * 1024 + 128);
+    PBJFramePool *pool = PBJFramePoolCreate(&configuration);
+    PBJTestCheck(pool != NULL);
+
+    PBJFrameBuffer *buffers[5];
+    for (size_t i = 0; i < 5; i++) {
+        buffers[i] = PBJFramePoolAcquire(pool, PBJFrameFormatBytes, 1000 + i * 64, 1024);
+        PBJTestCheck(buffers[i] != NULL);
+    }
+    // buffers in use are never taken back
+    PBJFramePoolStatistics statistics = PBJFramePoolGetStatistics(pool);
+    PBJTestCheck(statistics.buffersResident == 5 && statistics.bytesResident > configuration.maximumBytes);
+    PBJTestCheck(statistics.peakBytesResident == statistics.bytesResident);
+
+    // released in order, the oldest idle go first and the two newest fit
+    for (size_t i = 0; i < 5; i++)
+        PBJFrameBufferRelease(buffers[i]);
+    statistics = PBJFramePoolGetStatistics(pool);
+    PBJTestCheck(statistics.bytesResident <= configuration.maximumBytes);
+    PBJTestCheck(statistics.buffersResident == 2 && statistics.evictions == 3 && statistics.bytesInUse == 0);
+    PBJFrameBuffer *kept = PBJFramePoolAcquire(pool, PBJFrameFormatBytes, 1000 + 4 * 64, 1024);
+    PBJTestCheck(kept == buffers[4]);
+    PBJFrameBufferRelease(kept);
+
+    // a lower cap applies from the next release, which leaves room for one
+    PBJFramePoolSetMaximumBytes(pool, 1300 * 1024);
+    kept = PBJFramePoolAcquire(pool, PBJFrameFormatBytes, 1000 + 3 * 64, 1024);
+    PBJTestCheck(kept == buffers[3]);
+    PBJFrameBufferRelease(kept);
+    statistics = PBJFramePoolGetStatistics(pool);
+    PBJTestCheck(statistics.evictions == 4 && statistics.buffersResident == 1 && statistics.bytesResident <= 1300 * 1024);
+
+    PBJFramePoolTrim(pool, 0);
+    statistics = PBJFramePoolGetStatistics(pool);
+    PBJTestCheck(statistics.bytesResident == 0 && statistics.buffersResident == 0);
+    PBJFramePoolDestroy(pool);
+}
+
+#pragma mark - concurrency
+
+typedef struct {
+    PBJFramePool *pool;
+    PBJFrameBuffer *queue[PBJ_FRAME_POOL_TEST_QUEUE];
+    size_t head;
+    size_t count;
+    int producersDone;
+    int iterations;
+    pthread_mutex_t mutex;
+    pthread_cond_t condition;
+} PBJFramePoolTestHandOff;
+
+typedef struct {
+    PBJFramePoolTestHandOff *handOff;
+    uint64_t seed;
+} PBJFramePoolTestProducer;
+
+static void *PBJFramePoolTestProduce(void *context)
+{
+    PBJFramePoolTestProducer *producer = (PBJFramePoolTestProducer *)context;
+    PBJFramePoolTestHandOff *handOff = producer->handOff;
+    PBJTestRandom random = PBJTestRandomMake(producer->seed);
+    for (int i = 0; i < handOff->iterations; i++) {
+        // a few keys so buffers are shared between the producers
+        PBJFrameFormat format = (PBJFrameFormat)PBJTestRandomBelow(&random, PBJFrameFormatCount);
+        size_t width = 64 + (size_t)PBJTestRandomBelow(&random, 4) * 32;
+        size_t height = 16 + (size_t)PBJTestRandomBelow(&random, 3);
+        PBJFrameBuffer *buffer = PBJFramePoolAcquire(handOff->pool, format, width, height);
+        PBJTestCheck(buffer != NULL);
+        uint8_t tag = (uint8_t)PBJTestRandomNext(&random);
+        for (size_t plane = 0; plane < PBJFrameBufferGetPlaneCount(buffer); plane++)
+            memset(PBJFrameBufferGetPlane(buffer, plane), tag, PBJFrameBufferGetPlaneSize(buffer, plane));
+        if (PBJTestRandomBelow(&random, 1024) == 0)
+            PBJFramePoolTrim(handOff->pool, 4096);
+
+        pthread_mutex_lock(&handOff->mutex);
+        while (handOff->count == PBJ_FRAME_POOL_TEST_QUEUE)
+            pthread_cond_wait(&handOff->condition, &handOff->mutex);
+        handOff->queue[(handOff->head + handOff->count++) % PBJ_FRAME_POOL_TEST_QUEUE] = buffer;
+        pthread_cond_broadcast(&handOff->condition);
+        pthread_mutex_unlock(&handOff->mutex);
+    }
+    return NULL;
+}
+
+static void *PBJFramePoolTestConsume(void *context)
+{
+    PBJFramePoolTestHandOff *handOff = (PBJFramePoolTestHandOff *)context;
+    PBJFrameBuffer *held[PBJ_FRAME_POOL_TEST_HELD] = { NULL };
+    size_t next = 0;
+    for (;;) {
+        pthread_mutex_lock(&handOff->mutex);
+        while (handOff->count == 0 && handOff->producersDone < PBJ_FRAME_POOL_TEST_THREADS)
+            pthread_cond_wait(&handOff->condition, &handOff->mutex);
+        if (handOff->count == 0) {
+            pthread_mutex_unlock(&handOff->mutex);
+            break;
+        }
+        PBJFrameBuffer *buffer = handOff->queue[handOff->head];
+        handOff->head = (handOff->head + 1) % PBJ_FRAME_POOL_TEST_QUEUE;
+        handOff->count--;
+        pthread_cond_broadcast(&handOff->condition);
+        pthread_mutex_unlock(&handOff->mutex);
+
+        uint8_t tag = PBJFrameBufferGetPlane(buffer, 0)[0];
+        for (size_t plane = 0; plane < PBJFrameBufferGetPlaneCount(buffer); plane++) {
+            const uint8_t *bytes = PBJFrameBufferGetPlane(buffer, plane);
+            for (size_t i = 0; i < PBJFrameBufferGetPlaneSize(buffer, plane); i++)
+                PBJTestCheck(bytes[i] == tag);
+        }
+        // a second holder outlives the first, as a CGImage does its converter
+        PBJFrameBufferRelease(held[next]);
+        held[next] = PBJFrameBufferRetain(buffer);
+        next = (next + 1) % PBJ_FRAME_POOL_TEST_HELD;
+        PBJFrameBufferRelease(buffer);
+    }
+    for (size_t i = 0; i < PBJ_FRAME_POOL_TEST_HELD; i++)
+        PBJFrameBufferRelease(held[i]);
+    return NULL;
+}
+
+static void PBJFramePoolTestConcurrency(size_t maximumBytes)
+{
+    PBJFramePoolConfiguration configuration = PBJFramePoolDefaultConfiguration();
+    configuration.maximumBytes = maximumBytes;
+
+    PBJFramePoolTestHandOff handOff;
+    memset(&handOff, 0, sizeof(handOff));
+    handOff.pool = PBJFramePoolCreate(&configuration);
+    handOff.iterations = 20000;
+    PBJTestCheck(handOff.pool != NULL);
+    pthread_mutex_init(&handOff.mutex, NULL);
+    pthread_cond_init(&handOff.condition, NULL);
+
+    pthread_t producers[PBJ_FRAME_POOL_TEST_THREADS];
+    pthread_t consumers[PBJ_FRAME_POOL_TEST_THREADS];
+    PBJFramePoolTestProducer contexts[PBJ_FRAME_POOL_TEST_THREADS];
+    for (size_t i = 0; i < PBJ_FRAME_POOL_TEST_THREADS; i++) {
+        contexts[i].handOff = &handOff;
+        contexts[i].seed = i + 1;
+        PBJTestCheck(pthread_create(&producers[i], NULL, PBJFramePoolTestProduce, &contexts[i]) == 0);
+        PBJTestCheck(pthread_create(&consumers[i], NULL, PBJFramePoolTestConsume, &handOff) == 0);
+    }
+    for (size_t i = 0; i < PBJ_FRAME_POOL_TEST_THREADS; i++) {
+        pthread_join(producers[i], NULL);
+        pthread_mutex_lock(&handOff.mutex);
+        handOff.producersDone++;
+        pthread_cond_broadcast(&handOff.condition);
+        pthread_mutex_unlock(&handOff.mutex);
+    }
+    for (size_t i = 0; i < PBJ_FRAME_POOL_TEST_THREADS; i++)
+        pthread_join(consumers[i], NULL);
+
+    // every reference came back and the cap holds once nothing is in use
+    PBJFramePoolStatistics statistics = PBJFramePoolGetStatistics(handOff.pool);
+    PBJTestCheck(statistics.bytesInUse == 0 && statistics.buffersInUse == 0);
+    PBJTestCheck(statistics.bytesResident <= maximumBytes);
+    PBJTestCheck(statistics.hits + statistics.misses == (uint64_t)handOff.iterations * PBJ_FRAME_POOL_TEST_THREADS);
+    // with room for the working set most acquires are recycled, the trims account for the misses
+    if (maximumBytes >= 1024 * 1024)
+        PBJTestCheck(statistics.misses * 8 < statistics.hits);
+
+    pthread_cond_destroy(&handOff.condition);
+    pthread_mutex_destroy(&handOff.mutex);
+    PBJFramePoolDestroy(handOff.pool);
+}
+
+int main(void)
+{
+    PBJFramePoolTestLayout();
+    PBJFramePoolTestCap();
+    // a tight cap keeps evicting under the threads, a loose one recycles nearly everything
+    PBJFramePoolTestConcurrency(64 * 1024);
+    PBJFramePoolTestConcurrency(4 * 1024 * 1024);
+    return 0;
+}
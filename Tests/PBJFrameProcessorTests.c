@@ -0,0 +1,399 @@
+//
+//  PBJFrameProcessorTests.c
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include "PBJFrameProcessor.h"
+#include "PBJFrameStages.h"
+#include "PBJInstrumentation.h"
+#include "PBJTestSupport.h"
+
+#include <stdatomic.h>
+
+// chains of in-place and out-of-place stages over frames whose heights are odd and don't divide
+// into whole tiles, with no workers, one and seven, against a reference that runs each stage
+// alone over the whole frame on one thread. the fused passes have to match it byte for byte,
+// the output has to land in frame or spare as the out-of-place stages trade them, and planes an
+// out-of-place stage doesn't declare have to come over from its source. every tile has to run
+// exactly once however the workers steal, and a deadline has to skip whole passes, never half
+
+#define PBJ_FRAME_PROCESSOR_TEST_FILL 0xcd // spares start out as this, anything not written shows
+
+static const size_t PBJFrameProcessorTestThreadCounts[] = { PBJFrameProcessorNoWorkers, 1, 7 };
+
+#pragma mark - frames
+
+static PBJTestFrame PBJFrameProcessorTestFrameCopy(const PBJTestFrame *frame)
+{
+    PBJTestFrame copy = PBJTestFrameCreate(frame->image.width, frame->image.height, frame->image.range);
+    size_t bytes = frame->image.lumaBytesPerRow * frame->image.height + frame->image.chromaBytesPerRow * PBJNV12ChromaHeight(&frame->image);
+    memcpy(copy.storage, frame->storage, bytes);
+    return copy;
+}
+
+static void PBJFrameProcessorTestFrameFill(PBJTestFrame *frame, uint8_t value)
+{
+    memset(frame->storage, value, frame->image.lumaBytesPerRow * frame->image.height + frame->image.chromaBytesPerRow * PBJNV12ChromaHeight(&frame->image));
+}
+
+static void PBJFrameProcessorTestExpectSame(const PBJNV12Image *image, const PBJNV12Image *reference)
+{
+    PBJTestCheck(image->width == reference->width && image->height == reference->height);
+    for (size_t row = 0; row < reference->height; row++)
+        PBJTestCheck(memcmp(image->luma + row * image->lumaBytesPerRow, reference->luma + row * reference->lumaBytesPerRow, reference->width) == 0);
+    for (size_t row = 0; row < PBJNV12ChromaHeight(reference); row++)
+        PBJTestCheck(memcmp(image->chroma + row * image->chromaBytesPerRow, reference->chroma + row * reference->chromaBytesPerRow, PBJNV12ChromaWidth(reference) * 2) == 0);
+}
+
+#pragma mark - test stages
+
+// mirrors chroma top to bottom, out of place since each tile reads rows from the far end of
+// the frame, and leaves luma to be carried over
+static void PBJFrameProcessorTestFlipChroma(void *context, const PBJNV12Image *source, PBJNV12Image *destination, PBJFrameTile tile)
+{
+    size_t chromaHeight = PBJNV12ChromaHeight(source);
+    for (size_t row = tile.rowBegin >> 1; row < ((tile.rowEnd + 1) >> 1); row++) {
+        memcpy(destination->chroma + row * destination->chromaBytesPerRow, source->chroma + (chromaHeight - 1 - row) * source->chromaBytesPerRow,
+               PBJNV12ChromaWidth(source) * 2);
+    }
+}
+
+typedef struct {
+    size_t tileRows;
+    _Atomic(int) tiles[512];
+    _Atomic(int) rows[1024];
+    size_t slowTiles; // tiles below this spin before they finish, so the runs come out uneven
+} PBJFrameProcessorTestLedger;
+
+// counts every tile and row it's handed and bumps the luma of the rows, in place
+static void PBJFrameProcessorTestRecordTile(void *context, const PBJNV12Image *source, PBJNV12Image *destination, PBJFrameTile tile)
+{
+    PBJFrameProcessorTestLedger *ledger = (PBJFrameProcessorTestLedger *)context;
+    PBJTestCheck(source == destination);
+    PBJTestCheck(tile.rowBegin == tile.index * ledger->tileRows && tile.rowBegin % 2 == 0);
+    PBJTestCheck(tile.rowEnd > tile.rowBegin && tile.rowEnd <= destination->height);
+    PBJTestCheck(tile.rowEnd - tile.rowBegin == ledger->tileRows || tile.rowEnd == destination->height);
+    atomic_fetch_add(&ledger->tiles[tile.index], 1);
+    for (size_t row = tile.rowBegin; row < tile.rowEnd; row++) {
+        atomic_fetch_add(&ledger->rows[row], 1);
+        destination->luma[row * destination->lumaBytesPerRow]++;
+    }
+    if (tile.index < ledger->slowTiles) {
+        uint64_t until = PBJTestNow() + 100000;
+        while (PBJTestNow() < until) {
+        }
+    }
+}
+
+// holds its pass until the deadline has passed, so the next pass is the first one checked late
+static void PBJFrameProcessorTestWaitForDeadline(void *context, const PBJNV12Image *source, PBJNV12Image *destination, PBJFrameTile tile)
+{
+    uint64_t deadline = *(const uint64_t *)context;
+    while (PBJInstrumentationNow() < deadline) {
+    }
+}
+
+#pragma mark - reference
+
+typedef struct {
+    PBJFrameOverlay overlay;
+    PBJFrameOverlay badge;
+    PBJFrameMask mask;
+    PBJFrameDenoise denoise;
+    uint8_t *maskStorage;
+} PBJFrameProcessorTestParameters;
+
+static PBJFrameProcessorTestParameters PBJFrameProcessorTestMakeParameters(size_t width, size_t height)
+{
+    PBJFrameProcessorTestParameters parameters;
+    // a bar through the middle that runs off the right edge, a corner badge, half transparent
+    parameters.overlay = (PBJFrameOverlay){ (width / 4) & ~(size_t)1, (height / 3) & ~(size_t)1, width, height / 3 + 1, 16, 200, 90, 160 };
+    parameters.badge = (PBJFrameOverlay){ 2, 2, width / 5 + 1, height / 5 + 1, 235, 90, 240, 255 };
+    parameters.maskStorage = (uint8_t *)malloc(width * height);
+    PBJTestCheck(parameters.maskStorage != NULL);
+    PBJTestRandom random = PBJTestRandomMake(width * 31 + height);
+    for (size_t i = 0; i < width * height; i++)
+        parameters.maskStorage[i] = (uint8_t)PBJTestRandomNext(&random);
+    parameters.mask = (PBJFrameMask){ parameters.maskStorage, width, 16, 128, 128 };
+    parameters.denoise = (PBJFrameDenoise){ 12 };
+    return parameters;
+}
+
+// each stage alone over the whole frame as one tile, out-of-place stages into a fresh frame
+// with the planes they don't declare copied across here rather than by the processor
+static PBJTestFrame PBJFrameProcessorTestReference(const PBJTestFrame *input, const PBJFrameStage *stages, size_t stageCount)
+{
+    PBJTestFrame current = PBJFrameProcessorTestFrameCopy(input);
+    PBJFrameTile whole = { 0, input->image.height, 0 };
+    for (size_t i = 0; i < stageCount; i++) {
+        if (stages[i].inPlace) {
+            stages[i].process(stages[i].context, &current.image, &current.image, whole);
+            continue;
+        }
+        PBJTestFrame next = PBJTestFrameCreate(input->image.width, input->image.height, input->image.range);
+        PBJFrameProcessorTestFrameFill(&next, PBJ_FRAME_PROCESSOR_TEST_FILL);
+        stages[i].process(stages[i].context, &current.image, &next.image, whole);
+        if (!(stages[i].planes & PBJFramePlaneLuma)) {
+            for (size_t row = 0; row < input->image.height; row++)
+                memcpy(next.image.luma + row * next.image.lumaBytesPerRow, current.image.luma + row * current.image.lumaBytesPerRow, input->image.width);
+        }
+        if (!(stages[i].planes & PBJFramePlaneChroma)) {
+            for (size_t row = 0; row < PBJNV12ChromaHeight(&input->image); row++)
+                memcpy(next.image.chroma + row * next.image.chromaBytesPerRow, current.image.chroma + row * current.image.chromaBytesPerRow,
+                       PBJNV12ChromaWidth(&input->image) * 2);
+        }
+        PBJTestFrameDestroy(&current);
+        current = next;
+    }
+    return current;
+}
+
+#pragma mark - chains
+
+typedef struct {
+    size_t width;
+    size_t height;
+    size_t tileRows;
+} PBJFrameProcessorTestSize;
+
+static void PBJFrameProcessorTestChains(void)
+{
+    // whole tiles, an odd height with a short last tile, a tile taller than the frame, one row
+    static const PBJFrameProcessorTestSize sizes[] = { { 64, 48, 16 }, { 97, 75, 8 }, { 322, 181, 64 }, { 30, 7, 16 }, { 18, 1, 2 } };
+
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        PBJTestFrame input = PBJTestFrameCreate(sizes[s].width, sizes[s].height, PBJYCbCrRangeVideo);
+        PBJTestFrameFillNoise(&input, 17 + s);
+        PBJFrameProcessorTestParameters parameters = PBJFrameProcessorTestMakeParameters(sizes[s].width, sizes[s].height);
+        PBJFrameStage overlay = PBJFrameStageMakeOverlay(&parameters.overlay);
+        PBJFrameStage mask = PBJFrameStageMakeMask(&parameters.mask);
+        PBJFrameStage badge = PBJFrameStageMakeOverlay(&parameters.badge);
+        PBJFrameStage denoise = PBJFrameStageMakeDenoise(&parameters.denoise);
+        PBJFrameStage flip = { PBJFrameProcessorTestFlipChroma, NULL, PBJFramePlaneChroma, 0 };
+
+        // in place and fused into one pass, one out-of-place stage that carries chroma into the
+        // spare, and two that carry luma then chroma and hand the frame back
+        const PBJFrameStage fused[] = { overlay, mask, badge };
+        const PBJFrameStage once[] = { overlay, mask, denoise, badge };
+        const PBJFrameStage twice[] = { denoise, flip, overlay, mask };
+        const PBJFrameStage *chains[] = { fused, once, twice };
+        const size_t chainLengths[] = { 3, 4, 4 };
+        const int outputInSpare[] = { 0, 1, 0 };
+
+        for (size_t c = 0; c < 3; c++) {
+            PBJTestFrame reference = PBJFrameProcessorTestReference(&input, chains[c], chainLengths[c]);
+            for (size_t t = 0; t < sizeof(PBJFrameProcessorTestThreadCounts) / sizeof(PBJFrameProcessorTestThreadCounts[0]); t++) {
+                PBJFrameProcessorConfiguration configuration = { PBJFrameProcessorTestThreadCounts[t], sizes[s].tileRows };
+                PBJFrameProcessor *processor = PBJFrameProcessorCreate(&configuration);
+                PBJTestCheck(processor != NULL);
+                for (size_t i = 0; i < chainLengths[c]; i++)
+                    PBJTestCheck(PBJFrameProcessorAddStage(processor, &chains[c][i]));
+                PBJTestCheck(PBJFrameProcessorNeedsSpare(processor) == (c > 0));
+
+                PBJTestFrame frame = PBJFrameProcessorTestFrameCopy(&input);
+                PBJTestFrame spare = PBJTestFrameCreate(sizes[s].width, sizes[s].height, PBJYCbCrRangeVideo);
+                PBJFrameProcessorTestFrameFill(&spare, PBJ_FRAME_PROCESSOR_TEST_FILL);
+                PBJFrameProcessorResult result = PBJFrameProcessorRun(processor, &frame.image, &spare.image, 0);
+                PBJTestCheck(result.stagesRun == chainLengths[c] && result.stagesSkipped == 0);
+                PBJTestCheck(result.outputInSpare == outputInSpare[c]);
+                PBJFrameProcessorTestExpectSame(result.outputInSpare ? &spare.image : &frame.image, &reference.image);
+
+                PBJFrameProcessorCounters counters = PBJFrameProcessorGetCounters(processor);
+                size_t tileCount = (sizes[s].height + sizes[s].tileRows - 1) / sizes[s].tileRows;
+                size_t passCount = c == 0 ? 1 : 2;
+                PBJTestCheck(counters.frames == 1 && counters.framesLate == 0);
+                PBJTestCheck(counters.tiles == tileCount * passCount);
+
+                PBJTestFrameDestroy(&spare);
+                PBJTestFrameDestroy(&frame);
+                PBJFrameProcessorDestroy(processor);
+            }
+            PBJTestFrameDestroy(&reference);
+        }
+        free(parameters.maskStorage);
+        PBJTestFrameDestroy(&input);
+    }
+}
+
+#pragma mark - tiles
+
+// every tile exactly once on every frame, stolen or not, over many frames and an uneven load
+static void PBJFrameProcessorTestTileCoverage(void)
+{
+    static const PBJFrameProcessorTestSize sizes[] = { { 64, 75, 8 }, { 16, 999, 2 } };
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        size_t tileCount = (sizes[s].height + sizes[s].tileRows - 1) / sizes[s].tileRows;
+        for (size_t t = 0; t < sizeof(PBJFrameProcessorTestThreadCounts) / sizeof(PBJFrameProcessorTestThreadCounts[0]); t++) {
+            PBJFrameProcessorTestLedger *ledger = (PBJFrameProcessorTestLedger *)calloc(1, sizeof(PBJFrameProcessorTestLedger));
+            PBJTestCheck(ledger != NULL && tileCount <= 512 && sizes[s].height <= 1024);
+            ledger->tileRows = sizes[s].tileRows;
+            // the calling thread's own run, the first of eight, is the slow one
+            ledger->slowTiles = tileCount / 8;
+
+            PBJFrameProcessorConfiguration configuration = { PBJFrameProcessorTestThreadCounts[t], sizes[s].tileRows };
+            PBJFrameProcessor *processor = PBJFrameProcessorCreate(&configuration);
+            PBJTestCheck(processor != NULL);
+            PBJFrameStage record = { PBJFrameProcessorTestRecordTile, ledger, PBJFramePlaneLuma, 1 };
+            PBJTestCheck(PBJFrameProcessorAddStage(processor, &record));
+
+            PBJTestFrame frame = PBJTestFrameCreate(sizes[s].width, sizes[s].height, PBJYCbCrRangeVideo);
+            int frames = 20;
+            for (int f = 0; f < frames; f++) {
+                PBJFrameProcessorResult result = PBJFrameProcessorRun(processor, &frame.image, NULL, 0);
+                PBJTestCheck(result.stagesRun == 1 && !result.outputInSpare);
+                for (size_t i = 0; i < tileCount; i++)
+                    PBJTestCheck(atomic_exchange(&ledger->tiles[i], 0) == 1);
+                for (size_t row = 0; row < sizes[s].height; row++)
+                    PBJTestCheck(atomic_exchange(&ledger->rows[row], 0) == 1);
+            }
+            for (size_t row = 0; row < sizes[s].height; row++)
+                PBJTestCheck(frame.image.luma[row * frame.image.lumaBytesPerRow] == frames);
+
+            PBJFrameProcessorCounters counters = PBJFrameProcessorGetCounters(processor);
+            PBJTestCheck(counters.frames == (uint64_t)frames && counters.tiles == tileCount * (uint64_t)frames);
+            // with workers, the slow run is taken from behind or the caller takes the others' runs
+            if (PBJFrameProcessorTestThreadCounts[t] == PBJFrameProcessorNoWorkers)
+                PBJTestCheck(counters.tilesStolen == 0);
+            else if (tileCount > 16)
+                PBJTestCheck(counters.tilesStolen > 0);
+
+            PBJTestFrameDestroy(&frame);
+            PBJFrameProcessorDestroy(processor);
+            free(ledger);
+        }
+    }
+}
+
+#pragma mark - deadline
+
+static void PBJFrameProcessorTestDeadline(void)
+{
+    PBJTestFrame input = PBJTestFrameCreate(97, 75, PBJYCbCrRangeVideo);
+    PBJTestFrameFillNoise(&input, 5);
+    PBJFrameProcessorTestParameters parameters = PBJFrameProcessorTestMakeParameters(97, 75);
+    uint64_t deadline = 0;
+    PBJFrameStage wait = { PBJFrameProcessorTestWaitForDeadline, &deadline, PBJFramePlaneLuma, 1 };
+    const PBJFrameStage stages[] = {
+        wait,
+        PBJFrameStageMakeOverlay(&parameters.overlay),
+        PBJFrameStageMakeDenoise(&parameters.denoise),
+        PBJFrameStageMakeOverlay(&parameters.badge),
+    };
+    // the first pass, waiting and overlay, is all that runs once the deadline is met within it
+    PBJTestFrame firstPass = PBJFrameProcessorTestReference(&input, stages, 2);
+    PBJTestFrame whole = PBJFrameProcessorTestReference(&input, stages, 4);
+
+    for (size_t t = 0; t < sizeof(PBJFrameProcessorTestThreadCounts) / sizeof(PBJFrameProcessorTestThreadCounts[0]); t++) {
+        PBJFrameProcessorConfiguration configuration = { PBJFrameProcessorTestThreadCounts[t], 8 };
+        PBJFrameProcessor *processor = PBJFrameProcessorCreate(&configuration);
+        PBJTestCheck(processor != NULL);
+        for (size_t i = 0; i < 4; i++)
+            PBJTestCheck(PBJFrameProcessorAddStage(processor, &stages[i]));
+        PBJTestFrame frame = PBJFrameProcessorTestFrameCopy(&input);
+        PBJTestFrame spare = PBJTestFrameCreate(97, 75, PBJYCbCrRangeVideo);
+
+        // already expired, nothing runs and the frame is left as it was
+        PBJFrameProcessorResult result = PBJFrameProcessorRun(processor, &frame.image, &spare.image, 1);
+        PBJTestCheck(result.stagesRun == 0 && result.stagesSkipped == 4 && !result.outputInSpare);
+        PBJFrameProcessorTestExpectSame(&frame.image, &input.image);
+        PBJFrameProcessorCounters counters = PBJFrameProcessorGetCounters(processor);
+        PBJTestCheck(counters.frames == 1 && counters.framesLate == 1 && counters.tiles == 0);
+
+        // met during the first pass, the out-of-place pass behind it is skipped whole
+        deadline = PBJInstrumentationNow() + 2000000;
+        result = PBJFrameProcessorRun(processor, &frame.image, &spare.image, deadline);
+        PBJTestCheck(result.stagesRun == 2 && result.stagesSkipped == 2 && !result.outputInSpare);
+        PBJFrameProcessorTestExpectSame(&frame.image, &firstPass.image);
+        counters = PBJFrameProcessorGetCounters(processor);
+        PBJTestCheck(counters.frames == 2 && counters.framesLate == 2);
+
+        // far enough off, every pass runs and the frame isn't late
+        PBJTestFrameDestroy(&frame);
+        frame = PBJFrameProcessorTestFrameCopy(&input);
+        deadline = 0;
+        result = PBJFrameProcessorRun(processor, &frame.image, &spare.image, PBJInstrumentationNow() + 60 * PBJ_TEST_NSEC_PER_SEC);
+        PBJTestCheck(result.stagesRun == 4 && result.stagesSkipped == 0 && result.outputInSpare);
+        PBJFrameProcessorTestExpectSame(&spare.image, &whole.image);
+        counters = PBJFrameProcessorGetCounters(processor);
+        PBJTestCheck(counters.frames == 3 && counters.framesLate == 2);
+
+        // a spare that doesn't match the frame skips everything rather than write past it
+        PBJTestFrame small = PBJTestFrameCreate(96, 74, PBJYCbCrRangeVideo);
+        result = PBJFrameProcessorRun(processor, &frame.image, &small.image, 0);
+        PBJTestCheck(result.stagesRun == 0 && result.stagesSkipped == 4);
+        result = PBJFrameProcessorRun(processor, &frame.image, NULL, 0);
+        PBJTestCheck(result.stagesRun == 0 && result.stagesSkipped == 4);
+
+        PBJTestFrameDestroy(&small);
+        PBJTestFrameDestroy(&spare);
+        PBJTestFrameDestroy(&frame);
+        PBJFrameProcessorDestroy(processor);
+    }
+    PBJTestFrameDestroy(&whole);
+    PBJTestFrameDestroy(&firstPass);
+    free(parameters.maskStorage);
+    PBJTestFrameDestroy(&input);
+}
+
+#pragma mark - configuration
+
+static void PBJFrameProcessorTestStages(void)
+{
+    PBJFrameProcessor *processor = PBJFrameProcessorCreate(NULL);
+    PBJTestCheck(processor != NULL);
+    PBJTestFrame frame = PBJTestFrameCreate(32, 32, PBJYCbCrRangeVideo);
+
+    // nothing to run
+    PBJFrameProcessorResult result = PBJFrameProcessorRun(processor, &frame.image, NULL, 0);
+    PBJTestCheck(result.stagesRun == 0 && result.stagesSkipped == 0);
+    PBJTestCheck(PBJFrameProcessorGetCounters(processor).frames == 0);
+
+    PBJFrameDenoise denoise = { 16 };
+    PBJFrameOverlay overlay = { 0, 0, 8, 8, 16, 128, 128, 255 };
+    PBJFrameStage incomplete = { NULL, NULL, PBJFramePlaneAll, 1 };
+    PBJTestCheck(!PBJFrameProcessorAddStage(processor, &incomplete));
+    PBJTestCheck(!PBJFrameProcessorAddStage(processor, NULL));
+    for (size_t i = 0; i < PBJFrameProcessorMaximumStages; i++) {
+        PBJFrameStage stage = PBJFrameStageMakeOverlay(&overlay);
+        PBJTestCheck(PBJFrameProcessorAddStage(processor, &stage));
+    }
+    PBJFrameStage stage = PBJFrameStageMakeDenoise(&denoise);
+    PBJTestCheck(!PBJFrameProcessorAddStage(processor, &stage));
+    PBJTestCheck(PBJFrameProcessorGetStageCount(processor) == PBJFrameProcessorMaximumStages);
+    PBJTestCheck(!PBJFrameProcessorNeedsSpare(processor));
+
+    PBJFrameProcessorRemoveAllStages(processor);
+    PBJTestCheck(PBJFrameProcessorGetStageCount(processor) == 0);
+    PBJTestCheck(PBJFrameProcessorAddStage(processor, &stage) && PBJFrameProcessorNeedsSpare(processor));
+
+    PBJTestFrameDestroy(&frame);
+    PBJFrameProcessorDestroy(processor);
+}
+
+int main(void)
+{
+    PBJFrameProcessorTestStages();
+    PBJFrameProcessorTestChains();
+    PBJFrameProcessorTestTileCoverage();
+    PBJFrameProcessorTestDeadline();
+    return 0;
+}
@@ -0,0 +1,190 @@
+//
+//  PBJInstrumentationTests.c
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#include "PBJInstrumentation.h"
+#include "PBJTestSupport.h"
+
+#include <pthread.h>
+
+// histogram percentiles against exact ones over several distributions, concurrent recording
+// from many threads, and the NULL instrumentation every call site relies on when it's off
+
+static void PBJInstrumentationTestPercentiles(void)
+{
+    enum { PBJInstrumentationTestCount = 100000 };
+    static uint64_t values[PBJInstrumentationTestCount];
+    PBJTestRandom random = PBJTestRandomMake(42);
+
+    for (int distribution = 0; distribution < 4; distribution++) {
+        PBJLatencyHistogram *histogram = PBJLatencyHistogramCreate();
+        PBJTestCheck(histogram != NULL);
+        uint64_t sum = 0;
+        for (int i = 0; i < PBJInstrumentationTestCount; i++) {
+            uint64_t value;
+            switch (distribution) {
+                case 0: value = PBJTestRandomBelow(&random, 16); break; // exact buckets
+                case 1: value = 1000000 + PBJTestRandomBelow(&random, 1000000); break; // a frame's worth of ns
+                case 2: value = 1ull << PBJTestRandomBelow(&random, 40); break; // spread over decades
+                default: value = PBJTestRandomBelow(&random, 100) == 0 ? 50000000 + PBJTestRandomBelow(&random, 1000) : 20000; break; // long tail
+            }
+            values[i] = value;
+            sum += value;
+            PBJLatencyHistogramRecord(histogram, value);
+        }
+
+        PBJLatencySummary summary = PBJLatencyHistogramSummarize(histogram);
+        PBJTestCheck(summary.count == PBJInstrumentationTestCount);
+        PBJTestCheck(summary.mean == sum / PBJInstrumentationTestCount);
+
+        static const double percentiles[] = { 50.0, 90.0, 99.0, 99.9 };
+        uint64_t reported[4] = { summary.p50, 0, summary.p99, summary.p999 };
+        reported[1] = PBJLatencyHistogramValueAtPercentile(histogram, 90.0);
+        for (int p = 0; p < 4; p++) {
+            uint64_t exact = PBJTestPercentile(values, PBJInstrumentationTestCount, percentiles[p]);
+            // upper bound of the bucket, never below the exact value and within one 1/16 step of it
+            PBJTestCheck(reported[p] + 1 >= exact);
+            PBJTestCheck(reported[p] <= exact + exact / 16 + 1);
+            PBJTestCheck(PBJLatencyHistogramValueAtPercentile(histogram, percentiles[p]) == reported[p]);
+        }
+        PBJTestCheck(summary.max == values[PBJInstrumentationTestCount - 1]);
+        PBJTestCheck(summary.p50 <= summary.p99 && summary.p99 <= summary.p999 && summary.p999 <= summary.max);
+
+        PBJLatencyHistogramReset(histogram);
+        summary = PBJLatencyHistogramSummarize(histogram);
+        PBJTestCheck(summary.count == 0 && summary.max == 0 && summary.p99 == 0);
+        PBJLatencyHistogramDestroy(histogram);
+    }
+
+    // the extremes of the range land in a bucket too
+    PBJLatencyHistogram *histogram = PBJLatencyHistogramCreate();
+    PBJLatencyHistogramRecord(histogram, 0);
+    PBJLatencyHistogramRecord(histogram, UINT64_MAX);
+    PBJTestCheck(PBJLatencyHistogramSummarize(histogram).max == UINT64_MAX);
+    PBJTestCheck(PBJLatencyHistogramValueAtPercentile(histogram, 0.0) == 0);
+    PBJTestCheck(PBJLatencyHistogramValueAtPercentile(histogram, 100.0) == UINT64_MAX);
+    PBJLatencyHistogramDestroy(histogram);
+}
+
+#define PBJ_INSTRUMENTATION_TEST_THREADS 8
+#define PBJ_INSTRUMENTATION_TEST_RECORDS 50000
+
+typedef struct {
+    PBJInstrumentation *instrumentation;
+    uint64_t base;
+} PBJInstrumentationTestThread;
+
+static void *PBJInstrumentationTestRecorder(void *context)
+{
+    PBJInstrumentationTestThread *thread = (PBJInstrumentationTestThread *)context;
+    for (uint64_t i = 0; i < PBJ_INSTRUMENTATION_TEST_RECORDS; i++) {
+        PBJInstrumentationRecordLatency(thread->instrumentation, PBJInstrumentationStageAppend, thread->base + i);
+        PBJInstrumentationIncrementCounter(thread->instrumentation, PBJInstrumentationCounterFramesReceived);
+        PBJInstrumentationAddToCounter(thread->instrumentation, PBJInstrumentationCounterDelegateBacklog, (i & 1) ? -1 : 1);
+    }
+    return NULL;
+}
+
+static void PBJInstrumentationTestConcurrentRecording(void)
+{
+    PBJInstrumentation *instrumentation = PBJInstrumentationCreate();
+    PBJTestCheck(instrumentation != NULL);
+
+    pthread_t threads[PBJ_INSTRUMENTATION_TEST_THREADS];
+    PBJInstrumentationTestThread contexts[PBJ_INSTRUMENTATION_TEST_THREADS];
+    for (int i = 0; i < PBJ_INSTRUMENTATION_TEST_THREADS; i++) {
+        contexts[i].instrumentation = instrumentation;
+        contexts[i].base = (uint64_t)i * 1000000;
+        PBJTestCheck(pthread_create(&threads[i], NULL, PBJInstrumentationTestRecorder, &contexts[i]) == 0);
+    }
+    for (int i = 0; i < PBJ_INSTRUMENTATION_TEST_THREADS; i++)
+        pthread_join(threads[i], NULL);
+
+    // nothing lost to a race, the max is the largest value any thread recorded
+    PBJInstrumentationSnapshot snapshot = PBJInstrumentationGetSnapshot(instrumentation);
+    uint64_t total = (uint64_t)PBJ_INSTRUMENTATION_TEST_THREADS * PBJ_INSTRUMENTATION_TEST_RECORDS;
+    PBJTestCheck(snapshot.stages[PBJInstrumentationStageAppend].count == total);
+    PBJTestCheck(snapshot.stages[PBJInstrumentationStageAppend].max == (PBJ_INSTRUMENTATION_TEST_THREADS - 1) * 1000000ull + PBJ_INSTRUMENTATION_TEST_RECORDS - 1);
+    PBJTestCheck(snapshot.stages[PBJInstrumentationStageRendering].count == 0);
+    PBJTestCheck(snapshot.counters[PBJInstrumentationCounterFramesReceived] == (int64_t)total);
+    PBJTestCheck(snapshot.counters[PBJInstrumentationCounterDelegateBacklog] == 0);
+
+    PBJInstrumentationReset(instrumentation);
+    snapshot = PBJInstrumentationGetSnapshot(instrumentation);
+    PBJTestCheck(snapshot.stages[PBJInstrumentationStageAppend].count == 0);
+    PBJTestCheck(snapshot.counters[PBJInstrumentationCounterFramesReceived] == 0);
+    PBJInstrumentationDestroy(instrumentation);
+}
+
+static void PBJInstrumentationTestDisabled(void)
+{
+    PBJInstrumentationRecordLatency(NULL, PBJInstrumentationStageAppend, 10);
+    PBJInstrumentationIncrementCounter(NULL, PBJInstrumentationCounterFramesWritten);
+    PBJInstrumentationRecordSince(NULL, PBJInstrumentationStageRendering, PBJInstrumentationNow());
+    PBJLatencyHistogramRecord(NULL, 1);
+    PBJLatencyHistogramReset(NULL);
+    PBJInstrumentationReset(NULL);
+    PBJTestCheck(PBJLatencyHistogramSummarize(NULL).count == 0);
+    PBJTestCheck(PBJLatencyHistogramValueAtPercentile(NULL, 99.0) == 0);
+    PBJInstrumentationSnapshot snapshot = PBJInstrumentationGetSnapshot(NULL);
+    PBJTestCheck(snapshot.stages[0].count == 0 && snapshot.counters[0] == 0);
+
+    // out of range stages and counters are ignored rather than written past the arrays
+    PBJInstrumentation *instrumentation = PBJInstrumentationCreate();
+    PBJInstrumentationRecordLatency(instrumentation, PBJInstrumentationStageCount, 10);
+    PBJInstrumentationAddToCounter(instrumentation, PBJInstrumentationCounterCount, 1);
+    snapshot = PBJInstrumentationGetSnapshot(instrumentation);
+    for (int i = 0; i < PBJInstrumentationStageCount; i++)
+        PBJTestCheck(snapshot.stages[i].count == 0);
+    PBJInstrumentationDestroy(instrumentation);
+}
+
+static void PBJInstrumentationTestClock(void)
+{
+    uint64_t previous = PBJInstrumentationNow();
+    for (int i = 0; i < 100000; i++) {
+        uint64_t now = PBJInstrumentationNow();
+        PBJTestCheck(now >= previous);
+        previous = now;
+    }
+
+    PBJInstrumentation *instrumentation = PBJInstrumentationCreate();
+    uint64_t start = PBJInstrumentationNow();
+    struct timespec sleep = { 0, 2000000 };
+    nanosleep(&sleep, NULL);
+    PBJInstrumentationRecordSince(instrumentation, PBJInstrumentationStageRendering, start);
+    PBJInstrumentationSnapshot snapshot = PBJInstrumentationGetSnapshot(instrumentation);
+    PBJTestCheck(snapshot.stages[PBJInstrumentationStageRendering].count == 1);
+    PBJTestCheck(snapshot.stages[PBJInstrumentationStageRendering].max >= 2000000);
+    PBJInstrumentationDestroy(instrumentation);
+}
+
+int main(void)
+{
+    PBJInstrumentationTestPercentiles();
+    PBJInstrumentationTestConcurrentRecording();
+    PBJInstrumentationTestDisabled();
+    PBJInstrumentationTestClock();
+    return 0;
+}
@@ -0,0 +1,390 @@
+//
+//  PBJJPEGEncoderTests.c
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#include "PBJJPEGEncoder.h"
+#include "PBJTestSupport.h"
+
+#include <jpeglib.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+// files decoded by libjpeg as the reference decoder, without a warning, and compared in RGB
+// against what the NV12 planes themselves say through the BT.709 matrix. the PSNR has to stay
+// within reach of libjpeg encoding that same RGB at the same quality, rise with quality, and be
+// the same whatever the restart interval, vector path or order the segments were encoded in
+
+#pragma mark - scenes
+
+static uint8_t PBJJPEGEncoderTestClamp(double value)
+{
+    return value < 0.0 ? 0 : value > 255.0 ? 255 : (uint8_t)lround(value);
+}
+
+// gradients, a disc, a hard edged pattern and optionally noise, in RGB
+static uint8_t *PBJJPEGEncoderTestCreateScene(size_t width, size_t height, int noisy, uint64_t seed)
+{
+    uint8_t *rgb = (uint8_t *)malloc(width * height * 3);
+    PBJTestCheck(rgb != NULL);
+    PBJTestRandom random = PBJTestRandomMake(seed);
+    for (size_t y = 0; y < height; y++) {
+        for (size_t x = 0; x < width; x++) {
+            double fx = (double)x / (double)width;
+            double fy = (double)y / (double)height;
+            double r = 255.0 * fx;
+            double g = 255.0 * fy;
+            double b = 128.0 + 100.0 * sin(fx * 12.0) * cos(fy * 9.0);
+            double dx = fx - 0.5;
+            double dy = fy - 0.5;
+            if (dx * dx + dy * dy < 0.04) {
+                r = 220.0;
+                g = 40.0;
+                b = 60.0;
+            }
+            if (((x / 37) + (y / 29)) % 7 == 0) {
+                r *= 0.5;
+                g = 255.0 - g * 0.5;
+            }
+            if (noisy) {
+                r += (double)PBJTestRandomBetween(&random, -10, 10);
+                g += (double)PBJTestRandomBetween(&random, -10, 10);
+                b += (double)PBJTestRandomBetween(&random, -10, 10);
+            }
+            uint8_t *pixel = rgb + (y * width + x) * 3;
+            pixel[0] = PBJJPEGEncoderTestClamp(r);
+            pixel[1] = PBJJPEGEncoderTestClamp(g);
+            pixel[2] = PBJJPEGEncoderTestClamp(b);
+        }
+    }
+    return rgb;
+}
+
+// BT.709 planes as capture delivers them, chroma averaged over each 2x2 block
+static PBJTestFrame PBJJPEGEncoderTestCreateFrame(const uint8_t *rgb, size_t width, size_t height, PBJYCbCrRange range)
+{
+    PBJTestFrame frame = PBJTestFrameCreate(width, height, range);
+    int video = range == PBJYCbCrRangeVideo;
+    for (size_t y = 0; y < height; y++) {
+        for (size_t x = 0; x < width; x++) {
+            const uint8_t *pixel = rgb + (y * width + x) * 3;
+            double luma = 0.2126 * pixel[0] + 0.7152 * pixel[1] + 0.0722 * pixel[2];
+            frame.image.luma[y * frame.image.lumaBytesPerRow + x] = PBJJPEGEncoderTestClamp(video ? 16.0 + luma * 219.0 / 255.0 : luma);
+        }
+    }
+    double scale = video ? 224.0 / 255.0 : 1.0;
+    for (size_t y = 0; y < PBJNV12ChromaHeight(&frame.image); y++) {
+        for (size_t x = 0; x < PBJNV12ChromaWidth(&frame.image); x++) {
+            double cb = 0.0;
+            double cr = 0.0;
+            int count = 0;
+            for (size_t j = 0; j < 2; j++) {
+                for (size_t i = 0; i < 2; i++) {
+                    if (2 * x + i >= width || 2 * y + j >= height)
+                        continue;
+                    const uint8_t *pixel = rgb + ((2 * y + j) * width + 2 * x + i) * 3;
+                    double luma = 0.2126 * pixel[0] + 0.7152 * pixel[1] + 0.0722 * pixel[2];
+                    cb += (pixel[2] - luma) / 1.8556;
+                    cr += (pixel[0] - luma) / 1.5748;
+                    count++;
+                }
+            }
+            frame.image.chroma[y * frame.image.chromaBytesPerRow + 2 * x] = PBJJPEGEncoderTestClamp(128.0 + cb / count * scale);
+            frame.image.chroma[y * frame.image.chromaBytesPerRow + 2 * x + 1] = PBJJPEGEncoderTestClamp(128.0 + cr / count * scale);
+        }
+    }
+    return frame;
+}
+
+// what the planes say, through the BT.709 matrix with each chroma sample covering its 2x2 block
+static uint8_t *PBJJPEGEncoderTestCreateTruth(const PBJNV12Image *image)
+{
+    uint8_t *rgb = (uint8_t *)malloc(image->width * image->height * 3);
+    PBJTestCheck(rgb != NULL);
+    int video = image->range == PBJYCbCrRangeVideo;
+    for (size_t y = 0; y < image->height; y++) {
+        for (size_t x = 0; x < image->width; x++) {
+            double luma = image->luma[y * image->lumaBytesPerRow + x];
+            const uint8_t *cbcr = image->chroma + (y / 2) * image->chromaBytesPerRow + (x / 2) * 2;
+            double cb = cbcr[0] - 128.0;
+            double cr = cbcr[1] - 128.0;
+            if (video) {
+                luma = (luma - 16.0) * 255.0 / 219.0;
+                cb *= 255.0 / 224.0;
+                cr *= 255.0 / 224.0;
+            }
+            uint8_t *pixel = rgb + (y * image->width + x) * 3;
+            pixel[0] = PBJJPEGEncoderTestClamp(luma + 1.5748 * cr);
+            pixel[1] = PBJJPEGEncoderTestClamp(luma - 0.18732 * cb - 0.46812 * cr);
+            pixel[2] = PBJJPEGEncoderTestClamp(luma + 1.8556 * cb);
+        }
+    }
+    return rgb;
+}
+
+#pragma mark - libjpeg
+
+static int PBJJPEGEncoderTestWarnings;
+
+static void PBJJPEGEncoderTestEmitMessage(j_common_ptr info, int level)
+{
+    if (level < 0)
+        PBJJPEGEncoderTestWarnings++;
+}
+
+// decodes to RGB, any corrupt data warning fails the check
+static uint8_t *PBJJPEGEncoderTestDecode(const uint8_t *data, size_t size, size_t width, size_t height)
+{
+    struct jpeg_decompress_struct decompress;
+    struct jpeg_error_mgr error;
+    decompress.err = jpeg_std_error(&error);
+    error.emit_message = PBJJPEGEncoderTestEmitMessage;
+    PBJJPEGEncoderTestWarnings = 0;
+    jpeg_create_decompress(&decompress);
+    jpeg_mem_src(&decompress, (unsigned char *)data, (unsigned long)size);
+    PBJTestCheck(jpeg_read_header(&decompress, TRUE) == JPEG_HEADER_OK);
+    decompress.out_color_space = JCS_RGB;
+    jpeg_start_decompress(&decompress);
+    PBJTestCheck(decompress.output_width == width && decompress.output_height == height);
+    PBJTestCheck(decompress.output_components == 3);
+    uint8_t *rgb = (uint8_t *)malloc(width * height * 3);
+    PBJTestCheck(rgb != NULL);
+    while (decompress.output_scanline < decompress.output_height) {
+        JSAMPROW row = rgb + (size_t)decompress.output_scanline * width * 3;
+        jpeg_read_scanlines(&decompress, &row, 1);
+    }
+    jpeg_finish_decompress(&decompress);
+    jpeg_destroy_decompress(&decompress);
+    PBJTestCheck(PBJJPEGEncoderTestWarnings == 0);
+    return rgb;
+}
+
+static double PBJJPEGEncoderTestPSNR(const uint8_t *a, const uint8_t *b, size_t count)
+{
+    double squaredError = 0.0;
+    for (size_t i = 0; i < count; i++) {
+        double difference = (double)a[i] - (double)b[i];
+        squaredError += difference * difference;
+    }
+    return squaredError == 0.0 ? 99.0 : 10.0 * log10(255.0 * 255.0 / (squaredError / (double)count));
+}
+
+// libjpeg's own encode of the truth at the same quality, the bar to measure against
+static double PBJJPEGEncoderTestReferencePSNR(const uint8_t *truth, size_t width, size_t height, int quality)
+{
+    struct jpeg_compress_struct compress;
+    struct jpeg_error_mgr error;
+    compress.err = jpeg_std_error(&error);
+    jpeg_create_compress(&compress);
+    unsigned char *data = NULL;
+    unsigned long size = 0;
+    jpeg_mem_dest(&compress, &data, &size);
+    compress.image_width = (JDIMENSION)width;
+    compress.image_height = (JDIMENSION)height;
+    compress.input_components = 3;
+    compress.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&compress);
+    jpeg_set_quality(&compress, quality, TRUE);
+    compress.dct_method = JDCT_FLOAT;
+    jpeg_start_compress(&compress, TRUE);
+    while (compress.next_scanline < compress.image_height) {
+        JSAMPROW row = (JSAMPROW)truth + (size_t)compress.next_scanline * width * 3;
+        jpeg_write_scanlines(&compress, &row, 1);
+    }
+    jpeg_finish_compress(&compress);
+    jpeg_destroy_compress(&compress);
+
+    uint8_t *decoded = PBJJPEGEncoderTestDecode(data, size, width, height);
+    double psnr = PBJJPEGEncoderTestPSNR(decoded, truth, width * height * 3);
+    free(decoded);
+    free(data);
+    return psnr;
+}
+
+static uint8_t *PBJJPEGEncoderTestEncodeAndDecode(const PBJNV12Image *image, PBJJPEGOptions options, size_t *size)
+{
+    uint8_t *data = PBJJPEGEncode(image, options, size);
+    PBJTestCheck(data != NULL && *size > 0);
+    PBJTestCheck(data[0] == 0xff && data[1] == 0xd8 && data[*size - 2] == 0xff && data[*size - 1] == 0xd9);
+    uint8_t *decoded = PBJJPEGEncoderTestDecode(data, *size, image->width, image->height);
+    free(data);
+    return decoded;
+}
+
+#pragma mark - tests
+
+static const int PBJJPEGEncoderTestQualities[] = { 10, 50, 75, 90, 95, 100 };
+
+static void PBJJPEGEncoderTestQuality(size_t width, size_t height, PBJYCbCrRange range, int noisy)
+{
+    uint8_t *scene = PBJJPEGEncoderTestCreateScene(width, height, noisy, width * 7 + height);
+    PBJTestFrame frame = PBJJPEGEncoderTestCreateFrame(scene, width, height, range);
+    uint8_t *truth = PBJJPEGEncoderTestCreateTruth(&frame.image);
+    size_t count = width * height * 3;
+    // below a couple of blocks a single coefficient swings the ratio, the floor alone has to hold
+    int small = width * height < 256;
+
+    double previous = 0.0;
+    size_t previousSize = 0;
+    for (size_t q = 0; q < sizeof(PBJJPEGEncoderTestQualities) / sizeof(PBJJPEGEncoderTestQualities[0]); q++) {
+        int quality = PBJJPEGEncoderTestQualities[q];
+        PBJJPEGOptions options = { quality, 0, PBJSIMDLevelAuto };
+        size_t size = 0;
+        uint8_t *decoded = PBJJPEGEncoderTestEncodeAndDecode(&frame.image, options, &size);
+        double psnr = PBJJPEGEncoderTestPSNR(decoded, truth, count);
+        double reference = PBJJPEGEncoderTestReferencePSNR(truth, width, height, quality);
+
+        if (small) {
+            PBJTestCheck(psnr >= 45.0 || psnr >= reference - 3.5);
+        } else {
+            PBJTestCheck(psnr >= reference - 1.0);
+            PBJTestCheck(psnr + 0.05 >= previous);
+            PBJTestCheck(size >= previousSize);
+        }
+        if (width >= 64 && quality >= 90)
+            PBJTestCheck(psnr >= (noisy ? 32.0 : 34.0));
+        previous = psnr;
+        previousSize = size;
+
+        // the scalar path quantizes the same coefficients, give or take a rounding
+        PBJJPEGOptions scalarOptions = { quality, 0, PBJSIMDLevelScalar };
+        size_t scalarSize = 0;
+        uint8_t *scalar = PBJJPEGEncoderTestEncodeAndDecode(&frame.image, scalarOptions, &scalarSize);
+        PBJTestCheck(fabs(PBJJPEGEncoderTestPSNR(scalar, truth, count) - psnr) <= 0.02);
+        PBJTestCheck((scalarSize > size ? scalarSize - size : size - scalarSize) <= size / 200 + 4);
+        free(scalar);
+
+        // restart intervals only split the entropy coding, the pixels come out the same
+        for (size_t restartRows = 1; restartRows <= 3; restartRows++) {
+            PBJJPEGOptions restartOptions = { quality, restartRows, PBJSIMDLevelAuto };
+            size_t restartSize = 0;
+            uint8_t *restarted = PBJJPEGEncoderTestEncodeAndDecode(&frame.image, restartOptions, &restartSize);
+            PBJTestCheck(memcmp(restarted, decoded, count) == 0);
+            free(restarted);
+        }
+        free(decoded);
+    }
+
+    free(truth);
+    PBJTestFrameDestroy(&frame);
+    free(scene);
+}
+
+static void PBJJPEGEncoderTestConformance(void)
+{
+    // a single block, partial MCUs on either axis and odd chroma, and a capture size
+    static const size_t sizes[][2] = { { 1, 1 }, { 16, 16 }, { 17, 9 }, { 33, 47 }, { 640, 480 }, { 641, 363 } };
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        for (int range = PBJYCbCrRangeFull; range <= PBJYCbCrRangeVideo; range++) {
+            PBJJPEGEncoderTestQuality(sizes[i][0], sizes[i][1], (PBJYCbCrRange)range, 0);
+            PBJJPEGEncoderTestQuality(sizes[i][0], sizes[i][1], (PBJYCbCrRange)range, 1);
+        }
+    }
+}
+
+// a full frame at the quality photos are taken at
+static void PBJJPEGEncoderTestFullFrame(void)
+{
+    uint8_t *scene = PBJJPEGEncoderTestCreateScene(1920, 1080, 1, 3);
+    PBJTestFrame frame = PBJJPEGEncoderTestCreateFrame(scene, 1920, 1080, PBJYCbCrRangeVideo);
+    uint8_t *truth = PBJJPEGEncoderTestCreateTruth(&frame.image);
+    PBJJPEGOptions options = { 90, 0, PBJSIMDLevelAuto };
+    size_t size = 0;
+    uint8_t *decoded = PBJJPEGEncoderTestEncodeAndDecode(&frame.image, options, &size);
+    double psnr = PBJJPEGEncoderTestPSNR(decoded, truth, 1920 * 1080 * 3);
+    PBJTestCheck(psnr >= 32.0);
+    PBJTestCheck(psnr >= PBJJPEGEncoderTestReferencePSNR(truth, 1920, 1080, 90) - 1.0);
+    free(decoded);
+    free(truth);
+    PBJTestFrameDestroy(&frame);
+    free(scene);
+}
+
+typedef struct {
+    PBJJPEGEncoder *encoder;
+    _Atomic(size_t) next;
+    size_t count;
+} PBJJPEGEncoderTestWork;
+
+static void *PBJJPEGEncoderTestWorker(void *context)
+{
+    PBJJPEGEncoderTestWork *work = (PBJJPEGEncoderTestWork *)context;
+    for (size_t segment = atomic_fetch_add(&work->next, 1); segment < work->count; segment = atomic_fetch_add(&work->next, 1))
+        PBJTestCheck(PBJJPEGEncoderEncodeSegment(work->encoder, segment));
+    return NULL;
+}
+
+// segments encoded from several threads, or backwards, assemble into the file a single pass writes
+static void PBJJPEGEncoderTestSegments(void)
+{
+    PBJTestFrame frame = PBJTestFrameCreate(1282, 722, PBJYCbCrRangeFull);
+    PBJTestFrameFillScene(&frame);
+    PBJJPEGOptions options = { 85, 2, PBJSIMDLevelAuto };
+    size_t expectedSize = 0;
+    uint8_t *expected = PBJJPEGEncode(&frame.image, options, &expectedSize);
+    PBJTestCheck(expected != NULL);
+
+    PBJJPEGEncoder *encoder = PBJJPEGEncoderCreate(&frame.image, options);
+    PBJTestCheck(encoder != NULL);
+    size_t count = PBJJPEGEncoderGetSegmentCount(encoder);
+    PBJTestCheck(count == ((722 + 15) / 16 + 1) / 2);
+    for (size_t segment = count; segment-- > 1;)
+        PBJTestCheck(PBJJPEGEncoderEncodeSegment(encoder, segment));
+    // nothing to copy while a segment is missing
+    uint8_t *bytes = (uint8_t *)malloc(expectedSize);
+    PBJTestCheck(bytes != NULL);
+    PBJTestCheck(PBJJPEGEncoderGetSize(encoder) == 0);
+    PBJTestCheck(PBJJPEGEncoderCopyBytes(encoder, bytes, expectedSize) == 0);
+    PBJTestCheck(PBJJPEGEncoderEncodeSegment(encoder, 0));
+    PBJTestCheck(PBJJPEGEncoderGetSize(encoder) == expectedSize);
+    PBJTestCheck(PBJJPEGEncoderCopyBytes(encoder, bytes, expectedSize - 1) == 0);
+    PBJTestCheck(PBJJPEGEncoderCopyBytes(encoder, bytes, expectedSize) == expectedSize);
+    PBJTestCheck(memcmp(bytes, expected, expectedSize) == 0);
+    PBJJPEGEncoderDestroy(encoder);
+
+    encoder = PBJJPEGEncoderCreate(&frame.image, options);
+    PBJTestCheck(encoder != NULL);
+    PBJJPEGEncoderTestWork work = { encoder, 0, count };
+    pthread_t threads[4];
+    for (size_t i = 0; i < 4; i++)
+        PBJTestCheck(pthread_create(&threads[i], NULL, PBJJPEGEncoderTestWorker, &work) == 0);
+    for (size_t i = 0; i < 4; i++)
+        pthread_join(threads[i], NULL);
+    memset(bytes, 0, expectedSize);
+    PBJTestCheck(PBJJPEGEncoderCopyBytes(encoder, bytes, expectedSize) == expectedSize);
+    PBJTestCheck(memcmp(bytes, expected, expectedSize) == 0);
+    PBJJPEGEncoderDestroy(encoder);
+
+    free(bytes);
+    free(expected);
+    PBJTestFrameDestroy(&frame);
+}
+
+int main(void)
+{
+    PBJJPEGEncoderTestConformance();
+    PBJJPEGEncoderTestFullFrame();
+    PBJJPEGEncoderTestSegments();
+    return 0;
+}
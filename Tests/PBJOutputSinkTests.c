@@ -0,0 +1,266 @@
+//
+//  PBJOutputSinkTests.c
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#include "PBJOutputSink.h"
+#include "PBJTestSupport.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// the memory sink against a plain copy of everything written, then the file sink against the
+// memory sink for every batch size, batch count and durability policy, and failures that have
+// to reach the producer instead of hanging it
+
+static uint8_t *PBJOutputSinkTestReadFile(const char *path, size_t *length)
+{
+    int descriptor = open(path, O_RDONLY);
+    PBJTestCheck(descriptor >= 0);
+    struct stat status;
+    PBJTestCheck(fstat(descriptor, &status) == 0);
+    uint8_t *bytes = (uint8_t *)malloc((size_t)status.st_size + 1);
+    PBJTestCheck(bytes != NULL);
+    size_t count = 0;
+    while (count < (size_t)status.st_size) {
+        ssize_t result = read(descriptor, bytes + count, (size_t)status.st_size - count);
+        PBJTestCheck(result > 0);
+        count += (size_t)result;
+    }
+    close(descriptor);
+    *length = count;
+    return bytes;
+}
+
+// mostly small writes like sample headers and audio, every fifth up to a megabyte like a keyframe
+static size_t PBJOutputSinkTestFillChunk(PBJTestRandom *random, uint8_t *chunk)
+{
+    size_t length = PBJTestRandomBelow(random, 5) == 0 ? (size_t)PBJTestRandomBelow(random, 1 << 20) : (size_t)PBJTestRandomBelow(random, 3000);
+    for (size_t i = 0; i < length; i++)
+        chunk[i] = (uint8_t)PBJTestRandomNext(random);
+    return length;
+}
+
+#pragma mark - memory
+
+static void PBJOutputSinkTestMemory(void)
+{
+    PBJOutputSink *sink = PBJOutputSinkCreateMemory();
+    PBJTestCheck(sink != NULL);
+    size_t length = 1;
+    PBJOutputSinkGetMemoryBytes(sink, &length);
+    PBJTestCheck(length == 0);
+
+    uint8_t *chunk = (uint8_t *)malloc(1 << 20);
+    uint8_t *expected = (uint8_t *)malloc(64 << 20);
+    PBJTestCheck(chunk != NULL && expected != NULL);
+    PBJTestRandom random = PBJTestRandomMake(17);
+    size_t total = 0;
+    for (int i = 0; i < 200; i++) {
+        size_t count = PBJOutputSinkTestFillChunk(&random, chunk);
+        if (total + count > (64 << 20))
+            break;
+        // the muxer's write function is the same write
+        PBJTestCheck(i % 2 ? PBJOutputSinkWrite(sink, chunk, count) : PBJOutputSinkWriteFunction(sink, chunk, count));
+        memcpy(expected + total, chunk, count);
+        total += count;
+        if (i % 13 == 0)
+            PBJTestCheck(PBJOutputSinkEndFragment(sink));
+
+        // valid until the next write, however often the buffer has grown
+        const uint8_t *bytes = PBJOutputSinkGetMemoryBytes(sink, &length);
+        PBJTestCheck(length == total);
+        PBJTestCheck(total == 0 || memcmp(bytes, expected, total) == 0);
+    }
+    PBJTestCheck(PBJOutputSinkWrite(sink, chunk, 0));
+    PBJTestCheck(PBJOutputSinkWrite(sink, NULL, 0));
+
+    PBJOutputSinkStatistics statistics;
+    PBJOutputSinkGetStatistics(sink, &statistics);
+    PBJTestCheck(statistics.bytesWritten == total && statistics.bytesStored == total);
+    PBJTestCheck(statistics.writeCalls == 0 && statistics.syncCalls == 0 && statistics.preallocatedBytes == 0);
+    PBJTestCheck(statistics.producerWaits == 0);
+
+    // finished, the bytes stay readable and nothing more is taken
+    PBJTestCheck(PBJOutputSinkFinish(sink));
+    PBJTestCheck(!PBJOutputSinkHasFailed(sink));
+    PBJTestCheck(PBJOutputSinkWrite(sink, chunk, 1) == 0);
+    PBJTestCheck(PBJOutputSinkEndFragment(sink) == 0);
+    PBJTestCheck(PBJOutputSinkFinish(sink) == 0);
+    const uint8_t *bytes = PBJOutputSinkGetMemoryBytes(sink, &length);
+    PBJTestCheck(length == total && memcmp(bytes, expected, total) == 0);
+    PBJOutputSinkGetMemoryBytes(sink, NULL);
+    PBJOutputSinkDestroy(sink);
+
+    // an empty recording finishes as an empty buffer
+    sink = PBJOutputSinkCreateMemory();
+    PBJTestCheck(sink != NULL && PBJOutputSinkFinish(sink));
+    PBJOutputSinkGetMemoryBytes(sink, &length);
+    PBJTestCheck(length == 0);
+    PBJOutputSinkDestroy(sink);
+
+    // only memory sinks have bytes to hand out
+    length = 1;
+    PBJTestCheck(PBJOutputSinkGetMemoryBytes(NULL, &length) == NULL && length == 0);
+    PBJTestCheck(PBJOutputSinkWrite(NULL, chunk, 1) == 0);
+    PBJTestCheck(PBJOutputSinkHasFailed(NULL));
+    PBJOutputSinkGetStatistics(NULL, &statistics);
+    PBJTestCheck(statistics.bytesWritten == 0);
+    PBJOutputSinkDestroy(NULL);
+
+    free(expected);
+    free(chunk);
+}
+
+#pragma mark - file
+
+static void PBJOutputSinkTestFileMatchesMemory(const char *path)
+{
+    static const size_t batchSizes[] = { 4096, 5000, 65536, 1 << 20 };
+    static const size_t batchCounts[] = { 2, 5 };
+    uint8_t *chunk = (uint8_t *)malloc(1 << 20);
+    PBJTestCheck(chunk != NULL);
+
+    for (size_t b = 0; b < sizeof(batchSizes) / sizeof(batchSizes[0]); b++) {
+        for (int durability = PBJOutputSinkDurabilityFinish; durability <= PBJOutputSinkDurabilityBytes; durability++) {
+            for (size_t c = 0; c < sizeof(batchCounts) / sizeof(batchCounts[0]); c++) {
+                PBJOutputSinkConfiguration configuration = PBJOutputSinkDefaultConfiguration();
+                configuration.batchBytes = batchSizes[b];
+                configuration.batchCount = batchCounts[c];
+                configuration.durability = (PBJOutputSinkDurability)durability;
+                configuration.durabilityBytes = 3 << 20;
+                configuration.preallocationBytes = b % 2 ? 64 << 20 : 0;
+                PBJOutputSink *file = PBJOutputSinkCreateFile(path, &configuration);
+                PBJOutputSink *memory = PBJOutputSinkCreateMemory();
+                PBJTestCheck(file != NULL && memory != NULL);
+
+                PBJTestRandom random = PBJTestRandomMake(b * 100 + (uint64_t)durability * 10 + c + 1);
+                size_t total = 0;
+                uint64_t fragments = 0;
+                for (int i = 0; i < 120; i++) {
+                    size_t count = PBJOutputSinkTestFillChunk(&random, chunk);
+                    PBJTestCheck(PBJOutputSinkWrite(file, chunk, count) && PBJOutputSinkWrite(memory, chunk, count));
+                    total += count;
+                    if (PBJTestRandomBelow(&random, 17) == 0) {
+                        PBJTestCheck(PBJOutputSinkEndFragment(file) && PBJOutputSinkEndFragment(memory));
+                        fragments++;
+                    }
+                }
+                PBJOutputSinkStatistics statistics;
+                PBJOutputSinkGetStatistics(file, &statistics);
+                PBJTestCheck(statistics.preallocatedBytes == configuration.preallocationBytes);
+                if (configuration.preallocationBytes) {
+                    struct stat status;
+                    PBJTestCheck(stat(path, &status) == 0);
+                    PBJTestCheck((uint64_t)status.st_blocks * 512 >= configuration.preallocationBytes);
+                }
+                PBJTestCheck(PBJOutputSinkFinish(file) && PBJOutputSinkFinish(memory));
+
+                size_t fileLength = 0;
+                size_t memoryLength = 0;
+                uint8_t *fileBytes = PBJOutputSinkTestReadFile(path, &fileLength);
+                const uint8_t *memoryBytes = PBJOutputSinkGetMemoryBytes(memory, &memoryLength);
+                PBJTestCheck(fileLength == total && memoryLength == total);
+                PBJTestCheck(memcmp(fileBytes, memoryBytes, total) == 0);
+                free(fileBytes);
+
+                PBJOutputSinkGetStatistics(file, &statistics);
+                PBJTestCheck(statistics.bytesWritten == total && statistics.bytesStored == total);
+                // batches are rounded up to the alignment, each takes at least one write
+                size_t batchBytes = (configuration.batchBytes + PBJOutputSinkAlignment - 1) / PBJOutputSinkAlignment * PBJOutputSinkAlignment;
+                PBJTestCheck(statistics.writeCalls >= total / batchBytes);
+                if (durability == PBJOutputSinkDurabilityFinish) {
+                    PBJTestCheck(statistics.syncCalls == 1);
+                } else if (durability == PBJOutputSinkDurabilityFragment) {
+                    PBJTestCheck(statistics.syncCalls == fragments + 1);
+                } else {
+                    // a sync every 3 MB, moved to the next fragment end at the latest
+                    uint64_t expected = total / (3 << 20) + 1;
+                    PBJTestCheck(statistics.syncCalls + 1 >= expected && statistics.syncCalls <= expected + fragments);
+                }
+                // unused preallocation goes back when the file is finished
+                struct stat status;
+                PBJTestCheck(stat(path, &status) == 0);
+                PBJTestCheck((uint64_t)status.st_blocks * 512 < total + (1 << 20));
+
+                PBJTestCheck(PBJOutputSinkWrite(file, chunk, 1) == 0);
+                PBJTestCheck(PBJOutputSinkGetMemoryBytes(file, &fileLength) == NULL && fileLength == 0);
+                PBJOutputSinkDestroy(memory);
+                PBJOutputSinkDestroy(file);
+            }
+        }
+    }
+    free(chunk);
+}
+
+static void PBJOutputSinkTestFailures(const char *path)
+{
+    PBJOutputSinkConfiguration configuration = PBJOutputSinkDefaultConfiguration();
+    configuration.batchBytes = 4096;
+    configuration.batchCount = 2;
+    uint8_t block[10000];
+    memset(block, 1, sizeof(block));
+
+#if defined(__linux__)
+    // a full device fails on the I/O thread, the producer hears of it on a later write
+    PBJOutputSink *full = PBJOutputSinkCreateFile("/dev/full", &configuration);
+    PBJTestCheck(full != NULL);
+    int failed = 0;
+    for (int i = 0; i < 1000 && !failed; i++)
+        failed = !PBJOutputSinkWrite(full, block, sizeof(block));
+    PBJTestCheck(failed && PBJOutputSinkHasFailed(full));
+    PBJTestCheck(PBJOutputSinkEndFragment(full) == 0);
+    PBJTestCheck(PBJOutputSinkFinish(full) == 0);
+    PBJOutputSinkDestroy(full);
+#endif
+
+    PBJTestCheck(PBJOutputSinkCreateFile("/nonexistent/PBJOutputSinkTests", &configuration) == NULL);
+    PBJTestCheck(PBJOutputSinkCreateFile(NULL, &configuration) == NULL);
+    PBJTestCheck(PBJOutputSinkCreateFile(path, NULL) == NULL);
+
+    // destroyed without finishing, what was written is drained and the producer isn't left waiting
+    PBJOutputSink *sink = PBJOutputSinkCreateFile(path, &configuration);
+    PBJTestCheck(sink != NULL);
+    for (int i = 0; i < 100; i++)
+        PBJTestCheck(PBJOutputSinkWrite(sink, block, sizeof(block)));
+    PBJOutputSinkDestroy(sink);
+    size_t length = 0;
+    free(PBJOutputSinkTestReadFile(path, &length));
+    PBJTestCheck(length >= 100 * sizeof(block) / configuration.batchBytes * configuration.batchBytes);
+}
+
+int main(void)
+{
+    char path[] = "/tmp/PBJOutputSinkTestsXXXXXX";
+    int descriptor = mkstemp(path);
+    PBJTestCheck(descriptor >= 0);
+    close(descriptor);
+
+    PBJOutputSinkTestMemory();
+    PBJOutputSinkTestFileMatchesMemory(path);
+    PBJOutputSinkTestFailures(path);
+
+    unlink(path);
+    return 0;
+}
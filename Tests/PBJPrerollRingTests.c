@@ -0,0 +1,435 @@
+//
+//  PBJPrerollRingTests.c
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#include "PBJPrerollRing.h"
+#include "PBJTestSupport.h"
+
+// synthetic 30 fps video and 1024 frame AAC pushed through rings under a time window, a byte
+// budget and a slot capacity. payloads are indices into a ledger, so after every push the
+// items still held can be rebuilt from what was released and checked against the counters
+
+#define PBJ_PREROLL_TEST_MAX_ITEMS 400000
+
+typedef enum {
+    PBJPrerollTestStateNone = 0,
+    PBJPrerollTestStateHeld,
+    PBJPrerollTestStateReleased,
+    PBJPrerollTestStateDrained,
+} PBJPrerollTestState;
+
+typedef struct {
+    PBJCaptureTrack track;
+    int64_t time; // nanoseconds
+    int64_t end;
+    size_t size;
+    int isKeyframe;
+    PBJPrerollTestState state;
+} PBJPrerollTestEntry;
+
+typedef struct {
+    PBJPrerollTestEntry entries[PBJ_PREROLL_TEST_MAX_ITEMS];
+    size_t count;
+    size_t oldestHeld[PBJCaptureTrackCount]; // nothing before it is held
+    int64_t lastDrainedTime;
+    int drainedVideo;
+    int64_t firstDrainedVideoTime;
+    int64_t firstDrainedAudioEnd;
+} PBJPrerollTestLedger;
+
+static PBJPrerollTestLedger PBJPrerollTestLedgerStorage;
+
+static void PBJPrerollTestRelease(void *context, void *payload)
+{
+    PBJPrerollTestLedger *ledger = (PBJPrerollTestLedger *)context;
+    size_t index = (size_t)(uintptr_t)payload - 1;
+    PBJTestCheck(index < ledger->count);
+    PBJTestCheck(ledger->entries[index].state == PBJPrerollTestStateHeld);
+    ledger->entries[index].state = PBJPrerollTestStateReleased;
+}
+
+static void PBJPrerollTestDrain(void *context, const PBJPrerollItem *item)
+{
+    PBJPrerollTestLedger *ledger = (PBJPrerollTestLedger *)context;
+    size_t index = (size_t)(uintptr_t)item->payload - 1;
+    PBJTestCheck(index < ledger->count);
+    PBJPrerollTestEntry *entry = &ledger->entries[index];
+    PBJTestCheck(entry->state == PBJPrerollTestStateHeld);
+    PBJTestCheck(entry->track == item->track && entry->size == item->size);
+    entry->state = PBJPrerollTestStateDrained;
+
+    // the two tracks come out interleaved in presentation order, starting on a keyframe
+    PBJTestCheck(entry->time >= ledger->lastDrainedTime);
+    ledger->lastDrainedTime = entry->time;
+    if (entry->track == PBJCaptureTrackVideo) {
+        if (!ledger->drainedVideo)
+            PBJTestCheck(item->isKeyframe);
+        if (!ledger->drainedVideo)
+            ledger->firstDrainedVideoTime = entry->time;
+        ledger->drainedVideo = 1;
+    } else if (ledger->firstDrainedAudioEnd == INT64_MIN) {
+        ledger->firstDrainedAudioEnd = entry->end;
+    }
+}
+
+static void PBJPrerollTestLedgerReset(PBJPrerollTestLedger *ledger)
+{
+    ledger->count = 0;
+    for (int track = 0; track < PBJCaptureTrackCount; track++)
+        ledger->oldestHeld[track] = 0;
+}
+
+static int PBJPrerollTestPush(PBJPrerollRing *ring, PBJPrerollTestLedger *ledger, PBJCaptureTrack track, int64_t time, int64_t duration, size_t size, int isKeyframe)
+{
+    PBJTestCheck(ledger->count < PBJ_PREROLL_TEST_MAX_ITEMS);
+    PBJPrerollTestEntry *entry = &ledger->entries[ledger->count++];
+    entry->track = track;
+    entry->time = time;
+    entry->end = time + duration;
+    entry->size = size;
+    entry->isKeyframe = track == PBJCaptureTrackAudio || isKeyframe;
+    entry->state = PBJPrerollTestStateHeld;
+
+    PBJPrerollItem item;
+    item.track = track;
+    item.presentationTimestamp = PBJTimeMake(time, PBJ_TEST_NSEC_PER_SEC);
+    item.duration = PBJTimeMake(duration, PBJ_TEST_NSEC_PER_SEC);
+    item.size = size;
+    item.isKeyframe = isKeyframe;
+    item.payload = (void *)(uintptr_t)ledger->count;
+    uint64_t rejected = PBJPrerollRingGetCounters(ring).rejected;
+    int kept = PBJPrerollRingPush(ring, &item);
+    // a rejected push releases the payload straight away, a kept one can still go with its
+    // GOP when the budget can't hold the GOP any longer
+    PBJTestCheck(PBJPrerollRingGetCounters(ring).rejected == rejected + !kept);
+    PBJTestCheck(kept ? entry->state != PBJPrerollTestStateNone : entry->state == PBJPrerollTestStateReleased);
+    return kept;
+}
+
+typedef struct {
+    size_t videoItems;
+    size_t audioItems;
+    size_t bytes;
+    int64_t videoStart;
+    int64_t videoEnd;
+    int64_t audioStart;
+    int64_t audioEnd;
+} PBJPrerollTestHeld;
+
+// rebuilds what the ring holds from the ledger and checks it against the ring's own view
+static PBJPrerollTestHeld PBJPrerollTestCheckHeld(const PBJPrerollRing *ring, PBJPrerollTestLedger *ledger, size_t memoryBudget)
+{
+    PBJPrerollTestHeld held = { 0, 0, 0, INT64_MAX, INT64_MIN, INT64_MAX, INT64_MIN };
+    int firstVideo = 1;
+    for (int track = 0; track < PBJCaptureTrackCount; track++) {
+        size_t index = ledger->oldestHeld[track];
+        while (index < ledger->count && (ledger->entries[index].track != (PBJCaptureTrack)track || ledger->entries[index].state != PBJPrerollTestStateHeld))
+            index++;
+        ledger->oldestHeld[track] = index;
+
+        // eviction takes from the front, once an item is held everything after it that was kept is too
+        for (; index < ledger->count; index++) {
+            const PBJPrerollTestEntry *entry = &ledger->entries[index];
+            if (entry->track != (PBJCaptureTrack)track)
+                continue;
+            PBJTestCheck(entry->state == PBJPrerollTestStateHeld || entry->state == PBJPrerollTestStateReleased);
+            if (entry->state != PBJPrerollTestStateHeld)
+                continue;
+            held.bytes += entry->size;
+            if (track == PBJCaptureTrackVideo) {
+                // video always begins on a keyframe
+                if (firstVideo)
+                    PBJTestCheck(entry->isKeyframe);
+                firstVideo = 0;
+                held.videoItems++;
+                held.videoStart = entry->time < held.videoStart ? entry->time : held.videoStart;
+                held.videoEnd = entry->end;
+            } else {
+                held.audioItems++;
+                if (held.audioStart == INT64_MAX)
+                    PBJTestCheck(held.videoItems == 0 || entry->end > held.videoStart);
+                held.audioStart = entry->time < held.audioStart ? entry->time : held.audioStart;
+                held.audioEnd = entry->end;
+            }
+        }
+    }
+
+    // no audio that ends before the first keyframe is kept
+    if (held.videoItems > 0 && held.audioItems > 0) {
+        for (size_t index = ledger->oldestHeld[PBJCaptureTrackAudio]; index < ledger->count; index++) {
+            const PBJPrerollTestEntry *entry = &ledger->entries[index];
+            if (entry->track == PBJCaptureTrackAudio && entry->state == PBJPrerollTestStateHeld) {
+                PBJTestCheck(entry->end > held.videoStart);
+                break;
+            }
+        }
+    }
+
+    PBJPrerollRingCounters counters = PBJPrerollRingGetCounters(ring);
+    PBJTestCheck(counters.videoItems == held.videoItems);
+    PBJTestCheck(counters.audioItems == held.audioItems);
+    PBJTestCheck(counters.bytes == held.bytes);
+    PBJTestCheck(counters.bytes <= memoryBudget);
+
+    PBJTime duration = PBJPrerollRingGetVideoDuration(ring);
+    PBJTestCheck(duration.timescale == PBJ_TEST_NSEC_PER_SEC);
+    PBJTestCheck(duration.value == (held.videoItems ? held.videoEnd - held.videoStart : 0));
+    return held;
+}
+
+static size_t PBJPrerollTestDrainRing(PBJPrerollRing *ring, PBJPrerollTestLedger *ledger)
+{
+    ledger->lastDrainedTime = INT64_MIN;
+    ledger->drainedVideo = 0;
+    ledger->firstDrainedAudioEnd = INT64_MIN;
+    size_t drained = PBJPrerollRingDrain(ring, PBJPrerollTestDrain, ledger);
+    if (ledger->drainedVideo && ledger->firstDrainedAudioEnd != INT64_MIN)
+        PBJTestCheck(ledger->firstDrainedAudioEnd > ledger->firstDrainedVideoTime);
+    return drained;
+}
+
+// everything pushed ended up released or drained exactly once
+static void PBJPrerollTestCheckAccounted(const PBJPrerollTestLedger *ledger)
+{
+    for (size_t i = 0; i < ledger->count; i++)
+        PBJTestCheck(ledger->entries[i].state == PBJPrerollTestStateReleased || ledger->entries[i].state == PBJPrerollTestStateDrained);
+}
+
+#pragma mark - streams
+
+#define PBJ_PREROLL_TEST_FRAME (PBJ_TEST_NSEC_PER_SEC / 30)
+#define PBJ_PREROLL_TEST_PACKET (1024 * PBJ_TEST_NSEC_PER_SEC / 44100)
+
+typedef struct {
+    PBJTestRandom random;
+    int64_t frame;
+    int64_t packet;
+    int64_t audioOffset; // audio capture runs a little ahead or behind video
+    size_t gop;
+    size_t keyframeSize;
+    size_t frameSize;
+    int audio;
+    int64_t audioLag; // audio is delivered this much after video of the same time
+} PBJPrerollTestStream;
+
+// pushes the next sample in presentation order, returns whether it was kept
+static int PBJPrerollTestPushNext(PBJPrerollRing *ring, PBJPrerollTestLedger *ledger, PBJPrerollTestStream *stream)
+{
+    int64_t videoTime = stream->frame * PBJ_PREROLL_TEST_FRAME;
+    int64_t audioTime = stream->audioOffset + stream->packet * PBJ_PREROLL_TEST_PACKET;
+    if (stream->audio && audioTime + stream->audioLag < videoTime) {
+        stream->packet++;
+        return PBJPrerollTestPush(ring, ledger, PBJCaptureTrackAudio, audioTime, PBJ_PREROLL_TEST_PACKET, 300 + PBJTestRandomBelow(&stream->random, 200), 1);
+    }
+    int isKeyframe = (stream->frame % (int64_t)stream->gop) == 0;
+    size_t size = isKeyframe ? stream->keyframeSize : stream->frameSize / 2 + PBJTestRandomBelow(&stream->random, stream->frameSize);
+    stream->frame++;
+    return PBJPrerollTestPush(ring, ledger, PBJCaptureTrackVideo, videoTime, PBJ_PREROLL_TEST_FRAME, size, isKeyframe);
+}
+
+static PBJPrerollRing *PBJPrerollTestCreate(PBJPrerollTestLedger *ledger, int64_t window, size_t memoryBudget, size_t capacity)
+{
+    PBJPrerollRingConfiguration configuration;
+    configuration.duration = window > 0 ? PBJTimeMake(window, PBJ_TEST_NSEC_PER_SEC) : PBJTimeMake(0, 0);
+    configuration.memoryBudget = memoryBudget;
+    configuration.capacity = capacity;
+    PBJPrerollTestLedgerReset(ledger);
+    PBJPrerollRing *ring = PBJPrerollRingCreate(&configuration, PBJPrerollTestRelease, ledger);
+    PBJTestCheck(ring != NULL);
+    return ring;
+}
+
+#pragma mark - tests
+
+// with room to spare the window alone decides, whole GOPs leave once the rest still covers it
+static void PBJPrerollTestWindowEviction(void)
+{
+    PBJPrerollTestLedger *ledger = &PBJPrerollTestLedgerStorage;
+    int64_t window = 3 * PBJ_TEST_NSEC_PER_SEC;
+    PBJPrerollRing *ring = PBJPrerollTestCreate(ledger, window, SIZE_MAX / 2, 1024);
+    PBJPrerollTestStream stream = { PBJTestRandomMake(1), 0, 0, -5000000, 30, 60000, 8000, 1, 0 };
+
+    for (int i = 0; i < 30 * 60; i++) {
+        PBJPrerollTestPushNext(ring, ledger, &stream);
+        PBJPrerollTestHeld held = PBJPrerollTestCheckHeld(ring, ledger, SIZE_MAX / 2);
+        int64_t covered = held.videoEnd - held.videoStart;
+        if (stream.frame > 30 * 5) {
+            // at least the window and less than a GOP past it
+            PBJTestCheck(covered >= window);
+            PBJTestCheck(covered < window + PBJ_TEST_NSEC_PER_SEC);
+            PBJTestCheck((held.videoStart / PBJ_PREROLL_TEST_FRAME) % 30 == 0);
+            // audio reaches back to the first keyframe, no further than a packet
+            PBJTestCheck(held.audioStart <= held.videoStart && held.audioStart > held.videoStart - PBJ_PREROLL_TEST_PACKET);
+        }
+    }
+    PBJPrerollRingCounters counters = PBJPrerollRingGetCounters(ring);
+    PBJTestCheck(counters.evictedVideo > 0 && counters.evictedAudio > 0 && counters.rejected == 0);
+    PBJTestCheck(PBJPrerollTestDrainRing(ring, ledger) == counters.videoItems + counters.audioItems);
+    PBJPrerollRingDestroy(ring);
+    PBJPrerollTestCheckAccounted(ledger);
+}
+
+// a budget far below the window with audio arriving late, both tracks give way oldest first
+// and never hold a byte over
+static void PBJPrerollTestMemoryPressure(void)
+{
+    PBJPrerollTestLedger *ledger = &PBJPrerollTestLedgerStorage;
+    static const size_t budgets[] = { 70000, 150000, 400000, 1000000 };
+    for (size_t b = 0; b < sizeof(budgets) / sizeof(budgets[0]); b++) {
+        PBJPrerollRing *ring = PBJPrerollTestCreate(ledger, 10 * PBJ_TEST_NSEC_PER_SEC, budgets[b], 4096);
+        PBJPrerollTestStream stream = { PBJTestRandomMake(b + 10), 0, 0, 3000000, 30, 60000, 8000, 1, 80000000 };
+        for (int i = 0; i < 30 * 40; i++) {
+            PBJPrerollTestPushNext(ring, ledger, &stream);
+            PBJPrerollTestHeld held = PBJPrerollTestCheckHeld(ring, ledger, budgets[b]);
+            if (held.videoItems > 0 && held.audioItems > 0)
+                PBJTestCheck(held.audioStart > held.videoStart - PBJ_PREROLL_TEST_PACKET);
+        }
+        PBJPrerollRingCounters counters = PBJPrerollRingGetCounters(ring);
+        PBJTestCheck(counters.evictedVideo > 0);
+        // a recording starting now still opens on a keyframe with audio lined up
+        PBJPrerollTestDrainRing(ring, ledger);
+        PBJPrerollTestCheckHeld(ring, ledger, budgets[b]);
+        PBJPrerollRingDestroy(ring);
+        PBJPrerollTestCheckAccounted(ledger);
+    }
+}
+
+// a budget smaller than a single GOP empties the video and waits for the next keyframe,
+// rejecting the delta frames in between
+static void PBJPrerollTestBudgetBelowGOP(void)
+{
+    PBJPrerollTestLedger *ledger = &PBJPrerollTestLedgerStorage;
+    size_t budget = 100000;
+    PBJPrerollRing *ring = PBJPrerollTestCreate(ledger, 0, budget, 4096);
+    PBJPrerollTestStream stream = { PBJTestRandomMake(3), 0, 0, 0, 30, 60000, 10000, 0, 0 };
+    uint64_t rejected = 0;
+    for (int i = 0; i < 30 * 10; i++) {
+        int isKeyframe = stream.frame % 30 == 0;
+        int kept = PBJPrerollTestPushNext(ring, ledger, &stream);
+        PBJPrerollTestHeld held = PBJPrerollTestCheckHeld(ring, ledger, budget);
+        if (isKeyframe)
+            PBJTestCheck(kept && held.videoItems == 1);
+        if (!kept)
+            rejected++;
+    }
+    PBJTestCheck(rejected > 0);
+    PBJTestCheck(PBJPrerollRingGetCounters(ring).rejected == rejected);
+    PBJPrerollRingDestroy(ring);
+    PBJPrerollTestCheckAccounted(ledger);
+}
+
+// out of slots behaves like the budget, a GOP at a time
+static void PBJPrerollTestCapacity(void)
+{
+    PBJPrerollTestLedger *ledger = &PBJPrerollTestLedgerStorage;
+    PBJPrerollRing *ring = PBJPrerollTestCreate(ledger, 0, SIZE_MAX / 2, 75);
+    PBJPrerollTestStream stream = { PBJTestRandomMake(4), 0, 0, 1000000, 30, 1000, 100, 1, 0 };
+    for (int i = 0; i < 30 * 20; i++) {
+        PBJPrerollTestPushNext(ring, ledger, &stream);
+        PBJPrerollTestHeld held = PBJPrerollTestCheckHeld(ring, ledger, SIZE_MAX / 2);
+        PBJTestCheck(held.videoItems <= 75 && held.audioItems <= 75);
+        if (stream.frame > 90)
+            PBJTestCheck(held.videoItems >= 45);
+    }
+    // a capacity under one GOP can never keep a GOP whole
+    PBJPrerollRingDestroy(ring);
+    ring = PBJPrerollTestCreate(ledger, 0, SIZE_MAX / 2, 20);
+    stream = (PBJPrerollTestStream){ PBJTestRandomMake(5), 0, 0, 0, 30, 1000, 100, 0, 0 };
+    for (int i = 0; i < 30 * 5; i++) {
+        PBJPrerollTestPushNext(ring, ledger, &stream);
+        PBJPrerollTestHeld held = PBJPrerollTestCheckHeld(ring, ledger, SIZE_MAX / 2);
+        PBJTestCheck(held.videoItems == 0 || held.videoStart % (30 * PBJ_PREROLL_TEST_FRAME) == 0);
+    }
+    PBJPrerollRingDestroy(ring);
+    PBJPrerollTestCheckAccounted(ledger);
+}
+
+static void PBJPrerollTestRejections(void)
+{
+    PBJPrerollTestLedger *ledger = &PBJPrerollTestLedgerStorage;
+    PBJPrerollRing *ring = PBJPrerollTestCreate(ledger, 0, 10000, 16);
+    // video ahead of the first keyframe, larger than the budget, or not after the last
+    PBJTestCheck(!PBJPrerollTestPush(ring, ledger, PBJCaptureTrackVideo, 0, PBJ_PREROLL_TEST_FRAME, 100, 0));
+    PBJTestCheck(!PBJPrerollTestPush(ring, ledger, PBJCaptureTrackVideo, PBJ_PREROLL_TEST_FRAME, PBJ_PREROLL_TEST_FRAME, 10001, 1));
+    PBJTestCheck(PBJPrerollTestPush(ring, ledger, PBJCaptureTrackVideo, 2 * PBJ_PREROLL_TEST_FRAME, PBJ_PREROLL_TEST_FRAME, 100, 1));
+    PBJTestCheck(!PBJPrerollTestPush(ring, ledger, PBJCaptureTrackVideo, 2 * PBJ_PREROLL_TEST_FRAME, PBJ_PREROLL_TEST_FRAME, 100, 0));
+    PBJTestCheck(!PBJPrerollTestPush(ring, ledger, PBJCaptureTrackVideo, PBJ_PREROLL_TEST_FRAME, PBJ_PREROLL_TEST_FRAME, 100, 0));
+    // audio delivered after the keyframe but ending before it is never worth keeping
+    PBJTestCheck(!PBJPrerollTestPush(ring, ledger, PBJCaptureTrackAudio, 0, PBJ_PREROLL_TEST_FRAME, 50, 1));
+    PBJTestCheck(PBJPrerollTestPush(ring, ledger, PBJCaptureTrackAudio, PBJ_PREROLL_TEST_FRAME + 1, PBJ_PREROLL_TEST_FRAME, 50, 1));
+    PBJPrerollTestHeld held = PBJPrerollTestCheckHeld(ring, ledger, 10000);
+    PBJTestCheck(held.audioItems == 1 && held.videoItems == 1);
+    PBJTestCheck(PBJPrerollRingGetCounters(ring).rejected == 5);
+
+    // after a drain the next video kept is a keyframe again
+    PBJTestCheck(PBJPrerollTestDrainRing(ring, ledger) == 2);
+    PBJTestCheck(!PBJPrerollTestPush(ring, ledger, PBJCaptureTrackVideo, 3 * PBJ_PREROLL_TEST_FRAME, PBJ_PREROLL_TEST_FRAME, 100, 0));
+    PBJTestCheck(PBJPrerollTestPush(ring, ledger, PBJCaptureTrackVideo, 4 * PBJ_PREROLL_TEST_FRAME, PBJ_PREROLL_TEST_FRAME, 100, 1));
+    PBJPrerollRingClear(ring);
+    PBJTestCheck(PBJPrerollRingGetCounters(ring).bytes == 0);
+    PBJPrerollRingDestroy(ring);
+    PBJPrerollTestCheckAccounted(ledger);
+
+    PBJPrerollRingConfiguration configuration = { PBJTimeMake(0, 0), 0, 16 };
+    PBJTestCheck(PBJPrerollRingCreate(&configuration, NULL, NULL) == NULL);
+    configuration.memoryBudget = 1;
+    configuration.capacity = 0;
+    PBJTestCheck(PBJPrerollRingCreate(&configuration, NULL, NULL) == NULL);
+}
+
+// random GOP lengths, sizes, budgets, windows and drains, with every invariant checked per push
+static void PBJPrerollTestRandomized(void)
+{
+    PBJPrerollTestLedger *ledger = &PBJPrerollTestLedgerStorage;
+    PBJTestRandom random = PBJTestRandomMake(99);
+    for (int run = 0; run < 40; run++) {
+        size_t budget = (size_t)PBJTestRandomBetween(&random, 20000, 2000000);
+        int64_t window = PBJTestRandomBelow(&random, 4) == 0 ? 0 : PBJTestRandomBetween(&random, 1, 8) * PBJ_TEST_NSEC_PER_SEC / 2;
+        size_t capacity = (size_t)PBJTestRandomBetween(&random, 8, 600);
+        PBJPrerollRing *ring = PBJPrerollTestCreate(ledger, window, budget, capacity);
+        PBJPrerollTestStream stream = { PBJTestRandomMake((uint64_t)run), 0, 0, PBJTestRandomBetween(&random, -20000000, 20000000),
+                                        (size_t)PBJTestRandomBetween(&random, 1, 90), (size_t)PBJTestRandomBetween(&random, 1000, 80000),
+                                        (size_t)PBJTestRandomBetween(&random, 100, 20000), (int)PBJTestRandomBelow(&random, 4) != 0,
+                                        PBJTestRandomBetween(&random, 0, 200000000) };
+        for (int i = 0; i < 3000; i++) {
+            PBJPrerollTestPushNext(ring, ledger, &stream);
+            PBJPrerollTestCheckHeld(ring, ledger, budget);
+            if (PBJTestRandomBelow(&random, 500) == 0)
+                PBJPrerollTestDrainRing(ring, ledger);
+        }
+        PBJPrerollRingDestroy(ring);
+        PBJPrerollTestCheckAccounted(ledger);
+    }
+}
+
+int main(void)
+{
+    PBJPrerollTestWindowEviction();
+    PBJPrerollTestMemoryPressure();
+    PBJPrerollTestBudgetBelowGOP();
+    PBJPrerollTestCapacity();
+    PBJPrerollTestRejections();
+    PBJPrerollTestRandomized();
+    return 0;
+}
@@ -0,0 +1,340 @@
+//
+//  PBJProxyOutputTests.c
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include "PBJCapturePipeline.h"
+#include "PBJColorConversion.h"
+#include "PBJProxyOutput.h"
+#include "PBJSyntheticCaptureSource.h"
+#include "PBJTestSupport.h"
+
+// the proxy's geometry for the master sizes capture produces, decimation of jittered frame
+// streams on the written timeline, a downscale that matches the scalar reference at every level
+// and across strips, and the fan-out of a synthetic recording with a pause and an interruption,
+// where the proxy has to take every audio sample and half the frames
+
+#define PBJ_PROXY_TEST_NS PBJ_TEST_NSEC_PER_SEC
+
+#pragma mark - configuration
+
+static void PBJProxyTestExpectDimensions(PBJProxyOutput *proxy, size_t masterWidth, size_t masterHeight, size_t width, size_t height)
+{
+    PBJTestCheck(PBJProxyOutputPrepare(proxy, masterWidth, masterHeight));
+    size_t proxyWidth = 0;
+    size_t proxyHeight = 0;
+    PBJProxyOutputGetDimensions(proxy, &proxyWidth, &proxyHeight);
+    PBJTestCheck(proxyWidth == width && proxyHeight == height);
+    PBJTestCheck(proxyWidth % 2 == 0 && proxyHeight % 2 == 0);
+}
+
+static void PBJProxyTestConfigurations(void)
+{
+    PBJProxyOutputConfiguration configuration = PBJProxyOutputDefaultConfiguration();
+    PBJTestCheck(configuration.maximumDimension == 640 && configuration.frameRate == 15);
+    configuration.maximumDimension = 1;
+    PBJTestCheck(PBJProxyOutputCreate(&configuration) == NULL);
+    configuration.maximumDimension = 640;
+    configuration.frameRate = -1;
+    PBJTestCheck(PBJProxyOutputCreate(&configuration) == NULL);
+
+    PBJProxyOutput *proxy = PBJProxyOutputCreate(NULL);
+    PBJTestCheck(proxy != NULL);
+    size_t width = 1;
+    size_t height = 1;
+    PBJProxyOutputGetDimensions(proxy, &width, &height);
+    PBJTestCheck(width == 0 && height == 0);
+    PBJTestCheck(!PBJProxyOutputPrepare(proxy, 1, 720));
+
+    // the long edge fits, the aspect is kept, landscape and portrait alike
+    PBJProxyTestExpectDimensions(proxy, 1920, 1080, 640, 360);
+    const PBJResampler *resampler = PBJProxyOutputGetResampler(proxy);
+    PBJTestCheck(resampler != NULL);
+    PBJProxyTestExpectDimensions(proxy, 1920, 1080, 640, 360);
+    PBJTestCheck(PBJProxyOutputGetResampler(proxy) == resampler);
+    PBJProxyTestExpectDimensions(proxy, 1080, 1920, 360, 640);
+    PBJProxyTestExpectDimensions(proxy, 1080, 1080, 640, 640);
+    PBJProxyTestExpectDimensions(proxy, 1440, 1080, 640, 480);
+    PBJProxyTestExpectDimensions(proxy, 1280, 534, 640, 268);
+
+    // a master no larger than the proxy passes through
+    PBJProxyTestExpectDimensions(proxy, 480, 360, 480, 360);
+    PBJTestCheck(PBJProxyOutputGetResampler(proxy) == NULL && PBJProxyOutputScratchSize(proxy) == 0);
+
+    // a new frame rate keeps the geometry, a new long edge chooses it again
+    PBJProxyOutputConfiguration changed = PBJProxyOutputGetConfiguration(proxy);
+    changed.frameRate = 10;
+    PBJTestCheck(PBJProxyOutputSetConfiguration(proxy, &changed));
+    PBJProxyOutputGetDimensions(proxy, &width, &height);
+    PBJTestCheck(width == 480 && height == 360);
+    changed.maximumDimension = 320;
+    PBJTestCheck(PBJProxyOutputSetConfiguration(proxy, &changed));
+    PBJProxyOutputGetDimensions(proxy, &width, &height);
+    PBJTestCheck(width == 0 && height == 0);
+    PBJProxyTestExpectDimensions(proxy, 480, 360, 320, 240);
+    PBJTestCheck(PBJProxyOutputGetResampler(proxy) != NULL);
+
+    changed.frameRate = -1;
+    PBJTestCheck(!PBJProxyOutputSetConfiguration(proxy, &changed));
+    PBJTestCheck(PBJProxyOutputGetConfiguration(proxy).frameRate == 10);
+    PBJProxyOutputDestroy(proxy);
+}
+
+#pragma mark - decimation
+
+// frames kept of count arriving at rate, each up to jitter either side of its slot. with a stride,
+// exactly every stride-th frame has to be the one kept, however early its jitter brings it
+static uint64_t PBJProxyTestKeptFrames(double rate, double proxyFrameRate, int count, int64_t jitter, int stride)
+{
+    PBJProxyOutputConfiguration configuration = PBJProxyOutputDefaultConfiguration();
+    configuration.frameRate = proxyFrameRate;
+    PBJProxyOutput *proxy = PBJProxyOutputCreate(&configuration);
+    PBJTestCheck(proxy != NULL);
+
+    PBJTestRandom random = PBJTestRandomMake(7);
+    uint64_t kept = 0;
+    for (int frame = 0; frame < count; frame++) {
+        int64_t time = (int64_t)(frame * PBJ_PROXY_TEST_NS / rate) + (frame ? PBJTestRandomBetween(&random, -jitter, jitter) : 0);
+        unsigned int route = PBJProxyOutputRouteSample(proxy, PBJCaptureTrackVideo, time);
+        PBJTestCheck(route & PBJProxyOutputRouteMaster);
+        if (stride)
+            PBJTestCheck(!(route & PBJProxyOutputRouteProxy) == (frame % stride != 0));
+        if (route & PBJProxyOutputRouteProxy)
+            kept++;
+    }
+    PBJProxyOutputStatistics statistics = PBJProxyOutputGetStatistics(proxy);
+    PBJTestCheck(statistics.framesRouted == kept && statistics.framesDecimated == (uint64_t)count - kept);
+    PBJProxyOutputDestroy(proxy);
+    return kept;
+}
+
+static void PBJProxyTestDecimation(void)
+{
+    PBJTestCheck(PBJProxyTestKeptFrames(30, 15, 300, 0, 2) == 150);
+    PBJTestCheck(PBJProxyTestKeptFrames(30, 15, 300, 3000000, 2) == 150);
+    PBJTestCheck(PBJProxyTestKeptFrames(30, 20, 300, 0, 0) == 200);
+    uint64_t ntsc = PBJProxyTestKeptFrames(29.97, 15, 300, 2000000, 0);
+    PBJTestCheck(ntsc >= 149 && ntsc <= 151);
+    PBJTestCheck(PBJProxyTestKeptFrames(60, 15, 600, 1000000, 4) == 150);
+    // slower than the proxy's rate, or no rate at all, keeps every frame
+    PBJTestCheck(PBJProxyTestKeptFrames(24, 30, 240, 2000000, 1) == 240);
+    PBJTestCheck(PBJProxyTestKeptFrames(30, 0, 300, 5000000, 1) == 300);
+
+    // the grid starts over after a gap in the written time
+    PBJProxyOutput *proxy = PBJProxyOutputCreate(NULL);
+    PBJTestCheck(proxy != NULL);
+    int kept = 0;
+    for (int frame = 0; frame < 30; frame++)
+        kept += (PBJProxyOutputRouteSample(proxy, PBJCaptureTrackVideo, frame * PBJ_PROXY_TEST_NS / 30) & PBJProxyOutputRouteProxy) != 0;
+    for (int frame = 0; frame < 30; frame++)
+        kept += (PBJProxyOutputRouteSample(proxy, PBJCaptureTrackVideo, 5 * PBJ_PROXY_TEST_NS + frame * PBJ_PROXY_TEST_NS / 30) & PBJProxyOutputRouteProxy) != 0;
+    PBJTestCheck(kept == 30);
+
+    // audio always goes to both
+    PBJTestCheck(PBJProxyOutputRouteSample(proxy, PBJCaptureTrackAudio, 0) == (PBJProxyOutputRouteMaster | PBJProxyOutputRouteProxy));
+    PBJTestCheck(PBJProxyOutputGetStatistics(proxy).audioSamplesRouted == 1);
+
+    // a new recording starts with a frame
+    PBJProxyOutputReset(proxy);
+    PBJTestCheck(PBJProxyOutputGetStatistics(proxy).framesRouted == 0);
+    PBJTestCheck(PBJProxyOutputRouteSample(proxy, PBJCaptureTrackVideo, 0) & PBJProxyOutputRouteProxy);
+    PBJTestCheck(PBJProxyOutputRouteSample(NULL, PBJCaptureTrackVideo, 0) == PBJProxyOutputRouteMaster);
+    PBJProxyOutputDestroy(proxy);
+}
+
+#pragma mark - downscale
+
+static void PBJProxyTestExpectSameLuma(const PBJNV12Image *image, const PBJNV12Image *reference)
+{
+    for (size_t y = 0; y < reference->height; y++)
+        PBJTestCheck(memcmp(image->luma + y * image->lumaBytesPerRow, reference->luma + y * reference->lumaBytesPerRow, reference->width) == 0);
+}
+
+static void PBJProxyTestDownscale(void)
+{
+    // a horizontal luma ramp over alternating chroma
+    PBJTestFrame master = PBJTestFrameCreate(1920, 1080, PBJYCbCrRangeVideo);
+    for (size_t y = 0; y < 1080; y++) {
+        for (size_t x = 0; x < 1920; x++)
+            master.image.luma[y * master.image.lumaBytesPerRow + x] = (uint8_t)(x * 255 / 1919);
+    }
+    for (size_t y = 0; y < 540; y++) {
+        for (size_t x = 0; x < 1920; x++)
+            master.image.chroma[y * master.image.chromaBytesPerRow + x] = (x & 1) ? 200 : 60;
+    }
+    PBJTestFrame reference = PBJTestFrameCreate(640, 360, PBJYCbCrRangeVideo);
+    PBJTestFrame destination = PBJTestFrameCreate(640, 360, PBJYCbCrRangeVideo);
+
+    PBJProxyOutput *proxy = PBJProxyOutputCreate(NULL);
+    PBJTestCheck(proxy != NULL);
+    PBJTestCheck(PBJProxyOutputPrepare(proxy, 1920, 1080));
+    size_t scratchSize = PBJProxyOutputScratchSize(proxy);
+    void *scratch = malloc(scratchSize);
+    PBJTestCheck(scratch != NULL);
+    PBJTestCheck(!PBJProxyOutputDownscale(proxy, &destination.image, &master.image, scratch, PBJSIMDLevelAuto));
+
+    // the ramp stays a ramp end to end, flat chroma stays flat
+    PBJTestCheck(PBJProxyOutputDownscale(proxy, &master.image, &reference.image, scratch, PBJSIMDLevelScalar));
+    const PBJNV12Image *image = &reference.image;
+    for (size_t y = 0; y < 360; y++) {
+        const uint8_t *row = image->luma + y * image->lumaBytesPerRow;
+        for (size_t x = 1; x < 640; x++)
+            PBJTestCheck(row[x] >= row[x - 1]);
+        PBJTestCheck(row[0] <= 2 && row[639] >= 253);
+    }
+    for (size_t y = 0; y < 180; y++) {
+        for (size_t x = 0; x < 640; x++)
+            PBJTestCheck(image->chroma[y * image->chromaBytesPerRow + x] == ((x & 1) ? 200 : 60));
+    }
+
+    static const PBJSIMDLevel levels[] = { PBJSIMDLevelScalar, PBJSIMDLevelSSE2, PBJSIMDLevelAVX2, PBJSIMDLevelNEON, PBJSIMDLevelAuto };
+    for (size_t l = 0; l < sizeof(levels) / sizeof(levels[0]); l++) {
+        memset(destination.storage, 0, destination.image.lumaBytesPerRow * 360);
+        PBJTestCheck(PBJProxyOutputDownscale(proxy, &master.image, &destination.image, scratch, levels[l]));
+        PBJProxyTestExpectSameLuma(&destination.image, &reference.image);
+    }
+
+    // strips across threads, as the capture path runs it, give the same frame
+    size_t strips = PBJColorConversionStripCount(360, 4);
+    uint8_t *stripScratch = (uint8_t *)malloc(scratchSize * strips);
+    PBJTestCheck(stripScratch != NULL);
+    memset(destination.storage, 0, destination.image.lumaBytesPerRow * 360);
+    for (size_t strip = 0; strip < strips; strip++) {
+        size_t rowBegin = 0;
+        size_t rowEnd = 0;
+        PBJColorConversionStripRows(360, strips, strip, &rowBegin, &rowEnd);
+        PBJResamplerProcessRows(PBJProxyOutputGetResampler(proxy), &master.image, &destination.image, rowBegin, rowEnd,
+                                stripScratch + strip * scratchSize, PBJSIMDLevelAuto);
+    }
+    PBJProxyTestExpectSameLuma(&destination.image, &reference.image);
+
+    // at the master's size the downscale is a copy, no scratch needed
+    PBJTestCheck(PBJProxyOutputPrepare(proxy, 640, 360));
+    memset(destination.storage, 0, destination.image.lumaBytesPerRow * 360);
+    PBJTestCheck(PBJProxyOutputDownscale(proxy, &reference.image, &destination.image, NULL, PBJSIMDLevelAuto));
+    PBJProxyTestExpectSameLuma(&destination.image, &reference.image);
+
+    free(stripScratch);
+    free(scratch);
+    PBJProxyOutputDestroy(proxy);
+    PBJTestFrameDestroy(&destination);
+    PBJTestFrameDestroy(&reference);
+    PBJTestFrameDestroy(&master);
+}
+
+#pragma mark - fan-out
+
+typedef struct {
+    PBJProxyOutput *proxy;
+    PBJTestFrame destination;
+    void *scratch;
+    uint64_t master[PBJCaptureTrackCount];
+    uint64_t proxied[PBJCaptureTrackCount];
+    int64_t lastProxyVideo;
+    int backwards;
+} PBJProxyTestSink;
+
+static int PBJProxyTestSetupTrack(void *context, const PBJCaptureSample *sample)
+{
+    return 1;
+}
+
+// as the capture queue does, every sample the master writes is routed, kept frames downscaled
+static int PBJProxyTestWriteSample(void *context, const PBJCaptureSample *sample, PBJTime rebasedPresentationTimestamp)
+{
+    PBJProxyTestSink *sink = (PBJProxyTestSink *)context;
+    int64_t time = PBJTimeGetNanoseconds(rebasedPresentationTimestamp);
+    unsigned int route = PBJProxyOutputRouteSample(sink->proxy, sample->track, time);
+    PBJTestCheck(route & PBJProxyOutputRouteMaster);
+    sink->master[sample->track]++;
+    if (!(route & PBJProxyOutputRouteProxy))
+        return 1;
+
+    sink->proxied[sample->track]++;
+    if (sample->track != PBJCaptureTrackVideo)
+        return 1;
+
+    if (sink->proxied[PBJCaptureTrackVideo] > 1 && time <= sink->lastProxyVideo)
+        sink->backwards++;
+    sink->lastProxyVideo = time;
+
+    const PBJNV12Image *master = (const PBJNV12Image *)sample->payload;
+    PBJTestCheck(PBJProxyOutputPrepare(sink->proxy, master->width, master->height));
+    PBJTestCheck(PBJProxyOutputDownscale(sink->proxy, master, &sink->destination.image, sink->scratch, PBJSIMDLevelAuto));
+    return 1;
+}
+
+static void PBJProxyTestFanOut(void)
+{
+    // 10 seconds of 720p30 with audio, paused for 2 and interrupted for 1
+    PBJSyntheticCaptureSourceConfiguration configuration = PBJSyntheticCaptureSourceDefaultConfiguration(1280, 720, 30);
+    configuration.jitter = 3000000;
+    configuration.duration = 10 * PBJ_PROXY_TEST_NS;
+    const PBJSyntheticCaptureEvent events[] = {
+        { PBJSyntheticCaptureEventPause, 3 * PBJ_PROXY_TEST_NS, 0 },
+        { PBJSyntheticCaptureEventResume, 5 * PBJ_PROXY_TEST_NS, 0 },
+        { PBJSyntheticCaptureEventInterrupt, 7 * PBJ_PROXY_TEST_NS, PBJ_PROXY_TEST_NS }
+    };
+    PBJSyntheticCaptureSource *source = PBJSyntheticCaptureSourceCreate(&configuration, events, 3);
+    PBJTestCheck(source != NULL);
+
+    PBJProxyTestSink sink;
+    memset(&sink, 0, sizeof(sink));
+    sink.proxy = PBJProxyOutputCreate(NULL);
+    PBJTestCheck(sink.proxy != NULL);
+    PBJTestCheck(PBJProxyOutputPrepare(sink.proxy, 1280, 720));
+    sink.destination = PBJTestFrameCreate(640, 360, PBJYCbCrRangeVideo);
+    sink.scratch = malloc(PBJProxyOutputScratchSize(sink.proxy));
+    PBJTestCheck(sink.scratch != NULL);
+
+    PBJCapturePipelineSink callbacks = { &sink, PBJProxyTestSetupTrack, PBJProxyTestWriteSample, NULL, NULL, NULL };
+    PBJCapturePipeline *pipeline = PBJCapturePipelineCreate(callbacks);
+    PBJTestCheck(pipeline != NULL);
+    PBJTestCheck(PBJCapturePipelineStart(pipeline));
+    PBJCapturePipelineRunSource(pipeline, PBJSyntheticCaptureSourceGetSource(source));
+
+    // every audio sample, every other frame of a written timeline that never goes back
+    PBJTestCheck(sink.master[PBJCaptureTrackVideo] > 180 && sink.master[PBJCaptureTrackAudio] > 250);
+    PBJTestCheck(sink.proxied[PBJCaptureTrackAudio] == sink.master[PBJCaptureTrackAudio]);
+    PBJTestCheck(sink.proxied[PBJCaptureTrackVideo] * 2 + 2 >= sink.master[PBJCaptureTrackVideo]);
+    PBJTestCheck(sink.proxied[PBJCaptureTrackVideo] * 2 <= sink.master[PBJCaptureTrackVideo] + 4);
+    PBJTestCheck(sink.backwards == 0);
+    PBJProxyOutputStatistics statistics = PBJProxyOutputGetStatistics(sink.proxy);
+    PBJTestCheck(statistics.framesRouted == sink.proxied[PBJCaptureTrackVideo]);
+    PBJTestCheck(statistics.framesDecimated == sink.master[PBJCaptureTrackVideo] - sink.proxied[PBJCaptureTrackVideo]);
+    PBJTestCheck(statistics.audioSamplesRouted == sink.proxied[PBJCaptureTrackAudio]);
+
+    PBJCapturePipelineDestroy(pipeline);
+    PBJSyntheticCaptureSourceDestroy(source);
+    free(sink.scratch);
+    PBJTestFrameDestroy(&sink.destination);
+    PBJProxyOutputDestroy(sink.proxy);
+}
+
+int main(void)
+{
+    PBJProxyTestConfigurations();
+    PBJProxyTestDecimation();
+    PBJProxyTestDownscale();
+    PBJProxyTestFanOut();
+    return 0;
+}
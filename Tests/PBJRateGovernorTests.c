@@ -0,0 +1,309 @@
+//
+//  PBJRateGovernorTests.c
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#include "PBJRateGovernor.h"
+#include "PBJTestSupport.h"
+
+#include <math.h>
+
+// a simulated writer, a serial encoder and storage behind a queue of eight that drops its
+// oldest, put through load spikes with and without the governor. the governor has to cut drops
+// by an order of magnitude, meet a storage spike with the bit rate alone and an encoder spike
+// with the frame rate, recover fully and not oscillate; the backoff has to stop it probing a
+// limit that sits between two steps
+
+#define PBJ_GOVERNOR_TEST_MS 1000000LL
+#define PBJ_GOVERNOR_TEST_QUEUE 8
+
+typedef struct {
+    double encodeMilliseconds;
+    double storageBytesPerSecond;
+} PBJGovernorTestConditions;
+
+typedef PBJGovernorTestConditions (*PBJGovernorTestScript)(double seconds);
+
+typedef struct {
+    uint64_t dropped;
+    uint64_t admitted;
+    uint32_t decreases;
+    uint32_t increases;
+    uint32_t changes;
+    int reversals; // a step up after a cut or a cut after a step up
+    double bitRateAt[200]; // targets at each whole second
+    double frameRateAt[200];
+} PBJGovernorTestResult;
+
+static PBJGovernorTestResult PBJGovernorTestSimulate(PBJGovernorTestScript script, double seconds, int governed, const PBJRateGovernorConfiguration *configuration)
+{
+    PBJGovernorTestResult result;
+    memset(&result, 0, sizeof(result));
+    PBJRateGovernor *governor = PBJRateGovernorCreate(configuration);
+    PBJTestCheck(governor != NULL);
+
+    int64_t queue[PBJ_GOVERNOR_TEST_QUEUE];
+    size_t head = 0;
+    size_t count = 0;
+    int64_t busyUntil = 0;
+    uint64_t appended = 0;
+    uint64_t appendNanoseconds = 0;
+    uint64_t deferred = 0;
+    double lastBitRate = configuration->maximumBitRate;
+    int lastDirection = 0;
+    PBJTestRandom random = PBJTestRandomMake(7);
+    int64_t end = (int64_t)(seconds * (double)PBJ_TEST_NSEC_PER_SEC);
+
+    for (int64_t tick = 0; tick < end; tick += PBJ_TEST_NSEC_PER_SEC / 30) {
+        // 1.5 ms of capture jitter
+        int64_t now = tick + PBJTestRandomBetween(&random, -1500000, 1500000);
+        if (now < 0)
+            now = 0;
+        PBJRateGovernorTargets targets;
+        PBJRateGovernorGetTargets(governor, &targets);
+        double bitRate = governed ? targets.bitRate : configuration->maximumBitRate;
+        double frameRate = governed ? targets.frameRate : configuration->maximumFrameRate;
+
+        // the writer catches up to now
+        while (count > 0) {
+            int64_t arrival = queue[head];
+            int64_t start = busyUntil > arrival ? busyUntil : arrival;
+            if (start > now)
+                break;
+            PBJGovernorTestConditions conditions = script((double)start / (double)PBJ_TEST_NSEC_PER_SEC);
+            double bytes = bitRate / frameRate / 8.0;
+            int64_t service = (int64_t)(conditions.encodeMilliseconds * PBJ_GOVERNOR_TEST_MS + bytes / conditions.storageBytesPerSecond * (double)PBJ_TEST_NSEC_PER_SEC);
+            busyUntil = start + service;
+            head = (head + 1) % PBJ_GOVERNOR_TEST_QUEUE;
+            count--;
+            appended++;
+            appendNanoseconds += (uint64_t)service;
+        }
+        if (busyUntil > now && count > 0)
+            deferred++;
+
+        if (!governed || PBJRateGovernorAdmitFrame(governor, now)) {
+            result.admitted++;
+            if (count == PBJ_GOVERNOR_TEST_QUEUE) {
+                head = (head + 1) % PBJ_GOVERNOR_TEST_QUEUE;
+                count--;
+                result.dropped++;
+            }
+            queue[(head + count) % PBJ_GOVERNOR_TEST_QUEUE] = now;
+            count++;
+        }
+
+        if (governed) {
+            PBJWriterLoad load = { now, count, PBJ_GOVERNOR_TEST_QUEUE, result.dropped, deferred, appended, appendNanoseconds };
+            if (PBJRateGovernorObserve(governor, &load)) {
+                result.changes++;
+                PBJRateGovernorGetTargets(governor, &targets);
+                int direction = targets.bitRate < lastBitRate ? -1 : (targets.bitRate > lastBitRate ? 1 : 0);
+                if (direction && lastDirection && direction != lastDirection)
+                    result.reversals++;
+                if (direction)
+                    lastDirection = direction;
+                lastBitRate = targets.bitRate;
+            }
+        }
+        size_t second = (size_t)(now / PBJ_TEST_NSEC_PER_SEC);
+        if (second < 200) {
+            PBJRateGovernorGetTargets(governor, &targets);
+            result.bitRateAt[second] = governed ? targets.bitRate : configuration->maximumBitRate;
+            result.frameRateAt[second] = governed ? targets.frameRate : configuration->maximumFrameRate;
+        }
+    }
+
+    PBJRateGovernorTargets targets;
+    PBJRateGovernorGetTargets(governor, &targets);
+    result.decreases = targets.decreases;
+    result.increases = targets.increases;
+    PBJRateGovernorDestroy(governor);
+    return result;
+}
+
+#pragma mark - scripts
+
+// 8 ms to encode a frame and 4 MB/s to store it, comfortably ahead of 12 Mbps at 30 fps
+static PBJGovernorTestConditions PBJGovernorTestCalm(double seconds)
+{
+    return (PBJGovernorTestConditions){ 8.0, 4e6 };
+}
+
+// storage slows to 1 MB/s from 10 to 25 s, the encoder overheats to 45 ms a frame from 35 to 50 s
+static PBJGovernorTestConditions PBJGovernorTestSpikes(double seconds)
+{
+    PBJGovernorTestConditions conditions = PBJGovernorTestCalm(seconds);
+    if (seconds >= 10.0 && seconds < 25.0)
+        conditions.storageBytesPerSecond = 1e6;
+    if (seconds >= 35.0 && seconds < 50.0)
+        conditions.encodeMilliseconds = 45.0;
+    return conditions;
+}
+
+// storage that keeps up with a bit rate between two steps, for the whole run
+static PBJGovernorTestConditions PBJGovernorTestLimit(double seconds)
+{
+    return (PBJGovernorTestConditions){ 4.0, 1.2e6 };
+}
+
+#pragma mark - tests
+
+static void PBJRateGovernorTestLoadSpikes(void)
+{
+    PBJRateGovernorConfiguration configuration = PBJRateGovernorDefaultConfiguration(12e6, 30);
+    configuration.minimumFrameRate = 15;
+    PBJGovernorTestResult fixed = PBJGovernorTestSimulate(PBJGovernorTestSpikes, 80, 0, &configuration);
+    PBJGovernorTestResult governed = PBJGovernorTestSimulate(PBJGovernorTestSpikes, 80, 1, &configuration);
+
+    PBJTestCheck(fixed.dropped > 100);
+    PBJTestCheck(governed.dropped * 10 < fixed.dropped);
+    // untouched before the first spike
+    PBJTestCheck(governed.bitRateAt[9] == 12e6 && governed.frameRateAt[9] == 30);
+    // slow storage is met with the bit rate alone
+    PBJTestCheck(governed.bitRateAt[20] < 6.5e6 && governed.frameRateAt[20] == 30);
+    // a slow encoder costs frames whatever their size, the bit rate bottoms out and the frame rate follows
+    PBJTestCheck(governed.frameRateAt[45] < 30 && governed.frameRateAt[45] >= 15);
+    PBJTestCheck(governed.bitRateAt[45] == 3e6);
+    // back at the maximums once both have passed, without hunting on the way
+    PBJTestCheck(governed.bitRateAt[79] == 12e6 && governed.frameRateAt[79] == 30);
+    PBJTestCheck(governed.reversals <= 6);
+
+    // a load the writer keeps up with never moves the targets
+    PBJGovernorTestResult calm = PBJGovernorTestSimulate(PBJGovernorTestCalm, 60, 1, &configuration);
+    PBJTestCheck(calm.changes == 0 && calm.dropped == 0 && calm.admitted >= 60 * 30 - 1);
+}
+
+static void PBJRateGovernorTestBackoff(void)
+{
+    // no band between congested and clear, the limit can only be found by probing
+    PBJRateGovernorConfiguration configuration = PBJRateGovernorDefaultConfiguration(12e6, 30);
+    configuration.lowAppendLoad = configuration.highAppendLoad;
+    configuration.lowQueueFill = configuration.highQueueFill;
+    PBJGovernorTestResult backoff = PBJGovernorTestSimulate(PBJGovernorTestLimit, 120, 1, &configuration);
+    configuration.maximumIncreaseHold = configuration.increaseHold;
+    PBJGovernorTestResult fixedHold = PBJGovernorTestSimulate(PBJGovernorTestLimit, 120, 1, &configuration);
+
+    PBJTestCheck(backoff.increases > 0);
+    PBJTestCheck(backoff.increases * 3 <= fixedHold.increases);
+    PBJTestCheck(backoff.decreases * 3 <= fixedHold.decreases);
+    PBJTestCheck(backoff.dropped <= fixedHold.dropped);
+}
+
+static void PBJRateGovernorTestRules(void)
+{
+    PBJRateGovernorConfiguration configuration = PBJRateGovernorDefaultConfiguration(8e6, 30);
+    PBJRateGovernor *governor = PBJRateGovernorCreate(&configuration);
+    PBJTestCheck(governor != NULL);
+    PBJRateGovernorTargets targets;
+
+    int64_t time = 0;
+    PBJWriterLoad load = { time, 0, 8, 0, 0, 0, 0 };
+    PBJRateGovernorObserve(governor, &load);
+    // an encoder that turns appends away but keeps up is not congested
+    for (int i = 0; i < 40; i++) {
+        time += 50 * PBJ_GOVERNOR_TEST_MS;
+        load.time = time;
+        load.appendsDeferred += 3;
+        load.framesAppended += 1;
+        load.appendNanoseconds += 10 * PBJ_GOVERNOR_TEST_MS;
+        PBJTestCheck(!PBJRateGovernorObserve(governor, &load));
+    }
+    PBJRateGovernorGetTargets(governor, &targets);
+    PBJTestCheck(targets.bitRate == 8e6);
+
+    // drops cut to the floor and no further, the frame rate is fixed by default
+    for (int i = 0; i < 200; i++) {
+        time += 50 * PBJ_GOVERNOR_TEST_MS;
+        load.time = time;
+        load.framesDropped++;
+        PBJRateGovernorObserve(governor, &load);
+    }
+    PBJRateGovernorGetTargets(governor, &targets);
+    PBJTestCheck(targets.bitRate == 2e6 && targets.frameRate == 30);
+    PBJTestCheck(PBJRateGovernorAdmitFrame(governor, time));
+
+    // clear load climbs back a step a hold, eight 0.8 Mbps steps from 2 to 8 Mbps
+    int steps = 0;
+    for (int i = 0; i < 1000; i++) {
+        time += 50 * PBJ_GOVERNOR_TEST_MS;
+        load.time = time;
+        load.framesAppended += 1;
+        load.appendNanoseconds += PBJ_GOVERNOR_TEST_MS;
+        steps += PBJRateGovernorObserve(governor, &load);
+    }
+    PBJRateGovernorGetTargets(governor, &targets);
+    PBJTestCheck(targets.bitRate == 8e6 && steps == 8);
+
+    PBJRateGovernorReset(governor);
+    PBJRateGovernorGetTargets(governor, &targets);
+    PBJTestCheck(targets.bitRate == 8e6 && targets.decreases == 0 && targets.increaseHold == configuration.increaseHold);
+    PBJRateGovernorDestroy(governor);
+
+    PBJRateGovernorConfiguration invalid = configuration;
+    invalid.maximumBitRate = 0;
+    PBJTestCheck(PBJRateGovernorCreate(&invalid) == NULL);
+    PBJTestCheck(PBJRateGovernorCreate(NULL) == NULL);
+}
+
+// frames passed at a lowered frame rate arrive at that rate, whatever the capture jitter
+static void PBJRateGovernorTestAdmission(void)
+{
+    PBJRateGovernorConfiguration configuration = PBJRateGovernorDefaultConfiguration(8e6, 30);
+    configuration.minimumFrameRate = 10;
+    static const double frameRates[] = { 22.5, 16.875, 12.66, 10 };
+    for (size_t k = 0; k < sizeof(frameRates) / sizeof(frameRates[0]); k++) {
+        PBJRateGovernor *governor = PBJRateGovernorCreate(&configuration);
+        PBJTestCheck(governor != NULL);
+        int64_t time = 0;
+        PBJWriterLoad load = { 0, 0, 8, 0, 0, 0, 0 };
+        PBJRateGovernorObserve(governor, &load);
+        PBJRateGovernorTargets targets;
+        PBJRateGovernorGetTargets(governor, &targets);
+        while (targets.frameRate > frameRates[k] + 0.01) {
+            time += 600 * PBJ_GOVERNOR_TEST_MS;
+            load.time = time;
+            load.framesDropped++;
+            PBJRateGovernorObserve(governor, &load);
+            PBJRateGovernorGetTargets(governor, &targets);
+        }
+
+        PBJTestRandom random = PBJTestRandomMake(3 + k);
+        int admitted = 0;
+        for (int i = 0; i < 300; i++) {
+            int64_t frameTime = time + (int64_t)i * PBJ_TEST_NSEC_PER_SEC / 30 + PBJTestRandomBetween(&random, -2000000, 2000000);
+            admitted += PBJRateGovernorAdmitFrame(governor, frameTime);
+        }
+        PBJTestCheck(fabs((double)admitted - targets.frameRate * 10.0) <= 3.0);
+        PBJRateGovernorDestroy(governor);
+    }
+}
+
+int main(void)
+{
+    PBJRateGovernorTestRules();
+    PBJRateGovernorTestAdmission();
+    PBJRateGovernorTestLoadSpikes();
+    PBJRateGovernorTestBackoff();
+    return 0;
+}
@@ -0,0 +1,295 @@
+//
+//  PBJResamplerTests.c
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#include "PBJColorConversion.h"
+#include "PBJResampler.h"
+#include "PBJTestSupport.h"
+
+// golden images of the synthetic scene for each filter and a spread of geometries, plus the
+// properties every resample keeps: flat planes stay flat, the crop is never read outside of,
+// and vector, scalar and striped runs agree byte for byte
+
+static PBJTestFrame PBJResamplerTestRun(PBJCropRect crop, PBJResampleFilter filter, const PBJNV12Image *source,
+                                        size_t width, size_t height, PBJSIMDLevel level, size_t strips)
+{
+    PBJResampler *resampler = PBJResamplerCreate(crop, width, height, filter);
+    PBJTestCheck(resampler != NULL);
+    PBJTestFrame destination = PBJTestFrameCreate(width, height, source->range);
+    void *scratch = malloc(PBJResamplerScratchSize(resampler));
+    PBJTestCheck(scratch != NULL);
+
+    size_t count = PBJColorConversionStripCount(height, strips);
+    for (size_t strip = 0; strip < count; strip++) {
+        size_t begin, end;
+        PBJColorConversionStripRows(height, count, strip, &begin, &end);
+        PBJResamplerProcessRows(resampler, source, &destination.image, begin, end, scratch, level);
+    }
+
+    free(scratch);
+    PBJResamplerDestroy(resampler);
+    return destination;
+}
+
+static PBJCropRect PBJResamplerTestFullCrop(const PBJNV12Image *image)
+{
+    PBJCropRect crop = { 0, 0, image->width, image->height };
+    return crop;
+}
+
+#pragma mark - golden
+
+typedef struct {
+    PBJResampleFilter filter;
+    size_t sourceWidth;
+    size_t sourceHeight;
+    size_t aspectWidth; // 0 keeps the whole source
+    size_t aspectHeight;
+    size_t width;
+    size_t height;
+    uint64_t hash; // PBJTestImageHash of the result
+} PBJResamplerGolden;
+
+static const PBJResamplerGolden PBJResamplerGoldens[] = {
+    { PBJResampleFilterBox, 1920, 1080, 0, 0, 1280, 720, 0xdc121fa3144fd365ull },
+    { PBJResampleFilterBox, 1920, 1080, 1, 1, 640, 640, 0x18745e4689597189ull },
+    { PBJResampleFilterBox, 3840, 2160, 0, 0, 960, 540, 0x7f421046653b79e5ull },
+    { PBJResampleFilterBilinear, 1920, 1080, 0, 0, 1280, 720, 0x54275a879f5fff0bull },
+    { PBJResampleFilterBilinear, 1280, 720, 0, 0, 1920, 1080, 0xae7cdddff63abbdbull },
+    { PBJResampleFilterBilinear, 1920, 1080, 4, 3, 640, 480, 0x41de9f8bf90c924bull },
+    { PBJResampleFilterLanczos3, 1920, 1080, 0, 0, 1280, 720, 0xb409d7bd9ad9b106ull },
+    { PBJResampleFilterLanczos3, 640, 480, 0, 0, 1280, 960, 0x277aebf850bcdbd2ull },
+    { PBJResampleFilterLanczos3, 3840, 2160, 9, 16, 360, 640, 0x040cd9d304caacabull },
+    { PBJResampleFilterLanczos3, 1920, 1080, 0, 0, 1920, 1080, 0x8f652c5732c47925ull },
+};
+
+static const char *PBJResamplerTestFilterName(PBJResampleFilter filter)
+{
+    switch (filter) {
+        case PBJResampleFilterBilinear: return "PBJResampleFilterBilinear";
+        case PBJResampleFilterLanczos3: return "PBJResampleFilterLanczos3";
+        default: return "PBJResampleFilterBox";
+    }
+}
+
+static void PBJResamplerTestGolden(int print)
+{
+    int failed = 0;
+    for (size_t i = 0; i < sizeof(PBJResamplerGoldens) / sizeof(PBJResamplerGoldens[0]); i++) {
+        const PBJResamplerGolden *golden = &PBJResamplerGoldens[i];
+        PBJTestFrame source = PBJTestFrameCreate(golden->sourceWidth, golden->sourceHeight, PBJYCbCrRangeVideo);
+        PBJTestFrameFillScene(&source);
+        PBJCropRect crop = golden->aspectWidth ? PBJCropRectForAspectRatio(golden->sourceWidth, golden->sourceHeight, golden->aspectWidth, golden->aspectHeight)
+                                               : PBJResamplerTestFullCrop(&source.image);
+
+        PBJTestFrame result = PBJResamplerTestRun(crop, golden->filter, &source.image, golden->width, golden->height, PBJSIMDLevelScalar, 1);
+        uint64_t hash = PBJTestImageHash(&result.image);
+        if (print) {
+            printf("    { %s, %zu, %zu, %zu, %zu, %zu, %zu, 0x%016llxull },\n", PBJResamplerTestFilterName(golden->filter), golden->sourceWidth, golden->sourceHeight,
+                   golden->aspectWidth, golden->aspectHeight, golden->width, golden->height, (unsigned long long)hash);
+        } else if (hash != golden->hash) {
+            fprintf(stderr, "golden %zu differs: 0x%016llx\n", i, (unsigned long long)hash);
+            failed = 1;
+        }
+        PBJTestFrameDestroy(&result);
+        PBJTestFrameDestroy(&source);
+    }
+    PBJTestCheck(!failed);
+}
+
+#pragma mark - properties
+
+static void PBJResamplerTestFlat(void)
+{
+    static const size_t geometries[][4] = {
+        { 64, 48, 32, 24 }, { 64, 48, 128, 96 }, { 100, 60, 34, 18 }, { 38, 38, 200, 6 }, { 1920, 1080, 2, 2 }
+    };
+    for (int filter = PBJResampleFilterBox; filter <= PBJResampleFilterLanczos3; filter++) {
+        for (size_t g = 0; g < sizeof(geometries) / sizeof(geometries[0]); g++) {
+            PBJTestFrame source = PBJTestFrameCreate(geometries[g][0], geometries[g][1], PBJYCbCrRangeFull);
+            memset(source.image.luma, 77, source.image.lumaBytesPerRow * source.image.height);
+            for (size_t i = 0; i < source.image.chromaBytesPerRow * PBJNV12ChromaHeight(&source.image); i += 2) {
+                source.image.chroma[i] = 140;
+                source.image.chroma[i + 1] = 90;
+            }
+            PBJTestFrame result = PBJResamplerTestRun(PBJResamplerTestFullCrop(&source.image), (PBJResampleFilter)filter, &source.image,
+                                                      geometries[g][2], geometries[g][3], PBJSIMDLevelAuto, 1);
+            const PBJNV12Image *image = &result.image;
+            for (size_t y = 0; y < image->height; y++) {
+                for (size_t x = 0; x < image->width; x++)
+                    PBJTestCheck(image->luma[y * image->lumaBytesPerRow + x] == 77);
+            }
+            for (size_t y = 0; y < PBJNV12ChromaHeight(image); y++) {
+                for (size_t x = 0; x < PBJNV12ChromaWidth(image); x++) {
+                    PBJTestCheck(image->chroma[y * image->chromaBytesPerRow + 2 * x] == 140);
+                    PBJTestCheck(image->chroma[y * image->chromaBytesPerRow + 2 * x + 1] == 90);
+                }
+            }
+            PBJTestFrameDestroy(&result);
+            PBJTestFrameDestroy(&source);
+        }
+    }
+}
+
+// a 2:1 box is the rounded mean of each 2x2 block, the vertical pass rounds before the horizontal one
+static void PBJResamplerTestBoxHalf(void)
+{
+    PBJTestFrame source = PBJTestFrameCreate(96, 64, PBJYCbCrRangeFull);
+    PBJTestFrameFillNoise(&source, 21);
+    PBJTestFrame result = PBJResamplerTestRun(PBJResamplerTestFullCrop(&source.image), PBJResampleFilterBox, &source.image, 48, 32, PBJSIMDLevelAuto, 1);
+
+    const PBJNV12Image *in = &source.image;
+    for (size_t y = 0; y < 32; y++) {
+        for (size_t x = 0; x < 48; x++) {
+            const uint8_t *top = in->luma + 2 * y * in->lumaBytesPerRow + 2 * x;
+            const uint8_t *bottom = top + in->lumaBytesPerRow;
+            unsigned int left = (top[0] + bottom[0] + 1) >> 1;
+            unsigned int right = (top[1] + bottom[1] + 1) >> 1;
+            PBJTestCheck(result.image.luma[y * result.image.lumaBytesPerRow + x] == ((left + right + 1) >> 1));
+        }
+    }
+    for (size_t y = 0; y < 16; y++) {
+        for (size_t x = 0; x < 48; x++) {
+            const uint8_t *top = in->chroma + 2 * y * in->chromaBytesPerRow + (x & ~(size_t)1) * 2 + (x & 1);
+            const uint8_t *bottom = top + in->chromaBytesPerRow;
+            unsigned int left = (top[0] + bottom[0] + 1) >> 1;
+            unsigned int right = (top[2] + bottom[2] + 1) >> 1;
+            PBJTestCheck(result.image.chroma[y * result.image.chromaBytesPerRow + x] == ((left + right + 1) >> 1));
+        }
+    }
+    PBJTestFrameDestroy(&result);
+    PBJTestFrameDestroy(&source);
+}
+
+static void PBJResamplerTestIdentity(void)
+{
+    PBJTestFrame source = PBJTestFrameCreate(200, 120, PBJYCbCrRangeVideo);
+    PBJTestFrameFillNoise(&source, 8);
+    PBJCropRect crop = { 40, 20, 100, 64 };
+    for (int filter = PBJResampleFilterBox; filter <= PBJResampleFilterLanczos3; filter++) {
+        PBJTestFrame result = PBJResamplerTestRun(crop, (PBJResampleFilter)filter, &source.image, crop.width, crop.height, PBJSIMDLevelAuto, 1);
+        for (size_t y = 0; y < crop.height; y++) {
+            PBJTestCheck(memcmp(result.image.luma + y * result.image.lumaBytesPerRow,
+                                source.image.luma + (crop.y + y) * source.image.lumaBytesPerRow + crop.x, crop.width) == 0);
+        }
+        for (size_t y = 0; y < crop.height / 2; y++) {
+            PBJTestCheck(memcmp(result.image.chroma + y * result.image.chromaBytesPerRow,
+                                source.image.chroma + (crop.y / 2 + y) * source.image.chromaBytesPerRow + crop.x, crop.width) == 0);
+        }
+        PBJTestFrameDestroy(&result);
+    }
+    PBJTestFrameDestroy(&source);
+}
+
+// whatever lies outside the crop, black or white, the result is the same
+static void PBJResamplerTestCropBounds(void)
+{
+    PBJCropRect crop = { 30, 16, 132, 90 };
+    for (int filter = PBJResampleFilterBox; filter <= PBJResampleFilterLanczos3; filter++) {
+        uint64_t hashes[2];
+        for (int fill = 0; fill < 2; fill++) {
+            PBJTestFrame source = PBJTestFrameCreate(200, 130, PBJYCbCrRangeFull);
+            memset(source.storage, fill ? 0xff : 0x00, source.image.lumaBytesPerRow * source.image.height +
+                   source.image.chromaBytesPerRow * PBJNV12ChromaHeight(&source.image));
+            PBJTestFrame noise = PBJTestFrameCreate(crop.width, crop.height, PBJYCbCrRangeFull);
+            PBJTestFrameFillNoise(&noise, 99);
+            for (size_t y = 0; y < crop.height; y++) {
+                memcpy(source.image.luma + (crop.y + y) * source.image.lumaBytesPerRow + crop.x,
+                       noise.image.luma + y * noise.image.lumaBytesPerRow, crop.width);
+            }
+            for (size_t y = 0; y < crop.height / 2; y++) {
+                memcpy(source.image.chroma + (crop.y / 2 + y) * source.image.chromaBytesPerRow + crop.x,
+                       noise.image.chroma + y * noise.image.chromaBytesPerRow, crop.width);
+            }
+            PBJTestFrame result = PBJResamplerTestRun(crop, (PBJResampleFilter)filter, &source.image, 58, 40, PBJSIMDLevelAuto, 1);
+            hashes[fill] = PBJTestImageHash(&result.image);
+            PBJTestFrameDestroy(&result);
+            PBJTestFrameDestroy(&noise);
+            PBJTestFrameDestroy(&source);
+        }
+        PBJTestCheck(hashes[0] == hashes[1]);
+    }
+}
+
+static void PBJResamplerTestPathsAndStrips(void)
+{
+    static const size_t geometries[][4] = {
+        { 1920, 1080, 1280, 720 }, { 1280, 720, 1920, 1080 }, { 642, 362, 318, 180 }, { 3840, 2160, 640, 360 }, { 90, 70, 16, 12 }
+    };
+    for (int filter = PBJResampleFilterBox; filter <= PBJResampleFilterLanczos3; filter++) {
+        for (size_t g = 0; g < sizeof(geometries) / sizeof(geometries[0]); g++) {
+            PBJTestFrame source = PBJTestFrameCreate(geometries[g][0], geometries[g][1], PBJYCbCrRangeVideo);
+            PBJTestFrameFillNoise(&source, 1000 + g);
+            PBJCropRect crop = PBJResamplerTestFullCrop(&source.image);
+            PBJTestFrame reference = PBJResamplerTestRun(crop, (PBJResampleFilter)filter, &source.image, geometries[g][2], geometries[g][3], PBJSIMDLevelScalar, 1);
+            uint64_t expected = PBJTestImageHash(&reference.image);
+            PBJTestFrameDestroy(&reference);
+
+            static const PBJSIMDLevel levels[] = { PBJSIMDLevelAuto, PBJSIMDLevelSSE2, PBJSIMDLevelNEON };
+            for (size_t l = 0; l < sizeof(levels) / sizeof(levels[0]); l++) {
+                for (size_t strips = 1; strips <= 5; strips += 4) {
+                    PBJTestFrame result = PBJResamplerTestRun(crop, (PBJResampleFilter)filter, &source.image, geometries[g][2], geometries[g][3], levels[l], strips);
+                    PBJTestCheck(PBJTestImageHash(&result.image) == expected);
+                    PBJTestFrameDestroy(&result);
+                }
+            }
+            PBJTestFrameDestroy(&source);
+        }
+    }
+}
+
+static void PBJResamplerTestCropRect(void)
+{
+    PBJCropRect square = PBJCropRectForAspectRatio(1920, 1080, 1, 1);
+    PBJTestCheck(square.x == 420 && square.y == 0 && square.width == 1080 && square.height == 1080);
+    PBJCropRect portrait = PBJCropRectForAspectRatio(1920, 1080, 9, 16);
+    PBJTestCheck(portrait.width == 606 && portrait.height == 1080 && portrait.x == 656);
+    PBJCropRect wide = PBJCropRectForAspectRatio(1440, 1080, 16, 9);
+    PBJTestCheck(wide.width == 1440 && wide.height == 810 && wide.y == 134);
+    PBJCropRect odd = PBJCropRectForAspectRatio(1001, 777, 0, 0);
+    PBJTestCheck(odd.x == 0 && odd.y == 0 && odd.width == 1000 && odd.height == 776);
+
+    PBJCropRect unaligned = { 1, 0, 64, 64 };
+    PBJTestCheck(PBJResamplerCreate(unaligned, 32, 32, PBJResampleFilterBox) == NULL);
+    PBJCropRect crop = { 0, 0, 64, 64 };
+    PBJTestCheck(PBJResamplerCreate(crop, 31, 32, PBJResampleFilterBox) == NULL);
+    PBJTestCheck(PBJResamplerCreate(crop, 0, 32, PBJResampleFilterBox) == NULL);
+}
+
+// --print-golden regenerates the table after an intended change of output
+int main(int argc, char **argv)
+{
+    if (argc > 1 && strcmp(argv[1], "--print-golden") == 0) {
+        PBJResamplerTestGolden(1);
+        return 0;
+    }
+    PBJResamplerTestCropRect();
+    PBJResamplerTestFlat();
+    PBJResamplerTestBoxHalf();
+    PBJResamplerTestIdentity();
+    PBJResamplerTestCropBounds();
+    PBJResamplerTestPathsAndStrips();
+    PBJResamplerTestGolden(0);
+    return 0;
+}
@@ -0,0 +1,457 @@
+//
+//  PBJSampleInterleaverTests.c
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#include "PBJCapturePipeline.h"
+#include "PBJSampleInterleaver.h"
+#include "PBJTestSupport.h"
+
+// jittered 30 fps video on the host clock and 44.1 kHz audio on its own sample clock, each
+// track arriving late by its own latency, through the pipeline with and without interleaving.
+// interleaved, nothing may be written out of presentation order or lost to the timeline, audio
+// has to start on the first frame and run without holes, and a quiet or lagging track may hold
+// the other up no longer than the window. the synthetic capture source always delivers in
+// presentation order, so the streams are generated here
+
+#define PBJ_INTERLEAVER_TEST_MS (PBJ_TEST_NSEC_PER_SEC / 1000)
+#define PBJ_INTERLEAVER_TEST_AUDIO_TIMESCALE 44100LL
+#define PBJ_INTERLEAVER_TEST_AUDIO_FRAMES 1024LL
+#define PBJ_INTERLEAVER_TEST_ITEMS 4096
+#define PBJ_INTERLEAVER_TEST_WRITES 4096
+
+#pragma mark - streams
+
+typedef struct {
+    PBJCaptureSourceItemType type;
+    int start; // the recording's start, otherwise type applies
+    int64_t arrivalTime;
+    PBJCaptureSample sample;
+} PBJInterleaverTestItem;
+
+typedef struct {
+    int64_t latency[PBJCaptureTrackCount];
+    int64_t jitter[PBJCaptureTrackCount];
+    int64_t audioEnd; // after the stream's start, 0 for the whole stream
+    int pauseAndInterrupt;
+} PBJInterleaverTestStream;
+
+typedef struct {
+    PBJCaptureTrack track;
+    PBJTime presentationTimestamp;
+    PBJTime duration;
+    PBJTime rebased;
+} PBJInterleaverTestWrite;
+
+typedef struct {
+    PBJInterleaverTestWrite writes[PBJ_INTERLEAVER_TEST_WRITES];
+    size_t count;
+    int64_t livePayloads;
+} PBJInterleaverTestSink;
+
+typedef struct {
+    int references;
+} PBJInterleaverTestPayload;
+
+static PBJInterleaverTestItem PBJInterleaverTestItems[PBJ_INTERLEAVER_TEST_ITEMS];
+
+static int PBJInterleaverTestCompareItems(const void *a, const void *b)
+{
+    const PBJInterleaverTestItem *left = (const PBJInterleaverTestItem *)a;
+    const PBJInterleaverTestItem *right = (const PBJInterleaverTestItem *)b;
+    if (left->arrivalTime != right->arrivalTime)
+        return left->arrivalTime < right->arrivalTime ? -1 : 1;
+    // a sample delivered at the same moment as an event comes first
+    int leftOrder = left->type == PBJCaptureSourceItemSample && !left->start ? 0 : 1;
+    int rightOrder = right->type == PBJCaptureSourceItemSample && !right->start ? 0 : 1;
+    return leftOrder - rightOrder;
+}
+
+static size_t PBJInterleaverTestAddEvent(size_t count, PBJCaptureSourceItemType type, int start, int64_t arrivalTime)
+{
+    PBJInterleaverTestItem *item = &PBJInterleaverTestItems[count];
+    memset(item, 0, sizeof(*item));
+    item->type = type;
+    item->start = start;
+    item->arrivalTime = arrivalTime;
+    return count + 1;
+}
+
+// ten seconds of each track from an arbitrary host time, arrivals rise on each track as they do from
+// a capture output, the recording starts half a second in and stops after the last sample
+static size_t PBJInterleaverTestMakeStream(const PBJInterleaverTestStream *stream, uint64_t seed)
+{
+    PBJTestRandom random = PBJTestRandomMake(seed);
+    int64_t origin = 100000 * PBJ_TEST_NSEC_PER_SEC + 12345;
+    int64_t end = origin + 10 * PBJ_TEST_NSEC_PER_SEC;
+    int64_t audioEnd = stream->audioEnd ? origin + stream->audioEnd : end;
+    size_t count = 0;
+
+    int64_t latest = 0;
+    for (int64_t frame = 0;; frame++) {
+        int64_t time = origin + frame * PBJ_TEST_NSEC_PER_SEC / 30;
+        if (time >= end)
+            break;
+        int64_t arrival = time + stream->latency[PBJCaptureTrackVideo] + PBJTestRandomBetween(&random, 0, stream->jitter[PBJCaptureTrackVideo]);
+        latest = arrival > latest ? arrival : latest;
+        PBJInterleaverTestItem *item = &PBJInterleaverTestItems[count++];
+        item->type = PBJCaptureSourceItemSample;
+        item->start = 0;
+        item->arrivalTime = latest;
+        item->sample.track = PBJCaptureTrackVideo;
+        item->sample.presentationTimestamp = PBJTimeMake(time, PBJ_TEST_NSEC_PER_SEC);
+        item->sample.duration = PBJTimeMake(0, 0);
+    }
+
+    // audio's clock is offset from the host's so no buffer lines up with a frame
+    latest = 0;
+    int64_t first = origin / PBJ_TEST_NSEC_PER_SEC * PBJ_INTERLEAVER_TEST_AUDIO_TIMESCALE + 777;
+    for (int64_t buffer = 0;; buffer++) {
+        int64_t value = first + buffer * PBJ_INTERLEAVER_TEST_AUDIO_FRAMES;
+        int64_t time = PBJTimeGetNanoseconds(PBJTimeMake(value, PBJ_INTERLEAVER_TEST_AUDIO_TIMESCALE));
+        if (time >= end || time >= audioEnd)
+            break;
+        // a buffer is delivered once its last frame has been captured
+        int64_t arrival = time + PBJ_INTERLEAVER_TEST_AUDIO_FRAMES * PBJ_TEST_NSEC_PER_SEC / PBJ_INTERLEAVER_TEST_AUDIO_TIMESCALE +
+                          stream->latency[PBJCaptureTrackAudio] + PBJTestRandomBetween(&random, 0, stream->jitter[PBJCaptureTrackAudio]);
+        latest = arrival > latest ? arrival : latest;
+        PBJInterleaverTestItem *item = &PBJInterleaverTestItems[count++];
+        item->type = PBJCaptureSourceItemSample;
+        item->start = 0;
+        item->arrivalTime = latest;
+        item->sample.track = PBJCaptureTrackAudio;
+        item->sample.presentationTimestamp = PBJTimeMake(value, PBJ_INTERLEAVER_TEST_AUDIO_TIMESCALE);
+        item->sample.duration = PBJTimeMake(PBJ_INTERLEAVER_TEST_AUDIO_FRAMES, PBJ_INTERLEAVER_TEST_AUDIO_TIMESCALE);
+    }
+
+    count = PBJInterleaverTestAddEvent(count, PBJCaptureSourceItemSample, 1, origin + PBJ_TEST_NSEC_PER_SEC / 2);
+    if (stream->pauseAndInterrupt) {
+        count = PBJInterleaverTestAddEvent(count, PBJCaptureSourceItemPause, 0, origin + 4 * PBJ_TEST_NSEC_PER_SEC);
+        count = PBJInterleaverTestAddEvent(count, PBJCaptureSourceItemResume, 0, origin + 5 * PBJ_TEST_NSEC_PER_SEC);
+        // capture stops for half a second, the notification comes after what was in flight
+        size_t kept = 0;
+        for (size_t i = 0; i < count; i++) {
+            int64_t time = PBJTimeGetNanoseconds(PBJInterleaverTestItems[i].sample.presentationTimestamp);
+            if (PBJInterleaverTestItems[i].type == PBJCaptureSourceItemSample && !PBJInterleaverTestItems[i].start &&
+                time >= origin + 6900 * PBJ_INTERLEAVER_TEST_MS && time < origin + 7400 * PBJ_INTERLEAVER_TEST_MS)
+                continue;
+            PBJInterleaverTestItems[kept++] = PBJInterleaverTestItems[i];
+        }
+        count = PBJInterleaverTestAddEvent(kept, PBJCaptureSourceItemInterrupt, 0, origin + 7100 * PBJ_INTERLEAVER_TEST_MS);
+    }
+    count = PBJInterleaverTestAddEvent(count, PBJCaptureSourceItemEnd, 0, end + PBJ_TEST_NSEC_PER_SEC / 2);
+
+    qsort(PBJInterleaverTestItems, count, sizeof(PBJInterleaverTestItem), PBJInterleaverTestCompareItems);
+    return count;
+}
+
+#pragma mark - sink
+
+static int PBJInterleaverTestSetupTrack(void *context, const PBJCaptureSample *sample)
+{
+    return 1;
+}
+
+static int PBJInterleaverTestWriteSample(void *context, const PBJCaptureSample *sample, PBJTime rebasedPresentationTimestamp)
+{
+    PBJInterleaverTestSink *sink = (PBJInterleaverTestSink *)context;
+    PBJTestCheck(sink->count < PBJ_INTERLEAVER_TEST_WRITES);
+    // the payload has to be alive whenever it's written
+    PBJTestCheck(((PBJInterleaverTestPayload *)sample->payload)->references > 0);
+    PBJInterleaverTestWrite *write = &sink->writes[sink->count++];
+    write->track = sample->track;
+    write->presentationTimestamp = sample->presentationTimestamp;
+    write->duration = sample->duration;
+    write->rebased = rebasedPresentationTimestamp;
+    return 1;
+}
+
+static void PBJInterleaverTestRetainPayload(void *context, void *payload)
+{
+    ((PBJInterleaverTestPayload *)payload)->references++;
+}
+
+static void PBJInterleaverTestReleasePayload(void *context, void *payload)
+{
+    PBJInterleaverTestPayload *testPayload = (PBJInterleaverTestPayload *)payload;
+    if (--testPayload->references == 0) {
+        ((PBJInterleaverTestSink *)context)->livePayloads--;
+        free(testPayload);
+    }
+}
+
+#pragma mark - runs
+
+typedef struct {
+    size_t written;
+    int outOfOrder; // writes whose rebased time is behind one already written
+    int64_t audioStartGap; // nanoseconds from the first frame to the first audio written
+    int64_t audioHoles; // nanoseconds of the audio span not covered by its buffers
+    uint64_t timelineDrops;
+    PBJSampleInterleaverStatistics statistics;
+} PBJInterleaverTestReport;
+
+static PBJInterleaverTestReport PBJInterleaverTestRun(const PBJInterleaverTestStream *stream, int interleave)
+{
+    static PBJInterleaverTestSink sink;
+    memset(&sink, 0, sizeof(sink));
+    PBJCapturePipelineSink callbacks = {
+        &sink, PBJInterleaverTestSetupTrack, PBJInterleaverTestWriteSample, NULL,
+        interleave ? PBJInterleaverTestRetainPayload : NULL, interleave ? PBJInterleaverTestReleasePayload : NULL
+    };
+    PBJCapturePipeline *pipeline = PBJCapturePipelineCreate(callbacks);
+    PBJTestCheck(pipeline != NULL);
+
+    size_t count = PBJInterleaverTestMakeStream(stream, 777);
+    for (size_t i = 0; i < count; i++) {
+        PBJInterleaverTestItem *item = &PBJInterleaverTestItems[i];
+        if (item->start) {
+            PBJTestCheck(PBJCapturePipelineStart(pipeline));
+        } else if (item->type == PBJCaptureSourceItemSample) {
+            // the source lets go of its reference once the sample is handed over, as a capture output does
+            PBJInterleaverTestPayload *payload = (PBJInterleaverTestPayload *)calloc(1, sizeof(PBJInterleaverTestPayload));
+            PBJTestCheck(payload != NULL);
+            payload->references = 1;
+            sink.livePayloads++;
+            PBJCaptureSample sample = item->sample;
+            sample.payload = payload;
+            PBJCapturePipelineProcessSample(pipeline, &sample);
+            PBJInterleaverTestReleasePayload(&sink, payload);
+        } else {
+            PBJCaptureSourceItem event;
+            memset(&event, 0, sizeof(event));
+            event.type = item->type;
+            event.arrivalTime = item->arrivalTime;
+            PBJCapturePipelineProcessSourceItem(pipeline, &event, NULL);
+        }
+    }
+
+    PBJInterleaverTestReport report;
+    memset(&report, 0, sizeof(report));
+    report.written = sink.count;
+    PBJTestCheck(sink.count > 0 && sink.writes[0].track == PBJCaptureTrackVideo);
+    int64_t latest = INT64_MIN;
+    int64_t firstAudio = -1;
+    int64_t audioEnd = 0;
+    int64_t audioCovered = 0;
+    for (size_t i = 0; i < sink.count; i++) {
+        const PBJInterleaverTestWrite *write = &sink.writes[i];
+        int64_t rebased = PBJTimeGetNanoseconds(write->rebased);
+        if (rebased < latest)
+            report.outOfOrder++;
+        latest = rebased > latest ? rebased : latest;
+        if (write->track == PBJCaptureTrackAudio) {
+            int64_t time = PBJTimeGetNanoseconds(write->presentationTimestamp);
+            if (firstAudio < 0) {
+                firstAudio = time;
+                report.audioStartGap = time - PBJTimeGetNanoseconds(sink.writes[0].presentationTimestamp);
+            }
+            audioCovered += PBJTimeGetNanoseconds(write->duration);
+            audioEnd = time + PBJTimeGetNanoseconds(write->duration);
+        }
+    }
+    if (firstAudio >= 0)
+        report.audioHoles = audioEnd - firstAudio - audioCovered;
+    for (int track = 0; track < PBJCaptureTrackCount; track++)
+        report.timelineDrops += PBJCapturePipelineGetSampleCount(pipeline, (PBJCaptureTrack)track, PBJCapturePipelineSampleDroppedTimeline);
+    if (interleave)
+        report.statistics = PBJSampleInterleaverGetStatistics(PBJCapturePipelineGetInterleaver(pipeline));
+
+    PBJCapturePipelineDestroy(pipeline);
+    // every payload the interleaver held has been let go
+    PBJTestCheck(sink.livePayloads == 0);
+    return report;
+}
+
+#pragma mark - tests
+
+static void PBJInterleaverTestAudioLate(void)
+{
+    PBJInterleaverTestStream stream = { { 10 * PBJ_INTERLEAVER_TEST_MS, 40 * PBJ_INTERLEAVER_TEST_MS },
+                                        { 15 * PBJ_INTERLEAVER_TEST_MS, 10 * PBJ_INTERLEAVER_TEST_MS }, 0, 0 };
+    PBJInterleaverTestReport legacy = PBJInterleaverTestRun(&stream, 0);
+    PBJInterleaverTestReport interleaved = PBJInterleaverTestRun(&stream, 1);
+
+    PBJTestCheck(legacy.outOfOrder > 100);
+    PBJTestCheck(interleaved.outOfOrder == 0 && interleaved.timelineDrops == 0);
+    // cut onto the first frame, to within a tick of the audio clock
+    PBJTestCheck(interleaved.audioStartGap >= 0 && interleaved.audioStartGap <= PBJ_TEST_NSEC_PER_SEC / PBJ_INTERLEAVER_TEST_AUDIO_TIMESCALE);
+    PBJTestCheck(legacy.audioStartGap > interleaved.audioStartGap);
+    PBJTestCheck(interleaved.audioHoles <= 1000);
+    PBJTestCheck(interleaved.statistics.audioTrimmed == 1 && interleaved.statistics.forced == 0);
+    PBJTestCheck(interleaved.statistics.maximumReleaseSkew <= 34 * PBJ_INTERLEAVER_TEST_MS);
+    PBJTestCheck(interleaved.statistics.maximumArrivalSkew > interleaved.statistics.maximumReleaseSkew);
+}
+
+static void PBJInterleaverTestVideoLate(void)
+{
+    // audio for the first frames arrives before the recording starts, there's nothing to hold
+    PBJInterleaverTestStream stream = { { 60 * PBJ_INTERLEAVER_TEST_MS, 5 * PBJ_INTERLEAVER_TEST_MS },
+                                        { 20 * PBJ_INTERLEAVER_TEST_MS, 5 * PBJ_INTERLEAVER_TEST_MS }, 0, 0 };
+    PBJInterleaverTestReport legacy = PBJInterleaverTestRun(&stream, 0);
+    PBJInterleaverTestReport interleaved = PBJInterleaverTestRun(&stream, 1);
+
+    PBJTestCheck(interleaved.outOfOrder == 0 && interleaved.timelineDrops == 0);
+    PBJTestCheck(interleaved.audioStartGap <= legacy.audioStartGap);
+    PBJTestCheck(interleaved.statistics.forced == 0);
+}
+
+static void PBJInterleaverTestPauseAndInterrupt(void)
+{
+    PBJInterleaverTestStream stream = { { 10 * PBJ_INTERLEAVER_TEST_MS, 40 * PBJ_INTERLEAVER_TEST_MS },
+                                        { 15 * PBJ_INTERLEAVER_TEST_MS, 10 * PBJ_INTERLEAVER_TEST_MS }, 0, 1 };
+    PBJInterleaverTestReport legacy = PBJInterleaverTestRun(&stream, 0);
+    PBJInterleaverTestReport interleaved = PBJInterleaverTestRun(&stream, 1);
+
+    PBJTestCheck(interleaved.outOfOrder == 0 && interleaved.timelineDrops == 0);
+    // what's held is written before the pause rather than lost to it
+    PBJTestCheck(interleaved.written >= legacy.written);
+}
+
+static void PBJInterleaverTestQuietAudio(void)
+{
+    // the microphone stops after three seconds, video only waits out the window
+    PBJInterleaverTestStream stream = { { 10 * PBJ_INTERLEAVER_TEST_MS, 40 * PBJ_INTERLEAVER_TEST_MS },
+                                        { 15 * PBJ_INTERLEAVER_TEST_MS, 10 * PBJ_INTERLEAVER_TEST_MS }, 3 * PBJ_TEST_NSEC_PER_SEC, 0 };
+    PBJInterleaverTestReport interleaved = PBJInterleaverTestRun(&stream, 1);
+    PBJTestCheck(interleaved.outOfOrder == 0);
+    PBJTestCheck(interleaved.statistics.forced > 0);
+    PBJTestCheck(interleaved.statistics.maximumDelay <= 134 * PBJ_INTERLEAVER_TEST_MS);
+
+    // audio lagging beyond the window is forced out, no track holds more than its capacity
+    PBJInterleaverTestStream lagging = { { 10 * PBJ_INTERLEAVER_TEST_MS, 250 * PBJ_INTERLEAVER_TEST_MS },
+                                         { 5 * PBJ_INTERLEAVER_TEST_MS, 5 * PBJ_INTERLEAVER_TEST_MS }, 0, 0 };
+    interleaved = PBJInterleaverTestRun(&lagging, 1);
+    PBJTestCheck(interleaved.statistics.forced > 0);
+    PBJTestCheck(interleaved.statistics.maximumHeld <= 4 + 16 + 1);
+}
+
+// the interleaver on its own, the start and a straddling buffer
+static void PBJInterleaverTestStart(void)
+{
+    PBJSampleInterleaverConfiguration configuration = PBJSampleInterleaverDefaultConfiguration();
+    PBJSampleInterleaver *interleaver = PBJSampleInterleaverCreate(&configuration);
+    PBJTestCheck(interleaver != NULL);
+
+    // three buffers ahead of the first frame, the middle one straddles it
+    PBJCaptureSample sample;
+    memset(&sample, 0, sizeof(sample));
+    sample.track = PBJCaptureTrackAudio;
+    sample.duration = PBJTimeMake(PBJ_INTERLEAVER_TEST_AUDIO_FRAMES, PBJ_INTERLEAVER_TEST_AUDIO_TIMESCALE);
+    for (int64_t buffer = 0; buffer < 3; buffer++) {
+        sample.presentationTimestamp = PBJTimeMake(44100 + buffer * PBJ_INTERLEAVER_TEST_AUDIO_FRAMES, PBJ_INTERLEAVER_TEST_AUDIO_TIMESCALE);
+        PBJTestCheck(PBJSampleInterleaverPush(interleaver, &sample));
+    }
+    PBJTestCheck(!PBJSampleInterleaverHasVideoStart(interleaver));
+    PBJTestCheck(PBJSampleInterleaverNext(interleaver, 0, &sample) == PBJSampleInterleaverOutputNone);
+
+    // the frame lands 1500 audio frames in, the first buffer is dropped, the second is cut
+    PBJCaptureSample frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.track = PBJCaptureTrackVideo;
+    frame.presentationTimestamp = PBJTimeMake(PBJ_TEST_NSEC_PER_SEC + 1500 * PBJ_TEST_NSEC_PER_SEC / 44100, PBJ_TEST_NSEC_PER_SEC);
+    frame.duration = PBJTimeMake(0, 0);
+    PBJTestCheck(PBJSampleInterleaverPush(interleaver, &frame));
+    PBJTestCheck(PBJSampleInterleaverHasVideoStart(interleaver));
+
+    PBJTestCheck(PBJSampleInterleaverNext(interleaver, 0, &sample) == PBJSampleInterleaverOutputDrop);
+    PBJTestCheck(sample.track == PBJCaptureTrackAudio && sample.presentationTimestamp.value == 44100);
+    PBJTestCheck(PBJSampleInterleaverNext(interleaver, 0, &sample) == PBJSampleInterleaverOutputRelease);
+    PBJTestCheck(sample.track == PBJCaptureTrackVideo);
+    // the cut buffer starts after the frame, it waits on the next one
+    PBJTestCheck(PBJSampleInterleaverNext(interleaver, 0, &sample) == PBJSampleInterleaverOutputNone);
+    frame.presentationTimestamp.value += PBJ_TEST_NSEC_PER_SEC / 30;
+    PBJTestCheck(PBJSampleInterleaverPush(interleaver, &frame));
+    PBJTestCheck(PBJSampleInterleaverNext(interleaver, 0, &sample) == PBJSampleInterleaverOutputRelease);
+    // moved up to the first tick at or after the frame, the end stays where it was
+    PBJTestCheck(sample.track == PBJCaptureTrackAudio);
+    PBJTestCheck(sample.presentationTimestamp.value == 44100 + 1500 && sample.presentationTimestamp.timescale == 44100);
+    PBJTestCheck(sample.duration.value == 2 * PBJ_INTERLEAVER_TEST_AUDIO_FRAMES - 1500 && sample.duration.timescale == 44100);
+
+    // the last buffer is ahead of the second frame and runs past it, so the frame follows without waiting
+    PBJTestCheck(PBJSampleInterleaverNext(interleaver, 0, &sample) == PBJSampleInterleaverOutputRelease);
+    PBJTestCheck(sample.track == PBJCaptureTrackAudio && sample.presentationTimestamp.value == 44100 + 2 * PBJ_INTERLEAVER_TEST_AUDIO_FRAMES);
+    PBJTestCheck(PBJSampleInterleaverNext(interleaver, 0, &sample) == PBJSampleInterleaverOutputRelease);
+    PBJTestCheck(sample.track == PBJCaptureTrackVideo);
+    PBJTestCheck(PBJSampleInterleaverNext(interleaver, 1, &sample) == PBJSampleInterleaverOutputNone);
+    PBJTestCheck(PBJSampleInterleaverGetCount(interleaver) == 0);
+
+    PBJSampleInterleaverStatistics statistics = PBJSampleInterleaverGetStatistics(interleaver);
+    PBJTestCheck(statistics.audioHeld == 3 && statistics.audioTrimmed == 1 && statistics.audioDropped == 1);
+    PBJTestCheck(statistics.released[PBJCaptureTrackVideo] == 2 && statistics.released[PBJCaptureTrackAudio] == 2);
+
+    PBJSampleInterleaverReset(interleaver);
+    PBJTestCheck(!PBJSampleInterleaverHasVideoStart(interleaver));
+    PBJTestCheck(PBJSampleInterleaverGetStatistics(interleaver).audioHeld == 0);
+    PBJSampleInterleaverDestroy(interleaver);
+}
+
+// a full track turns samples away, a disabled one is never waited on
+static void PBJInterleaverTestCapacity(void)
+{
+    PBJSampleInterleaverConfiguration configuration = PBJSampleInterleaverDefaultConfiguration();
+    PBJSampleInterleaver *interleaver = PBJSampleInterleaverCreate(&configuration);
+    PBJTestCheck(interleaver != NULL);
+
+    PBJCaptureSample sample;
+    memset(&sample, 0, sizeof(sample));
+    sample.track = PBJCaptureTrackVideo;
+    sample.duration = PBJTimeMake(0, 0);
+    for (int64_t frame = 0; frame < 4; frame++) {
+        sample.presentationTimestamp = PBJTimeMake(frame, 600);
+        PBJTestCheck(PBJSampleInterleaverPush(interleaver, &sample));
+    }
+    // video holds back for audio within the window
+    PBJTestCheck(PBJSampleInterleaverNext(interleaver, 0, &sample) == PBJSampleInterleaverOutputNone);
+
+    // one past the capacity is taken and forces the head out, the next is turned away
+    sample.presentationTimestamp = PBJTimeMake(4, 600);
+    PBJTestCheck(PBJSampleInterleaverPush(interleaver, &sample));
+    sample.presentationTimestamp = PBJTimeMake(5, 600);
+    PBJTestCheck(!PBJSampleInterleaverPush(interleaver, &sample));
+    PBJTestCheck(PBJSampleInterleaverNext(interleaver, 0, &sample) == PBJSampleInterleaverOutputRelease);
+    PBJTestCheck(sample.presentationTimestamp.value == 0);
+    PBJTestCheck(PBJSampleInterleaverNext(interleaver, 0, &sample) == PBJSampleInterleaverOutputNone);
+    PBJTestCheck(PBJSampleInterleaverGetStatistics(interleaver).forced == 1);
+    while (PBJSampleInterleaverNext(interleaver, 1, &sample) != PBJSampleInterleaverOutputNone) {
+    }
+    PBJTestCheck(PBJSampleInterleaverGetCount(interleaver) == 0);
+
+    PBJSampleInterleaverSetTrackEnabled(interleaver, PBJCaptureTrackAudio, 0);
+    sample.presentationTimestamp = PBJTimeMake(6, 600);
+    PBJTestCheck(PBJSampleInterleaverPush(interleaver, &sample));
+    PBJTestCheck(PBJSampleInterleaverNext(interleaver, 0, &sample) == PBJSampleInterleaverOutputRelease);
+    PBJTestCheck(sample.presentationTimestamp.value == 6);
+    PBJSampleInterleaverDestroy(interleaver);
+}
+
+int main(void)
+{
+    PBJInterleaverTestStart();
+    PBJInterleaverTestCapacity();
+    PBJInterleaverTestAudioLate();
+    PBJInterleaverTestVideoLate();
+    PBJInterleaverTestPauseAndInterrupt();
+    PBJInterleaverTestQuietAudio();
+    return 0;
+}
@@ -0,0 +1,186 @@
+//
+//  PBJSampleRingTests.c
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#include "PBJSampleRing.h"
+#include "PBJTestSupport.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+
+// a producer and a consumer thread racing over small rings, items are sequence numbers so
+// every one can be accounted for: popped in order by the consumer or handed back to the
+// producer as dropped, never both and never lost
+
+typedef struct {
+    PBJSampleRing *ring;
+    PBJSampleRingOverflow overflow;
+    uintptr_t items;
+    uint64_t seed;
+
+    uint8_t *owned; // per item, 1 popped, 2 dropped
+    atomic_int producerDone;
+    uintptr_t dropped;
+    uintptr_t popped;
+} PBJSampleRingTestRun;
+
+static void PBJSampleRingTestClaim(PBJSampleRingTestRun *run, uintptr_t item, uint8_t side)
+{
+    PBJTestCheck(item >= 1 && item <= run->items);
+    // each side only ever writes its own items, a second claim of any kind is a double ownership
+    PBJTestCheck(run->owned[item] == 0);
+    run->owned[item] = side;
+}
+
+static void *PBJSampleRingTestProducer(void *context)
+{
+    PBJSampleRingTestRun *run = (PBJSampleRingTestRun *)context;
+    PBJTestRandom random = PBJTestRandomMake(run->seed);
+    for (uintptr_t item = 1; item <= run->items; item++) {
+        void *dropped = NULL;
+        int enqueued = PBJSampleRingPush(run->ring, (void *)item, run->overflow, &dropped);
+        if (run->overflow == PBJSampleRingOverflowDropNewest)
+            PBJTestCheck(enqueued ? dropped == NULL : dropped == (void *)item);
+        else
+            PBJTestCheck(enqueued);
+        if (dropped) {
+            PBJSampleRingTestClaim(run, (uintptr_t)dropped, 2);
+            run->dropped++;
+        }
+        if (PBJTestRandomBelow(&random, 64) == 0)
+            sched_yield();
+    }
+    atomic_store_explicit(&run->producerDone, 1, memory_order_release);
+    return NULL;
+}
+
+static void *PBJSampleRingTestConsumer(void *context)
+{
+    PBJSampleRingTestRun *run = (PBJSampleRingTestRun *)context;
+    PBJTestRandom random = PBJTestRandomMake(run->seed * 31 + 7);
+    uintptr_t last = 0;
+    for (;;) {
+        int done = atomic_load_explicit(&run->producerDone, memory_order_acquire);
+        void *item = PBJSampleRingPop(run->ring);
+        if (!item) {
+            if (done)
+                break;
+            sched_yield();
+            continue;
+        }
+        // drops only ever remove the oldest or the newest, what is popped stays in order
+        PBJTestCheck((uintptr_t)item > last);
+        last = (uintptr_t)item;
+        PBJSampleRingTestClaim(run, (uintptr_t)item, 1);
+        run->popped++;
+        // a slow consumer now and then, so the ring fills and the producer evicts
+        if (PBJTestRandomBelow(&random, 16) == 0)
+            sched_yield();
+    }
+    return NULL;
+}
+
+static void PBJSampleRingTestStress(size_t capacity, PBJSampleRingOverflow overflow, uintptr_t items, uint64_t seed)
+{
+    PBJSampleRingTestRun run;
+    memset(&run, 0, sizeof(run));
+    run.ring = PBJSampleRingCreate(capacity);
+    PBJTestCheck(run.ring != NULL);
+    run.overflow = overflow;
+    run.items = items;
+    run.seed = seed;
+    run.owned = (uint8_t *)calloc(items + 1, 1);
+    PBJTestCheck(run.owned != NULL);
+    atomic_init(&run.producerDone, 0);
+
+    pthread_t producer, consumer;
+    PBJTestCheck(pthread_create(&consumer, NULL, PBJSampleRingTestConsumer, &run) == 0);
+    PBJTestCheck(pthread_create(&producer, NULL, PBJSampleRingTestProducer, &run) == 0);
+    pthread_join(producer, NULL);
+    pthread_join(consumer, NULL);
+
+    PBJTestCheck(PBJSampleRingPop(run.ring) == NULL);
+    PBJTestCheck(run.popped + run.dropped == items);
+    for (uintptr_t item = 1; item <= items; item++)
+        PBJTestCheck(run.owned[item] != 0);
+
+    PBJSampleRingCounters counters = PBJSampleRingGetCounters(run.ring);
+    PBJTestCheck(counters.dequeued == run.popped);
+    PBJTestCheck(counters.dropped == run.dropped);
+    if (overflow == PBJSampleRingOverflowDropOldest)
+        PBJTestCheck(counters.enqueued == items);
+    else
+        PBJTestCheck(counters.enqueued == items - run.dropped);
+    PBJTestCheck(PBJSampleRingCount(run.ring) == 0);
+
+    free(run.owned);
+    PBJSampleRingDestroy(run.ring);
+}
+
+static void PBJSampleRingTestSingleThreaded(void)
+{
+    PBJSampleRing *ring = PBJSampleRingCreate(4);
+    PBJTestCheck(ring != NULL);
+    PBJTestCheck(PBJSampleRingCapacity(ring) >= 4);
+    size_t capacity = PBJSampleRingCapacity(ring);
+    PBJTestCheck(PBJSampleRingPop(ring) == NULL);
+
+    void *dropped = (void *)1;
+    for (uintptr_t item = 1; item <= capacity; item++) {
+        PBJTestCheck(PBJSampleRingPush(ring, (void *)item, PBJSampleRingOverflowDropNewest, &dropped));
+        PBJTestCheck(dropped == NULL);
+    }
+    PBJTestCheck(PBJSampleRingCount(ring) == capacity);
+
+    // full, newest is refused
+    PBJTestCheck(!PBJSampleRingPush(ring, (void *)100, PBJSampleRingOverflowDropNewest, &dropped));
+    PBJTestCheck(dropped == (void *)100);
+    // full, oldest is evicted
+    PBJTestCheck(PBJSampleRingPush(ring, (void *)101, PBJSampleRingOverflowDropOldest, &dropped));
+    PBJTestCheck(dropped == (void *)1);
+
+    for (uintptr_t item = 2; item <= capacity; item++)
+        PBJTestCheck(PBJSampleRingPop(ring) == (void *)item);
+    PBJTestCheck(PBJSampleRingPop(ring) == (void *)101);
+    PBJTestCheck(PBJSampleRingPop(ring) == NULL);
+
+    PBJSampleRingCountDropped(ring);
+    PBJSampleRingCounters counters = PBJSampleRingGetCounters(ring);
+    PBJTestCheck(counters.enqueued == capacity + 1);
+    PBJTestCheck(counters.dequeued == capacity);
+    PBJTestCheck(counters.dropped == 3);
+    PBJSampleRingDestroy(ring);
+}
+
+int main(void)
+{
+    PBJSampleRingTestSingleThreaded();
+    static const size_t capacities[] = { 1, 2, 3, 8, 64 };
+    for (size_t i = 0; i < sizeof(capacities) / sizeof(capacities[0]); i++) {
+        PBJSampleRingTestStress(capacities[i], PBJSampleRingOverflowDropOldest, 200000, 1 + i);
+        PBJSampleRingTestStress(capacities[i], PBJSampleRingOverflowDropNewest, 200000, 11 + i);
+    }
+    return 0;
+}
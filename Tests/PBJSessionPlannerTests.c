@@ -0,0 +1,238 @@
+//
+//  PBJSessionPlannerTests.c
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#include "PBJSessionPlanner.h"
+#include "PBJTestSupport.h"
+
+// every pair of configurations in a space covering each camera, output and connection setting
+// is planned and the plan replayed: it has to reach the desired configuration, in execution
+// order, with nothing it could do without, and replanning from where it ends has to be empty
+
+static const PBJSessionCamera PBJSessionPlannerTestCameras[] = { PBJSessionCameraNone, PBJSessionCameraBack, PBJSessionCameraFront };
+static const int PBJSessionPlannerTestOrientations[] = { PBJSessionConnectionUnknown, 1, 3 };
+static const int PBJSessionPlannerTestMirrorings[] = { PBJSessionConnectionUnknown, 0, 1 };
+
+#define PBJ_SESSION_PLANNER_TEST_SPACE (3 * 2 * 2 * 2 * 2 * 2 * 3 * 3)
+
+static PBJSessionConfiguration PBJSessionPlannerTestConfiguration(size_t index)
+{
+    PBJSessionConfiguration configuration = PBJSessionConfigurationMakeEmpty();
+    configuration.camera = PBJSessionPlannerTestCameras[index % 3];
+    index /= 3;
+    configuration.videoOutput = (int)(index % 2);
+    index /= 2;
+    configuration.photoOutput = (int)(index % 2);
+    index /= 2;
+    configuration.audioInput = (int)(index % 2);
+    index /= 2;
+    configuration.audioOutput = (int)(index % 2);
+    index /= 2;
+    configuration.preset = (uint32_t)(index % 2) + 7;
+    index /= 2;
+    configuration.videoOrientation = PBJSessionPlannerTestOrientations[index % 3];
+    index /= 3;
+    configuration.mirrored = PBJSessionPlannerTestMirrorings[index % 3];
+    return configuration;
+}
+
+static int PBJSessionPlannerTestHasVideoConnection(const PBJSessionConfiguration *configuration)
+{
+    return configuration->camera != PBJSessionCameraNone && configuration->videoOutput;
+}
+
+static int PBJSessionPlannerTestHasPrimaryConnection(const PBJSessionConfiguration *configuration)
+{
+    return configuration->camera != PBJSessionCameraNone && (configuration->videoOutput || configuration->photoOutput);
+}
+
+// the session has what was asked for, a connection setting left unknown in desired is free
+static int PBJSessionPlannerTestReached(const PBJSessionConfiguration *state, const PBJSessionConfiguration *desired)
+{
+    if (state->camera != desired->camera || !state->videoOutput != !desired->videoOutput || !state->photoOutput != !desired->photoOutput ||
+        !state->audioInput != !desired->audioInput || !state->audioOutput != !desired->audioOutput || state->preset != desired->preset)
+        return 0;
+    if (PBJSessionPlannerTestHasVideoConnection(desired) && desired->videoOrientation != PBJSessionConnectionUnknown &&
+        state->videoOrientation != desired->videoOrientation)
+        return 0;
+    if (PBJSessionPlannerTestHasPrimaryConnection(desired) && desired->mirrored != PBJSessionConnectionUnknown &&
+        state->mirrored != desired->mirrored)
+        return 0;
+    return 1;
+}
+
+// replays the plan, skipping one operation when skip is in range. valid is cleared when an
+// operation finds the session in a state it can't act on
+static PBJSessionConfiguration PBJSessionPlannerTestReplay(const PBJSessionConfiguration *current, const PBJSessionConfiguration *desired,
+                                                           const PBJSessionPlan *plan, size_t skip, int *valid)
+{
+    PBJSessionConfiguration state = *current;
+    *valid = 1;
+    for (size_t i = 0; i < plan->count; i++) {
+        if (i == skip)
+            continue;
+        PBJSessionOperation operation = plan->operations[i];
+        int allowed = 1;
+        switch (operation) {
+            case PBJSessionOperationRemoveCameraInput: allowed = state.camera != PBJSessionCameraNone; break;
+            case PBJSessionOperationRemoveAudioInput: allowed = state.audioInput; break;
+            case PBJSessionOperationRemoveVideoOutput: allowed = state.videoOutput; break;
+            case PBJSessionOperationRemovePhotoOutput: allowed = state.photoOutput; break;
+            case PBJSessionOperationRemoveAudioOutput: allowed = state.audioOutput; break;
+            // one camera at a time
+            case PBJSessionOperationAddCameraInput: allowed = state.camera == PBJSessionCameraNone; break;
+            case PBJSessionOperationAddAudioInput: allowed = !state.audioInput; break;
+            case PBJSessionOperationAddVideoOutput: allowed = !state.videoOutput; break;
+            case PBJSessionOperationAddPhotoOutput: allowed = !state.photoOutput; break;
+            case PBJSessionOperationAddAudioOutput: allowed = !state.audioOutput; break;
+            case PBJSessionOperationConfigureVideoOutput:
+            case PBJSessionOperationSetVideoOrientation: allowed = PBJSessionPlannerTestHasVideoConnection(&state); break;
+            case PBJSessionOperationConfigureDevice:
+            case PBJSessionOperationSetMirroring: allowed = PBJSessionPlannerTestHasPrimaryConnection(&state); break;
+            default: break;
+        }
+        *valid &= allowed;
+        PBJSessionConfigurationApply(&state, operation, desired);
+    }
+    return state;
+}
+
+static void PBJSessionPlannerTestPair(const PBJSessionConfiguration *current, const PBJSessionConfiguration *desired)
+{
+    PBJSessionPlan plan;
+    size_t count = PBJSessionPlannerPlan(current, desired, &plan);
+    PBJTestCheck(count == plan.count && count <= PBJSessionOperationCount);
+
+    // declaration order is execution order, each operation at most once
+    for (size_t i = 1; i < count; i++)
+        PBJTestCheck(plan.operations[i - 1] < plan.operations[i]);
+
+    int valid;
+    PBJSessionConfiguration state = PBJSessionPlannerTestReplay(current, desired, &plan, SIZE_MAX, &valid);
+    PBJTestCheck(valid && PBJSessionPlannerTestReached(&state, desired));
+
+    // nothing the plan could do without. configuring an output or device leaves no trace in
+    // the configuration, so those are checked against when they are owed
+    int cameraChanged = current->camera != desired->camera;
+    int videoAdded = !current->videoOutput && desired->videoOutput;
+    int modeChanged = (current->videoOutput ? 1 : current->photoOutput ? 2 : 0) != (desired->videoOutput ? 1 : desired->photoOutput ? 2 : 0);
+    int configuresOutput = 0;
+    int configuresDevice = 0;
+    for (size_t i = 0; i < count; i++) {
+        PBJSessionOperation operation = plan.operations[i];
+        if (operation == PBJSessionOperationConfigureVideoOutput) {
+            configuresOutput = 1;
+        } else if (operation == PBJSessionOperationConfigureDevice) {
+            configuresDevice = 1;
+        } else if (operation == PBJSessionOperationSetPreset && cameraChanged && desired->camera != PBJSessionCameraNone) {
+            // a new camera may not have kept the preset, so it's set again even when equal
+        } else {
+            int skippedValid;
+            PBJSessionConfiguration skipped = PBJSessionPlannerTestReplay(current, desired, &plan, i, &skippedValid);
+            PBJTestCheck(!skippedValid || !PBJSessionPlannerTestReached(&skipped, desired));
+        }
+    }
+    PBJTestCheck(configuresOutput == (PBJSessionPlannerTestHasVideoConnection(desired) && (videoAdded || cameraChanged)));
+    PBJTestCheck(configuresDevice == (PBJSessionPlannerTestHasPrimaryConnection(desired) && (cameraChanged || modeChanged)));
+
+    // where the plan ends needs no further work, and the planner's own equality agrees
+    PBJSessionPlan again;
+    PBJTestCheck(PBJSessionPlannerPlan(&state, desired, &again) == 0);
+    if (count == 0)
+        PBJTestCheck(PBJSessionPlannerTestReached(current, desired));
+}
+
+static void PBJSessionPlannerTestExhaustive(void)
+{
+    size_t pairs = 0;
+    for (size_t c = 0; c < PBJ_SESSION_PLANNER_TEST_SPACE; c++) {
+        PBJSessionConfiguration current = PBJSessionPlannerTestConfiguration(c);
+        // a connection setting is only known where the connection exists
+        if (!PBJSessionPlannerTestHasVideoConnection(&current) && current.videoOrientation != PBJSessionConnectionUnknown)
+            continue;
+        if (!PBJSessionPlannerTestHasPrimaryConnection(&current) && current.mirrored != PBJSessionConnectionUnknown)
+            continue;
+        for (size_t d = 0; d < PBJ_SESSION_PLANNER_TEST_SPACE; d++) {
+            PBJSessionConfiguration desired = PBJSessionPlannerTestConfiguration(d);
+            PBJSessionPlannerTestPair(&current, &desired);
+            pairs++;
+        }
+
+        // planning to itself is a no-op, and the planner's equality agrees
+        PBJSessionPlan plan;
+        PBJTestCheck(PBJSessionPlannerPlan(&current, &current, &plan) == 0);
+        PBJTestCheck(PBJSessionConfigurationEqual(&current, &current));
+    }
+    PBJTestCheck(pairs > 100000);
+}
+
+// what the capture code does most, each should cost only what it changes
+static void PBJSessionPlannerTestCommonTransitions(void)
+{
+    PBJSessionConfiguration video = PBJSessionConfigurationMakeEmpty();
+    video.camera = PBJSessionCameraBack;
+    video.videoOutput = 1;
+    video.audioInput = 1;
+    video.audioOutput = 1;
+    video.preset = 1;
+    video.videoOrientation = 1;
+    video.mirrored = 0;
+
+    PBJSessionPlan plan;
+    // flipping to the front camera, mirrored
+    PBJSessionConfiguration front = video;
+    front.camera = PBJSessionCameraFront;
+    front.mirrored = 1;
+    PBJTestCheck(PBJSessionPlannerPlan(&video, &front, &plan) == 7);
+    PBJSessionOperation flip[] = { PBJSessionOperationRemoveCameraInput, PBJSessionOperationAddCameraInput, PBJSessionOperationSetPreset,
+                                   PBJSessionOperationConfigureVideoOutput, PBJSessionOperationConfigureDevice,
+                                   PBJSessionOperationSetVideoOrientation, PBJSessionOperationSetMirroring };
+    PBJTestCheck(memcmp(plan.operations, flip, sizeof(flip)) == 0);
+
+    // rotating the device touches only the connection
+    PBJSessionConfiguration rotated = video;
+    rotated.videoOrientation = 3;
+    PBJTestCheck(PBJSessionPlannerPlan(&video, &rotated, &plan) == 1 && plan.operations[0] == PBJSessionOperationSetVideoOrientation);
+
+    // switching to photo drops the video and audio, adds the photo output and reconfigures the device
+    PBJSessionConfiguration photo = PBJSessionConfigurationMakeEmpty();
+    photo.camera = PBJSessionCameraBack;
+    photo.photoOutput = 1;
+    photo.preset = 2;
+    photo.mirrored = 0;
+    PBJTestCheck(PBJSessionPlannerPlan(&video, &photo, &plan) == 7);
+    PBJTestCheck(plan.operations[0] == PBJSessionOperationRemoveAudioInput && plan.operations[6] == PBJSessionOperationSetMirroring);
+
+    // NULL arguments plan nothing
+    PBJTestCheck(PBJSessionPlannerPlan(NULL, &video, &plan) == 0 && plan.count == 0);
+    PBJTestCheck(PBJSessionPlannerPlan(&video, NULL, &plan) == 0);
+    PBJTestCheck(PBJSessionPlannerPlan(&video, &video, NULL) == 0);
+}
+
+int main(void)
+{
+    PBJSessionPlannerTestExhaustive();
+    PBJSessionPlannerTestCommonTransitions();
+    return 0;
+}
@@ -0,0 +1,439 @@
+//
+//  PBJSteadyStateAllocationTests.c
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#include "PBJCapturePipeline.h"
+#include "PBJFrameAnalyzer.h"
+#include "PBJFramePool.h"
+#include "PBJRateGovernor.h"
+#include "PBJSampleDelivery.h"
+#include "PBJSampleRing.h"
+#include "PBJSyntheticCaptureSource.h"
+#include "PBJTestSupport.h"
+#include "PBJThumbnailRequests.h"
+
+#include <stdatomic.h>
+
+// once a recording settles the per-frame path must stay off the heap. linked with
+// --wrap=malloc,calloc,realloc,posix_memalign so every heap call made by the test and the cores
+// is counted, the synthetic capture source drives the pipeline through a pause, an interruption
+// and a stall at each speed, into a sink that stands in for PBJVision's write path only where it
+// calls CoreMedia (a recycled sample copy and the writer ring) and hands the rest to the
+// library's PBJSampleDelivery, which admits, scores, numbers thumbnail requests, keeps the best
+// frames and wakes a main queue run between samples. after two seconds of warm-up nothing may
+// allocate.
+// a sink that allocates on purpose has to be caught, so a harness that stopped counting fails
+
+#pragma mark - counting
+
+static atomic_long PBJAllocationTestCount;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *pointer, size_t size);
+int __real_posix_memalign(void **pointer, size_t alignment, size_t size);
+
+void *__wrap_malloc(size_t size);
+void *__wrap_calloc(size_t count, size_t size);
+void *__wrap_realloc(void *pointer, size_t size);
+int __wrap_posix_memalign(void **pointer, size_t alignment, size_t size);
+
+void *__wrap_malloc(size_t size)
+{
+    atomic_fetch_add_explicit(&PBJAllocationTestCount, 1, memory_order_relaxed);
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size)
+{
+    atomic_fetch_add_explicit(&PBJAllocationTestCount, 1, memory_order_relaxed);
+    return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *pointer, size_t size)
+{
+    atomic_fetch_add_explicit(&PBJAllocationTestCount, 1, memory_order_relaxed);
+    return __real_realloc(pointer, size);
+}
+
+int __wrap_posix_memalign(void **pointer, size_t alignment, size_t size)
+{
+    atomic_fetch_add_explicit(&PBJAllocationTestCount, 1, memory_order_relaxed);
+    return __real_posix_memalign(pointer, alignment, size);
+}
+
+static long PBJAllocationTestGetCount(void)
+{
+    return atomic_load_explicit(&PBJAllocationTestCount, memory_order_relaxed);
+}
+
+#pragma mark - write path
+
+// the main queue, run between samples, holds at most one wake of each kind
+#define PBJAllocationTestWakeCapacity PBJSampleDeliveryWakeCount
+#define PBJAllocationTestFrameSelectionCapacity 3
+#define PBJAllocationTestAudioCapacity 8
+// thumbnail requests by frame number below this, and by time every half second up to it
+#define PBJAllocationTestRequestedFrames 600
+#define PBJAllocationTestRequestedTimes 20
+
+typedef struct {
+    PBJFramePool *pool;
+    PBJSampleRing *writerRing;
+    PBJFrameAnalyzer *analyzer;
+    PBJRateGovernor *governor;
+    PBJSampleDelivery *delivery;
+    PBJSampleDeliveryRoutes routes;
+    const PBJNV12Image *image; // the pixels and time of the frame being delivered
+    int64_t time;
+    PBJSampleDeliveryWake *wakes[PBJAllocationTestWakeCapacity];
+    size_t wakeCount;
+    uint64_t written[PBJCaptureTrackCount];
+    uint64_t framesOffered;
+    uint64_t thumbnailFrames;
+    uint64_t thumbnailsRequested;
+    // what the thumbnail requests should give, the next time request not yet passed
+    uint8_t framesRequested[PBJAllocationTestRequestedFrames];
+    uint8_t timesRequested[PBJAllocationTestRequestedTimes];
+    size_t nextTime;
+    int64_t firstTime;
+    uint64_t framesTaken;
+    uint64_t audioTaken;
+    int allocates; // plants an allocation per sample, for the negative check
+} PBJAllocationTestWritePath;
+
+static void PBJAllocationTestRetainSample(void *context, void *sample)
+{
+    PBJFrameBufferRetain((PBJFrameBuffer *)sample);
+}
+
+static void PBJAllocationTestReleaseSample(void *context, void *sample)
+{
+    PBJFrameBufferRelease((PBJFrameBuffer *)sample);
+}
+
+// stands in for locking the sample's pixel buffer
+static float PBJAllocationTestScoreFrame(void *context, void *frame)
+{
+    PBJAllocationTestWritePath *path = (PBJAllocationTestWritePath *)context;
+    PBJFrameStatistics statistics;
+    PBJTestCheck(PBJFrameAnalyzerAnalyze(path->analyzer, path->image, &statistics));
+    return PBJFrameStatisticsScore(&statistics);
+}
+
+// stands in for the downscale into the thumbnail store
+static void PBJAllocationTestThumbnailFrame(void *context, void *frame, float score, int requested)
+{
+    PBJAllocationTestWritePath *path = (PBJAllocationTestWritePath *)context;
+    uint64_t number = path->thumbnailFrames++;
+    if (number == 0)
+        path->firstTime = path->time;
+
+    // a frame request is taken by its frame, a time request by the first frame at or past it
+    int expected = number < PBJAllocationTestRequestedFrames && path->framesRequested[number];
+    while (path->nextTime < PBJAllocationTestRequestedTimes &&
+           (int64_t)path->nextTime * (PBJ_TEST_NSEC_PER_SEC / 2) <= path->time - path->firstTime) {
+        expected = expected || path->timesRequested[path->nextTime];
+        path->nextTime++;
+    }
+    PBJTestCheck(requested == expected);
+    if (requested)
+        path->thumbnailsRequested++;
+}
+
+static void PBJAllocationTestSendWake(void *context, PBJSampleDeliveryWake *wake)
+{
+    PBJAllocationTestWritePath *path = (PBJAllocationTestWritePath *)context;
+    PBJTestCheck(path->wakeCount < PBJAllocationTestWakeCapacity);
+    path->wakes[path->wakeCount++] = wake;
+}
+
+// the main queue's turn, as PBJVision's wake function receives and empties each wake
+static void PBJAllocationTestRunMainQueue(PBJAllocationTestWritePath *path)
+{
+    for (size_t i = 0; i < path->wakeCount; i++) {
+        PBJSampleDeliveryWake wake = PBJSampleDeliveryReceiveWake(path->wakes[i]);
+        void *sample = NULL;
+        if (wake.type == PBJSampleDeliveryWakeDelegateAudio) {
+            while ((sample = PBJSampleDeliveryTakeAudio(wake.delivery))) {
+                path->audioTaken++;
+                PBJFrameBufferRelease((PBJFrameBuffer *)sample);
+            }
+        } else if ((sample = PBJSampleDeliveryTakeFrame(wake.delivery, wake.type))) {
+            path->framesTaken++;
+            PBJFrameBufferRelease((PBJFrameBuffer *)sample);
+        }
+    }
+    path->wakeCount = 0;
+}
+
+static int PBJAllocationTestSetupTrack(void *context, const PBJCaptureSample *sample)
+{
+    return 1;
+}
+
+// the synthetic source's payloads outlive every sample, as the capture pool's do held by a retain
+static void PBJAllocationTestRetainPayload(void *context, void *payload)
+{
+}
+
+static void PBJAllocationTestReleasePayload(void *context, void *payload)
+{
+}
+
+// PBJVision's _writeSampleBuffer, with its CoreMedia calls stood in for: the retimed copy comes
+// from the pool and the writer's append is a ring it drains behind. everything after the
+// append is the library's own PBJSampleDelivery
+static int PBJAllocationTestWriteSample(void *context, const PBJCaptureSample *sample, PBJTime rebasedPresentationTimestamp)
+{
+    PBJAllocationTestWritePath *path = (PBJAllocationTestWritePath *)context;
+    int64_t time = PBJTimeGetNanoseconds(rebasedPresentationTimestamp);
+    if (sample->track == PBJCaptureTrackVideo) {
+        // the writer reads as congested throughout, so the governor settles at its lowest frame rate
+        PBJWriterLoad load = { time, 0, 16, ++path->framesOffered, 0, path->framesOffered, 0 };
+        PBJRateGovernorObserve(path->governor, &load);
+        if (!PBJSampleDeliveryAdmitFrame(path->delivery, time))
+            return 1;
+    }
+
+    PBJFrameBuffer *copy = PBJFramePoolAcquire(path->pool, PBJFrameFormatBytes, 208, 1);
+    PBJTestCheck(copy != NULL);
+    void *dropped = NULL;
+    PBJSampleRingPush(path->writerRing, PBJFrameBufferRetain(copy), PBJSampleRingOverflowDropOldest, &dropped);
+    PBJFrameBufferRelease((PBJFrameBuffer *)dropped);
+
+    if (sample->track == PBJCaptureTrackVideo) {
+        path->image = (const PBJNV12Image *)sample->payload;
+        path->time = time;
+        PBJSampleDeliveryDeliverFrame(path->delivery, copy, time, &path->routes);
+        path->image = NULL;
+    } else {
+        PBJSampleDeliveryDeliverAudio(path->delivery, copy, &path->routes);
+    }
+    PBJFrameBufferRelease(copy);
+    path->written[sample->track]++;
+
+    if (path->allocates) {
+        // volatile, so the compiler can't pair the two calls away
+        void *volatile planted = malloc(8);
+        free(planted);
+    }
+
+    void *item;
+    while ((item = PBJSampleRingPop(path->writerRing)))
+        PBJFrameBufferRelease((PBJFrameBuffer *)item);
+    // the main queue runs every third frame, so the mailboxes supersede, and is busy one second in
+    // five, so the audio ring fills
+    uint64_t frames = path->written[PBJCaptureTrackVideo];
+    if (frames % 3 == 0 && (frames / 15) % 5 != 4)
+        PBJAllocationTestRunMainQueue(path);
+    return 1;
+}
+
+// allocations counted after the warm-up, items is the number of source items processed after it
+static long PBJAllocationTestRecord(const PBJCaptureRetimerConfiguration *speed, int interleave, int allocates, uint64_t *items)
+{
+    PBJAllocationTestWritePath path;
+    memset(&path, 0, sizeof(path));
+    path.allocates = allocates;
+    PBJFramePoolConfiguration poolConfiguration = PBJFramePoolDefaultConfiguration();
+    path.pool = PBJFramePoolCreate(&poolConfiguration);
+    path.writerRing = PBJSampleRingCreate(16);
+    PBJFrameAnalyzerConfiguration analyzerConfiguration = PBJFrameAnalyzerDefaultConfiguration();
+    path.analyzer = PBJFrameAnalyzerCreate(&analyzerConfiguration);
+    PBJRateGovernorConfiguration governorConfiguration = PBJRateGovernorDefaultConfiguration(4e6, 30);
+    governorConfiguration.minimumFrameRate = 10;
+    path.governor = PBJRateGovernorCreate(&governorConfiguration);
+    PBJSampleDeliveryCallbacks callbacks = {
+        &path, PBJAllocationTestRetainSample, PBJAllocationTestReleaseSample,
+        PBJAllocationTestScoreFrame, PBJAllocationTestThumbnailFrame, PBJAllocationTestSendWake
+    };
+    path.delivery = PBJSampleDeliveryCreate(callbacks, PBJAllocationTestFrameSelectionCapacity, PBJAllocationTestAudioCapacity);
+    PBJTestCheck(path.pool && path.writerRing && path.analyzer && path.governor && path.delivery);
+
+    // the copies stand in for CoreMedia's, outside the guarantee, so the pool starts with as many
+    // as the delivery can hold at once (the window, both mailboxes, the audio ring and the one in
+    // the writer) rather than reaching that in a late burst
+    PBJFrameBuffer *primed[PBJAllocationTestFrameSelectionCapacity + 2 + PBJAllocationTestAudioCapacity + 1];
+    for (size_t i = 0; i < sizeof(primed) / sizeof(primed[0]); i++)
+        PBJTestCheck((primed[i] = PBJFramePoolAcquire(path.pool, PBJFrameFormatBytes, 208, 1)) != NULL);
+    for (size_t i = 0; i < sizeof(primed) / sizeof(primed[0]); i++)
+        PBJFrameBufferRelease(primed[i]);
+    PBJSampleDeliverySetRateGovernor(path.delivery, path.governor);
+
+    // every route on, as with a delegate taking video and audio and a photo chosen from frames
+    path.routes.thumbnails = 1;
+    path.routes.scoresThumbnails = 1;
+    path.routes.frameSelectionInterval = PBJ_TEST_NSEC_PER_SEC / 2;
+    path.routes.render = 1;
+    path.routes.delegateVideo = 1;
+    path.routes.delegateAudio = 1;
+
+    // as startVideoCapture and the thumbnail requests before it
+    PBJSampleDeliveryReset(path.delivery);
+    PBJTestCheck(PBJSampleDeliveryRequestThumbnailAtFrame(path.delivery, 0));
+    path.framesRequested[0] = 1;
+    for (int64_t i = 0; i < 40; i++) {
+        int64_t frame = (i * 7919) % PBJAllocationTestRequestedFrames;
+        int64_t time = (i * 104729) % PBJAllocationTestRequestedTimes;
+        PBJTestCheck(PBJSampleDeliveryRequestThumbnailAtFrame(path.delivery, frame));
+        PBJTestCheck(PBJSampleDeliveryRequestThumbnailAtTime(path.delivery, time * (PBJ_TEST_NSEC_PER_SEC / 2)));
+        path.framesRequested[frame] = 1;
+        path.timesRequested[time] = 1;
+    }
+
+    PBJCapturePipelineSink sink = {
+        &path, PBJAllocationTestSetupTrack, PBJAllocationTestWriteSample, NULL,
+        interleave ? PBJAllocationTestRetainPayload : NULL, interleave ? PBJAllocationTestReleasePayload : NULL
+    };
+    PBJCapturePipeline *pipeline = PBJCapturePipelineCreate(sink);
+    PBJTestCheck(pipeline != NULL);
+    if (speed)
+        PBJTestCheck(PBJCapturePipelineSetSpeed(pipeline, speed));
+
+    PBJSyntheticCaptureSourceConfiguration configuration = PBJSyntheticCaptureSourceDefaultConfiguration(320, 240, 30);
+    configuration.jitter = 3000000;
+    configuration.duration = 20 * PBJ_TEST_NSEC_PER_SEC;
+    const PBJSyntheticCaptureEvent events[] = {
+        { PBJSyntheticCaptureEventPause, 6 * PBJ_TEST_NSEC_PER_SEC, 0 },
+        { PBJSyntheticCaptureEventResume, 8 * PBJ_TEST_NSEC_PER_SEC, 0 },
+        { PBJSyntheticCaptureEventInterrupt, 12 * PBJ_TEST_NSEC_PER_SEC, PBJ_TEST_NSEC_PER_SEC },
+        { PBJSyntheticCaptureEventStall, 15 * PBJ_TEST_NSEC_PER_SEC, PBJ_TEST_NSEC_PER_SEC / 5 }
+    };
+    PBJSyntheticCaptureSource *source = PBJSyntheticCaptureSourceCreate(&configuration, events, sizeof(events) / sizeof(events[0]));
+    PBJTestCheck(source != NULL);
+    PBJTestCheck(PBJCapturePipelineStart(pipeline));
+
+    long steady = -1;
+    *items = 0;
+    PBJCaptureSourceItem item;
+    while (PBJSyntheticCaptureSourceNextItem(source, &item)) {
+        if (steady < 0 && PBJTimeGetSeconds(PBJCaptureTimelineCapturedDuration(PBJCapturePipelineGetTimeline(pipeline))) >= 2.0)
+            steady = PBJAllocationTestGetCount();
+        PBJCapturePipelineProcessSourceItem(pipeline, &item, NULL);
+        if (steady >= 0)
+            (*items)++;
+        if (item.type == PBJCaptureSourceItemEnd)
+            break;
+    }
+    PBJTestCheck(steady >= 0);
+    long counted = PBJAllocationTestGetCount() - steady;
+    PBJAllocationTestRunMainQueue(&path);
+
+    // every written sample reached the delivery, and every frame posted was taken or superseded
+    PBJSampleDeliveryCounters counters = PBJSampleDeliveryGetCounters(path.delivery);
+    // a retimed recording drops its audio
+    PBJTestCheck(path.written[PBJCaptureTrackVideo] > 0 && (speed || path.written[PBJCaptureTrackAudio] > 0));
+    PBJTestCheck(counters.framesDelivered == path.written[PBJCaptureTrackVideo]);
+    PBJTestCheck(counters.framesPassedOver + counters.framesDelivered == path.framesOffered);
+    // a time-lapse writes fewer frames a second than the governor's lowest rate
+    PBJTestCheck(counters.framesPassedOver > 0 || (speed && speed->speed == PBJCaptureSpeedTimeLapse));
+    PBJTestCheck(counters.audioDelivered == path.written[PBJCaptureTrackAudio]);
+    PBJTestCheck(path.thumbnailFrames == counters.framesDelivered);
+    PBJTestCheck(path.framesTaken + counters.framesSuperseded == 2 * counters.framesDelivered);
+    PBJTestCheck(counters.framesSuperseded > 0);
+    PBJTestCheck(path.audioTaken + counters.audioDropped == counters.audioDelivered);
+    PBJTestCheck(speed || counters.audioDropped > 0);
+    PBJTestCheck(path.thumbnailsRequested > 0);
+    PBJTestCheck(PBJBestFrameWindowGetCount(PBJSampleDeliveryGetFrameSelectionWindow(path.delivery)) > 0);
+
+    PBJCapturePipelineDestroy(pipeline);
+    PBJSyntheticCaptureSourceDestroy(source);
+    PBJSampleDeliveryDestroy(path.delivery);
+    // every sample the delivery held went back
+    PBJTestCheck(PBJFramePoolGetStatistics(path.pool).buffersInUse == 0);
+    PBJRateGovernorDestroy(path.governor);
+    PBJFrameAnalyzerDestroy(path.analyzer);
+    PBJSampleRingDestroy(path.writerRing);
+    PBJFramePoolDestroy(path.pool);
+    return counted;
+}
+
+#pragma mark - tests
+
+// the request queue keeps order, holds each request once and only grows on insert
+static void PBJAllocationTestThumbnailRequests(void)
+{
+    PBJThumbnailRequests requests;
+    memset(&requests, 0, sizeof(requests));
+    for (int64_t i = 100; i > 0; i--) {
+        PBJTestCheck(PBJThumbnailRequestsInsert(&requests, i % 37));
+        PBJTestCheck(PBJThumbnailRequestsInsert(&requests, i));
+    }
+    // 1 to 100, and the 0 only i % 37 gives
+    PBJTestCheck(requests.count == 101);
+    for (size_t i = 1; i < requests.count; i++)
+        PBJTestCheck(requests.values[requests.head + i - 1] < requests.values[requests.head + i]);
+
+    PBJTestCheck(!PBJThumbnailRequestsConsume(&requests, -1));
+    PBJTestCheck(PBJThumbnailRequestsConsume(&requests, 0) && requests.count == 100);
+    PBJTestCheck(PBJThumbnailRequestsConsume(&requests, 50) && requests.count == 50);
+
+    // the consumed front makes room
+    long before = PBJAllocationTestGetCount();
+    for (int64_t i = 0; i < 50; i++)
+        PBJTestCheck(PBJThumbnailRequestsInsert(&requests, 1000 + i));
+    PBJTestCheck(PBJAllocationTestGetCount() == before && requests.count == 100);
+    PBJTestCheck(requests.values[requests.head] == 51 && requests.values[requests.head + 99] == 1049);
+
+    PBJThumbnailRequestsReset(&requests);
+    PBJTestCheck(requests.count == 0 && !PBJThumbnailRequestsConsume(&requests, INT64_MAX));
+    PBJThumbnailRequestsDestroy(&requests);
+    PBJTestCheck(requests.values == NULL && requests.capacity == 0);
+}
+
+static void PBJAllocationTestSteadyState(void)
+{
+    PBJCaptureRetimerConfiguration timeLapse = PBJCaptureRetimerDefaultConfiguration();
+    timeLapse.speed = PBJCaptureSpeedTimeLapse;
+    timeLapse.interval = PBJTimeMake(1, 2);
+    PBJCaptureRetimerConfiguration slowMotion = PBJCaptureRetimerDefaultConfiguration();
+    slowMotion.speed = PBJCaptureSpeedSlowMotion;
+    slowMotion.captureFrameRate = 60;
+    slowMotion.outputFrameRate = 30;
+
+    const struct {
+        const PBJCaptureRetimerConfiguration *speed;
+        int interleave;
+    } runs[] = { { NULL, 0 }, { NULL, 1 }, { &timeLapse, 1 }, { &slowMotion, 1 } };
+    for (size_t r = 0; r < sizeof(runs) / sizeof(runs[0]); r++) {
+        uint64_t items = 0;
+        long counted = PBJAllocationTestRecord(runs[r].speed, runs[r].interleave, 0, &items);
+        PBJTestCheck(items > 1000);
+        if (counted != 0)
+            fprintf(stderr, "run %zu: %ld allocations over %llu steady state items\n", r, counted, (unsigned long long)items);
+        PBJTestCheck(counted == 0);
+    }
+
+    // a sample that allocates is seen, once for each written after the warm-up
+    uint64_t items = 0;
+    PBJTestCheck(PBJAllocationTestRecord(NULL, 1, 1, &items) > 100);
+}
+
+int main(void)
+{
+    PBJAllocationTestThumbnailRequests();
+    PBJAllocationTestSteadyState();
+    return 0;
+}
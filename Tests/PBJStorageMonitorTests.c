@@ -0,0 +1,289 @@
+//
+//  PBJStorageMonitorTests.c
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#include "PBJStorageMonitor.h"
+#include "PBJTestSupport.h"
+
+#include <math.h>
+
+// a fake volume behind the freeBytes callback, drained by a simulated writer that flushes in
+// chunks like fragments and by whatever else is filling the disk. recordings have to stop
+// before the reserve is touched, close to where the rate says they should, while the volume
+// is queried no more often than the configuration allows
+
+#define PBJ_STORAGE_TEST_MB (1024.0 * 1024.0)
+#define PBJ_STORAGE_TEST_RESERVE (48ull * 1024 * 1024)
+
+typedef struct {
+    double freeBytes; // what the volume really has
+    int failing;
+    int queries;
+    int64_t lastQueryTime;
+    int64_t shortestGap;
+    const int64_t *now;
+} PBJStorageTestVolume;
+
+static int PBJStorageTestFreeBytes(void *context, uint64_t *freeBytes)
+{
+    PBJStorageTestVolume *volume = (PBJStorageTestVolume *)context;
+    if (volume->queries > 0 && *volume->now - volume->lastQueryTime < volume->shortestGap)
+        volume->shortestGap = *volume->now - volume->lastQueryTime;
+    volume->lastQueryTime = *volume->now;
+    volume->queries++;
+    if (volume->failing)
+        return 0;
+    *freeBytes = volume->freeBytes > 0.0 ? (uint64_t)volume->freeBytes : 0;
+    return 1;
+}
+
+static PBJStorageTestVolume PBJStorageTestVolumeMake(double freeBytes, const int64_t *now)
+{
+    PBJStorageTestVolume volume = { freeBytes, 0, 0, 0, INT64_MAX, now };
+    return volume;
+}
+
+typedef struct {
+    const char *name;
+    double freeMegabytes;
+    double rate;         // bytes per second written by the recording
+    double steppedRate;  // after stepTime
+    double stepTime;
+    double flushSeconds; // the writer's bytes land on the volume in chunks this long
+    double otherRate;    // bytes per second taken by something else
+} PBJStorageTestScenario;
+
+typedef struct {
+    double stoppedAt;      // seconds into the recording, negative when it never stopped
+    double freeAtStop;     // true free bytes on the volume
+    double predictedStop;  // remaining seconds plus elapsed, from the first estimate after 30 s
+    int recordingQueries;
+    double seconds;
+} PBJStorageTestResult;
+
+static PBJStorageTestResult PBJStorageTestRecord(const PBJStorageTestScenario *scenario)
+{
+    PBJStorageTestResult result = { -1.0, 0.0, -1.0, 0, 0.0 };
+    int64_t now = 0;
+    PBJStorageTestVolume volume = PBJStorageTestVolumeMake(scenario->freeMegabytes * PBJ_STORAGE_TEST_MB, &now);
+    PBJStorageMonitorConfiguration configuration = PBJStorageMonitorDefaultConfiguration(PBJ_STORAGE_TEST_RESERVE);
+    PBJStorageMonitor *monitor = PBJStorageMonitorCreate(&configuration, (PBJStorageVolume){ &volume, PBJStorageTestFreeBytes });
+    PBJTestCheck(monitor != NULL);
+
+    // a minute idle with the interface reading estimates every frame
+    PBJTestCheck(PBJStorageMonitorUpdate(monitor, now) == 1);
+    int idleQueries = volume.queries;
+    for (; now < 60 * PBJ_TEST_NSEC_PER_SEC; now += PBJ_TEST_NSEC_PER_SEC / 60) {
+        if (now >= PBJStorageMonitorNextUpdateTime(monitor))
+            PBJStorageMonitorUpdate(monitor, now);
+        PBJStorageEstimate estimate;
+        PBJStorageMonitorGetEstimate(monitor, &estimate);
+        PBJTestCheck(estimate.measured && !estimate.shouldStop && estimate.remainingSeconds < 0.0 && estimate.bytesPerSecond == 0.0);
+    }
+    PBJTestCheck(volume.queries - idleQueries <= 7);
+
+    int64_t start = now;
+    PBJStorageMonitorBeginRecording(monitor, now);
+    double written = 0.0;
+    double flushed = 0.0;
+    double nextFlush = scenario->flushSeconds;
+    int queries = volume.queries;
+    const int64_t step = PBJ_TEST_NSEC_PER_SEC / 1000;
+    for (;;) {
+        now += step;
+        double elapsed = (double)(now - start) / (double)PBJ_TEST_NSEC_PER_SEC;
+        double rate = elapsed < scenario->stepTime ? scenario->rate : scenario->steppedRate;
+        written += rate / 1000.0;
+        if (elapsed >= nextFlush) {
+            volume.freeBytes -= written - flushed;
+            flushed = written;
+            nextFlush += scenario->flushSeconds;
+        }
+        volume.freeBytes -= scenario->otherRate / 1000.0;
+
+        if (now >= PBJStorageMonitorNextUpdateTime(monitor)) {
+            PBJStorageMonitorRecordBytesWritten(monitor, (uint64_t)flushed, now);
+            PBJStorageMonitorUpdate(monitor, now);
+            PBJStorageEstimate estimate;
+            PBJStorageMonitorGetEstimate(monitor, &estimate);
+            if (result.predictedStop < 0.0 && elapsed >= 30.0 && estimate.remainingSeconds >= 0.0)
+                result.predictedStop = elapsed + estimate.remainingSeconds;
+            if (estimate.shouldStop) {
+                result.stoppedAt = elapsed;
+                break;
+            }
+        }
+        if (volume.freeBytes <= 0.0 || elapsed > 7200.0)
+            break;
+    }
+    result.recordingQueries = volume.queries - queries;
+    result.seconds = (double)(now - start) / (double)PBJ_TEST_NSEC_PER_SEC;
+    result.freeAtStop = volume.freeBytes;
+
+    PBJTestCheck(result.stoppedAt > 0.0);
+    // a second more of every writer while the file is finished still leaves half the reserve
+    double fastest = scenario->rate > scenario->steppedRate ? scenario->rate : scenario->steppedRate;
+    PBJTestCheck(result.freeAtStop - fastest - scenario->otherRate > (double)PBJ_STORAGE_TEST_RESERVE * 0.5);
+    PBJTestCheck(volume.shortestGap >= configuration.minimumQueryInterval);
+    PBJTestCheck((double)result.recordingQueries <= result.seconds / 5.0 + 40.0);
+
+    PBJStorageMonitorDestroy(monitor);
+    return result;
+}
+
+static void PBJStorageMonitorTestRecordings(void)
+{
+    // 50 Mbps 4K written in small flushes, the stop lands the headroom short of the reserve
+    PBJStorageTestScenario steady = { "steady", 2000.0, 6.25 * PBJ_STORAGE_TEST_MB, 6.25 * PBJ_STORAGE_TEST_MB, 1e9, 0.05, 0.0 };
+    PBJStorageTestResult result = PBJStorageTestRecord(&steady);
+    double expected = (2000.0 * PBJ_STORAGE_TEST_MB - (double)PBJ_STORAGE_TEST_RESERVE) / steady.rate - 3.0;
+    PBJTestCheck(fabs(result.stoppedAt - expected) < 2.0);
+    PBJTestCheck(fabs(result.predictedStop - result.stoppedAt) < 0.05 * result.stoppedAt);
+
+    // one second fragments, the written bytes arrive in steps
+    PBJStorageTestScenario fragmented = { "fragmented", 2000.0, 6.25 * PBJ_STORAGE_TEST_MB, 6.25 * PBJ_STORAGE_TEST_MB, 1e9, 1.0, 0.0 };
+    result = PBJStorageTestRecord(&fragmented);
+    PBJTestCheck(fabs(result.predictedStop - result.stoppedAt) < 0.1 * result.stoppedAt);
+
+    // the bitrate jumps from 8 to 100 Mbps partway through
+    PBJStorageTestScenario stepped = { "stepped", 1000.0, 1.0 * PBJ_STORAGE_TEST_MB, 12.5 * PBJ_STORAGE_TEST_MB, 40.0, 0.05, 0.0 };
+    PBJStorageTestRecord(&stepped);
+
+    // a download competing for the space, only seen through the volume queries
+    PBJStorageTestScenario download = { "download", 3000.0, 6.25 * PBJ_STORAGE_TEST_MB, 6.25 * PBJ_STORAGE_TEST_MB, 1e9, 0.05, 20.0 * PBJ_STORAGE_TEST_MB };
+    PBJStorageTestRecord(&download);
+
+    // barely above the reserve to begin with
+    PBJStorageTestScenario nearReserve = { "near reserve", 60.0, 6.25 * PBJ_STORAGE_TEST_MB, 6.25 * PBJ_STORAGE_TEST_MB, 1e9, 0.05, 0.0 };
+    result = PBJStorageTestRecord(&nearReserve);
+    PBJTestCheck(result.stoppedAt < 1.0);
+}
+
+// between queries the free space is the last answer less what the recording wrote since
+static void PBJStorageMonitorTestCarryForward(void)
+{
+    int64_t now = 0;
+    PBJStorageTestVolume volume = PBJStorageTestVolumeMake(1000.0 * PBJ_STORAGE_TEST_MB, &now);
+    PBJStorageMonitorConfiguration configuration = PBJStorageMonitorDefaultConfiguration(PBJ_STORAGE_TEST_RESERVE);
+    PBJStorageMonitor *monitor = PBJStorageMonitorCreate(&configuration, (PBJStorageVolume){ &volume, PBJStorageTestFreeBytes });
+    PBJTestCheck(monitor != NULL);
+    uint64_t queried = (uint64_t)volume.freeBytes;
+
+    PBJStorageMonitorBeginRecording(monitor, now);
+    // a fresh recording asks for a query straight away
+    PBJTestCheck(PBJStorageMonitorNextUpdateTime(monitor) == now);
+    PBJTestCheck(PBJStorageMonitorUpdate(monitor, now) == 1);
+
+    PBJStorageEstimate estimate;
+    PBJStorageMonitorGetEstimate(monitor, &estimate);
+    PBJTestCheck(estimate.measured && estimate.freeBytes == queried && estimate.usableBytes == queried - PBJ_STORAGE_TEST_RESERVE);
+    PBJTestCheck(estimate.bytesPerSecond == 0.0 && estimate.remainingSeconds < 0.0 && !estimate.shouldStop);
+
+    // polled before the query is due, nothing is asked of the volume
+    now += configuration.writePollInterval;
+    PBJStorageMonitorRecordBytesWritten(monitor, 5000000, now);
+    PBJTestCheck(PBJStorageMonitorUpdate(monitor, now) == 0);
+    PBJStorageMonitorGetEstimate(monitor, &estimate);
+    PBJTestCheck(estimate.freeBytes == queried - 5000000);
+    PBJTestCheck(fabs(estimate.bytesPerSecond - 10000000.0) < 1.0);
+    double remaining = ((double)(queried - 5000000 - PBJ_STORAGE_TEST_RESERVE) - 3.0 * 10000000.0) / 10000000.0;
+    PBJTestCheck(fabs(estimate.remainingSeconds - remaining) < 1e-6);
+
+    // a counter going backwards is ignored, as is a poll at the same time
+    now += configuration.writePollInterval;
+    PBJStorageMonitorRecordBytesWritten(monitor, 4000000, now);
+    PBJStorageMonitorRecordBytesWritten(monitor, 9000000, now);
+    PBJStorageMonitorGetEstimate(monitor, &estimate);
+    PBJTestCheck(estimate.freeBytes == queried - 5000000);
+
+    // the next answer replaces the carried estimate, writes count from there
+    volume.freeBytes -= 20000000.0;
+    now = PBJStorageMonitorNextUpdateTime(monitor) > now ? PBJStorageMonitorNextUpdateTime(monitor) : now;
+    while (!PBJStorageMonitorUpdate(monitor, now))
+        now += configuration.minimumQueryInterval;
+    PBJStorageMonitorGetEstimate(monitor, &estimate);
+    PBJTestCheck(estimate.freeBytes == queried - 20000000);
+    PBJStorageMonitorRecordBytesWritten(monitor, 7000000, now + 1);
+    PBJStorageMonitorGetEstimate(monitor, &estimate);
+    PBJTestCheck(estimate.freeBytes == queried - 22000000);
+
+    // ending asks for a query to see the finished file, and the rate is gone
+    PBJStorageMonitorEndRecording(monitor, now + 2);
+    PBJTestCheck(PBJStorageMonitorNextUpdateTime(monitor) == now + 2);
+    PBJStorageMonitorGetEstimate(monitor, &estimate);
+    PBJTestCheck(estimate.bytesPerSecond == 0.0 && estimate.remainingSeconds < 0.0 && !estimate.shouldStop);
+
+    PBJStorageMonitorDestroy(monitor);
+}
+
+// a failing volume keeps the cached answer and the query rate, one that never answered stays unmeasured
+static void PBJStorageMonitorTestFailures(void)
+{
+    int64_t now = 0;
+    PBJStorageTestVolume volume = PBJStorageTestVolumeMake(500.0 * PBJ_STORAGE_TEST_MB, &now);
+    PBJStorageMonitorConfiguration configuration = PBJStorageMonitorDefaultConfiguration(PBJ_STORAGE_TEST_RESERVE);
+    PBJStorageMonitor *monitor = PBJStorageMonitorCreate(&configuration, (PBJStorageVolume){ &volume, PBJStorageTestFreeBytes });
+    PBJTestCheck(monitor != NULL);
+
+    PBJStorageEstimate estimate;
+    PBJStorageMonitorGetEstimate(monitor, &estimate);
+    PBJTestCheck(!estimate.measured && estimate.freeBytes == 0 && estimate.remainingSeconds < 0.0);
+    PBJTestCheck(PBJStorageMonitorUpdate(monitor, now) == 1);
+    PBJTestCheck(PBJStorageMonitorUpdate(monitor, now + PBJ_TEST_NSEC_PER_SEC) == 0);
+
+    volume.failing = 1;
+    int queries = volume.queries;
+    for (now = 0; now < 100 * PBJ_TEST_NSEC_PER_SEC; now += PBJ_TEST_NSEC_PER_SEC / 100)
+        PBJStorageMonitorUpdate(monitor, now);
+    PBJTestCheck(volume.queries - queries <= 10);
+    PBJStorageMonitorGetEstimate(monitor, &estimate);
+    PBJTestCheck(estimate.measured && estimate.freeBytes == (uint64_t)(500.0 * PBJ_STORAGE_TEST_MB));
+    PBJStorageMonitorDestroy(monitor);
+
+    volume.queries = 0;
+    volume.shortestGap = INT64_MAX;
+    monitor = PBJStorageMonitorCreate(&configuration, (PBJStorageVolume){ &volume, PBJStorageTestFreeBytes });
+    PBJTestCheck(monitor != NULL);
+    for (now = 0; now < 10 * PBJ_TEST_NSEC_PER_SEC; now += PBJ_TEST_NSEC_PER_SEC / 1000)
+        PBJStorageMonitorUpdate(monitor, now);
+    PBJTestCheck(volume.queries <= 41);
+    PBJTestCheck(volume.shortestGap >= configuration.minimumQueryInterval);
+    PBJStorageMonitorGetEstimate(monitor, &estimate);
+    PBJTestCheck(!estimate.measured);
+    PBJStorageMonitorDestroy(monitor);
+
+    PBJTestCheck(PBJStorageMonitorCreate(NULL, (PBJStorageVolume){ &volume, PBJStorageTestFreeBytes }) == NULL);
+    PBJTestCheck(PBJStorageMonitorCreate(&configuration, (PBJStorageVolume){ &volume, NULL }) == NULL);
+    PBJTestCheck(PBJStorageMonitorUpdate(NULL, 0) == 0);
+    PBJStorageMonitorGetEstimate(NULL, &estimate);
+    PBJTestCheck(!estimate.measured);
+}
+
+int main(void)
+{
+    PBJStorageMonitorTestRecordings();
+    PBJStorageMonitorTestCarryForward();
+    PBJStorageMonitorTestFailures();
+    return 0;
+}
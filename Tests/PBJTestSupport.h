@@ -0,0 +1,209 @@
+//
+//  PBJTestSupport.h
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#ifndef PBJTestSupport_h
+#define PBJTestSupport_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "PBJPlanarImage.h"
+
+// what the tests and benchmarks of the portable cores share: a check that stops the run, a
+// monotonic clock, a seeded generator and synthetic NV12 frames
+
+#define PBJ_TEST_NSEC_PER_SEC 1000000000LL
+
+#define PBJTestCheck(condition) \
+    do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            exit(1); \
+        } \
+    } while (0)
+
+static inline uint64_t PBJTestNow(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+// benchmarks run shortened under ctest
+static inline int PBJTestIsQuick(int argc, char **argv)
+{
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--quick") == 0)
+            return 1;
+    }
+    return 0;
+}
+
+#pragma mark - random
+
+typedef struct {
+    uint64_t state;
+} PBJTestRandom;
+
+static inline PBJTestRandom PBJTestRandomMake(uint64_t seed)
+{
+    PBJTestRandom random = { seed ? seed : 0x9e3779b97f4a7c15ull };
+    return random;
+}
+
+static inline uint64_t PBJTestRandomNext(PBJTestRandom *random)
+{
+    uint64_t x = random->state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    random->state = x;
+    return x;
+}
+
+// [0, bound)
+static inline uint64_t PBJTestRandomBelow(PBJTestRandom *random, uint64_t bound)
+{
+    return bound ? PBJTestRandomNext(random) % bound : 0;
+}
+
+// [minimum, maximum]
+static inline int64_t PBJTestRandomBetween(PBJTestRandom *random, int64_t minimum, int64_t maximum)
+{
+    return minimum + (int64_t)PBJTestRandomBelow(random, (uint64_t)(maximum - minimum) + 1);
+}
+
+#pragma mark - frames
+
+// an NV12 frame with rows padded past the width, as capture pixel buffers are
+typedef struct {
+    PBJNV12Image image;
+    uint8_t *storage;
+} PBJTestFrame;
+
+static inline PBJTestFrame PBJTestFrameCreate(size_t width, size_t height, PBJYCbCrRange range)
+{
+    PBJTestFrame frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.image.width = width;
+    frame.image.height = height;
+    frame.image.range = range;
+    frame.image.lumaBytesPerRow = (width + 63) & ~(size_t)63;
+    frame.image.chromaBytesPerRow = (PBJNV12ChromaWidth(&frame.image) * 2 + 63) & ~(size_t)63;
+    size_t lumaBytes = frame.image.lumaBytesPerRow * height;
+    frame.storage = (uint8_t *)calloc(1, lumaBytes + frame.image.chromaBytesPerRow * PBJNV12ChromaHeight(&frame.image));
+    if (!frame.storage) {
+        fprintf(stderr, "out of memory for a %zux%zu frame\n", width, height);
+        exit(1);
+    }
+    frame.image.luma = frame.storage;
+    frame.image.chroma = frame.storage + lumaBytes;
+    return frame;
+}
+
+static inline void PBJTestFrameDestroy(PBJTestFrame *frame)
+{
+    free(frame->storage);
+    frame->storage = NULL;
+}
+
+// seeded noise over the whole of each plane's range
+static inline void PBJTestFrameFillNoise(PBJTestFrame *frame, uint64_t seed)
+{
+    PBJTestRandom random = PBJTestRandomMake(seed);
+    PBJNV12Image *image = &frame->image;
+    for (size_t y = 0; y < image->height; y++) {
+        for (size_t x = 0; x < image->width; x++)
+            image->luma[y * image->lumaBytesPerRow + x] = (uint8_t)PBJTestRandomNext(&random);
+    }
+    for (size_t y = 0; y < PBJNV12ChromaHeight(image); y++) {
+        for (size_t x = 0; x < PBJNV12ChromaWidth(image) * 2; x++)
+            image->chroma[y * image->chromaBytesPerRow + x] = (uint8_t)PBJTestRandomNext(&random);
+    }
+}
+
+// a smooth scene: a diagonal luma ramp, slow chroma gradients and a few hard edges
+static inline void PBJTestFrameFillScene(PBJTestFrame *frame)
+{
+    PBJNV12Image *image = &frame->image;
+    for (size_t y = 0; y < image->height; y++) {
+        for (size_t x = 0; x < image->width; x++) {
+            unsigned int value = (unsigned int)((x * 160) / (image->width ? image->width : 1) + (y * 80) / (image->height ? image->height : 1));
+            if (((x / 64) + (y / 64)) % 5 == 0)
+                value = 255 - value;
+            image->luma[y * image->lumaBytesPerRow + x] = (uint8_t)(value > 255 ? 255 : value);
+        }
+    }
+    for (size_t y = 0; y < PBJNV12ChromaHeight(image); y++) {
+        for (size_t x = 0; x < PBJNV12ChromaWidth(image); x++) {
+            image->chroma[y * image->chromaBytesPerRow + 2 * x] = (uint8_t)(64 + (x * 128) / PBJNV12ChromaWidth(image));
+            image->chroma[y * image->chromaBytesPerRow + 2 * x + 1] = (uint8_t)(192 - (y * 128) / PBJNV12ChromaHeight(image));
+        }
+    }
+}
+
+// FNV-1a over the visible bytes of both planes, padding excluded
+static inline uint64_t PBJTestImageHash(const PBJNV12Image *image)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (size_t y = 0; y < image->height; y++) {
+        for (size_t x = 0; x < image->width; x++) {
+            hash ^= image->luma[y * image->lumaBytesPerRow + x];
+            hash *= 0x100000001b3ull;
+        }
+    }
+    for (size_t y = 0; y < PBJNV12ChromaHeight(image); y++) {
+        for (size_t x = 0; x < PBJNV12ChromaWidth(image) * 2; x++) {
+            hash ^= image->chroma[y * image->chromaBytesPerRow + x];
+            hash *= 0x100000001b3ull;
+        }
+    }
+    return hash;
+}
+
+#pragma mark - statistics
+
+static inline int PBJTestCompareUInt64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+// sorts values in place
+static inline uint64_t PBJTestPercentile(uint64_t *values, size_t count, double percentile)
+{
+    if (count == 0)
+        return 0;
+    qsort(values, count, sizeof(uint64_t), PBJTestCompareUInt64);
+    size_t index = (size_t)(percentile / 100.0 * (double)(count - 1) + 0.5);
+    return values[index < count ? index : count - 1];
+}
+
+#endif /* PBJTestSupport_h */
@@ -0,0 +1,411 @@
+//
+//  PBJSyntheticCaptureSource.c
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include "PBJSyntheticCaptureSource.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PBJ_SYNTHETIC_NANOSECONDS 1000000000ll
+#define PBJ_SYNTHETIC_CLOCK_ORIGIN (1000ll * PBJ_SYNTHETIC_NANOSECONDS)
+#define PBJ_SYNTHETIC_PATTERN_PERIOD 64 // even, generated frames scroll through it
+#define PBJ_SYNTHETIC_TONE_FREQUENCY 440.0
+
+struct PBJSyntheticCaptureSource {
+    PBJSyntheticCaptureSourceConfiguration configuration;
+    PBJSyntheticCaptureEvent *events;
+    size_t eventCount;
+    size_t nextEvent;
+
+    uint64_t videoIndex;
+    uint64_t audioIndex;
+    int64_t skipUntil; // interrupted, nothing is captured before
+    int64_t stallBegin;
+    int64_t stallEnd; // delivery is blocked until
+    int64_t lastArrival;
+    uint32_t random;
+    int ended;
+
+    // video, generated frames borrow a window of a wider pattern, file frames are read into it
+    FILE *videoFile;
+    uint8_t *lumaPlane;
+    uint8_t *chromaPlane;
+    size_t planeBytesPerRow;
+    PBJNV12Image frame;
+
+    // audio
+    FILE *audioFile;
+    int16_t *audioSamples;
+    double tonePhase;
+    PBJSyntheticAudioBuffer audioBuffer;
+
+    PBJSyntheticCaptureSourceCounters counters;
+};
+
+PBJSyntheticCaptureSourceConfiguration PBJSyntheticCaptureSourceDefaultConfiguration(size_t width, size_t height, int32_t frameRate)
+{
+    PBJSyntheticCaptureSourceConfiguration configuration;
+    memset(&configuration, 0, sizeof(configuration));
+    configuration.width = width;
+    configuration.height = height;
+    configuration.frameRate = frameRate;
+    configuration.audioSampleRate = 44100;
+    configuration.audioChannels = 1;
+    configuration.audioFramesPerBuffer = 1024;
+    configuration.duration = 10 * PBJ_SYNTHETIC_NANOSECONDS;
+    configuration.deliveryLatency = frameRate > 0 ? PBJ_SYNTHETIC_NANOSECONDS / frameRate : 0;
+    configuration.seed = 1;
+    return configuration;
+}
+
+#pragma mark - helpers
+
+static int PBJSyntheticCompareEvents(const void *a, const void *b)
+{
+    const PBJSyntheticCaptureEvent *lhs = (const PBJSyntheticCaptureEvent *)a;
+    const PBJSyntheticCaptureEvent *rhs = (const PBJSyntheticCaptureEvent *)b;
+    return (lhs->time > rhs->time) - (lhs->time < rhs->time);
+}
+
+static uint32_t PBJSyntheticNextRandom(PBJSyntheticCaptureSource *source)
+{
+    uint32_t x = source->random;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    source->random = x;
+    return x;
+}
+
+// reads exactly length bytes, looping at the end of the file
+static int PBJSyntheticReadLooping(FILE *file, void *buffer, size_t length)
+{
+    uint8_t *bytes = (uint8_t *)buffer;
+    int rewound = 0;
+    while (length > 0) {
+        size_t count = fread(bytes, 1, length, file);
+        bytes += count;
+        length -= count;
+        if (length > 0) {
+            if (rewound && count == 0)
+                return 0;
+            rewound = (count == 0);
+            rewind(file);
+        }
+    }
+    return 1;
+}
+
+static int64_t PBJSyntheticVideoTime(const PBJSyntheticCaptureSource *source, uint64_t index)
+{
+    return PBJ_SYNTHETIC_CLOCK_ORIGIN + (int64_t)(index * (uint64_t)PBJ_SYNTHETIC_NANOSECONDS / (uint64_t)source->configuration.frameRate);
+}
+
+static int64_t PBJSyntheticAudioTime(const PBJSyntheticCaptureSource *source, uint64_t index)
+{
+    uint64_t frames = index * (uint64_t)source->configuration.audioFramesPerBuffer;
+    return PBJ_SYNTHETIC_CLOCK_ORIGIN + (int64_t)(frames * (uint64_t)PBJ_SYNTHETIC_NANOSECONDS / (uint64_t)source->configuration.audioSampleRate);
+}
+
+static int PBJSyntheticHasAudio(const PBJSyntheticCaptureSource *source)
+{
+    return source->configuration.audioSampleRate > 0 && source->configuration.audioChannels > 0 && source->configuration.audioFramesPerBuffer > 0;
+}
+
+static void PBJSyntheticGeneratePattern(PBJSyntheticCaptureSource *source)
+{
+    size_t width = source->planeBytesPerRow;
+    size_t height = source->configuration.height;
+    for (size_t y = 0; y < height; y++) {
+        uint8_t *row = source->lumaPlane + y * width;
+        for (size_t x = 0; x < width; x++) {
+            unsigned checker = (unsigned)(((x >> 4) ^ (y >> 4)) & 1);
+            row[x] = (uint8_t)(16 + checker * 160 + ((x + y) & 63));
+        }
+    }
+    for (size_t y = 0; y < height / 2; y++) {
+        uint8_t *row = source->chromaPlane + y * width;
+        for (size_t x = 0; x < width / 2; x++) {
+            row[2 * x] = (uint8_t)(64 + ((x >> 2) & 127));
+            row[2 * x + 1] = (uint8_t)(192 - ((y >> 2) & 127));
+        }
+    }
+}
+
+#pragma mark - init
+
+PBJSyntheticCaptureSource *PBJSyntheticCaptureSourceCreate(const PBJSyntheticCaptureSourceConfiguration *configuration,
+                                                           const PBJSyntheticCaptureEvent *events, size_t eventCount)
+{
+    if (!configuration || configuration->width < 2 || configuration->height < 2 ||
+        (configuration->width & 1) || (configuration->height & 1) || configuration->frameRate <= 0)
+        return NULL;
+
+    PBJSyntheticCaptureSource *source = (PBJSyntheticCaptureSource *)calloc(1, sizeof(PBJSyntheticCaptureSource));
+    if (!source)
+        return NULL;
+
+    source->configuration = *configuration;
+    source->random = configuration->seed ? configuration->seed : 1;
+    source->lastArrival = INT64_MIN;
+    source->stallBegin = source->stallEnd = INT64_MIN;
+    source->skipUntil = INT64_MIN;
+
+    if (eventCount > 0 && events) {
+        source->events = (PBJSyntheticCaptureEvent *)malloc(eventCount * sizeof(PBJSyntheticCaptureEvent));
+        if (!source->events)
+            goto fail;
+        memcpy(source->events, events, eventCount * sizeof(PBJSyntheticCaptureEvent));
+        qsort(source->events, eventCount, sizeof(PBJSyntheticCaptureEvent), PBJSyntheticCompareEvents);
+        source->eventCount = eventCount;
+    }
+
+    size_t width = configuration->width;
+    size_t height = configuration->height;
+    source->planeBytesPerRow = configuration->videoPath ? width : width + PBJ_SYNTHETIC_PATTERN_PERIOD;
+    source->lumaPlane = (uint8_t *)malloc(source->planeBytesPerRow * height);
+    source->chromaPlane = (uint8_t *)malloc(source->planeBytesPerRow * (height / 2));
+    if (!source->lumaPlane || !source->chromaPlane)
+        goto fail;
+
+    source->frame.lumaBytesPerRow = source->planeBytesPerRow;
+    source->frame.chromaBytesPerRow = source->planeBytesPerRow;
+    source->frame.width = width;
+    source->frame.height = height;
+    source->frame.range = PBJYCbCrRangeVideo;
+    source->frame.luma = source->lumaPlane;
+    source->frame.chroma = source->chromaPlane;
+
+    if (configuration->videoPath) {
+        source->videoFile = fopen(configuration->videoPath, "rb");
+        if (!source->videoFile)
+            goto fail;
+    } else {
+        PBJSyntheticGeneratePattern(source);
+    }
+
+    if (PBJSyntheticHasAudio(source)) {
+        size_t sampleCount = (size_t)configuration->audioFramesPerBuffer * (size_t)configuration->audioChannels;
+        source->audioSamples = (int16_t *)malloc(sampleCount * sizeof(int16_t));
+        if (!source->audioSamples)
+            goto fail;
+        if (configuration->audioPath) {
+            source->audioFile = fopen(configuration->audioPath, "rb");
+            if (!source->audioFile)
+                goto fail;
+        }
+        source->audioBuffer.samples = source->audioSamples;
+        source->audioBuffer.frameCount = (size_t)configuration->audioFramesPerBuffer;
+        source->audioBuffer.channels = configuration->audioChannels;
+        source->audioBuffer.sampleRate = configuration->audioSampleRate;
+    }
+
+    return source;
+
+fail:
+    PBJSyntheticCaptureSourceDestroy(source);
+    return NULL;
+}
+
+void PBJSyntheticCaptureSourceDestroy(PBJSyntheticCaptureSource *source)
+{
+    if (!source)
+        return;
+    if (source->videoFile)
+        fclose(source->videoFile);
+    if (source->audioFile)
+        fclose(source->audioFile);
+    free(source->events);
+    free(source->lumaPlane);
+    free(source->chromaPlane);
+    free(source->audioSamples);
+    free(source);
+}
+
+#pragma mark - payloads
+
+static int PBJSyntheticPrepareFrame(PBJSyntheticCaptureSource *source, uint64_t index)
+{
+    if (!source->videoFile) {
+        size_t offset = (size_t)((index * 2) % PBJ_SYNTHETIC_PATTERN_PERIOD);
+        source->frame.luma = source->lumaPlane + offset;
+        source->frame.chroma = source->chromaPlane + offset;
+        return 1;
+    }
+
+    size_t width = source->configuration.width;
+    size_t height = source->configuration.height;
+    return PBJSyntheticReadLooping(source->videoFile, source->lumaPlane, width * height) &&
+           PBJSyntheticReadLooping(source->videoFile, source->chromaPlane, width * (height / 2));
+}
+
+static int PBJSyntheticPrepareAudio(PBJSyntheticCaptureSource *source)
+{
+    size_t frameCount = (size_t)source->configuration.audioFramesPerBuffer;
+    size_t channels = (size_t)source->configuration.audioChannels;
+
+    if (source->audioFile)
+        return PBJSyntheticReadLooping(source->audioFile, source->audioSamples, frameCount * channels * sizeof(int16_t));
+
+    double step = 2.0 * 3.14159265358979323846 * PBJ_SYNTHETIC_TONE_FREQUENCY / (double)source->configuration.audioSampleRate;
+    for (size_t frame = 0; frame < frameCount; frame++) {
+        int16_t value = (int16_t)(sin(source->tonePhase) * 8192.0);
+        for (size_t channel = 0; channel < channels; channel++) {
+            source->audioSamples[frame * channels + channel] = value;
+        }
+        source->tonePhase += step;
+    }
+    source->tonePhase = fmod(source->tonePhase, 2.0 * 3.14159265358979323846);
+    return 1;
+}
+
+#pragma mark - items
+
+static int64_t PBJSyntheticArrival(PBJSyntheticCaptureSource *source, int64_t presentationTime)
+{
+    int64_t arrival = presentationTime + source->configuration.deliveryLatency;
+    if (source->configuration.jitter > 0) {
+        arrival += (int64_t)(PBJSyntheticNextRandom(source) % (uint64_t)(source->configuration.jitter + 1));
+    }
+    if (presentationTime >= source->stallBegin && presentationTime < source->stallEnd && arrival < source->stallEnd) {
+        arrival = source->stallEnd;
+    }
+    // a single delivery queue, nothing overtakes
+    if (arrival < source->lastArrival) {
+        arrival = source->lastArrival;
+    }
+    source->lastArrival = arrival;
+    return arrival;
+}
+
+int PBJSyntheticCaptureSourceNextItem(PBJSyntheticCaptureSource *source, PBJCaptureSourceItem *item)
+{
+    if (source->ended)
+        return 0;
+
+    int hasAudio = PBJSyntheticHasAudio(source);
+    int64_t end = PBJ_SYNTHETIC_CLOCK_ORIGIN + source->configuration.duration;
+
+    for (;;) {
+        // nothing is captured while interrupted
+        while (PBJSyntheticVideoTime(source, source->videoIndex) < source->skipUntil)
+            source->videoIndex++;
+        while (hasAudio && PBJSyntheticAudioTime(source, source->audioIndex) < source->skipUntil)
+            source->audioIndex++;
+
+        int64_t videoTime = PBJSyntheticVideoTime(source, source->videoIndex);
+        int64_t audioTime = hasAudio ? PBJSyntheticAudioTime(source, source->audioIndex) : INT64_MAX;
+        int isVideo = videoTime <= audioTime;
+        int64_t time = isVideo ? videoTime : audioTime;
+
+        if (source->nextEvent < source->eventCount &&
+            PBJ_SYNTHETIC_CLOCK_ORIGIN + source->events[source->nextEvent].time <= time) {
+            const PBJSyntheticCaptureEvent *event = &source->events[source->nextEvent++];
+            int64_t eventTime = PBJ_SYNTHETIC_CLOCK_ORIGIN + event->time;
+
+            memset(item, 0, sizeof(*item));
+            item->arrivalTime = eventTime > source->lastArrival ? eventTime : source->lastArrival;
+            switch (event->type) {
+                case PBJSyntheticCaptureEventPause:
+                    item->type = PBJCaptureSourceItemPause;
+                    return 1;
+                case PBJSyntheticCaptureEventResume:
+                    item->type = PBJCaptureSourceItemResume;
+                    return 1;
+                case PBJSyntheticCaptureEventInterrupt:
+                    source->skipUntil = eventTime + event->duration;
+                    item->type = PBJCaptureSourceItemInterrupt;
+                    return 1;
+                case PBJSyntheticCaptureEventStall:
+                    source->stallBegin = eventTime;
+                    source->stallEnd = eventTime + event->duration;
+                    continue;
+            }
+            continue;
+        }
+
+        if (time >= end) {
+            memset(item, 0, sizeof(*item));
+            item->type = PBJCaptureSourceItemEnd;
+            item->arrivalTime = end > source->lastArrival ? end : source->lastArrival;
+            source->ended = 1;
+            return 1;
+        }
+
+        if (isVideo) {
+            uint64_t index = source->videoIndex++;
+
+            // only the most recent frame survives a blocked delivery queue
+            if (videoTime >= source->stallBegin && PBJSyntheticVideoTime(source, source->videoIndex) < source->stallEnd) {
+                source->counters.videoFramesDiscarded++;
+                continue;
+            }
+            if (!PBJSyntheticPrepareFrame(source, index))
+                return 0;
+
+            item->type = PBJCaptureSourceItemSample;
+            item->arrivalTime = PBJSyntheticArrival(source, videoTime);
+            item->sample.track = PBJCaptureTrackVideo;
+            item->sample.presentationTimestamp = PBJTimeMake(videoTime, PBJ_SYNTHETIC_NANOSECONDS);
+            item->sample.duration = PBJTimeMake(0, 0);
+            item->sample.payload = &source->frame;
+            source->counters.videoFrames++;
+            return 1;
+        }
+
+        source->audioIndex++;
+        if (!PBJSyntheticPrepareAudio(source))
+            return 0;
+
+        item->type = PBJCaptureSourceItemSample;
+        item->arrivalTime = PBJSyntheticArrival(source, audioTime);
+        item->sample.track = PBJCaptureTrackAudio;
+        // in the sample rate's timescale, so consecutive buffers abut exactly
+        int64_t sampleRate = source->configuration.audioSampleRate;
+        int64_t frameIndex = (int64_t)(source->audioIndex - 1) * source->configuration.audioFramesPerBuffer;
+        item->sample.presentationTimestamp = PBJTimeMake((PBJ_SYNTHETIC_CLOCK_ORIGIN / PBJ_SYNTHETIC_NANOSECONDS) * sampleRate + frameIndex, sampleRate);
+        item->sample.duration = PBJTimeMake(source->configuration.audioFramesPerBuffer, source->configuration.audioSampleRate);
+        item->sample.payload = &source->audioBuffer;
+        source->counters.audioBuffers++;
+        return 1;
+    }
+}
+
+static int PBJSyntheticCaptureSourceNextItemThunk(void *context, PBJCaptureSourceItem *item)
+{
+    return PBJSyntheticCaptureSourceNextItem((PBJSyntheticCaptureSource *)context, item);
+}
+
+PBJCaptureSource PBJSyntheticCaptureSourceGetSource(PBJSyntheticCaptureSource *source)
+{
+    PBJCaptureSource captureSource = { source, PBJSyntheticCaptureSourceNextItemThunk };
+    return captureSource;
+}
+
+PBJSyntheticCaptureSourceCounters PBJSyntheticCaptureSourceGetCounters(const PBJSyntheticCaptureSource *source)
+{
+    return source->counters;
+}
@@ -0,0 +1,104 @@
+//
+//  PBJSyntheticCaptureSource.h
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef PBJSyntheticCaptureSource_h
+#define PBJSyntheticCaptureSource_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "PBJCapturePipeline.h"
+#include "PBJPlanarImage.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// a deterministic stand-in for the camera and microphone, for driving PBJCapturePipeline
+// without a device (simulator, headless hosts). frames and audio are read from raw files
+// or generated, delivery follows a script of pauses, interruptions and stalls. all times
+// are nanoseconds, presentation timestamps start at a host clock like origin
+
+typedef struct {
+    size_t width; // even
+    size_t height; // even
+    int32_t frameRate;
+    int32_t audioSampleRate; // 0 disables audio
+    int32_t audioChannels;
+    int32_t audioFramesPerBuffer;
+    const char *videoPath; // raw NV12 frames (luma plane then interleaved CbCr), looped, NULL generates
+    const char *audioPath; // interleaved signed 16-bit PCM, looped, NULL generates a tone
+    int64_t duration; // of source time to produce
+    int64_t deliveryLatency; // presentation to arrival
+    int64_t jitter; // uniform extra delivery delay in [0, jitter]
+    uint32_t seed;
+} PBJSyntheticCaptureSourceConfiguration;
+
+// 44.1kHz mono audio in 1024 frame buffers, 10 seconds, one frame of latency, no jitter
+PBJSyntheticCaptureSourceConfiguration PBJSyntheticCaptureSourceDefaultConfiguration(size_t width, size_t height, int32_t frameRate);
+
+typedef enum {
+    PBJSyntheticCaptureEventPause = 0,
+    PBJSyntheticCaptureEventResume,
+    PBJSyntheticCaptureEventInterrupt, // capture stops for the duration
+    PBJSyntheticCaptureEventStall // delivery blocks for the duration, late video frames are discarded
+} PBJSyntheticCaptureEventType;
+
+typedef struct {
+    PBJSyntheticCaptureEventType type;
+    int64_t time; // from the start of the source
+    int64_t duration; // interruptions and stalls
+} PBJSyntheticCaptureEvent;
+
+// audio sample payload, video sample payloads are PBJNV12Image
+typedef struct {
+    const int16_t *samples; // interleaved
+    size_t frameCount;
+    int32_t channels;
+    int32_t sampleRate;
+} PBJSyntheticAudioBuffer;
+
+typedef struct {
+    uint64_t videoFrames;
+    uint64_t videoFramesDiscarded; // late during a stall
+    uint64_t audioBuffers;
+} PBJSyntheticCaptureSourceCounters;
+
+typedef struct PBJSyntheticCaptureSource PBJSyntheticCaptureSource;
+
+// events need not be sorted, returns NULL if a file cannot be read
+PBJSyntheticCaptureSource *PBJSyntheticCaptureSourceCreate(const PBJSyntheticCaptureSourceConfiguration *configuration,
+                                                           const PBJSyntheticCaptureEvent *events, size_t eventCount);
+void PBJSyntheticCaptureSourceDestroy(PBJSyntheticCaptureSource *source);
+
+int PBJSyntheticCaptureSourceNextItem(PBJSyntheticCaptureSource *source, PBJCaptureSourceItem *item);
+PBJCaptureSource PBJSyntheticCaptureSourceGetSource(PBJSyntheticCaptureSource *source);
+
+PBJSyntheticCaptureSourceCounters PBJSyntheticCaptureSourceGetCounters(const PBJSyntheticCaptureSource *source);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PBJSyntheticCaptureSource_h */
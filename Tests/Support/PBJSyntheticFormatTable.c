@@ -0,0 +1,117 @@
+//
+//  PBJSyntheticFormatTable.c
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#include "PBJSyntheticFormatTable.h"
+
+typedef struct {
+    int32_t width;
+    int32_t height;
+    double maxFrameRate; // highest unbinned range
+    int highSpeed; // adds binned 120 and 240 ranges
+} PBJSyntheticFormatSize;
+
+static const PBJSyntheticFormatSize PBJSyntheticFormatSizes[] = {
+    { 192, 144, 30.0, 0 },
+    { 352, 288, 30.0, 0 },
+    { 480, 360, 30.0, 0 },
+    { 640, 480, 30.0, 0 },
+    { 960, 540, 30.0, 0 },
+    { 1024, 768, 30.0, 0 },
+    { 1280, 720, 60.0, 1 },
+    { 1440, 1080, 30.0, 0 },
+    { 1920, 1080, 60.0, 1 },
+    { 1920, 1440, 30.0, 0 },
+    { 3088, 2316, 30.0, 0 },
+    { 3840, 2160, 60.0, 0 },
+    { 4032, 3024, 30.0, 0 },
+};
+
+static uint64_t PBJSyntheticFormatRandom(uint64_t *state)
+{
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+static size_t PBJSyntheticFormatAppend(PBJFormatDescriptor *descriptors, size_t capacity, size_t count, uint32_t format,
+                                       int32_t width, int32_t height, uint32_t pixelFormat, double minFrameRate,
+                                       double maxFrameRate, float fieldOfView, float maxZoomFactor, int binned)
+{
+    if (count == capacity)
+        return count;
+    PBJFormatDescriptor *descriptor = &descriptors[count];
+    descriptor->format = format;
+    descriptor->width = width;
+    descriptor->height = height;
+    descriptor->pixelFormat = pixelFormat;
+    descriptor->minFrameRate = minFrameRate;
+    descriptor->maxFrameRate = maxFrameRate;
+    descriptor->fieldOfView = fieldOfView;
+    descriptor->maxZoomFactor = maxZoomFactor;
+    descriptor->binned = binned;
+    return count + 1;
+}
+
+size_t PBJSyntheticFormatTableFill(PBJFormatDescriptor *descriptors, size_t capacity, uint32_t scale, uint64_t seed)
+{
+    static const uint32_t pixelFormats[] = { PBJSyntheticFormatPixelFormatVideoRange, PBJSyntheticFormatPixelFormatFullRange };
+    uint64_t state = seed * 0x9e3779b97f4a7c15ull + 1;
+    size_t sizeCount = sizeof(PBJSyntheticFormatSizes) / sizeof(PBJSyntheticFormatSizes[0]);
+    size_t count = 0;
+    uint32_t format = 0;
+
+    for (uint32_t repeat = 0; repeat < (scale ? scale : 1); repeat++) {
+        for (size_t s = 0; s < sizeCount; s++) {
+            const PBJSyntheticFormatSize *size = &PBJSyntheticFormatSizes[s];
+            // later repeats nudge the size so the table doesn't collapse onto the same areas
+            int32_t width = size->width + (repeat ? (int32_t)(PBJSyntheticFormatRandom(&state) % 8) * 16 : 0);
+            int32_t height = size->height + (repeat ? (int32_t)(PBJSyntheticFormatRandom(&state) % 8) * 8 : 0);
+            float fieldOfView = 58.0f + (float)(PBJSyntheticFormatRandom(&state) % 160) / 10.0f;
+            float maxZoomFactor = (float)(16 + PBJSyntheticFormatRandom(&state) % 3 * 56);
+            for (size_t p = 0; p < sizeof(pixelFormats) / sizeof(pixelFormats[0]); p++) {
+                // a format may list several ranges, as 4K at 24-30 and 1-60 does
+                count = PBJSyntheticFormatAppend(descriptors, capacity, count, format, width, height, pixelFormats[p],
+                                                 1.0, size->maxFrameRate, fieldOfView, maxZoomFactor, 0);
+                if (size->maxFrameRate > 30.0 && PBJSyntheticFormatRandom(&state) % 2)
+                    count = PBJSyntheticFormatAppend(descriptors, capacity, count, format, width, height, pixelFormats[p],
+                                                     24.0, 30.0, fieldOfView, maxZoomFactor, 0);
+                format++;
+            }
+            if (size->highSpeed) {
+                count = PBJSyntheticFormatAppend(descriptors, capacity, count, format++, width, height,
+                                                 PBJSyntheticFormatPixelFormatVideoRange, 1.0, 120.0, fieldOfView * 0.9f, maxZoomFactor, 1);
+                count = PBJSyntheticFormatAppend(descriptors, capacity, count, format++, width, height,
+                                                 PBJSyntheticFormatPixelFormatVideoRange, 1.0, 240.0, fieldOfView * 0.8f, maxZoomFactor, 1);
+            }
+            if (size->width >= 1920 && PBJSyntheticFormatRandom(&state) % 2)
+                count = PBJSyntheticFormatAppend(descriptors, capacity, count, format++, width, height,
+                                                 PBJSyntheticFormatPixelFormatTenBit, 1.0, 30.0, fieldOfView, maxZoomFactor, 0);
+        }
+    }
+    return count;
+}
@@ -0,0 +1,54 @@
+//
+//  PBJSyntheticFormatTable.h
+//  PBJVision
+//
+//  Copyright (c) 2013-present, Patrick Piemonte, http://patrickpiemonte.com
+//
+//  Permission is hereby granted, free of charge, to any person obtaining a copy of
+//  this software and associated documentation files (the "Software"), to deal in
+//  the Software without restriction, including without limitation the rights to
+//  use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+//  the Software, and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be included in all
+//  copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+//  FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+//  COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+//  IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+//  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#ifndef PBJSyntheticFormatTable_h
+#define PBJSyntheticFormatTable_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "PBJFormatIndex.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// device format tables shaped like a camera's: every size in 420v and 420f, several frame
+// rate ranges per format, binned high speed variants and a few fields of view and zoom ranges,
+// for exercising PBJFormatIndex without a device. scale repeats the size ladder with jittered
+// dimensions for larger tables
+
+#define PBJSyntheticFormatPixelFormatVideoRange 0x34323076u // '420v'
+#define PBJSyntheticFormatPixelFormatFullRange 0x34323066u // '420f'
+#define PBJSyntheticFormatPixelFormatTenBit 0x78343230u // 'x420'
+
+// descriptors written, at most capacity, formats are numbered in list order
+size_t PBJSyntheticFormatTableFill(PBJFormatDescriptor *descriptors, size_t capacity, uint32_t scale, uint64_t seed);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PBJSyntheticFormatTable_h */